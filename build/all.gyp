@@ -57,6 +57,7 @@
         '../net/instaweb/instaweb_apr.gyp:*',
         '../net/instaweb/test.gyp:mod_pagespeed_test',
         '../net/instaweb/test.gyp:mod_pagespeed_speed_test',
+        '../net/instaweb/test.gyp:proxy_load_test',
         'install.gyp:*',
         '<(DEPTH)/pagespeed/kernel.gyp:redis_cache_cluster_setup',
       ]
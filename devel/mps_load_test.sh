@@ -19,6 +19,10 @@
 # we don't currently have a script or instructions on how to do this.
 # TODO(jefftk): resolve this
 #
+# For a self-contained, in-process measurement that needs no corpus, see
+# out/Release/proxy_load_test (pagespeed/automatic/proxy_load_test_main.cc),
+# which generates a synthetic site and drives it through ProxyInterface.
+#
 # This script runs a mod_pagespeed load-test.  The typical
 # configuration is to run this on your development workstation and
 # mps_generate_load.sh will be run (via ssh) on a different machine
@@ -271,7 +271,8 @@ class CacheFindCallback : public HTTPCache::Callback {
         proactively_freshen_user_facing_request_(
             owner->proactively_freshen_user_facing_request()),
         serve_stale_while_revalidate_threshold_sec_(
-            owner->serve_stale_while_revalidate_threshold_sec()) {
+            owner->serve_stale_while_revalidate_threshold_sec()),
+        streamed_(false) {
     // Note that this is a cache lookup: there are no request-headers.  At
     // this level, we have already made a policy decision that any Vary
     // headers present will be ignored.  See
@@ -293,13 +294,18 @@ class CacheFindCallback : public HTTPCache::Callback {
     switch (find_result.status) {
       case HTTPCache::kFound: {
         VLOG(1) << "Found in cache: " << url_ << " (" << fragment_ << ")";
-        http_value()->ExtractHeaders(response_headers(), handler_);
+        if (!streamed_) {
+          http_value()->ExtractHeaders(response_headers(), handler_);
+        }
 
         bool is_imminently_expiring = false;
 
-        // Respond with a 304 if the If-Modified-Since / If-None-Match values
-        // are equal to those in the request.
-        if (ShouldReturn304()) {
+        if (streamed_) {
+          // HTTPCache::FindAndStream has already sent the headers and body.
+          is_imminently_expiring = IsImminentlyExpiring(*response_headers());
+        } else if (ShouldReturn304()) {
+          // Respond with a 304 if the If-Modified-Since / If-None-Match values
+          // are equal to those in the request.
           response_headers()->Clear();
           response_headers()->SetStatusAndReason(HttpStatus::kNotModified);
           response_headers()->ComputeCaching();
@@ -365,7 +371,11 @@ class CacheFindCallback : public HTTPCache::Callback {
       case HTTPCache::kNotFound: {
         VLOG(1) << "Did not find in cache: "
                 << url_ << " (" << fragment_ << ")";
-        if (fetcher_ == NULL) {
+        if (streamed_ && base_fetch_->headers_complete()) {
+          // A chunk went missing part way through FindAndStream; the
+          // response is already under way and can only be cut short.
+          base_fetch_->Done(false);
+        } else if (fetcher_ == NULL) {
           // Set status code to indicate reason we failed Fetch.
           DCHECK(!base_fetch_->headers_complete());
           base_fetch_->response_headers()->set_status_code(
@@ -421,6 +431,10 @@ class CacheFindCallback : public HTTPCache::Callback {
     response_sequence_ = sequence;
   }
 
+  // Records that the lookup is being made with HTTPCache::FindAndStream,
+  // which writes a hit straight to base_fetch_.
+  void set_streamed(bool x) { streamed_ = x; }
+
  private:
   bool ServedStaleContentWhileRevalidate(AsyncFetch* base_fetch) {
     if (serve_stale_while_revalidate_threshold_sec_ == 0 ||
@@ -576,6 +590,7 @@ class CacheFindCallback : public HTTPCache::Callback {
   bool proactively_freshen_user_facing_request_;
   int64 serve_stale_while_revalidate_threshold_sec_;
   Sequence* response_sequence_;
+  bool streamed_;
 
   DISALLOW_COPY_AND_ASSIGN(CacheFindCallback);
 };
@@ -639,7 +654,15 @@ void CacheUrlAsyncFetcher::Fetch(
                 async_op_hooks_,
                 handler);
         find_callback->set_response_sequence(response_sequence_);
-        http_cache_->Find(url, fragment_, handler, find_callback);
+        int64 range_first, range_last;
+        if (ShouldStream(*base_fetch->request_headers(), &range_first,
+                         &range_last)) {
+          find_callback->set_streamed(true);
+          http_cache_->FindAndStream(url, fragment_, range_first, range_last,
+                                     handler, find_callback, base_fetch);
+        } else {
+          http_cache_->Find(url, fragment_, handler, find_callback);
+        }
       }
       return;
 
@@ -662,6 +685,43 @@ void CacheUrlAsyncFetcher::Fetch(
   }
 }
 
+bool CacheUrlAsyncFetcher::ShouldStream(const RequestHeaders& request_headers,
+                                        int64* range_first,
+                                        int64* range_last) const {
+  // Streaming only pays off for chunked entries.  It is skipped when the
+  // response must be delivered on response_sequence_, as the chunks are
+  // written from cache threads, and for requests that may be answered with
+  // a 304, which needs the headers before anything is sent.
+  if (http_cache_->chunk_size() <= 0 || response_sequence_ != NULL ||
+      request_headers.method() != RequestHeaders::kGet ||
+      request_headers.Has(HttpAttributes::kIfModifiedSince) ||
+      request_headers.Has(HttpAttributes::kIfNoneMatch)) {
+    return false;
+  }
+  *range_first = -1;
+  *range_last = -1;
+  // Only a single range, "bytes=first-" or "bytes=first-last", is served as
+  // such.  Anything else, or a conditional range, gets the whole body,
+  // which HTTP permits.
+  const char* range = request_headers.Lookup1(HttpAttributes::kRange);
+  StringPiece spec(range == NULL ? "" : range);
+  if (!request_headers.Has(HttpAttributes::kIfRange) &&
+      StringCaseStartsWith(spec, "bytes=")) {
+    spec.remove_prefix(STATIC_STRLEN("bytes="));
+    StringPieceVector bounds;
+    SplitStringPieceToVector(spec, "-", &bounds, false);
+    int64 first, last = -1;
+    if (bounds.size() == 2 && StringToInt64(bounds[0], &first) &&
+        first >= 0 &&
+        (bounds[1].empty() ||
+         (StringToInt64(bounds[1], &last) && last >= first))) {
+      *range_first = first;
+      *range_last = last;
+    }
+  }
+  return true;
+}
+
 CacheUrlAsyncFetcher::AsyncOpHooks::~AsyncOpHooks() {
 }
 
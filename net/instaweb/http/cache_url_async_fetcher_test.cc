@@ -1394,6 +1394,45 @@ TEST_F(CacheUrlAsyncFetcherTest, CacheNonEmpty) {
                    original_contents, kBackendFetch, true);
 }
 
+TEST_F(CacheUrlAsyncFetcherTest, ChunkedHitStreamsRange) {
+  const char url[] = "http://www.example.com/chunked.jpg";
+  const char kContents[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_chunk_size(10);
+  ResponseHeaders response_headers;
+  SetDefaultHeaders(kContentTypeJpeg, &response_headers);
+  response_headers.SetDateAndCaching(timer_.NowMs(), ttl_ms_);
+  mock_fetcher_.SetResponse(url, response_headers, kContents);
+  FetchAndValidate(url, empty_request_headers_, true, HttpStatus::kOK,
+                   kContents, kBackendFetch, true);
+  EXPECT_EQ(1, counting_fetcher_.fetch_count());
+
+  // A hit on the chunked entry is streamed, whole or in part.
+  ClearStats();
+  FetchAndValidate(url, empty_request_headers_, true, HttpStatus::kOK,
+                   kContents, kBackendFetch, true);
+  RequestHeaders range_headers;
+  range_headers.Add(HttpAttributes::kRange, "bytes=8-21");
+  FetchAndValidate(url, range_headers, true, HttpStatus::kPartialContent,
+                   "89abcdefghijAB", kBackendFetch, true);
+  EXPECT_EQ(2, http_cache_->cache_hits()->Get());
+  EXPECT_EQ(0, counting_fetcher_.fetch_count());
+
+  // A range we don't handle gets the whole body.
+  range_headers.Replace(HttpAttributes::kRange, "bytes=-5");
+  FetchAndValidate(url, range_headers, true, HttpStatus::kOK,
+                   kContents, kBackendFetch, true);
+
+  // A chunk lost after the headers went out cuts the response short rather
+  // than refetching it.
+  ClearStats();
+  lru_cache_.Delete(HTTPCache::ChunkKey(
+      http_cache_->CompositeKey(url, fragment_), mock_hasher_.Hash(kContents),
+      1));
+  FetchAndValidate(url, empty_request_headers_, false, HttpStatus::kOK,
+                   "0123456789", kBackendFetch, true);
+  EXPECT_EQ(0, counting_fetcher_.fetch_count());
+}
+
 TEST_F(CacheUrlAsyncFetcherTest, NoCacheHtmlOnEmptyHeader) {
   ResponseHeaders response_headers;
   SetDefaultHeaders(kContentTypeHtml, &response_headers);
@@ -21,15 +21,20 @@
 #include "net/instaweb/http/public/http_cache.h"
 
 #include <algorithm>
+#include <vector>
 
 #include "base/logging.h"
+#include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/http_cache_failure.h"
 #include "net/instaweb/http/public/http_value.h"
 #include "net/instaweb/http/public/inflating_fetch.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -54,6 +59,57 @@ const int kHttpCacheVersion = 3;
 // limit.
 const int64 kCacheSizeUnlimited = -1;
 
+// Parses the HTTPCache::kChunkedBodyHeader value written by PutChunked:
+// "<chunk size>,<body size>,<body hash>".
+bool ParseChunkedBodyHeader(const ResponseHeaders& headers, int64* chunk_size,
+                            int64* body_size, GoogleString* id) {
+  const char* value = headers.Lookup1(HTTPCache::kChunkedBodyHeader);
+  if (value == NULL) {
+    return false;
+  }
+  StringPieceVector fields;
+  SplitStringPieceToVector(value, ",", &fields, true);
+  if (fields.size() != 3 ||
+      !StringToInt64(fields[0], chunk_size) || (*chunk_size <= 0) ||
+      !StringToInt64(fields[1], body_size) || (*body_size < 0)) {
+    return false;
+  }
+  fields[2].CopyToString(id);
+  return true;
+}
+
+// Deletes an entry once its value has been read, along with its chunks if
+// it is a manifest written by PutChunked.
+class DeleteEntryCallback : public CacheInterface::Callback {
+ public:
+  DeleteEntryCallback(CacheInterface* cache, const GoogleString& key)
+      : cache_(cache), key_(key) {}
+
+  virtual void Done(CacheInterface::KeyState state) {
+    HTTPValue value;
+    ResponseHeaders headers;
+    int64 chunk_size, body_size;
+    GoogleString id;
+    if ((state == CacheInterface::kAvailable) &&
+        value.Link(this->value(), &headers, &handler_) &&
+        ParseChunkedBodyHeader(headers, &chunk_size, &body_size, &id)) {
+      for (int64 i = 0, start = 0; start < body_size;
+           ++i, start += chunk_size) {
+        cache_->Delete(HTTPCache::ChunkKey(key_, id, i));
+      }
+    }
+    cache_->Delete(key_);
+    delete this;
+  }
+
+ private:
+  CacheInterface* cache_;
+  GoogleString key_;
+  NullMessageHandler handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeleteEntryCallback);
+};
+
 }  // namespace
 
 const char HTTPCache::kCacheTimeUs[] = "cache_time_us";
@@ -69,6 +125,8 @@ const char HTTPCache::kCacheDeletes[] = "cache_deletes";
 // This used for doing prefix match for etag in fetcher code.
 const char HTTPCache::kEtagPrefix[] = "W/\"PSA-";
 
+const char HTTPCache::kChunkedBodyHeader[] = "X-PSA-Chunked-Body";
+
 HTTPCache::HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
                      Statistics* stats)
     : cache_(cache),
@@ -78,6 +136,8 @@ HTTPCache::HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
       disable_html_caching_on_https_(false),
       cache_levels_(1),
       compression_level_(0),
+      parallel_gzip_(NULL),
+      chunk_size_(0),
       cache_time_us_(stats->GetVariable(kCacheTimeUs)),
       cache_hits_(stats->GetVariable(kCacheHits)),
       cache_misses_(stats->GetVariable(kCacheMisses)),
@@ -89,6 +149,7 @@ HTTPCache::HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
       cache_deletes_(stats->GetVariable(kCacheDeletes)),
       name_(FormatName(cache->Name())) {
   max_cacheable_response_content_length_ = kCacheSizeUnlimited;
+  max_cacheable_chunked_content_length_ = kCacheSizeUnlimited;
   SetVersion(kHttpCacheVersion);
 }
 
@@ -133,11 +194,28 @@ class HTTPCacheCallback : public CacheInterface::Callback {
         callback_(callback),
         http_cache_(http_cache),
         result_(HTTPCache::kNotFound, kFetchStatusNotSet),
-        cache_level_(0) {
+        cache_level_(0),
+        chunked_(false),
+        chunk_size_(0),
+        body_size_(0),
+        stream_fetch_(NULL),
+        range_first_(-1),
+        range_last_(-1),
+        range_end_(0),
+        next_chunk_(0),
+        stream_chunk_available_(false) {
     start_us_ = http_cache_->timer()->NowUs();
     start_ms_ = start_us_ / 1000;
   }
 
+  // Makes a hit write its response to 'fetch' rather than leaving the body
+  // in the callback's HTTPValue.  See HTTPCache::FindAndStream.
+  void set_stream(AsyncFetch* fetch, int64 range_first, int64 range_last) {
+    stream_fetch_ = fetch;
+    range_first_ = range_first;
+    range_last_ = range_last;
+  }
+
   virtual bool ValidateCandidate(const GoogleString& key,
                                  CacheInterface::KeyState backend_state) {
     ++cache_level_;
@@ -145,6 +223,7 @@ class HTTPCacheCallback : public CacheInterface::Callback {
     int64 now_ms = now_us / 1000;
     ResponseHeaders* headers = callback_->response_headers();
     bool is_expired = false;
+    chunked_ = false;
     if ((backend_state == CacheInterface::kAvailable) &&
         callback_->http_value()->Link(value(), headers, handler_) &&
         (http_cache_->force_caching_ ||
@@ -165,6 +244,13 @@ class HTTPCacheCallback : public CacheInterface::Callback {
         // Once the caches are all clean, the Sanitize call will be a
         // relatively fast check.
         !headers->Sanitize()) {
+      // A chunked entry holds only the headers; its body is read in Done.
+      if (headers->Has(HTTPCache::kChunkedBodyHeader)) {
+        chunked_ = ParseChunkedBodyHeader(*headers, &chunk_size_, &body_size_,
+                                          &chunk_id_);
+        headers->RemoveAll(HTTPCache::kChunkedBodyHeader);
+        headers->ComputeCaching();
+      }
       // While stale responses can potentially be used in case of fetch
       // failures, responses invalidated via a cache flush should never be
       // returned under any scenario.
@@ -227,10 +313,13 @@ class HTTPCacheCallback : public CacheInterface::Callback {
             callback_->http_value()->SetHeaders(headers);
           }
         } else {
-          if (http_cache_->force_caching_ ||
-              headers->IsProxyCacheable(callback_->req_properties(),
+          // The body of a chunked entry is not at hand, so it can't serve
+          // as a fallback.
+          if (!chunked_ &&
+              (http_cache_->force_caching_ ||
+               headers->IsProxyCacheable(callback_->req_properties(),
                                         callback_->RespectVaryOnResources(),
-                                        ResponseHeaders::kHasValidator)) {
+                                        ResponseHeaders::kHasValidator))) {
             ResponseHeaders fallback_headers;
             if (callback_->request_context()->accepts_gzip() ||
                 !callback_->http_value()->ExtractHeaders(&fallback_headers,
@@ -261,8 +350,8 @@ class HTTPCacheCallback : public CacheInterface::Callback {
     if (result_.status != HTTPCache::kFound) {
       headers->Clear();
       callback_->http_value()->Clear();
-    } else if (!callback_->request_context()->accepts_gzip() &&
-               headers->IsGzipped()) {
+    } else if (!chunked_ && NeedsInflate()) {
+      // Chunked bodies are inflated once they have been assembled.
       HTTPValue new_value;
       GoogleString inflated;
       if (InflatingFetch::UnGzipValueIfCompressed(
@@ -276,11 +365,262 @@ class HTTPCacheCallback : public CacheInterface::Callback {
   }
 
   virtual void Done(CacheInterface::KeyState backend_state) {
+    if (result_.status == HTTPCache::kFound) {
+      if (chunked_) {
+        if (stream_fetch_ != NULL && !NeedsInflate()) {
+          StreamChunks();
+        } else {
+          ReadAllChunks();
+        }
+        return;
+      }
+      if (stream_fetch_ != NULL) {
+        StreamValue();
+      }
+    }
+    Finish();
+  }
+
+ private:
+  class ChunkCallback : public CacheInterface::Callback {
+   public:
+    ChunkCallback(HTTPCacheCallback* parent, int64 index)
+        : parent_(parent), index_(index) {}
+
+    virtual void Done(CacheInterface::KeyState state) {
+      parent_->ChunkDone(index_, state == CacheInterface::kAvailable,
+                         value());
+      delete this;
+    }
+
+   private:
+    HTTPCacheCallback* parent_;
+    int64 index_;
+
+    DISALLOW_COPY_AND_ASSIGN(ChunkCallback);
+  };
+
+  bool NeedsInflate() {
+    return !callback_->request_context()->accepts_gzip() &&
+        callback_->response_headers()->IsGzipped();
+  }
+
+  int64 NumChunks() const {
+    return (body_size_ + chunk_size_ - 1) / chunk_size_;
+  }
+
+  // Chunk 'index' must be full-sized, except for the last.
+  bool IsValidChunk(int64 index, const SharedString& chunk) const {
+    int64 expected_size =
+        std::min(chunk_size_, body_size_ - index * chunk_size_);
+    return chunk.size() == expected_size;
+  }
+
+  GoogleString ChunkKey(int64 index) const {
+    return HTTPCache::ChunkKey(http_cache_->CompositeKey(key_, fragment_),
+                               chunk_id_, index);
+  }
+
+  void ChunkDone(int64 index, bool available, const SharedString& chunk) {
+    if (stream_fetch_ != NULL && !NeedsInflate()) {
+      StreamChunkDone(index, available, chunk);
+      return;
+    }
+    if (available && IsValidChunk(index, chunk)) {
+      chunks_[index] = chunk;
+    }
+    if (pending_chunks_.BarrierIncrement(-1) == 0) {
+      AssembleChunks();
+    }
+  }
+
+  // Fetches every chunk in one MultiGet and rebuilds the complete value.
+  void ReadAllChunks() {
+    int64 num_chunks = NumChunks();
+    if (num_chunks == 0) {
+      // Can't happen for bodies we chunked, but avoid an empty MultiGet.
+      chunks_.resize(1);
+      pending_chunks_.set_value(1);
+      ChunkDone(0, true, SharedString());
+      return;
+    }
+    chunks_.resize(num_chunks);
+    pending_chunks_.set_value(num_chunks);
+    CacheInterface::MultiGetRequest* request =
+        new CacheInterface::MultiGetRequest;
+    for (int64 i = 0; i < num_chunks; ++i) {
+      request->push_back(
+          CacheInterface::KeyCallback(ChunkKey(i), new ChunkCallback(this, i)));
+    }
+    http_cache_->cache_->MultiGet(request);
+  }
+
+  void AssembleChunks() {
+    ResponseHeaders* headers = callback_->response_headers();
+    HTTPValue* value = callback_->http_value();
+    value->Clear();
+    value->SetHeaders(headers);
+    for (int i = 0, n = chunks_.size(); i < n; ++i) {
+      if (chunks_[i].size() == 0 && body_size_ != 0) {
+        // Evicted, or overwritten by a different body.
+        Miss();
+        Finish();
+        return;
+      }
+      value->Write(chunks_[i].Value(), handler_);
+    }
+    chunks_.clear();
+    if (NeedsInflate()) {
+      HTTPValue new_value;
+      if (InflatingFetch::UnGzipValueIfCompressed(
+              *value, headers, &new_value, handler_)) {
+        value->Link(&new_value);
+      }
+    }
+    if (stream_fetch_ != NULL) {
+      StreamValue();
+    }
+    Finish();
+  }
+
+  // Sends the headers to stream_fetch_, applying the requested byte range
+  // to a body of body_size bytes.  Returns the range to write in
+  // [*first, *last], which is empty (*first > *last) if there is nothing.
+  void StartStream(int64 body_size, int64* first, int64* last) {
+    ResponseHeaders* out = stream_fetch_->response_headers();
+    if (out != callback_->response_headers()) {
+      out->CopyFrom(*callback_->response_headers());
+    }
+    *first = 0;
+    *last = body_size - 1;
+    if (range_first_ >= 0 && out->status_code() == HttpStatus::kOK) {
+      if (range_first_ >= body_size) {
+        out->SetStatusAndReason(HttpStatus::kRangeNotSatisfiable);
+        out->Replace(HttpAttributes::kContentRange,
+                     StrCat("bytes */", Integer64ToString(body_size)));
+        *last = -1;
+      } else {
+        *first = range_first_;
+        if (range_last_ >= range_first_ && range_last_ < body_size) {
+          *last = range_last_;
+        }
+        out->SetStatusAndReason(HttpStatus::kPartialContent);
+        out->Replace(HttpAttributes::kContentRange,
+                     StrCat("bytes ", Integer64ToString(*first), "-",
+                            Integer64ToString(*last), "/",
+                            Integer64ToString(body_size)));
+      }
+      out->SetContentLength(*last - *first + 1);
+    }
+    out->ComputeCaching();
+    stream_fetch_->set_content_length(*last - *first + 1);
+    stream_fetch_->HeadersComplete();
+  }
+
+  // Streams a body that is already in callback_->http_value().
+  void StreamValue() {
+    StringPiece contents;
+    callback_->http_value()->ExtractContents(&contents);
+    int64 first, last;
+    StartStream(contents.size(), &first, &last);
+    if (first <= last) {
+      stream_fetch_->Write(contents.substr(first, last - first + 1), handler_);
+    }
+  }
+
+  // Streams the chunks covering the requested range one at a time, so that
+  // only one chunk is in memory at once.
+  void StreamChunks() {
+    ResponseHeaders* headers = callback_->response_headers();
+    HTTPValue* value = callback_->http_value();
+    value->Clear();
+    value->SetHeaders(headers);
+    value->Write("", handler_);
+    int64 first, last;
+    StartStream(body_size_, &first, &last);
+    if (first > last) {
+      Finish();
+      return;
+    }
+    stream_first_ = first;
+    stream_last_ = last;
+    next_chunk_ = first / chunk_size_;
+    range_end_ = last / chunk_size_;
+    StreamNextChunks();
+  }
+
+  // Reads chunk next_chunk_ and those after it.  A cache that calls back
+  // synchronously would otherwise recurse once per chunk, so chunk_handoff_
+  // decides whether this loop or StreamChunkDone handles each result: it
+  // is set to 2 before the Get, and whichever of the two decrements it to
+  // zero goes on to write the chunk and issue the next Get.
+  void StreamNextChunks() {
+    do {
+      chunk_handoff_.set_value(2);
+      http_cache_->cache_->Get(ChunkKey(next_chunk_),
+                               new ChunkCallback(this, next_chunk_));
+      if (chunk_handoff_.BarrierIncrement(-1) != 0) {
+        return;  // StreamChunkDone will continue when the chunk arrives.
+      }
+    } while (WriteStreamedChunk());
+  }
+
+  void StreamChunkDone(int64 index, bool available,
+                       const SharedString& chunk) {
+    stream_chunk_available_ = available && IsValidChunk(index, chunk);
+    stream_chunk_ = chunk;
+    if ((chunk_handoff_.BarrierIncrement(-1) == 0) && WriteStreamedChunk()) {
+      StreamNextChunks();
+    }
+  }
+
+  // Writes the part of the chunk just read that lies in the requested
+  // range.  Returns true if there are more chunks to read; otherwise this
+  // has been deleted.
+  bool WriteStreamedChunk() {
+    if (!stream_chunk_available_) {
+      // The headers have gone out, so all we can do is tell the caller.
+      Miss();
+      Finish();
+      return false;
+    }
+    int64 chunk_start = next_chunk_ * chunk_size_;
+    int64 begin = std::max(stream_first_, chunk_start) - chunk_start;
+    int64 end = std::min(stream_last_ + 1,
+                         chunk_start + static_cast<int64>(stream_chunk_.size()))
+        - chunk_start;
+    stream_fetch_->Write(stream_chunk_.Value().substr(begin, end - begin),
+                         handler_);
+    stream_chunk_ = SharedString();
+    if (next_chunk_ == range_end_) {
+      Finish();
+      return false;
+    }
+    ++next_chunk_;
+    return true;
+  }
+
+  void Miss() {
+    if (handler_ != NULL) {
+      handler_->Message(kWarning,
+                        "HTTPCache key=%s fragment=%s: chunk missing",
+                        key_.c_str(), fragment_.c_str());
+    }
+    result_ = HTTPCache::FindResult(HTTPCache::kNotFound, kFetchStatusNotSet);
+    if (stream_fetch_ == NULL ||
+        stream_fetch_->response_headers() != callback_->response_headers()) {
+      // When streaming into the callback's own headers they have already
+      // been sent, and stay as they were.
+      callback_->response_headers()->Clear();
+    }
+    callback_->http_value()->Clear();
+  }
+
+  void Finish() {
     callback_->Done(result_);
     delete this;
   }
 
- private:
   GoogleString key_;
   GoogleString fragment_;
   RequestHeaders::Properties req_properties_;
@@ -292,16 +632,95 @@ class HTTPCacheCallback : public CacheInterface::Callback {
   int64 start_ms_;
   int cache_level_;
 
+  // Set when the entry found is a manifest written by PutChunked.
+  bool chunked_;
+  int64 chunk_size_;
+  int64 body_size_;
+  GoogleString chunk_id_;
+
+  // Chunks read by ReadAllChunks, indexed by position; pending_chunks_
+  // counts the MultiGet callbacks still outstanding.
+  std::vector<SharedString> chunks_;
+  AtomicInt32 pending_chunks_;
+
+  // Streaming state; see set_stream().
+  AsyncFetch* stream_fetch_;
+  int64 range_first_;
+  int64 range_last_;
+  int64 stream_first_;
+  int64 stream_last_;
+  int64 range_end_;
+  int64 next_chunk_;
+  AtomicInt32 chunk_handoff_;
+  bool stream_chunk_available_;
+  SharedString stream_chunk_;
+
   DISALLOW_COPY_AND_ASSIGN(HTTPCacheCallback);
 };
 
 void HTTPCache::Find(const GoogleString& key, const GoogleString& fragment,
                      MessageHandler* handler, Callback* callback) {
+  FindInternal(key, fragment, -1, -1, handler, callback, NULL);
+}
+
+void HTTPCache::FindAndStream(const GoogleString& key,
+                              const GoogleString& fragment,
+                              int64 range_first, int64 range_last,
+                              MessageHandler* handler, Callback* callback,
+                              AsyncFetch* fetch) {
+  DCHECK(fetch != NULL);
+  FindInternal(key, fragment, range_first, range_last, handler, callback,
+               fetch);
+}
+
+void HTTPCache::FindInternal(const GoogleString& key,
+                             const GoogleString& fragment,
+                             int64 range_first, int64 range_last,
+                             MessageHandler* handler, Callback* callback,
+                             AsyncFetch* fetch) {
   HTTPCacheCallback* cb = new HTTPCacheCallback(
       key, fragment, handler, callback, this);
+  if (fetch != NULL) {
+    cb->set_stream(fetch, range_first, range_last);
+  }
   cache_->Get(CompositeKey(key, fragment), cb);
 }
 
+GoogleString HTTPCache::ChunkKey(StringPiece composite_key, StringPiece id,
+                                 int64 index) {
+  return StrCat(composite_key, "#chunk/", id, "/", Integer64ToString(index));
+}
+
+void HTTPCache::PutChunked(const GoogleString& composite_key,
+                           HTTPValue* value, MessageHandler* handler) {
+  ResponseHeaders headers;
+  StringPiece contents;
+  if (!value->ExtractHeaders(&headers, handler) ||
+      !value->ExtractContents(&contents)) {
+    return;
+  }
+
+  // The chunk keys include a hash of the body, so a reader holding an older
+  // manifest can't splice together chunks from two different bodies.
+  GoogleString id = hasher_->Hash(contents);
+  int64 body_size = contents.size();
+  for (int64 i = 0, start = 0; start < body_size; ++i, start += chunk_size_) {
+    cache_->Put(ChunkKey(composite_key, id, i),
+                SharedString(contents.substr(start, chunk_size_)));
+  }
+
+  // Written last, so that a reader finding the manifest will normally find
+  // its chunks too.  Orphaned chunks are left for the backend to evict.
+  headers.Replace(kChunkedBodyHeader,
+                  StrCat(Integer64ToString(chunk_size_), ",",
+                         Integer64ToString(body_size), ",", id));
+  headers.ComputeCaching();
+  HTTPValue manifest;
+  manifest.SetHeaders(&headers);
+  manifest.Write("", handler);
+  cache_->Put(composite_key, manifest.share());
+}
+
 void HTTPCache::UpdateStats(
     const GoogleString& key, const GoogleString& fragment,
     CacheInterface::KeyState backend_state, FindResult result,
@@ -334,6 +753,27 @@ void HTTPCache::set_max_cacheable_response_content_length(int64 value) {
   }
 }
 
+void HTTPCache::set_max_cacheable_chunked_content_length(int64 value) {
+  DCHECK(value >= kCacheSizeUnlimited);
+  if (value >= kCacheSizeUnlimited) {
+    max_cacheable_chunked_content_length_ = value;
+  }
+}
+
+int64 HTTPCache::MaxCacheableBodySize() const {
+  if (max_cacheable_response_content_length_ == kCacheSizeUnlimited) {
+    return kCacheSizeUnlimited;
+  }
+  if (chunk_size_ > 0) {
+    if (max_cacheable_chunked_content_length_ == kCacheSizeUnlimited) {
+      return kCacheSizeUnlimited;
+    }
+    return std::max(max_cacheable_response_content_length_,
+                    max_cacheable_chunked_content_length_);
+  }
+  return max_cacheable_response_content_length_;
+}
+
 void HTTPCache::RememberFailure(
     const GoogleString& key,
     const GoogleString& fragment,
@@ -432,8 +872,8 @@ void HTTPCache::PutInternal(bool preserve_response_headers,
       }
       headers_to_gzip->ComputeCaching();
 
-      if (InflatingFetch::GzipValue(compression_level_, *value,
-                                    &working_value, headers_to_gzip,
+      if (InflatingFetch::GzipValue(compression_level_, parallel_gzip_,
+                                    *value, &working_value, headers_to_gzip,
                                     handler)) {
         // The resource is text (js, css, html, svg, etc.), and not previously
         // compressed, so we'll compress it and stick the new compressed version
@@ -456,7 +896,12 @@ void HTTPCache::PutInternal(bool preserve_response_headers,
   }
   // TODO(jcrowell): prevent the unzip-rezip flow when sending compressed data
   // directly to a client through InflatingFetch.
-  cache_->Put(CompositeKey(key, fragment), value->share());
+  GoogleString composite_key = CompositeKey(key, fragment);
+  if (chunk_size_ > 0 && value->contents_size() > chunk_size_) {
+    PutChunked(composite_key, value, handler);
+  } else {
+    cache_->Put(composite_key, value->share());
+  }
   if (cache_time_us_ != NULL) {
     int64 delta_us = timer_->NowUs() - start_us;
     cache_time_us_->Add(delta_us);
@@ -545,8 +990,14 @@ bool HTTPCache::IsCacheableContentLength(ResponseHeaders* headers) const {
 }
 
 bool HTTPCache::IsCacheableBodySize(int64 body_size) const {
-  return (max_cacheable_response_content_length_ == -1 ||
-          body_size <= max_cacheable_response_content_length_);
+  if (max_cacheable_response_content_length_ == kCacheSizeUnlimited ||
+      body_size <= max_cacheable_response_content_length_) {
+    return true;
+  }
+  // Too big for a single value, but acceptable if it will be chunked.
+  return (chunk_size_ > 0 && body_size > chunk_size_ &&
+          (max_cacheable_chunked_content_length_ == kCacheSizeUnlimited ||
+           body_size <= max_cacheable_chunked_content_length_));
 }
 
 bool HTTPCache::MayCacheUrl(const GoogleString& url,
@@ -565,11 +1016,11 @@ bool HTTPCache::MayCacheUrl(const GoogleString& url,
 
 void HTTPCache::Delete(const GoogleString& key, const GoogleString& fragment) {
   cache_deletes_->Add(1);
-  DeleteInternal(CompositeKey(key, fragment));
-}
-
-void HTTPCache::DeleteInternal(const GoogleString& key_fragment) {
-  cache_->Delete(key_fragment);
+  // The entry is read first in case it was stored in chunks, which would
+  // otherwise be left behind.  This is done even if chunk_size_ is now 0,
+  // as the entry may have been written under an earlier configuration.
+  cache_->Get(CompositeKey(key, fragment),
+              new DeleteEntryCallback(cache_, CompositeKey(key, fragment)));
 }
 
 void HTTPCache::InitStats(Statistics* statistics) {
@@ -24,6 +24,7 @@
 
 #include <cstddef>                     // for size_t
 
+#include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/http_value.h"
 #include "net/instaweb/http/public/inflating_fetch.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -43,6 +44,7 @@
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
 #include "pagespeed/kernel/util/gzip_inflater.h"
+#include "pagespeed/kernel/util/parallel_gzip.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_stats.h"
 #include "pagespeed/opt/logging/request_timing_info.h"
@@ -349,6 +351,40 @@ TEST_F(HTTPCacheTest, PutGetCompressed) {
   http_cache_->SetCompressionLevel(0); // Return cache to uncompressed.
 }
 
+TEST_F(HTTPCacheTest, PutGetCompressedInParallel) {
+  // Values above the parallel threshold are compressed on the ParallelGzip
+  // threads and must still inflate back to the original content.
+  ParallelGzip parallel_gzip(4, thread_system_.get());
+  parallel_gzip.set_block_size(4 * 1024);
+  parallel_gzip.set_min_parallel_bytes(8 * 1024);
+  http_cache_->SetCompressionLevel(9);
+  http_cache_->set_parallel_gzip(&parallel_gzip);
+  GoogleString content;
+  for (int i = 0; static_cast<int>(content.size()) < 50 * 1000; ++i) {
+    StrAppend(&content, ".class", IntegerToString(i), " { color: red; }\n");
+  }
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+  meta_data_in.Replace(HttpAttributes::kContentType,
+                       kContentTypeCss.mime_type());
+  meta_data_in.ComputeCaching();
+  Put(kUrl, kFragment, &meta_data_in, content);
+  HTTPValue value;
+  ASSERT_EQ(kFoundResult,
+            FindAcceptGzip(kUrl, kFragment, &value, &meta_data_out));
+  EXPECT_TRUE(meta_data_out.IsGzipped());
+  StringPiece contents;
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_GT(content.size(), contents.size());
+  GoogleString inflated;
+  StringWriter inflate_writer(&inflated);
+  ASSERT_TRUE(GzipInflater::Inflate(contents, GzipInflater::kGzip,
+                                    &inflate_writer));
+  EXPECT_TRUE(content == inflated);
+  http_cache_->set_parallel_gzip(NULL);
+  http_cache_->SetCompressionLevel(0);
+}
+
 TEST_F(HTTPCacheTest, StaticInflatingFetch) {
   // Check to see that when compression is on, data put into the cache is
   // properly compressed, and can be retrieved if the callback accepts gzipped
@@ -1016,6 +1052,212 @@ TEST_F(HTTPCacheTest, PutUncompressedWithCompressionOn) {
   EXPECT_GT(kPayloadSizeWithoutHeaders, cache_size);
 }
 
+TEST_F(HTTPCacheTest, ChunkedPutGet) {
+  const char kBody[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_chunk_size(10);
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+  // Three chunks plus the manifest.
+  EXPECT_EQ(4, lru_cache_.num_elements());
+
+  HTTPValue value;
+  ASSERT_EQ(kFoundResult, Find(kUrl, kFragment, &value, &meta_data_out));
+  StringPiece contents;
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_EQ(kBody, contents);
+  EXPECT_STREQ("value", meta_data_out.Lookup1("name"));
+  EXPECT_FALSE(meta_data_out.Has(HTTPCache::kChunkedBodyHeader));
+
+  // Bodies no larger than a chunk are stored whole.
+  Put(kUrl2, kFragment, &meta_data_in, "short");
+  EXPECT_EQ(5, lru_cache_.num_elements());
+  ASSERT_EQ(kFoundResult, Find(kUrl2, kFragment, &value, &meta_data_out));
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_EQ("short", contents);
+}
+
+TEST_F(HTTPCacheTest, ChunkedMissingChunk) {
+  const char kBody[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_chunk_size(10);
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+  lru_cache_.Delete(HTTPCache::ChunkKey(
+      http_cache_->CompositeKey(kUrl, kFragment), mock_hasher_.Hash(kBody),
+      1));
+
+  HTTPValue value;
+  EXPECT_EQ(kNotFoundResult, Find(kUrl, kFragment, &value, &meta_data_out));
+  EXPECT_FALSE(meta_data_out.headers_complete());
+}
+
+TEST_F(HTTPCacheTest, ChunkedStreamRange) {
+  const char kBody[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_chunk_size(10);
+  ResponseHeaders meta_data_in;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+
+  // A range spanning two chunks.
+  scoped_ptr<Callback> callback(NewCallback());
+  StringAsyncFetch fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, 8, 21, &message_handler_,
+                             callback.get(), &fetch);
+  ASSERT_TRUE(callback->called_);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ("89abcdefghijAB", fetch.buffer());
+  EXPECT_EQ(HttpStatus::kPartialContent,
+            fetch.response_headers()->status_code());
+  EXPECT_STREQ("bytes 8-21/25",
+               fetch.response_headers()->Lookup1(
+                   HttpAttributes::kContentRange));
+  EXPECT_STREQ("14", fetch.response_headers()->Lookup1(
+      HttpAttributes::kContentLength));
+
+  // An open-ended range.
+  callback.reset(NewCallback());
+  StringAsyncFetch tail_fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, 20, -1, &message_handler_,
+                             callback.get(), &tail_fetch);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ("ABCDE", tail_fetch.buffer());
+
+  // No range streams the whole body.
+  callback.reset(NewCallback());
+  StringAsyncFetch full_fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, -1, -1, &message_handler_,
+                             callback.get(), &full_fetch);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ(kBody, full_fetch.buffer());
+  EXPECT_EQ(HttpStatus::kOK, full_fetch.response_headers()->status_code());
+
+  // A range starting past the end.
+  callback.reset(NewCallback());
+  StringAsyncFetch bad_fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, 25, -1, &message_handler_,
+                             callback.get(), &bad_fetch);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ("", bad_fetch.buffer());
+  EXPECT_EQ(HttpStatus::kRangeNotSatisfiable,
+            bad_fetch.response_headers()->status_code());
+  EXPECT_STREQ("bytes */25", bad_fetch.response_headers()->Lookup1(
+      HttpAttributes::kContentRange));
+}
+
+TEST_F(HTTPCacheTest, StreamRangeUnchunked) {
+  ResponseHeaders meta_data_in;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, "content");
+
+  scoped_ptr<Callback> callback(NewCallback());
+  StringAsyncFetch fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, 3, 5, &message_handler_,
+                             callback.get(), &fetch);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ("ten", fetch.buffer());
+  EXPECT_STREQ("bytes 3-5/7",
+               fetch.response_headers()->Lookup1(
+                   HttpAttributes::kContentRange));
+}
+
+TEST_F(HTTPCacheTest, ChunkedStreamSingleByteChunks) {
+  // Every chunk is read synchronously from the LRU cache, one per byte.
+  const char kBody[] = "0123456789abcdefghijABCDEFGHIJklmnopqrstKLMNOPQRST";
+  http_cache_->set_chunk_size(1);
+  ResponseHeaders meta_data_in;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+  EXPECT_EQ(STATIC_STRLEN(kBody) + 1, lru_cache_.num_elements());
+
+  scoped_ptr<Callback> callback(NewCallback());
+  StringAsyncFetch fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, -1, -1, &message_handler_,
+                             callback.get(), &fetch);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ(kBody, fetch.buffer());
+  EXPECT_EQ(STATIC_STRLEN(kBody), fetch.content_length());
+
+  callback.reset(NewCallback());
+  StringAsyncFetch range_fetch(callback->request_context());
+  http_cache_->FindAndStream(kUrl, kFragment, 5, 44, &message_handler_,
+                             callback.get(), &range_fetch);
+  EXPECT_EQ(kFoundResult, callback->result_);
+  EXPECT_EQ(GoogleString(kBody).substr(5, 40), range_fetch.buffer());
+}
+
+TEST_F(HTTPCacheTest, ChunkedStreamMissingChunk) {
+  const char kBody[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_chunk_size(10);
+  ResponseHeaders meta_data_in;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+  lru_cache_.Delete(HTTPCache::ChunkKey(
+      http_cache_->CompositeKey(kUrl, kFragment), mock_hasher_.Hash(kBody),
+      2));
+
+  // The headers and the chunks before the missing one have been sent by the
+  // time it is found to be missing; the headers are left as they were.
+  scoped_ptr<Callback> callback(NewCallback());
+  StringAsyncFetch fetch(callback->request_context());
+  callback->set_response_headers(fetch.response_headers());
+  http_cache_->FindAndStream(kUrl, kFragment, -1, -1, &message_handler_,
+                             callback.get(), &fetch);
+  EXPECT_EQ(kNotFoundResult, callback->result_);
+  EXPECT_TRUE(fetch.headers_complete());
+  EXPECT_EQ(HttpStatus::kOK, fetch.response_headers()->status_code());
+  EXPECT_EQ("0123456789abcdefghij", fetch.buffer());
+}
+
+TEST_F(HTTPCacheTest, ChunkedDelete) {
+  const char kBody[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_chunk_size(10);
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+  Put(kUrl2, kFragment, &meta_data_in, "short");
+  EXPECT_EQ(5, lru_cache_.num_elements());
+
+  // Deleting the chunked entry takes its chunks with it, even once chunking
+  // has been turned off.
+  http_cache_->set_chunk_size(0);
+  http_cache_->Delete(kUrl, kFragment);
+  EXPECT_EQ(1, lru_cache_.num_elements());
+  HTTPValue value;
+  EXPECT_EQ(kNotFoundResult, Find(kUrl, kFragment, &value, &meta_data_out));
+
+  http_cache_->Delete(kUrl2, kFragment);
+  EXPECT_EQ(0, lru_cache_.num_elements());
+  EXPECT_EQ(2, http_cache_->cache_deletes()->Get());
+}
+
+TEST_F(HTTPCacheTest, ChunkedSizeLimit) {
+  const char kBody[] = "0123456789abcdefghijABCDE";
+  http_cache_->set_max_cacheable_response_content_length(20);
+  EXPECT_FALSE(http_cache_->IsCacheableBodySize(25));
+  EXPECT_EQ(20, http_cache_->MaxCacheableBodySize());
+
+  // Once chunked, a body may exceed the limit on a single value, up to the
+  // limit on chunked bodies.
+  http_cache_->set_chunk_size(10);
+  EXPECT_TRUE(http_cache_->IsCacheableBodySize(25));
+  EXPECT_EQ(-1, http_cache_->MaxCacheableBodySize());
+  http_cache_->set_max_cacheable_chunked_content_length(24);
+  EXPECT_FALSE(http_cache_->IsCacheableBodySize(25));
+  EXPECT_TRUE(http_cache_->IsCacheableBodySize(24));
+  EXPECT_EQ(24, http_cache_->MaxCacheableBodySize());
+  http_cache_->set_max_cacheable_chunked_content_length(100);
+
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+  Put(kUrl, kFragment, &meta_data_in, kBody);
+  HTTPValue value;
+  ASSERT_EQ(kFoundResult, Find(kUrl, kFragment, &value, &meta_data_out));
+  StringPiece contents;
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_EQ(kBody, contents);
+}
+
 class HTTPCacheWriteThroughTest : public HTTPCacheTest {
  protected:
   // Unlike HTTPCacheTest::Callback this can produce different validity for
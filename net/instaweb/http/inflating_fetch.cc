@@ -28,6 +28,7 @@
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/parallel_gzip.h"
 
 namespace net_instaweb {
 
@@ -138,14 +139,33 @@ bool InflatingFetch::GzipValue(int compression_level,
                                HTTPValue* compressed_value,
                                ResponseHeaders* headers,
                                MessageHandler* handler) {
+  return GzipValue(compression_level, NULL, http_value, compressed_value,
+                   headers, handler);
+}
+
+bool InflatingFetch::GzipValue(int compression_level,
+                               ParallelGzip* parallel_gzip,
+                               const HTTPValue& http_value,
+                               HTTPValue* compressed_value,
+                               ResponseHeaders* headers,
+                               MessageHandler* handler) {
   StringPiece content;
   GoogleString deflated;
   int64 content_length;
   http_value.ExtractContents(&content);
   StringWriter deflate_writer(&deflated);
-  if (!headers->IsGzipped() &&
-      GzipInflater::Deflate(content, GzipInflater::kGzip, compression_level,
-                            &deflate_writer)) {
+  if (headers->IsGzipped()) {
+    return false;
+  }
+  bool deflated_ok;
+  if (parallel_gzip != NULL) {
+    deflated_ok = parallel_gzip->Deflate(content, GzipInflater::kGzip,
+                                         compression_level, &deflate_writer);
+  } else {
+    deflated_ok = GzipInflater::Deflate(content, GzipInflater::kGzip,
+                                        compression_level, &deflate_writer);
+  }
+  if (deflated_ok) {
     if (!headers->HasValue(HttpAttributes::HttpAttributes::kVary,
                            HttpAttributes::kAcceptEncoding)) {
       headers->Add(HttpAttributes::HttpAttributes::kVary,
@@ -34,6 +34,7 @@ class Histogram;
 class HTTPCache;
 class MessageHandler;
 class NamedLockManager;
+class RequestHeaders;
 class Sequence;
 class Variable;
 
@@ -193,6 +194,11 @@ class CacheUrlAsyncFetcher : public UrlAsyncFetcher {
   }
 
  private:
+  // Returns true if a lookup for 'request_headers' should use
+  // HTTPCache::FindAndStream, setting the byte range to request.
+  bool ShouldStream(const RequestHeaders& request_headers,
+                    int64* range_first, int64* range_last) const;
+
   // Not owned by CacheUrlAsyncFetcher.
   const Hasher* lock_hasher_;
   NamedLockManager* lock_manager_;
@@ -39,8 +39,10 @@
 
 namespace net_instaweb {
 
+class AsyncFetch;
 class Hasher;
 class MessageHandler;
+class ParallelGzip;
 class Statistics;
 class Timer;
 class Variable;
@@ -82,9 +84,18 @@ class HTTPCache {
   // The prefix used for Etags.
   static const char kEtagPrefix[];
 
+  // Marks a stored entry whose body was split into separate cache values;
+  // see set_chunk_size().  Never visible to callers of Find.
+  static const char kChunkedBodyHeader[];
+
   // Function to format etags.
   static GoogleString FormatEtag(StringPiece hash);
 
+  // Returns the key under which PutChunked stores chunk 'index' of a body
+  // with hash 'id', for the entry at 'composite_key'.
+  static GoogleString ChunkKey(StringPiece composite_key, StringPiece id,
+                               int64 index);
+
   // Does not take ownership of any inputs.
   HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
             Statistics* stats);
@@ -264,6 +275,25 @@ class HTTPCache {
                     MessageHandler* handler,
                     Callback* callback);
 
+  // Like Find, but on a hit writes the response to 'fetch' instead of
+  // leaving the body in callback->http_value().  Chunked entries are read
+  // one chunk at a time, so a large body is never assembled in memory.
+  //
+  // If range_first is non-negative, only bytes [range_first, range_last] of
+  // the body are written (range_last < 0 meaning "to the end") and a 200
+  // response is turned into a 206, or a 416 if the range starts past the
+  // end.  On a hit, fetch->HeadersComplete() and the body Writes precede
+  // callback->Done(); the caller remains responsible for calling
+  // fetch->Done().  If a chunk has been evicted after the headers were
+  // sent, callback->Done() reports kNotFound and the caller should fail the
+  // fetch.
+  void FindAndStream(const GoogleString& key,
+                     const GoogleString& fragment,
+                     int64 range_first, int64 range_last,
+                     MessageHandler* handler,
+                     Callback* callback,
+                     AsyncFetch* fetch);
+
   // Note that Put takes a non-const pointer for HTTPValue so it can
   // bump the reference count.
   void Put(const GoogleString& key,
@@ -285,7 +315,8 @@ class HTTPCache {
            ResponseHeaders* headers,
            const StringPiece& content, MessageHandler* handler);
 
-  // Deletes an element in the cache.
+  // Deletes an element in the cache, including its chunks if it was stored
+  // in chunks.
   void Delete(const GoogleString& key, const GoogleString& fragment);
 
   void set_force_caching(bool force) { force_caching_ = force; }
@@ -346,12 +377,23 @@ class HTTPCache {
     remember_failure_policy_.ttl_sec_for_status[kind] = ttl_sec;
   }
 
-  int max_cacheable_response_content_length() {
+  int64 max_cacheable_response_content_length() const {
     return max_cacheable_response_content_length_;
   }
 
   void set_max_cacheable_response_content_length(int64 value);
 
+  // Bodies larger than max_cacheable_response_content_length() are still
+  // accepted up to this size when chunk_size() is positive, as they are then
+  // never stored as a single value.  -1, the default, means no limit.
+  int64 max_cacheable_chunked_content_length() const {
+    return max_cacheable_chunked_content_length_;
+  }
+  void set_max_cacheable_chunked_content_length(int64 value);
+
+  // The largest body IsCacheableBodySize accepts, or -1 for no limit.
+  int64 MaxCacheableBodySize() const;
+
   // Sets how many levels the cache has. Affects reporting of statistics ---
   // we don't want them for lower levels of multi-level setups.
   void set_cache_levels(int levels) { cache_levels_ = levels; }
@@ -369,6 +411,20 @@ class HTTPCache {
   }
   int compression_level() const { return compression_level_; }
 
+  // When set, values large enough to benefit are gzipped on this
+  // compressor's threads rather than on the thread calling Put.  Not owned.
+  void set_parallel_gzip(ParallelGzip* x) { parallel_gzip_ = x; }
+  ParallelGzip* parallel_gzip() const { return parallel_gzip_; }
+
+  // When positive, bodies larger than this many bytes are stored as a
+  // series of separate cache values of at most this size, plus a small
+  // manifest entry under the usual key.  This keeps large media under the
+  // per-value size limit of backends such as memcached, and lets
+  // FindAndStream serve byte ranges without reading the whole body.
+  // Zero, the default, stores every body as a single value.
+  void set_chunk_size(int64 x) { chunk_size_ = x; }
+  int64 chunk_size() const { return chunk_size_; }
+
   GoogleString Name() const { return FormatName(cache_->Name()); }
   static GoogleString FormatName(StringPiece cache);
 
@@ -383,6 +439,7 @@ class HTTPCache {
  private:
   friend class HTTPCacheCallback;
   FRIEND_TEST(HTTPCacheTest, UpdateVersion);
+  FRIEND_TEST(HTTPCacheTest, ChunkedMissingChunk);
 
   // If headers is passed as NULL, the response headers will be extracted from
   // the HTTPValue. Otherwise, the headers passed in will be used.
@@ -393,7 +450,13 @@ class HTTPCache {
                    HTTPValue* value,
                    ResponseHeaders* headers,
                    MessageHandler* handler);
-  void DeleteInternal(const GoogleString& key_fragment);
+  // Stores value's body as chunks followed by the manifest.
+  void PutChunked(const GoogleString& composite_key, HTTPValue* value,
+                  MessageHandler* handler);
+  void FindInternal(const GoogleString& key, const GoogleString& fragment,
+                    int64 range_first, int64 range_last,
+                    MessageHandler* handler, Callback* callback,
+                    AsyncFetch* fetch);
 
   // Used by constructor and tests.
   void SetVersion(int version_number);
@@ -425,6 +488,8 @@ class HTTPCache {
 
   int cache_levels_;
   int compression_level_;
+  ParallelGzip* parallel_gzip_;
+  int64 chunk_size_;
 
   // Total cumulative time spent accessing backend cache.
   Variable* cache_time_us_;
@@ -445,6 +510,7 @@ class HTTPCache {
   GoogleString name_;
   HttpCacheFailurePolicy remember_failure_policy_;
   int64 max_cacheable_response_content_length_;
+  int64 max_cacheable_chunked_content_length_;
   AtomicBool ignore_failure_puts_;
 
   GoogleString version_prefix_;
@@ -32,6 +32,7 @@
 namespace net_instaweb {
 
 class MessageHandler;
+class ParallelGzip;
 
 // This Fetch layer helps work with origin servers that serve gzipped
 // content even when request-headers do not include
@@ -69,6 +70,12 @@ class InflatingFetch : public SharedAsyncFetch {
   static bool GzipValue(int compression_level, const HTTPValue& http_value,
                         HTTPValue* compressed_value, ResponseHeaders* headers,
                         MessageHandler* handler);
+  // As above, but compresses large values on parallel_gzip's threads.
+  // parallel_gzip may be NULL, in which case this is the same as above.
+  static bool GzipValue(int compression_level, ParallelGzip* parallel_gzip,
+                        const HTTPValue& http_value,
+                        HTTPValue* compressed_value, ResponseHeaders* headers,
+                        MessageHandler* handler);
 
  protected:
   // If inflation is required, inflates and passes bytes to the linked fetch,
@@ -1339,7 +1339,9 @@
       'sources': [
         'config/rewrite_options_manager.cc',
         'config/measurement_proxy_rewrite_options_manager.cc',
+        'rewriter/adaptive_rewrite_deadline.cc',
         'rewriter/beacon_critical_images_finder.cc',
+        'rewriter/combine_fragment_cache.cc',
         'rewriter/critical_images_finder.cc',
         'rewriter/device_properties.cc',
         'rewriter/domain_lawyer.cc',
@@ -1647,6 +1649,7 @@
         'rewriter/script_tag_scanner.cc',
         'rewriter/simple_text_filter.cc',
         'rewriter/single_rewrite_context.cc',
+        'rewriter/speculative_fetch_filter.cc',
         'rewriter/srcset_slot.cc',
         'rewriter/strip_scripts_filter.cc',
         'rewriter/strip_subresource_hints_filter.cc',
@@ -1693,6 +1696,8 @@
         '<(DEPTH)/build/build_util.gyp:mod_pagespeed_version_header',
         '<(DEPTH)/third_party/serf/serf.gyp:serf',
         '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_http',
+        '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_image_processing',
+        '<(DEPTH)/pagespeed/kernel.gyp:pthread_system',
         '<(DEPTH)/third_party/apr/apr.gyp:include',
         '<(DEPTH)/third_party/aprutil/aprutil.gyp:include',
         '<(DEPTH)/third_party/domain_registry_provider/src/domain_registry/domain_registry.gyp:init_registry_tables_lib',
@@ -1709,6 +1714,7 @@
         '<(DEPTH)/pagespeed/system/external_server_spec.cc',
         '<(DEPTH)/pagespeed/system/in_place_resource_recorder.cc',
         '<(DEPTH)/pagespeed/system/loopback_route_fetcher.cc',
+        '<(DEPTH)/pagespeed/system/memcached_binary_cache.cc',
         '<(DEPTH)/pagespeed/system/serf_url_async_fetcher.cc',
         '<(DEPTH)/pagespeed/system/system_cache_path.cc',
         '<(DEPTH)/pagespeed/system/system_caches.cc',
@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "net/instaweb/rewriter/public/adaptive_rewrite_deadline.h"
+
+#include <algorithm>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Weight of each flush window in the completion-rate moving average.
+const double kCompletionRateWeight = 0.05;
+
+// Rewrites are considered to be fitting in the deadline when at least this
+// fraction complete in time.
+const double kTargetCompletionRate = 0.99;
+
+// How much of the target the 95th percentile must leave unused before the
+// deadline is raised, to avoid oscillating around the target.
+const double kRaiseHeadroom = 0.8;
+
+}  // namespace
+
+const int AdaptiveRewriteDeadline::kNumSamples;
+const int AdaptiveRewriteDeadline::kAdjustmentInterval;
+const int64 AdaptiveRewriteDeadline::kMinDeadlineMs;
+const int AdaptiveRewriteDeadline::kMaxDeadlineTargetMultiple;
+
+AdaptiveRewriteDeadline::AdaptiveRewriteDeadline(AbstractMutex* mutex)
+    : mutex_(mutex),
+      base_deadline_ms_(-1),
+      completion_rate_(1.0),
+      next_sample_(0),
+      samples_since_adjustment_(0) {
+}
+
+AdaptiveRewriteDeadline::~AdaptiveRewriteDeadline() {
+}
+
+int64 AdaptiveRewriteDeadline::MaxDeadlineMs(int64 target_ms) const {
+  return std::max(kMinDeadlineMs, kMaxDeadlineTargetMultiple * target_ms);
+}
+
+int64 AdaptiveRewriteDeadline::DeadlineMs(int64 target_ms,
+                                          int64 initial_deadline_ms,
+                                          double load) {
+  int64 base;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (base_deadline_ms_ < 0) {
+      base_deadline_ms_ = std::max(
+          kMinDeadlineMs, std::min(initial_deadline_ms,
+                                   MaxDeadlineMs(target_ms)));
+    }
+    base = base_deadline_ms_;
+  }
+  load = std::max(0.0, std::min(1.0, load));
+  return std::max(kMinDeadlineMs,
+                  static_cast<int64>(base * (1.0 - load) + 0.5));
+}
+
+void AdaptiveRewriteDeadline::RecordFlush(int64 target_ms, int64 waited_ms,
+                                          int num_rewrites,
+                                          int num_completed) {
+  if (num_rewrites <= 0) {
+    return;
+  }
+  ScopedMutex lock(mutex_.get());
+  double completed = static_cast<double>(num_completed) / num_rewrites;
+  completion_rate_ += kCompletionRateWeight * (completed - completion_rate_);
+
+  waited_ms = std::max(static_cast<int64>(0), waited_ms);
+  if (static_cast<int>(waits_ms_.size()) < kNumSamples) {
+    waits_ms_.push_back(waited_ms);
+  } else {
+    waits_ms_[next_sample_] = waited_ms;
+  }
+  next_sample_ = (next_sample_ + 1) % kNumSamples;
+
+  if (++samples_since_adjustment_ >= kAdjustmentInterval) {
+    samples_since_adjustment_ = 0;
+    AdjustLockHeld(target_ms);
+  }
+}
+
+void AdaptiveRewriteDeadline::AdjustLockHeld(int64 target_ms) {
+  if (base_deadline_ms_ < 0) {
+    return;  // No deadline has been handed out yet.
+  }
+  int64 p95 = WaitPercentileMsLockHeld(95);
+  int64 deadline = base_deadline_ms_;
+  if (p95 > target_ms) {
+    // Cut in proportion to the overshoot, by at least a millisecond.
+    deadline = std::min(deadline - 1, deadline * target_ms / p95);
+  } else if ((completion_rate_ < kTargetCompletionRate) &&
+             (p95 <= kRaiseHeadroom * target_ms)) {
+    deadline += std::max(static_cast<int64>(1), deadline / 4);
+  }
+  base_deadline_ms_ = std::max(kMinDeadlineMs,
+                               std::min(deadline, MaxDeadlineMs(target_ms)));
+}
+
+int64 AdaptiveRewriteDeadline::base_deadline_ms() const {
+  ScopedMutex lock(mutex_.get());
+  return base_deadline_ms_;
+}
+
+double AdaptiveRewriteDeadline::completion_rate() const {
+  ScopedMutex lock(mutex_.get());
+  return completion_rate_;
+}
+
+int64 AdaptiveRewriteDeadline::WaitPercentileMs(int percentile) const {
+  ScopedMutex lock(mutex_.get());
+  return WaitPercentileMsLockHeld(percentile);
+}
+
+int64 AdaptiveRewriteDeadline::WaitPercentileMsLockHeld(
+    int percentile) const {
+  if (waits_ms_.empty()) {
+    return -1;
+  }
+  std::vector<int64> sorted(waits_ms_);
+  int index = (static_cast<int>(sorted.size()) - 1) * percentile / 100;
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return sorted[index];
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,151 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test AdaptiveRewriteDeadline.
+
+#include "net/instaweb/rewriter/public/adaptive_rewrite_deadline.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int64 kTargetMs = 20;
+const int64 kInitialDeadlineMs = 10;
+
+class AdaptiveRewriteDeadlineTest : public testing::Test {
+ protected:
+  AdaptiveRewriteDeadlineTest() : deadline_(new NullMutex) {}
+
+  // Reports a full adjustment interval of identical flush windows.
+  void RecordFlushes(int64 waited_ms, int num_rewrites, int num_completed) {
+    for (int i = 0; i < AdaptiveRewriteDeadline::kAdjustmentInterval; ++i) {
+      deadline_.RecordFlush(kTargetMs, waited_ms, num_rewrites,
+                            num_completed);
+    }
+  }
+
+  int64 Deadline() {
+    return deadline_.DeadlineMs(kTargetMs, kInitialDeadlineMs, 0.0);
+  }
+
+  AdaptiveRewriteDeadline deadline_;
+};
+
+TEST_F(AdaptiveRewriteDeadlineTest, StartsAtInitialDeadline) {
+  EXPECT_EQ(-1, deadline_.base_deadline_ms());
+  EXPECT_EQ(-1, deadline_.WaitPercentileMs(95));
+  EXPECT_EQ(kInitialDeadlineMs, Deadline());
+  EXPECT_EQ(kInitialDeadlineMs, deadline_.base_deadline_ms());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, InitialDeadlineIsCapped) {
+  EXPECT_EQ(AdaptiveRewriteDeadline::kMaxDeadlineTargetMultiple * kTargetMs,
+            deadline_.DeadlineMs(kTargetMs, 1000 * kTargetMs, 0.0));
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, FlushesWithoutRewritesIgnored) {
+  Deadline();
+  RecordFlushes(1000, 0, 0);
+  EXPECT_EQ(-1, deadline_.WaitPercentileMs(95));
+  EXPECT_EQ(kInitialDeadlineMs, Deadline());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, RaisesWhileRewritesMissDeadline) {
+  Deadline();
+  // Half the rewrites miss the deadline, but the waits are well within the
+  // target, so the deadline grows until it reaches its cap.
+  int64 previous = kInitialDeadlineMs;
+  for (int i = 0; i < 20; ++i) {
+    RecordFlushes(kTargetMs / 4, 2, 1);
+    EXPECT_LE(previous, Deadline());
+    previous = Deadline();
+  }
+  EXPECT_GT(0.99, deadline_.completion_rate());
+  EXPECT_EQ(AdaptiveRewriteDeadline::kMaxDeadlineTargetMultiple * kTargetMs,
+            Deadline());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, RaisingStopsShortOfTarget) {
+  Deadline();
+  // Each window waits out the whole deadline, so raising it stops once the
+  // waits get close to the target, without overshooting it.
+  for (int i = 0; i < 20; ++i) {
+    RecordFlushes(Deadline(), 2, 1);
+  }
+  EXPECT_LT(kInitialDeadlineMs, Deadline());
+  EXPECT_GE(kTargetMs, Deadline());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, HoldsWhenRewritesComplete) {
+  Deadline();
+  RecordFlushes(2, 3, 3);
+  EXPECT_DOUBLE_EQ(1.0, deadline_.completion_rate());
+  EXPECT_EQ(kInitialDeadlineMs, Deadline());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, CutsWhenOverTarget) {
+  deadline_.DeadlineMs(kTargetMs, 4 * kTargetMs, 0.0);
+  // Every window waits out the whole deadline, twice the target.
+  RecordFlushes(2 * kTargetMs, 1, 0);
+  EXPECT_EQ(2 * kTargetMs, Deadline());
+  EXPECT_EQ(2 * kTargetMs, deadline_.WaitPercentileMs(95));
+
+  // The older waits still dominate the window, so it keeps cutting.
+  RecordFlushes(Deadline(), 1, 0);
+  EXPECT_GT(2 * kTargetMs, Deadline());
+  EXPECT_LE(AdaptiveRewriteDeadline::kMinDeadlineMs, Deadline());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, ShrinksUnderLoad) {
+  EXPECT_EQ(kInitialDeadlineMs,
+            deadline_.DeadlineMs(kTargetMs, kInitialDeadlineMs, 0.0));
+  EXPECT_EQ(kInitialDeadlineMs / 2,
+            deadline_.DeadlineMs(kTargetMs, kInitialDeadlineMs, 0.5));
+  EXPECT_EQ(AdaptiveRewriteDeadline::kMinDeadlineMs,
+            deadline_.DeadlineMs(kTargetMs, kInitialDeadlineMs, 1.0));
+  EXPECT_EQ(AdaptiveRewriteDeadline::kMinDeadlineMs,
+            deadline_.DeadlineMs(kTargetMs, kInitialDeadlineMs, 2.0));
+  // Load does not change the base deadline.
+  EXPECT_EQ(kInitialDeadlineMs, deadline_.base_deadline_ms());
+}
+
+TEST_F(AdaptiveRewriteDeadlineTest, PercentileOverRecentWindow) {
+  Deadline();
+  for (int i = 1; i <= AdaptiveRewriteDeadline::kNumSamples; ++i) {
+    deadline_.RecordFlush(kTargetMs, i, 1, 1);
+  }
+  EXPECT_EQ(95, deadline_.WaitPercentileMs(95));
+  EXPECT_EQ(1, deadline_.WaitPercentileMs(0));
+
+  // Older samples are overwritten.
+  for (int i = 0; i < AdaptiveRewriteDeadline::kNumSamples; ++i) {
+    deadline_.RecordFlush(kTargetMs, 7, 1, 1);
+  }
+  EXPECT_EQ(7, deadline_.WaitPercentileMs(0));
+  EXPECT_EQ(7, deadline_.WaitPercentileMs(100));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -35,6 +35,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_stats.h"
+#include "net/instaweb/rewriter/public/speculative_fetch_filter.h"
 #include "pagespeed/kernel/base/basictypes.h"        // for int64
 #include "pagespeed/kernel/base/callback.h"
 #include "pagespeed/kernel/base/hasher.h"
@@ -701,6 +702,15 @@ void CacheableResourceBase::LoadAndCallback(
     NotCacheablePolicy not_cacheable_policy,
     const RequestContextPtr& request_context,
     AsyncCallback* callback) {
+  // If the HTML lexer already discovered this resource and started loading
+  // it, wait for that load rather than starting another.
+  SpeculativeFetchFilter* speculative_fetch =
+      rewrite_driver_->speculative_fetch_filter();
+  if (speculative_fetch != NULL &&
+      speculative_fetch->AttachToLoad(this, not_cacheable_policy,
+                                      request_context, callback)) {
+    return;
+  }
   LoadHttpCacheCallback* cache_callback =
       new LoadHttpCacheCallback(request_context, not_cacheable_policy,
                                 callback, this);
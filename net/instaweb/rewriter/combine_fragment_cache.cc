@@ -0,0 +1,60 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include "net/instaweb/rewriter/public/combine_fragment_cache.h"
+
+namespace net_instaweb {
+
+CombineFragmentCache::CombineFragmentCache(size_t max_bytes,
+                                           AbstractMutex* mutex)
+    : mutex_(mutex),
+      lru_(max_bytes, &value_helper_) {
+}
+
+CombineFragmentCache::~CombineFragmentCache() {
+}
+
+bool CombineFragmentCache::Lookup(StringPiece key, SharedString* value) {
+  ScopedMutex lock(mutex_.get());
+  SharedString* found = lru_.GetFreshen(key);
+  if (found == NULL) {
+    return false;
+  }
+  *value = *found;
+  return true;
+}
+
+void CombineFragmentCache::Insert(StringPiece key, const SharedString& value) {
+  ScopedMutex lock(mutex_.get());
+  lru_.Put(key, value);
+}
+
+size_t CombineFragmentCache::num_elements() const {
+  ScopedMutex lock(mutex_.get());
+  return lru_.num_elements();
+}
+
+void CombineFragmentCache::Clear() {
+  ScopedMutex lock(mutex_.get());
+  lru_.Clear();
+}
+
+}  // namespace net_instaweb
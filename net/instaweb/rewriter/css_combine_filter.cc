@@ -41,11 +41,14 @@
 #include "net/instaweb/rewriter/public/rewrite_filter.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
 #include "net/instaweb/rewriter/public/server_context.h"
+#include "net/instaweb/rewriter/public/url_namer.h"
 #include "pagespeed/kernel/base/charset_util.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_name.h"
@@ -65,6 +68,8 @@ const char CssCombineFilter::kCssCombineOpportunities[] =
     "css_combine_opportunities";
 const char CssCombineFilter::kCssFileCountReduction[] =
     "css_file_count_reduction";
+const char CssCombineFilter::kCssCombineFragmentReuses[] =
+    "css_combine_fragment_reuses";
 
 // Combining helper. Takes care of checking that media matches, that we do not
 // produce @import's in the middle and of URL absolutification.
@@ -76,6 +81,21 @@ class CssCombineFilter::CssCombiner : public ResourceCombiner {
         combined_css_size_(0) {
     Statistics* stats = server_context_->statistics();
     css_file_count_reduction_ = stats->GetVariable(kCssFileCountReduction);
+    fragment_reuses_ = stats->GetVariable(kCssCombineFragmentReuses);
+  }
+
+  // Parse-checks the resource, remembering the verdict for its contents so
+  // later combinations including the same file skip the parse.
+  bool ParsesCleanly(const Resource* resource) {
+    GoogleString key = FragmentKey("parse", "", resource);
+    SharedString verdict;
+    if (LookupFragment(key, &verdict)) {
+      fragment_reuses_->Add(1);
+      return verdict.Value() == "1";
+    }
+    bool clean = CleanParse(resource->ExtractUncompressedContents());
+    InsertFragment(key, SharedString(clean ? "1" : "0"));
+    return clean;
   }
 
   bool CleanParse(const StringPiece& contents) {
@@ -95,7 +115,7 @@ class CssCombineFilter::CssCombiner : public ResourceCombiner {
     // the rest of the files combined with this one. So we should not include
     // it in the combination.
     // TODO(sligocki): Just do the CSS parsing and rewriting here.
-    if (!CleanParse(resource->ExtractUncompressedContents())) {
+    if (!ParsesCleanly(resource)) {
       *failure_reason = "CSS parse error";
       // TODO(sligocki): All parse failures are repeated twice because we will
       // try to combine them in the normal combination, then we'll try again
@@ -162,8 +182,15 @@ class CssCombineFilter::CssCombiner : public ResourceCombiner {
                           OutputResource* combination, Writer* writer,
                           MessageHandler* handler);
 
+  // Computes the text WritePiece emits for input, with its URLs resolved
+  // against the combination's base.
+  bool ComputePiece(bool first, bool last, const Resource* input,
+                    OutputResource* combination, Writer* writer,
+                    MessageHandler* handler);
+
   GoogleString media_;
   Variable* css_file_count_reduction_;
+  Variable* fragment_reuses_;
   int64 combined_css_size_;
 };
 
@@ -371,6 +398,7 @@ CssCombineFilter::~CssCombineFilter() {
 void CssCombineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCssCombineOpportunities);
   statistics->AddVariable(kCssFileCountReduction);
+  statistics->AddVariable(kCssCombineFragmentReuses);
 }
 
 void CssCombineFilter::StartDocumentImpl() {
@@ -530,11 +558,40 @@ void CssCombineFilter::Flush() {
 bool CssCombineFilter::CssCombiner::WritePiece(
     int index, int num_pieces, const Resource* input,
     OutputResource* combination, Writer* writer, MessageHandler* handler) {
+  // The resolved text depends on where the piece sits (BOM stripping and
+  // the trailing newline), on the URLs it is resolved between, and on
+  // whether we are proxying, as well as on the contents and options.
+  bool first = (index == 0);
+  bool last = (index == num_pieces - 1);
+  const UrlNamer* url_namer = server_context_->url_namer();
+  GoogleString qualifier = StrCat(
+      first ? "f" : "", last ? "l" : "",
+      (url_namer->ProxyMode() == UrlNamer::ProxyExtent::kFull) ? "p" : "",
+      "/", input->url(), " ", combination->resolved_base());
+  GoogleString key = FragmentKey("piece", qualifier, input);
+  SharedString piece;
+  if (LookupFragment(key, &piece)) {
+    fragment_reuses_->Add(1);
+    return writer->Write(piece.Value(), handler);
+  }
+  GoogleString resolved;
+  StringWriter resolved_writer(&resolved);
+  if (!ComputePiece(first, last, input, combination, &resolved_writer,
+                    handler)) {
+    return false;
+  }
+  InsertFragment(key, SharedString(resolved));
+  return writer->Write(resolved, handler);
+}
+
+bool CssCombineFilter::CssCombiner::ComputePiece(
+    bool first, bool last, const Resource* input,
+    OutputResource* combination, Writer* writer, MessageHandler* handler) {
   StringPiece contents = input->ExtractUncompressedContents();
   GoogleUrl input_url(input->url());
   // Strip the BOM off of the contents (if it's there) if this is not the
   // first resource.
-  if (index != 0) {
+  if (!first) {
     StripUtf8Bom(&contents);
   }
   bool ret = false;
@@ -542,7 +599,7 @@ bool CssCombineFilter::CssCombiner::WritePiece(
       input_url, combination->resolved_base(), contents, writer, handler)) {
     case RewriteDriver::kNoResolutionNeeded:
       ret = writer->Write(contents, handler);
-      if (ret && (index != (num_pieces - 1)) && !contents.ends_with("\n")) {
+      if (ret && !last && !contents.ends_with("\n")) {
         // Ensure that we add a new line at the end, to make sure that any
         // unopened strings get closed in a predictable manner. (Not needed
         // for last piece since it will be terminated by EOF).
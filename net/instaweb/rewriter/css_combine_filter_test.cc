@@ -967,6 +967,36 @@ TEST_F(CssCombineFilterTest, StripBom) {
   EXPECT_EQ(0, bom_pos);
 }
 
+
+TEST_F(CssCombineFilterTest, ReuseFragmentsAcrossCombinations) {
+  Variable* reuses = statistics()->GetVariable(
+      CssCombineFilter::kCssCombineFragmentReuses);
+  GoogleString html_url = StrCat(kDomain, "reuse.html");
+  ResponseHeaders default_header;
+  SetDefaultLongCacheHeaders(&kContentTypeCss, &default_header);
+  SetFetchResponse(StrCat(kDomain, kCssA), default_header, kACssBody);
+  SetFetchResponse(StrCat(kDomain, kCssB), default_header, kBCssBody);
+  SetFetchResponse(StrCat(kDomain, "c.css"), default_header, kCCssBody);
+
+  ParseUrl(html_url, StrCat(Link(kCssA), Link(kCssB)));
+  EXPECT_EQ(0, reuses->Get());
+
+  // A different combination sharing a.css and b.css reuses their parse
+  // checks, and a.css's resolved text since it is first in both.  b.css
+  // moved from last to the middle, so its text is resolved again.
+  ParseUrl(html_url, StrCat(Link(kCssA), Link(kCssB), Link("c.css")));
+  EXPECT_EQ(3, reuses->Get());
+
+  StringVector css_urls;
+  CollectCssLinks("reuse", output_buffer_, &css_urls);
+  ASSERT_EQ(1UL, css_urls.size());
+  GoogleString actual_combination;
+  GoogleUrl base_url(html_url);
+  GoogleUrl css_url(base_url, css_urls[0]);
+  EXPECT_TRUE(FetchResourceUrl(css_url.Spec(), &actual_combination));
+  EXPECT_EQ(StrCat(kACssBody, kBCssBody, kCCssBody), actual_combination);
+}
+
 TEST_F(CssCombineFilterTest, StripBomReconstruct) {
   // Make sure we strip the BOM properly when reconstructing, too.
   static const char kCssText[] = "div {background-image:url(fancy.png);}";
@@ -38,6 +38,7 @@ extern "C" {
 #include "net/instaweb/rewriter/public/webp_optimizer.h"
 #include "pagespeed/kernel/base/annotated_message_handler.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/countdown_timer.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
@@ -48,7 +49,9 @@ extern "C" {
 #include "pagespeed/kernel/image/image_analysis.h"
 #include "pagespeed/kernel/image/image_converter.h"
 #include "pagespeed/kernel/image/image_frame_interface.h"
+#include "pagespeed/kernel/image/image_probe.h"
 #include "pagespeed/kernel/image/image_resizer.h"
+#include "pagespeed/kernel/image/image_similarity.h"
 #include "pagespeed/kernel/image/image_util.h"
 #include "pagespeed/kernel/image/jpeg_optimizer.h"
 #include "pagespeed/kernel/image/jpeg_utils.h"
@@ -81,9 +84,11 @@ using pagespeed::image_compression::GRAY_8;
 using pagespeed::image_compression::ImageConverter;
 using pagespeed::image_compression::ImageFormat;
 using pagespeed::image_compression::ImageFormatToString;
+using pagespeed::image_compression::ImagePyramid;
 using pagespeed::image_compression::JpegCompressionOptions;
 using pagespeed::image_compression::JpegScanlineWriter;
 using pagespeed::image_compression::JpegUtils;
+using pagespeed::image_compression::LumaPlane;
 using pagespeed::image_compression::OptimizeJpegWithOptions;
 using pagespeed::image_compression::PixelFormat;
 using pagespeed::image_compression::PngCompressParams;
@@ -92,12 +97,14 @@ using pagespeed::image_compression::PngReader;
 using pagespeed::image_compression::PngReaderInterface;
 using pagespeed::image_compression::PngScanlineWriter;
 using pagespeed::image_compression::PreferredLibwebpLevel;
+using pagespeed::image_compression::QualitySearchEncoder;
 using pagespeed::image_compression::RETAIN;
 using pagespeed::image_compression::RGB_888;
 using pagespeed::image_compression::RGBA_8888;
 using pagespeed::image_compression::ScanlineReaderInterface;
 using pagespeed::image_compression::ScanlineResizer;
 using pagespeed::image_compression::ScanlineWriterInterface;
+using pagespeed::image_compression::SearchQualityForSsim;
 using pagespeed::image_compression::WebpConfiguration;
 using pagespeed::image_compression::WEBP_NONE;
 using pagespeed::image_compression::WEBP_LOSSY;
@@ -222,6 +229,8 @@ class ImageImpl : public Image {
 
   virtual void Dimensions(ImageDim* natural_dim);
   virtual bool ResizeTo(const ImageDim& new_dim);
+  virtual bool ResizeFromPyramid(const ImageDim& new_dim,
+                                 ImagePyramid* pyramid);
   virtual bool DrawImage(Image* image, int x, int y);
   virtual bool EnsureLoaded(bool output_useful);
   virtual bool ShouldConvertToProgressive(int64 quality) const;
@@ -238,6 +247,11 @@ class ImageImpl : public Image {
     debug_message_url_ = StrCat(" ", url);
   }
 
+  bool CanRecompressAtFullEffort() const override {
+    return output_valid_ && used_fast_encode_;
+  }
+  bool RecompressAtFullEffort() override;
+
   bool GenerateBlankImage();
 
   StringPiece original_contents() { return original_contents_; }
@@ -264,10 +278,19 @@ class ImageImpl : public Image {
 
   // Internal methods used only in the implementation
   void UndoChange();
-  void FindJpegSize();
-  void FindPngSize();
-  void FindGifSize();
-  void FindWebpSize();
+
+  // Shared prologue of ResizeTo and ResizeFromPyramid.  Returns false if the
+  // image cannot be resized at all.
+  bool PrepareToResize(const ImageDim& new_dim);
+
+  // Creates a reader for the original contents, or returns NULL and sets
+  // resize_debug_message_.
+  ScanlineReaderInterface* NewOriginalReader();
+
+  // Re-encodes the scanlines of 'resized_reader', which produces this image
+  // at new_dim, into resized_image_.
+  bool WriteResizedImage(const ImageDim& new_dim,
+                         ScanlineReaderInterface* resized_reader);
 
   // Convert the given options object to jpeg compression options.
   void ConvertToJpegOptions(const Image::CompressionOptions& options,
@@ -297,10 +320,20 @@ class ImageImpl : public Image {
 
   // Convert the JPEG in original_jpeg to WebP format in
   // compressed_webp using the quality specified in
-  // configured_quality.
+  // configured_quality, giving up after time_allowed_ms (never, if
+  // negative).
   bool ConvertJpegToWebp(
       const GoogleString& original_jpeg, int configured_quality,
-      GoogleString* compressed_webp);
+      int64 time_allowed_ms, GoogleString* compressed_webp);
+
+  // Writes original_jpeg, encoded by encoder, to output_contents_.  If
+  // options_->target_ssim is set, the quality is the one remembered in
+  // *searched_quality, or else the result of a search up to max_quality,
+  // which is then stored there.  Otherwise max_quality is used.
+  bool EncodeJpegForSsim(const GoogleString& original_jpeg,
+                         ImageFormat output_format, int max_quality,
+                         int64* searched_quality,
+                         QualitySearchEncoder* encoder);
 
   static bool ContinueWebpConversion(
       int percent,
@@ -331,6 +364,12 @@ class ImageImpl : public Image {
   // Quality level for compressing the resized image.
   int EstimateQualityForResizedJpeg();
 
+  // Returns the libwebp method (speed/size trade-off) for this encode,
+  // noting whether fast_encode lowered it.
+  int WebpMethod();
+
+  class WebpQualityEncoder;
+
   bool ConvertAnimatedGifToWebp(bool has_transparency);
 
   const GoogleString file_prefix_;
@@ -347,9 +386,71 @@ class ImageImpl : public Image {
   GoogleString resize_debug_message_;
   GoogleString debug_message_url_;
 
+  // State needed to run ComputeOutputContents a second time: the image type
+  // and conversion count it started from, and whether fast_encode actually
+  // changed any encoder setting.
+  ImageType source_image_type_;
+  int source_conversions_attempted_;
+  bool used_fast_encode_;
+
   DISALLOW_COPY_AND_ASSIGN(ImageImpl);
 };
 
+namespace {
+
+// Re-encodes a JPEG as a JPEG with the given options at each quality tried.
+class JpegQualityEncoder : public QualitySearchEncoder {
+ public:
+  JpegQualityEncoder(const GoogleString& original,
+                     const JpegCompressionOptions& options,
+                     MessageHandler* handler)
+      : original_(original), options_(options), handler_(handler) {}
+
+  virtual bool Encode(int quality, GoogleString* output) {
+    options_.lossy_options.quality = quality;
+    return OptimizeJpegWithOptions(original_, output, options_, handler_);
+  }
+
+ private:
+  const GoogleString& original_;
+  JpegCompressionOptions options_;
+  MessageHandler* handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(JpegQualityEncoder);
+};
+
+}  // namespace
+
+// Converts a JPEG to lossy WebP at each quality tried.  All the encodes
+// share one webp_conversion_timeout_ms, so a quality search takes no
+// longer than a single conversion is allowed to.
+class ImageImpl::WebpQualityEncoder : public QualitySearchEncoder {
+ public:
+  WebpQualityEncoder(ImageImpl* image, const GoogleString& original)
+      : image_(image),
+        original_(original),
+        time_allowed_ms_(image->options_->webp_conversion_timeout_ms),
+        deadline_(image->timer_, NULL, time_allowed_ms_) {}
+
+  virtual bool Encode(int quality, GoogleString* output) {
+    int64 time_left_ms = -1;
+    if (time_allowed_ms_ >= 0) {
+      time_left_ms = std::max(static_cast<int64>(0), deadline_.TimeLeftMs());
+    }
+    return image_->ConvertJpegToWebp(original_, quality, time_left_ms, output);
+  }
+
+  virtual bool HaveTimeLeft() { return deadline_.HaveTimeLeft(); }
+
+ private:
+  ImageImpl* image_;
+  const GoogleString& original_;
+  const int64 time_allowed_ms_;
+  CountdownTimer deadline_;
+
+  DISALLOW_COPY_AND_ASSIGN(WebpQualityEncoder);
+};
+
 void ImageImpl::SetTransformToLowRes() {
   // TODO(vchudnov): Deprecate low_quality_enabled_.
   low_quality_enabled_ = true;
@@ -381,7 +482,10 @@ ImageImpl::ImageImpl(const StringPiece& original_contents,
       url_(url),
       options_(options),
       low_quality_enabled_(false),
-      timer_(timer) {
+      timer_(timer),
+      source_image_type_(IMAGE_UNKNOWN),
+      source_conversions_attempted_(0),
+      used_fast_encode_(false) {
   const GoogleString annotation = StrCat(url, ": ");
   handler_.reset(new AnnotatedMessageHandler(annotation, handler));
 }
@@ -411,7 +515,10 @@ ImageImpl::ImageImpl(int width, int height, ImageType type,
       file_prefix_(tmp_dir.data(), tmp_dir.size()),
       changed_(false),
       low_quality_enabled_(false),
-      timer_(timer) {
+      timer_(timer),
+      source_image_type_(IMAGE_UNKNOWN),
+      source_conversions_attempted_(0),
+      used_fast_encode_(false) {
   options_.reset(options);
   dims_.set_width(width);
   dims_.set_height(height);
@@ -445,128 +552,35 @@ Image* BlankImageWithOptions(int width, int height, ImageType type,
 Image::~Image() {
 }
 
-// Looks through blocks of jpeg stream to find SOFn block
-// indicating encoding and dimensions of image.
-// Loosely based on code and FAQs found here:
-//    http://www.faqs.org/faqs/jpeg-faq/part1/
-void ImageImpl::FindJpegSize() {
-  const StringPiece& buf = original_contents_;
-  size_t pos = 2;  // Position of first data block after header.
-  while (pos < buf.size()) {
-    // Read block identifier
-    int id = CharToInt(buf[pos++]);
-    if (id == 0xff) {  // Padding byte
-      continue;
-    }
-    // At this point pos points to first data byte in block.  In any block,
-    // first two data bytes are size (including these 2 bytes).  But first,
-    // make sure block wasn't truncated on download.
-    if (pos + ImageHeaders::kJpegIntSize > buf.size()) {
-      break;
-    }
-    int length = JpegIntAtPosition(buf, pos);
-    // Now check for a SOFn header, which describes image dimensions.
-    if (0xc0 <= id && id <= 0xcf &&  // SOFn header
-        length >= 8 &&               // Valid SOFn block size
-        pos + 1 + 3 * ImageHeaders::kJpegIntSize <= buf.size() &&
-        // Above avoids case where dimension data was truncated
-        id != 0xc4 && id != 0xc8 && id != 0xcc) {
-      // 0xc4, 0xc8, 0xcc aren't actually valid SOFn headers.
-      // NOTE: we don't care if we have the whole SOFn block,
-      // just that we can fetch both dimensions without trouble.
-      // Our image download could be truncated at this point for
-      // all we care.
-      // We're a bit sloppy about SOFn block size, as it's
-      // actually 8 + 3 * buf[pos+2], but for our purposes this
-      // will suffice as we don't parse subsequent metadata (which
-      // describes the formatting of chunks of image data).
-      dims_.set_height(
-          JpegIntAtPosition(buf, pos + 1 + ImageHeaders::kJpegIntSize));
-      dims_.set_width(
-          JpegIntAtPosition(buf, pos + 1 + 2 * ImageHeaders::kJpegIntSize));
-      break;
-    }
-    pos += length;
-  }
-  if (!ImageUrlEncoder::HasValidDimensions(dims_) ||
-      (dims_.height() <= 0) || (dims_.width() <= 0)) {
-    dims_.Clear();
-    PS_LOG_INFO(handler_, "Couldn't find jpeg dimensions (data truncated?).");
-  }
-}
-
-// Looks at first (IHDR) block of png stream to find image dimensions.
-// See also: http://www.w3.org/TR/PNG/
-void ImageImpl::FindPngSize() {
-  const StringPiece& buf = original_contents_;
-  // Here we make sure that buf contains at least enough data that we'll be able
-  // to decipher the image dimensions first, before we actually check for the
-  // headers and attempt to decode the dimensions (which are the first two ints
-  // after the IHDR section label).
-  if ((buf.size() >=  // Not truncated
-       ImageHeaders::kIHDRDataStart + 2 * ImageHeaders::kPngIntSize) &&
-      (StringPiece(buf.data() + ImageHeaders::kPngHeaderLength,
-                   ImageHeaders::kPngSectionHeaderLength) ==
-       StringPiece(ImageHeaders::kPngIHDR,
-                   ImageHeaders::kPngSectionHeaderLength))) {
-    dims_.set_width(PngIntAtPosition(buf, ImageHeaders::kIHDRDataStart));
-    dims_.set_height(PngIntAtPosition(
-        buf, ImageHeaders::kIHDRDataStart + ImageHeaders::kPngIntSize));
-  } else {
-    PS_LOG_INFO(handler_, "Couldn't find png dimensions "
-                "(data truncated or IHDR missing).");
-  }
-}
-
-// Looks at header of GIF file to extract image dimensions.
-// See also: http://en.wikipedia.org/wiki/Graphics_Interchange_Format
-void ImageImpl::FindGifSize() {
-  const StringPiece& buf = original_contents_;
-  // Make sure that buf contains enough data that we'll be able to
-  // decipher the image dimensions before we attempt to do so.
-  if (buf.size() >=
-      ImageHeaders::kGifDimStart + 2 * ImageHeaders::kGifIntSize) {
-    // Not truncated
-    dims_.set_width(GifIntAtPosition(buf, ImageHeaders::kGifDimStart));
-    dims_.set_height(GifIntAtPosition(
-        buf, ImageHeaders::kGifDimStart + ImageHeaders::kGifIntSize));
-  } else {
-    PS_LOG_INFO(handler_, "Couldn't find gif dimensions (data truncated)");
-  }
-}
-
-void ImageImpl::FindWebpSize() {
-  const uint8* webp = reinterpret_cast<const uint8*>(original_contents_.data());
-  const int webp_size = original_contents_.size();
-  int width = 0, height = 0;
-  if (WebPGetInfo(webp, webp_size, &width, &height) > 0) {
-    dims_.set_width(width);
-    dims_.set_height(height);
-  } else {
-    PS_LOG_INFO(handler_, "Couldn't find webp dimensions ");
-  }
-}
-
 // Looks at image data in order to determine image type, and also fills in any
 // dimension information it can (setting image_type_ and dims_).
 void ImageImpl::ComputeImageType() {
-  image_type_ =
-      pagespeed::image_compression::ComputeImageType(original_contents_);
-
+  pagespeed::image_compression::ImageProbeResult probe;
+  pagespeed::image_compression::ProbeImage(original_contents_, &probe);
+  image_type_ = probe.type;
+  if (image_type_ == IMAGE_UNKNOWN) {
+    return;
+  }
+  if (probe.has_dimensions) {
+    dims_.set_width(probe.width);
+    dims_.set_height(probe.height);
+    return;
+  }
   switch (image_type_) {
     case IMAGE_JPEG:
-      FindJpegSize();
+      PS_LOG_INFO(handler_, "Couldn't find jpeg dimensions (data truncated?).");
       break;
     case IMAGE_PNG:
-      FindPngSize();
+      PS_LOG_INFO(handler_, "Couldn't find png dimensions "
+                  "(data truncated or IHDR missing).");
       break;
     case IMAGE_GIF:
-      FindGifSize();
+      PS_LOG_INFO(handler_, "Couldn't find gif dimensions (data truncated)");
       break;
     case IMAGE_WEBP:
     case IMAGE_WEBP_LOSSLESS_OR_ALPHA:
     case IMAGE_WEBP_ANIMATED:
-      FindWebpSize();
+      PS_LOG_INFO(handler_, "Couldn't find webp dimensions ");
       break;
     case IMAGE_UNKNOWN:
       break;
@@ -666,7 +680,7 @@ void ImageImpl::Dimensions(ImageDim* natural_dim) {
   *natural_dim = dims_;
 }
 
-bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
+bool ImageImpl::PrepareToResize(const ImageDim& new_dim) {
   CHECK(ImageUrlEncoder::HasValidDimensions(new_dim));
   if ((new_dim.width() <= 0) || (new_dim.height() <= 0)) {
     return false;
@@ -680,20 +694,31 @@ bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
   // TODO(huibao): Enable resizing for WebP and images with alpha channel.
   // We have the tools ready but no tests.
   const ImageFormat original_format = ImageTypeToImageFormat(image_type());
-  if (original_format == pagespeed::image_compression::IMAGE_WEBP) {
-    return false;
-  }
+  return (original_format != pagespeed::image_compression::IMAGE_WEBP);
+}
 
-  scoped_ptr<ScanlineReaderInterface> image_reader(
-      CreateScanlineReader(original_format,
+ScanlineReaderInterface* ImageImpl::NewOriginalReader() {
+  ScanlineReaderInterface* image_reader =
+      CreateScanlineReader(ImageTypeToImageFormat(image_type()),
                            original_contents_.data(),
                            original_contents_.length(),
-                           handler_.get()));
+                           handler_.get());
   if (image_reader == NULL) {
     resize_debug_message_ =
         StringPrintf("Cannot resize: Cannot open the image%s to resize",
                      debug_message_url_.c_str());
     PS_LOG_INFO(handler_, "Cannot open the image to resize.");
+  }
+  return image_reader;
+}
+
+bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
+  if (!PrepareToResize(new_dim)) {
+    return false;
+  }
+
+  scoped_ptr<ScanlineReaderInterface> image_reader(NewOriginalReader());
+  if (image_reader == NULL) {
     return false;
   }
 
@@ -705,10 +730,45 @@ bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
                      debug_message_url_.c_str());
     return false;
   }
+  return WriteResizedImage(new_dim, &resizer);
+}
+
+bool ImageImpl::ResizeFromPyramid(const ImageDim& new_dim,
+                                  ImagePyramid* pyramid) {
+  if (!PrepareToResize(new_dim)) {
+    return false;
+  }
+
+  if (!pyramid->initialized()) {
+    scoped_ptr<ScanlineReaderInterface> image_reader(NewOriginalReader());
+    if (image_reader == NULL) {
+      return false;
+    }
+    if (!pyramid->Initialize(image_reader.get())) {
+      resize_debug_message_ =
+          StringPrintf("Cannot resize%s: Reading image failed",
+                       debug_message_url_.c_str());
+      return false;
+    }
+  }
+
+  scoped_ptr<ScanlineReaderInterface> resized_reader(
+      pyramid->NewResizedReader(new_dim.width(), new_dim.height()));
+  if (resized_reader == NULL) {
+    resize_debug_message_ =
+        StringPrintf("Cannot resize%s: Unable to initialize resizer",
+                     debug_message_url_.c_str());
+    return false;
+  }
+  return WriteResizedImage(new_dim, resized_reader.get());
+}
 
+bool ImageImpl::WriteResizedImage(const ImageDim& new_dim,
+                                  ScanlineReaderInterface* resized_reader) {
   // Create a writer.
   scoped_ptr<ScanlineWriterInterface> writer;
-  const ImageFormat resized_format = GetOutputImageFormat(original_format);
+  const ImageFormat resized_format =
+      GetOutputImageFormat(ImageTypeToImageFormat(image_type()));
   switch (resized_format) {
     case pagespeed::image_compression::IMAGE_JPEG:
       {
@@ -716,9 +776,9 @@ bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
         jpeg_config.lossy = true;
         jpeg_config.lossy_options.quality = EstimateQualityForResizedJpeg();
         writer.reset(CreateScanlineWriter(resized_format,
-                                          resizer.GetPixelFormat(),
-                                          resizer.GetImageWidth(),
-                                          resizer.GetImageHeight(),
+                                          resized_reader->GetPixelFormat(),
+                                          resized_reader->GetImageWidth(),
+                                          resized_reader->GetImageHeight(),
                                           &jpeg_config,
                                           &resized_image_,
                                           handler_.get()));
@@ -730,9 +790,9 @@ bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
         PngCompressParams png_config(PNG_FILTER_NONE, Z_DEFAULT_STRATEGY,
                                      false);
         writer.reset(CreateScanlineWriter(resized_format,
-                                          resizer.GetPixelFormat(),
-                                          resizer.GetImageWidth(),
-                                          resizer.GetImageHeight(),
+                                          resized_reader->GetPixelFormat(),
+                                          resized_reader->GetImageWidth(),
+                                          resized_reader->GetImageHeight(),
                                           &png_config,
                                           &resized_image_,
                                           handler_.get()));
@@ -752,8 +812,8 @@ bool ImageImpl::ResizeTo(const ImageDim& new_dim) {
 
   // Resize the image and save the results in 'resized_image_'.
   void* scanline = NULL;
-  while (resizer.HasMoreScanLines()) {
-    if (!resizer.ReadNextScanline(&scanline)) {
+  while (resized_reader->HasMoreScanLines()) {
+    if (!resized_reader->ReadNextScanline(&scanline)) {
       resize_debug_message_ =
           StringPrintf("Cannot resize%s: Reading image failed",
                        debug_message_url_.c_str());
@@ -823,6 +883,8 @@ bool ImageImpl::ComputeOutputContents() {
   if (!output_valid_) {
     StringPiece contents;
     bool resized;
+    source_image_type_ = image_type();
+    source_conversions_attempted_ = options_->conversions_attempted;
 
     // Choose appropriate source for image contents.
     // Favor original contents if image unchanged.
@@ -874,8 +936,11 @@ bool ImageImpl::ComputeOutputContents() {
         if (MayConvert() &&
             options_->convert_jpeg_to_webp &&
             (options_->preferred_webp != WEBP_NONE)) {
-          ok = ConvertJpegToWebp(string_for_image, options_->webp_quality,
-                                 &output_contents_);
+          WebpQualityEncoder encoder(this, string_for_image);
+          ok = EncodeJpegForSsim(string_for_image,
+                                 pagespeed::image_compression::IMAGE_WEBP,
+                                 options_->webp_quality,
+                                 &options_->searched_webp_quality, &encoder);
           VLOG(1) << "Image conversion: " << ok << " jpeg->webp for " << url_;
           if (!ok) {
             // Image is not going to be webp-converted!
@@ -888,8 +953,18 @@ bool ImageImpl::ComputeOutputContents() {
                    (resized || options_->recompress_jpeg)) {
           JpegCompressionOptions jpeg_options;
           ConvertToJpegOptions(*options_.get(), &jpeg_options);
-          ok = OptimizeJpegWithOptions(string_for_image, &output_contents_,
-                                       jpeg_options, handler_.get());
+          if (jpeg_options.lossy) {
+            JpegQualityEncoder encoder(string_for_image, jpeg_options,
+                                       handler_.get());
+            ok = EncodeJpegForSsim(string_for_image,
+                                   pagespeed::image_compression::IMAGE_JPEG,
+                                   jpeg_options.lossy_options.quality,
+                                   &options_->searched_jpeg_quality,
+                                   &encoder);
+          } else {
+            ok = OptimizeJpegWithOptions(string_for_image, &output_contents_,
+                                         jpeg_options, handler_.get());
+          }
           VLOG(1) << "Image conversion: " << ok << " jpeg->jpeg for " << url_;
         }
         break;
@@ -932,9 +1007,9 @@ bool ImageImpl::ComputeOutputContents() {
 
 inline bool ImageImpl::ConvertJpegToWebp(
     const GoogleString& original_jpeg, int configured_quality,
-    GoogleString* compressed_webp) {
-  ConversionTimeoutHandler timeout_handler(options_->webp_conversion_timeout_ms,
-                                           timer_, handler_.get());
+    int64 time_allowed_ms, GoogleString* compressed_webp) {
+  ConversionTimeoutHandler timeout_handler(time_allowed_ms, timer_,
+                                           handler_.get());
   timeout_handler.Start(compressed_webp);
   bool ok = OptimizeWebp(original_jpeg, configured_quality,
                          ConversionTimeoutHandler::Continue, &timeout_handler,
@@ -954,6 +1029,39 @@ inline bool ImageImpl::ConvertJpegToWebp(
   return ok;
 }
 
+bool ImageImpl::EncodeJpegForSsim(const GoogleString& original_jpeg,
+                                  ImageFormat output_format, int max_quality,
+                                  int64* searched_quality,
+                                  QualitySearchEncoder* encoder) {
+  output_contents_.clear();
+  if (options_->target_ssim <= 0.0 || max_quality <= 0) {
+    return encoder->Encode(max_quality, &output_contents_);
+  }
+  if (*searched_quality > 0) {
+    return encoder->Encode(
+        std::min(static_cast<int>(*searched_quality), max_quality),
+        &output_contents_);
+  }
+  LumaPlane reference;
+  if (!reference.Read(pagespeed::image_compression::IMAGE_JPEG,
+                      original_jpeg.data(), original_jpeg.size(),
+                      pagespeed::image_compression::kSimilarityMaxDimension,
+                      handler_.get())) {
+    return encoder->Encode(max_quality, &output_contents_);
+  }
+  int quality = SearchQualityForSsim(
+      reference, output_format,
+      std::min(pagespeed::image_compression::kMinSearchedQuality,
+               max_quality),
+      max_quality, options_->target_ssim, encoder, handler_.get(),
+      &output_contents_);
+  if (quality < 0) {
+    return false;
+  }
+  *searched_quality = quality;
+  return true;
+}
+
 bool ImageImpl::ConvertAnimatedGifToWebp(bool has_transparency) {
   ConversionTimeoutHandler timeout_handler(
       options_->webp_conversion_timeout_ms, timer_, handler_.get());
@@ -965,7 +1073,7 @@ bool ImageImpl::ConvertAnimatedGifToWebp(bool has_transparency) {
   webp_config.progress_hook = ConversionTimeoutHandler::Continue;
   webp_config.user_data = &timeout_handler;
   // TODO(huibao): Evaluate the following parameters.
-  webp_config.method = 3;
+  webp_config.method = WebpMethod();
   webp_config.kmin = 3;
   webp_config.kmax = 5;
   webp_config.lossless = false;
@@ -1173,7 +1281,7 @@ bool ImageImpl::ConvertPngToWebp(
   // This is the default value in libpagespeed. We should evaluate
   // whether this is the optimal value, and consider making it
   // tunable.
-  webp_config.method = 3;
+  webp_config.method = WebpMethod();
   webp_config.quality = options_->webp_quality;
   webp_config.progress_hook = ConversionTimeoutHandler::Continue;
   webp_config.user_data = &timeout_handler;
@@ -1290,6 +1398,51 @@ void ImageImpl::ConvertToJpegOptions(const Image::CompressionOptions& options,
 
   jpeg_options->progressive = options.progressive_jpeg &&
       ShouldConvertToProgressive(output_quality);
+
+  if (options.fast_encode) {
+    jpeg_options->progressive = false;
+    jpeg_options->optimize_coding = false;
+    used_fast_encode_ = true;
+  }
+}
+
+int Image::WebpEncoderMethod(bool fast_encode) {
+  return fast_encode ? 0 : 3;
+}
+
+int ImageImpl::WebpMethod() {
+  if (options_->fast_encode) {
+    used_fast_encode_ = true;
+  }
+  return WebpEncoderMethod(options_->fast_encode);
+}
+
+bool ImageImpl::RecompressAtFullEffort() {
+  if (!CanRecompressAtFullEffort()) {
+    return false;
+  }
+  GoogleString fast_contents;
+  fast_contents.swap(output_contents_);
+  const ImageType fast_image_type = image_type_;
+  const int fast_conversions_attempted = options_->conversions_attempted;
+
+  options_->fast_encode = false;
+  options_->conversions_attempted = source_conversions_attempted_;
+  image_type_ = source_image_type_;
+  used_fast_encode_ = false;
+  output_valid_ = false;
+  rewrite_attempted_ = false;
+  if (ComputeOutputContents() && image_type_ == fast_image_type &&
+      output_contents_.size() < fast_contents.size()) {
+    return true;
+  }
+
+  // Keep the fast output.
+  output_contents_.swap(fast_contents);
+  image_type_ = fast_image_type;
+  options_->conversions_attempted = fast_conversions_attempted;
+  output_valid_ = true;
+  return false;
 }
 
 bool ImageImpl::ShouldConvertToProgressive(int64 quality) const {
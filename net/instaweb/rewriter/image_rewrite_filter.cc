@@ -60,12 +60,18 @@
 #include "pagespeed/controller/expensive_operation_callback.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/escaping.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/html/html_node.h"
@@ -74,6 +80,7 @@
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/response_headers.h"
 #include "pagespeed/kernel/http/semantic_type.h"
+#include "pagespeed/kernel/image/image_resizer.h"
 #include "pagespeed/kernel/image/image_util.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/util/simple_random.h"
@@ -221,6 +228,10 @@ const int ImageRewriteFilter::kRelatedFiltersSize = arraysize(kRelatedFilters);
 StringPieceVector* ImageRewriteFilter::related_options_ = NULL;
 
 // names for Statistics variables.
+const char ImageRewriteFilter::kImageAnytimeRefinements[] =
+    "image_anytime_refinements";
+const char ImageRewriteFilter::kImageAnytimeRefinementsDropped[] =
+    "image_anytime_refinements_dropped";
 const char ImageRewriteFilter::kImageRewrites[] = "image_rewrites";
 const char ImageRewriteFilter::kImageNoRewritesHighResolution[] =
     "image_norewrites_high_resolution";
@@ -249,6 +260,8 @@ const char ImageRewriteFilter::kImageOngoingRewrites[] =
     "image_ongoing_rewrites";
 const char ImageRewriteFilter::kImageResizedUsingRenderedDimensions[] =
     "image_resized_using_rendered_dimensions";
+const char ImageRewriteFilter::kImageResizesFromSharedDecode[] =
+    "image_resizes_from_shared_decode";
 const char ImageRewriteFilter::kImageWebpRewrites[] = "image_webp_rewrites";
 const char ImageRewriteFilter::kInlinableImageUrlsPropertyName[] =
     "ImageRewriter-inlinable-urls";
@@ -404,13 +417,29 @@ class ImageRewriteFilter::Context : public SingleRewriteContext {
         html_index_(html_index),
         in_noscript_element_(in_noscript_element),
         is_resized_using_rendered_dimensions_(
-            is_resized_using_rendered_dimensions) {}
-  virtual ~Context() {}
+            is_resized_using_rendered_dimensions),
+        responsive_role_(kNotResponsive),
+        searched_jpeg_quality_(-1),
+        searched_webp_quality_(-1) {}
+  virtual ~Context();
+
+  // Where this image stands among the <img> elements ResponsiveImageFirstFilter
+  // creates for one responsive image.  The virtual images are rewritten
+  // before the original one, which is rewritten last.
+  enum ResponsiveRole {
+    kNotResponsive,
+    kResponsiveVirtual,
+    kResponsiveOriginal,
+  };
+
+  void set_responsive_role(ResponsiveRole role) { responsive_role_ = role; }
+  ResponsiveRole responsive_role() const { return responsive_role_; }
 
   bool PolicyPermitsRendering() const override;
   virtual void Render();
   virtual void RewriteSingle(const ResourcePtr& input,
                              const OutputResourcePtr& output);
+  virtual void PartitionsWritten();
   virtual const char* id() const { return filter_->id(); }
   virtual OutputResourceKind kind() const { return kRewrittenResource; }
   virtual const UrlSegmentEncoder* encoder() const;
@@ -434,17 +463,46 @@ class ImageRewriteFilter::Context : public SingleRewriteContext {
 
  private:
   class InvokeRewriteFunction;
+  class SearchedQualityLookup;
 
   friend class ImageRewriteFilter;
 
   virtual bool ScheduleViaCentralController() { return true; }
 
+  // Whether this image's first encode is a quick one, to be refined later
+  // with ImageAnytimeEncoding.  That only applies to images referenced
+  // directly from HTML, whose cached partition can later be pointed at the
+  // refined encode; images in CSS and .pagespeed. fetches are always
+  // encoded at full effort.
+  bool UsesAnytimeEncoding() const {
+    return Options()->image_anytime_encoding() &&
+        (place_ == Place::kHtmlAttr || place_ == Place::kSrcset);
+  }
+
+  // Hands the rewrite to the central controller to run when there's
+  // capacity.
+  void ScheduleRewrite(const ResourcePtr& input_resource,
+                       const OutputResourcePtr& output_resource);
+
   int64 css_image_inline_max_bytes_;
   ImageRewriteFilter* filter_;
   Place place_;
   const int html_index_;
   bool in_noscript_element_;
   bool is_resized_using_rendered_dimensions_;
+  ResponsiveRole responsive_role_;
+
+  // With ImageTargetSsim, the metadata cache key remembering the qualities
+  // that a previous rewrite of this image searched for, and those qualities
+  // (-1 if unknown).  Filled in by SearchedQualityLookup before the rewrite
+  // is scheduled.
+  GoogleString searched_quality_key_;
+  int64 searched_jpeg_quality_;
+  int64 searched_webp_quality_;
+
+  // With ImageAnytimeEncoding, the full-effort re-encode of a quick result,
+  // waiting for the partition naming that result to be written.
+  scoped_ptr<Refinement> refinement_;
 
   DISALLOW_COPY_AND_ASSIGN(Context);
 };
@@ -488,6 +546,198 @@ class ImageRewriteFilter::Context::InvokeRewriteFunction
   DISALLOW_COPY_AND_ASSIGN(InvokeRewriteFunction);
 };
 
+// Looks up the qualities an earlier rewrite of the same image contents
+// settled on, so the SSIM search runs once per source image rather than
+// once per rewrite, then schedules the rewrite.  The value is
+// "<jpeg quality>,<webp quality>".
+class ImageRewriteFilter::Context::SearchedQualityLookup
+    : public CacheInterface::Callback {
+ public:
+  SearchedQualityLookup(ImageRewriteFilter::Context* context,
+                        const ResourcePtr& input_resource,
+                        const OutputResourcePtr& output_resource)
+      : context_(context),
+        input_resource_(input_resource),
+        output_resource_(output_resource) {}
+  virtual ~SearchedQualityLookup() {}
+
+  virtual void Done(CacheInterface::KeyState state) {
+    if (state == CacheInterface::kAvailable) {
+      StringPieceVector qualities;
+      SplitStringPieceToVector(value().Value(), ",", &qualities, false);
+      if (qualities.size() == 2) {
+        if (!StringToInt64(qualities[0].as_string(),
+                           &context_->searched_jpeg_quality_)) {
+          context_->searched_jpeg_quality_ = -1;
+        }
+        if (!StringToInt64(qualities[1].as_string(),
+                           &context_->searched_webp_quality_)) {
+          context_->searched_webp_quality_ = -1;
+        }
+      }
+    }
+    context_->ScheduleRewrite(input_resource_, output_resource_);
+    delete this;
+  }
+
+ private:
+  ImageRewriteFilter::Context* context_;
+  const ResourcePtr input_resource_;
+  const OutputResourcePtr output_resource_;
+
+  DISALLOW_COPY_AND_ASSIGN(SearchedQualityLookup);
+};
+
+// Second half of anytime encoding.  RewriteLoadedResourceImpl has already
+// written a quick encode of an image; once the context has cached the
+// partition naming it, Start() queues this task on the low-priority sequence
+// of a clone of the driver, so it is shed first under load and does not hold
+// up the request.  It re-encodes the image at full effort, writes the result
+// as a new output resource, and points the cached partition at it so later
+// page views serve the smaller image.
+//
+// The metadata cache has no compare-and-swap, so the partition is only
+// rewritten if its bytes are still exactly the ones the context wrote;
+// otherwise the work is dropped.  A concurrent write that lands between
+// that check and the Put is overwritten, but the partition written here
+// keeps the original input_info, so a changed input is still caught on the
+// next lookup.
+class ImageRewriteFilter::Refinement : public CacheInterface::Callback {
+ public:
+  // image and image_options are the Image built by RewriteLoadedResourceImpl
+  // and the options it took ownership of; the Image is owned by this.
+  Refinement(ImageRewriteFilter* filter, Image* image,
+             Image::CompressionOptions* image_options,
+             const ResourcePtr& input, const OutputResourcePtr& fast_output)
+      : refinements_(filter->image_anytime_refinements_),
+        refinements_dropped_(filter->image_anytime_refinements_dropped_),
+        webp_conversion_variables_(filter->webp_conversion_variables_),
+        content_type_(filter->ImageToContentType(input->url(), image)),
+        driver_(NULL),
+        image_(image),
+        input_(input),
+        fast_output_(fast_output) {
+    // The filter, and the variables it owns, go away with its driver.
+    image_options->webp_conversion_variables = &webp_conversion_variables_;
+  }
+  virtual ~Refinement() {}
+
+  // Called once the context has stored written under partition_key in the
+  // metadata cache.  From here on this deletes itself when done.
+  void Start(RewriteDriver* driver, const GoogleString& partition_key,
+             const OutputPartitions& written) {
+    partition_key_ = partition_key;
+    {
+      StringOutputStream sstream(&written_);  // finalizes in destructor
+      written.SerializeToZeroCopyStream(&sstream);
+    }
+    driver_ = driver->Clone();
+    fast_url_ = fast_output_->url();
+    refined_output_.reset(new OutputResource(
+        driver_, fast_output_->resolved_base(), fast_output_->unmapped_base(),
+        fast_output_->original_base(), fast_output_->full_name(),
+        fast_output_->kind()));
+    if (!fast_output_->cache_control_suffix().empty()) {
+      refined_output_->set_cache_control_suffix(
+          fast_output_->cache_control_suffix());
+    }
+    fast_output_.clear();
+    driver_->server_context()->MergeNonCachingResponseHeaders(
+        input_, refined_output_);
+    driver_->AddLowPriorityRewriteTask(MakeFunction(
+        this, &Refinement::Run, &Refinement::Cancel));
+  }
+
+  void Run() {
+    if (!image_->RecompressAtFullEffort() ||
+        !driver_->Write(
+            ResourceVector(1, input_), image_->Contents(), content_type_,
+            StringPiece() /* no charset for images */,
+            refined_output_.get())) {
+      Finish(false);
+      return;
+    }
+    driver_->server_context()->metadata_cache()->Get(partition_key_, this);
+  }
+
+  void Cancel() {
+    Finish(false);
+  }
+
+  virtual void Done(CacheInterface::KeyState state) {
+    bool updated = false;
+    if (state == CacheInterface::kAvailable &&
+        value().Value() == written_) {
+      ArrayInputStream input(written_.data(), written_.size());
+      OutputPartitions partitions;
+      if (partitions.ParseFromZeroCopyStream(&input)) {
+        for (int i = 0, n = partitions.partition_size(); i < n; ++i) {
+          CachedResult* partition = partitions.mutable_partition(i);
+          if (partition->url() == fast_url_) {
+            partition->set_url(refined_output_->url());
+            partition->set_size(image_->output_size());
+            if (partition->has_inlined_data()) {
+              partition->set_inlined_data(image_->Contents().data(),
+                                          image_->Contents().size());
+            }
+            updated = true;
+          }
+        }
+      }
+      if (updated) {
+        GoogleString buf;
+        {
+          StringOutputStream sstream(&buf);  // finalizes buf in destructor
+          partitions.SerializeToZeroCopyStream(&sstream);
+        }
+        driver_->server_context()->metadata_cache()->PutSwappingString(
+            partition_key_, &buf);
+      }
+    }
+    Finish(updated);
+  }
+
+ private:
+  void Finish(bool updated) {
+    if (updated) {
+      refinements_->Add(1);
+    } else {
+      refinements_dropped_->Add(1);
+    }
+    RewriteDriver* driver = driver_;
+    delete this;
+    driver->Cleanup();
+  }
+
+  Variable* refinements_;
+  Variable* refinements_dropped_;
+  Image::ConversionVariables webp_conversion_variables_;
+  const ContentType* content_type_;
+  RewriteDriver* driver_;
+  GoogleString partition_key_;
+  GoogleString written_;
+  GoogleString fast_url_;
+  scoped_ptr<Image> image_;
+  const ResourcePtr input_;
+  OutputResourcePtr fast_output_;
+  OutputResourcePtr refined_output_;
+
+  DISALLOW_COPY_AND_ASSIGN(Refinement);
+};
+
+ImageRewriteFilter::Context::~Context() {
+  if (refinement_.get() != NULL) {
+    // The partition was never written, so there is nothing to refine.
+    filter_->image_anytime_refinements_dropped_->Add(1);
+  }
+}
+
+void ImageRewriteFilter::Context::PartitionsWritten() {
+  if (refinement_.get() != NULL) {
+    refinement_.release()->Start(Driver(), partition_key(), *partitions());
+  }
+}
+
 // TODO(huibao): Move the logic for determining output format to a centralized
 // method which should consider all relevant factors.
 void SetWebpCompressionOptions(
@@ -561,6 +811,39 @@ void ImageRewriteFilter::Context::RewriteSingle(
   bool is_ipro = IsNestedIn(RewriteOptions::kInPlaceRewriteId);
   AttachDependentRequestTrace(is_ipro ? "IproProcessImage" : "ProcessImage");
   AddLinkRelCanonical(input_resource, output_resource->response_headers());
+  const int target_ssim = Options()->image_target_ssim();
+  if (target_ssim > 0) {
+    // The qualities depend on the target, on the qualities capping the
+    // search, on the WebP encoder settings and on the size the image is
+    // scaled to, as well as on the source contents.
+    const ResourceContext* context = resource_context();
+    Image::CompressionOptions max_qualities;
+    DetermineQualities(*Options(),
+                       (context != NULL) ? *context : ResourceContext(),
+                       *Driver()->request_properties(), &max_qualities);
+    searched_quality_key_ = StrCat(
+        "ssim_quality/", IntegerToString(target_ssim), "/",
+        Integer64ToString(max_qualities.jpeg_quality), ",",
+        Integer64ToString(max_qualities.webp_quality), "/");
+    StrAppend(&searched_quality_key_, "webp_method=",
+              IntegerToString(Image::WebpEncoderMethod(UsesAnytimeEncoding())),
+              "/", input_resource->ContentsHash());
+    if (context != NULL && context->has_desired_image_dims()) {
+      StrAppend(&searched_quality_key_, "/",
+                IntegerToString(context->desired_image_dims().width()), "x",
+                IntegerToString(context->desired_image_dims().height()));
+    }
+    FindServerContext()->metadata_cache()->Get(
+        searched_quality_key_,
+        new SearchedQualityLookup(this, input_resource, output_resource));
+  } else {
+    ScheduleRewrite(input_resource, output_resource);
+  }
+}
+
+void ImageRewriteFilter::Context::ScheduleRewrite(
+    const ResourcePtr& input_resource,
+    const OutputResourcePtr& output_resource) {
   FindServerContext()->central_controller()->ScheduleExpensiveOperation(
       new InvokeRewriteFunction(this, filter_, input_resource,
                                 output_resource));
@@ -655,13 +938,17 @@ void ImageRewriteFilter::Context::EncodeUserAgentIntoResourceContext(
 ImageRewriteFilter::ImageRewriteFilter(RewriteDriver* driver)
     : RewriteFilter(driver),
       image_counter_(0),
-      saw_end_document_(false) {
+      saw_end_document_(false),
+      saw_responsive_image_(false),
+      responsive_pyramid_mutex_(server_context()->thread_system()->NewMutex()) {
   Statistics* stats = server_context()->statistics();
   image_rewrites_ = stats->GetVariable(kImageRewrites);
   image_resized_using_rendered_dimensions_ =
       stats->GetVariable(kImageResizedUsingRenderedDimensions);
   image_norewrites_high_resolution_ = stats->GetVariable(
       kImageNoRewritesHighResolution);
+  image_resizes_from_shared_decode_ = stats->GetVariable(
+      kImageResizesFromSharedDecode);
   image_rewrites_dropped_intentionally_ =
       stats->GetVariable(kImageRewritesDroppedIntentionally);
   image_rewrites_dropped_decode_failure_ =
@@ -752,6 +1039,9 @@ ImageRewriteFilter::ImageRewriteFilter(RewriteDriver* driver)
       stats->GetHistogram(kImageRewriteLatencyFailedMs);
 
   image_ongoing_rewrites_ = stats->GetUpDownCounter(kImageOngoingRewrites);
+  image_anytime_refinements_ = stats->GetVariable(kImageAnytimeRefinements);
+  image_anytime_refinements_dropped_ =
+      stats->GetVariable(kImageAnytimeRefinementsDropped);
 }
 
 ImageRewriteFilter::~ImageRewriteFilter() {}
@@ -767,6 +1057,7 @@ void ImageRewriteFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kImageRewrites);
   statistics->AddVariable(kImageResizedUsingRenderedDimensions);
   statistics->AddVariable(kImageNoRewritesHighResolution);
+  statistics->AddVariable(kImageResizesFromSharedDecode);
   statistics->AddVariable(kImageRewritesDroppedIntentionally);
   statistics->AddVariable(kImageRewritesDroppedDecodeFailure);
   statistics->AddVariable(kImageRewritesDroppedMIMETypeUnknown);
@@ -786,6 +1077,8 @@ void ImageRewriteFilter::InitStats(Statistics* statistics) {
   statistics->AddUpDownCounter(kImageOngoingRewrites);
   statistics->AddHistogram(kImageRewriteLatencyOkMs);
   statistics->AddHistogram(kImageRewriteLatencyFailedMs);
+  statistics->AddVariable(kImageAnytimeRefinements);
+  statistics->AddVariable(kImageAnytimeRefinementsDropped);
 
   statistics->AddVariable(kImageWebpFromGifTimeouts);
   statistics->AddVariable(kImageWebpFromPngTimeouts);
@@ -833,7 +1126,13 @@ void ImageRewriteFilter::AddRelatedOptions(StringPieceVector* target) {
 void ImageRewriteFilter::StartDocumentImpl() {
   image_counter_ = 0;
   saw_end_document_ = false;
+  saw_responsive_image_ = false;
   inlinable_urls_.clear();
+  {
+    ScopedMutex lock(responsive_pyramid_mutex_.get());
+    responsive_pyramid_key_.clear();
+    responsive_pyramid_.reset();
+  }
   driver()->log_record()->LogRewriterHtmlStatus(
       RewriteOptions::kImageCompressionId, RewriterHtmlApplication::ACTIVE);
 }
@@ -850,6 +1149,16 @@ void ImageRewriteFilter::RenderDone() {
   if (!saw_end_document_) {
     return;
   }
+  if (saw_responsive_image_) {
+    // The kResponsiveOriginal rewrite that would normally free the decoded
+    // rasters may have been skipped, e.g. on a metadata cache hit, so don't
+    // leave them on this driver while it sits in the pool.
+    saw_responsive_image_ = false;
+    driver()->IncrementAsyncEventsCount();
+    driver()->AddLowPriorityRewriteTask(MakeFunction(
+        this, &ImageRewriteFilter::ReleaseResponsivePyramid,
+        &ImageRewriteFilter::ReleaseResponsivePyramid));
+  }
   if (!image_info_.empty()) {
     GoogleString code =
         "psMobStaticImageInfo = {";
@@ -874,6 +1183,15 @@ void ImageRewriteFilter::RenderDone() {
   image_info_.clear();
 }
 
+void ImageRewriteFilter::ReleaseResponsivePyramid() {
+  {
+    ScopedMutex lock(responsive_pyramid_mutex_.get());
+    responsive_pyramid_key_.clear();
+    responsive_pyramid_.reset();
+  }
+  driver()->DecrementAsyncEventsCount();
+}
+
 // Allocate and initialize CompressionOptions object based on RewriteOptions and
 // ResourceContext.
 Image::CompressionOptions* ImageRewriteFilter::ImageOptionsForLoadedResource(
@@ -920,6 +1238,9 @@ Image::CompressionOptions* ImageRewriteFilter::ImageOptionsForLoadedResource(
       !options->Enabled(RewriteOptions::kJpegSubsampling);
   image_options->webp_conversion_timeout_ms =
       options->image_webp_timeout_ms();
+  if (options->image_target_ssim() > 0) {
+    image_options->target_ssim = options->image_target_ssim() / 1000.0;
+  }
 
   return image_options;
 }
@@ -928,7 +1249,9 @@ Image::CompressionOptions* ImageRewriteFilter::ImageOptionsForLoadedResource(
 // if it's unnecessary or fails.
 bool ImageRewriteFilter::ResizeImageIfNecessary(
     const Context* rewrite_context, const GoogleString& url,
-    ResourceContext* resource_context, Image* image, CachedResult* cached) {
+    ResourceContext* resource_context, Image* image,
+    pagespeed::image_compression::ImagePyramid* pyramid,
+    CachedResult* cached) {
   bool resized = false;
   // Begin by resizing the image if necessary
   ImageDim image_dim;
@@ -952,7 +1275,12 @@ bool ImageRewriteFilter::ResizeImageIfNecessary(
     DCHECK_LT(0, desired_dim->height());
 
     const char* message;  // Informational message for logging only.
-    if (image->ResizeTo(*desired_dim)) {
+    bool shared_decode = (pyramid != NULL) && pyramid->initialized();
+    if ((pyramid != NULL) ? image->ResizeFromPyramid(*desired_dim, pyramid)
+                          : image->ResizeTo(*desired_dim)) {
+      if (shared_decode) {
+        image_resizes_from_shared_decode_->Add(1);
+      }
       post_resize_dim = desired_dim;
       message = "Resized";
       resized = true;
@@ -981,6 +1309,24 @@ bool ImageRewriteFilter::ResizeImageIfNecessary(
   return resized;
 }
 
+pagespeed::image_compression::ImagePyramid*
+ImageRewriteFilter::ResponsivePyramidFor(const Context* rewrite_context,
+                                         const ResourcePtr& input_resource) {
+  if (rewrite_context->responsive_role() == Context::kNotResponsive) {
+    return NULL;
+  }
+  GoogleString key = StrCat(
+      input_resource->url(), " ",
+      server_context()->contents_hasher()->Hash(
+          input_resource->ExtractUncompressedContents()));
+  if (responsive_pyramid_.get() == NULL || key != responsive_pyramid_key_) {
+    responsive_pyramid_key_.swap(key);
+    responsive_pyramid_.reset(new pagespeed::image_compression::ImagePyramid(
+        driver()->message_handler()));
+  }
+  return responsive_pyramid_.get();
+}
+
 // Determines whether an image should be resized based on the current options.
 //
 // Returns the dimensions to resize to in *desired_dimensions.
@@ -1081,6 +1427,12 @@ RewriteResult ImageRewriteFilter::RewriteLoadedResourceImpl(
 
   Image::CompressionOptions* image_options =
       ImageOptionsForLoadedResource(resource_context, input_resource);
+  const bool anytime_encoding = rewrite_context->UsesAnytimeEncoding();
+  image_options->fast_encode = anytime_encoding;
+  image_options->searched_jpeg_quality =
+      rewrite_context->searched_jpeg_quality_;
+  image_options->searched_webp_quality =
+      rewrite_context->searched_webp_quality_;
   scoped_ptr<Image> image(
       NewImage(input_resource->ExtractUncompressedContents(),
                input_resource->url(), server_context()->filename_prefix(),
@@ -1124,9 +1476,18 @@ RewriteResult ImageRewriteFilter::RewriteLoadedResourceImpl(
   Timer* timer = server_context()->timer();
   int64 rewrite_time_start_ms = GetCurrentCpuTimeMs(timer);
   CachedResult* cached = result->EnsureCachedResultCreated();
-  is_resized = ResizeImageIfNecessary(
-      rewrite_context, input_resource->url(),
-      &resource_context, image.get(), cached);
+  {
+    ScopedMutex lock(responsive_pyramid_mutex_.get());
+    is_resized = ResizeImageIfNecessary(
+        rewrite_context, input_resource->url(), &resource_context, image.get(),
+        ResponsivePyramidFor(rewrite_context, input_resource), cached);
+    if (rewrite_context->responsive_role() == Context::kResponsiveOriginal) {
+      // This is the last image of its group to be rewritten; don't hold on
+      // to the decoded rasters any longer.
+      responsive_pyramid_key_.clear();
+      responsive_pyramid_.reset();
+    }
+  }
 
   // When the "resize_images" filter has been turned on and the IMG tag has
   // width and/or height specified, we assume that the image will be resized so
@@ -1157,9 +1518,31 @@ RewriteResult ImageRewriteFilter::RewriteLoadedResourceImpl(
     // in order to get the smallest output.
     // TODO(huibao): rename output_size() to RecompressAndReturnOutputSize()
     optimized_size = image->output_size();
+    if (image->CanRecompressAtFullEffort() &&
+        optimized_size * 100 >=
+        image->input_size() * options->image_limit_optimized_percent()) {
+      // The quick encode doesn't save enough to be served at all, so spend
+      // the full effort now rather than dropping the rewrite.
+      image->RecompressAtFullEffort();
+      optimized_size = image->output_size();
+    }
     optimized_image_type = image->image_type();
     is_recompressed = true;
 
+    // Remember any qualities the SSIM search settled on for the next
+    // rewrite of this image.
+    if (!rewrite_context->searched_quality_key_.empty() &&
+        (image_options->searched_jpeg_quality !=
+             rewrite_context->searched_jpeg_quality_ ||
+         image_options->searched_webp_quality !=
+             rewrite_context->searched_webp_quality_)) {
+      GoogleString qualities = StrCat(
+          Integer64ToString(image_options->searched_jpeg_quality), ",",
+          Integer64ToString(image_options->searched_webp_quality));
+      server_context()->metadata_cache()->PutSwappingString(
+          rewrite_context->searched_quality_key_, &qualities);
+    }
+
     // The image has been recompressed (and potentially resized). However,
     // the recompressed image may not be used unless the file size is reduced.
     if (image->output_size() * 100 <
@@ -1341,6 +1724,12 @@ RewriteResult ImageRewriteFilter::RewriteLoadedResourceImpl(
       rewrite_context->is_resized_using_rendered_dimensions_,
       post_resize_dim.width(), post_resize_dim.height());
 
+  if (rewrite_result == kRewriteOk && image->CanRecompressAtFullEffort()) {
+    // Started by Context::PartitionsWritten once the quick result is cached.
+    rewrite_context->refinement_.reset(new Refinement(
+        this, image.release(), image_options, input_resource, result));
+  }
+
   return rewrite_result;
 }
 
@@ -1509,6 +1898,15 @@ void ImageRewriteFilter::BeginRewriteImageUrl(HtmlElement* element,
                                  Context::Place::kHtmlAttr, image_counter_++,
                                  noscript_element() != NULL,
                                  is_resized_using_rendered_dimensions);
+  const char* responsive_attr =
+      element->AttributeValue(HtmlName::kDataPagespeedResponsiveTemp);
+  if (responsive_attr != NULL) {
+    saw_responsive_image_ = true;
+    context->set_responsive_role(
+        (StringPiece(responsive_attr) ==
+         ResponsiveImageFirstFilter::kOriginalImage) ?
+        Context::kResponsiveOriginal : Context::kResponsiveVirtual);
+  }
   ResourceSlotPtr slot(driver()->GetSlot(input_resource, element, src));
   context->AddSlot(slot);
 
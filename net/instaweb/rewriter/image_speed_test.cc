@@ -33,25 +33,36 @@
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
 // interleaved runs with the old & new algorithm.
+//
+// Each benchmark also logs how many of the codecs' large scratch buffers
+// per rewrite had to come from malloc rather than the per-thread
+// ScratchPool (see pagespeed/kernel/image/codec_pool.h).  Once the pool
+// is warm this should be close to zero.
 
 #include "net/instaweb/rewriter/public/image.h"
 
+#include "base/logging.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
+#include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/benchmark.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/mock_message_handler.h"
 #include "pagespeed/kernel/base/mock_timer.h"
 #include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/image_types.pb.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/image/image_util.h"
 
 namespace net_instaweb {
 
 namespace {
 
+using pagespeed::image_compression::ScratchPool;
+
 const char kTestData[] = "/net/instaweb/rewriter/testdata/";
 const char kCuppa[] = "Cuppa.png";
 const char kIronChef[] = "IronChef2.gif";
@@ -87,9 +98,9 @@ class TestImageRewrite {
     options_->conversions_attempted = 0;
 
     // Rewrite the image.
-    net_instaweb::Image* image =
+    scoped_ptr<net_instaweb::Image> image(
         NewImage(contents_, file_name_, "/NOT-USED",
-                 options_, &timer_, &handler_);
+                 options_, &timer_, &handler_));
 
     if (image_dim != NULL && image_dim->has_width() &&
         image_dim->has_height()) {
@@ -100,6 +111,25 @@ class TestImageRewrite {
     EXPECT_NE(contents_.length(), image->output_size());
   }
 
+  // Rewrites the image iters times, then logs the number of pooled
+  // scratch buffers each rewrite allocated and reused.
+  void RewriteRepeatedly(int iters, const ImageDim* image_dim) {
+    int64 malloc_count = ScratchPool::malloc_count();
+    int64 reuse_count = ScratchPool::reuse_count();
+    for (int i = 0; i < iters; ++i) {
+      Rewrite(image_dim);
+    }
+    if (iters > 0) {
+      LOG(INFO) << file_name_ << ": "
+                << static_cast<double>(
+                       ScratchPool::malloc_count() - malloc_count) / iters
+                << " scratch mallocs and "
+                << static_cast<double>(
+                       ScratchPool::reuse_count() - reuse_count) / iters
+                << " reuses per rewrite";
+    }
+  }
+
  private:
   net_instaweb::StdioFileSystem file_system_;
   net_instaweb::MockMessageHandler handler_;
@@ -117,9 +147,7 @@ static void BM_ConvertJpegToJpeg(int iters) {
 
   TestImageRewrite test_rewrite(kPuzzle, &options);
   ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_JPEG));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertJpegToJpeg);
 
@@ -131,9 +159,7 @@ static void BM_ConvertJpegToWebp(int iters) {
 
   TestImageRewrite test_rewrite(kPuzzle, &options);
   ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_WEBP));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertJpegToWebp);
 
@@ -143,9 +169,7 @@ static void BM_ConvertPngToPng(int iters) {
 
   TestImageRewrite test_rewrite(kCuppa, &options);
   ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_PNG));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertPngToPng);
 
@@ -158,9 +182,7 @@ static void BM_ConvertPngToWebp(int iters) {
   TestImageRewrite test_rewrite(kCuppa, &options);
   ASSERT_TRUE(test_rewrite.Initialize(
       net_instaweb::IMAGE_WEBP_LOSSLESS_OR_ALPHA));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertPngToWebp);
 
@@ -170,9 +192,7 @@ static void BM_ConvertGifToPng(int iters) {
 
   TestImageRewrite test_rewrite(kIronChef, &options);
   ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_PNG));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertGifToPng);
 
@@ -188,9 +208,7 @@ static void BM_ConvertGifToWebp(int iters) {
   TestImageRewrite test_rewrite(kIronChef, &options);
   ASSERT_TRUE(test_rewrite.Initialize(
       net_instaweb::IMAGE_WEBP_LOSSLESS_OR_ALPHA));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertGifToWebp);
 
@@ -202,9 +220,7 @@ static void BM_ConvertWebpToWebp(int iters) {
 
   TestImageRewrite test_rewrite(kScenery, &options);
   ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_WEBP));
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(NULL /* no resizing */);
-  }
+  test_rewrite.RewriteRepeatedly(iters, NULL /* no resizing */);
 }
 BENCHMARK(BM_ConvertWebpToWebp);
 
@@ -220,9 +236,7 @@ static void BM_ResizeGifToWebp(int iters) {
   ImageDim image_dim;
   image_dim.set_width(190);
   image_dim.set_height(250);
-  for (int i = 0; i < iters; ++i) {
-    test_rewrite.Rewrite(&image_dim);
-  }
+  test_rewrite.RewriteRepeatedly(iters, &image_dim);
 }
 BENCHMARK(BM_ResizeGifToWebp);
 
@@ -988,6 +988,58 @@ TEST_F(ImageTest, UseJpegLossyIfInputQualityIsLowTest) {
                                               &message_handler_));
 }
 
+TEST_F(ImageTest, JpegQualityFromSsimTargetTest) {
+  Image::CompressionOptions* options = new Image::CompressionOptions();
+  SetJpegRecompressionAndQuality(options);
+  GoogleString buffer;
+  ImagePtr image(ReadFromFileWithOptions(kPuzzle, &buffer, options));
+  const size_t fixed_quality_size = image->output_size();
+
+  // A loose target lets the search go well below the configured quality.
+  options = new Image::CompressionOptions();
+  SetJpegRecompressionAndQuality(options);
+  options->target_ssim = 0.9;
+  buffer.clear();
+  image.reset(ReadFromFileWithOptions(kPuzzle, &buffer, options));
+  const int64 searched_quality = options->searched_jpeg_quality;
+  EXPECT_LE(30, searched_quality);
+  EXPECT_GT(85, searched_quality);
+  EXPECT_GT(fixed_quality_size, image->output_size());
+  const GoogleString searched_output = image->Contents().as_string();
+
+  // Supplying the remembered quality gives the same output without a search.
+  options = new Image::CompressionOptions();
+  SetJpegRecompressionAndQuality(options);
+  options->target_ssim = 0.9;
+  options->searched_jpeg_quality = searched_quality;
+  buffer.clear();
+  image.reset(ReadFromFileWithOptions(kPuzzle, &buffer, options));
+  EXPECT_EQ(searched_output, image->Contents().as_string());
+  EXPECT_EQ(searched_quality, options->searched_jpeg_quality);
+}
+
+TEST_F(ImageTest, FastEncodeThenRecompressAtFullEffortTest) {
+  Image::CompressionOptions* options = new Image::CompressionOptions();
+  SetJpegRecompressionAndQuality(options);
+  options->progressive_jpeg = true;
+  options->fast_encode = true;
+
+  GoogleString buffer;
+  ImagePtr image(ReadFromFileWithOptions(kPuzzle, &buffer, options));
+  size_t fast_size = image->output_size();
+  EXPECT_GT(buffer.size(), fast_size);
+  // The quick encode is baseline, even though progressive was requested.
+  EXPECT_EQ(1, GetNumScansInJpeg(image->Contents().as_string()));
+  ASSERT_TRUE(image->CanRecompressAtFullEffort());
+
+  EXPECT_TRUE(image->RecompressAtFullEffort());
+  EXPECT_EQ(IMAGE_JPEG, image->image_type());
+  EXPECT_GT(fast_size, image->output_size());
+  EXPECT_LT(1, GetNumScansInJpeg(image->Contents().as_string()));
+  EXPECT_FALSE(image->CanRecompressAtFullEffort());
+  EXPECT_FALSE(image->RecompressAtFullEffort());
+}
+
 TEST_F(ImageTest, JpegRetainColorProfileTest) {
   Image::CompressionOptions* options = new Image::CompressionOptions();
   SetJpegRecompressionAndQuality(options);
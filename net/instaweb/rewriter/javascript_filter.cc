@@ -307,6 +307,11 @@ class JavascriptFilter::Context : public SingleRewriteContext {
     }
   }
 
+  // Minification only touches the code block and output resources owned by
+  // this context; config_ is shared but only its thread-safe counters are
+  // written.
+  bool CanRewriteConcurrently() const override { return true; }
+
  private:
   // Take script_out, which is derived from the script at script_url,
   // and write it to script_dest.
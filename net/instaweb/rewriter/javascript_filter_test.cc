@@ -33,6 +33,7 @@
 #include "net/instaweb/rewriter/public/js_outline_filter.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/rewrite_test_base.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/support_noscript_filter.h"
@@ -217,6 +218,26 @@ TEST_P(JavascriptFilterTest, DoRewrite) {
                         "http://test.com/hello.js");
 }
 
+TEST_P(JavascriptFilterTest, DoRewriteInParallel) {
+  options()->set_parallel_rewrites(true);
+  InitFiltersAndTest(100);
+  const char kOtherJsName[] = "other.js";
+  const char kOtherJsData[] = "var   other  =  1 ;  // comment";
+  SetResponseWithDefaultHeaders(
+      kOtherJsName, kContentTypeJavascript, kOtherJsData, 100);
+  GoogleString other_rewritten_path =
+      Encode("", kFilterId, "0", kOtherJsName, "js");
+  ValidateExpected("do_rewrite_in_parallel",
+                   StrCat(GenerateHtml(kOrigJsName),
+                          GenerateHtml(kOtherJsName)),
+                   StrCat(GenerateHtml(expected_rewritten_path_.c_str()),
+                          GenerateHtml(other_rewritten_path.c_str())));
+  EXPECT_EQ(2, blocks_minified_->Get());
+  EXPECT_EQ(2, factory()->rewrite_stats()->
+                   num_rewrites_executed_in_parallel()->Get(
+                       TimedVariable::START));
+}
+
 TEST_P(JavascriptFilterTest, DontRewriteUnauthorizedDomain) {
   InitFiltersAndTest(100);
   ValidateNoChanges("dont_rewrite", GenerateHtml(kUnauthorizedJs));
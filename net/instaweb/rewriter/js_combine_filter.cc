@@ -50,6 +50,7 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string.h"
@@ -69,6 +70,8 @@ namespace net_instaweb {
 class MessageHandler;
 
 const char JsCombineFilter::kJsFileCountReduction[] = "js_file_count_reduction";
+const char JsCombineFilter::kJsCombineFragmentReuses[] =
+    "js_combine_fragment_reuses";
 
 // See file comment and ResourceCombiner docs for this class's role.
 class JsCombineFilter::JsCombiner : public ResourceCombiner {
@@ -80,6 +83,7 @@ class JsCombineFilter::JsCombiner : public ResourceCombiner {
         combined_js_size_(0) {
     Statistics* stats = server_context_->statistics();
     js_file_count_reduction_ = stats->GetVariable(kJsFileCountReduction);
+    fragment_reuses_ = stats->GetVariable(kJsCombineFragmentReuses);
   }
 
   virtual ~JsCombiner() {
@@ -192,9 +196,13 @@ class JsCombineFilter::JsCombiner : public ResourceCombiner {
 
   JavascriptCodeBlock* BlockForResource(const Resource* input);
 
+  // Returns input's code, minified if enabled, as a JS string literal.
+  GoogleString EscapedCode(const Resource* input);
+
   JsCombineFilter* filter_;
   int64 combined_js_size_;
   Variable* js_file_count_reduction_;
+  Variable* fragment_reuses_;
   // The charset from the resource's element, set by our owning Context's
   // Partition() method each time it checks if a resource can be added to the
   // current combination. The value is only safe to use in ResourceCombinable()
@@ -460,6 +468,30 @@ class JsCombineFilter::Context : public RewriteContext {
 bool JsCombineFilter::JsCombiner::WritePiece(
     int index, int num_pieces, const Resource* input,
     OutputResource* combination, Writer* writer, MessageHandler* handler) {
+  // We write out code of each script into a variable.
+  writer->Write(StrCat("var ",
+                       JsCombineFilter::VarName(
+                           rewrite_driver_, input->url()),
+                       " = "),
+                handler);
+
+  // The escaped code depends only on the contents and the options, so
+  // members shared with an earlier combination are not minified again.
+  GoogleString key = FragmentKey("code", "", input);
+  SharedString escaped;
+  if (LookupFragment(key, &escaped)) {
+    fragment_reuses_->Add(1);
+  } else {
+    escaped = SharedString(EscapedCode(input));
+    InsertFragment(key, escaped);
+  }
+
+  writer->Write(escaped.Value(), handler);
+  writer->Write(";\n", handler);
+  return true;
+}
+
+GoogleString JsCombineFilter::JsCombiner::EscapedCode(const Resource* input) {
   // Minify if needed.
   StringPiece not_escaped = input->ExtractUncompressedContents();
 
@@ -473,19 +505,9 @@ bool JsCombineFilter::JsCombiner::WritePiece(
     }
   }
 
-  // We write out code of each script into a variable.
-  writer->Write(StrCat("var ",
-                       JsCombineFilter::VarName(
-                           rewrite_driver_, input->url()),
-                       " = "),
-                handler);
-
   GoogleString escaped;
   JavascriptCodeBlock::ToJsStringLiteral(not_escaped, &escaped);
-
-  writer->Write(escaped, handler);
-  writer->Write(";\n", handler);
-  return true;
+  return escaped;
 }
 
 JavascriptCodeBlock* JsCombineFilter::JsCombiner::BlockForResource(
@@ -521,6 +543,7 @@ JsCombineFilter::~JsCombineFilter() {
 
 void JsCombineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kJsFileCountReduction);
+  statistics->AddVariable(kJsCombineFragmentReuses);
 }
 
 bool JsCombineFilter::IsLikelyStrictMode(
@@ -870,6 +870,33 @@ TEST_F(JsCombineFilterTest, TestCombineStats) {
   EXPECT_EQ(2, num_reduced->Get());
 }
 
+TEST_F(JsCombineFilterTest, ReuseFragmentsAcrossCombinations) {
+  Variable* reuses =
+      statistics()->GetVariable(JsCombineFilter::kJsCombineFragmentReuses);
+  ParseUrl(kTestDomain, StrCat("<script src=", kJsUrl1, "></script>",
+                               "<script src=", kJsUrl2, "></script>"));
+  EXPECT_EQ(0, reuses->Get());
+
+  // Adding a third file makes a new combination, but the first two files'
+  // escaped code is taken from the fragment cache.
+  ParseUrl(kTestDomain, StrCat("<script src=", kJsUrl1, "></script>",
+                               "<script src=", kJsUrl2, "></script>",
+                               "<script src=", kJsUrl3, "></script>"));
+  EXPECT_EQ(2, reuses->Get());
+}
+
+TEST_F(JsCombineFilterTest, FragmentCacheDisabled) {
+  server_context()->set_combine_fragment_cache(NULL);
+  Variable* reuses =
+      statistics()->GetVariable(JsCombineFilter::kJsCombineFragmentReuses);
+  ParseUrl(kTestDomain, StrCat("<script src=", kJsUrl1, "></script>",
+                               "<script src=", kJsUrl2, "></script>"));
+  ParseUrl(kTestDomain, StrCat("<script src=", kJsUrl1, "></script>",
+                               "<script src=", kJsUrl2, "></script>",
+                               "<script src=", kJsUrl3, "></script>"));
+  EXPECT_EQ(0, reuses->Get());
+}
+
 TEST_F(JsCombineFilterTest, TestCombineShard) {
   // Make sure we produce consistent output when sharding/serving off a
   // different host.
@@ -0,0 +1,108 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef NET_INSTAWEB_REWRITER_PUBLIC_ADAPTIVE_REWRITE_DEADLINE_H_
+#define NET_INSTAWEB_REWRITER_PUBLIC_ADAPTIVE_REWRITE_DEADLINE_H_
+
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+
+namespace net_instaweb {
+
+// Tunes the per-flush rewrite deadline from what the rewrites of recent
+// flush windows actually did, for RewriteDriver when
+// RewriteOptions::rewrite_deadline_latency_target_ms() is set.
+//
+// Each flush window that waited on rewrites reports how long it waited --
+// the latency the deadline added to the HTML -- and how many of its
+// rewrites completed in time.  Every kAdjustmentInterval reports, the base
+// deadline is re-tuned against the 95th percentile of the recent waits:
+// if that is over the target, the deadline is cut in proportion; if it is
+// under the target while rewrites are still missing the deadline, the
+// deadline is raised, since there is latency budget left to spend on them.
+// Waits usually end well before the deadline when rewrites hit in cache,
+// so the deadline may settle above the target itself.
+//
+// Independently of that, the deadline handed out for each flush shrinks
+// towards kMinDeadlineMs as the rewrite queues approach their
+// load-shedding threshold, as waiting on rewrites that are about to be
+// dropped only adds latency.
+class AdaptiveRewriteDeadline {
+ public:
+  // Number of recent flush windows whose waits are kept.
+  static const int kNumSamples = 100;
+  // The base deadline is re-tuned after this many new flush windows.
+  static const int kAdjustmentInterval = 20;
+  // A deadline <= 0 means to wait forever, so never go below this.
+  static const int64 kMinDeadlineMs = 1;
+  // The base deadline never exceeds this multiple of the target.
+  static const int kMaxDeadlineTargetMultiple = 4;
+
+  // Takes ownership of mutex.
+  explicit AdaptiveRewriteDeadline(AbstractMutex* mutex);
+  ~AdaptiveRewriteDeadline();
+
+  // Returns the deadline for the next flush window.  initial_deadline_ms,
+  // normally RewriteOptions::rewrite_deadline_ms(), seeds the base
+  // deadline on first use.  load is the fraction of the rewrite queues'
+  // load-shedding threshold in use, from 0 to 1.
+  int64 DeadlineMs(int64 target_ms, int64 initial_deadline_ms, double load)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Reports a flush window that initiated num_rewrites rewrites, of which
+  // num_completed finished within the waited_ms spent waiting for them.
+  // Windows without rewrites add no latency and are ignored.
+  void RecordFlush(int64 target_ms, int64 waited_ms, int num_rewrites,
+                   int num_completed) LOCKS_EXCLUDED(mutex_);
+
+  // The deadline before any load adjustment, or -1 before first use.
+  int64 base_deadline_ms() const LOCKS_EXCLUDED(mutex_);
+
+  // Moving average of the fraction of rewrites that met their deadline.
+  double completion_rate() const LOCKS_EXCLUDED(mutex_);
+
+  // Returns the given percentile of the recorded waits, or -1 if there are
+  // none.
+  int64 WaitPercentileMs(int percentile) const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  int64 MaxDeadlineMs(int64 target_ms) const;
+  int64 WaitPercentileMsLockHeld(int percentile) const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void AdjustLockHeld(int64 target_ms) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  scoped_ptr<AbstractMutex> mutex_;
+  int64 base_deadline_ms_ GUARDED_BY(mutex_);
+  double completion_rate_ GUARDED_BY(mutex_);
+  // Circular buffer of the most recent waits.
+  std::vector<int64> waits_ms_ GUARDED_BY(mutex_);
+  int next_sample_ GUARDED_BY(mutex_);
+  int samples_since_adjustment_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(AdaptiveRewriteDeadline);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_REWRITER_PUBLIC_ADAPTIVE_REWRITE_DEADLINE_H_
@@ -0,0 +1,85 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#ifndef NET_INSTAWEB_REWRITER_PUBLIC_COMBINE_FRAGMENT_CACHE_H_
+#define NET_INSTAWEB_REWRITER_PUBLIC_COMBINE_FRAGMENT_CACHE_H_
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/cache/lru_cache_base.h"
+
+namespace net_instaweb {
+
+// An in-memory, thread-safe LRU of the per-member output of combining
+// filters: minified and escaped JavaScript, CSS with its URLs resolved, and
+// the verdict of the CSS parse check.  Entries are keyed by (a hash of)
+// the member's contents plus whatever else the output depends on, so a new
+// combination that shares members with an earlier one only does the work
+// for the members it has not seen before and concatenates the rest.
+//
+// Unlike the metadata and HTTP caches this is synchronous and local to the
+// process, since combiners assemble their output inside a single call.
+class CombineFragmentCache {
+ public:
+  static const size_t kDefaultMaxBytes = 4 * 1024 * 1024;
+
+  // Takes ownership of mutex.
+  CombineFragmentCache(size_t max_bytes, AbstractMutex* mutex);
+  ~CombineFragmentCache();
+
+  // Returns true and sets *value if key is present.
+  bool Lookup(StringPiece key, SharedString* value) LOCKS_EXCLUDED(mutex_);
+  void Insert(StringPiece key, const SharedString& value)
+      LOCKS_EXCLUDED(mutex_);
+
+  size_t num_elements() const LOCKS_EXCLUDED(mutex_);
+  void Clear() LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct SharedStringHelper {
+    size_t size(const SharedString& ss) const { return ss.size(); }
+    bool Equal(const SharedString& a, const SharedString& b) const {
+      return a.Value() == b.Value();
+    }
+    void EvictNotify(const SharedString& a) {}
+    bool ShouldReplace(const SharedString& old_value,
+                       const SharedString& new_value) const {
+      return true;
+    }
+  };
+  typedef LRUCacheBase<SharedString, SharedStringHelper> Lru;
+
+  scoped_ptr<AbstractMutex> mutex_;
+  SharedStringHelper value_helper_;
+  Lru lru_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(CombineFragmentCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_REWRITER_PUBLIC_COMBINE_FRAGMENT_CACHE_H_
@@ -46,6 +46,9 @@ class CssCombineFilter : public RewriteFilter {
   static const char kCssCombineOpportunities[];
   // CSS file reduction (Optimally this equals kCssCombineOpportunities).
   static const char kCssFileCountReduction[];
+  // Members whose parse check or resolved text came from the
+  // CombineFragmentCache instead of being recomputed.
+  static const char kCssCombineFragmentReuses[];
 
   explicit CssCombineFilter(RewriteDriver* rewrite_driver);
   virtual ~CssCombineFilter();
@@ -31,6 +31,12 @@
 #include "pagespeed/kernel/http/image_types.pb.h"
 #include "pagespeed/kernel/image/image_util.h"
 
+namespace pagespeed {
+namespace image_compression {
+class ImagePyramid;
+}  // namespace image_compression
+}  // namespace pagespeed
+
 namespace net_instaweb {
 class Histogram;
 class MessageHandler;
@@ -109,6 +115,10 @@ class Image {
           jpeg_num_progressive_scans(
               RewriteOptions::kDefaultImageJpegNumProgressiveScans),
           webp_conversion_timeout_ms(-1),
+          fast_encode(false),
+          target_ssim(0.0),
+          searched_jpeg_quality(-1),
+          searched_webp_quality(-1),
           conversions_attempted(0),
           preserve_lossless(false),
           webp_conversion_variables(NULL) {}
@@ -135,6 +145,20 @@ class Image {
     bool use_transparent_for_blank_image;
     int64 jpeg_num_progressive_scans;
     int64 webp_conversion_timeout_ms;
+    // Favor encoding speed over output size: libwebp runs at method 0, and
+    // JPEGs are written baseline without optimized Huffman tables.  Used
+    // for the first pass of anytime encoding; see RecompressAtFullEffort.
+    bool fast_encode;
+    // If positive, recompressing a JPEG to JPEG or lossy WebP uses the
+    // lowest quality (down to kMinSearchedQuality) whose output still has
+    // this SSIM against the source; jpeg_quality and webp_quality become
+    // upper bounds.
+    double target_ssim;
+    // The qualities that search settled on.  A caller that remembers them
+    // from an earlier rewrite of the same image can set them to skip the
+    // search.  Recompression fills in any it searched for.
+    int64 searched_jpeg_quality;
+    int64 searched_webp_quality;
 
     // These fields are set by the conversion routines to report
     // characteristics of the conversion process.
@@ -149,6 +173,10 @@ class Image {
   // static method to convert image type to content type.
   static const ContentType* TypeToContentType(ImageType t);
 
+  // The libwebp method (0=fast, 6=slower-better) that lossy and lossless
+  // WebP encodes use for the given CompressionOptions::fast_encode.
+  static int WebpEncoderMethod(bool fast_encode);
+
   // Stores the image dimensions in natural_dim (on success, sets
   // natural_dim->{width, height} and
   // ImageUrlEncoder::HasValidDimensions(natural_dim) == true).  This
@@ -187,6 +215,14 @@ class Image {
   // fails.  Otherwise the image contents and type can change.
   virtual bool ResizeTo(const ImageDim& new_dim) = 0;
 
+  // Like ResizeTo, but takes the pixels from 'pyramid' instead of decoding
+  // the original contents again, so that several sizes of one image cost a
+  // single decode.  An uninitialized 'pyramid' is initialized by decoding
+  // this image; an initialized one must hold this image.
+  virtual bool ResizeFromPyramid(
+      const ImageDim& new_dim,
+      pagespeed::image_compression::ImagePyramid* pyramid) = 0;
+
   // Enable the transformation to low res image. If low res image is enabled,
   // all jpeg images are transformed to low quality jpeg images and all webp
   // images to low quality webp images, if possible.
@@ -225,6 +261,15 @@ class Image {
   // Sets the URL to be printed in debug messages.
   virtual void SetDebugMessageUrl(const GoogleString& url) = 0;
 
+  // Returns true if the current output was produced with
+  // options->fast_encode and a full-effort encode might improve on it.
+  virtual bool CanRecompressAtFullEffort() const = 0;
+
+  // Compresses the (possibly resized) image again with fast_encode turned
+  // off.  The new output replaces the current one only if it is smaller and
+  // of the same type; returns true if it did.
+  virtual bool RecompressAtFullEffort() = 0;
+
  protected:
   explicit Image(const StringPiece& original_contents);
   explicit Image(ImageType type);
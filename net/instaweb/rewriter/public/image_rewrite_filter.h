@@ -34,11 +34,14 @@
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
 #include "net/instaweb/rewriter/public/server_context.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/printf_format.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/image_types.pb.h"
@@ -69,9 +72,12 @@ class ImageRewriteFilter : public RewriteFilter {
   typedef std::map<GoogleString, AssociatedImageInfo> AssociatedImageInfoMap;
 
   // Statistic names:
+  static const char kImageAnytimeRefinements[];
+  static const char kImageAnytimeRefinementsDropped[];
   static const char kImageNoRewritesHighResolution[];
   static const char kImageOngoingRewrites[];
   static const char kImageResizedUsingRenderedDimensions[];
+  static const char kImageResizesFromSharedDecode[];
   static const char kImageRewriteLatencyFailedMs[];
   static const char kImageRewriteLatencyOkMs[];
   static const char kImageRewriteLatencyTotalMs[];
@@ -197,9 +203,25 @@ class ImageRewriteFilter : public RewriteFilter {
 
   // Resize image if necessary, returning true if this resizing succeeds and
   // false if it's unnecessary or fails.
+  // If pyramid is non-NULL, the image is resized through it.
   bool ResizeImageIfNecessary(
       const Context* rewrite_context, const GoogleString& url,
-      ResourceContext* context, Image* image, CachedResult* cached);
+      ResourceContext* context, Image* image,
+      pagespeed::image_compression::ImagePyramid* pyramid,
+      CachedResult* cached);
+
+  // Returns the pyramid responsive images of input_resource should be
+  // resized through, replacing any held for a different image, or NULL if
+  // rewrite_context is not part of a responsive image.
+  pagespeed::image_compression::ImagePyramid* ResponsivePyramidFor(
+      const Context* rewrite_context, const ResourcePtr& input_resource)
+      EXCLUSIVE_LOCKS_REQUIRED(responsive_pyramid_mutex_);
+
+  // Frees responsive_pyramid_.  Queued on the low-priority sequence by the
+  // final RenderDone, so that it runs after any rewrite still using it.  It
+  // is also the task's cancel method, which may run on another thread while
+  // a rewrite is using the pyramid, so it waits for responsive_pyramid_mutex_.
+  void ReleaseResponsivePyramid() LOCKS_EXCLUDED(responsive_pyramid_mutex_);
 
   // Allocate and initialize CompressionOptions object based on RewriteOptions
   // and ResourceContext.
@@ -223,6 +245,7 @@ class ImageRewriteFilter : public RewriteFilter {
   virtual RewriteContext* MakeRewriteContext();
 
  private:
+  class Refinement;
   friend class Context;
 
   // Helper methods.
@@ -298,6 +321,8 @@ class ImageRewriteFilter : public RewriteFilter {
   Variable* image_resized_using_rendered_dimensions_;
   // # of images that we decided not to rewrite because of size constraint.
   Variable* image_norewrites_high_resolution_;
+  // # of responsive image resizes that reused an earlier decode.
+  Variable* image_resizes_from_shared_decode_;
   // # of images that we decided not to serve rewritten. This could be because
   // the rewrite failed, recompression wasn't effective enough, the image
   // couldn't be resized because it had an alpha-channel, etc.
@@ -339,6 +364,11 @@ class ImageRewriteFilter : public RewriteFilter {
   Variable* image_webp_rewrites_;
   // # of images being rewritten right now.
   UpDownCounter* image_ongoing_rewrites_;
+  // # of quick anytime encodes replaced in the metadata cache by a
+  // full-effort encode, and # of full-effort encodes that were cancelled,
+  // saved nothing, or found the metadata already changed.
+  Variable* image_anytime_refinements_;
+  Variable* image_anytime_refinements_dropped_;
 
   // # total number of milliseconds spent rewriting images since server start
   Variable* image_rewrite_latency_total_ms_;
@@ -367,6 +397,19 @@ class ImageRewriteFilter : public RewriteFilter {
   std::map<GoogleString, AssociatedImageInfo> image_info_;
   // Used to figure out which RenderDone() call is the last one.
   bool saw_end_document_;
+  // Whether this document has a responsive image, and so may have left
+  // rasters in responsive_pyramid_.  Only touched on the HTML thread.
+  bool saw_responsive_image_;
+
+  // Decoded rasters of the image most recently resized for a responsive
+  // <img>, so that the other sizes ResponsiveImageFirstFilter asks for can
+  // be produced without decoding it again.  responsive_pyramid_key_ holds
+  // the URL and content hash of that image.  RewriteLoadedResourceImpl
+  // holds responsive_pyramid_mutex_ for as long as it uses the pyramid.
+  scoped_ptr<AbstractMutex> responsive_pyramid_mutex_;
+  GoogleString responsive_pyramid_key_ GUARDED_BY(responsive_pyramid_mutex_);
+  scoped_ptr<pagespeed::image_compression::ImagePyramid> responsive_pyramid_
+      GUARDED_BY(responsive_pyramid_mutex_);
 
   DISALLOW_COPY_AND_ASSIGN(ImageRewriteFilter);
 };
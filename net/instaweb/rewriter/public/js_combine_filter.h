@@ -68,6 +68,9 @@ class Statistics;
 class JsCombineFilter : public RewriteFilter {
  public:
   static const char kJsFileCountReduction[];  // statistics variable name
+  // Members whose escaped code came from the CombineFragmentCache instead
+  // of being minified again.
+  static const char kJsCombineFragmentReuses[];
 
   // rewrite_driver is the context owning us, and filter_id is the ID we
   // are registered under.
@@ -261,6 +261,11 @@ class Resource : public RefCounted<Resource> {
   // successful.
   bool Link(HTTPValue* source, MessageHandler* handler);
 
+  // Shares the contents, headers and fetch status of loaded, another
+  // resource for the same URL that has finished loading, as if this
+  // resource had loaded them itself.
+  void LinkLoadedResource(Resource* loaded);
+
   // Freshen a soon-to-expire resource so that we minimize the number
   // of cache misses when serving live traffic.
   // Note that callback may be NULL, and all subclasses must handle this.
@@ -40,6 +40,7 @@ class MessageHandler;
 class OutputResource;
 class RewriteDriver;
 class RewriteFilter;
+class SharedString;
 class Writer;
 
 // A boolean with an expiration date.
@@ -127,6 +128,19 @@ class ResourceCombiner {
   // Your implementation must call the superclass.
   virtual void Clear();
 
+  // Builds a key for per-member work in the server's CombineFragmentCache.
+  // The key covers the filter, the rewrite options and the contents of
+  // input; kind names the piece of work, and qualifier carries anything
+  // else the result depends on (e.g. the input and output URLs).  Returns
+  // the empty string if the cache is disabled.
+  GoogleString FragmentKey(StringPiece kind, StringPiece qualifier,
+                           const Resource* input);
+
+  // Looks up and stores fragments in the server's CombineFragmentCache.
+  // Both do nothing if the cache is disabled.
+  bool LookupFragment(const GoogleString& key, SharedString* fragment);
+  void InsertFragment(const GoogleString& key, const SharedString& fragment);
+
   ServerContext* const server_context_;
   RewriteDriver* const rewrite_driver_;
 
@@ -173,6 +187,7 @@ class ResourceCombiner {
   int prev_num_components_;
   int accumulated_leaf_size_;
   GoogleString resolved_base_;
+  GoogleString options_signature_hash_;  // Computed on first FragmentKey.
   const int url_overhead_;
   RewriteFilter* filter_;
 
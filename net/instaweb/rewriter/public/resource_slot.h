@@ -180,6 +180,9 @@ class ResourceSlot : public RefCounted<ResourceSlot> {
   // if no context has been added to the slot so far.
   RewriteContext* LastContext() const;
 
+  // Number of contexts currently attached to this slot.
+  int num_contexts() const { return contexts_.size(); }
+
   // Adds a new context to this slot.
   void AddContext(RewriteContext* context) { contexts_.push_back(context); }
 
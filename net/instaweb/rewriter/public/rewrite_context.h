@@ -42,6 +42,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/util/url_segment_encoder.h"
 
 namespace net_instaweb {
@@ -267,6 +268,10 @@ class RewriteContext {
   // This particular rewrite was a metadata cache miss.
   bool is_metadata_cache_miss() const { return is_metadata_cache_miss_; }
 
+  // The metadata cache key under which this context's OutputPartitions are
+  // stored.  Empty until the partition key has been computed.
+  const GoogleString& partition_key() const { return partition_key_; }
+
   // Returns true if this is a nested rewriter.
   bool has_parent() const { return parent_ != NULL; }
 
@@ -464,6 +469,12 @@ class RewriteContext {
   // set_disable_further_processing. Default implementation does nothing.
   virtual void Cancel();
 
+  // Called (in Rewrite thread) once this context's partitions() have been
+  // written to the metadata cache under partition_key().  Work that revises
+  // the cached result later should start here, so it cannot race the write.
+  // Default implementation does nothing.
+  virtual void PartitionsWritten() {}
+
   // This final set of protected methods can be optionally overridden
   // by subclasses.
 
@@ -622,6 +633,15 @@ class RewriteContext {
   // true, allowing more intelligent prioritization.
   virtual bool ScheduleViaCentralController() { return false; }
 
+  // Whether Rewrite() touches only state owned by this context, plus
+  // thread-safe services such as statistics, caches and the driver's
+  // output-resource methods.  When RewriteOptions::parallel_rewrites() is
+  // on, top-level contexts that return true and share no slots with other
+  // contexts get their own low-priority sequence, so that several of them
+  // can be rewritten at once.  Rendering still happens on the driver's
+  // rewrite thread, in order.
+  virtual bool CanRewriteConcurrently() const { return false; }
+
   // In general, ScheduleViaCentralController() is ignored for nested Contexts.
   // However, in the case of (at least) IPRO we need to schedule the inner
   // context via the Controller. This can be overridden by such contexts, which
@@ -741,6 +761,11 @@ class RewriteContext {
   // IPRO or .pagespeed. URLs) and false otherwise.
   bool IsFetchRewrite() const { return fetch_.get() != NULL; }
 
+  // Returns true if this context's rewrites may run on a sequence of their
+  // own rather than the driver's shared low-priority sequence.  See
+  // CanRewriteConcurrently().
+  bool CanRunInParallel() const;
+
   // Called on the parent from a nested Rewrite when it is complete.
   // Note that we don't track rewrite success/failure here.  We only
   // care whether the nested rewrites are complete, and whether there
@@ -975,6 +1000,11 @@ class RewriteContext {
   // completion (which may have occurred already).
   bool chained_;
 
+  // Sequence on which this context's Rewrite() calls run when it was
+  // eligible for parallel rewriting; NULL if they run on the driver's
+  // low-priority sequence.
+  QueuedWorkerPool::Sequence* parallel_rewrite_worker_;
+
   // TODO(jmarantz): Refactor to replace a bunch bool member variables with
   // an explicit state_ member variable, with a set of possibilties that
   // look something like this:
@@ -48,6 +48,7 @@
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/srcset_slot.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/allocation_profiler.h"
 #include "pagespeed/kernel/base/atomic_bool.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
@@ -93,6 +94,7 @@ class RequestProperties;
 class RequestTrace;
 class RewriteDriverPool;
 class RewriteFilter;
+class SpeculativeFetchFilter;
 class Statistics;
 class UrlLeftTrimFilter;
 class UrlNamer;
@@ -959,6 +961,14 @@ class RewriteDriver : public HtmlParse {
   // Such tasks are expected to be safely cancelable.
   void AddLowPriorityRewriteTask(Function* task);
 
+  // Returns a fresh sequence on the low-priority rewrite pool, so that a
+  // RewriteContext can run its rewrites concurrently with those of other
+  // contexts in this driver.  Tasks added to it have the same cancellation
+  // semantics as AddLowPriorityRewriteTask.  Returns NULL if the pool is
+  // shutting down.  Release with FreeParallelRewriteSequence.
+  QueuedWorkerPool::Sequence* NewParallelRewriteSequence();
+  void FreeParallelRewriteSequence(QueuedWorkerPool::Sequence* sequence);
+
   QueuedWorkerPool::Sequence* html_worker() { return html_worker_; }
   Sequence* rewrite_worker();
   Scheduler::Sequence* scheduler_sequence() {
@@ -1163,6 +1173,12 @@ class RewriteDriver : public HtmlParse {
     return dom_stats_filter_;
   }
 
+  // Returns the filter that loads resources as the lexer discovers them, or
+  // NULL if SpeculativeResourceFetch is off.
+  SpeculativeFetchFilter* speculative_fetch_filter() const {
+    return speculative_fetch_filter_;
+  }
+
   // Determines whether the system is healthy enough to rewrite resources.
   // Currently, systems get sick based on the health of the metadata cache.
   bool can_rewrite_resources() const { return can_rewrite_resources_; }
@@ -1310,6 +1326,10 @@ class RewriteDriver : public HtmlParse {
   // (configured via max_page_processing_delay_ms()).
   int64 ComputeCurrentFlushWindowRewriteDelayMs();
 
+  // Returns how close the low-priority rewrite workers are to shedding
+  // load, from 0 (idle, or no threshold) to 1 (at the threshold).
+  double RewriteQueueLoad();
+
   // Queues up invocation of FlushAsyncDone in our html_workers sequence.
   void QueueFlushAsyncDone(int num_rewrites, Function* callback);
 
@@ -1340,6 +1360,20 @@ class RewriteDriver : public HtmlParse {
   // Parses an arbitrary block of an html file
   virtual void ParseTextInternal(const char* content, int size);
 
+  // Decides, per RewriteOptions::filter_cpu_sample_percentage(), whether
+  // the CPU time of each filter is accounted for this request.
+  void SampleFilterCpu();
+
+  // Sets the QueuedWorkerPool priority class of this driver's html and
+  // rewrite sequences to request_priority, and of its low-priority rewrite
+  // sequence and any parallel rewrite sequences to rewrite_priority, so
+  // that load-shedding drops work no client is waiting for first.
+  void SetWorkerPriorities(QueuedWorkerPool::Priority request_priority,
+                           QueuedWorkerPool::Priority rewrite_priority);
+
+  // Charges HTML event processing time to filter's RewriteFilter id.
+  virtual void RecordFilterCpuUs(HtmlFilter* filter, int64 cpu_us);
+
   // Indicates whether we should skip parsing for the given request.
   bool ShouldSkipParsing();
 
@@ -1646,6 +1680,7 @@ class RewriteDriver : public HtmlParse {
   std::vector<UrlAsyncFetcher*> owned_url_async_fetchers_;
 
   DomStatsFilter* dom_stats_filter_;
+  SpeculativeFetchFilter* speculative_fetch_filter_;  // owned by HtmlParse
   scoped_ptr<HtmlWriterFilter> html_writer_filter_;
 
   ScanFilter scan_filter_;
@@ -1689,6 +1724,8 @@ class RewriteDriver : public HtmlParse {
   QueuedWorkerPool::Sequence* html_worker_;
   QueuedWorkerPool::Sequence* rewrite_worker_;
   QueuedWorkerPool::Sequence* low_priority_rewrite_worker_;
+  // Priority class for sequences from NewParallelRewriteSequence.
+  QueuedWorkerPool::Priority parallel_rewrite_priority_;
   scoped_ptr<Scheduler::Sequence> scheduler_sequence_;
 
   Writer* writer_;
@@ -1722,6 +1759,10 @@ class RewriteDriver : public HtmlParse {
   // The total number of bytes for which ParseText is called.
   int num_bytes_in_;
 
+  // Heap allocations made while parsing and rendering this page, when
+  // AllocationProfiler is enabled.
+  AllocationProfiler::Counts allocation_counts_;
+
   DebugFilter* debug_filter_;
 
   scoped_ptr<FlushEarlyInfo> flush_early_info_;
@@ -1737,6 +1778,10 @@ class RewriteDriver : public HtmlParse {
   // Start time for HTML requests. Used for statistics reporting.
   int64 start_time_ms_;
 
+  // When the current flush window started waiting on its rewrites, if its
+  // wait is to be reported to the AdaptiveRewriteDeadline; otherwise -1.
+  int64 flush_wait_start_ms_ GUARDED_BY(rewrite_mutex());
+
   scoped_ptr<RequestProperties> request_properties_;
 
   // Helps make sure RewriteDriver and its children are initialized exactly
@@ -41,6 +41,7 @@ namespace pagespeed { namespace js { struct JsTokenizerPatterns; } }
 
 namespace net_instaweb {
 
+class CombineFragmentCache;
 class CriticalImagesFinder;
 class CriticalSelectorFinder;
 class FileSystem;
@@ -129,6 +130,16 @@ class RewriteDriverFactory {
   // fecher to return cached versions.
   void set_force_caching(bool u) { force_caching_ = u; }
 
+  // Sets the size of the per-member fragment cache shared by the combining
+  // filters of every ServerContext; 0 disables it.  Must be called before
+  // the first call to InitServerContext.
+  void set_combine_fragment_cache_bytes(int64 bytes) {
+    combine_fragment_cache_bytes_ = bytes;
+  }
+  int64 combine_fragment_cache_bytes() const {
+    return combine_fragment_cache_bytes_;
+  }
+
   // You can call set_base_url_async_fetcher to set up real async fetching
   // for real serving or for modeling of live traffic.
   //
@@ -166,6 +177,8 @@ class RewriteDriverFactory {
   QueuedWorkerPool* WorkerPool(WorkerPoolCategory pool);
   Scheduler* scheduler();
   UsageDataReporter* usage_data_reporter();
+  // Returns NULL if set_combine_fragment_cache_bytes(0) was called.
+  CombineFragmentCache* combine_fragment_cache();
   const pagespeed::js::JsTokenizerPatterns* js_tokenizer_patterns() const {
     return js_tokenizer_patterns_;
   }
@@ -443,6 +456,8 @@ class RewriteDriverFactory {
   scoped_ptr<Timer> timer_;
   scoped_ptr<Scheduler> scheduler_;
   scoped_ptr<UsageDataReporter> usage_data_reporter_;
+  scoped_ptr<CombineFragmentCache> combine_fragment_cache_;
+  int64 combine_fragment_cache_bytes_;
   // RE2 patterns needed for JsTokenizer.
   const pagespeed::js::JsTokenizerPatterns* js_tokenizer_patterns_;
 
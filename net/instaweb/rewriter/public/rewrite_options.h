@@ -291,6 +291,7 @@ class RewriteOptions {
   static const char kExperimentCookieDurationMs[];
   static const char kExperimentSlot[];
   static const char kFetcherTimeOutMs[];
+  static const char kFilterCpuSamplePercentage[];
   static const char kFinderPropertiesCacheExpirationTimeMs[];
   static const char kFinderPropertiesCacheRefreshTimeMs[];
   static const char kFlushBufferLimitBytes[];
@@ -302,6 +303,7 @@ class RewriteOptions {
   static const char kHttpCacheCompressionLevel[];
   static const char kHonorCsp[];
   static const char kIdleFlushTimeMs[];
+  static const char kImageAnytimeEncoding[];
   static const char kImageInlineMaxBytes[];
   // TODO(huibao): Unify terminology for image rewrites. For example,
   // kImageJpeg*Quality might be renamed to kImageJpegQuality.
@@ -317,6 +319,7 @@ class RewriteOptions {
   static const char kImagePreserveURLs[];
   static const char kImageRecompressionQuality[];
   static const char kImageResolutionLimitBytes[];
+  static const char kImageTargetSsim[];
   static const char kImageWebpQualityForSaveData[];
   static const char kImageWebpRecompressionQuality[];
   static const char kImageWebpRecompressionQualityForSmallScreens[];
@@ -366,6 +369,7 @@ class RewriteOptions {
   static const char kObliviousPagespeedUrls[];
   static const char kOptionCookiesDurationMs[];
   static const char kOverrideCachingTtlMs[];
+  static const char kParallelRewrites[];
   static const char kPreserveSubresourceHints[];
   static const char kPreserveUrlRelativity[];
   static const char kPrivateNotVaryForIE[];
@@ -382,6 +386,7 @@ class RewriteOptions {
   static const char kRespectVary[];
   static const char kRespectXForwardedProto[];
   static const char kResponsiveImageDensities[];
+  static const char kRewriteDeadlineLatencyTargetMs[];
   static const char kRewriteDeadlineMs[];
   static const char kRewriteLevel[];
   static const char kRewriteRandomDropPercentage[];
@@ -390,6 +395,7 @@ class RewriteOptions {
   static const char kServeStaleIfFetchError[];
   static const char kServeStaleWhileRevalidateThresholdSec[];
   static const char kServeXhrAccessControlHeaders[];
+  static const char kSpeculativeResourceFetch[];
   static const char kStickyQueryParameters[];
   static const char kSupportNoScriptEnabled[];
   static const char kTestOnlyPrioritizeCriticalCssDontApplyOriginalCss[];
@@ -1825,6 +1831,21 @@ class RewriteOptions {
     set_option(x, &rewrite_deadline_ms_);
   }
 
+  // When positive, the per-flush rewrite deadline is tuned at runtime so
+  // that the 95th percentile of the latency it adds stays near this value;
+  // rewrite_deadline_ms() is then only the starting point.
+  int rewrite_deadline_latency_target_ms() const {
+    return rewrite_deadline_latency_target_ms_.value();
+  }
+  void set_rewrite_deadline_latency_target_ms(int x) {
+    set_option(x, &rewrite_deadline_latency_target_ms_);
+  }
+
+  bool parallel_rewrites() const { return parallel_rewrites_.value(); }
+  void set_parallel_rewrites(bool x) {
+    set_option(x, &parallel_rewrites_);
+  }
+
   bool test_instant_fetch_rewrite_deadline() const {
     return test_instant_fetch_rewrite_deadline_.value();
   }
@@ -2010,6 +2031,13 @@ class RewriteOptions {
   void set_flush_html(bool x) { set_option(x, &flush_html_); }
   bool flush_html() const { return flush_html_.value(); }
 
+  void set_speculative_resource_fetch(bool x) {
+    set_option(x, &speculative_resource_fetch_);
+  }
+  bool speculative_resource_fetch() const {
+    return speculative_resource_fetch_.value();
+  }
+
   void set_serve_stale_if_fetch_error(bool x) {
     set_option(x, &serve_stale_if_fetch_error_);
   }
@@ -2181,6 +2209,13 @@ class RewriteOptions {
     return rewrite_random_drop_percentage_.value();
   }
 
+  void set_filter_cpu_sample_percentage(int x) {
+    set_option(x, &filter_cpu_sample_percentage_);
+  }
+  int filter_cpu_sample_percentage() const {
+    return filter_cpu_sample_percentage_.value();
+  }
+
   // css_preserve_urls() is determined by the following rules in order:
   // 1. Value set by the user, if the user has explicitly set it.
   // 2. Default value (true) for OptimizeForBandwidth, if this is the rewrite
@@ -2304,6 +2339,12 @@ class RewriteOptions {
   void set_image_limit_optimized_percent(int x) {
     set_option(x, &image_limit_optimized_percent_);
   }
+  int image_target_ssim() const {
+    return image_target_ssim_.value();
+  }
+  void set_image_target_ssim(int x) {
+    set_option(x, &image_target_ssim_);
+  }
   int image_limit_resize_area_percent() const {
     return image_limit_resize_area_percent_.value();
   }
@@ -2352,6 +2393,13 @@ class RewriteOptions {
     set_option(x, &image_webp_timeout_ms_);
   }
 
+  bool image_anytime_encoding() const {
+    return image_anytime_encoding_.value();
+  }
+  void set_image_anytime_encoding(bool x) {
+    set_option(x, &image_anytime_encoding_);
+  }
+
   bool domain_rewrite_hyperlinks() const {
     return CheckMobilizeFiltersOption(domain_rewrite_hyperlinks_);
   }
@@ -3727,6 +3775,9 @@ class RewriteOptions {
   Option<int> image_limit_optimized_percent_;
   Option<int> image_limit_resize_area_percent_;
   Option<int> image_limit_rendered_area_percent_;
+  // Similarity, in thousandths of SSIM, that lossy recompression must keep;
+  // the quality options become upper bounds.  -1 disables the search.
+  Option<int> image_target_ssim_;
 
   // Options related to webp compression.
   Option<int64> image_webp_recompress_quality_;
@@ -3734,6 +3785,9 @@ class RewriteOptions {
   Option<int64> image_webp_animated_recompress_quality_;
   Option<int64> image_webp_quality_for_save_data_;
   Option<int64> image_webp_timeout_ms_;
+  // Whether images in HTML are first encoded at low effort and then
+  // re-encoded at full effort in the background.
+  Option<bool> image_anytime_encoding_;
 
   Option<int> image_max_rewrites_at_once_;
   Option<int> max_url_segment_size_;  // For http://a/b/c.d, use strlen("c.d").
@@ -3741,6 +3795,13 @@ class RewriteOptions {
   // The interval to wait for async rewrites to complete before flushing
   // content.  This deadline is per flush.
   Option<int> rewrite_deadline_ms_;
+  // Target for the 95th percentile of the latency added by waiting for
+  // rewrites in a flush window; <= 0 keeps the deadline fixed.
+  Option<int> rewrite_deadline_latency_target_ms_;
+  // Whether independent top-level rewrites in a flush window may run
+  // concurrently rather than one at a time on the driver's low-priority
+  // sequence.
+  Option<bool> parallel_rewrites_;
   // Maximum number of shards for rewritten resources in a directory.
   Option<int> domain_shard_count_;
 
@@ -3796,6 +3857,9 @@ class RewriteOptions {
   Option<bool> respect_vary_;
   Option<bool> respect_x_forwarded_proto_;
   Option<bool> flush_html_;
+  // Start loading subresources as soon as their tags are lexed, rather than
+  // when the filters that rewrite them see the element.
+  Option<bool> speculative_resource_fetch_;
   // If set to true, ProxyFetch will request a flush on its RewriteDriver when
   // Flush() is called on it.
   Option<bool> follow_flushes_;
@@ -3941,6 +4005,9 @@ class RewriteOptions {
   // Percentage (an integer between 0 and 100 inclusive) of images rewrites to
   // drop.
   Option<int> rewrite_random_drop_percentage_;
+  // Percentage (an integer between 0 and 100 inclusive) of requests for
+  // which the CPU time spent in each filter is recorded in statistics.
+  Option<int> filter_cpu_sample_percentage_;
 
   // For proxies operating in in-place mode this allows fetching optimized
   // resources from sites that have MPS, etc configured.
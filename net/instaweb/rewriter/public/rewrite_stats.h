@@ -26,7 +26,9 @@
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
 
 namespace net_instaweb {
 
@@ -49,6 +51,15 @@ class RewriteStats {
   // successful (200s).
   static const char kSuccessfulDownstreamCachePurges[];
 
+  // The phases of work charged to individual filters when
+  // RewriteOptions::filter_cpu_sample_percentage() selects a request.
+  enum FilterCpuPhase {
+    kHtmlEventCpu,  // HtmlParse::ApplyFilter, once per flush window.
+    kRewriteCpu,    // RewriteContext::Rewrite, on the calling thread.
+    kRenderCpu,     // RewriteContext::Render and slot rendering.
+    kNumFilterCpuPhases
+  };
+
   RewriteStats(bool has_waveforms, Statistics* stats,
                ThreadSystem* thread_system, Timer* timer);
   ~RewriteStats();
@@ -119,6 +130,14 @@ class RewriteStats {
   // HTML rewrite latency in ms.
   Histogram* rewrite_latency_histogram() { return rewrite_latency_histogram_; }
   Histogram* backend_latency_histogram() { return backend_latency_histogram_; }
+  // Heap allocations made while parsing and rendering each HTML page, when
+  // AllocationProfiler is enabled.
+  Histogram* html_allocations_histogram() {
+    return html_allocations_histogram_;
+  }
+  Histogram* html_allocated_kb_histogram() {
+    return html_allocated_kb_histogram_;
+  }
 
   // Number of .pagespeed. resources fetched.
   TimedVariable* total_fetch_count() { return total_fetch_count_; }
@@ -131,8 +150,41 @@ class RewriteStats {
     return thread_queue_depths_[pool];
   }
 
+  // Number of sequences of the given priority class waiting for a worker in
+  // pool, and the number dropped there by load-shedding.
+  UpDownCounter* worker_queued_sequences(
+      RewriteDriverFactory::WorkerPoolCategory pool,
+      QueuedWorkerPool::Priority priority) {
+    return worker_queued_sequences_[pool][priority];
+  }
+  Variable* worker_shed_sequences(
+      RewriteDriverFactory::WorkerPoolCategory pool,
+      QueuedWorkerPool::Priority priority) {
+    return worker_shed_sequences_[pool][priority];
+  }
+
   TimedVariable* num_rewrites_executed() { return num_rewrites_executed_; }
   TimedVariable* num_rewrites_dropped() { return num_rewrites_dropped_; }
+  // Subset of num_rewrites_executed that ran on a context's own sequence
+  // because RewriteOptions::parallel_rewrites() was enabled.
+  TimedVariable* num_rewrites_executed_in_parallel() {
+    return num_rewrites_executed_in_parallel_;
+  }
+
+  // The per-flush rewrite deadline most recently chosen by the
+  // AdaptiveRewriteDeadline, when RewriteDeadlineLatencyTargetMs is set.
+  UpDownCounter* adaptive_rewrite_deadline_ms() {
+    return adaptive_rewrite_deadline_ms_;
+  }
+
+  // Number of HTML requests chosen for per-filter CPU accounting.
+  Variable* filter_cpu_sampled_pages() { return filter_cpu_sampled_pages_; }
+
+  // Charges cpu_us microseconds of thread CPU time in the given phase to the
+  // RewriteFilter with the given id.  Filters without a RewriteFilter id,
+  // and ids not known here, are charged to "other".
+  void AddFilterCpuUs(FilterCpuPhase phase, StringPiece filter_id,
+                      int64 cpu_us);
 
  private:
   Variable* cached_output_hits_;
@@ -164,13 +216,28 @@ class RewriteStats {
   Histogram* fetch_latency_histogram_;
   Histogram* rewrite_latency_histogram_;
   Histogram* backend_latency_histogram_;
+  Histogram* html_allocations_histogram_;
+  Histogram* html_allocated_kb_histogram_;
 
   TimedVariable* total_fetch_count_;
   TimedVariable* total_rewrite_count_;
   TimedVariable* num_rewrites_executed_;
   TimedVariable* num_rewrites_dropped_;
+  TimedVariable* num_rewrites_executed_in_parallel_;
+
+  UpDownCounter* adaptive_rewrite_deadline_ms_;
+  Variable* filter_cpu_sampled_pages_;
+  Variable* filter_cpu_total_us_[kNumFilterCpuPhases];
+  Histogram* filter_cpu_us_histogram_[kNumFilterCpuPhases];
+  // Per-filter totals for each phase, in the order of kFilterCpuIds in
+  // rewrite_stats.cc.
+  std::vector<Variable*> filter_cpu_us_[kNumFilterCpuPhases];
 
   std::vector<Waveform*> thread_queue_depths_;
+  UpDownCounter* worker_queued_sequences_[RewriteDriverFactory::kNumWorkerPools]
+                                         [QueuedWorkerPool::kNumPriorities];
+  Variable* worker_shed_sequences_[RewriteDriverFactory::kNumWorkerPools]
+                                  [QueuedWorkerPool::kNumPriorities];
 
   DISALLOW_COPY_AND_ASSIGN(RewriteStats);
 };
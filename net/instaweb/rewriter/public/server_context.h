@@ -58,8 +58,10 @@ namespace pagespeed { namespace js { struct JsTokenizerPatterns; } }
 
 namespace net_instaweb {
 
+class AdaptiveRewriteDeadline;
 class AsyncFetch;
 class CachePropertyStore;
+class CombineFragmentCache;
 class CriticalImagesFinder;
 class CriticalSelectorFinder;
 class RequestProperties;
@@ -630,6 +632,21 @@ class ServerContext {
     return js_tokenizer_patterns_;
   }
 
+  // Per-member fragments reused by the JS and CSS combiners, shared by all
+  // the ServerContexts of the factory.  NULL if disabled.
+  CombineFragmentCache* combine_fragment_cache() {
+    return combine_fragment_cache_;
+  }
+  void set_combine_fragment_cache(CombineFragmentCache* cache) {
+    combine_fragment_cache_ = cache;
+  }
+
+  // Tunes the per-flush rewrite deadline for drivers whose options set
+  // rewrite_deadline_latency_target_ms().
+  AdaptiveRewriteDeadline* adaptive_rewrite_deadline() {
+    return adaptive_rewrite_deadline_.get();
+  }
+
   enum Format {
     kFormatAsHtml,
     kFormatAsJson
@@ -794,6 +811,9 @@ class ServerContext {
   // Owned by RewriteDriverFactory.
   const pagespeed::js::JsTokenizerPatterns* js_tokenizer_patterns_;
 
+  CombineFragmentCache* combine_fragment_cache_;  // Owned by factory_.
+  scoped_ptr<AdaptiveRewriteDeadline> adaptive_rewrite_deadline_;
+
   scoped_ptr<CachePropertyStore> cache_property_store_;
 
   std::shared_ptr<CentralController> central_controller_;
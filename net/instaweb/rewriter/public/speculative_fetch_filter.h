@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#ifndef NET_INSTAWEB_REWRITER_PUBLIC_SPECULATIVE_FETCH_FILTER_H_
+#define NET_INSTAWEB_REWRITER_PUBLIC_SPECULATIVE_FETCH_FILTER_H_
+
+#include <map>
+#include <vector>
+
+#include "net/instaweb/http/public/request_context.h"
+#include "net/instaweb/rewriter/public/common_filter.h"
+#include "net/instaweb/rewriter/public/resource.h"
+#include "net/instaweb/rewriter/public/resource_slot.h"
+#include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/http/semantic_type.h"
+
+namespace net_instaweb {
+
+class CacheableResourceBase;
+class HtmlElement;
+class OutputPartitions;
+class Statistics;
+class Variable;
+
+// This filter is run immediately after lexing, like FlushHtmlFilter.  As
+// each stylesheet, script or image reference is tokenized it resolves and
+// authorizes the URL and, unless the resource's rewrites are already in
+// the metadata cache, starts loading the resource (HTTP cache lookup, then
+// a fetch on a miss), so the network round trip overlaps with the rest of
+// parsing and with the filters that run before the one that rewrites the
+// resource.
+//
+// When that filter later loads the same resource, CacheableResourceBase
+// asks AttachToLoad whether a speculative load is under way.  If it is,
+// the later load waits for it and takes its result instead of issuing a
+// second cache lookup and fetch.  If the speculative load failed, the later
+// load proceeds normally, so failure handling is unchanged.
+//
+// The keys of the metadata entries themselves depend on the filter and on
+// how it partitions its slots, so they can't be computed here.  Instead,
+// whenever an HTML rewrite writes its metadata, RecordWarmInputs stores a
+// small hint keyed by each input's URL and the options signature, holding
+// the time the inputs expire.  A resource is only loaded speculatively
+// after a lookup of its hint misses or finds it expired, so once a page's
+// rewrites are cached, speculation costs one metadata lookup per resource
+// and never touches the HTTP cache or the origin.  Loads are then only
+// started for resources the rewrites are about to load anyway.
+class SpeculativeFetchFilter : public CommonFilter {
+ public:
+  static const char kSpeculativeResourceLoads[];
+  static const char kSpeculativeResourceLoadsAttached[];
+  static const char kSpeculativeResourceLoadsSkippedWarm[];
+
+  // Prefix of the metadata cache keys of the hints described above.
+  static const char kWarmInputHintPrefix[];
+
+  // Upper bound on the number of loads considered for one document.
+  static const int kMaxLoadsPerDocument = 64;
+
+  explicit SpeculativeFetchFilter(RewriteDriver* driver);
+  virtual ~SpeculativeFetchFilter();
+
+  static void InitStats(Statistics* statistics);
+
+  virtual void StartDocumentImpl();
+  virtual void StartElementImpl(HtmlElement* element);
+  virtual void EndElementImpl(HtmlElement* element) {}
+
+  virtual const char* Name() const { return "SpeculativeFetch"; }
+
+  // Called when resource is about to be loaded.  If a speculative load of
+  // the same cache key has been started by this filter, arranges for
+  // callback to be run once resource has been populated from it and returns
+  // true; the callback may be run before this returns.  Returns false if
+  // there is no such load, or it has already failed, in which case the
+  // caller should load the resource itself.  If the load fails after we
+  // attach, resource is loaded with not_cacheable_policy as usual.
+  bool AttachToLoad(CacheableResourceBase* resource,
+                    Resource::NotCacheablePolicy not_cacheable_policy,
+                    const RequestContextPtr& request_context,
+                    Resource::AsyncCallback* callback);
+
+  // Called by RewriteContext when a top-level HTML rewrite of slots writes
+  // partitions to the metadata cache, to record that loading its inputs
+  // again can be skipped until they expire.
+  void RecordWarmInputs(const OutputPartitions& partitions,
+                        const ResourceSlotVector& slots);
+
+  int num_loads_started() const { return num_loads_started_; }
+
+ private:
+  class HintCallback;
+  class LoadCallback;
+  struct Load;
+  typedef std::map<GoogleString, Load*> LoadMap;
+
+  bool WantsCategory(semantic_type::Category category) const;
+  GoogleString WarmInputHintKey(const GoogleString& cache_key) const;
+  void StartLoad(StringPiece url, RewriteDriver::InputRole role);
+  void HintLookupDone(Load* load, bool warm);
+  void LoadDone(Load* load, bool ok);
+  void ClearLoads();
+
+  scoped_ptr<AbstractMutex> mutex_;
+  LoadMap loads_ GUARDED_BY(mutex_);
+
+  // These are only accessed from the parser thread.
+  int num_loads_started_;
+  bool seen_base_tag_;
+
+  Variable* loads_started_;
+  Variable* loads_attached_;
+  Variable* loads_skipped_warm_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpeculativeFetchFilter);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_REWRITER_PUBLIC_SPECULATIVE_FETCH_FILTER_H_
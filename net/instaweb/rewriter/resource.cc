@@ -133,8 +133,8 @@ bool Resource::IsSafeToRewrite(bool rewrite_uncacheable,
                "Cached content expired, " :
                "Invalid or uncacheable content, "));
   } else if (disable_rewrite_on_no_transform_ &&
-             response_headers_.HasValue(HttpAttributes::kCacheControl,
-                                        "no-transform")) {
+             response_headers_.HasCacheControlDirective(
+                 ResponseHeaders::kCacheControlNoTransform)) {
     StrAppend(reason, "Cache-control: no-transform, ");
   } else if (response_headers_.Lookup1(HttpAttributes::kXSendfile) ||
              response_headers_.Lookup1(HttpAttributes::kXAccelRedirect)) {
@@ -264,6 +264,14 @@ bool Resource::Link(HTTPValue* value, MessageHandler* handler) {
   return value_.Link(contents_and_headers, &response_headers_, handler);
 }
 
+void Resource::LinkLoadedResource(Resource* loaded) {
+  DCHECK(loaded->loaded());
+  Link(&loaded->value_, server_context_->message_handler());
+  response_headers_.CopyFrom(loaded->response_headers_);
+  DetermineContentType();
+  fetch_response_status_ = loaded->fetch_response_status_;
+}
+
 void Resource::LinkFallbackValue(HTTPValue* value) {
   DCHECK(UseHttpCache());
   if (!value->Empty()) {
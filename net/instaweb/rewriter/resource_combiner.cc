@@ -28,6 +28,7 @@
 
 #include "base/logging.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
+#include "net/instaweb/rewriter/public/combine_fragment_cache.h"
 #include "net/instaweb/rewriter/public/output_resource.h"
 #include "net/instaweb/rewriter/public/output_resource_kind.h"
 #include "net/instaweb/rewriter/public/resource.h"
@@ -40,6 +41,7 @@
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
@@ -300,6 +302,36 @@ bool ResourceCombiner::WritePiece(int index,
   return writer->Write(input->ExtractUncompressedContents(), handler);
 }
 
+GoogleString ResourceCombiner::FragmentKey(StringPiece kind,
+                                          StringPiece qualifier,
+                                          const Resource* input) {
+  if (server_context_->combine_fragment_cache() == NULL) {
+    return GoogleString();
+  }
+  if (options_signature_hash_.empty()) {
+    options_signature_hash_ = server_context_->GetRewriteOptionsSignatureHash(
+        rewrite_driver_->options());
+  }
+  GoogleString contents_hash = server_context_->contents_hasher()->Hash(
+      input->ExtractUncompressedContents());
+  return StrCat(filter_->id(), "/", kind, "/", options_signature_hash_, "/",
+                qualifier, "/", contents_hash);
+}
+
+bool ResourceCombiner::LookupFragment(const GoogleString& key,
+                                      SharedString* fragment) {
+  CombineFragmentCache* cache = server_context_->combine_fragment_cache();
+  return (cache != NULL) && cache->Lookup(key, fragment);
+}
+
+void ResourceCombiner::InsertFragment(const GoogleString& key,
+                                      const SharedString& fragment) {
+  CombineFragmentCache* cache = server_context_->combine_fragment_cache();
+  if (cache != NULL) {
+    cache->Insert(key, fragment);
+  }
+}
+
 void ResourceCombiner::Clear() {
   resources_.clear();
   multipart_encoder_urls_.clear();
@@ -21,6 +21,7 @@
 #include "net/instaweb/rewriter/public/responsive_image_filter.h"
 
 #include "net/instaweb/rewriter/public/delay_images_filter.h"
+#include "net/instaweb/rewriter/public/image_rewrite_filter.h"
 #include "net/instaweb/rewriter/public/local_storage_cache_filter.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_test_base.h"
@@ -28,6 +29,7 @@
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/gmock.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/html_keywords.h"
 #include "pagespeed/kernel/html/html_parse_test_base.h"
@@ -114,6 +116,19 @@ TEST_F(ResponsiveImageFilterTest, SimpleJpg) {
   TestSimple(100, 100, "a.jpg", "10.23", "jpg", false);
 }
 
+TEST_F(ResponsiveImageFilterTest, SharedDecode) {
+  options()->EnableFilter(RewriteOptions::kResponsiveImages);
+  options()->EnableFilter(RewriteOptions::kResizeImages);
+  options()->EnableFilter(RewriteOptions::kRecompressJpeg);
+  rewrite_driver()->AddFilters();
+
+  TestSimple(100, 100, "a.jpg", "10.23", "jpg", false);
+  // Only the first of the 1.5x, 2x, 3x and 1x resizes decodes the source;
+  // the others reuse its raster.
+  EXPECT_LE(3, statistics()->GetVariable(
+      ImageRewriteFilter::kImageResizesFromSharedDecode)->Get());
+}
+
 TEST_F(ResponsiveImageFilterTest, SimplePng) {
   options()->EnableFilter(RewriteOptions::kResponsiveImages);
   options()->EnableFilter(RewriteOptions::kResizeImages);
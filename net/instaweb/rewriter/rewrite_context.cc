@@ -50,6 +50,7 @@
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
+#include "net/instaweb/rewriter/public/speculative_fetch_filter.h"
 #include "net/instaweb/rewriter/public/url_namer.h"
 #include "pagespeed/controller/central_controller.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
@@ -65,6 +66,7 @@
 #include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_cpu_time.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/base/writer.h"
@@ -879,7 +881,8 @@ class RewriteContext::FetchContext {
     // compute the cache-control for a hidden .pagespeed. resource in a
     // nested RewriteContext, and we need to propogate that to the ipro
     // resource response headers.
-    if (headers->HasValue(HttpAttributes::kCacheControl, "public")) {
+    if (headers->HasCacheControlDirective(
+            ResponseHeaders::kCacheControlPublic)) {
       async_fetch_->response_headers()->SetCacheControlPublic();
     }
 
@@ -953,11 +956,24 @@ class RewriteContext::InvokeRewriteFunction : public Function {
   virtual ~InvokeRewriteFunction() {}
 
   virtual void Run() {
-    context_->FindServerContext()->rewrite_stats()->num_rewrites_executed()
-        ->IncBy(1);
+    RewriteStats* stats = context_->FindServerContext()->rewrite_stats();
+    stats->num_rewrites_executed()->IncBy(1);
+    if (context_->parallel_rewrite_worker_ != NULL) {
+      stats->num_rewrites_executed_in_parallel()->IncBy(1);
+    }
+    // Rewrite may complete synchronously, and so release the context, so
+    // take everything needed for the CPU accounting beforehand.  Work that
+    // Rewrite hands off to other threads is not counted.
+    const char* id = context_->id();
+    int64 start_cpu_us =
+        context_->Driver()->measure_filter_cpu() ? ThreadCpuTimeUs() : -1;
     context_->Rewrite(partition_,
                       context_->partitions_->mutable_partition(partition_),
                       output_);
+    if (start_cpu_us >= 0) {
+      stats->AddFilterCpuUs(RewriteStats::kRewriteCpu, id,
+                            ThreadCpuTimeUs() - start_cpu_us);
+    }
   }
 
   virtual void Cancel() {
@@ -1026,6 +1042,7 @@ RewriteContext::RewriteContext(RewriteDriver* driver,
     driver_((driver == NULL) ? parent->Driver() : driver),
     num_predecessors_(0),
     chained_(false),
+    parallel_rewrite_worker_(NULL),
     rewrite_done_(false),
     ok_to_write_output_partitions_(true),
     was_too_busy_(false),
@@ -1044,11 +1061,31 @@ RewriteContext::RewriteContext(RewriteDriver* driver,
   partitions_.reset(new OutputPartitions);
 }
 
+bool RewriteContext::CanRunInParallel() const {
+  if (!Options()->parallel_rewrites() ||
+      has_parent() ||
+      IsFetchRewrite() ||
+      !CanRewriteConcurrently()) {
+    return false;
+  }
+  // A context chained to others through a shared slot must stay ordered
+  // with respect to them, so only fully independent contexts qualify.
+  for (int i = 0, n = num_slots(); i < n; ++i) {
+    if (slot(i)->num_contexts() != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
 RewriteContext::~RewriteContext() {
   DCHECK_EQ(0, num_predecessors_);
   DCHECK_EQ(0, outstanding_fetches_);
   DCHECK(successors_.empty());
   STLDeleteElements(&nested_);
+  if (parallel_rewrite_worker_ != NULL) {
+    Driver()->FreeParallelRewriteSequence(parallel_rewrite_worker_);
+  }
 }
 
 int RewriteContext::num_output_partitions() const {
@@ -1754,11 +1791,23 @@ void RewriteContext::PartitionDone(RewriteResult result_or_busy) {
     // inside a fetch (top-levels for fetches are handled inside
     // StartRewriteForFetch), so failing it due to load-shedding will not
     // prevent us from serving requests.
+    //
+    // Contexts that can rewrite concurrently get a sequence of their own on
+    // the same pool, so that independent resources in a flush window don't
+    // queue up behind one another.  Their completions are still funneled
+    // back to the rewrite thread by RewriteDone, so rendering is unaffected.
     CHECK_EQ(outstanding_rewrites_, num_outputs());
+    if ((parallel_rewrite_worker_ == NULL) && CanRunInParallel()) {
+      parallel_rewrite_worker_ = Driver()->NewParallelRewriteSequence();
+    }
     for (int i = 0, n = outstanding_rewrites_; i < n; ++i) {
       InvokeRewriteFunction* invoke_rewrite =
           new InvokeRewriteFunction(this, i, outputs_[i]);
-      Driver()->AddLowPriorityRewriteTask(invoke_rewrite);
+      if (parallel_rewrite_worker_ != NULL) {
+        parallel_rewrite_worker_->Add(invoke_rewrite);
+      } else {
+        Driver()->AddLowPriorityRewriteTask(invoke_rewrite);
+      }
     }
   }
 }
@@ -1800,6 +1849,12 @@ void RewriteContext::WritePartition() {
       } else {
         metadata_cache->PutSwappingString(partition_key_, &buf);
       }
+      SpeculativeFetchFilter* speculative_fetch =
+          has_parent() ? NULL : Driver()->speculative_fetch_filter();
+      if (!IsFetchRewrite() && (speculative_fetch != NULL)) {
+        speculative_fetch->RecordWarmInputs(*partitions_, slots_);
+      }
+      PartitionsWritten();
     }
   } else {
     // TODO(jmarantz): if our rewrite failed due to lock contention or
@@ -2022,6 +2077,8 @@ void RewriteContext::Cancel() {
 
 void RewriteContext::Propagate(RenderOp render_op) {
   bool render_slots = (render_op == RenderOp::kRender);
+  int64 start_cpu_us = (render_slots && Driver()->measure_filter_cpu()) ?
+      ThreadCpuTimeUs() : -1;
   DCHECK(rewrite_done_ && (num_pending_nested_ == 0));
   if (rewrite_done_ && (num_pending_nested_ == 0)) {
     if (render_slots) {
@@ -2108,6 +2165,10 @@ void RewriteContext::Propagate(RenderOp render_op) {
       }
     }
   }
+  if (start_cpu_us >= 0) {
+    FindServerContext()->rewrite_stats()->AddFilterCpuUs(
+        RewriteStats::kRenderCpu, id(), ThreadCpuTimeUs() - start_cpu_us);
+  }
 
   if (successors_.empty()) {
     for (int i = 0, n = slots_.size(); i < n; ++i) {
@@ -2199,8 +2260,8 @@ void RewriteContext::StartRewriteForFetch() {
     ResourcePtr resource(slot(i)->resource());
     if (resource->loaded() && resource->HttpStatusOk() &&
         !(Options()->disable_rewrite_on_no_transform() &&
-          resource->response_headers()->HasValue(HttpAttributes::kCacheControl,
-                                                 "no-transform"))) {
+          resource->response_headers()->HasCacheControlDirective(
+              ResponseHeaders::kCacheControlNoTransform))) {
       bool on_the_fly = (kind() == kOnTheFlyResource);
       Resource::HashHint hash_hint = on_the_fly ?
           Resource::kOmitInputHash : Resource::kIncludeInputHash;
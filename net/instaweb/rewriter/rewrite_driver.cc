@@ -40,6 +40,7 @@
 #include "net/instaweb/http/public/url_async_fetcher.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
 #include "net/instaweb/rewriter/flush_early.pb.h"
+#include "net/instaweb/rewriter/public/adaptive_rewrite_deadline.h"
 #include "net/instaweb/rewriter/public/add_head_filter.h"
 #include "net/instaweb/rewriter/public/add_ids_filter.h"
 #include "net/instaweb/rewriter/public/add_instrumentation_filter.h"
@@ -114,6 +115,7 @@
 #include "net/instaweb/rewriter/public/rewritten_content_scanning_filter.h"
 #include "net/instaweb/rewriter/public/scan_filter.h"
 #include "net/instaweb/rewriter/public/server_context.h"
+#include "net/instaweb/rewriter/public/speculative_fetch_filter.h"
 #include "net/instaweb/rewriter/public/strip_scripts_filter.h"
 #include "net/instaweb/rewriter/public/strip_subresource_hints_filter.h"
 #include "net/instaweb/rewriter/public/support_noscript_filter.h"
@@ -121,6 +123,7 @@
 #include "net/instaweb/rewriter/public/url_left_trim_filter.h"
 #include "net/instaweb/rewriter/public/url_namer.h"
 #include "net/instaweb/util/public/fallback_property_page.h"
+#include "pagespeed/kernel/base/allocation_profiler.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/callback.h"
 #include "pagespeed/kernel/base/file_system.h"
@@ -153,8 +156,10 @@
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/scheduler.h"
 #include "pagespeed/kernel/thread/scheduler_sequence.h"
+#include "pagespeed/kernel/util/simple_random.h"
 #include "pagespeed/kernel/util/statistics_logger.h"
 #include "pagespeed/opt/logging/log_record.h"
 
@@ -264,6 +269,7 @@ RewriteDriver::RewriteDriver(MessageHandler* message_handler,
       default_url_async_fetcher_(url_async_fetcher),
       url_async_fetcher_(default_url_async_fetcher_),
       dom_stats_filter_(NULL),
+      speculative_fetch_filter_(NULL),
       scan_filter_(this),
       controlling_pool_(NULL),
       cache_url_async_fetcher_async_op_hooks_(
@@ -271,6 +277,7 @@ RewriteDriver::RewriteDriver(MessageHandler* message_handler,
       html_worker_(NULL),
       rewrite_worker_(NULL),
       low_priority_rewrite_worker_(NULL),
+      parallel_rewrite_priority_(QueuedWorkerPool::kNormalPriority),
       writer_(NULL),
       fallback_property_page_(NULL),
       owns_property_page_(false),
@@ -284,6 +291,7 @@ RewriteDriver::RewriteDriver(MessageHandler* message_handler,
       is_nested_(false),
       request_context_(NULL),
       start_time_ms_(0),
+      flush_wait_start_ms_(-1),
       defer_instrumentation_script_(false),
       is_amp_(false),
       downstream_cache_purger_(this)
@@ -459,6 +467,9 @@ void RewriteDriver::Clear() NO_THREAD_SAFETY_ANALYSIS {
   fast_blocking_rewrite_ = true;
   num_inline_preview_images_ = 0;
   num_bytes_in_ = 0;
+  allocation_counts_ = AllocationProfiler::Counts();
+  set_measure_filter_cpu(false);
+  flush_wait_start_ms_ = -1;
   flush_early_info_.reset(NULL);
   can_rewrite_resources_ = true;
   is_nested_ = false;
@@ -657,22 +668,28 @@ void RewriteDriver::FlushAsync(Function* callback) {
   }
   flush_requested_ = false;
 
-  // Figure out which filters should be enabled and whether any enabled filter
-  // can modify urls.
-  DetermineFiltersBehavior();
-
-  for (FilterList::iterator it = early_pre_render_filters_.begin();
-      it != early_pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      ApplyFilter(filter);
+  {
+    // The counter must go out of scope before any rewrites are initiated,
+    // as from then on FlushAsyncDone may run concurrently.
+    AllocationProfiler::ScopedCounter allocation_counter(&allocation_counts_);
+
+    // Figure out which filters should be enabled and whether any enabled
+    // filter can modify urls.
+    DetermineFiltersBehavior();
+
+    for (FilterList::iterator it = early_pre_render_filters_.begin();
+        it != early_pre_render_filters_.end(); ++it) {
+      HtmlFilter* filter = *it;
+      if (filter->is_enabled()) {
+        ApplyFilter(filter);
+      }
     }
-  }
-  for (FilterList::iterator it = pre_render_filters_.begin();
-      it != pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      ApplyFilter(filter);
+    for (FilterList::iterator it = pre_render_filters_.begin();
+        it != pre_render_filters_.end(); ++it) {
+      HtmlFilter* filter = *it;
+      if (filter->is_enabled()) {
+        ApplyFilter(filter);
+      }
     }
   }
 
@@ -722,6 +739,9 @@ void RewriteDriver::FlushAsync(Function* callback) {
       CheckForCompletionAsync(kWaitForCompletion, -1, flush_async_done);
     } else {
       int64 deadline = ComputeCurrentFlushWindowRewriteDelayMs();
+      if (options()->rewrite_deadline_latency_target_ms() > 0) {
+        flush_wait_start_ms_ = server_context_->timer()->NowMs();
+      }
       CheckForCompletionAsync(kWaitForCachedRender, deadline, flush_async_done);
     }
   }
@@ -729,6 +749,13 @@ void RewriteDriver::FlushAsync(Function* callback) {
 
 int64 RewriteDriver::ComputeCurrentFlushWindowRewriteDelayMs() {
   int64 deadline = rewrite_deadline_ms();
+  int target_ms = options()->rewrite_deadline_latency_target_ms();
+  if (target_ms > 0) {
+    deadline = server_context_->adaptive_rewrite_deadline()->DeadlineMs(
+        target_ms, deadline, RewriteQueueLoad());
+    server_context_->rewrite_stats()->adaptive_rewrite_deadline_ms()->Set(
+        deadline);
+  }
   // If we've configured a max processing delay for the entire page, enforce
   // that limit here.
   if (max_page_processing_delay_ms_ > 0) {
@@ -748,6 +775,16 @@ int64 RewriteDriver::ComputeCurrentFlushWindowRewriteDelayMs() {
   return deadline;
 }
 
+double RewriteDriver::RewriteQueueLoad() {
+  QueuedWorkerPool* pool = server_context_->low_priority_rewrite_workers();
+  if ((pool == NULL) ||
+      (pool->load_shedding_threshold() == QueuedWorkerPool::kNoLoadShedding)) {
+    return 0.0;
+  }
+  return static_cast<double>(pool->NumQueuedSequences()) /
+      pool->load_shedding_threshold();
+}
+
 void RewriteDriver::QueueFlushAsyncDone(int num_rewrites, Function* callback) {
   html_worker_->Add(MakeFunction(this, &RewriteDriver::FlushAsyncDone,
                                  num_rewrites, callback));
@@ -773,6 +810,13 @@ void RewriteDriver::FlushAsyncDone(int num_rewrites, Function* callback) {
     RewriteStats* stats = server_context_->rewrite_stats();
     stats->cached_output_hits()->Add(completed_rewrites);
     stats->cached_output_missed_deadline()->Add(still_pending_rewrites);
+    if (flush_wait_start_ms_ >= 0) {
+      server_context_->adaptive_rewrite_deadline()->RecordFlush(
+          options()->rewrite_deadline_latency_target_ms(),
+          server_context_->timer()->NowMs() - flush_wait_start_ms_,
+          num_rewrites, completed_rewrites);
+      flush_wait_start_ms_ = -1;
+    }
     {
       // Add completed_rewrites (from this flush window) to the logged value.
       ScopedMutex lock(log_record()->mutex());
@@ -824,28 +868,32 @@ void RewriteDriver::FlushAsyncDone(int num_rewrites, Function* callback) {
     srcset_collections_.clear();
   }
 
-  // Notify all enabled pre-render filters that rendering is done.
-  if (debug_filter_ != NULL) {
-    debug_filter_->RenderDone();
-  }
+  {
+    AllocationProfiler::ScopedCounter allocation_counter(&allocation_counts_);
 
-  for (FilterList::iterator it = early_pre_render_filters_.begin();
-       it != early_pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      filter->RenderDone();
+    // Notify all enabled pre-render filters that rendering is done.
+    if (debug_filter_ != NULL) {
+      debug_filter_->RenderDone();
     }
-  }
-  for (FilterList::iterator it = pre_render_filters_.begin();
-       it != pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      filter->RenderDone();
+
+    for (FilterList::iterator it = early_pre_render_filters_.begin();
+         it != early_pre_render_filters_.end(); ++it) {
+      HtmlFilter* filter = *it;
+      if (filter->is_enabled()) {
+        filter->RenderDone();
+      }
+    }
+    for (FilterList::iterator it = pre_render_filters_.begin();
+         it != pre_render_filters_.end(); ++it) {
+      HtmlFilter* filter = *it;
+      if (filter->is_enabled()) {
+        filter->RenderDone();
+      }
     }
-  }
 
-  // Run all the post-render filters, and clear the event queue.
-  HtmlParse::Flush();
+    // Run all the post-render filters, and clear the event queue.
+    HtmlParse::Flush();
+  }
   flush_occurred_ = true;
   callback->CallRun();
 }
@@ -889,6 +937,7 @@ void RewriteDriver::InitStats(Statistics* statistics) {
   MakeShowAdsAsyncFilter::InitStats(statistics);
   MetaTagFilter::InitStats(statistics);
   RewriteContext::InitStats(statistics);
+  SpeculativeFetchFilter::InitStats(statistics);
   UrlInputResource::InitStats(statistics);
   UrlLeftTrimFilter::InitStats(statistics);
 }
@@ -1023,6 +1072,12 @@ void RewriteDriver::AddPreRenderFilters() {
     // based on the content it sees.
     add_event_listener(new FlushHtmlFilter(this));
   }
+  if (rewrite_options->speculative_resource_fetch()) {
+    // Also run straight off the lexer, so that resource loads start as soon
+    // as their tags are parsed rather than when their filters see them.
+    speculative_fetch_filter_ = new SpeculativeFetchFilter(this);
+    add_event_listener(speculative_fetch_filter_);
+  }
   add_event_listener(new AmpDocumentFilter(this, NewPermanentCallback(
       this, &RewriteDriver::SetIsAmpDocument)));
 
@@ -1832,9 +1887,15 @@ bool RewriteDriver::FetchResource(const StringPiece& url,
   DCHECK_EQ(0, ref_counts_.QueryCountMutexHeld(kRefFetchBackground));
   DCHECK_EQ(0, ref_counts_.QueryCountMutexHeld(kRefParsing));
   bool handled = false;
+  SampleFilterCpu();
 
   fetch_url_ = url.as_string();
 
+  // A client is waiting for this resource, but not as urgently as for HTML
+  // that references it.
+  SetWorkerPriorities(QueuedWorkerPool::kNormalPriority,
+                      QueuedWorkerPool::kNormalPriority);
+
   // Set the request headers if they haven't been yet.
   if (request_headers_ == NULL && async_fetch->request_headers() != NULL) {
     SetRequestHeaders(*async_fetch->request_headers());
@@ -1876,6 +1937,14 @@ void RewriteDriver::FetchInPlaceResource(const GoogleUrl& gurl,
   CHECK(gurl.IsWebValid()) << "Invalid URL " << gurl.spec_c_str();
   CHECK(request_headers_.get() != NULL);
   gurl.Spec().CopyToString(&fetch_url_);
+  SampleFilterCpu();
+
+  // Unless told to wait, IPRO serves the original on a miss and optimizes
+  // in the background, so only the cache lookups are user-facing.
+  SetWorkerPriorities(QueuedWorkerPool::kNormalPriority,
+                      options()->in_place_wait_for_optimized()
+                          ? QueuedWorkerPool::kNormalPriority
+                          : QueuedWorkerPool::kBackgroundPriority);
   StringPiece base = gurl.AllExceptLeaf();
   ResourceNamer namer;
   OutputResourcePtr output_resource(
@@ -2165,6 +2234,12 @@ bool RewriteDriver::StartParseId(const StringPiece& url, const StringPiece& id,
   }
   start_time_ms_ = server_context_->timer()->NowMs();
   set_log_rewrite_timing(options()->log_rewrite_timing());
+  SampleFilterCpu();
+  if (measure_filter_cpu()) {
+    server_context_->rewrite_stats()->filter_cpu_sampled_pages()->Add(1);
+  }
+  SetWorkerPriorities(QueuedWorkerPool::kHighPriority,
+                      QueuedWorkerPool::kHighPriority);
 
   if (debug_filter_ != NULL) {
     debug_filter_->InitParse();
@@ -2192,6 +2267,7 @@ bool RewriteDriver::StartParseId(const StringPiece& url, const StringPiece& id,
 }
 
 void RewriteDriver::ParseTextInternal(const char* content, int size) {
+  AllocationProfiler::ScopedCounter allocation_counter(&allocation_counts_);
   num_bytes_in_ += size;
   if (ShouldSkipParsing()) {
     StringPiece sp(content, size);
@@ -2205,6 +2281,38 @@ void RewriteDriver::ParseTextInternal(const char* content, int size) {
   }
 }
 
+void RewriteDriver::SampleFilterCpu() {
+  int sample_percentage = options()->filter_cpu_sample_percentage();
+  SimpleRandom* simple_random = server_context_->simple_random();
+  set_measure_filter_cpu(
+      (sample_percentage > 0) &&
+      (sample_percentage > static_cast<int>(simple_random->Next() % 100)));
+}
+
+void RewriteDriver::SetWorkerPriorities(
+    QueuedWorkerPool::Priority request_priority,
+    QueuedWorkerPool::Priority rewrite_priority) {
+  html_worker_->set_priority(request_priority);
+  rewrite_worker_->set_priority(request_priority);
+  low_priority_rewrite_worker_->set_priority(rewrite_priority);
+  parallel_rewrite_priority_ = rewrite_priority;
+}
+
+void RewriteDriver::RecordFilterCpuUs(HtmlFilter* filter, int64 cpu_us) {
+  // Only sampled requests get here, so a scan of the few RewriteFilters is
+  // cheap enough.
+  StringPiece id;
+  for (StringFilterMap::const_iterator p = resource_filter_map_.begin(),
+           e = resource_filter_map_.end(); p != e; ++p) {
+    if (p->second == filter) {
+      id = p->first;
+      break;
+    }
+  }
+  server_context_->rewrite_stats()->AddFilterCpuUs(
+      RewriteStats::kHtmlEventCpu, id, cpu_us);
+}
+
 void RewriteDriver::SetDecodedUrlFromBase() {
   UrlNamer* namer = server_context()->url_namer();
   GoogleString decoded_base;
@@ -2549,6 +2657,10 @@ void RewriteDriver::FinishParseAfterFlush(Function* user_callback) {
   stats->rewrite_latency_histogram()->Add(
       server_context_->timer()->NowMs() - start_time_ms_);
   stats->total_rewrite_count()->IncBy(1);
+  if (allocation_counts_.allocations != 0) {
+    stats->html_allocations_histogram()->Add(allocation_counts_.allocations);
+    stats->html_allocated_kb_histogram()->Add(allocation_counts_.bytes / 1024);
+  }
 
   // Update statistics log.
   StatisticsLogger* stats_logger =
@@ -2946,6 +3058,22 @@ void RewriteDriver::AddLowPriorityRewriteTask(Function* task) {
   low_priority_rewrite_worker_->Add(task);
 }
 
+QueuedWorkerPool::Sequence* RewriteDriver::NewParallelRewriteSequence() {
+  QueuedWorkerPool::Sequence* sequence =
+      server_context_->low_priority_rewrite_workers()->NewSequence();
+  if (sequence != NULL) {
+    sequence->set_priority(parallel_rewrite_priority_);
+    scheduler_->RegisterWorker(sequence);
+  }
+  return sequence;
+}
+
+void RewriteDriver::FreeParallelRewriteSequence(
+    QueuedWorkerPool::Sequence* sequence) {
+  scheduler_->UnregisterWorker(sequence);
+  server_context_->low_priority_rewrite_workers()->FreeSequence(sequence);
+}
+
 OptionsAwareHTTPCacheCallback::OptionsAwareHTTPCacheCallback(
     const RewriteOptions* rewrite_options, const RequestContextPtr& request_ctx)
     : HTTPCache::Callback(request_ctx, RequestHeaders::Properties()),
@@ -28,6 +28,7 @@
 #include "net/instaweb/http/public/request_context.h"
 #include "net/instaweb/http/public/url_async_fetcher.h"
 #include "net/instaweb/rewriter/public/beacon_critical_images_finder.h"
+#include "net/instaweb/rewriter/public/combine_fragment_cache.h"
 #include "net/instaweb/rewriter/public/critical_images_finder.h"
 #include "net/instaweb/rewriter/public/critical_selector_finder.h"
 #include "net/instaweb/rewriter/public/experiment_matcher.h"
@@ -73,6 +74,7 @@ namespace net_instaweb {
 RewriteDriverFactory::RewriteDriverFactory(
     const ProcessContext& process_context, ThreadSystem* thread_system)
     : url_async_fetcher_(NULL),
+      combine_fragment_cache_bytes_(CombineFragmentCache::kDefaultMaxBytes),
       js_tokenizer_patterns_(process_context.js_tokenizer_patterns()),
       force_caching_(false),
       slurp_read_only_(false),
@@ -314,6 +316,15 @@ UsageDataReporter* RewriteDriverFactory::usage_data_reporter() {
   return usage_data_reporter_.get();
 }
 
+CombineFragmentCache* RewriteDriverFactory::combine_fragment_cache() {
+  if ((combine_fragment_cache_ == NULL) &&
+      (combine_fragment_cache_bytes_ > 0)) {
+    combine_fragment_cache_.reset(new CombineFragmentCache(
+        combine_fragment_cache_bytes_, thread_system()->NewMutex()));
+  }
+  return combine_fragment_cache_.get();
+}
+
 const std::vector<const UserAgentNormalizer*>&
     RewriteDriverFactory::user_agent_normalizers() {
   if (user_agent_normalizers_.empty()) {
@@ -419,6 +430,13 @@ QueuedWorkerPool* RewriteDriverFactory::WorkerPool(WorkerPoolCategory pool) {
     worker_pools_[pool] = CreateWorkerPool(pool, name);
     worker_pools_[pool]->set_queue_size_stat(
         rewrite_stats()->thread_queue_depth(pool));
+    for (int p = 0; p < QueuedWorkerPool::kNumPriorities; ++p) {
+      QueuedWorkerPool::Priority priority =
+          static_cast<QueuedWorkerPool::Priority>(p);
+      worker_pools_[pool]->set_priority_stats(
+          priority, rewrite_stats()->worker_queued_sequences(pool, priority),
+          rewrite_stats()->worker_shed_sequences(pool, priority));
+    }
     if (pool == kLowPriorityRewriteWorkers) {
       worker_pools_[pool]->SetLoadSheddingThreshold(
           LowPriorityLoadSheddingThreshold());
@@ -491,6 +509,7 @@ void RewriteDriverFactory::InitServerContext(ServerContext* server_context) {
   server_context->set_signature(signature());
   server_context->set_message_handler(message_handler());
   server_context->set_static_asset_manager(static_asset_manager());
+  server_context->set_combine_fragment_cache(combine_fragment_cache());
   server_context->set_critical_images_finder(
       DefaultCriticalImagesFinder(server_context));
   server_context->set_critical_selector_finder(
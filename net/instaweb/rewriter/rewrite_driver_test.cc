@@ -62,6 +62,7 @@
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/semantic_type.h"
 #include "pagespeed/kernel/http/user_agent_matcher_test_base.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/worker_test_base.h"
 #include "pagespeed/opt/logging/log_record.h"
 
@@ -486,6 +487,31 @@ TEST_F(RewriteDriverTest, TestCacheUse) {
   EXPECT_EQ(0, lru_cache()->num_identical_reinserts());
 }
 
+TEST_F(RewriteDriverTest, FilterCpuAccounting) {
+  Histogram* html_histogram =
+      statistics()->GetHistogram("Filter HTML Event CPU us Histogram");
+  Histogram* rewrite_histogram =
+      statistics()->GetHistogram("Filter Rewrite CPU us Histogram");
+  Histogram* render_histogram =
+      statistics()->GetHistogram("Filter Render CPU us Histogram");
+  Variable* sampled_pages =
+      statistics()->GetVariable("filter_cpu_sampled_pages");
+
+  SetResponseWithDefaultHeaders("a.css", kContentTypeCss,
+                                "* { display: none; }", 100);
+  options()->set_filter_cpu_sample_percentage(100);
+  AddFilter(RewriteOptions::kRewriteCss);
+  GoogleString css_minified_url =
+      Encode(kTestDomain, RewriteOptions::kCssFilterId,
+             hasher()->Hash("*{display:none}"), "a.css", "css");
+  ValidateExpected("cpu", CssLinkHref("a.css"), CssLinkHref(css_minified_url));
+
+  EXPECT_EQ(1, sampled_pages->Get());
+  EXPECT_LT(0, html_histogram->Count());
+  EXPECT_LT(0, rewrite_histogram->Count());
+  EXPECT_LT(0, render_histogram->Count());
+}
+
 // Test to make sure when we fetch a with a Via header, "public"
 // is added to the Cache-Control.
 TEST_F(RewriteDriverTest, ViaPublicPageSpeedResource) {
@@ -827,6 +853,46 @@ TEST_F(RewriteDriverTest, TestComputeCurrentFlushWindowRewriteDelayMs) {
   rewrite_driver()->FinishParse();
 }
 
+TEST_F(RewriteDriverTest, AdaptiveFlushWindowRewriteDelay) {
+  options()->set_rewrite_deadline_ms(30);
+  options()->set_rewrite_deadline_latency_target_ms(10);
+  rewrite_driver()->AddFilters();
+  ASSERT_TRUE(rewrite_driver()->StartParseId("http://site.com/",
+                                             "adaptive_flush_window_test",
+                                             kContentTypeHtml));
+
+  // The fixed deadline seeds the adaptive one, which is capped relative to
+  // the latency target.
+  EXPECT_EQ(30, GetFlushTimeout());
+  EXPECT_EQ(30, factory()->rewrite_stats()->
+                    adaptive_rewrite_deadline_ms()->Get());
+
+  // The per-page deadline still applies on top.
+  rewrite_driver()->set_max_page_processing_delay_ms(20);
+  EXPECT_EQ(20, GetFlushTimeout());
+
+  rewrite_driver()->FinishParse();
+}
+
+TEST_F(RewriteDriverTest, HtmlRewritesQueueAtHighPriority) {
+  rewrite_driver()->AddFilters();
+  ASSERT_TRUE(rewrite_driver()->StartParseId("http://site.com/",
+                                             "worker_priority_test",
+                                             kContentTypeHtml));
+  EXPECT_EQ(QueuedWorkerPool::kHighPriority,
+            rewrite_driver()->html_worker()->priority());
+  EXPECT_EQ(QueuedWorkerPool::kHighPriority,
+            rewrite_driver()->low_priority_rewrite_worker()->priority());
+
+  QueuedWorkerPool::Sequence* parallel =
+      rewrite_driver()->NewParallelRewriteSequence();
+  ASSERT_TRUE(parallel != NULL);
+  EXPECT_EQ(QueuedWorkerPool::kHighPriority, parallel->priority());
+  rewrite_driver()->FreeParallelRewriteSequence(parallel);
+
+  rewrite_driver()->FinishParse();
+}
+
 // Extension of above with cache invalidation.
 TEST_F(RewriteDriverTest, TestCacheUseOnTheFlyWithInvalidation) {
   AddFilter(RewriteOptions::kExtendCacheCss);
@@ -138,6 +138,7 @@ const char RewriteOptions::kHttpCacheCompressionLevel[] =
     "HttpCacheCompressionLevel";
 const char RewriteOptions::kHonorCsp[] = "HonorCsp";
 const char RewriteOptions::kIdleFlushTimeMs[] = "IdleFlushTimeMs";
+const char RewriteOptions::kImageAnytimeEncoding[] = "ImageAnytimeEncoding";
 const char RewriteOptions::kImageInlineMaxBytes[] = "ImageInlineMaxBytes";
 const char RewriteOptions::kImageJpegNumProgressiveScans[] =
     "ImageJpegNumProgressiveScans";
@@ -161,6 +162,7 @@ const char RewriteOptions::kImageRecompressionQuality[] =
     "ImageRecompressionQuality";
 const char RewriteOptions::kImageResolutionLimitBytes[] =
     "ImageResolutionLimitBytes";
+const char RewriteOptions::kImageTargetSsim[] = "ImageTargetSsim";
 const char RewriteOptions::kImageWebpRecompressionQuality[] =
     "WebpRecompressionQuality";
 const char RewriteOptions::kImageWebpRecompressionQualityForSmallScreens[] =
@@ -234,6 +236,7 @@ const char RewriteOptions::kObliviousPagespeedUrls[] = "ObliviousPagespeedUrls";
 const char RewriteOptions::kOptionCookiesDurationMs[] =
     "OptionCookiesDurationMs";
 const char RewriteOptions::kOverrideCachingTtlMs[] = "OverrideCachingTtlMs";
+const char RewriteOptions::kParallelRewrites[] = "ParallelRewrites";
 const char RewriteOptions::kPreserveSubresourceHints[] =
     "PreserveSubresourceHints";
 const char RewriteOptions::kPreserveUrlRelativity[] = "PreserveUrlRelativity";
@@ -254,6 +257,8 @@ const char RewriteOptions::kRespectVary[] = "RespectVary";
 const char RewriteOptions::kRespectXForwardedProto[] = "RespectXForwardedProto";
 const char RewriteOptions::kResponsiveImageDensities[] =
     "ResponsiveImageDensities";
+const char RewriteOptions::kRewriteDeadlineLatencyTargetMs[] =
+    "RewriteDeadlineLatencyTargetMs";
 const char RewriteOptions::kRewriteDeadlineMs[] = "RewriteDeadlinePerFlushMs";
 const char RewriteOptions::kRewriteLevel[] = "RewriteLevel";
 const char RewriteOptions::kRewriteRandomDropPercentage[] =
@@ -266,6 +271,8 @@ const char RewriteOptions::kServeStaleWhileRevalidateThresholdSec[] =
     "ServeStaleWhileRevalidateThresholdSec";
 const char RewriteOptions::kServeXhrAccessControlHeaders[] =
     "ServeXhrAccessControlHeaders";
+const char RewriteOptions::kSpeculativeResourceFetch[] =
+    "SpeculativeResourceFetch";
 const char RewriteOptions::kStickyQueryParameters[] = "StickyQueryParameters";
 const char RewriteOptions::kSupportNoScriptEnabled[] = "SupportNoScriptEnabled";
 const char
@@ -317,6 +324,8 @@ const char RewriteOptions::kCacheFlushPollIntervalSec[] =
     "CacheFlushPollIntervalSec";
 const char RewriteOptions::kFetchHttps[] = "FetchHttps";
 const char RewriteOptions::kFetcherTimeOutMs[] = "FetcherTimeOutMs";
+const char RewriteOptions::kFilterCpuSamplePercentage[] =
+    "FilterCpuSamplePercentage";
 const char RewriteOptions::kFileCacheCleanInodeLimit[] =
     "FileCacheInodeLimit";
 const char RewriteOptions::kFileCacheCleanIntervalMs[] =
@@ -1365,6 +1374,19 @@ void RewriteOptions::AddProperties() {
       kDirectoryScope,
       "Time to wait for resource optimization (per flush window) before"
       "falling back to the original resource for the request.", true);
+  AddBaseProperty(
+      -1, &RewriteOptions::rewrite_deadline_latency_target_ms_,
+      "rdlt", kRewriteDeadlineLatencyTargetMs,
+      kDirectoryScope,
+      "If positive, adapts the per-flush rewrite deadline to rewrite "
+      "completion rates and load, aiming for a 95th percentile added "
+      "latency of this many milliseconds.", true);
+  AddBaseProperty(
+      false, &RewriteOptions::parallel_rewrites_, "prw",
+      kParallelRewrites,
+      kDirectoryScope,
+      "Rewrite independent resources in a flush window concurrently on the "
+      "low-priority rewrite threads instead of one after another.", true);
   AddBaseProperty(
       kEnabledOn, &RewriteOptions::enabled_, "e", kEnabled,
       kDirectoryScope,
@@ -1517,6 +1539,12 @@ void RewriteOptions::AddProperties() {
       false, &RewriteOptions::flush_html_, "fh", kFlushHtml,
       kServerScope,
       "Enable auto-flush heuristics for HTML in full proxy mode", true);
+  AddBaseProperty(
+      false, &RewriteOptions::speculative_resource_fetch_, "srf",
+      kSpeculativeResourceFetch,
+      kDirectoryScope,
+      "Start loading stylesheets, scripts and images as soon as their tags "
+      "are parsed, ahead of the filters that rewrite them.", true);
   AddBaseProperty(
       false, &RewriteOptions::css_preserve_urls_, "cpu",
       kCssPreserveURLs,
@@ -1770,6 +1798,14 @@ void RewriteOptions::AddProperties() {
       "Consider resizing images whose area in pixels is less than the "
       "given percent of original image area; 100 means replace if "
       "smaller.", true);
+  AddBaseProperty(
+      -1, &RewriteOptions::image_target_ssim_, "its",
+      kImageTargetSsim,
+      kDirectoryScope,
+      "If set, JPEGs recompressed as JPEG or WebP use the lowest quality "
+      "that keeps this structural similarity to the original, in "
+      "thousandths (e.g. 985).  The recompression quality options become "
+      "upper bounds.  -1 disables the search.", true);
   AddBaseProperty(
       kDefaultImageWebpRecompressQuality,
       &RewriteOptions::image_webp_recompress_quality_, "iw",
@@ -1807,6 +1843,13 @@ void RewriteOptions::AddProperties() {
       kImageWebpTimeoutMs,
       kLegacyProcessScope,
       NULL, true);  // TODO(jmarantz): write help & doc for mod_pagespeed.
+  AddBaseProperty(
+      false, &RewriteOptions::image_anytime_encoding_, "iae",
+      kImageAnytimeEncoding,
+      kDirectoryScope,
+      "Serve a quick low-effort encode of each image in HTML right away, "
+      "and replace it with a full-effort encode computed in the background "
+      "when the rewrite threads have time.", true);
   AddBaseProperty(
       kDefaultMaxInlinedPreviewImagesIndex,
       &RewriteOptions::max_inlined_preview_images_index_, "mdii",
@@ -1882,6 +1925,12 @@ void RewriteOptions::AddProperties() {
       "The percentage of time that pagespeed should randomly drop an "
       "opportunity to optimize an image.  The value should be an integer "
       "between 0 and 100 inclusive.", true);
+  AddBaseProperty(
+      0, &RewriteOptions::filter_cpu_sample_percentage_, "fcsp",
+      kFilterCpuSamplePercentage, kDirectoryScope,
+      "The percentage of requests for which the thread CPU time spent in "
+      "each filter is recorded in statistics.  The value should be an "
+      "integer between 0 and 100 inclusive.", true);
   AddBaseProperty(
       "", &RewriteOptions::ga_id_, "ig", kAnalyticsID,
       kDirectoryScope,
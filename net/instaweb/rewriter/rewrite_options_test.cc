@@ -959,6 +959,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kExperimentCookieDurationMs,
     RewriteOptions::kExperimentSlot,
     RewriteOptions::kFetcherTimeOutMs,
+    RewriteOptions::kFilterCpuSamplePercentage,
     RewriteOptions::kFinderPropertiesCacheExpirationTimeMs,
     RewriteOptions::kFinderPropertiesCacheRefreshTimeMs,
     RewriteOptions::kFlushBufferLimitBytes,
@@ -970,6 +971,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kHttpCacheCompressionLevel,
     RewriteOptions::kHonorCsp,
     RewriteOptions::kIdleFlushTimeMs,
+    RewriteOptions::kImageAnytimeEncoding,
     RewriteOptions::kImageInlineMaxBytes,
     RewriteOptions::kImageJpegNumProgressiveScans,
     RewriteOptions::kImageJpegNumProgressiveScansForSmallScreens,
@@ -983,6 +985,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kImagePreserveURLs,
     RewriteOptions::kImageRecompressionQuality,
     RewriteOptions::kImageResolutionLimitBytes,
+    RewriteOptions::kImageTargetSsim,
     RewriteOptions::kImageWebpQualityForSaveData,
     RewriteOptions::kImageWebpRecompressionQuality,
     RewriteOptions::kImageWebpRecompressionQualityForSmallScreens,
@@ -1033,6 +1036,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kObliviousPagespeedUrls,
     RewriteOptions::kOptionCookiesDurationMs,
     RewriteOptions::kOverrideCachingTtlMs,
+    RewriteOptions::kParallelRewrites,
     RewriteOptions::kPreserveSubresourceHints,
     RewriteOptions::kPreserveUrlRelativity,
     RewriteOptions::kPrivateNotVaryForIE,
@@ -1049,6 +1053,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kRespectVary,
     RewriteOptions::kRespectXForwardedProto,
     RewriteOptions::kResponsiveImageDensities,
+    RewriteOptions::kRewriteDeadlineLatencyTargetMs,
     RewriteOptions::kRewriteDeadlineMs,
     RewriteOptions::kRewriteLevel,
     RewriteOptions::kRewriteRandomDropPercentage,
@@ -1058,6 +1063,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kServeStaleWhileRevalidateThresholdSec,
     RewriteOptions::kServeWebpToAnyAgent,
     RewriteOptions::kServeXhrAccessControlHeaders,
+    RewriteOptions::kSpeculativeResourceFetch,
     RewriteOptions::kStickyQueryParameters,
     RewriteOptions::kSupportNoScriptEnabled,
     RewriteOptions::kTestOnlyPrioritizeCriticalCssDontApplyOriginalCss,
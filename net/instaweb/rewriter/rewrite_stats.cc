@@ -20,10 +20,14 @@
 
 #include "net/instaweb/rewriter/public/rewrite_stats.h"
 
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/waveform.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
 
 namespace net_instaweb {
 
@@ -48,6 +52,8 @@ const char kFallbackResponsesServedWhileRevalidate[] =
     "num_fallback_responses_served_while_revalidate";
 const char kNumConditionalRefreshes[] = "num_conditional_refreshes";
 
+const char kAdaptiveRewriteDeadlineMs[] = "adaptive_rewrite_deadline_ms";
+
 const char kIproServed[] = "ipro_served";
 const char kIproNotInCache[] = "ipro_not_in_cache";
 const char kIproNotRewritable[] = "ipro_not_rewritable";
@@ -58,6 +64,22 @@ const char* kWaveFormCounters[RewriteDriverFactory::kNumWorkerPools] = {
   "low-priority-worked-queue-depth"
 };
 
+// Per-priority queue depth and load-shedding counts for each worker pool,
+// named e.g. low_priority_rewrite_worker_background_shed.
+const char* const kWorkerPoolStatNames[RewriteDriverFactory::kNumWorkerPools] =
+{
+  "html", "rewrite", "low_priority_rewrite"
+};
+const char* const kWorkerPriorityNames[QueuedWorkerPool::kNumPriorities] = {
+  "high", "normal", "background"
+};
+
+GoogleString WorkerPriorityStatName(int pool, int priority,
+                                    StringPiece suffix) {
+  return StrCat(kWorkerPoolStatNames[pool], "_worker_",
+                kWorkerPriorityNames[priority], "_", suffix);
+}
+
 // Variables for the beacon to increment.  These are currently handled in
 // mod_pagespeed_handler on apache.  The average load time in milliseconds is
 // total_page_load_ms / page_load_count.  Note that these are not updated
@@ -75,12 +97,61 @@ const char kFetchLatencyHistogram[] = "Pagespeed Resource Latency Histogram";
 const char kRewriteLatencyHistogram[] = "Rewrite Latency Histogram";
 const char kBackendLatencyHistogram[] =
     "Backend Fetch First Byte Latency Histogram";
+const char kHtmlAllocationsHistogram[] = "HTML Rewrite Allocations Histogram";
+const char kHtmlAllocatedKbHistogram[] =
+    "HTML Rewrite Allocated KB Histogram";
+const int kHtmlAllocationsHistogramMaxValue = 1000 * 1000;
+const int kHtmlAllocatedKbHistogramMaxValue = 100 * 1000;
+
+// Per-filter CPU accounting.  Each RewriteFilter id listed here gets a
+// variable per phase, named e.g. filter_cpu_rewrite_us_ic; every other
+// filter is charged to the "other" variables.  Only the per-phase totals
+// get histograms, as shared-memory histograms are comparatively large.
+const char kFilterCpuSampledPages[] = "filter_cpu_sampled_pages";
+const char kFilterCpuOtherId[] = "other";
+const char* const kFilterCpuIds[] = {
+  RewriteOptions::kCacheExtenderId,
+  RewriteOptions::kCssCombinerId,
+  RewriteOptions::kCssFilterId,
+  RewriteOptions::kCssImportFlattenerId,
+  RewriteOptions::kCssInlineId,
+  RewriteOptions::kGoogleFontCssInlineId,
+  RewriteOptions::kImageCombineId,
+  RewriteOptions::kImageCompressionId,
+  RewriteOptions::kInPlaceRewriteId,
+  RewriteOptions::kJavascriptCombinerId,
+  RewriteOptions::kJavascriptMinId,
+  RewriteOptions::kJavascriptMinSourceMapId,
+  RewriteOptions::kJavascriptInlineId,
+  RewriteOptions::kLocalStorageCacheId,
+  RewriteOptions::kPrioritizeCriticalCssId,
+  kFilterCpuOtherId  // Must be last.
+};
+const char* const kFilterCpuPhaseNames[RewriteStats::kNumFilterCpuPhases] = {
+  "html", "rewrite", "render"
+};
+const char* const kFilterCpuHistograms[RewriteStats::kNumFilterCpuPhases] = {
+  "Filter HTML Event CPU us Histogram",
+  "Filter Rewrite CPU us Histogram",
+  "Filter Render CPU us Histogram"
+};
+const int kFilterCpuHistogramMaxValue = 100 * 1000;
+
+// Returns the name of the total for phase, e.g. filter_cpu_render_us.
+GoogleString FilterCpuTotalName(int phase) {
+  return StrCat("filter_cpu_", kFilterCpuPhaseNames[phase], "_us");
+}
+
+GoogleString FilterCpuName(int phase, const char* id) {
+  return StrCat(FilterCpuTotalName(phase), "_", id);
+}
 
 // TimedVariable names.
 const char kTotalFetchCount[] = "total_fetch_count";
 const char kTotalRewriteCount[] = "total_rewrite_count";
 const char kRewritesExecuted[] = "num_rewrites_executed";
 const char kRewritesDropped[] = "num_rewrites_dropped";
+const char kRewritesExecutedInParallel[] = "num_rewrites_executed_in_parallel";
 
 }  // namespace
 
@@ -130,6 +201,10 @@ void RewriteStats::InitStats(Statistics* statistics) {
   statistics->AddHistogram(kFetchLatencyHistogram);
   statistics->AddHistogram(kRewriteLatencyHistogram);
   statistics->AddHistogram(kBackendLatencyHistogram);
+  statistics->AddHistogram(kHtmlAllocationsHistogram)->SetMaxValue(
+      kHtmlAllocationsHistogramMaxValue);
+  statistics->AddHistogram(kHtmlAllocatedKbHistogram)->SetMaxValue(
+      kHtmlAllocatedKbHistogramMaxValue);
   statistics->AddVariable(kFallbackResponsesServed);
   statistics->AddVariable(kProactivelyFreshenUserFacingRequest);
   statistics->AddVariable(kFallbackResponsesServedWhileRevalidate);
@@ -147,11 +222,28 @@ void RewriteStats::InitStats(Statistics* statistics) {
                                Statistics::kDefaultGroup);
   statistics->AddTimedVariable(kRewritesDropped,
                                Statistics::kDefaultGroup);
+  statistics->AddTimedVariable(kRewritesExecutedInParallel,
+                               Statistics::kDefaultGroup);
   statistics->AddVariable(kNumResourceFetchSuccesses);
   statistics->AddVariable(kNumResourceFetchFailures);
 
   for (int i = 0; i < RewriteDriverFactory::kNumWorkerPools; ++i) {
     statistics->AddUpDownCounter(kWaveFormCounters[i]);
+    for (int p = 0; p < QueuedWorkerPool::kNumPriorities; ++p) {
+      statistics->AddUpDownCounter(WorkerPriorityStatName(i, p, "queued"));
+      statistics->AddVariable(WorkerPriorityStatName(i, p, "shed"));
+    }
+  }
+  statistics->AddUpDownCounter(kAdaptiveRewriteDeadlineMs);
+
+  statistics->AddVariable(kFilterCpuSampledPages);
+  for (int phase = 0; phase < kNumFilterCpuPhases; ++phase) {
+    statistics->AddVariable(FilterCpuTotalName(phase));
+    statistics->AddHistogram(kFilterCpuHistograms[phase])->SetMaxValue(
+        kFilterCpuHistogramMaxValue);
+    for (int i = 0, n = arraysize(kFilterCpuIds); i < n; ++i) {
+      statistics->AddVariable(FilterCpuName(phase, kFilterCpuIds[i]));
+    }
   }
 }
 
@@ -217,10 +309,19 @@ RewriteStats::RewriteStats(bool has_waveforms,
           stats->GetHistogram(kRewriteLatencyHistogram)),
       backend_latency_histogram_(
           stats->GetHistogram(kBackendLatencyHistogram)),
+      html_allocations_histogram_(
+          stats->GetHistogram(kHtmlAllocationsHistogram)),
+      html_allocated_kb_histogram_(
+          stats->GetHistogram(kHtmlAllocatedKbHistogram)),
       total_fetch_count_(stats->GetTimedVariable(kTotalFetchCount)),
       total_rewrite_count_(stats->GetTimedVariable(kTotalRewriteCount)),
       num_rewrites_executed_(stats->GetTimedVariable(kRewritesExecuted)),
-      num_rewrites_dropped_(stats->GetTimedVariable(kRewritesDropped)) {
+      num_rewrites_dropped_(stats->GetTimedVariable(kRewritesDropped)),
+      num_rewrites_executed_in_parallel_(
+          stats->GetTimedVariable(kRewritesExecutedInParallel)),
+      adaptive_rewrite_deadline_ms_(
+          stats->GetUpDownCounter(kAdaptiveRewriteDeadlineMs)),
+      filter_cpu_sampled_pages_(stats->GetVariable(kFilterCpuSampledPages)) {
   // Timers are not guaranteed to go forward in time, however
   // Histograms will CHECK-fail given a negative value unless
   // EnableNegativeBuckets is called, allowing bars to be created with
@@ -230,8 +331,28 @@ RewriteStats::RewriteStats(bool has_waveforms,
   fetch_latency_histogram_->EnableNegativeBuckets();
   rewrite_latency_histogram_->EnableNegativeBuckets();
   backend_latency_histogram_->EnableNegativeBuckets();
+  html_allocations_histogram_->SetMaxValue(kHtmlAllocationsHistogramMaxValue);
+  html_allocated_kb_histogram_->SetMaxValue(kHtmlAllocatedKbHistogramMaxValue);
+
+  for (int phase = 0; phase < kNumFilterCpuPhases; ++phase) {
+    filter_cpu_total_us_[phase] =
+        stats->GetVariable(FilterCpuTotalName(phase));
+    filter_cpu_us_histogram_[phase] =
+        stats->GetHistogram(kFilterCpuHistograms[phase]);
+    filter_cpu_us_histogram_[phase]->SetMaxValue(kFilterCpuHistogramMaxValue);
+    for (int i = 0, n = arraysize(kFilterCpuIds); i < n; ++i) {
+      filter_cpu_us_[phase].push_back(
+          stats->GetVariable(FilterCpuName(phase, kFilterCpuIds[i])));
+    }
+  }
 
   for (int i = 0; i < RewriteDriverFactory::kNumWorkerPools; ++i) {
+    for (int p = 0; p < QueuedWorkerPool::kNumPriorities; ++p) {
+      worker_queued_sequences_[i][p] =
+          stats->GetUpDownCounter(WorkerPriorityStatName(i, p, "queued"));
+      worker_shed_sequences_[i][p] =
+          stats->GetVariable(WorkerPriorityStatName(i, p, "shed"));
+    }
     if (has_waveforms) {
       thread_queue_depths_.push_back(
           new Waveform(thread_system, timer, kNumWaveformSamples,
@@ -246,4 +367,18 @@ RewriteStats::~RewriteStats() {
   STLDeleteElements(&thread_queue_depths_);
 }
 
+void RewriteStats::AddFilterCpuUs(FilterCpuPhase phase, StringPiece filter_id,
+                                  int64 cpu_us) {
+  // Falls through to "other", which is last.
+  int i = 0;
+  for (int n = arraysize(kFilterCpuIds) - 1; i < n; ++i) {
+    if (filter_id == kFilterCpuIds[i]) {
+      break;
+    }
+  }
+  filter_cpu_us_[phase][i]->Add(cpu_us);
+  filter_cpu_total_us_[phase]->Add(cpu_us);
+  filter_cpu_us_histogram_[phase]->Add(cpu_us);
+}
+
 }  // namespace net_instaweb
@@ -32,6 +32,7 @@
 #include "net/instaweb/http/public/url_async_fetcher.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
 #include "net/instaweb/rewriter/input_info.pb.h"
+#include "net/instaweb/rewriter/public/adaptive_rewrite_deadline.h"
 #include "net/instaweb/rewriter/public/beacon_critical_images_finder.h"
 #include "net/instaweb/rewriter/public/critical_images_finder.h"
 #include "net/instaweb/rewriter/public/critical_selector_finder.h"
@@ -278,7 +279,10 @@ ServerContext::ServerContext(RewriteDriverFactory* factory)
       experiment_matcher_(factory_->NewExperimentMatcher()),
       usage_data_reporter_(factory_->usage_data_reporter()),
       simple_random_(thread_system_->NewMutex()),
-      js_tokenizer_patterns_(factory_->js_tokenizer_patterns()) {
+      js_tokenizer_patterns_(factory_->js_tokenizer_patterns()),
+      combine_fragment_cache_(NULL),
+      adaptive_rewrite_deadline_(
+          new AdaptiveRewriteDeadline(thread_system_->NewMutex())) {
   // Make sure the excluded-attributes are in abc order so binary_search works.
   // Make sure to use the same comparator that we pass to the binary_search.
 #ifndef NDEBUG
@@ -426,7 +430,8 @@ void ServerContext::ApplyInputCacheControl(const ResourceVector& inputs,
       ResponseHeaders::kHasValidator);
 
   bool browser_cacheable = headers->IsBrowserCacheable();
-  bool no_store = headers->HasValue(HttpAttributes::kCacheControl, "no-store");
+  bool no_store = headers->HasCacheControlDirective(
+      ResponseHeaders::kCacheControlNoStore);
   bool is_public = true;  // Only used if we see a non-empty resource.
   bool saw_nonempty_resource = false;
   int64 max_age = headers->cache_ttl_ms();
@@ -444,10 +449,10 @@ void ServerContext::ApplyInputCacheControl(const ResourceVector& inputs,
           ResponseHeaders::kHasValidator);
       proxy_cacheable &= resource_cacheable;
       browser_cacheable &= input_headers->IsBrowserCacheable();
-      no_store |= input_headers->HasValue(HttpAttributes::kCacheControl,
-                                          "no-store");
-      is_public &= input_headers->HasValue(HttpAttributes::kCacheControl,
-                                           "public");
+      no_store |= input_headers->HasCacheControlDirective(
+          ResponseHeaders::kCacheControlNoStore);
+      is_public &= input_headers->HasCacheControlDirective(
+          ResponseHeaders::kCacheControlPublic);
       saw_nonempty_resource = true;
     }
   }
@@ -0,0 +1,365 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include "net/instaweb/rewriter/public/speculative_fetch_filter.h"
+
+#include <utility>
+
+#include "base/logging.h"
+#include "net/instaweb/rewriter/cached_result.pb.h"
+#include "net/instaweb/rewriter/input_info.pb.h"
+#include "net/instaweb/rewriter/public/cacheable_resource_base.h"
+#include "net/instaweb/rewriter/public/resource_tag_scanner.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/server_context.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/hasher.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_name.h"
+
+namespace net_instaweb {
+
+const char SpeculativeFetchFilter::kSpeculativeResourceLoads[] =
+    "speculative_resource_loads";
+const char SpeculativeFetchFilter::kSpeculativeResourceLoadsAttached[] =
+    "speculative_resource_loads_attached";
+const char SpeculativeFetchFilter::kSpeculativeResourceLoadsSkippedWarm[] =
+    "speculative_resource_loads_skipped_warm";
+const char SpeculativeFetchFilter::kWarmInputHintPrefix[] = "spec_warm/";
+
+namespace {
+
+void TakeEarlierExpiration(const InputInfo& input, int64* expiration_ms) {
+  if (input.has_expiration_time_ms() &&
+      ((*expiration_ms < 0) || (input.expiration_time_ms() < *expiration_ms))) {
+    *expiration_ms = input.expiration_time_ms();
+  }
+}
+
+}  // namespace
+
+// A load started by this filter, and the loads waiting on it.
+struct SpeculativeFetchFilter::Load {
+  struct Waiter {
+    CacheableResourceBase* resource;  // Owned by callback->resource().
+    Resource::NotCacheablePolicy not_cacheable_policy;
+    RequestContextPtr request_context;
+    Resource::AsyncCallback* callback;
+  };
+
+  explicit Load(const ResourcePtr& resource_in)
+      : resource(resource_in), done(false), ok(false) {
+  }
+
+  ResourcePtr resource;
+  bool done;
+  bool ok;
+  std::vector<Waiter> waiters;
+};
+
+// Looks up the hint left by RecordWarmInputs, and starts the load if it is
+// absent or has expired.
+class SpeculativeFetchFilter::HintCallback : public CacheInterface::Callback {
+ public:
+  HintCallback(SpeculativeFetchFilter* filter, Load* load, Timer* timer)
+      : filter_(filter),
+        load_(load),
+        timer_(timer),
+        warm_(false) {
+  }
+
+  virtual bool ValidateCandidate(const GoogleString& key,
+                                 CacheInterface::KeyState state) {
+    int64 expiration_ms;
+    warm_ = ((state == CacheInterface::kAvailable) &&
+             StringToInt64(value().Value().as_string(), &expiration_ms) &&
+             (expiration_ms > timer_->NowMs()));
+    return warm_;
+  }
+
+  virtual void Done(CacheInterface::KeyState state) {
+    filter_->HintLookupDone(load_, warm_);
+    delete this;
+  }
+
+ private:
+  SpeculativeFetchFilter* filter_;
+  Load* load_;
+  Timer* timer_;
+  bool warm_;
+
+  DISALLOW_COPY_AND_ASSIGN(HintCallback);
+};
+
+class SpeculativeFetchFilter::LoadCallback : public Resource::AsyncCallback {
+ public:
+  LoadCallback(const ResourcePtr& resource, SpeculativeFetchFilter* filter,
+               Load* load)
+      : Resource::AsyncCallback(resource),
+        filter_(filter),
+        load_(load) {
+  }
+
+  virtual void Done(bool lock_failure, bool resource_ok) {
+    filter_->LoadDone(load_, resource_ok && resource()->IsValidAndCacheable());
+    delete this;
+  }
+
+ private:
+  SpeculativeFetchFilter* filter_;
+  Load* load_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadCallback);
+};
+
+SpeculativeFetchFilter::SpeculativeFetchFilter(RewriteDriver* driver)
+    : CommonFilter(driver),
+      mutex_(driver->server_context()->thread_system()->NewMutex()),
+      num_loads_started_(0),
+      seen_base_tag_(false) {
+  Statistics* stats = driver->server_context()->statistics();
+  loads_started_ = stats->GetVariable(kSpeculativeResourceLoads);
+  loads_attached_ = stats->GetVariable(kSpeculativeResourceLoadsAttached);
+  loads_skipped_warm_ =
+      stats->GetVariable(kSpeculativeResourceLoadsSkippedWarm);
+}
+
+SpeculativeFetchFilter::~SpeculativeFetchFilter() {
+  ClearLoads();
+}
+
+void SpeculativeFetchFilter::InitStats(Statistics* statistics) {
+  statistics->AddVariable(kSpeculativeResourceLoads);
+  statistics->AddVariable(kSpeculativeResourceLoadsAttached);
+  statistics->AddVariable(kSpeculativeResourceLoadsSkippedWarm);
+}
+
+void SpeculativeFetchFilter::StartDocumentImpl() {
+  // The driver does not start a new document until every load from the
+  // previous one has called back, so nothing is pending here.
+  ClearLoads();
+  num_loads_started_ = 0;
+  seen_base_tag_ = false;
+}
+
+void SpeculativeFetchFilter::ClearLoads() {
+  ScopedMutex lock(mutex_.get());
+  for (LoadMap::iterator p = loads_.begin(), e = loads_.end(); p != e; ++p) {
+    DCHECK(p->second->done);
+    delete p->second;
+  }
+  loads_.clear();
+}
+
+bool SpeculativeFetchFilter::WantsCategory(
+    semantic_type::Category category) const {
+  const RewriteOptions* options = driver()->options();
+  switch (category) {
+    case semantic_type::kStylesheet:
+      return (options->Enabled(RewriteOptions::kRewriteCss) ||
+              options->Enabled(RewriteOptions::kCombineCss) ||
+              options->Enabled(RewriteOptions::kInlineCss));
+    case semantic_type::kScript:
+      return (options->Enabled(RewriteOptions::kRewriteJavascriptExternal) ||
+              options->Enabled(RewriteOptions::kCombineJavascript) ||
+              options->Enabled(RewriteOptions::kInlineJavascript));
+    case semantic_type::kImage:
+      return options->ImageOptimizationEnabled();
+    default:
+      return false;
+  }
+}
+
+void SpeculativeFetchFilter::StartElementImpl(HtmlElement* element) {
+  if (element->keyword() == HtmlName::kBase &&
+      element->FindAttribute(HtmlName::kHref) != NULL) {
+    // The driver's base URL is only updated once the filter chain reaches
+    // this element, so anything we resolved from here on could be wrong.
+    seen_base_tag_ = true;
+  }
+  if (seen_base_tag_ || (noscript_element() != NULL)) {
+    return;
+  }
+  resource_tag_scanner::UrlCategoryVector attributes;
+  resource_tag_scanner::ScanElement(element, driver()->options(), &attributes);
+  for (int i = 0, n = attributes.size(); i < n; ++i) {
+    if (num_loads_started_ >= kMaxLoadsPerDocument) {
+      return;
+    }
+    const char* url = attributes[i].url->DecodedValueOrNull();
+    if (url == NULL || !WantsCategory(attributes[i].category)) {
+      continue;
+    }
+    switch (attributes[i].category) {
+      case semantic_type::kStylesheet:
+        StartLoad(url, RewriteDriver::InputRole::kStyle);
+        break;
+      case semantic_type::kScript:
+        StartLoad(url, RewriteDriver::InputRole::kScript);
+        break;
+      default:
+        StartLoad(url, RewriteDriver::InputRole::kImg);
+        break;
+    }
+  }
+}
+
+void SpeculativeFetchFilter::StartLoad(StringPiece url,
+                                       RewriteDriver::InputRole role) {
+  bool is_authorized;
+  ResourcePtr resource(CreateInputResource(url, role, &is_authorized));
+  if (resource.get() == NULL || !is_authorized || !resource->UseHttpCache()) {
+    return;
+  }
+  Load* load = new Load(resource);
+  {
+    ScopedMutex lock(mutex_.get());
+    std::pair<LoadMap::iterator, bool> inserted =
+        loads_.insert(LoadMap::value_type(resource->cache_key(), load));
+    if (!inserted.second) {
+      delete load;
+      return;
+    }
+  }
+  ++num_loads_started_;
+  // Rewrites that load this resource before the hint lookup completes wait
+  // for it, and load the resource themselves if the hint says it's warm.
+  driver()->IncrementAsyncEventsCount();
+  ServerContext* server_context = driver()->server_context();
+  server_context->metadata_cache()->Get(
+      WarmInputHintKey(resource->cache_key()),
+      new HintCallback(this, load, server_context->timer()));
+}
+
+GoogleString SpeculativeFetchFilter::WarmInputHintKey(
+    const GoogleString& cache_key) const {
+  const Hasher* hasher = driver()->server_context()->lock_hasher();
+  return StrCat(kWarmInputHintPrefix,
+                hasher->Hash(driver()->options()->signature()), "/",
+                cache_key);
+}
+
+void SpeculativeFetchFilter::HintLookupDone(Load* load, bool warm) {
+  if (warm) {
+    // The rewrites of this resource are cached, so they won't load it.
+    loads_skipped_warm_->Add(1);
+    LoadDone(load, false);
+    return;
+  }
+  loads_started_->Add(1);
+  load->resource->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                            driver()->request_context(),
+                            new LoadCallback(load->resource, this, load));
+}
+
+void SpeculativeFetchFilter::RecordWarmInputs(
+    const OutputPartitions& partitions, const ResourceSlotVector& slots) {
+  int64 expiration_ms = -1;
+  for (int i = 0, n = partitions.partition_size(); i < n; ++i) {
+    const CachedResult& partition = partitions.partition(i);
+    for (int j = 0, m = partition.input_size(); j < m; ++j) {
+      TakeEarlierExpiration(partition.input(j), &expiration_ms);
+    }
+  }
+  for (int i = 0, n = partitions.other_dependency_size(); i < n; ++i) {
+    TakeEarlierExpiration(partitions.other_dependency(i), &expiration_ms);
+  }
+  if (expiration_ms < 0) {
+    return;
+  }
+  CacheInterface* metadata_cache = driver()->server_context()->metadata_cache();
+  GoogleString value = Integer64ToString(expiration_ms);
+  for (int i = 0, n = slots.size(); i < n; ++i) {
+    ResourcePtr resource(slots[i]->resource());
+    if (resource.get() != NULL && resource->UseHttpCache()) {
+      metadata_cache->Put(WarmInputHintKey(resource->cache_key()),
+                          SharedString(value));
+    }
+  }
+}
+
+bool SpeculativeFetchFilter::AttachToLoad(
+    CacheableResourceBase* resource,
+    Resource::NotCacheablePolicy not_cacheable_policy,
+    const RequestContextPtr& request_context,
+    Resource::AsyncCallback* callback) {
+  Load* load;
+  {
+    ScopedMutex lock(mutex_.get());
+    LoadMap::iterator p = loads_.find(resource->cache_key());
+    if (p == loads_.end()) {
+      return false;
+    }
+    load = p->second;
+    if (load->resource.get() == resource || (load->done && !load->ok)) {
+      return false;
+    }
+    if (!load->done) {
+      Load::Waiter waiter;
+      waiter.resource = resource;
+      waiter.not_cacheable_policy = not_cacheable_policy;
+      waiter.request_context = request_context;
+      waiter.callback = callback;
+      load->waiters.push_back(waiter);
+      loads_attached_->Add(1);
+      return true;
+    }
+  }
+
+  // The load has already succeeded and its resource no longer changes, so
+  // it is safe to copy from it outside the lock.
+  loads_attached_->Add(1);
+  resource->LinkLoadedResource(load->resource.get());
+  callback->Done(false /* lock_failure */, true /* resource_ok */);
+  return true;
+}
+
+void SpeculativeFetchFilter::LoadDone(Load* load, bool ok) {
+  std::vector<Load::Waiter> waiters;
+  {
+    ScopedMutex lock(mutex_.get());
+    load->done = true;
+    load->ok = ok;
+    waiters.swap(load->waiters);
+  }
+  Resource* loaded = load->resource.get();
+  for (int i = 0, n = waiters.size(); i < n; ++i) {
+    const Load::Waiter& waiter = waiters[i];
+    if (ok) {
+      waiter.resource->LinkLoadedResource(loaded);
+      waiter.callback->Done(false /* lock_failure */, true /* resource_ok */);
+    } else {
+      // Since the load is now marked as failed, this won't attach again.
+      waiter.resource->LoadAndCallback(waiter.not_cacheable_policy,
+                                       waiter.request_context,
+                                       waiter.callback);
+    }
+  }
+  // This may release the driver, so it must come last.
+  driver()->DecrementAsyncEventsCount();
+}
+
+}  // namespace net_instaweb
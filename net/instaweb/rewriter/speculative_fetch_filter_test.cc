@@ -0,0 +1,142 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+// Unit-test the SpeculativeFetchFilter.
+
+#include "net/instaweb/rewriter/public/speculative_fetch_filter.h"
+
+#include "net/instaweb/http/public/counting_url_async_fetcher.h"
+#include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_test_base.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/http/content_type.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kCss[] = ".a { color : red ; }";
+
+class SpeculativeFetchFilterTest : public RewriteTestBase {
+ protected:
+  virtual void SetUp() {
+    options()->set_speculative_resource_fetch(true);
+    options()->EnableFilter(RewriteOptions::kRewriteCss);
+    RewriteTestBase::SetUp();
+    rewrite_driver()->AddFilters();
+    SetResponseWithDefaultHeaders("a.css", kContentTypeCss, kCss, 100);
+    loads_ = statistics()->GetVariable(
+        SpeculativeFetchFilter::kSpeculativeResourceLoads);
+    attached_ = statistics()->GetVariable(
+        SpeculativeFetchFilter::kSpeculativeResourceLoadsAttached);
+    skipped_warm_ = statistics()->GetVariable(
+        SpeculativeFetchFilter::kSpeculativeResourceLoadsSkippedWarm);
+  }
+
+  Variable* loads_;
+  Variable* attached_;
+  Variable* skipped_warm_;
+};
+
+TEST_F(SpeculativeFetchFilterTest, LoadIsSharedWithRewrite) {
+  ASSERT_TRUE(rewrite_driver()->speculative_fetch_filter() != NULL);
+  Parse("shared", CssLinkHref("a.css"));
+  EXPECT_EQ(1, loads_->Get());
+  EXPECT_EQ(1, attached_->Get());
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_EQ(1, rewrite_driver()->speculative_fetch_filter()->
+            num_loads_started());
+}
+
+TEST_F(SpeculativeFetchFilterTest, RewriteWaitsForPendingLoad) {
+  SetupWaitFetcher();
+  Parse("pending", CssLinkHref("a.css"));
+  EXPECT_EQ(1, loads_->Get());
+
+  // The CSS rewrite attached to the speculative load instead of fetching
+  // a.css itself, so releasing the one outstanding fetch completes both.
+  CallFetcherCallbacks();
+  EXPECT_EQ(1, attached_->Get());
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  ValidateExpected("pending", CssLinkHref("a.css"),
+                   CssLinkHref(Encode("", "cf", "0", "a.css", "css")));
+}
+
+TEST_F(SpeculativeFetchFilterTest, CachedRewritesSkipLoad) {
+  Parse("cold", CssLinkHref("a.css"));
+  EXPECT_EQ(1, loads_->Get());
+  EXPECT_EQ(0, skipped_warm_->Get());
+
+  // The rewrite of a.css is now in the metadata cache, so speculation
+  // neither looks a.css up in the HTTP cache nor fetches it.
+  ClearStats();
+  Parse("warm", CssLinkHref("a.css"));
+  EXPECT_EQ(0, loads_->Get());
+  EXPECT_EQ(1, skipped_warm_->Get());
+  EXPECT_EQ(0, http_cache()->cache_hits()->Get());
+  EXPECT_EQ(0, counting_url_async_fetcher()->fetch_count());
+
+  // Once a.css expires, its rewrite will need to load it again.
+  ClearStats();
+  AdvanceTimeMs(200 * Timer::kSecondMs);
+  Parse("expired", CssLinkHref("a.css"));
+  EXPECT_EQ(1, loads_->Get());
+  EXPECT_EQ(0, skipped_warm_->Get());
+}
+
+TEST_F(SpeculativeFetchFilterTest, RepeatedReferencesLoadOnce) {
+  Parse("repeated", StrCat(CssLinkHref("a.css"), CssLinkHref("a.css")));
+  EXPECT_EQ(1, loads_->Get());
+}
+
+TEST_F(SpeculativeFetchFilterTest, OnlyResourcesWeRewrite) {
+  // No JavaScript or image filters are on.
+  Parse("other_types",
+        "<script src='a.js'></script><img src='a.jpg'>");
+  EXPECT_EQ(0, loads_->Get());
+}
+
+TEST_F(SpeculativeFetchFilterTest, UnauthorizedDomain) {
+  Parse("unauthorized", CssLinkHref("http://unauthorized.com/a.css"));
+  EXPECT_EQ(0, loads_->Get());
+}
+
+TEST_F(SpeculativeFetchFilterTest, StopsAtBaseTag) {
+  Parse("base", StrCat("<base href='http://test.com/sub/'>",
+                       CssLinkHref("a.css")));
+  EXPECT_EQ(0, loads_->Get());
+}
+
+TEST_F(SpeculativeFetchFilterTest, SkipsNoscript) {
+  Parse("noscript", StrCat("<noscript>", CssLinkHref("a.css"),
+                           "</noscript>"));
+  EXPECT_EQ(0, loads_->Get());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
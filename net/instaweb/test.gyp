@@ -78,6 +78,7 @@
         '<(DEPTH)/pagespeed/automatic/proxy_fetch_test.cc',
         '<(DEPTH)/pagespeed/automatic/proxy_interface_test.cc',
         '<(DEPTH)/pagespeed/automatic/proxy_interface_test_base.cc',
+        '<(DEPTH)/pagespeed/automatic/synthetic_page_generator_test.cc',
         # TODO(jefftk): get this test to build.
         # '<(DEPTH)/pagespeed/automatic/rewriter_speed_test.cc',
         'config/measurement_proxy_rewrite_options_manager_test.cc',
@@ -106,6 +107,7 @@
         'http/wait_url_async_fetcher_test.cc',
         'rewriter/add_ids_filter_test.cc',
         'rewriter/add_instrumentation_filter_test.cc',
+        'rewriter/adaptive_rewrite_deadline_test.cc',
         'rewriter/association_transformer_test.cc',
         'rewriter/base_tag_filter_test.cc',
         'rewriter/beacon_critical_images_finder_test.cc',
@@ -209,6 +211,7 @@
         'rewriter/script_tag_scanner_test.cc',
         'rewriter/server_context_test.cc',
         'rewriter/shared_cache_test.cc',
+        'rewriter/speculative_fetch_filter_test.cc',
         'rewriter/srcset_slot_test.cc',
         'rewriter/static_asserts_test.cc',
         'rewriter/static_asset_manager_test.cc',
@@ -224,6 +227,7 @@
         'spriter/image_spriter_test.cc',
         'spriter/libpng_image_library_test.cc',
         '<(DEPTH)/pagespeed/system/apr_mem_cache_test.cc',
+        '<(DEPTH)/pagespeed/system/memcached_binary_cache_test.cc',
         '<(DEPTH)/pagespeed/system/redis_cache_test.cc',
         '<(DEPTH)/pagespeed/system/redis_cache_cluster_test.cc',
         '<(DEPTH)/pagespeed/system/admin_site_test.cc',
@@ -241,6 +245,7 @@
         '<(DEPTH)/pagespeed/controller/schedule_rewrite_rpc_handler_test.cc',
         '<(DEPTH)/pagespeed/controller/queued_expensive_operation_controller_test.cc',
         '<(DEPTH)/pagespeed/controller/work_bound_expensive_operation_controller_test.cc',
+        '<(DEPTH)/pagespeed/kernel/base/allocation_profiler_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/annotated_message_handler_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/arena_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/base64_test.cc',
@@ -251,6 +256,7 @@
         '<(DEPTH)/pagespeed/kernel/base/countdown_timer_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/escaping_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/fast_wildcard_group_test.cc',
+        '<(DEPTH)/pagespeed/kernel/base/flat_hash_map_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/function_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/hasher_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/hostname_util_test.cc',
@@ -274,6 +280,7 @@
         '<(DEPTH)/pagespeed/kernel/base/string_multi_map_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/string_util_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/symbol_table_test.cc',
+        '<(DEPTH)/pagespeed/kernel/base/thread_cpu_time_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/time_util_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/vector_deque_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/waveform_test.cc',
@@ -281,6 +288,7 @@
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/wildcard_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/async_cache_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/blocking_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/cache_batcher_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/cache_key_prepender.cc',
         '<(DEPTH)/pagespeed/kernel/cache/cache_key_prepender_test.cc',
@@ -313,6 +321,7 @@
         '<(DEPTH)/pagespeed/kernel/http/data_url_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/domain_registry_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/google_url_test.cc',
+        '<(DEPTH)/pagespeed/kernel/http/http_header_name_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/query_params_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/request_headers_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/response_headers_test.cc',
@@ -320,13 +329,16 @@
         '<(DEPTH)/pagespeed/kernel/http/user_agent_matcher_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/user_agent_matcher_test_base.cc',
         '<(DEPTH)/pagespeed/kernel/http/user_agent_normalizer_test.cc',
+        '<(DEPTH)/pagespeed/kernel/image/codec_pool_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/frame_interface_integration_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/frame_interface_optimizer_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/gif_reader_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/image_analysis_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/image_converter_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/image_optimizer_test.cc',
+        '<(DEPTH)/pagespeed/kernel/image/image_probe_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/image_resizer_test.cc',
+        '<(DEPTH)/pagespeed/kernel/image/image_similarity_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/image_util_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/jpeg_optimizer_test.cc',
         '<(DEPTH)/pagespeed/kernel/image/jpeg_reader_test.cc',
@@ -340,6 +352,7 @@
         '<(DEPTH)/pagespeed/kernel/js/js_tokenizer_test.cc',
         '<(DEPTH)/pagespeed/kernel/sharedmem/inprocess_shared_mem_test.cc',
         '<(DEPTH)/pagespeed/kernel/sharedmem/shared_mem_cache_spammer_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/lock_profiler_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/mock_scheduler_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/pthread_condvar_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/pthread_thread_system_test.cc',
@@ -352,6 +365,7 @@
         '<(DEPTH)/pagespeed/kernel/thread/scheduler_thread_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/slow_worker_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/thread_synchronizer_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/uring_file_system_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/brotli_inflater_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/categorized_refcount_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/copy_on_write_test.cc',
@@ -361,6 +375,7 @@
         '<(DEPTH)/pagespeed/kernel/util/input_file_nonce_generator_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/mem_lock_manager_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/nonce_generator_test_base.cc',
+        '<(DEPTH)/pagespeed/kernel/util/parallel_gzip_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/re2_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/simple_stats_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/statistics_logger_test.cc',
@@ -371,6 +386,7 @@
         '<(DEPTH)/pagespeed/opt/ads/ads_attribute_test.cc',
         '<(DEPTH)/pagespeed/opt/ads/ads_util_test.cc',
         '<(DEPTH)/pagespeed/opt/ads/show_ads_snippet_parser_test.cc',
+        '<(DEPTH)/pagespeed/opt/logging/log_event_buffer_test.cc',
         '<(DEPTH)/pagespeed/opt/logging/log_record_test.cc',
         '<(DEPTH)/pagespeed/opt/logging/log_record_test_helper.cc',
         '<(DEPTH)/pagespeed/opt/logging/request_timing_info_test.cc',
@@ -482,12 +498,14 @@
         'test_infrastructure',
         '<(DEPTH)/testing/gmock.gyp:gmock',
         '<(DEPTH)/pagespeed/kernel.gyp:kernel_test_util',
+        '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_image_processing',
       ],
       'include_dirs': [
         '<(DEPTH)/third_party/protobuf/src',
         '<(DEPTH)',
       ],
       'sources': [
+        '<(DEPTH)/pagespeed/automatic/synthetic_page_generator.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_parse_test_base.cc',
         'http/mock_url_fetcher.cc',
         'rewriter/fake_filter.cc',
@@ -507,6 +525,8 @@
         '<(DEPTH)/pagespeed/kernel.gyp:pthread_system',
         '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_base_core',
         '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_http',
+        '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_sharedmem',
+        '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_thread',
         '<(DEPTH)/pagespeed/kernel.gyp:proto_util',
         '<(DEPTH)/third_party/css_parser/css_parser.gyp:css_parser',
         '<(DEPTH)/third_party/re2/re2.gyp:re2_bench_util',
@@ -527,11 +547,37 @@
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group.cc',
         '<(DEPTH)/pagespeed/kernel/cache/compressed_cache_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/lru_cache_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/threadsafe_cache_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_parse_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/image/image_probe_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/sharedmem/shared_mem_cache_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/sharedmem/shared_mem_lock_manager_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/sharedmem/shared_mem_statistics_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/queued_worker_pool_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/scheduler_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/deque_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/util/parallel_gzip_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/util/threaded_benchmark.cc',
         '<(DEPTH)/pagespeed/kernel/util/url_escaper_speed_test.cc',
       ],
     },
+    {
+      'target_name': 'proxy_load_test',
+      'type': 'executable',
+      'dependencies': [
+        'test_util',
+        'instaweb.gyp:automatic_util',
+        'instaweb.gyp:instaweb_automatic',
+        '<(DEPTH)/pagespeed/kernel.gyp:pthread_system',
+        '<(DEPTH)/pagespeed/kernel.gyp:util_gflags',
+      ],
+      'include_dirs': [
+        '<(DEPTH)',
+      ],
+      'sources': [
+        '<(DEPTH)/pagespeed/automatic/proxy_load_test_main.cc',
+      ],
+    },
     {
       'target_name': 'css_minify_main',
       'type': 'executable',
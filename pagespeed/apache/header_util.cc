@@ -22,6 +22,7 @@
 
 #include <cstdio>
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <utility>
 
@@ -116,18 +117,34 @@ void ApacheRequestToResponseHeaders(const request_rec& request,
 void AddResponseHeadersToRequestHelper(const ResponseHeaders& response_headers,
                                        request_rec* request,
                                        apr_table_t* table) {
-  for (int i = 0, n = response_headers.NumAttributes(); i < n; ++i) {
+  int num_attributes = response_headers.NumAttributes();
+  if (num_attributes == 0) {
+    return;
+  }
+
+  // Rather than having apr_table_add make two pool copies per header, copy
+  // all the names and values into a single pool allocation up front and hand
+  // them to apr_table_addn, which does not copy.  ap_set_content_type does not
+  // copy either, so the content-type value comes from the same block.
+  size_t buffer_size = 0;
+  for (int i = 0; i < num_attributes; ++i) {
+    buffer_size += response_headers.Name(i).size() +
+        response_headers.Value(i).size() + 2;  // Two NUL terminators.
+  }
+  char* buffer = static_cast<char*>(apr_palloc(request->pool, buffer_size));
+  for (int i = 0; i < num_attributes; ++i) {
     const GoogleString& name = response_headers.Name(i);
     const GoogleString& value = response_headers.Value(i);
+    char* name_copy = buffer;
+    memcpy(name_copy, name.c_str(), name.size() + 1);
+    buffer += name.size() + 1;
+    char* value_copy = buffer;
+    memcpy(value_copy, value.c_str(), value.size() + 1);
+    buffer += value.size() + 1;
     if (StringCaseEqual(name, HttpAttributes::kContentType)) {
-      // ap_set_content_type does not make a copy of the string, we need
-      // to duplicate it.
-      char* ptr = apr_pstrdup(request->pool, value.c_str());
-      ap_set_content_type(request, ptr);
+      ap_set_content_type(request, value_copy);
     } else {
-      // apr_table_add makes copies of both head key and value, so we do not
-      // have to duplicate them.
-      apr_table_add(table, name.c_str(), value.c_str());
+      apr_table_addn(table, name_copy, value_copy);
     }
   }
 }
@@ -25,6 +25,7 @@
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
+#include "pagespeed/kernel/http/response_headers.h"
 
 #include "http_request.h"                                            // NOLINT
 
@@ -140,4 +141,23 @@ TEST_F(HeaderUtilTest, SelectiveRequestHeaders) {
   EXPECT_EQ(1, selective.NumAttributes());
 }
 
+TEST_F(HeaderUtilTest, ResponseHeadersToApacheRequest) {
+  ResponseHeaders headers;
+  headers.Add(HttpAttributes::kContentType, "text/css");
+  headers.Add(HttpAttributes::kCacheControl, "max-age=60");
+  headers.Add(HttpAttributes::kSetCookie, "a=1");
+  headers.Add(HttpAttributes::kSetCookie, "b=2");
+  ResponseHeadersToApacheRequest(headers, &request_);
+
+  // The copies belong to the request, not to the headers.
+  headers.Clear();
+  EXPECT_EQ("ap_set_content_type(text/css)",
+            MockApache::ActionsSinceLastCall());
+  EXPECT_EQ("Content-Type: text/css\n"
+            "Cache-Control: max-age=60\n"
+            "Set-Cookie: a=1\n"
+            "Set-Cookie: b=2\n",
+            HeadersOutToString(&request_));
+}
+
 }  // namespace net_instaweb
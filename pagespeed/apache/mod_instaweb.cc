@@ -119,13 +119,18 @@ const char kModPagespeedConsoleDomains[] = "ModPagespeedConsoleDomains";
 const char kModPagespeedCreateSharedMemoryMetadataCache[] =
     "ModPagespeedCreateSharedMemoryMetadataCache";
 const char kModPagespeedAddResourceHeader[] = "ModPagespeedAddResourceHeader";
+const char kModPagespeedCombineFragmentCacheKb[] =
+    "ModPagespeedCombineFragmentCacheKb";
 const char kModPagespeedCustomFetchHeader[] = "ModPagespeedCustomFetchHeader";
+const char kModPagespeedImageScratchPoolKb[] = "ModPagespeedImageScratchPoolKb";
 const char kModPagespeedDisableFilters[] = "ModPagespeedDisableFilters";
 const char kModPagespeedDisallow[] = "ModPagespeedDisallow";
 const char kModPagespeedDomain[] = "ModPagespeedDomain";
 const char kModPagespeedDownstreamCachePurgeLocationPrefix[] =
     "ModPagespeedDownstreamCachePurgeLocationPrefix";
 const char kModPagespeedEnableFilters[] = "ModPagespeedEnableFilters";
+const char kModPagespeedExpensiveRewriteThreadCpus[] =
+    "ModPagespeedExpensiveRewriteThreadCpus";
 const char kModPagespeedFetchProxy[] = "ModPagespeedFetchProxy";
 const char kModPagespeedFetcherTimeoutMs[] = "ModPagespeedFetcherTimeOutMs";
 const char kModPagespeedFileCachePath[] = "ModPagespeedFileCachePath";
@@ -165,8 +170,11 @@ const char kModPagespeedPreserveSubresourceHints[] =
     "ModPagespeedPreserveSubresourceHints";
 const char kModPagespeedProxySuffix[] = "ModPagespeedProxySuffix";
 const char kModPagespeedRetainComment[] = "ModPagespeedRetainComment";
+const char kModPagespeedRewriteThreadCpus[] = "ModPagespeedRewriteThreadCpus";
 const char kModPagespeedRunExperiment[] = "ModPagespeedRunExperiment";
 const char kModPagespeedShardDomain[] = "ModPagespeedShardDomain";
+const char kModPagespeedSharedMemoryNumaNodes[] =
+    "ModPagespeedSharedMemoryNumaNodes";
 const char kModPagespeedSpeedTracking[] = "ModPagespeedIncreaseSpeedTracking";
 const char kModPagespeedStaticAssetPrefix[] = "ModPagespeedStaticAssetPrefix";
 const char kModPagespeedStatisticsDomains[] = "ModPagespeedStatisticsDomains";
@@ -1778,12 +1786,25 @@ static const command_rec mod_pagespeed_filter_cmds[] = {
         "Try to dump backtrace on crashes. For developer use"),
   APACHE_CONFIG_OPTION(kModPagespeedMessageBufferSize,
         "Set the size of buffer used for /mod_pagespeed_message."),
+  APACHE_CONFIG_OPTION(kModPagespeedCombineFragmentCacheKb,
+        "Size of the per-process cache of CSS and JS combining fragments. "
+        "0 to disable"),
+  APACHE_CONFIG_OPTION(kModPagespeedImageScratchPoolKb,
+        "Idle image codec buffers each rewrite thread may keep for reuse. "
+        "0 to disable"),
   APACHE_CONFIG_OPTION(kModPagespeedNumRewriteThreads,
         "Number of threads to use for inexpensive portions of "
         "resource-rewriting. <= 0 to auto-detect"),
   APACHE_CONFIG_OPTION(kModPagespeedNumExpensiveRewriteThreads,
         "Number of threads to use for computation-intensive portions of "
         "resource-rewriting. <= 0 to auto-detect"),
+  APACHE_CONFIG_OPTION(kModPagespeedRewriteThreadCpus,
+        "CPUs to run inexpensive rewrite threads on, e.g. 0-3,8"),
+  APACHE_CONFIG_OPTION(kModPagespeedExpensiveRewriteThreadCpus,
+        "CPUs to run computation-intensive rewrite threads on, e.g. 0-3,8"),
+  APACHE_CONFIG_OPTION(kModPagespeedSharedMemoryNumaNodes,
+        "NUMA nodes to bind (one node) or interleave (several) shared "
+        "memory segments on, e.g. 0-1"),
   APACHE_CONFIG_OPTION(kModPagespeedStaticAssetPrefix,
          "Where to serve static support files for pagespeed filters from."),
   APACHE_CONFIG_OPTION(kModPagespeedTrackOriginalContentLength,
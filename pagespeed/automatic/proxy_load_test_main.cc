@@ -0,0 +1,467 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+// In-process end-to-end load test.  Builds a synthetic site with
+// SyntheticPageGenerator, serves it from a MockUrlFetcher origin, and drives
+// --clients concurrent clients through ProxyInterface, the same entry point
+// the servers use.  Each page view fetches the HTML and then every
+// same-site resource it references, exactly as a browser without a cache
+// would.
+//
+// Two phases run back to back.  In the cold phase each page is viewed once
+// with an empty cache; in the warm phase --warm_page_views views cycle
+// through the pages again.  For each phase we print request throughput,
+// p50/p99 request latency, origin versus served bytes, and CPU time per
+// request.  The filter set comes from the usual --rewrite_level and
+// --rewriters flags.
+//
+// The factory runs on mock time, so rewrite deadlines never expire while a
+// request is in flight: cold-phase latency includes the full cost of every
+// rewrite, rather than whatever fits in a deadline.  Wall-clock numbers are
+// measured with the real clock.  CPU time is process-wide and is taken once
+// background work has drained, so it includes rewrites that finish after
+// their response was sent.
+//
+// Example:
+//   proxy_load_test --clients=8 --warm_page_views=2000
+//       --rewrite_level=PassThrough --rewriters=rewrite_css,rewrite_images
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "base/logging.h"
+#include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/mock_url_fetcher.h"
+#include "net/instaweb/rewriter/public/process_context.h"
+#include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
+#include "net/instaweb/rewriter/public/rewrite_gflags.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/server_context.h"
+#include "net/instaweb/rewriter/public/test_rewrite_driver_factory.h"
+#include "pagespeed/automatic/proxy_interface.h"
+#include "pagespeed/automatic/synthetic_page_generator.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/http/google_url.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/thread/mock_scheduler.h"
+#include "pagespeed/kernel/util/gflags.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/opt/http/request_context.h"
+
+namespace net_instaweb {
+
+DEFINE_int32(clients, 4, "Number of concurrent clients.");
+DEFINE_int32(warm_page_views, 200,
+             "Number of page views in the warm-cache phase.");
+DEFINE_int32(pages, 20, "Number of distinct pages on the synthetic site.");
+DEFINE_int32(html_bytes, 20 * 1024, "Approximate size of each page.");
+DEFINE_int32(css_per_page, 3, "Stylesheets referenced by each page.");
+DEFINE_int32(css_bytes, 8 * 1024, "Approximate size of each stylesheet.");
+DEFINE_int32(js_per_page, 3, "Scripts referenced by each page.");
+DEFINE_int32(js_bytes, 16 * 1024, "Approximate size of each script.");
+DEFINE_int32(images_per_page, 6, "JPEG images referenced by each page.");
+DEFINE_int32(image_width, 320, "Width of each image, in pixels.");
+DEFINE_int32(image_height, 240, "Height of each image, in pixels.");
+DEFINE_int32(seed, 1, "Seed for the synthetic site.  The same seed and "
+             "shape always produce the same site.");
+
+namespace {
+
+const char kBaseUrl[] = "http://www.example.com/";
+const char kStatsPrefix[] = "load-test-";
+const char kUserAgent[] =
+    "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/64.0.3282.140 Safari/537.36";
+const int64 kResourceTtlMs = 10 * Timer::kMinuteMs;
+
+// Returns the CPU time, user plus system, consumed by the whole process.
+int64 ProcessCpuUs() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * Timer::kSecondUs +
+      usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Extracts the same-site resources a page references: every quoted src or
+// href attribute except links to other pages.  Inlined data: URLs are
+// skipped, since their bytes are already part of the page.
+void ExtractResourceUrls(const GoogleUrl& page_url, StringPiece html,
+                         StringVector* urls) {
+  static const char* const kAttributes[] = { " src=\"", " href=\"" };
+  for (int a = 0; a < static_cast<int>(arraysize(kAttributes)); ++a) {
+    StringPiece attr(kAttributes[a]);
+    for (stringpiece_ssize_type pos = html.find(attr);
+         pos != StringPiece::npos; pos = html.find(attr, pos)) {
+      pos += attr.size();
+      stringpiece_ssize_type end = html.find('"', pos);
+      if (end == StringPiece::npos) {
+        break;
+      }
+      StringPiece value = html.substr(pos, end - pos);
+      GoogleUrl url(page_url, value);
+      if (url.IsWebValid() && (url.Origin() == page_url.Origin()) &&
+          !StringCaseEndsWith(url.PathSansQuery(), ".html")) {
+        urls->push_back(url.Spec().as_string());
+      }
+    }
+  }
+}
+
+// Measurements for one phase, accumulated per client and then merged.
+struct PhaseStats {
+  PhaseStats()
+      : page_views(0), requests(0), failures(0), origin_bytes(0),
+        served_bytes(0) {
+  }
+
+  void Merge(const PhaseStats& other) {
+    page_views += other.page_views;
+    requests += other.requests;
+    failures += other.failures;
+    origin_bytes += other.origin_bytes;
+    served_bytes += other.served_bytes;
+    latencies_us.insert(latencies_us.end(), other.latencies_us.begin(),
+                        other.latencies_us.end());
+  }
+
+  int page_views;
+  int requests;
+  int failures;
+  int64 origin_bytes;
+  int64 served_bytes;
+  std::vector<int64> latencies_us;
+};
+
+// Collects one response and lets the requesting client block until it is
+// complete.
+class ClientFetch : public StringAsyncFetch {
+ public:
+  ClientFetch(const RequestContextPtr& request_context,
+              ThreadSystem* thread_system)
+      : StringAsyncFetch(request_context),
+        mutex_(thread_system->NewMutex()),
+        condvar_(mutex_->NewCondvar()),
+        complete_(false) {
+  }
+
+  virtual void HandleDone(bool success) {
+    StringAsyncFetch::HandleDone(success);
+    ScopedMutex lock(mutex_.get());
+    complete_ = true;
+    condvar_->Signal();
+  }
+
+  void Wait() {
+    ScopedMutex lock(mutex_.get());
+    while (!complete_) {
+      condvar_->Wait();
+    }
+  }
+
+ private:
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> condvar_;
+  bool complete_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClientFetch);
+};
+
+class LoadTest {
+ public:
+  explicit LoadTest(const RewriteGflags& gflags)
+      : gflags_(gflags),
+        wall_timer_(Platform::CreateTimer()),
+        server_context_(NULL) {
+  }
+
+  ~LoadTest() {
+    proxy_interface_.reset(NULL);
+    factory_.reset(NULL);
+  }
+
+  bool Init(const ProcessContext& process_context);
+
+  // Views the pages in page_sequence, shared among the clients round-robin,
+  // and prints a line of results.
+  void RunPhase(const char* name, const std::vector<int>& page_sequence);
+
+  // Fetches a page and its resources, accumulating into stats.
+  void PageView(int page_index, PhaseStats* stats);
+
+  static void PrintHeader();
+
+ private:
+  class Client;
+
+  bool Fetch(const GoogleString& url, GoogleString* body, PhaseStats* stats);
+
+  const RewriteGflags& gflags_;
+  GoogleMessageHandler handler_;
+  scoped_ptr<Timer> wall_timer_;
+  MockUrlFetcher fetcher_;
+  scoped_ptr<TestRewriteDriverFactory> factory_;
+  ServerContext* server_context_;
+  scoped_ptr<ProxyInterface> proxy_interface_;
+  StringVector page_urls_;
+  std::vector<int64> origin_page_view_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadTest);
+};
+
+class LoadTest::Client : public ThreadSystem::Thread {
+ public:
+  Client(LoadTest* load_test, ThreadSystem* thread_system, int index)
+      : Thread(thread_system, StrCat("client", IntegerToString(index)),
+               ThreadSystem::kJoinable),
+        load_test_(load_test) {
+  }
+
+  void AddPage(int page_index) { pages_.push_back(page_index); }
+  const PhaseStats& stats() const { return stats_; }
+
+  virtual void Run() {
+    for (int i = 0, n = pages_.size(); i < n; ++i) {
+      load_test_->PageView(pages_[i], &stats_);
+    }
+  }
+
+ private:
+  LoadTest* load_test_;
+  std::vector<int> pages_;
+  PhaseStats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(Client);
+};
+
+bool LoadTest::Init(const ProcessContext& process_context) {
+  SyntheticPageGenerator::Shape shape;
+  shape.num_pages = FLAGS_pages;
+  shape.html_bytes = FLAGS_html_bytes;
+  shape.css_per_page = FLAGS_css_per_page;
+  shape.css_bytes = FLAGS_css_bytes;
+  shape.js_per_page = FLAGS_js_per_page;
+  shape.js_bytes = FLAGS_js_bytes;
+  shape.images_per_page = FLAGS_images_per_page;
+  shape.image_width = FLAGS_image_width;
+  shape.image_height = FLAGS_image_height;
+  if (shape.num_pages <= 0) {
+    LOG(ERROR) << "--pages must be positive";
+    return false;
+  }
+  SyntheticPageGenerator generator(shape, kBaseUrl, FLAGS_seed);
+  std::vector<SyntheticPageGenerator::Resource> site;
+  generator.Generate(&site);
+
+  factory_.reset(new TestRewriteDriverFactory(process_context, "/tmp",
+                                              &fetcher_));
+  TestRewriteDriverFactory::InitStats(factory_->statistics());
+  ProxyInterface::InitStats(kStatsPrefix, factory_->statistics());
+  server_context_ = factory_->CreateServerContext();
+  RewriteOptions* options = server_context_->global_options();
+  options->ClearSignatureForTesting();
+  if (!gflags_.SetupOptionsOnly(options, &handler_)) {
+    return false;
+  }
+  server_context_->ComputeSignature(options);
+  proxy_interface_.reset(new ProxyInterface(
+      kStatsPrefix, "localhost", 80, server_context_,
+      factory_->statistics()));
+
+  // HTML is uncacheable, as most of it is in practice; everything else can
+  // be cached long enough to outlast the run.
+  int64 now_ms = factory_->timer()->NowMs();
+  std::map<GoogleString, int64> sizes;
+  fetcher_.set_fail_on_unexpected(false);
+  for (int i = 0, n = site.size(); i < n; ++i) {
+    const SyntheticPageGenerator::Resource& resource = site[i];
+    ResponseHeaders headers;
+    headers.SetStatusAndReason(HttpStatus::kOK);
+    headers.Add(HttpAttributes::kContentType,
+                resource.content_type->mime_type());
+    if (resource.content_type->IsHtmlLike()) {
+      headers.SetDateAndCaching(now_ms, 0, ", private");
+    } else {
+      headers.SetDateAndCaching(now_ms, kResourceTtlMs);
+    }
+    headers.ComputeCaching();
+    fetcher_.SetResponse(resource.url, headers, resource.content);
+    sizes[resource.url] = resource.content.size();
+  }
+
+  // What a page view would cost without the proxy.
+  for (int p = 0; p < shape.num_pages; ++p) {
+    page_urls_.push_back(generator.PageUrl(p));
+    GoogleUrl page_url(page_urls_.back());
+    StringVector resources;
+    ExtractResourceUrls(page_url, site[p].content, &resources);
+    int64 bytes = site[p].content.size();
+    for (int i = 0, n = resources.size(); i < n; ++i) {
+      bytes += sizes[resources[i]];
+    }
+    origin_page_view_bytes_.push_back(bytes);
+  }
+  return true;
+}
+
+bool LoadTest::Fetch(const GoogleString& url, GoogleString* body,
+                     PhaseStats* stats) {
+  ClientFetch fetch(
+      RequestContext::NewTestRequestContext(factory_->thread_system()),
+      factory_->thread_system());
+  fetch.request_headers()->Add(HttpAttributes::kUserAgent, kUserAgent);
+  int64 start_us = wall_timer_->NowUs();
+  proxy_interface_->Fetch(url, &handler_, &fetch);
+  fetch.Wait();
+  stats->latencies_us.push_back(wall_timer_->NowUs() - start_us);
+  ++stats->requests;
+  if (!fetch.success() ||
+      (fetch.response_headers()->status_code() != HttpStatus::kOK)) {
+    ++stats->failures;
+    return false;
+  }
+  stats->served_bytes += fetch.buffer().size();
+  if (body != NULL) {
+    *body = fetch.buffer();
+  }
+  return true;
+}
+
+void LoadTest::PageView(int page_index, PhaseStats* stats) {
+  ++stats->page_views;
+  stats->origin_bytes += origin_page_view_bytes_[page_index];
+  GoogleString html;
+  if (!Fetch(page_urls_[page_index], &html, stats)) {
+    return;
+  }
+  StringVector resources;
+  ExtractResourceUrls(GoogleUrl(page_urls_[page_index]), html, &resources);
+  for (int i = 0, n = resources.size(); i < n; ++i) {
+    Fetch(resources[i], NULL, stats);
+  }
+}
+
+void LoadTest::PrintHeader() {
+  printf("%-6s %10s %9s %8s %9s %8s %8s %10s %10s %7s %10s\n",
+         "Phase", "PageViews", "Requests", "Failures", "Req/s", "p50(ms)",
+         "p99(ms)", "OriginKB", "ServedKB", "Saved%", "CPUms/req");
+}
+
+void LoadTest::RunPhase(const char* name,
+                        const std::vector<int>& page_sequence) {
+  ThreadSystem* thread_system = factory_->thread_system();
+  int num_clients = std::max(FLAGS_clients, 1);
+  std::vector<Client*> clients;
+  for (int i = 0; i < num_clients; ++i) {
+    clients.push_back(new Client(this, thread_system, i));
+  }
+  for (int i = 0, n = page_sequence.size(); i < n; ++i) {
+    clients[i % num_clients]->AddPage(page_sequence[i]);
+  }
+
+  int64 cpu_start_us = ProcessCpuUs();
+  int64 start_us = wall_timer_->NowUs();
+  for (int i = 0; i < num_clients; ++i) {
+    CHECK(clients[i]->Start());
+  }
+  PhaseStats stats;
+  for (int i = 0; i < num_clients; ++i) {
+    clients[i]->Join();
+    stats.Merge(clients[i]->stats());
+  }
+  int64 elapsed_us = std::max(wall_timer_->NowUs() - start_us,
+                              static_cast<int64>(1));
+  factory_->mock_scheduler()->AwaitQuiescence();
+  int64 cpu_us = ProcessCpuUs() - cpu_start_us;
+  STLDeleteElements(&clients);
+
+  std::sort(stats.latencies_us.begin(), stats.latencies_us.end());
+  int64 p50_us = 0, p99_us = 0;
+  if (!stats.latencies_us.empty()) {
+    int n = stats.latencies_us.size();
+    p50_us = stats.latencies_us[n / 2];
+    p99_us = stats.latencies_us[std::min(n - 1, (n * 99) / 100)];
+  }
+  int requests = std::max(stats.requests, 1);
+  double saved_percent = (stats.origin_bytes == 0) ? 0.0 :
+      100.0 * (stats.origin_bytes - stats.served_bytes) / stats.origin_bytes;
+  printf("%-6s %10d %9d %8d %9.1f %8.2f %8.2f %10.1f %10.1f %7.1f %10.3f\n",
+         name, stats.page_views, stats.requests, stats.failures,
+         (1.0 * Timer::kSecondUs * stats.requests) / elapsed_us,
+         p50_us / 1000.0, p99_us / 1000.0, stats.origin_bytes / 1024.0,
+         stats.served_bytes / 1024.0, saved_percent,
+         cpu_us / (1000.0 * requests));
+  fflush(stdout);
+}
+
+}  // namespace
+
+bool ProxyLoadTestMain(int argc, char** argv) {
+  RewriteGflags gflags(argv[0], &argc, &argv);
+  ProcessContext process_context;
+  RewriteDriverFactory::Initialize();
+  bool ok;
+  {
+    LoadTest load_test(gflags);
+    ok = load_test.Init(process_context);
+    if (ok) {
+      std::vector<int> cold, warm;
+      for (int i = 0; i < FLAGS_pages; ++i) {
+        cold.push_back(i);
+      }
+      for (int i = 0; i < FLAGS_warm_page_views; ++i) {
+        warm.push_back(i % FLAGS_pages);
+      }
+      LoadTest::PrintHeader();
+      load_test.RunPhase("cold", cold);
+      load_test.RunPhase("warm", warm);
+    }
+  }
+  RewriteDriverFactory::Terminate();
+  return ok;
+}
+
+}  // namespace net_instaweb
+
+int main(int argc, char** argv) {
+  return net_instaweb::ProxyLoadTestMain(argc, argv)
+      ? EXIT_SUCCESS : EXIT_FAILURE;
+}
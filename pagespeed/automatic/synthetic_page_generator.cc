@@ -0,0 +1,333 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#include "pagespeed/automatic/synthetic_page_generator.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/image/image_util.h"
+#include "pagespeed/kernel/image/jpeg_optimizer.h"
+#include "pagespeed/kernel/image/read_image.h"
+#include "pagespeed/kernel/image/scanline_interface.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Shared vocabulary for class names, identifiers and text, so the output
+// compresses and minifies roughly like real pages do.
+const char* const kWords[] = {
+  "article", "banner", "button", "caption", "content", "detail", "footer",
+  "gallery", "header", "highlight", "item", "layout", "list", "main",
+  "menu", "navigation", "panel", "preview", "primary", "profile", "promo",
+  "search", "section", "sidebar", "summary", "thumbnail", "title", "widget",
+  "account", "checkout", "product", "review", "shipping", "subscribe",
+};
+
+const int kNumWords = arraysize(kWords);
+
+// A simple, fast generator (xorshift64*) whose output is identical on every
+// platform.  Each resource gets its own stream, seeded from the site seed
+// and its URL, so its content doesn't depend on generation order.
+uint64 HashUrl(StringPiece url) {
+  uint64 hash = 14695981039346656037ULL;  // FNV-1a.
+  for (int i = 0, n = url.size(); i < n; ++i) {
+    hash ^= static_cast<unsigned char>(url[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+class SyntheticPageGenerator::Random {
+ public:
+  Random(uint32 seed, StringPiece url)
+      : state_(HashUrl(url) ^ (static_cast<uint64>(seed) << 32 | seed)) {
+    if (state_ == 0) {
+      state_ = 1;
+    }
+  }
+
+  // Returns a value in [0, n).
+  int Uniform(int n) {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return static_cast<int>(((state_ * 2685821657736338717ULL) >> 33) % n);
+  }
+
+  const char* Word() { return kWords[Uniform(kNumWords)]; }
+
+  GoogleString Words(int count) {
+    GoogleString out;
+    for (int i = 0; i < count; ++i) {
+      if (i != 0) {
+        out += " ";
+      }
+      out += Word();
+    }
+    return out;
+  }
+
+  GoogleString Color() {
+    return StringPrintf("#%02x%02x%02x", Uniform(256), Uniform(256),
+                        Uniform(256));
+  }
+
+ private:
+  uint64 state_;
+
+  DISALLOW_COPY_AND_ASSIGN(Random);
+};
+
+SyntheticPageGenerator::Shape::Shape()
+    : num_pages(20),
+      html_bytes(20 * 1024),
+      css_per_page(3),
+      css_bytes(8 * 1024),
+      js_per_page(3),
+      js_bytes(16 * 1024),
+      images_per_page(6),
+      image_width(320),
+      image_height(240) {
+}
+
+SyntheticPageGenerator::SyntheticPageGenerator(
+    const Shape& shape, StringPiece base_url, uint32 seed)
+    : shape_(shape),
+      base_url_(base_url.data(), base_url.size()),
+      seed_(seed) {
+  DCHECK(base_url.ends_with("/"));
+}
+
+SyntheticPageGenerator::~SyntheticPageGenerator() {
+}
+
+GoogleString SyntheticPageGenerator::PageUrl(int page_index) const {
+  return StrCat(base_url_, "page", IntegerToString(page_index), ".html");
+}
+
+// The first stylesheet and script on every page are site-wide.
+GoogleString SyntheticPageGenerator::CssUrl(int page_index,
+                                            int css_index) const {
+  if (css_index == 0) {
+    return StrCat(base_url_, "css/site.css");
+  }
+  return StrCat(base_url_, "css/page", IntegerToString(page_index), "_",
+                IntegerToString(css_index), ".css");
+}
+
+GoogleString SyntheticPageGenerator::JsUrl(int page_index,
+                                           int js_index) const {
+  if (js_index == 0) {
+    return StrCat(base_url_, "js/site.js");
+  }
+  return StrCat(base_url_, "js/page", IntegerToString(page_index), "_",
+                IntegerToString(js_index), ".js");
+}
+
+GoogleString SyntheticPageGenerator::ImageUrl(int page_index,
+                                              int image_index) const {
+  return StrCat(base_url_, "img/page", IntegerToString(page_index), "_",
+                IntegerToString(image_index), ".jpg");
+}
+
+void SyntheticPageGenerator::Generate(std::vector<Resource>* site) const {
+  for (int p = 0; p < shape_.num_pages; ++p) {
+    Resource page;
+    page.url = PageUrl(p);
+    page.content_type = &kContentTypeHtml;
+    page.content = GenerateHtml(p);
+    site->push_back(page);
+  }
+  // Site-wide resources are only emitted once, for page 0.
+  for (int p = 0; p < shape_.num_pages; ++p) {
+    for (int i = (p == 0) ? 0 : 1; i < shape_.css_per_page; ++i) {
+      Resource css;
+      css.url = CssUrl(p, i);
+      css.content_type = &kContentTypeCss;
+      css.content = GenerateCss(css.url);
+      site->push_back(css);
+    }
+    for (int i = (p == 0) ? 0 : 1; i < shape_.js_per_page; ++i) {
+      Resource js;
+      js.url = JsUrl(p, i);
+      js.content_type = &kContentTypeJavascript;
+      js.content = GenerateJs(js.url);
+      site->push_back(js);
+    }
+    for (int i = 0; i < shape_.images_per_page; ++i) {
+      Resource image;
+      image.url = ImageUrl(p, i);
+      image.content_type = &kContentTypeJpeg;
+      image.content = GenerateImage(image.url);
+      site->push_back(image);
+    }
+  }
+}
+
+GoogleString SyntheticPageGenerator::GenerateHtml(int page_index) const {
+  GoogleString url = PageUrl(page_index);
+  Random random(seed_, url);
+  GoogleString html = StrCat(
+      "<!DOCTYPE html>\n<html>\n  <head>\n    <title>",
+      random.Words(4), "</title>\n");
+  for (int i = 0; i < shape_.css_per_page; ++i) {
+    StrAppend(&html, "    <link rel=\"stylesheet\" type=\"text/css\" href=\"",
+              CssUrl(page_index, i), "\">\n");
+  }
+  for (int i = 0; i < shape_.js_per_page; ++i) {
+    StrAppend(&html, "    <script type=\"text/javascript\" src=\"",
+              JsUrl(page_index, i), "\"></script>\n");
+  }
+  StrAppend(&html, "  </head>\n  <body>\n");
+
+  // Spread the images through the body text, then pad with text blocks
+  // until the page reaches its target size.
+  int images_placed = 0;
+  int block = 0;
+  while (images_placed < shape_.images_per_page ||
+         static_cast<int>(html.size()) < shape_.html_bytes) {
+    StrAppend(&html, "    <div class=\"", random.Word(), "-", random.Word(),
+              "\" id=\"block", IntegerToString(block), "\">\n");
+    StrAppend(&html, "      <h2>", random.Words(3 + random.Uniform(4)),
+              "</h2>\n");
+    StrAppend(&html, "      <p>", random.Words(20 + random.Uniform(40)),
+              ".</p>\n");
+    if (images_placed < shape_.images_per_page) {
+      StrAppend(&html, "      <img src=\"", ImageUrl(page_index, images_placed),
+                "\" width=\"", IntegerToString(shape_.image_width),
+                "\" height=\"", IntegerToString(shape_.image_height), "\"");
+      StrAppend(&html, " alt=\"", random.Words(3), "\">\n");
+      ++images_placed;
+    }
+    if (shape_.num_pages > 1) {
+      int other = random.Uniform(shape_.num_pages);
+      StrAppend(&html, "      <a href=\"", PageUrl(other), "\">",
+                random.Words(2), "</a>\n");
+    }
+    StrAppend(&html, "    </div>\n");
+    ++block;
+  }
+  StrAppend(&html, "  </body>\n</html>\n");
+  return html;
+}
+
+GoogleString SyntheticPageGenerator::GenerateCss(StringPiece url) const {
+  Random random(seed_, url);
+  GoogleString css;
+  int rule = 0;
+  while (static_cast<int>(css.size()) < shape_.css_bytes) {
+    StrAppend(&css, "/* ", random.Words(5), " */\n");
+    StrAppend(&css, ".", random.Word(), "-", random.Word(), " .",
+              random.Word(), IntegerToString(rule), " {\n");
+    StrAppend(&css, "  color: ", random.Color(), ";\n",
+              "  background-color: ", random.Color(), ";\n");
+    StrAppend(&css, "  margin: 0px ", IntegerToString(random.Uniform(20)),
+              "px 0px ", IntegerToString(random.Uniform(20)), "px;\n");
+    StrAppend(&css, "  font-family: \"Helvetica Neue\", Arial, sans-serif;\n",
+              "}\n\n");
+    ++rule;
+  }
+  return css;
+}
+
+GoogleString SyntheticPageGenerator::GenerateJs(StringPiece url) const {
+  Random random(seed_, url);
+  GoogleString js;
+  int function = 0;
+  while (static_cast<int>(js.size()) < shape_.js_bytes) {
+    GoogleString name = StrCat(random.Word(), "_", random.Word(), "_",
+                               IntegerToString(function));
+    StrAppend(&js, "// Computes the ", random.Words(4), " for the ",
+              random.Word(), ".\n");
+    StrAppend(&js, "function ", name, "(inputElements, scaleFactor) {\n",
+              "  var accumulatedValue = ",
+              IntegerToString(random.Uniform(1000)), ";\n");
+    StrAppend(&js, "  for (var index = 0; index < inputElements.length; "
+              "++index) {\n",
+              "    accumulatedValue += inputElements[index] * scaleFactor;\n",
+              "  }\n");
+    StrAppend(&js, "  return accumulatedValue;  // ", random.Words(3), "\n",
+              "}\n\n");
+    ++function;
+  }
+  return js;
+}
+
+// Draws a noisy gradient, so the JPEG is photo-like rather than trivially
+// compressible, and encodes it at high quality without optimized Huffman
+// tables, as cameras and many authoring tools do.
+GoogleString SyntheticPageGenerator::GenerateImage(StringPiece url) const {
+  using pagespeed::image_compression::CreateScanlineWriter;
+  using pagespeed::image_compression::IMAGE_JPEG;
+  using pagespeed::image_compression::JpegCompressionOptions;
+  using pagespeed::image_compression::RGB_888;
+  using pagespeed::image_compression::ScanlineWriterInterface;
+
+  Random random(seed_, url);
+  int width = shape_.image_width;
+  int height = shape_.image_height;
+  int base_r = random.Uniform(128);
+  int base_g = random.Uniform(128);
+  int base_b = random.Uniform(128);
+
+  JpegCompressionOptions options;
+  options.lossy = true;
+  options.lossy_options.quality = 95;
+  options.optimize_coding = false;
+
+  GoogleString jpeg;
+  NullMessageHandler handler;
+  scoped_ptr<ScanlineWriterInterface> writer(CreateScanlineWriter(
+      IMAGE_JPEG, RGB_888, width, height, &options, &jpeg, &handler));
+  if (writer.get() == NULL) {
+    LOG(DFATAL) << "Unable to create JPEG writer for " << url;
+    return jpeg;
+  }
+  std::vector<unsigned char> row(3 * width);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int shade = (x * 128) / width + (y * 64) / height;
+      row[3 * x] = std::min(base_r + shade + random.Uniform(24), 255);
+      row[3 * x + 1] = std::min(base_g + shade / 2 + random.Uniform(24), 255);
+      row[3 * x + 2] = std::min(base_b + 2 * shade + random.Uniform(24), 255);
+    }
+    if (!writer->WriteNextScanline(&row[0])) {
+      LOG(DFATAL) << "Unable to write JPEG scanline for " << url;
+      return GoogleString();
+    }
+  }
+  if (!writer->FinalizeWrite()) {
+    LOG(DFATAL) << "Unable to finish JPEG for " << url;
+    return GoogleString();
+  }
+  return jpeg;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#ifndef PAGESPEED_AUTOMATIC_SYNTHETIC_PAGE_GENERATOR_H_
+#define PAGESPEED_AUTOMATIC_SYNTHETIC_PAGE_GENERATOR_H_
+
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+struct ContentType;
+
+// Generates a small web site of pages that look enough like real ones to
+// give the rewriters realistic work: commented, indented CSS and
+// JavaScript, unoptimized JPEGs, and HTML that links them together.  The
+// output is a pure function of the shape and the seed, so load tests can
+// compare runs without a private corpus.
+//
+// Every page references one site-wide stylesheet and script (when it has
+// any at all) plus its own; images are never shared.
+class SyntheticPageGenerator {
+ public:
+  struct Shape {
+    Shape();
+
+    int num_pages;
+    int html_bytes;        // Approximate size of each page's markup.
+    int css_per_page;
+    int css_bytes;         // Approximate size of each stylesheet.
+    int js_per_page;
+    int js_bytes;          // Approximate size of each script.
+    int images_per_page;
+    int image_width;
+    int image_height;
+  };
+
+  struct Resource {
+    GoogleString url;
+    const ContentType* content_type;
+    GoogleString content;
+  };
+
+  // base_url must end in a slash; every generated URL is below it.
+  SyntheticPageGenerator(const Shape& shape, StringPiece base_url,
+                         uint32 seed);
+  ~SyntheticPageGenerator();
+
+  // Appends every page and resource of the site to site.  The pages come
+  // first, in order, so page i is (*site)[i] for a previously empty vector.
+  void Generate(std::vector<Resource>* site) const;
+
+  GoogleString PageUrl(int page_index) const;
+
+  const Shape& shape() const { return shape_; }
+
+ private:
+  class Random;
+
+  GoogleString CssUrl(int page_index, int css_index) const;
+  GoogleString JsUrl(int page_index, int js_index) const;
+  GoogleString ImageUrl(int page_index, int image_index) const;
+
+  GoogleString GenerateHtml(int page_index) const;
+  GoogleString GenerateCss(StringPiece url) const;
+  GoogleString GenerateJs(StringPiece url) const;
+  GoogleString GenerateImage(StringPiece url) const;
+
+  const Shape shape_;
+  const GoogleString base_url_;
+  const uint32 seed_;
+
+  DISALLOW_COPY_AND_ASSIGN(SyntheticPageGenerator);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_AUTOMATIC_SYNTHETIC_PAGE_GENERATOR_H_
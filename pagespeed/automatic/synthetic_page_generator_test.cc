@@ -0,0 +1,142 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+// Unit-tests for SyntheticPageGenerator
+
+#include "pagespeed/automatic/synthetic_page_generator.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/http/image_types.pb.h"
+#include "pagespeed/kernel/image/image_probe.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kBaseUrl[] = "http://www.example.com/";
+
+class SyntheticPageGeneratorTest : public testing::Test {
+ protected:
+  SyntheticPageGeneratorTest() {
+    shape_.num_pages = 3;
+    shape_.html_bytes = 4000;
+    shape_.css_per_page = 2;
+    shape_.css_bytes = 1000;
+    shape_.js_per_page = 2;
+    shape_.js_bytes = 1500;
+    shape_.images_per_page = 2;
+    shape_.image_width = 40;
+    shape_.image_height = 30;
+  }
+
+  SyntheticPageGenerator::Shape shape_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SyntheticPageGeneratorTest);
+};
+
+TEST_F(SyntheticPageGeneratorTest, SiteLayout) {
+  SyntheticPageGenerator generator(shape_, kBaseUrl, 1);
+  std::vector<SyntheticPageGenerator::Resource> site;
+  generator.Generate(&site);
+
+  // One site-wide stylesheet and script, plus one more of each and two
+  // images on each page.
+  ASSERT_EQ(3 + 2 + 3 * (1 + 1 + 2), site.size());
+  for (int p = 0; p < 3; ++p) {
+    EXPECT_EQ(generator.PageUrl(p), site[p].url);
+    EXPECT_EQ(&kContentTypeHtml, site[p].content_type);
+    EXPECT_LE(shape_.html_bytes, site[p].content.size());
+    EXPECT_TRUE(HasPrefixString(site[p].content, "<!DOCTYPE html>"));
+    EXPECT_NE(GoogleString::npos, site[p].content.find(
+        StrCat("href=\"", kBaseUrl, "css/site.css\"")));
+    EXPECT_NE(GoogleString::npos, site[p].content.find(
+        StrCat("src=\"", kBaseUrl, "js/site.js\"")));
+    EXPECT_NE(GoogleString::npos, site[p].content.find(
+        StrCat("src=\"", kBaseUrl, "img/page", IntegerToString(p),
+               "_1.jpg\"")));
+  }
+
+  int num_css = 0, num_js = 0, num_images = 0;
+  for (int i = 3, n = site.size(); i < n; ++i) {
+    const SyntheticPageGenerator::Resource& resource = site[i];
+    EXPECT_TRUE(HasPrefixString(resource.url, kBaseUrl));
+    if (resource.content_type == &kContentTypeCss) {
+      ++num_css;
+      EXPECT_LE(shape_.css_bytes, resource.content.size());
+    } else if (resource.content_type == &kContentTypeJavascript) {
+      ++num_js;
+      EXPECT_LE(shape_.js_bytes, resource.content.size());
+    } else {
+      ASSERT_EQ(&kContentTypeJpeg, resource.content_type);
+      ++num_images;
+      pagespeed::image_compression::ImageProbeResult probe;
+      ASSERT_TRUE(pagespeed::image_compression::ProbeImage(resource.content,
+                                                           &probe));
+      EXPECT_EQ(IMAGE_JPEG, probe.type) << resource.url;
+      ASSERT_TRUE(probe.has_dimensions) << resource.url;
+      EXPECT_EQ(shape_.image_width, probe.width);
+      EXPECT_EQ(shape_.image_height, probe.height);
+    }
+  }
+  EXPECT_EQ(4, num_css);
+  EXPECT_EQ(4, num_js);
+  EXPECT_EQ(6, num_images);
+}
+
+TEST_F(SyntheticPageGeneratorTest, Deterministic) {
+  std::vector<SyntheticPageGenerator::Resource> first, second, reseeded;
+  SyntheticPageGenerator(shape_, kBaseUrl, 1).Generate(&first);
+  SyntheticPageGenerator(shape_, kBaseUrl, 1).Generate(&second);
+  SyntheticPageGenerator(shape_, kBaseUrl, 2).Generate(&reseeded);
+  ASSERT_EQ(first.size(), second.size());
+  ASSERT_EQ(first.size(), reseeded.size());
+  for (int i = 0, n = first.size(); i < n; ++i) {
+    EXPECT_EQ(first[i].url, second[i].url);
+    EXPECT_EQ(first[i].content, second[i].content) << first[i].url;
+    EXPECT_EQ(first[i].url, reseeded[i].url);
+    EXPECT_NE(first[i].content, reseeded[i].content) << first[i].url;
+  }
+}
+
+TEST_F(SyntheticPageGeneratorTest, NoResources) {
+  shape_.css_per_page = 0;
+  shape_.js_per_page = 0;
+  shape_.images_per_page = 0;
+  SyntheticPageGenerator generator(shape_, kBaseUrl, 1);
+  std::vector<SyntheticPageGenerator::Resource> site;
+  generator.Generate(&site);
+  ASSERT_EQ(3, site.size());
+  EXPECT_EQ(GoogleString::npos, site[0].content.find("<link"));
+  EXPECT_EQ(GoogleString::npos, site[0].content.find("<script"));
+  EXPECT_EQ(GoogleString::npos, site[0].content.find("<img"));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
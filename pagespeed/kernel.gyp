@@ -38,6 +38,7 @@
       'sources': [
         'kernel/base/abstract_mutex.cc',
         'kernel/base/annotated_message_handler.cc',
+        'kernel/base/async_file_system.cc',
         'kernel/base/atom.cc',
         'kernel/base/debug.cc',
         'kernel/base/file_message_handler.cc',
@@ -57,6 +58,7 @@
         'kernel/base/symbol_table.cc',
         'kernel/base/time_util.cc',
         'kernel/base/timer.cc',
+        'kernel/base/thread_cpu_time.cc',
         'kernel/base/thread_system.cc',
         'kernel/base/writer.cc',
       ],
@@ -81,6 +83,7 @@
       'type': '<(library)',
       'sources': [
         'kernel/base/abstract_shared_mem.cc',
+        'kernel/base/allocation_profiler.cc',
         'kernel/base/cache_interface.cc',
         'kernel/base/charset_util.cc',
         'kernel/base/checking_thread_system.cc',
@@ -191,6 +194,7 @@
       'type': '<(library)',
       'sources': [
         'kernel/cache/async_cache.cc',
+        'kernel/cache/blocking_cache.cc',
         'kernel/cache/cache_batcher.cc',
         'kernel/cache/cache_stats.cc',
         'kernel/cache/compressed_cache.cc',
@@ -207,6 +211,7 @@
        ],
       'dependencies': [
         'pagespeed_base',
+        'pagespeed_sharedmem',
         '<(DEPTH)/third_party/rdestl/rdestl.gyp:rdestl',
       ],
       'include_dirs': [
@@ -304,6 +309,7 @@
       },
       'sources': [
         'kernel/http/bot_checker.gperf',
+        'kernel/http/http_header_name.gperf',
       ],
       'includes': [
         '../net/instaweb/gperf.gypi',
@@ -403,6 +409,7 @@
         'kernel/util/hashed_nonce_generator.cc',
         'kernel/util/input_file_nonce_generator.cc',
         'kernel/util/nonce_generator.cc',
+        'kernel/util/parallel_gzip.cc',
         'kernel/util/simple_random.cc',
         'kernel/util/statistics_logger.cc',
         'kernel/util/url_escaper.cc',
@@ -529,13 +536,16 @@
         '<(DEPTH)/third_party/zlib/zlib.gyp:zlib',
       ],
       'sources': [
+        'kernel/image/codec_pool.cc',
         'kernel/image/frame_interface_optimizer.cc',
         'kernel/image/gif_reader.cc',
         'kernel/image/image_analysis.cc',
         'kernel/image/image_converter.cc',
         'kernel/image/image_frame_interface.cc',
         'kernel/image/image_optimizer.cc',
+        'kernel/image/image_probe.cc',
         'kernel/image/image_resizer.cc',
+        'kernel/image/image_similarity.cc',
         'kernel/image/image_util.cc',
         'kernel/image/jpeg_optimizer.cc',
         'kernel/image/jpeg_reader.cc',
@@ -608,6 +618,7 @@
         'kernel/sharedmem/shared_mem_cache.cc',
         'kernel/sharedmem/shared_mem_cache_data.cc',
         'kernel/sharedmem/shared_mem_lock_manager.cc',
+        'kernel/sharedmem/shared_mem_purge_log.cc',
         'kernel/sharedmem/shared_mem_statistics.cc',
       ],
       'dependencies': [
@@ -668,11 +679,13 @@
       'target_name': 'pthread_system',
       'type': '<(library)',
       'sources': [
+        'kernel/thread/lock_profiler.cc',
         'kernel/thread/pthread_condvar.cc',
         'kernel/thread/pthread_mutex.cc',
         'kernel/thread/pthread_rw_lock.cc',
         'kernel/thread/pthread_shared_mem.cc',
         'kernel/thread/pthread_thread_system.cc',
+        'kernel/thread/uring_file_system.cc',
       ],
       'conditions': [
         ['support_posix_shared_mem != 1', {
@@ -688,6 +701,7 @@
         '<(DEPTH)',
       ],
       'ldflags': [
+        '-ldl',
         '-lrt',
       ]
     },
@@ -28,4 +28,8 @@ AbstractSharedMemSegment::~AbstractSharedMemSegment() {
 AbstractSharedMem::~AbstractSharedMem() {
 }
 
+bool AbstractSharedMem::SetNumaNodes(const std::vector<int>& nodes) {
+  return false;
+}
+
 }  // namespace net_instaweb
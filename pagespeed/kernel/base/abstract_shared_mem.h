@@ -22,6 +22,8 @@
 #define PAGESPEED_KERNEL_BASE_ABSTRACT_SHARED_MEM_H_
 
 #include <cstddef>
+#include <vector>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/string.h"
 
@@ -119,6 +121,13 @@ class AbstractSharedMem {
   // leave this as false.
   virtual bool IsDummy() { return false; }
 
+  // Requests that segments created from now on have their pages placed on
+  // the given NUMA nodes: bound to the node if there is one, and interleaved
+  // across them otherwise.  An empty list restores the default placement.
+  // Returns false if the implementation does not support placement, which
+  // is the default.
+  virtual bool SetNumaNodes(const std::vector<int>& nodes);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AbstractSharedMem);
 };
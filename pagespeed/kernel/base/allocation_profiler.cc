@@ -0,0 +1,59 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "pagespeed/kernel/base/allocation_profiler.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Plain integers, so that they are usable from operator new at any point in
+// a thread's life, including before and after its C++ thread_local objects.
+thread_local int64 thread_allocations = 0;
+thread_local int64 thread_bytes = 0;
+
+}  // namespace
+
+base::subtle::Atomic32 AllocationProfiler::enabled_ = 0;
+
+bool AllocationProfiler::compiled_in() {
+  // Keep in sync with the guard in mem_debug.cc.
+#if !defined(NDEBUG) || defined(PAGESPEED_ALLOCATION_PROFILING)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void AllocationProfiler::RecordAllocation(size_t bytes) {
+  if (enabled()) {
+    ++thread_allocations;
+    thread_bytes += bytes;
+  }
+}
+
+AllocationProfiler::Counts AllocationProfiler::ThreadCounts() {
+  Counts counts;
+  counts.allocations = thread_allocations;
+  counts.bytes = thread_bytes;
+  return counts;
+}
+
+}  // namespace net_instaweb
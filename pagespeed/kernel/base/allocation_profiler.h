@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_BASE_ALLOCATION_PROFILER_H_
+#define PAGESPEED_KERNEL_BASE_ALLOCATION_PROFILER_H_
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/atomicops.h"
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+// Counts the heap allocations made by each thread, so that allocation
+// volume can be charged to a unit of work, such as the HTML rewrite done by
+// a RewriteDriver, by sampling the counters before and after it.
+//
+// The counting is done by the operator new overrides in mem_debug.cc, which
+// are compiled into Debug builds and into Release builds made with the gyp
+// variable enable_allocation_profiling=1.  Other builds never count, and
+// compiled_in() returns false.  Where the overrides are present but the
+// profiler is disabled, each allocation pays a single relaxed load of a
+// global flag.
+class AllocationProfiler {
+ public:
+  struct Counts {
+    Counts() : allocations(0), bytes(0) {}
+
+    int64 allocations;
+    int64 bytes;
+  };
+
+  // Adds the allocations made on the current thread during its lifetime to
+  // *counts, if the profiler was enabled when it was constructed.
+  class ScopedCounter {
+   public:
+    explicit ScopedCounter(Counts* counts)
+        : counts_(AllocationProfiler::enabled() ? counts : NULL) {
+      if (counts_ != NULL) {
+        start_ = AllocationProfiler::ThreadCounts();
+      }
+    }
+
+    ~ScopedCounter() {
+      if (counts_ != NULL) {
+        Counts end = AllocationProfiler::ThreadCounts();
+        counts_->allocations += end.allocations - start_.allocations;
+        counts_->bytes += end.bytes - start_.bytes;
+      }
+    }
+
+   private:
+    Counts* counts_;
+    Counts start_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedCounter);
+  };
+
+  static bool enabled() {
+    return base::subtle::NoBarrier_Load(&enabled_) != 0;
+  }
+  static void set_enabled(bool x) {
+    base::subtle::Release_Store(&enabled_, x ? 1 : 0);
+  }
+
+  // Whether this binary contains the operator new overrides that count.
+  static bool compiled_in();
+
+  // Called by the operator new overrides for every allocation.
+  static void RecordAllocation(size_t bytes);
+
+  // Allocations counted on the calling thread since it started.
+  static Counts ThreadCounts();
+
+ private:
+  static base::subtle::Atomic32 enabled_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(AllocationProfiler);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_ALLOCATION_PROFILER_H_
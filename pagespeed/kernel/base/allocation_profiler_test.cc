@@ -0,0 +1,84 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test AllocationProfiler.
+
+#include "pagespeed/kernel/base/allocation_profiler.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumAllocations = 10;
+
+class AllocationProfilerTest : public testing::Test {
+ protected:
+  virtual ~AllocationProfilerTest() {
+    AllocationProfiler::set_enabled(false);
+  }
+
+  void Allocate(AllocationProfiler::Counts* counts) {
+    AllocationProfiler::ScopedCounter counter(counts);
+    for (int i = 0; i < kNumAllocations; ++i) {
+      blocks_.push_back(new char[100]);
+    }
+  }
+
+  virtual void TearDown() {
+    for (int i = 0, n = blocks_.size(); i < n; ++i) {
+      delete [] blocks_[i];
+    }
+  }
+
+  std::vector<char*> blocks_;
+};
+
+TEST_F(AllocationProfilerTest, DisabledCountsNothing) {
+  AllocationProfiler::Counts counts;
+  Allocate(&counts);
+  EXPECT_EQ(0, counts.allocations);
+  EXPECT_EQ(0, counts.bytes);
+}
+
+TEST_F(AllocationProfilerTest, EnabledCountsAllocations) {
+  if (!AllocationProfiler::compiled_in()) {
+    return;
+  }
+  AllocationProfiler::set_enabled(true);
+  AllocationProfiler::Counts counts;
+  Allocate(&counts);
+  // The vector's own reallocations are counted too.
+  EXPECT_LE(kNumAllocations, counts.allocations);
+  EXPECT_LE(kNumAllocations * 100, counts.bytes);
+
+  // A second scope accumulates into the same counts.
+  int64 previous = counts.allocations;
+  Allocate(&counts);
+  EXPECT_LE(previous + kNumAllocations, counts.allocations);
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#ifndef PAGESPEED_KERNEL_BASE_ASYNC_FILE_SYSTEM_H_
+#define PAGESPEED_KERNEL_BASE_ASYNC_FILE_SYSTEM_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class Sequence;
+
+// Optional extension to FileSystem for implementations that can perform
+// whole-file operations without blocking the calling thread.  Each call
+// returns immediately; when the operation finishes, its callback is added
+// to the supplied Sequence, so the caller decides which thread observes
+// the result.  If the Sequence is destroyed before the callback runs, the
+// callback is still called, reporting failure.  The file system does not
+// take ownership of callbacks; they usually delete themselves in Done.
+//
+// Implementations that cannot do asynchronous I/O on this platform may
+// perform the operation on the calling thread, but must still deliver the
+// result via the Sequence.  IsAsync() tells callers which is happening.
+class AsyncFileSystem {
+ public:
+  class ReadCallback {
+   public:
+    virtual ~ReadCallback();
+    // On success, contents holds the whole file; the callee may swap it out.
+    virtual void Done(bool success, GoogleString* contents) = 0;
+  };
+
+  class WriteCallback {
+   public:
+    virtual ~WriteCallback();
+    virtual void Done(bool success) = 0;
+  };
+
+  class StatCallback {
+   public:
+    virtual ~StatCallback();
+    // size_bytes is the disk utilization, as reported by FileSystem::Size.
+    virtual void Done(bool success, int64 size_bytes, int64 atime_sec,
+                      int64 mtime_sec) = 0;
+  };
+
+  virtual ~AsyncFileSystem();
+
+  // Returns true if operations are really performed off the calling thread.
+  virtual bool IsAsync() = 0;
+
+  // Reads filename in one shot.  A file larger than max_file_size fails,
+  // as does a missing file.  Read failures are reported only through the
+  // callback, since cache misses are routine.
+  virtual void ReadFileAsync(const GoogleString& filename,
+                             int64 max_file_size, Sequence* sequence,
+                             ReadCallback* callback) = 0;
+
+  // Like FileSystem::WriteFileAtomic: writes buffer to a temp file and then
+  // renames it over filename, creating directories as needed.  handler must
+  // outlive the operation.
+  virtual void WriteFileAtomicAsync(const GoogleString& filename,
+                                    const SharedString& buffer,
+                                    MessageHandler* handler,
+                                    Sequence* sequence,
+                                    WriteCallback* callback) = 0;
+
+  // Stats path.  A missing file fails quietly.
+  virtual void StatAsync(const GoogleString& path, Sequence* sequence,
+                         StatCallback* callback) = 0;
+
+  // Like FileSystem::RenameFile, creating directories for new_filename as
+  // needed.  handler must outlive the operation.
+  virtual void RenameFileAsync(const GoogleString& old_filename,
+                               const GoogleString& new_filename,
+                               MessageHandler* handler, Sequence* sequence,
+                               WriteCallback* callback) = 0;
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_ASYNC_FILE_SYSTEM_H_
@@ -35,6 +35,13 @@
     ::testing::Benchmark* _benchmark_##f = \
         (new ::testing::Benchmark(#f, f, lo, hi))->ThreadRange(1, 1)
 
+// RE2's runner only runs benchmarks on a single thread, so contention
+// benchmarks are registered as ranges whose argument is the number of
+// threads; f(iters, num_threads) is expected to pass both on to
+// ThreadedBenchmark::Run (pagespeed/kernel/util/threaded_benchmark.h).
+// The runner steps the argument through powers of two from lo to hi.
+#define BENCHMARK_THREAD_RANGE(f, lo, hi) BENCHMARK_RANGE(f, lo, hi)
+
 
 
 #endif  // PAGESPEED_KERNEL_BASE_BENCHMARK_H_
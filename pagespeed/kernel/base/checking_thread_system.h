@@ -23,6 +23,8 @@
 
 #include "pagespeed/kernel/base/thread_system.h"
 
+#include <vector>
+
 #include "pagespeed/kernel/base/atomic_bool.h"
 #include "pagespeed/kernel/base/atomic_int32.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -122,6 +124,9 @@ class CheckingThreadSystem : public ThreadSystem {
   virtual ThreadId* GetThreadId() const {
     return thread_system_->GetThreadId();
   }
+  virtual bool SetCurrentThreadCpuAffinity(const std::vector<int>& cpus) {
+    return thread_system_->SetCurrentThreadCpuAffinity(cpus);
+  }
 
  private:
   friend class Mutex;
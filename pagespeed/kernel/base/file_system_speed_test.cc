@@ -19,13 +19,22 @@
 
 
 #include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/async_file_system.h"
 #include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/sequence.h"
+#include "pagespeed/kernel/thread/uring_file_system.h"
+#include "pagespeed/kernel/util/platform.h"
 
 // Running the speed test:
 //   src/out/Release/mod_pagespeed_speed_test .File
@@ -34,6 +43,20 @@
 //   BM_1MWholeFile                10000            122070 ns/op
 //   BM_1MStreamingFile             2000            760416 ns/op
 //
+// The Async benchmarks read through UringFileSystem::ReadFileAsync, keeping
+// kReadsInFlight reads outstanding; the Blocking variants disable the ring,
+// so each read runs on the calling thread.  The Latency benchmarks issue one
+// read at a time.  On a 1-CPU VM with the file in the page cache:
+//   BM_100kAsyncBlocking         200000              8143 ns/op
+//   BM_100kAsyncUring            200000             13460 ns/op
+//   BM_1MAsyncBlocking            50000             65876 ns/op
+//   BM_1MAsyncUring               10000            128623 ns/op
+//   BM_100kLatencyBlocking       200000              7974 ns/op
+//   BM_100kLatencyUring          100000             14962 ns/op
+// With a hot page cache and no spare cores, the ring only adds the open,
+// statx, read and close round trips and a thread hop, so it costs about
+// twice as much per read.  What it buys is that the calling thread never
+// waits for the disk, which these benchmarks don't show.
 //
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
@@ -83,6 +106,81 @@ class FSTester {
   GoogleMessageHandler handler_;
 };
 
+// Runs each function as soon as it is added, on whatever thread adds it.
+class InlineSequence : public Sequence {
+ public:
+  InlineSequence() {}
+  virtual void Add(Function* function) { function->CallRun(); }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InlineSequence);
+};
+
+class AsyncFSTester : public AsyncFileSystem::ReadCallback {
+ public:
+  AsyncFSTester(int size, bool use_ring)
+      : thread_system_(Platform::CreateThreadSystem()),
+        file_system_(use_ring ? UringFileSystem::kDefaultQueueDepth : 0,
+                     thread_system_.get()),
+        mutex_(thread_system_->NewMutex()),
+        condvar_(mutex_->NewCondvar()),
+        outstanding_(0) {
+    StopBenchmarkTiming();
+    GoogleString str;
+    str.append(size, 'a');
+    filename_ = StrCat(GTestTempDir(), "large_file.txt");
+    file_system_.WriteFile(filename_.c_str(), str, &handler_);
+    LOG_IF(WARNING, use_ring && !file_system_.IsAsync())
+        << "io_uring is unavailable; measuring the blocking path";
+  }
+
+  ~AsyncFSTester() {
+    file_system_.ShutDown();
+    file_system_.RemoveFile(filename_.c_str(), &handler_);
+    StartBenchmarkTiming();
+  }
+
+  // Reads the file iters times, with up to max_in_flight reads outstanding.
+  void ReadFiles(int iters, int max_in_flight) {
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; ++i) {
+      {
+        ScopedMutex lock(mutex_.get());
+        while (outstanding_ >= max_in_flight) {
+          condvar_->Wait();
+        }
+        ++outstanding_;
+      }
+      file_system_.ReadFileAsync(filename_, FileSystem::kUnlimitedSize,
+                                 &sequence_, this);
+    }
+    ScopedMutex lock(mutex_.get());
+    while (outstanding_ > 0) {
+      condvar_->Wait();
+    }
+    StopBenchmarkTiming();
+  }
+
+  virtual void Done(bool success, GoogleString* contents) {
+    CHECK(success);
+    ScopedMutex lock(mutex_.get());
+    --outstanding_;
+    condvar_->Signal();
+  }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  UringFileSystem file_system_;
+  InlineSequence sequence_;
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> condvar_;
+  int outstanding_;
+  GoogleString filename_;
+  GoogleMessageHandler handler_;
+};
+
+const int kReadsInFlight = 32;
+
 static void BM_100kWholeFile(int iters) {
   FSTester fs_tester(100000);
   fs_tester.ReadWholeFile(iters);
@@ -107,6 +205,42 @@ static void BM_1MStreamingFile(int iters) {
 }
 BENCHMARK(BM_1MStreamingFile);
 
+static void BM_100kAsyncBlocking(int iters) {
+  AsyncFSTester fs_tester(100000, false);
+  fs_tester.ReadFiles(iters, kReadsInFlight);
+}
+BENCHMARK(BM_100kAsyncBlocking);
+
+static void BM_100kAsyncUring(int iters) {
+  AsyncFSTester fs_tester(100000, true);
+  fs_tester.ReadFiles(iters, kReadsInFlight);
+}
+BENCHMARK(BM_100kAsyncUring);
+
+static void BM_1MAsyncBlocking(int iters) {
+  AsyncFSTester fs_tester(1000000, false);
+  fs_tester.ReadFiles(iters, kReadsInFlight);
+}
+BENCHMARK(BM_1MAsyncBlocking);
+
+static void BM_1MAsyncUring(int iters) {
+  AsyncFSTester fs_tester(1000000, true);
+  fs_tester.ReadFiles(iters, kReadsInFlight);
+}
+BENCHMARK(BM_1MAsyncUring);
+
+static void BM_100kLatencyBlocking(int iters) {
+  AsyncFSTester fs_tester(100000, false);
+  fs_tester.ReadFiles(iters, 1);
+}
+BENCHMARK(BM_100kLatencyBlocking);
+
+static void BM_100kLatencyUring(int iters) {
+  AsyncFSTester fs_tester(100000, true);
+  fs_tester.ReadFiles(iters, 1);
+}
+BENCHMARK(BM_100kLatencyUring);
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -0,0 +1,466 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_BASE_FLAT_HASH_MAP_H_
+#define PAGESPEED_KERNEL_BASE_FLAT_HASH_MAP_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+namespace flat_hash_map_internal {
+
+// Each slot in the table has a one-byte control value.  Full slots hold the
+// low 7 bits of the key's hash (so the sign bit is clear); empty and deleted
+// slots have the sign bit set, which lets us find them all with one movemask.
+typedef signed char ControlByte;
+const ControlByte kEmpty = -128;   // 0x80
+const ControlByte kDeleted = -2;   // 0xfe
+const size_t kGroupWidth = 16;
+
+// A group of kGroupWidth consecutive control bytes, probed as a unit.  Each
+// Match method returns a bitmask with bit i set if control byte i matches.
+class Group {
+ public:
+  explicit Group(const ControlByte* ctrl) {
+#if defined(__SSE2__)
+    ctrl_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+    ctrl_ = ctrl;
+#endif
+  }
+
+  uint32 Match(ControlByte h2) const {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_));
+#else
+    return MatchScalar(h2);
+#endif
+  }
+
+  uint32 MatchEmpty() const {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(kEmpty), ctrl_));
+#else
+    return MatchScalar(kEmpty);
+#endif
+  }
+
+  uint32 MatchEmptyOrDeleted() const {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(ctrl_);
+#else
+    uint32 mask = 0;
+    for (size_t i = 0; i < kGroupWidth; ++i) {
+      if (ctrl_[i] < 0) {
+        mask |= 1U << i;
+      }
+    }
+    return mask;
+#endif
+  }
+
+ private:
+#if defined(__SSE2__)
+  __m128i ctrl_;
+#else
+  uint32 MatchScalar(ControlByte value) const {
+    uint32 mask = 0;
+    for (size_t i = 0; i < kGroupWidth; ++i) {
+      if (ctrl_[i] == value) {
+        mask |= 1U << i;
+      }
+    }
+    return mask;
+  }
+
+  const ControlByte* ctrl_;
+#endif
+};
+
+inline int LowestBit(uint32 mask) {
+  return __builtin_ctz(mask);
+}
+
+// The string hashes used in this codebase (see string_hash.h) are simple
+// polynomial hashes whose low bits are poorly distributed, so we run them
+// through the murmur3 finalizer before splitting them into the group index
+// (H1) and the 7-bit control tag (H2).
+inline uint64 MixHash(uint64 h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+}  // namespace flat_hash_map_internal
+
+// Open-addressing hash map in the style of the "Swiss table": keys and values
+// are stored inline in a flat slot array, with a parallel array of one-byte
+// control values that are probed 16 at a time using SSE2 compares.  A lookup
+// usually touches one cache line of control bytes and one slot.
+//
+// Lookups (find, count, erase-by-key) are templated on the key type, so a map
+// keyed by GoogleString can be probed with a StringPiece without constructing
+// a temporary string, provided the Hash and Equal functors accept both.  The
+// functors in string_hash.h that take StringPiece work for this.
+//
+// Differences from std::unordered_map to be aware of:
+//   - Inserting may rehash, which moves entries and invalidates all iterators
+//     and pointers to entries.  Values that must have a stable address should
+//     be stored by pointer.
+//   - Erasing does not invalidate iterators to other entries, so it is safe
+//     to erase the current element while iterating if the iterator is
+//     advanced first.
+//   - Key and Value must be copy-constructible; they are copied on rehash.
+template<class Key, class Value, class Hash, class Equal>
+class FlatHashMap {
+ public:
+  typedef std::pair<Key, Value> value_type;
+  typedef Key key_type;
+  typedef Value mapped_type;
+
+  class const_iterator;
+
+  class iterator {
+   public:
+    iterator() : map_(NULL), index_(0) {}
+
+    value_type& operator*() const { return map_->slots_[index_]; }
+    value_type* operator->() const { return &map_->slots_[index_]; }
+    iterator& operator++() {
+      index_ = map_->NextFullSlot(index_ + 1);
+      return *this;
+    }
+    bool operator==(const iterator& that) const {
+      return index_ == that.index_;
+    }
+    bool operator!=(const iterator& that) const {
+      return index_ != that.index_;
+    }
+
+   private:
+    friend class FlatHashMap;
+    friend class const_iterator;
+    iterator(FlatHashMap* map, size_t index) : map_(map), index_(index) {}
+
+    FlatHashMap* map_;
+    size_t index_;
+  };
+
+  class const_iterator {
+   public:
+    const_iterator() : map_(NULL), index_(0) {}
+    const_iterator(const iterator& src)  // NOLINT(runtime/explicit)
+        : map_(src.map_), index_(src.index_) {}
+
+    const value_type& operator*() const { return map_->slots_[index_]; }
+    const value_type* operator->() const { return &map_->slots_[index_]; }
+    const_iterator& operator++() {
+      index_ = map_->NextFullSlot(index_ + 1);
+      return *this;
+    }
+    bool operator==(const const_iterator& that) const {
+      return index_ == that.index_;
+    }
+    bool operator!=(const const_iterator& that) const {
+      return index_ != that.index_;
+    }
+
+   private:
+    friend class FlatHashMap;
+    const_iterator(const FlatHashMap* map, size_t index)
+        : map_(map), index_(index) {}
+
+    const FlatHashMap* map_;
+    size_t index_;
+  };
+
+  FlatHashMap()
+      : ctrl_(NULL),
+        slots_(NULL),
+        capacity_(0),
+        size_(0),
+        num_deleted_(0) {
+  }
+
+  ~FlatHashMap() {
+    DestroyAll();
+    delete [] ctrl_;
+    std::free(slots_);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return capacity_; }
+
+  iterator begin() { return iterator(this, NextFullSlot(0)); }
+  iterator end() { return iterator(this, capacity_); }
+  const_iterator begin() const {
+    return const_iterator(this, NextFullSlot(0));
+  }
+  const_iterator end() const { return const_iterator(this, capacity_); }
+
+  template<class K> iterator find(const K& key) {
+    return iterator(this, FindIndex(key));
+  }
+
+  template<class K> const_iterator find(const K& key) const {
+    return const_iterator(this, FindIndex(key));
+  }
+
+  template<class K> size_t count(const K& key) const {
+    return (FindIndex(key) == capacity_) ? 0 : 1;
+  }
+
+  // Inserts a copy of value if its key is not already present.  Returns an
+  // iterator to the entry with that key, and whether an insertion was made.
+  std::pair<iterator, bool> insert(const value_type& value) {
+    uint64 hash = HashOf(value.first);
+    size_t index = FindIndexWithHash(value.first, hash);
+    if (index != capacity_) {
+      return std::make_pair(iterator(this, index), false);
+    }
+    index = PrepareInsert(hash);
+    new(&slots_[index]) value_type(value);
+    return std::make_pair(iterator(this, index), true);
+  }
+
+  // Finds the value for key, inserting a default-constructed one first if
+  // the key is not present.
+  Value& operator[](const Key& key) {
+    uint64 hash = HashOf(key);
+    size_t index = FindIndexWithHash(key, hash);
+    if (index == capacity_) {
+      index = PrepareInsert(hash);
+      new(&slots_[index]) value_type(key, Value());
+    }
+    return slots_[index].second;
+  }
+
+  void erase(iterator iter) {
+    EraseIndex(iter.index_);
+  }
+
+  template<class K> size_t erase(const K& key) {
+    size_t index = FindIndex(key);
+    if (index == capacity_) {
+      return 0;
+    }
+    EraseIndex(index);
+    return 1;
+  }
+
+  // Removes all entries, retaining the allocated capacity.
+  void clear() {
+    DestroyAll();
+    if (capacity_ != 0) {
+      memset(ctrl_, flat_hash_map_internal::kEmpty, capacity_);
+    }
+    size_ = 0;
+    num_deleted_ = 0;
+  }
+
+  // Ensures that num_entries can be stored without rehashing.
+  void reserve(size_t num_entries) {
+    size_t capacity = capacity_;
+    if (capacity == 0) {
+      capacity = flat_hash_map_internal::kGroupWidth;
+    }
+    while (MaxLoad(capacity) < num_entries) {
+      capacity *= 2;
+    }
+    if (capacity != capacity_) {
+      Rehash(capacity);
+    }
+  }
+
+ private:
+  typedef flat_hash_map_internal::ControlByte ControlByte;
+  typedef flat_hash_map_internal::Group Group;
+
+  // We keep the table at most 7/8 full, counting tombstones, which
+  // guarantees every probe sequence terminates at an empty slot.
+  static size_t MaxLoad(size_t capacity) {
+    return capacity - capacity / 8;
+  }
+
+  template<class K> uint64 HashOf(const K& key) const {
+    return flat_hash_map_internal::MixHash(hash_(key));
+  }
+
+  static ControlByte H2(uint64 hash) {
+    return static_cast<ControlByte>(hash & 0x7f);
+  }
+
+  // Probes groups in triangular order: g, g+1, g+3, g+6, ...  Since the
+  // number of groups is a power of two, this visits every group.
+  template<class K> size_t FindIndexWithHash(const K& key, uint64 hash) const {
+    if (capacity_ == 0) {
+      return capacity_;
+    }
+    const size_t group_mask =
+        capacity_ / flat_hash_map_internal::kGroupWidth - 1;
+    size_t group = (hash >> 7) & group_mask;
+    ControlByte h2 = H2(hash);
+    for (size_t stride = 1; ; ++stride) {
+      size_t base = group * flat_hash_map_internal::kGroupWidth;
+      Group g(ctrl_ + base);
+      for (uint32 mask = g.Match(h2); mask != 0; mask &= mask - 1) {
+        size_t index = base + flat_hash_map_internal::LowestBit(mask);
+        if (equal_(slots_[index].first, key)) {
+          return index;
+        }
+      }
+      if (g.MatchEmpty() != 0) {
+        return capacity_;
+      }
+      group = (group + stride) & group_mask;
+    }
+  }
+
+  template<class K> size_t FindIndex(const K& key) const {
+    return FindIndexWithHash(key, HashOf(key));
+  }
+
+  // Finds a slot for a key known to be absent, growing the table if needed,
+  // and marks it full.  The caller must construct the slot contents.
+  size_t PrepareInsert(uint64 hash) {
+    if (size_ + num_deleted_ + 1 > MaxLoad(capacity_)) {
+      if (capacity_ == 0) {
+        Rehash(flat_hash_map_internal::kGroupWidth);
+      } else if ((size_ + 1) * 2 > MaxLoad(capacity_)) {
+        Rehash(capacity_ * 2);
+      } else {
+        // Mostly tombstones: rehash in place to reclaim them.
+        Rehash(capacity_);
+      }
+    }
+    size_t index = FindInsertSlot(hash);
+    if (ctrl_[index] == flat_hash_map_internal::kDeleted) {
+      --num_deleted_;
+    }
+    ctrl_[index] = H2(hash);
+    ++size_;
+    return index;
+  }
+
+  size_t FindInsertSlot(uint64 hash) const {
+    const size_t group_mask =
+        capacity_ / flat_hash_map_internal::kGroupWidth - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t stride = 1; ; ++stride) {
+      size_t base = group * flat_hash_map_internal::kGroupWidth;
+      uint32 mask = Group(ctrl_ + base).MatchEmptyOrDeleted();
+      if (mask != 0) {
+        return base + flat_hash_map_internal::LowestBit(mask);
+      }
+      group = (group + stride) & group_mask;
+    }
+  }
+
+  void EraseIndex(size_t index) {
+    DCHECK_LT(index, capacity_);
+    DCHECK_LE(0, ctrl_[index]);
+    slots_[index].~value_type();
+    --size_;
+
+    // If this slot's group still has an empty slot, no probe sequence can
+    // have passed through the group, so the slot can be marked empty rather
+    // than leaving a tombstone.
+    size_t base = index - (index % flat_hash_map_internal::kGroupWidth);
+    if (Group(ctrl_ + base).MatchEmpty() != 0) {
+      ctrl_[index] = flat_hash_map_internal::kEmpty;
+    } else {
+      ctrl_[index] = flat_hash_map_internal::kDeleted;
+      ++num_deleted_;
+    }
+  }
+
+  void Rehash(size_t new_capacity) {
+    DCHECK_EQ(0U, new_capacity % flat_hash_map_internal::kGroupWidth);
+    ControlByte* old_ctrl = ctrl_;
+    value_type* old_slots = slots_;
+    size_t old_capacity = capacity_;
+
+    ctrl_ = new ControlByte[new_capacity];
+    memset(ctrl_, flat_hash_map_internal::kEmpty, new_capacity);
+    slots_ = static_cast<value_type*>(
+        std::malloc(new_capacity * sizeof(value_type)));
+    capacity_ = new_capacity;
+    size_ = 0;
+    num_deleted_ = 0;
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] >= 0) {
+        uint64 hash = HashOf(old_slots[i].first);
+        size_t index = FindInsertSlot(hash);
+        ctrl_[index] = H2(hash);
+        new(&slots_[index]) value_type(old_slots[i]);
+        old_slots[i].~value_type();
+        ++size_;
+      }
+    }
+    delete [] old_ctrl;
+    std::free(old_slots);
+  }
+
+  void DestroyAll() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] >= 0) {
+        slots_[i].~value_type();
+      }
+    }
+  }
+
+  size_t NextFullSlot(size_t index) const {
+    while ((index < capacity_) && (ctrl_[index] < 0)) {
+      ++index;
+    }
+    return index;
+  }
+
+  ControlByte* ctrl_;
+  value_type* slots_;
+  size_t capacity_;
+  size_t size_;
+  size_t num_deleted_;
+  Hash hash_;
+  Equal equal_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlatHashMap);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_FLAT_HASH_MAP_H_
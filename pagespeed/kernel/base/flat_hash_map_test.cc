@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test FlatHashMap.
+
+#include "pagespeed/kernel/base/flat_hash_map.h"
+
+#include <map>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_hash.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+namespace {
+
+typedef FlatHashMap<GoogleString, int, CasePreserveStringPieceHash,
+                    CasePreserveStringPieceEqual> SensitiveMap;
+typedef FlatHashMap<GoogleString, int, CaseFoldStringPieceHash,
+                    CaseFoldStringPieceEqual> InsensitiveMap;
+
+// Hashes every key to the same value, forcing all entries into one probe
+// sequence so we exercise overflow into subsequent groups and tombstones.
+struct ConstantHash {
+  size_t operator()(StringPiece str) const { return 42; }
+};
+
+typedef FlatHashMap<GoogleString, int, ConstantHash,
+                    CasePreserveStringPieceEqual> CollidingMap;
+
+}  // namespace
+
+class FlatHashMapTest : public testing::Test {
+};
+
+TEST_F(FlatHashMapTest, Empty) {
+  SensitiveMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0, map.size());
+  EXPECT_EQ(0, map.capacity());
+  EXPECT_TRUE(map.find("a") == map.end());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_EQ(0, map.erase("a"));
+}
+
+TEST_F(FlatHashMapTest, InsertFindErase) {
+  SensitiveMap map;
+  std::pair<SensitiveMap::iterator, bool> result =
+      map.insert(SensitiveMap::value_type("hello", 1));
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ("hello", result.first->first);
+  EXPECT_EQ(1, result.first->second);
+
+  // A second insert with the same key leaves the original value in place.
+  result = map.insert(SensitiveMap::value_type("hello", 2));
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(1, result.first->second);
+  EXPECT_EQ(1, map.size());
+
+  // Lookups by StringPiece and by const char* find the GoogleString key.
+  GoogleString buffer("xhellox");
+  StringPiece piece(buffer.data() + 1, 5);
+  SensitiveMap::iterator p = map.find(piece);
+  ASSERT_TRUE(p != map.end());
+  EXPECT_EQ(1, p->second);
+  EXPECT_EQ(1, map.count("hello"));
+  EXPECT_EQ(0, map.count("Hello"));
+
+  map.erase(p);
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.find("hello") == map.end());
+}
+
+TEST_F(FlatHashMapTest, BracketOperator) {
+  SensitiveMap map;
+  map["a"] = 1;
+  map["b"] += 2;
+  map["b"] += 3;
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(1, map["a"]);
+  EXPECT_EQ(5, map["b"]);
+}
+
+TEST_F(FlatHashMapTest, CaseInsensitive) {
+  InsensitiveMap map;
+  map["Content-Type"] = 1;
+  map["CONTENT-TYPE"] = 2;
+  EXPECT_EQ(1, map.size());
+  InsensitiveMap::const_iterator p = map.find(StringPiece("content-type"));
+  ASSERT_TRUE(p != map.end());
+  EXPECT_EQ("Content-Type", p->first);
+  EXPECT_EQ(2, p->second);
+}
+
+TEST_F(FlatHashMapTest, ManyEntries) {
+  const int kNumEntries = 10000;
+  SensitiveMap map;
+  for (int i = 0; i < kNumEntries; ++i) {
+    map[IntegerToString(i)] = i;
+  }
+  EXPECT_EQ(kNumEntries, map.size());
+  for (int i = 0; i < kNumEntries; ++i) {
+    SensitiveMap::const_iterator p = map.find(IntegerToString(i));
+    ASSERT_TRUE(p != map.end()) << i;
+    EXPECT_EQ(i, p->second);
+  }
+  EXPECT_TRUE(map.find(IntegerToString(kNumEntries)) == map.end());
+
+  // Remove the odd entries.
+  for (int i = 1; i < kNumEntries; i += 2) {
+    EXPECT_EQ(1, map.erase(IntegerToString(i)));
+  }
+  EXPECT_EQ(kNumEntries / 2, map.size());
+  for (int i = 0; i < kNumEntries; ++i) {
+    EXPECT_EQ((i % 2) == 0 ? 1 : 0, map.count(IntegerToString(i))) << i;
+  }
+
+  // Iteration visits each remaining entry exactly once.
+  std::map<GoogleString, int> seen;
+  for (SensitiveMap::const_iterator p = map.begin(), e = map.end();
+       p != e; ++p) {
+    ++seen[p->first];
+    EXPECT_EQ(0, p->second % 2);
+  }
+  EXPECT_EQ(kNumEntries / 2, seen.size());
+  for (std::map<GoogleString, int>::const_iterator p = seen.begin();
+       p != seen.end(); ++p) {
+    EXPECT_EQ(1, p->second);
+  }
+}
+
+TEST_F(FlatHashMapTest, EraseWhileIterating) {
+  SensitiveMap map;
+  for (int i = 0; i < 100; ++i) {
+    map[StrCat("key", IntegerToString(i))] = i;
+  }
+  SensitiveMap::iterator p = map.begin();
+  while (p != map.end()) {
+    SensitiveMap::iterator next = p;
+    ++next;
+    if (p->second >= 50) {
+      map.erase(p);
+    }
+    p = next;
+  }
+  EXPECT_EQ(50, map.size());
+  EXPECT_EQ(1, map.count("key49"));
+  EXPECT_EQ(0, map.count("key50"));
+}
+
+TEST_F(FlatHashMapTest, Collisions) {
+  // With every key in the same probe sequence, repeated insert/erase cycles
+  // leave tombstones that must be skipped on lookup and reclaimed on growth.
+  CollidingMap map;
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 40; ++i) {
+      map[IntegerToString(i)] = i + round;
+    }
+    EXPECT_EQ(40, map.size());
+    for (int i = 0; i < 40; ++i) {
+      CollidingMap::iterator p = map.find(IntegerToString(i));
+      ASSERT_TRUE(p != map.end());
+      EXPECT_EQ(i + round, p->second);
+    }
+    for (int i = 0; i < 40; i += 3) {
+      EXPECT_EQ(1, map.erase(IntegerToString(i)));
+    }
+    for (int i = 0; i < 40; ++i) {
+      EXPECT_EQ((i % 3) == 0 ? 0 : 1, map.count(IntegerToString(i)));
+    }
+    map.clear();
+    EXPECT_TRUE(map.empty());
+  }
+}
+
+TEST_F(FlatHashMapTest, Reserve) {
+  SensitiveMap map;
+  map.reserve(100);
+  size_t capacity = map.capacity();
+  EXPECT_LE(100, capacity);
+  for (int i = 0; i < 100; ++i) {
+    map[IntegerToString(i)] = i;
+  }
+  EXPECT_EQ(capacity, map.capacity());
+}
+
+}  // namespace net_instaweb
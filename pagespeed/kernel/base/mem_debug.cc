@@ -53,14 +53,21 @@
 // are not included in Release builds, type:
 //   nm out/Debug/libmod_pagespeed.so   | /usr/bin/c++filt |grep 'operator new'
 //   nm out/Release/libmod_pagespeed.so | /usr/bin/c++filt |grep 'operator new'
-#ifndef NDEBUG
+//
+// The same overrides feed AllocationProfiler's per-thread counters.  Release
+// builds made with enable_allocation_profiling=1 include them for that
+// purpose alone, without the marker and scribbling overhead.
+#if !defined(NDEBUG) || defined(PAGESPEED_ALLOCATION_PROFILING)
 
 #include <cstdlib>
 #include "base/logging.h"
+#include "pagespeed/kernel/base/allocation_profiler.h"
 #include "pagespeed/kernel/base/basictypes.h"
 
 namespace {
 
+#ifndef NDEBUG
+
 const int32 kLiveMarker = 0xfeedface;   // first 4 bytes after alloc
 const int32 kDeadMarker1 = 0xabacabff;  // first 4 bytes after free
 const int32 kDeadMarker2 = 0xdeadbeef;  // overwrites the 'size' field on free
@@ -107,6 +114,25 @@ void debug_free(void* ptr) {
   }
 }
 
+#else
+
+void* debug_malloc(size_t size) {
+  void* ptr = malloc((size == 0) ? 1 : size);
+  CHECK(ptr != NULL);
+  return ptr;
+}
+
+void debug_free(void* ptr) {
+  free(ptr);
+}
+
+#endif  // !NDEBUG
+
+void* counting_malloc(size_t size) {
+  net_instaweb::AllocationProfiler::RecordAllocation(size);
+  return debug_malloc(size);
+}
+
 }  // namespace
 
 // C++ operator new/delete overrides, in all 8 combinations:
@@ -117,15 +143,15 @@ void debug_free(void* ptr) {
 #endif
 
 void* operator new(size_t size) throw (std::bad_alloc) {
-  return debug_malloc(size);
+  return counting_malloc(size);
 }
 
 void* operator new[](size_t size) throw (std::bad_alloc) {
-  return debug_malloc(size);
+  return counting_malloc(size);
 }
 
 void* operator new(size_t size, const std::nothrow_t&) __THROW {
-  return debug_malloc(size);
+  return counting_malloc(size);
 }
 
 void operator delete(void* ptr) __THROW {
@@ -137,7 +163,7 @@ void operator delete(void* ptr, const std::nothrow_t&) __THROW {
 }
 
 void* operator new[](size_t size, const std::nothrow_t&) __THROW {
-  return debug_malloc(size);
+  return counting_malloc(size);
 }
 
 void operator delete[](void* ptr) __THROW {
@@ -148,4 +174,4 @@ void operator delete[](void* ptr, const std::nothrow_t&) __THROW {
   debug_free(ptr);
 }
 
-#endif  // !NDEBUG
+#endif  // !NDEBUG || PAGESPEED_ALLOCATION_PROFILING
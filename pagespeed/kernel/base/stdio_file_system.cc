@@ -50,11 +50,6 @@
 #include "pagespeed/kernel/base/string_util.h"
 
 namespace {
-// The st_blocks field returned by stat is the number of 512B blocks allocated
-// for the files. (While POSIX doesn't specify this, it's the proper value on
-// at least Linux, FreeBSD, and OS X).
-const int kBlockSize = 512;
-
 static const char kOutstandingOps[] = "stdio_fs_outstanding_ops";
 static const char kSlowOps[] = "stdio_fs_slow_ops";
 static const char kTotalOps[] = "stdio_fs_total_ops";
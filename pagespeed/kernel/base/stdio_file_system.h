@@ -90,11 +90,17 @@ class StdioFileSystem : public FileSystem {
   int64 StartTimer();
   void EndTimer(const char* filename, const char* operation, int64 start_us);
 
- private:
+ protected:
   // Used by *time and Size methods to get file info.
   bool Stat(const StringPiece& path, struct stat* statbuf,
             MessageHandler* handler) const;
 
+  // The st_blocks field returned by stat is the number of 512B blocks
+  // allocated for the files. (While POSIX doesn't specify this, it's the
+  // proper value on at least Linux, FreeBSD, and OS X).
+  static const int kBlockSize = 512;
+
+ private:
   int64 slow_file_latency_threshold_us_;
   Timer* timer_;
   Statistics* statistics_;
@@ -101,6 +101,12 @@ struct CasePreserveStringPieceHash {
   }
 };
 
+struct CasePreserveStringPieceEqual {
+  bool operator()(StringPiece a, StringPiece b) const {
+    return a == b;
+  }
+};
+
 struct CaseFoldStringPieceHash {
   size_t operator()(StringPiece str) const {
     return HashString<CaseFold, size_t>(str.data(), str.size());
@@ -22,13 +22,14 @@
 #define PAGESPEED_KERNEL_BASE_STRING_MULTI_MAP_H_
 
 #include <algorithm>
-#include <set>
 #include <utility>
 #include <vector>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/flat_hash_map.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_hash.h"
 #include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
@@ -40,7 +41,12 @@ namespace net_instaweb {
 // The keys and values in the map may contain embedded NUL characters.
 // The values can also be the NULL pointer, which the API retains
 // distinctly from empty strings.
-template<class StringCompare> class StringMultiMap {
+//
+// StringCompare is used to validate the sorted arrays passed to
+// RemoveAllFromSortedArray; StringHash and StringEqual define the name
+// lookups and must be consistent with it.
+template<class StringCompare, class StringHash, class StringEqual>
+class StringMultiMap {
  public:
   StringMultiMap() { }
   ~StringMultiMap() {
@@ -55,12 +61,16 @@ template<class StringCompare> class StringMultiMap {
     for (int i = 0, n = vector_.size(); i < n; ++i) {
       delete vector_[i].second;
     }
-    set_.clear();
+    for (typename Map::iterator p = map_.begin(), e = map_.end(); p != e;
+         ++p) {
+      delete p->second;
+    }
+    map_.clear();
     vector_.clear();
   }
 
   // Returns the number of distinct names
-  int num_names() const { return set_.size(); }
+  int num_names() const { return map_.size(); }
 
   // Returns the number of distinct values, which can be larger than num_names
   // if Add is called twice with the same name.
@@ -71,15 +81,24 @@ template<class StringCompare> class StringMultiMap {
   // with the same variable, and each of these values will be returned
   // in the vector.
   bool Lookup(const StringPiece& name, ConstStringStarVector* values) const {
-    SetEntry lookup_entry(name);
-    typename Set::const_iterator p = set_.find(lookup_entry);
-    bool ret = false;
-    if (p != set_.end()) {
-      ret = true;
-      const SetEntry& stored_entry = *p;
-      *values = stored_entry.values();
+    const ConstStringStarVector* found = LookupValues(name);
+    if (found == NULL) {
+      return false;
+    }
+    *values = *found;
+    return true;
+  }
+
+  // Like Lookup, but returns the map's own vector of values for name, or NULL
+  // if name is not present, avoiding a copy.  The returned vector is stable:
+  // it remains valid, and is updated in place by Add, until name is removed
+  // or the map is cleared.
+  const ConstStringStarVector* LookupValues(const StringPiece& name) const {
+    typename Map::const_iterator p = map_.find(name);
+    if (p == map_.end()) {
+      return NULL;
     }
-    return ret;
+    return &p->second->values();
   }
 
   // Looks up a single value.  Returns NULL if the name is not found or more
@@ -93,8 +112,7 @@ template<class StringCompare> class StringMultiMap {
   }
 
   bool Has(const StringPiece& name) const {
-    SetEntry lookup_entry(name);
-    return set_.find(lookup_entry) != set_.end();
+    return map_.find(name) != map_.end();
   }
 
   // Remove all variables by name.  Returns true if anything was removed.
@@ -119,21 +137,16 @@ template<class StringCompare> class StringMultiMap {
     }
 #endif
 
-    // Keep around dummy entry for stuffing in keys and doing lookups.
-    // The values field for this instance is unused.
-    SetEntry lookup_entry;
-
     // First, see if any of the names are in the map.  This way we'll avoid
     // making any allocations if there is no work to be done.  We cannot
     // actually remove the map entries, though, until we rebuild the vector,
     // since the map owns the StringPiece key storage used by the vector.
     const int kNotFound = -1;
     int index_of_first_match = kNotFound;
-    typename Set::iterator set_entry_of_first_match;
+    typename Map::iterator map_entry_of_first_match;
     for (int i = 0; i < names_size; ++i) {
-      lookup_entry.set_key(names[i]);
-      set_entry_of_first_match = set_.find(lookup_entry);
-      if (set_entry_of_first_match != set_.end()) {
+      map_entry_of_first_match = map_.find(names[i]);
+      if (map_entry_of_first_match != map_.end()) {
         index_of_first_match = i;
         break;
       }
@@ -155,10 +168,14 @@ template<class StringCompare> class StringMultiMap {
 
       vector_.swap(temp_vector);
 
-      set_.erase(set_entry_of_first_match);
+      delete map_entry_of_first_match->second;
+      map_.erase(map_entry_of_first_match);
       for (int i = index_of_first_match + 1; i < names_size; ++i) {
-        lookup_entry.set_key(names[i]);
-        set_.erase(lookup_entry);
+        typename Map::iterator p = map_.find(names[i]);
+        if (p != map_.end()) {
+          delete p->second;
+          map_.erase(p);
+        }
       }
     }
     return true;
@@ -171,31 +188,22 @@ template<class StringCompare> class StringMultiMap {
 
   // Add a new variable.  The value can be null.
   void Add(const StringPiece& key, const StringPiece& value) {
-    SetEntry lookup_entry(key);
-    std::pair<typename Set::iterator, bool> iter_inserted =
-        set_.insert(lookup_entry);
-    typename Set::iterator iter = iter_inserted.first;
-
-    // To avoid letting you corrupt the comparison sanity of an STL set,
-    // the 'insert' method returns an iterator that returns you only a
-    // const reference to the stored entry.  However, the mutation we are
-    // going to do here is to change the key to point to storage we'll
-    // own in the entry, which we want to allocate only the first time
-    // it is added.
-    //
-    // We also need to be able to mutate the entry to allow adding new
-    // value entries.
-    SetEntry& entry = const_cast<SetEntry&>(*iter);
-    if (iter_inserted.second) {
-      // The first time we insert, make a copy of the key in storage we own.
-      entry.SaveKey();
+    Entry* entry;
+    typename Map::iterator iter = map_.find(key);
+    if (iter != map_.end()) {
+      entry = iter->second;
+    } else {
+      // The first time we see a name, make a copy of it in storage owned
+      // by the entry, and key the map on that copy.
+      entry = new Entry(key);
+      map_.insert(typename Map::value_type(entry->key(), entry));
     }
     GoogleString* value_copy = NULL;
     if (value.data() != NULL) {
       value_copy = new GoogleString(value.as_string());
     }
-    entry.AddValue(value_copy);
-    vector_.push_back(StringPair(iter->key(), value_copy));
+    entry->AddValue(value_copy);
+    vector_.push_back(StringPair(entry->key(), value_copy));
   }
 
   // Parse and add from a string of name-value pairs.
@@ -234,58 +242,28 @@ template<class StringCompare> class StringMultiMap {
   }
 
  private:
-  // We are creating a map-like object using a std::set to make it clearer
-  // how we are managing key storage within the entry.
-  class SetEntry {
+  // Each distinct name gets a heap-allocated Entry, which owns the name
+  // storage and collects pointers to all the values added under that name.
+  // The Entry does not move when the map rehashes, so the StringPiece keys
+  // in the map and in vector_ remain valid for the life of the Entry.
+  class Entry {
    public:
-    SetEntry() { }
-    SetEntry(StringPiece key) : key_(key) { }
-    SetEntry(const SetEntry& src)
-        : key_(src.key_) {
-      // Note that a copy-construction does occur in Add, but only of
-      // the lookup_entry, which will not have a saved key.
-      DCHECK(src.values_.empty());
-    }
-
-    SetEntry& operator=(const SetEntry& src) {
-      if (&src != this) {
-        DCHECK(src.values_.empty());
-        key_ = src.key_;
-      }
-      return *this;
-    }
-
-    void set_key(StringPiece key) {
-      key_ = key;
+    explicit Entry(StringPiece key) {
+      key.CopyToString(&key_storage_);
     }
 
     void AddValue(const GoogleString* value) {
       values_.push_back(value);
     }
 
-    // During lookups, key will point to the passed-in StringPiece.
-    // However, the persistent entry we put in the map must duplicate
-    // the key into key_storage and change key to point to that.
-    void SaveKey() {
-      key_.CopyToString(&key_storage_);
-      key_ = key_storage_;
-    }
-
-    StringPiece key() const { return key_; }
+    StringPiece key() const { return key_storage_; }
     const ConstStringStarVector& values() const { return values_; }
 
    private:
     GoogleString key_storage_;
-    StringPiece key_;
     ConstStringStarVector values_;
-  };
-
-  struct EntryCompare {
-    bool operator()(const SetEntry& a, const SetEntry& b) const {
-      return compare(a.key(), b.key());
-    }
 
-    StringCompare compare;
+    DISALLOW_COPY_AND_ASSIGN(Entry);
   };
 
   // We are keeping two structures, conceptually map<String,vector<String>> and
@@ -293,29 +271,33 @@ template<class StringCompare> class StringMultiMap {
   // also order-preserving iteration and easy indexed access.
   //
   // To avoid duplicating the strings and superfluous string-allocations on
-  // lookups, we implement this via a set, whose entries own the keys.  A
-  // separate string-pair-vector owns the values as new'd GoogleString*.  We
-  // use a pointer here to avoid the cost of string-copies as the vector is
-  // resized.
+  // lookups, we implement this via a flat hash map keyed by StringPiece,
+  // whose Entry values own the keys.  A separate string-pair-vector owns the
+  // values as new'd GoogleString*.  We use a pointer here to avoid the cost
+  // of string-copies as the vector is resized.
   typedef std::pair<StringPiece, GoogleString*> StringPair;  // owns the value
-  typedef std::set<SetEntry, EntryCompare> Set;
+  typedef FlatHashMap<StringPiece, Entry*, StringHash, StringEqual> Map;
   typedef std::vector<StringPair> StringPairVector;
 
-  Set set_;
+  Map map_;
   StringPairVector vector_;
 
   DISALLOW_COPY_AND_ASSIGN(StringMultiMap);
 };
 
 class StringMultiMapInsensitive
-    : public StringMultiMap<StringCompareInsensitive> {
+    : public StringMultiMap<StringCompareInsensitive, CaseFoldStringPieceHash,
+                            CaseFoldStringPieceEqual> {
  public:
   StringMultiMapInsensitive() { }
  private:
   DISALLOW_COPY_AND_ASSIGN(StringMultiMapInsensitive);
 };
 
-class StringMultiMapSensitive : public StringMultiMap<StringCompareSensitive> {
+class StringMultiMapSensitive
+    : public StringMultiMap<StringCompareSensitive,
+                            CasePreserveStringPieceHash,
+                            CasePreserveStringPieceEqual> {
  public:
   StringMultiMapSensitive() { }
  private:
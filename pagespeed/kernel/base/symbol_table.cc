@@ -47,9 +47,6 @@ template<class CharTransform>
 SymbolTable<CharTransform>::SymbolTable()
     : next_ptr_(NULL),
       string_bytes_allocated_(0) {
-  // We can use an empty string piece as the empty value, since
-  // ::Intern has a quick exit on empty inputs.
-  string_map_.set_empty_key(StringPiece());
 }
 
 template<class CharTransform>
@@ -111,7 +108,7 @@ Atom SymbolTable<CharTransform>::Intern(const StringPiece& src) {
     StringPiece new_sp(new_symbol_storage, src.size());
     pieces_.push_back(new_sp);
     StringPiece* canonical_sp = &pieces_.back();
-    string_map_.insert(make_pair(new_sp, canonical_sp));
+    string_map_.insert(typename SymbolMap::value_type(new_sp, canonical_sp));
     string_bytes_allocated_ += bytes_required;
     return Atom(canonical_sp);
   }
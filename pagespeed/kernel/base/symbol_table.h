@@ -28,7 +28,7 @@
 
 #include "pagespeed/kernel/base/atom.h"
 #include "pagespeed/kernel/base/basictypes.h"
-#include "pagespeed/kernel/base/dense_hash_map.h"
+#include "pagespeed/kernel/base/flat_hash_map.h"
 #include "pagespeed/kernel/base/string_hash.h"
 #include "pagespeed/kernel/base/string_util.h"
 
@@ -96,8 +96,7 @@ template<class CharTransform> class SymbolTable {
     }
   };
 
-  typedef dense_hash_map<StringPiece, StringPiece*,
-                         Hash, Comparator> SymbolMap;
+  typedef FlatHashMap<StringPiece, StringPiece*, Hash, Comparator> SymbolMap;
   SymbolMap string_map_;
 
   // Since we don't want to have Atom include both base and size, it keeps
@@ -0,0 +1,37 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_BASE_THREAD_CPU_TIME_H_
+#define PAGESPEED_KERNEL_BASE_THREAD_CPU_TIME_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+// Returns the CPU time consumed so far by the calling thread, in
+// microseconds, or -1 if the platform has no per-thread CPU clock.  Unlike
+// Timer::NowUs, time the thread spends blocked or descheduled is not
+// counted, so the difference between two readings charges only the work
+// done in between.
+int64 ThreadCpuTimeUs();
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_THREAD_CPU_TIME_H_
@@ -0,0 +1,58 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test ThreadCpuTimeUs.
+
+#include "pagespeed/kernel/base/thread_cpu_time.h"
+
+#include <unistd.h>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+
+namespace net_instaweb {
+
+namespace {
+
+TEST(ThreadCpuTimeTest, CountsWorkButNotSleep) {
+  int64 start_us = ThreadCpuTimeUs();
+  if (start_us < 0) {
+    return;  // No per-thread CPU clock on this platform.
+  }
+
+  // Spin until the clock has advanced by at least a millisecond.
+  volatile int64 sink = 0;
+  int64 now_us = start_us;
+  while (now_us - start_us < 1000) {
+    for (int i = 0; i < 10000; ++i) {
+      sink += i;
+    }
+    now_us = ThreadCpuTimeUs();
+  }
+  EXPECT_LE(start_us + 1000, now_us);
+
+  // Sleeping for 50ms should cost far less than 50ms of CPU.
+  usleep(50 * 1000);
+  EXPECT_GT(25 * 1000, ThreadCpuTimeUs() - now_us);
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -20,6 +20,8 @@
 
 #include "pagespeed/kernel/base/thread_system.h"
 
+#include <vector>
+
 namespace net_instaweb {
 
 ThreadSystem::~ThreadSystem() {
@@ -40,4 +42,8 @@ void ThreadSystem::RWLock::DCheckReaderLocked() {
 ThreadSystem::ThreadId::~ThreadId() {
 }
 
+bool ThreadSystem::SetCurrentThreadCpuAffinity(const std::vector<int>& cpus) {
+  return false;
+}
+
 }  // namespace net_instaweb
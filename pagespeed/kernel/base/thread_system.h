@@ -29,6 +29,8 @@
 #ifndef PAGESPEED_KERNEL_BASE_THREAD_SYSTEM_H_
 #define PAGESPEED_KERNEL_BASE_THREAD_SYSTEM_H_
 
+#include <vector>
+
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
@@ -153,6 +155,12 @@ class ThreadSystem {
   // be freed by the caller.
   virtual ThreadId* GetThreadId() const = 0;
 
+  // Restricts the calling thread to run only on the given CPUs, numbered as
+  // the OS numbers them.  Returns false if that is not supported or fails,
+  // leaving the thread unrestricted.  The default implementation always
+  // returns false.
+  virtual bool SetCurrentThreadCpuAffinity(const std::vector<int>& cpus);
+
  private:
   friend class Thread;
   friend class MockThreadSystem;
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/cache/blocking_cache.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/stl_util.h"
+
+namespace net_instaweb {
+
+// Passes candidates straight through to the caller's callback for
+// validation, but holds on to the final state until the caller has
+// finished waiting.
+class BlockingCache::WaitingCallback : public CacheInterface::Callback {
+ public:
+  WaitingCallback(BlockingCache* cache, CacheInterface::Callback* callback)
+      : cache_(cache),
+        callback_(callback),
+        state_(CacheInterface::kNotFound),
+        done_(false) {
+  }
+
+  // Waits for Done, then calls the caller's callback.
+  void WaitAndReport() {
+    {
+      ScopedMutex lock(cache_->mutex_.get());
+      while (!done_) {
+        cache_->done_->Wait();
+      }
+    }
+    callback_->DelegatedDone(state_);
+  }
+
+ protected:
+  virtual bool ValidateCandidate(const GoogleString& key,
+                                 CacheInterface::KeyState state) {
+    callback_->set_value(value());
+    return callback_->DelegatedValidateCandidate(key, state);
+  }
+
+  virtual void Done(CacheInterface::KeyState state) {
+    ScopedMutex lock(cache_->mutex_.get());
+    state_ = state;
+    done_ = true;
+    cache_->done_->Broadcast();
+  }
+
+ private:
+  BlockingCache* cache_;
+  CacheInterface::Callback* callback_;
+  CacheInterface::KeyState state_;
+  bool done_;
+
+  DISALLOW_COPY_AND_ASSIGN(WaitingCallback);
+};
+
+BlockingCache::BlockingCache(CacheInterface* cache,
+                             ThreadSystem* thread_system)
+    : cache_(cache),
+      mutex_(thread_system->NewMutex()),
+      done_(mutex_->NewCondvar()) {
+}
+
+BlockingCache::~BlockingCache() {
+}
+
+GoogleString BlockingCache::FormatName(StringPiece cache) {
+  return StrCat("Blocking(", cache, ")");
+}
+
+void BlockingCache::Get(const GoogleString& key, Callback* callback) {
+  WaitingCallback waiter(this, callback);
+  cache_->Get(key, &waiter);
+  waiter.WaitAndReport();
+}
+
+void BlockingCache::MultiGet(MultiGetRequest* request) {
+  std::vector<WaitingCallback*> waiters;
+  MultiGetRequest* waiting_request = new MultiGetRequest;
+  for (int i = 0, n = request->size(); i < n; ++i) {
+    KeyCallback* key_callback = &(*request)[i];
+    waiters.push_back(new WaitingCallback(this, key_callback->callback));
+    waiting_request->push_back(KeyCallback(key_callback->key, waiters.back()));
+  }
+  delete request;
+  cache_->MultiGet(waiting_request);
+  for (WaitingCallback* waiter : waiters) {
+    waiter->WaitAndReport();
+  }
+  STLDeleteElements(&waiters);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,80 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_BLOCKING_CACHE_H_
+#define PAGESPEED_KERNEL_CACHE_BLOCKING_CACHE_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+
+namespace net_instaweb {
+
+// The inverse of AsyncCache: makes the calling thread wait for the lookups
+// of a non-blocking cache, for clients that need IsBlocking(), such as the
+// property store.  The wrapped cache calls ValidateCandidate on whatever
+// thread it likes, but Done is always called on the thread that made the
+// request, before Get or MultiGet returns.
+class BlockingCache : public CacheInterface {
+ public:
+  // Does not take ownership of cache.
+  BlockingCache(CacheInterface* cache, ThreadSystem* thread_system);
+  virtual ~BlockingCache();
+
+  virtual void Get(const GoogleString& key, Callback* callback);
+  virtual void MultiGet(MultiGetRequest* request);
+  virtual void Put(const GoogleString& key, const SharedString& value) {
+    cache_->Put(key, value);
+  }
+  virtual void Delete(const GoogleString& key) { cache_->Delete(key); }
+  virtual CacheInterface* Backend() { return cache_; }
+  static GoogleString FormatName(StringPiece cache);
+  virtual GoogleString Name() const { return FormatName(cache_->Name()); }
+  virtual bool IsBlocking() const { return true; }
+  virtual bool IsHealthy() const { return cache_->IsHealthy(); }
+  virtual void ShutDown() { cache_->ShutDown(); }
+
+  virtual bool MustEncodeKeyInValueOnPut() const {
+    return cache_->MustEncodeKeyInValueOnPut();
+  }
+  virtual void PutWithKeyInValue(const GoogleString& key,
+                                 const SharedString& key_and_value) {
+    cache_->PutWithKeyInValue(key, key_and_value);
+  }
+
+ private:
+  class WaitingCallback;
+
+  CacheInterface* cache_;
+
+  // Shared by all the waiting threads, each of which checks its own
+  // callback when woken.
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> done_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockingCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_BLOCKING_CACHE_H_
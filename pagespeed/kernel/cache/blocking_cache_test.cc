@@ -0,0 +1,130 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Unit-test BlockingCache, wrapped around an LRUCache whose lookups are
+// answered on another thread.
+
+#include "pagespeed/kernel/cache/blocking_cache.h"
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace {
+const size_t kMaxSize = 100;
+}
+
+namespace net_instaweb {
+
+namespace {
+
+// Answers Gets on a worker thread, so it does not block.
+class DeferredCache : public CacheInterface {
+ public:
+  DeferredCache(CacheInterface* cache, QueuedWorkerPool::Sequence* sequence)
+      : cache_(cache), sequence_(sequence) {
+  }
+
+  virtual void Get(const GoogleString& key, Callback* callback) {
+    sequence_->Add(MakeFunction(this, &DeferredCache::DoGet,
+                                new GoogleString(key), callback));
+  }
+  virtual void Put(const GoogleString& key, const SharedString& value) {
+    cache_->Put(key, value);
+  }
+  virtual void Delete(const GoogleString& key) { cache_->Delete(key); }
+  virtual GoogleString Name() const { return "Deferred"; }
+  virtual bool IsBlocking() const { return false; }
+  virtual bool IsHealthy() const { return true; }
+  virtual void ShutDown() {}
+
+ private:
+  void DoGet(GoogleString* key, Callback* callback) {
+    cache_->Get(*key, callback);
+    delete key;
+  }
+
+  CacheInterface* cache_;
+  QueuedWorkerPool::Sequence* sequence_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeferredCache);
+};
+
+}  // namespace
+
+class BlockingCacheTest : public CacheTestBase {
+ protected:
+  BlockingCacheTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        lru_cache_(new LRUCache(kMaxSize)),
+        threadsafe_cache_(lru_cache_.get(), thread_system_->NewMutex()),
+        pool_(1, "cache", thread_system_.get()),
+        deferred_cache_(&threadsafe_cache_, pool_.NewSequence()),
+        blocking_cache_(&deferred_cache_, thread_system_.get()) {
+  }
+
+  ~BlockingCacheTest() {
+    pool_.ShutDown();
+  }
+
+  // The default Callback checks that Done was called before Wait.
+  virtual CacheInterface* Cache() { return &blocking_cache_; }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<LRUCache> lru_cache_;
+  ThreadsafeCache threadsafe_cache_;
+  QueuedWorkerPool pool_;
+  DeferredCache deferred_cache_;
+  BlockingCache blocking_cache_;
+};
+
+TEST_F(BlockingCacheTest, PutGetDelete) {
+  EXPECT_TRUE(blocking_cache_.IsBlocking());
+  EXPECT_EQ("Blocking(Deferred)", blocking_cache_.Name());
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  CheckNotFound("Another Name");
+
+  CheckDelete("Name");
+  CheckNotFound("Name");
+}
+
+TEST_F(BlockingCacheTest, MultiGet) {
+  TestMultiGet();
+}
+
+// Candidates are validated by the caller's callback.
+TEST_F(BlockingCacheTest, InvalidValue) {
+  CheckPut("Name", "Value");
+  set_invalid_value("Value");
+  CheckNotFound("Name");
+}
+
+}  // namespace net_instaweb
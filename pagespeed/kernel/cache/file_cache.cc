@@ -25,6 +25,7 @@
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/async_file_system.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/function.h"
@@ -38,6 +39,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
 #include "pagespeed/kernel/util/url_to_filename_encoder.h"
 
@@ -70,6 +72,57 @@ class FileCache::CacheCleanFunction : public Function {
   DISALLOW_COPY_AND_ASSIGN(CacheCleanFunction);
 };
 
+// Reports the result of an asynchronous read to a Get callback, then frees
+// the Sequence it ran on.
+class FileCache::GetCallback : public AsyncFileSystem::ReadCallback {
+ public:
+  GetCallback(FileCache* cache, const GoogleString& key,
+              QueuedWorkerPool::Sequence* sequence,
+              CacheInterface::Callback* callback)
+      : cache_(cache), key_(key), sequence_(sequence), callback_(callback) {}
+  virtual ~GetCallback() {}
+
+  virtual void Done(bool success, GoogleString* contents) {
+    if (success) {
+      SharedString value;
+      value.SwapWithString(contents);
+      callback_->set_value(value);
+    }
+    cache_->ValidateAndReportResult(key_, success ? kAvailable : kNotFound,
+                                    callback_);
+    cache_->callback_pool_->FreeSequence(sequence_);
+    delete this;
+  }
+
+ private:
+  FileCache* cache_;
+  GoogleString key_;
+  QueuedWorkerPool::Sequence* sequence_;
+  CacheInterface::Callback* callback_;
+  DISALLOW_COPY_AND_ASSIGN(GetCallback);
+};
+
+// Counts failures of asynchronous writes, then frees the Sequence it ran on.
+class FileCache::PutCallback : public AsyncFileSystem::WriteCallback {
+ public:
+  PutCallback(FileCache* cache, QueuedWorkerPool::Sequence* sequence)
+      : cache_(cache), sequence_(sequence) {}
+  virtual ~PutCallback() {}
+
+  virtual void Done(bool success) {
+    if (!success) {
+      cache_->write_errors_->Add(1);
+    }
+    cache_->callback_pool_->FreeSequence(sequence_);
+    delete this;
+  }
+
+ private:
+  FileCache* cache_;
+  QueuedWorkerPool::Sequence* sequence_;
+  DISALLOW_COPY_AND_ASSIGN(PutCallback);
+};
+
 const char FileCache::kBytesFreedInCleanup[] =
     "file_cache_bytes_freed_in_cleanup";
 const char FileCache::kCleanups[] = "file_cache_cleanups";
@@ -136,6 +189,8 @@ FileCache::FileCache(const GoogleString& path, FileSystem* file_system,
                      MessageHandler* handler)
     : path_(path),
       file_system_(file_system),
+      async_file_system_(NULL),
+      callback_pool_(NULL),
       worker_(worker),
       message_handler_(handler),
       cache_policy_(policy),
@@ -177,6 +232,15 @@ void FileCache::InitStats(Statistics* statistics) {
 void FileCache::Get(const GoogleString& key, Callback* callback) {
   GoogleString filename;
   bool ret = EncodeFilename(key, &filename);
+  if (ret && (async_file_system_ != NULL)) {
+    QueuedWorkerPool::Sequence* sequence = callback_pool_->NewSequence();
+    if (sequence != NULL) {
+      async_file_system_->ReadFileAsync(
+          filename, FileSystem::kUnlimitedSize, sequence,
+          new GetCallback(this, key, sequence, callback));
+      return;
+    }
+  }
   if (ret) {
     // Suppress read errors.  Note that we want to show Write errors,
     // as they likely indicate a permissions or disk-space problem
@@ -192,10 +256,19 @@ void FileCache::Get(const GoogleString& key, Callback* callback) {
 
 void FileCache::Put(const GoogleString& key, const SharedString& value) {
   GoogleString filename;
-  if (EncodeFilename(key, &filename) &&
-      !file_system_->WriteFileAtomic(filename, value.Value(),
-                                     message_handler_)) {
-    write_errors_->Add(1);
+  if (EncodeFilename(key, &filename)) {
+    QueuedWorkerPool::Sequence* sequence = NULL;
+    if (async_file_system_ != NULL) {
+      sequence = callback_pool_->NewSequence();
+    }
+    if (sequence != NULL) {
+      async_file_system_->WriteFileAtomicAsync(
+          filename, value, message_handler_, sequence,
+          new PutCallback(this, sequence));
+    } else if (!file_system_->WriteFileAtomic(filename, value.Value(),
+                                              message_handler_)) {
+      write_errors_->Add(1);
+    }
   }
   CleanIfNeeded();
 }
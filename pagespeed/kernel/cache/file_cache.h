@@ -33,8 +33,10 @@
 
 namespace net_instaweb {
 
+class AsyncFileSystem;
 class Hasher;
 class MessageHandler;
+class QueuedWorkerPool;
 class SlowWorker;
 class Statistics;
 class Timer;
@@ -72,10 +74,27 @@ class FileCache : public CacheInterface {
   void set_worker(SlowWorker* worker) { worker_ = worker; }
   SlowWorker* worker() { return worker_; }
 
+  // Makes Get and Put non-blocking: the file reads and writes are issued
+  // through async_file_system, which should operate on the same files as
+  // the FileSystem passed to the constructor.  Each operation's completion
+  // runs on its own Sequence from callback_pool, so a slow Get callback
+  // does not hold up the others.  Both must outlive any operation in
+  // flight.  Delete, and cache cleaning, still use the synchronous
+  // FileSystem, as do Get and Put once callback_pool is shutting down.
+  void set_async_file_system(AsyncFileSystem* async_file_system,
+                             QueuedWorkerPool* callback_pool) {
+    async_file_system_ = async_file_system;
+    callback_pool_ = callback_pool;
+  }
+
   static GoogleString FormatName() { return "FileCache"; }
-  virtual GoogleString Name() const { return FormatName(); }
+  // Name of a FileCache that has an AsyncFileSystem set.
+  static GoogleString FormatAsyncName() { return "AsyncFileCache"; }
+  virtual GoogleString Name() const {
+    return (async_file_system_ == NULL) ? FormatName() : FormatAsyncName();
+  }
 
-  virtual bool IsBlocking() const { return true; }
+  virtual bool IsBlocking() const { return async_file_system_ == NULL; }
   virtual bool IsHealthy() const { return true; }
   virtual void ShutDown() {}  // TODO(jmarantz): implement.
 
@@ -104,6 +123,8 @@ class FileCache : public CacheInterface {
 
  private:
   class CacheCleanFunction;
+  class GetCallback;
+  class PutCallback;
   friend class FileCacheTest;
   friend class CacheCleanFunction;
 
@@ -132,6 +153,8 @@ class FileCache : public CacheInterface {
 
   const GoogleString path_;
   FileSystem* file_system_;
+  AsyncFileSystem* async_file_system_;
+  QueuedWorkerPool* callback_pool_;
   SlowWorker* worker_;
   MessageHandler* message_handler_;
   const scoped_ptr<CachePolicy> cache_policy_;
@@ -23,22 +23,32 @@
 
 #include <unistd.h>
 
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/async_file_system.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/condvar.h"
 #include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/file_system_test_base.h"
+#include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/md5_hasher.h"
 #include "pagespeed/kernel/base/mem_file_system.h"
 #include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/thread/sequence.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
 #include "pagespeed/kernel/thread/worker_test_base.h"
 #include "pagespeed/kernel/util/platform.h"
@@ -46,8 +56,115 @@
 
 namespace net_instaweb {
 
+namespace {
+
+// Performs each operation immediately on a synchronous FileSystem, but
+// holds the results until RunAll delivers them through their Sequences, as
+// a real asynchronous implementation would.
+class SimulatedAsyncFileSystem : public AsyncFileSystem {
+ public:
+  explicit SimulatedAsyncFileSystem(FileSystem* file_system)
+      : file_system_(file_system), fail_writes_(false), write_done_(NULL) {}
+  virtual ~SimulatedAsyncFileSystem() {
+    for (int i = 0, n = results_.size(); i < n; ++i) {
+      results_[i].second->CallCancel();
+    }
+  }
+
+  void set_fail_writes(bool x) { fail_writes_ = x; }
+
+  // Notified each time a write's callback has returned.
+  void set_write_done(WorkerTestBase::SyncPoint* x) { write_done_ = x; }
+
+  void RunAll() {
+    std::vector<std::pair<Sequence*, Function*> > results;
+    results.swap(results_);
+    for (int i = 0, n = results.size(); i < n; ++i) {
+      results[i].first->Add(results[i].second);
+    }
+  }
+
+  virtual bool IsAsync() { return true; }
+
+  virtual void ReadFileAsync(const GoogleString& filename,
+                             int64 max_file_size, Sequence* sequence,
+                             ReadCallback* callback) {
+    NullMessageHandler handler;
+    GoogleString contents;
+    bool success = file_system_->ReadFile(filename.c_str(), max_file_size,
+                                          &contents, &handler);
+    results_.push_back(std::make_pair(sequence, MakeFunction(
+        this, &SimulatedAsyncFileSystem::ReadDone, success, contents,
+        callback)));
+  }
+
+  virtual void WriteFileAtomicAsync(const GoogleString& filename,
+                                    const SharedString& buffer,
+                                    MessageHandler* handler,
+                                    Sequence* sequence,
+                                    WriteCallback* callback) {
+    bool success = !fail_writes_ &&
+        file_system_->WriteFileAtomic(filename, buffer.Value(), handler);
+    results_.push_back(std::make_pair(sequence, MakeFunction(
+        this, &SimulatedAsyncFileSystem::WriteDone, success, callback)));
+  }
+
+  virtual void StatAsync(const GoogleString& path, Sequence* sequence,
+                         StatCallback* callback) {
+    LOG(FATAL) << "Not used by FileCache";
+  }
+
+  virtual void RenameFileAsync(const GoogleString& old_filename,
+                               const GoogleString& new_filename,
+                               MessageHandler* handler, Sequence* sequence,
+                               WriteCallback* callback) {
+    LOG(FATAL) << "Not used by FileCache";
+  }
+
+ private:
+  void ReadDone(bool success, GoogleString contents, ReadCallback* callback) {
+    callback->Done(success, &contents);
+  }
+
+  void WriteDone(bool success, WriteCallback* callback) {
+    callback->Done(success);
+    if (write_done_ != NULL) {
+      write_done_->Notify();
+    }
+  }
+
+  FileSystem* file_system_;
+  bool fail_writes_;
+  WorkerTestBase::SyncPoint* write_done_;
+  std::vector<std::pair<Sequence*, Function*> > results_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedAsyncFileSystem);
+};
+
+}  // namespace
+
 class FileCacheTest : public CacheTestBase {
  protected:
+  // With an AsyncFileSystem, Done runs on a callback_pool thread, so Wait
+  // blocks until it has.
+  class SyncedCallback : public CacheTestBase::Callback {
+   public:
+    explicit SyncedCallback(FileCacheTest* test)
+        : Callback(test),
+          sync_point_(test->thread_system_.get()) {
+    }
+
+    virtual void Done(CacheInterface::KeyState state) {
+      Callback::Done(state);
+      sync_point_.Notify();
+    }
+
+    virtual void Wait() { sync_point_.Wait(); }
+
+   private:
+    WorkerTestBase::SyncPoint sync_point_;
+  };
+
   FileCacheTest()
       : thread_system_(Platform::CreateThreadSystem()),
         worker_("cleaner", thread_system_.get()),
@@ -58,6 +175,7 @@ class FileCacheTest : public CacheTestBase {
         kTargetInodeLimit(10),
         stats_(thread_system_.get()),
         lock_timeout_ms_(FileCache::kLockTimeoutMs) {
+    set_mutex(thread_system_->NewMutex());
     FileCache::InitStats(&stats_);
     ResetFileCache(kCleanIntervalMs, kTargetSize);
     disk_checks_ = stats_.GetVariable(FileCache::kDiskChecks);
@@ -97,6 +215,7 @@ class FileCacheTest : public CacheTestBase {
   }
 
   virtual CacheInterface* Cache() { return cache_.get(); }
+  virtual Callback* NewCallback() { return new SyncedCallback(this); }
   virtual void PostOpCleanup() { }
 
   bool Clean(int64 size, int64 inode_count) {
@@ -204,6 +323,44 @@ TEST_F(FileCacheTest, PutGetDelete) {
   CheckNotFound("Name");
 }
 
+// With an AsyncFileSystem, Get returns before its callback is run, and the
+// callback is run on a sequence from the callback pool.
+TEST_F(FileCacheTest, NonBlocking) {
+  QueuedWorkerPool callback_pool(2, "file_cache_callbacks",
+                                 thread_system_.get());
+  SimulatedAsyncFileSystem async_file_system(&file_system_);
+  cache_->set_async_file_system(&async_file_system, &callback_pool);
+  EXPECT_FALSE(cache_->IsBlocking());
+  EXPECT_STREQ(FileCache::FormatAsyncName(), cache_->Name());
+
+  cache_->Put("Name", SharedString("Value"));
+  Callback* found = InitiateGet("Name");
+  Callback* not_found = InitiateGet("Another Name");
+  EXPECT_FALSE(found->called());
+  EXPECT_FALSE(not_found->called());
+  async_file_system.RunAll();
+  WaitAndCheck(found, "Value");
+  WaitAndCheckNotFound(not_found);
+
+  // Write failures are still counted.
+  Variable* write_errors = stats_.GetVariable(FileCache::kWriteErrors);
+  WorkerTestBase::SyncPoint write_done(thread_system_.get());
+  async_file_system.set_fail_writes(true);
+  async_file_system.set_write_done(&write_done);
+  cache_->Put("Name", SharedString("NewValue"));
+  EXPECT_EQ(0, write_errors->Get());
+  async_file_system.RunAll();
+  write_done.Wait();
+  EXPECT_EQ(1, write_errors->Get());
+  async_file_system.set_write_done(NULL);
+
+  // Once the pool is shutting down, operations run on the calling thread.
+  callback_pool.ShutDown();
+  async_file_system.set_fail_writes(false);
+  cache_->Put("Name", SharedString("Blocking"));
+  CheckGet("Name", "Blocking");
+}
+
 // Throw a bunch of files into the cache and verify that they are
 // evicted sensibly.
 TEST_F(FileCacheTest, Clean) {
@@ -27,7 +27,7 @@
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
-#include "pagespeed/kernel/base/rde_hash_map.h"
+#include "pagespeed/kernel/base/flat_hash_map.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_hash.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -66,7 +66,11 @@ class LRUCacheBase {
   // STL guarantees lifetime of list iterators as long as the node is in list.
   typedef typename EntryList::iterator ListNode;
 
-  typedef rde::hash_map<GoogleString, ListNode, CasePreserveStringHash> Map;
+  // The map keys point into the GoogleString held by the KeyValuePair, which
+  // is heap-allocated and does not move, so keys are only stored once.  This
+  // also lets us look up a StringPiece without constructing a GoogleString.
+  typedef FlatHashMap<StringPiece, ListNode, CasePreserveStringPieceHash,
+                      CasePreserveStringPieceEqual> Map;
 
  public:
   class Iterator {
@@ -114,7 +118,7 @@ class LRUCacheBase {
   // Returns a pointer to the stored value, or NULL if not found, freshening
   // the entry in the lru-list.  Note: this pointer is safe to use until the
   // next call to Put or Delete in the cache.
-  ValueType* GetFreshen(const GoogleString& key) {
+  ValueType* GetFreshen(StringPiece key) {
     ValueType* value = NULL;
     typename Map::iterator p = map_.find(key);
     if (p != map_.end()) {
@@ -133,7 +137,7 @@ class LRUCacheBase {
     return value;
   }
 
-  ValueType* GetNoFreshen(const GoogleString& key) const {
+  ValueType* GetNoFreshen(StringPiece key) const {
     ValueType* value = NULL;
     typename Map::const_iterator p = map_.find(key);
     if (p != map_.end()) {
@@ -150,65 +154,52 @@ class LRUCacheBase {
 
   // Puts an object into the cache.  The value is copied using the assignment
   // operator.
-  void Put(const GoogleString& key, const ValueType& new_value) {
-    // Just do one map operation, calling the awkward 'insert' which returns
-    // a pair.  The bool indicates whether a new value was inserted, and the
-    // iterator provides access to the element, whether it's new or old.
-    //
-    // If the key is already in the map, this will give us access to the value
-    // cell, and the uninitialized cell will not be used.
-    ListNode cell;
-    std::pair<typename Map::iterator, bool> iter_found =
-        map_.insert(typename Map::value_type(key, cell));
-    bool found = !iter_found.second;
-    typename Map::iterator map_iter = iter_found.first;
-    bool need_to_insert = true;
-    if (found) {
-      cell = map_iter->second;
+  void Put(StringPiece key, const ValueType& new_value) {
+    KeyValuePair* replaced = NULL;
+    typename Map::iterator map_iter = map_.find(key);
+    if (map_iter != map_.end()) {
+      ListNode cell = map_iter->second;
       KeyValuePair* key_value = *cell;
-
-      // Protect the element that we are rewriting by erasing
-      // it from the entry_list prior to calling EvictIfNecessary,
-      // which can't find it if it isn't in the list.
       if (!value_helper_->ShouldReplace(key_value->second, new_value)) {
-        need_to_insert = false;
-      } else {
-        if (value_helper_->Equal(new_value, key_value->second)) {
-          map_iter->second = Freshen(cell);
-          need_to_insert = false;
-          ++num_identical_reinserts_;
-        } else {
-          ++num_deletes_;
-          CHECK_GE(current_bytes_in_cache_, EntrySize(key_value));
-          current_bytes_in_cache_ -= EntrySize(key_value);
-          delete key_value;
-          lru_ordered_list_.erase(cell);
-        }
+        return;
       }
+      if (value_helper_->Equal(new_value, key_value->second)) {
+        map_iter->second = Freshen(cell);
+        ++num_identical_reinserts_;
+        return;
+      }
+
+      // Remove the old entry before calling EvictIfNecessary, so that it
+      // can't find it.  The map key points into the old KeyValuePair, so the
+      // map entry must go too; we re-insert it below pointing at the new
+      // pair's key storage.  We don't delete the old pair until then in case
+      // 'key' points into it.
+      ++num_deletes_;
+      CHECK_GE(current_bytes_in_cache_, EntrySize(key_value));
+      current_bytes_in_cache_ -= EntrySize(key_value);
+      map_.erase(map_iter);
+      lru_ordered_list_.erase(cell);
+      replaced = key_value;
     }
 
-    if (need_to_insert) {
-      // At this point, if we were doing a replacement, then the value
-      // is removed from the list, so we can treat replacements and new
-      // insertions the same way.  In both cases, the new key is in the map
-      // as a result of the call to map_.insert above.
-
-      if (EvictIfNecessary(key.size() + value_helper_->size(new_value))) {
-        // The new value fits.  Put it in the LRU-list.
-        KeyValuePair* kvp = new KeyValuePair(map_iter->first, new_value);
-        lru_ordered_list_.push_front(kvp);
-        map_iter->second = lru_ordered_list_.begin();
-        ++num_inserts_;
-      } else {
-        // The new value was too big to fit.  Remove it from the map.
-        // it's already removed from the list.  We have failed.  We
-        // could potentially log this somewhere or keep a stat.
-        map_.erase(map_iter);
-      }
+    // At this point, if we were doing a replacement, then the old value has
+    // been removed from both the list and the map, so we can treat
+    // replacements and new insertions the same way.
+    if (EvictIfNecessary(key.size() + value_helper_->size(new_value))) {
+      // The new value fits.  Put it in the LRU-list.
+      KeyValuePair* kvp = new KeyValuePair(key.as_string(), new_value);
+      lru_ordered_list_.push_front(kvp);
+      map_.insert(typename Map::value_type(kvp->first,
+                                           lru_ordered_list_.begin()));
+      ++num_inserts_;
+    } else {
+      // The new value was too big to fit.  We have failed.  We could
+      // potentially log this somewhere or keep a stat.
     }
+    delete replaced;
   }
 
-  void Delete(const GoogleString& key) {
+  void Delete(StringPiece key) {
     typename Map::iterator p = map_.find(key);
     if (p != map_.end()) {
       DeleteAt(p);
@@ -273,7 +264,7 @@ class LRUCacheBase {
       KeyValuePair* key_value = *cell;
       typename Map::iterator map_iter = map_.find(key_value->first);
       CHECK(map_iter != map_.end());
-      CHECK(map_iter->first == key_value->first);
+      CHECK(map_iter->first.data() == key_value->first.data());
       CHECK(map_iter->second == cell);
       bytes_used += EntrySize(key_value);
     }
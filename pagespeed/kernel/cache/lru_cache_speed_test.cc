@@ -30,6 +30,11 @@
 // LRUFailedGets         16068878   16000000        100
 // LRUEvictions         143558421  143200000        100
 //
+// RdeHashMapFinds and FlatHashMapFinds compare the map that LRUCacheBase
+// used to be built on against the one it uses now, looking up every key
+// once per iteration.  FlatHashMapPieceFinds probes with StringPieces into a
+// larger buffer, as callers holding a substring would.
+//
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
 // interleaved runs with the old & new algorithm.
@@ -42,9 +47,12 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/benchmark.h"
 #include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/flat_hash_map.h"
 #include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/rde_hash_map.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string_hash.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/util/simple_random.h"
 
@@ -190,6 +198,93 @@ static void LRUEvictions(int iters) {
   CHECK_LT(0, static_cast<int>(payload.lru_cache()->num_evictions()));
 }
 
+// Builds kNumKeys keys of kKeySize bytes, each ending in a distinct index.
+void MakeKeys(net_instaweb::StringVector* keys) {
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  GoogleString prefix = random.GenerateHighEntropyString(kKeySize);
+  keys->resize(kNumKeys);
+  for (int k = 0; k < kNumKeys; ++k) {
+    GoogleString index_string =
+        net_instaweb::StrCat("_", net_instaweb::IntegerToString(k));
+    (*keys)[k] = prefix.substr(0, kKeySize - index_string.size());
+    (*keys)[k] += index_string;
+  }
+}
+
+static void RdeHashMapFinds(int iters) {
+  StopBenchmarkTiming();
+  typedef rde::hash_map<GoogleString, int,
+                        net_instaweb::CasePreserveStringHash> Map;
+  net_instaweb::StringVector keys;
+  MakeKeys(&keys);
+  Map map;
+  for (int k = 0; k < kNumKeys; ++k) {
+    map.insert(Map::value_type(keys[k], k));
+  }
+  StartBenchmarkTiming();
+  int found = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int k = 0; k < kNumKeys; ++k) {
+      if (map.find(keys[k]) != map.end()) {
+        ++found;
+      }
+    }
+  }
+  CHECK_EQ(kNumKeys * iters, found);
+}
+
+static void FlatHashMapFinds(int iters) {
+  StopBenchmarkTiming();
+  typedef net_instaweb::FlatHashMap<
+      GoogleString, int, net_instaweb::CasePreserveStringPieceHash,
+      net_instaweb::CasePreserveStringPieceEqual> Map;
+  net_instaweb::StringVector keys;
+  MakeKeys(&keys);
+  Map map;
+  for (int k = 0; k < kNumKeys; ++k) {
+    map.insert(Map::value_type(keys[k], k));
+  }
+  StartBenchmarkTiming();
+  int found = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int k = 0; k < kNumKeys; ++k) {
+      if (map.find(keys[k]) != map.end()) {
+        ++found;
+      }
+    }
+  }
+  CHECK_EQ(kNumKeys * iters, found);
+}
+
+static void FlatHashMapPieceFinds(int iters) {
+  StopBenchmarkTiming();
+  typedef net_instaweb::FlatHashMap<
+      GoogleString, int, net_instaweb::CasePreserveStringPieceHash,
+      net_instaweb::CasePreserveStringPieceEqual> Map;
+  net_instaweb::StringVector keys;
+  MakeKeys(&keys);
+  Map map;
+  GoogleString buffer;
+  std::vector<StringPiece> pieces;
+  for (int k = 0; k < kNumKeys; ++k) {
+    map.insert(Map::value_type(keys[k], k));
+    buffer += keys[k];
+  }
+  for (int k = 0; k < kNumKeys; ++k) {
+    pieces.push_back(StringPiece(buffer.data() + k * kKeySize, kKeySize));
+  }
+  StartBenchmarkTiming();
+  int found = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int k = 0; k < kNumKeys; ++k) {
+      if (map.find(pieces[k]) != map.end()) {
+        ++found;
+      }
+    }
+  }
+  CHECK_EQ(kNumKeys * iters, found);
+}
+
 }  // namespace
 
 BENCHMARK(LRUPuts);
@@ -198,3 +293,6 @@ BENCHMARK(LRUReplaceNewValue);
 BENCHMARK(LRUGets);
 BENCHMARK(LRUFailedGets);
 BENCHMARK(LRUEvictions);
+BENCHMARK(RdeHashMapFinds);
+BENCHMARK(FlatHashMapFinds);
+BENCHMARK(FlatHashMapPieceFinds);
@@ -20,6 +20,8 @@
 
 #include "pagespeed/kernel/cache/purge_context.h"
 
+#include <vector>
+
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/atomic_bool.h"
@@ -36,6 +38,7 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/time_util.h"
 #include "pagespeed/kernel/cache/lru_cache_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_purge_log.h"
 #include "pagespeed/kernel/thread/scheduler.h"
 #include "pagespeed/kernel/util/copy_on_write.h"
 
@@ -55,6 +58,7 @@ const char PurgeContext::kFileParseFailures[]    = "purge_file_parse_failures";
 const char PurgeContext::kFileStats[]            = "purge_file_stats";
 const char PurgeContext::kFileWriteFailures[]    = "purge_file_write_failures";
 const char PurgeContext::kFileWrites[]           = "purge_file_writes";
+const char PurgeContext::kLogReloads[]           = "purge_log_reloads";
 const char PurgeContext::kPurgeIndex[]           = "purge_index";
 
 // TODO(jmarantz): make it possible to avoid showing this implementation detail
@@ -132,6 +136,8 @@ PurgeContext::PurgeContext(StringPiece filename,
       num_consecutive_failures_(0),
       waiting_for_interprocess_lock_(false),
       reading_(false),
+      purge_log_sequence_(0),
+      purge_log_primed_(false),
       enable_purge_(true),
       max_bytes_in_cache_(max_bytes_in_cache),
       request_batching_delay_ms_(0),
@@ -141,12 +147,14 @@ PurgeContext::PurgeContext(StringPiece filename,
       file_stats_(statistics->GetVariable(kFileStats)),
       file_write_failures_(statistics->GetVariable(kFileWriteFailures)),
       file_writes_(statistics->GetVariable(kFileWrites)),
+      log_reloads_(statistics->GetVariable(kLogReloads)),
       purge_index_(statistics->GetVariable(kPurgeIndex)),
       purge_poll_timestamp_ms_(new BackupUpDownCounter(
           statistics->GetUpDownCounter(kPurgePollTimestampMs),
           thread_system->NewMutex())),
       scheduler_(scheduler),
-      message_handler_(handler) {
+      message_handler_(handler),
+      purge_log_(NULL) {
   purge_set_.MakeWriteable()->set_max_size(max_bytes_in_cache_);
 }
 
@@ -160,6 +168,7 @@ void PurgeContext::InitStats(Statistics* statistics) {
   statistics->AddVariable(kFileStats);
   statistics->AddVariable(kFileWrites);
   statistics->AddVariable(kFileWriteFailures);
+  statistics->AddVariable(kLogReloads);
   statistics->AddVariable(kPurgeIndex);
   statistics->AddUpDownCounter(kPurgePollTimestampMs);
 }
@@ -272,6 +281,18 @@ void PurgeContext::UpdateCachePurgeFile() {
   bool success = true;
   int failures = 0;
 
+  // Note the file's mtime before reading it, so that once we have written
+  // it back we can tell whether what we read had been changed by someone
+  // other than a PurgeContext.
+  bool file_changed_behind_log = false;
+  if (UsePurgeLog()) {
+    NullMessageHandler null_handler;
+    int64 mtime_sec;
+    file_changed_behind_log =
+        (!file_system_->Mtime(filename_, &mtime_sec, &null_handler) ||
+         (mtime_sec != purge_log_->file_mtime_sec()));
+  }
+
   // Initiate a read/modify/write/verify sequence while holding
   // interprocess_lock_.  Note that during 'modify' we need to
   // also grab mutex_, so we'll need to collect the serizlized
@@ -287,10 +308,14 @@ void PurgeContext::UpdateCachePurgeFile() {
     HandleWriteFailure(failures, &callbacks, &return_purges, &lock_and_update);
   }
 
+  if (success && UsePurgeLog()) {
+    AppendToPurgeLog(return_purges, file_changed_behind_log);
+  }
+
   interprocess_lock_->Unlock();
 
   if (!callbacks.empty()) {
-    if (success) {
+    if (success && !UsePurgeLog()) {
       // Induce a file-read the next time PollFileSystem() is called.
       // Note that there is a small chance we might read the same
       // version of the file twice if we get a PollFileSystem()
@@ -495,7 +520,33 @@ void PurgeContext::AddPurgeUrl(StringPiece url, int64 timestamp_ms,
   }
 }
 
+void PurgeContext::AppendToPurgeLog(const PurgeSet& purges,
+                                    bool file_changed_behind_log) {
+  // Record the mtime of what we wrote first, so a concurrent poll in
+  // another process doesn't mistake our own write for a foreign one.
+  NullMessageHandler null_handler;
+  int64 mtime_sec;
+  if (file_system_->Mtime(filename_, &mtime_sec, &null_handler)) {
+    purge_log_->set_file_mtime_sec(mtime_sec);
+  }
+  if (file_changed_behind_log) {
+    purge_log_->AppendReload();
+    return;
+  }
+  if (purges.has_global_invalidation_timestamp_ms()) {
+    purge_log_->AppendGlobal(purges.global_invalidation_timestamp_ms());
+  }
+  for (PurgeSet::Iterator p = purges.Begin(), e = purges.End(); p != e; ++p) {
+    purge_log_->AppendUrl(p.Key(), p.Value());
+  }
+}
+
 void PurgeContext::PollFileSystem() {
+  if (UsePurgeLog()) {
+    PollPurgeLog();
+    return;
+  }
+
   int64 now_ms = timer_->NowMs();
   int64 delta_ms = now_ms - purge_poll_timestamp_ms_->Get();
   int64 global_purge_index = purge_index_->Get();
@@ -558,6 +609,86 @@ void PurgeContext::ReadFileAndCallCallbackIfChanged(bool needs_update) {
   // pending_purges_.
 }
 
+void PurgeContext::PollPurgeLog() {
+  int64 now_ms = timer_->NowMs();
+  bool check_mtime =
+      ((now_ms - purge_poll_timestamp_ms_->Get()) >= kCheckCacheIntervalMs);
+  int64 next_sequence = purge_log_->NextSequence();
+  int64 sequence;
+  bool read_file;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (reading_ ||
+        (purge_log_primed_ && !check_mtime &&
+         (next_sequence <= purge_log_sequence_))) {
+      return;
+    }
+    reading_ = true;
+    sequence = purge_log_sequence_;
+    read_file = !purge_log_primed_;
+  }
+
+  NullMessageHandler null_handler;
+  if (check_mtime) {
+    purge_poll_timestamp_ms_->Set(now_ms);
+    int64 mtime_sec;
+    if (file_system_->Mtime(filename_, &mtime_sec, &null_handler) &&
+        (mtime_sec != purge_log_->file_mtime_sec())) {
+      purge_log_->set_file_mtime_sec(mtime_sec);
+      purge_log_->AppendReload();
+    }
+  }
+
+  std::vector<SharedMemPurgeLog::Entry> entries;
+  if (!read_file && !purge_log_->ReadSince(&sequence, &entries)) {
+    log_reloads_->Add(1);
+    read_file = true;
+  }
+
+  CopyOnWrite<PurgeSet> new_purge_set;
+  if (read_file) {
+    // Take the sequence number before reading the file: every record
+    // appended before then was appended after its purge was written.
+    sequence = purge_log_->NextSequence();
+    PurgeSet* purges_from_file = new_purge_set.MakeWriteable();
+    purges_from_file->set_max_size(max_bytes_in_cache_);
+    ReadPurgeFile(purges_from_file);
+  } else if (!entries.empty()) {
+    {
+      // No other thread mutates purge_set_ while reading_ is set.
+      ScopedMutex lock(mutex_.get());
+      new_purge_set = purge_set_;
+    }
+    PurgeSet* purges = new_purge_set.MakeWriteable();
+    for (int i = 0, n = entries.size(); i < n; ++i) {
+      const SharedMemPurgeLog::Entry& entry = entries[i];
+      if (entry.global) {
+        purges->UpdateGlobalInvalidationTimestampMs(entry.timestamp_ms);
+      } else {
+        purges->Put(entry.url, entry.timestamp_ms);
+      }
+    }
+  }
+
+  bool call_callback = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    purge_log_sequence_ = sequence;
+    purge_log_primed_ = true;
+    if ((read_file && !purge_set_->Equals(*new_purge_set)) ||
+        (!read_file && !entries.empty())) {
+      purge_set_ = new_purge_set;
+      call_callback = (update_callback_ != NULL);
+    }
+  }
+  if (call_callback) {
+    update_callback_->Run(new_purge_set);
+  }
+
+  ScopedMutex lock(mutex_.get());
+  reading_ = false;
+}
+
 void PurgeContext::SetUpdateCallback(PurgeSetCallback* cb) {
   update_callback_.reset(cb);
 }
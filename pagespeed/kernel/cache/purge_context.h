@@ -40,6 +40,7 @@ class MessageHandler;
 class NamedLock;
 class NamedLockManager;
 class Scheduler;
+class SharedMemPurgeLog;
 class Statistics;
 class ThreadSystem;
 class UpDownCounter;
@@ -53,6 +54,12 @@ class Variable;
 //
 // This class depends on Statistics being functional.  If statistics are off,
 // then cache purging may be slower, but it will still work.
+//
+// When a SharedMemPurgeLog is supplied, purges written by any process are
+// also appended to it, and the other processes apply just those records
+// rather than re-reading the whole file.  The file is then only re-read on
+// startup, when a process falls too far behind the log, or when its mtime
+// shows it was changed by someone else.
 class PurgeContext {
  public:
   typedef Callback2<bool, StringPiece> PurgeCallback;
@@ -71,6 +78,7 @@ class PurgeContext {
   static const char kFileStats[];
   static const char kFileWriteFailures[];
   static const char kFileWrites[];
+  static const char kLogReloads[];
   static const char kPurgeIndex[];
   static const char kPurgePollTimestampMs[];
   static const char kStatCalls[];
@@ -137,6 +145,12 @@ class PurgeContext {
   // the individual entries.
   void set_enable_purge(bool x) { enable_purge_ = x; }
 
+  // Propagates purges between processes through log rather than through
+  // the purge_index statistic and periodic re-reads of the file.  log must
+  // already be initialized or attached, and must outlive this.  It is
+  // ignored when purging is disabled.  Call this before the first poll.
+  void set_purge_log(SharedMemPurgeLog* log) { purge_log_ = log; }
+
  private:
   friend class PurgeContextTest;
 
@@ -157,6 +171,21 @@ class PurgeContext {
   void ReadPurgeFile(PurgeSet* purges_from_file);
   void ReadFileAndCallCallbackIfChanged(bool needs_update);
 
+  bool UsePurgeLog() const { return (purge_log_ != NULL) && enable_purge_; }
+
+  // Replacement for the body of PollFileSystem when purge_log_ is in use:
+  // applies any records appended to the log since the last poll, falling
+  // back to a full read of the file when the log can't supply them.  Every
+  // kCheckCacheIntervalMs one process also stats the file, and if it was
+  // changed behind the log's back, tells every process to re-read it.
+  void PollPurgeLog();
+
+  // Called after successfully writing the file, to publish the purges
+  // just written to the other processes.  If the file had been modified
+  // by someone other than a PurgeContext before we read it, we can't
+  // describe the change as a delta, so we ask for a re-read instead.
+  void AppendToPurgeLog(const PurgeSet& purges, bool file_changed_behind_log);
+
   // Combines the purges_from_file with pending_purges_ and purge_set_,
   // serializes the result into *buffer for writing back to the file.
   //
@@ -242,6 +271,8 @@ class PurgeContext {
   int num_consecutive_failures_;           // protected_by mutex_
   bool waiting_for_interprocess_lock_;     // protected_by mutex_
   bool reading_;                           // protected_by mutex_
+  int64 purge_log_sequence_;               // protected_by mutex_
+  bool purge_log_primed_;                  // protected_by mutex_
 
   bool enable_purge_;           // When false, can only flush entire cache.
   int max_bytes_in_cache_;
@@ -254,11 +285,13 @@ class PurgeContext {
   Variable* file_stats_;
   Variable* file_write_failures_;
   Variable* file_writes_;
+  Variable* log_reloads_;
   Variable* purge_index_;
   scoped_ptr<UpDownCounter> purge_poll_timestamp_ms_;
 
   Scheduler* scheduler_;
   MessageHandler* message_handler_;
+  SharedMemPurgeLog* purge_log_;
 
   scoped_ptr<PurgeSetCallback> update_callback_;
 
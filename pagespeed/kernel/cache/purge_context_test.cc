@@ -20,6 +20,8 @@
 
 #include "pagespeed/kernel/cache/purge_context.h"
 
+#include <vector>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/mem_file_system.h"
@@ -31,6 +33,8 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/sharedmem/inprocess_shared_mem.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_purge_log.h"
 #include "pagespeed/kernel/thread/mock_scheduler.h"
 #include "pagespeed/kernel/thread/scheduler_based_abstract_lock.h"
 #include "pagespeed/kernel/util/file_system_lock_manager.h"
@@ -42,6 +46,7 @@ namespace {
 const int kMaxBytes = 100;
 const char kPurgeFile[] = "/cache/cache.flush";
 const char kBasePath[] = "/cache";
+const char kPurgeLogSegment[] = "/cache/purge_log";
 
 }  // namespace
 
@@ -115,6 +120,25 @@ class PurgeContextTest : public ::testing::Test,
 
   GoogleString LockName() { return purge_context1_->LockName(); }
 
+  // Connects both contexts to a shared purge log, each through its own
+  // attachment as they would be in separate processes.
+  void EnablePurgeLog(int capacity) {
+    shm_runtime_.reset(new InProcessSharedMem(thread_system_.get()));
+    root_purge_log_.reset(MakePurgeLog(capacity));
+    ASSERT_TRUE(root_purge_log_->Initialize());
+    purge_log1_.reset(MakePurgeLog(capacity));
+    ASSERT_TRUE(purge_log1_->Attach());
+    purge_log2_.reset(MakePurgeLog(capacity));
+    ASSERT_TRUE(purge_log2_->Attach());
+    purge_context1_->set_purge_log(purge_log1_.get());
+    purge_context2_->set_purge_log(purge_log2_.get());
+  }
+
+  SharedMemPurgeLog* MakePurgeLog(int capacity) {
+    return new SharedMemPurgeLog(shm_runtime_.get(), kPurgeLogSegment,
+                                 capacity, &message_handler_);
+  }
+
   void ExpectSuccessHelper(bool x, StringPiece reason) {
     EXPECT_TRUE(x);
   }
@@ -176,6 +200,10 @@ class PurgeContextTest : public ::testing::Test,
     return statistics_->GetVariable(PurgeContext::kFileWrites)->Get();
   }
 
+  int log_reloads() {
+    return statistics_->GetVariable(PurgeContext::kLogReloads)->Get();
+  }
+
   void UpdatePurgeSet1(const CopyOnWrite<PurgeSet>& purge_set) {
     purge_set1_ = purge_set;
   }
@@ -191,6 +219,10 @@ class PurgeContextTest : public ::testing::Test,
   MockScheduler scheduler_;
   FileSystemLockManager lock_manager_;
   scoped_ptr<Statistics> statistics_;
+  scoped_ptr<AbstractSharedMem> shm_runtime_;
+  scoped_ptr<SharedMemPurgeLog> root_purge_log_;
+  scoped_ptr<SharedMemPurgeLog> purge_log1_;
+  scoped_ptr<SharedMemPurgeLog> purge_log2_;
   scoped_ptr<PurgeContext> purge_context1_;
   scoped_ptr<PurgeContext> purge_context2_;
   CopyOnWrite<PurgeSet> purge_set1_;
@@ -375,6 +407,97 @@ TEST_P(PurgeContextTest, InvalidTimestampInPurgeRecord) {
   EXPECT_EQ(ExpectStat(6), file_parse_failures());
 }
 
+TEST_P(PurgeContextTest, PurgeLogSharing) {
+  EnablePurgeLog(SharedMemPurgeLog::kDefaultCapacity);
+
+  // Each context reads the (missing) file once on its first poll.
+  EXPECT_TRUE(PollAndTest1("a", 500000));
+  EXPECT_TRUE(PollAndTest2("a", 500000));
+  EXPECT_EQ(ExpectStat(2), num_file_stats());
+
+  // The purge is visible to both contexts on their very next poll, with
+  // no time advanced, and only the writer reads the file.
+  purge_context1_->AddPurgeUrl("a", 500000, ExpectSuccess());
+  EXPECT_EQ(ExpectStat(1), file_writes());
+  EXPECT_FALSE(PollAndTest2("a", 500000));
+  EXPECT_TRUE(PollAndTest2("a", 500001));
+  EXPECT_FALSE(PollAndTest1("a", 500000));
+  EXPECT_TRUE(PollAndTest1("a", 500001));
+  EXPECT_EQ(ExpectStat(3), num_file_stats());
+
+  purge_context2_->SetCachePurgeGlobalTimestampMs(600000, ExpectSuccess());
+  EXPECT_FALSE(PollAndTest1("b", 600000));
+  EXPECT_TRUE(PollAndTest1("b", 600001));
+  EXPECT_FALSE(PollAndTest2("b", 600000));
+  EXPECT_EQ(ExpectStat(4), num_file_stats());
+
+  // Periodic polls only stat the file, which we wrote ourselves.
+  scheduler_.AdvanceTimeMs(10 * Timer::kSecondMs);
+  EXPECT_FALSE(PollAndTest1("a", 500000));
+  EXPECT_FALSE(PollAndTest2("a", 500000));
+  EXPECT_EQ(ExpectStat(4), num_file_stats());
+  EXPECT_EQ(0, log_reloads());
+  EXPECT_EQ(0, file_parse_failures());
+}
+
+TEST_P(PurgeContextTest, PurgeLogOverflow) {
+  EnablePurgeLog(2);
+  EXPECT_TRUE(PollAndTest1("a", 500000));
+  EXPECT_TRUE(PollAndTest2("a", 500000));
+
+  // purge_context2_ falls more than two records behind, so it must fall
+  // back to reading the file.
+  purge_context1_->AddPurgeUrl("a", 500000, ExpectSuccess());
+  purge_context1_->AddPurgeUrl("b", 500000, ExpectSuccess());
+  purge_context1_->AddPurgeUrl("c", 500000, ExpectSuccess());
+  EXPECT_FALSE(PollAndTest2("a", 500000));
+  EXPECT_FALSE(PollAndTest2("b", 500000));
+  EXPECT_FALSE(PollAndTest2("c", 500000));
+  EXPECT_EQ(ExpectStat(1), log_reloads());
+}
+
+TEST_P(PurgeContextTest, PurgeLogLongUrl) {
+  EnablePurgeLog(SharedMemPurgeLog::kDefaultCapacity);
+
+  // A URL too long for a ring slot is recorded as a request to re-read the
+  // file, which only arrives once the records before it have been copied.
+  GoogleString url(SharedMemPurgeLog::kMaxUrlSize + 1, 'x');
+  purge_log1_->AppendUrl("a", 500);
+  purge_log1_->AppendUrl(url, 500);
+  int64 sequence = 0;
+  std::vector<SharedMemPurgeLog::Entry> entries;
+  EXPECT_FALSE(purge_log2_->ReadSince(&sequence, &entries));
+  EXPECT_EQ(2, sequence);
+  ASSERT_EQ(1, entries.size());
+  EXPECT_EQ("a", entries[0].url);
+  EXPECT_EQ(500, entries[0].timestamp_ms);
+  EXPECT_FALSE(entries[0].global);
+
+  entries.clear();
+  purge_log1_->AppendGlobal(600);
+  EXPECT_TRUE(purge_log2_->ReadSince(&sequence, &entries));
+  EXPECT_EQ(3, sequence);
+  ASSERT_EQ(1, entries.size());
+  EXPECT_TRUE(entries[0].global);
+  EXPECT_EQ(600, entries[0].timestamp_ms);
+}
+
+TEST_P(PurgeContextTest, PurgeLogForeignFileEdit) {
+  EnablePurgeLog(SharedMemPurgeLog::kDefaultCapacity);
+  EXPECT_TRUE(PollAndTest1("a", 500));
+  EXPECT_TRUE(PollAndTest2("a", 500));
+
+  // An edit made directly to the file is noticed by the next periodic stat,
+  // which makes every context re-read the file.
+  scheduler_.AdvanceTimeMs(10 * Timer::kSecondMs);
+  ASSERT_TRUE(file_system_.WriteFile(kPurgeFile, "-1\n500 a\n",
+                                     &message_handler_));
+  EXPECT_FALSE(PollAndTest1("a", 500));
+  EXPECT_FALSE(PollAndTest2("a", 500));
+  EXPECT_TRUE(PollAndTest2("a", 501));
+  EXPECT_EQ(ExpectStat(2), log_reloads());
+}
+
 // We test with use_null_statistics == GetParam() as both true and false.
 INSTANTIATE_TEST_CASE_P(PurgeContextTestInstance, PurgeContextTest,
                         ::testing::Bool());
@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+//
+// Measures ThreadsafeCache wrapped around an LRUCache, as the per-process
+// cache is configured in SystemCachePath, with several threads hitting it
+// at once.  Every operation takes the one cache mutex, so on a multi-core
+// machine ns/op stops falling, and the upper percentiles climb, as soon as
+// threads start queueing for it.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/cache/threadsafe_cache.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_random.h"
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumKeys = 10000;
+const int kKeySize = 50;
+const int kPayloadSize = 100;
+
+class EmptyCallback : public CacheInterface::Callback {
+ public:
+  EmptyCallback() {}
+  virtual ~EmptyCallback() {}
+  virtual void Done(CacheInterface::KeyState state) {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(EmptyCallback);
+};
+
+// A ThreadsafeCache holding kNumKeys entries.  Threads start at different
+// offsets in the key list so they don't walk it in lock-step.
+class CacheBody : public ThreadedBenchmark::Body {
+ public:
+  explicit CacheBody(bool do_puts)
+      : thread_system_(Platform::CreateThreadSystem()),
+        lru_cache_(kNumKeys * (kKeySize + kPayloadSize) * 2),
+        cache_(&lru_cache_, thread_system_->NewMutex()),
+        do_puts_(do_puts) {
+    SimpleRandom random(new NullMutex);
+    GoogleString key_prefix = random.GenerateHighEntropyString(kKeySize);
+    value_.Assign(random.GenerateHighEntropyString(kPayloadSize));
+    for (int i = 0; i < kNumKeys; ++i) {
+      keys_.push_back(StrCat(key_prefix, IntegerToString(i)));
+      cache_.Put(keys_.back(), value_);
+    }
+  }
+
+  virtual void RunIteration(int thread_index, int iteration) {
+    const GoogleString& key =
+        keys_[(thread_index * (kNumKeys / 7) + iteration) % kNumKeys];
+    if (do_puts_) {
+      cache_.Put(key, value_);
+    } else {
+      EmptyCallback callback;
+      cache_.Get(key, &callback);
+    }
+  }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  LRUCache lru_cache_;
+  ThreadsafeCache cache_;
+  StringVector keys_;
+  SharedString value_;
+  bool do_puts_;
+
+  DISALLOW_COPY_AND_ASSIGN(CacheBody);
+};
+
+static void BM_ThreadsafeCacheGets(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  CacheBody body(false);
+  ThreadedBenchmark::Run("BM_ThreadsafeCacheGets", iters, num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_ThreadsafeCacheGets, 1, 8);
+
+static void BM_ThreadsafeCachePuts(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  CacheBody body(true);
+  ThreadedBenchmark::Run("BM_ThreadsafeCachePuts", iters, num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_ThreadsafeCachePuts, 1, 8);
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -21,6 +21,8 @@
 #include "pagespeed/kernel/html/html_element.h"
 
 #include <cstdio>
+#include <cstring>
+#include <new>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -48,6 +50,7 @@ HtmlElement::Data::Data(const HtmlName& name,
       live_(1),
       end_line_number_(0),
       style_(AUTO_CLOSE),
+      attribute_keywords_(0),
       name_(name),
       begin_(begin),
       end_(end) {
@@ -74,10 +77,16 @@ void HtmlElement::SynthesizeEvents(const HtmlEventListIterator& iter,
 }
 
 bool HtmlElement::DeleteAttribute(HtmlName::Keyword keyword) {
+  if ((data_->attribute_keywords_ & KeywordBit(keyword)) == 0) {
+    return false;
+  }
   AttributeList* attrs = mutable_attributes();
   for (AttributeIterator iter(attrs->begin()); iter != attrs->end(); ++iter) {
     if (iter->keyword() == keyword) {
       attrs->Erase(&iter);
+      if (attrs->IsEmpty()) {
+        data_->attribute_keywords_ = 0;
+      }
       return true;
     }
   }
@@ -98,6 +107,9 @@ bool HtmlElement::DeleteAttribute(StringPiece name) {
 const HtmlElement::Attribute* HtmlElement::FindAttribute(
     HtmlName::Keyword keyword) const {
   const Attribute* ret = NULL;
+  if ((data_->attribute_keywords_ & KeywordBit(keyword)) == 0) {
+    return ret;
+  }
 
   for (AttributeConstIterator iter = attributes().begin();
        iter != attributes().end(); ++iter) {
@@ -169,60 +181,109 @@ void HtmlElement::DebugPrint() const {
   puts(ToString().c_str());
 }
 
+HtmlElement::Attribute* HtmlElement::NewAttribute(
+    const HtmlName& name, const StringPiece& escaped_value,
+    QuoteStyle quote_style) {
+  // Round the inline storage up so that a modest rewrite of the value,
+  // e.g. a URL that grows by a few characters, can reuse it.
+  int inline_capacity = 0;
+  if (escaped_value.data() != NULL) {
+    inline_capacity = static_cast<int>(
+        (escaped_value.size() + 8) & ~static_cast<size_t>(7));
+  }
+  void* storage = ::operator new(sizeof(Attribute) + inline_capacity);
+  Attribute* attr = new(storage) Attribute(
+      name, &data_->attribute_keywords_, inline_capacity, quote_style);
+  attr->escaped_value_ = attr->StoreValue(escaped_value);
+  data_->attribute_keywords_ |= KeywordBit(name.keyword());
+  data_->attributes_.Append(attr);
+  return attr;
+}
+
 void HtmlElement::AddAttribute(const Attribute& src_attr) {
-  Attribute* attr = new Attribute(src_attr.name(),
-                                  src_attr.escaped_value(),
-                                  src_attr.quote_style());
+  Attribute* attr = NewAttribute(src_attr.name(), src_attr.escaped_value(),
+                                 src_attr.quote_style());
   if (src_attr.decoded_value_computed_) {
     attr->decoded_value_computed_ = true;
     attr->decoding_error_ = src_attr.decoding_error_;
-    Attribute::CopyValue(src_attr.decoded_value_.get(), &attr->decoded_value_);
+    if (src_attr.decoded_value_ == src_attr.escaped_value_) {
+      attr->decoded_value_ = attr->escaped_value_;
+    } else {
+      attr->decoded_value_ = Attribute::CopyValue(src_attr.decoded_value_);
+    }
   }
-  data_->attributes_.Append(attr);
 }
 
 void HtmlElement::AddAttribute(const HtmlName& name,
                                const StringPiece& decoded_value,
                                QuoteStyle quote_style) {
   GoogleString buf;
-  Attribute* attr = new Attribute(name,
-                                  HtmlKeywords::Escape(decoded_value, &buf),
-                                  quote_style);
+  StringPiece escaped_value = HtmlKeywords::Escape(decoded_value, &buf);
+  Attribute* attr = NewAttribute(name, escaped_value, quote_style);
   attr->decoded_value_computed_ = true;
   attr->decoding_error_ = false;
-  Attribute::CopyValue(decoded_value, &attr->decoded_value_);
-  data_->attributes_.Append(attr);
+  if ((decoded_value.data() == NULL) || (escaped_value == decoded_value)) {
+    attr->decoded_value_ = attr->escaped_value_;
+  } else {
+    attr->decoded_value_ = Attribute::CopyValue(decoded_value);
+  }
 }
 
 void HtmlElement::AddEscapedAttribute(const HtmlName& name,
                                       const StringPiece& escaped_value,
                                       QuoteStyle quote_style) {
-  Attribute* attr = new Attribute(name, escaped_value, quote_style);
-  data_->attributes_.Append(attr);
+  NewAttribute(name, escaped_value, quote_style);
 }
 
-void HtmlElement::Attribute::CopyValue(const StringPiece& src,
-                                       scoped_array<char>* dst) {
+char* HtmlElement::Attribute::CopyValue(const StringPiece& src) {
   if (src.data() == NULL) {
     // This case indicates attribute without value <tag attr>, as opposed
     // to data()=="", which implies an empty value <tag attr=>.
-    dst->reset();
-  } else {
-    char* buf = new char[src.size() + 1];
-    memcpy(buf, src.data(), src.size());
-    buf[src.size()] = '\0';
-    dst->reset(buf);
+    return NULL;
   }
+  char* buf = new char[src.size() + 1];
+  memcpy(buf, src.data(), src.size());
+  buf[src.size()] = '\0';
+  return buf;
+}
+
+char* HtmlElement::Attribute::StoreValue(const StringPiece& src) {
+  if ((src.data() == NULL) ||
+      (src.size() >= static_cast<size_t>(inline_capacity_))) {
+    return CopyValue(src);
+  }
+  char* buf = inline_storage();
+  memmove(buf, src.data(), src.size());
+  buf[src.size()] = '\0';
+  return buf;
 }
 
-HtmlElement::Attribute::Attribute(const HtmlName& name,
-                                  const StringPiece& escaped_value,
-                                  QuoteStyle quote_style)
+void HtmlElement::Attribute::FreeValues(char* escaped_value,
+                                        char* decoded_value) const {
+  // The decoded value is never stored inline, but may share the escaped
+  // value's storage.
+  if (decoded_value != escaped_value) {
+    delete [] decoded_value;
+  }
+  if (escaped_value != inline_storage()) {
+    delete [] escaped_value;
+  }
+}
+
+HtmlElement::Attribute::Attribute(const HtmlName& name, uint64* keyword_mask,
+                                  int inline_capacity, QuoteStyle quote_style)
     : name_(name),
       quote_style_(quote_style),
       decoding_error_(false),
-      decoded_value_computed_(false) {
-  CopyValue(escaped_value, &escaped_value_);
+      decoded_value_computed_(false),
+      inline_capacity_(inline_capacity),
+      keyword_mask_(keyword_mask),
+      escaped_value_(NULL),
+      decoded_value_(NULL) {
+}
+
+HtmlElement::Attribute::~Attribute() {
+  FreeValues(escaped_value_, decoded_value_);
 }
 
 // Modify value of attribute (eg to rewrite dest of src or href).
@@ -230,34 +291,33 @@ HtmlElement::Attribute::Attribute(const HtmlName& name,
 // ownership of value.
 void HtmlElement::Attribute::SetValue(const StringPiece& decoded_value) {
   GoogleString buf;
-  // Note that we execute the lines in this order in case value
-  // is a substring of value_.  This copies the value just prior
-  // to deallocation of the old value_.
-  const char* escaped_chars = escaped_value_.get();
-  DCHECK(decoded_value.data() + decoded_value.size() < escaped_chars ||
-         escaped_chars + strlen(escaped_chars) < decoded_value.data())
-      << "Setting unescaped value from substring of escaped value.";
-  CopyValue(HtmlKeywords::Escape(decoded_value, &buf), &escaped_value_);
-  CopyValue(decoded_value, &decoded_value_);
-}
+  StringPiece escaped_value = HtmlKeywords::Escape(decoded_value, &buf);
+  char* old_escaped_value = escaped_value_;
+  char* old_decoded_value = decoded_value_;
 
-void HtmlElement::Attribute::SetEscapedValue(const StringPiece& escaped_value) {
-  GoogleString buf;
-  // Note that we execute the lines in this order in case value
-  // is a substring of value_.  This copies the value just prior
-  // to deallocation of the old value_.
-  const char* value_chars = decoded_value_.get();
-  if (value_chars != NULL) {
-    DCHECK(value_chars + strlen(value_chars) < escaped_value.data() ||
-           escaped_value.data() + escaped_value.size() < value_chars)
-        << "Setting escaped value from substring of unescaped value.";
+  // decoded_value may point into our own storage, so copy it out before
+  // the escaped value is written to the inline buffer, and free the old
+  // values only at the end.
+  if ((decoded_value.data() == NULL) || (escaped_value == decoded_value)) {
+    escaped_value_ = StoreValue(decoded_value);
+    decoded_value_ = escaped_value_;
+  } else {
+    decoded_value_ = CopyValue(decoded_value);
+    escaped_value_ = StoreValue(escaped_value);
   }
+  FreeValues(old_escaped_value, old_decoded_value);
+  decoding_error_ = false;
+  decoded_value_computed_ = true;
+}
 
-  decoded_value_.reset();
+void HtmlElement::Attribute::SetEscapedValue(const StringPiece& escaped_value) {
+  char* old_escaped_value = escaped_value_;
+  char* old_decoded_value = decoded_value_;
+  escaped_value_ = StoreValue(escaped_value);
+  FreeValues(old_escaped_value, old_decoded_value);
+  decoded_value_ = NULL;
   decoding_error_ = false;
   decoded_value_computed_ = false;
-
-  CopyValue(escaped_value, &escaped_value_);
 }
 
 const char* HtmlElement::Attribute::quote_str() const {
@@ -275,8 +335,13 @@ const char* HtmlElement::Attribute::quote_str() const {
 void HtmlElement::Attribute::ComputeDecodedValue() const {
   GoogleString buf;
   StringPiece unescaped_value = HtmlKeywords::Unescape(
-      escaped_value_.get(), &buf, &decoding_error_);
-  CopyValue(unescaped_value, &decoded_value_);
+      escaped_value_, &buf, &decoding_error_);
+  if (unescaped_value.data() == escaped_value_) {
+    // Nothing needed unescaping, so share the escaped value's storage.
+    decoded_value_ = escaped_value_;
+  } else {
+    decoded_value_ = CopyValue(unescaped_value);
+  }
   decoded_value_computed_ = true;
 }
 
@@ -86,11 +86,14 @@ class HtmlElement : public HtmlNode {
     HtmlName::Keyword keyword() const { return name_.keyword(); }
 
     HtmlName name() const { return name_; }
-    void set_name(const HtmlName& name) { name_ = name; }
+    void set_name(const HtmlName& name) {
+      name_ = name;
+      *keyword_mask_ |= KeywordBit(name.keyword());
+    }
 
     // Returns the value in its original directly from the HTML source.
     // This may have HTML escapes in it, such as "&amp;".
-    const char* escaped_value() const { return escaped_value_.get(); }
+    const char* escaped_value() const { return escaped_value_; }
 
     // The result of DecodedValueOrNull() is still owned by this, and
     // will be invalidated by a subsequent call to SetValue().
@@ -121,7 +124,7 @@ class HtmlElement : public HtmlNode {
       if (!decoded_value_computed_) {
         ComputeDecodedValue();
       }
-      return decoded_value_.get();
+      return decoded_value_;
     }
 
     void set_decoding_error(bool x) { decoding_error_ = x; }
@@ -168,23 +171,53 @@ class HtmlElement : public HtmlNode {
       quote_style_ = new_quote_style;
     }
 
+    ~Attribute();
+
+    // Attributes are allocated by HtmlElement::NewAttribute with extra
+    // storage following the object, so deletion must not use the sized
+    // global operator delete.
+    static void operator delete(void* ptr) { ::operator delete(ptr); }
+
     friend class HtmlElement;
 
    private:
     void ComputeDecodedValue() const;
 
-    // This should only be called from AddAttribute
-    Attribute(const HtmlName& name, const StringPiece& escaped_value,
-              QuoteStyle quote_style);
+    // This should only be called from HtmlElement::NewAttribute.
+    Attribute(const HtmlName& name, uint64* keyword_mask,
+              int inline_capacity, QuoteStyle quote_style);
+
+    // The inline value storage immediately follows the object.
+    char* inline_storage() const {
+      return reinterpret_cast<char*>(const_cast<Attribute*>(this) + 1);
+    }
+
+    // Returns a NUL-terminated copy of src, placed in the inline storage
+    // if it fits and on the heap otherwise.  src may point into the inline
+    // storage.  Returns NULL if src.data() is NULL.
+    char* StoreValue(const StringPiece& src);
 
-    static inline void CopyValue(const StringPiece& src,
-                                 scoped_array<char>* dst);
+    // Returns a heap-allocated NUL-terminated copy of src, or NULL if
+    // src.data() is NULL.
+    static char* CopyValue(const StringPiece& src);
+
+    // Frees previously held values once they have been replaced.
+    void FreeValues(char* escaped_value, char* decoded_value) const;
 
     HtmlName name_;
     QuoteStyle quote_style_ : 8;
     mutable bool decoding_error_;
     mutable bool decoded_value_computed_;
 
+    // Number of bytes available in inline_storage().  Values parsed from
+    // HTML are copied there when the attribute is created, so most
+    // attributes need only one allocation.
+    int inline_capacity_;
+
+    // Keyword summary of the element that owns this attribute; see
+    // HtmlElement::Data::attribute_keywords_.
+    uint64* keyword_mask_;
+
     // Attribute value represented as ascii and
     // HTML-escape-sequences, typically parsed directly from an HTML
     // file.  This is the canonical representation, and it can handle
@@ -193,7 +226,9 @@ class HtmlElement : public HtmlNode {
     // Note that it is acceptable to have 8-bit characters in escape
     // sequences (typically iso8859).  However we will not be able to
     // decode such attributes.
-    scoped_array<char> escaped_value_;
+    //
+    // This points either at inline_storage() or at a heap-allocated array.
+    char* escaped_value_;
 
     // An 8-bit representation of the escaped_value.  Escape sequences
     // that contain character-codes >= 256 are not decoded, and will
@@ -211,7 +246,10 @@ class HtmlElement : public HtmlNode {
     // Note that we do not decode non-ASCII characters but we can
     // represent them in escaped_value_.  We can get 8-bit characters
     // into decoded_value_ via &#129; etc.
-    mutable scoped_array<char> decoded_value_;
+    //
+    // Values without escape sequences decode to themselves, in which case
+    // this shares escaped_value_ rather than holding its own copy.
+    mutable char* decoded_value_;
 
     DISALLOW_COPY_AND_ASSIGN(Attribute);
   };
@@ -383,6 +421,13 @@ class HtmlElement : public HtmlNode {
     unsigned end_line_number_ : 24;
     Style style_ : 8;
 
+    // Bitmask summarizing the keywords of attributes_, one bit per
+    // keyword modulo 64 (see KeywordBit).  Bits are set as attributes are
+    // added or renamed but not cleared when an attribute is removed through
+    // mutable_attributes(), so this is a superset: a clear bit means
+    // FindAttribute can answer without walking the list.
+    uint64 attribute_keywords_;
+
     HtmlName name_;
     AttributeList attributes_;
     HtmlEventListIterator begin_;
@@ -395,6 +440,16 @@ class HtmlElement : public HtmlNode {
   void set_begin(const HtmlEventListIterator& begin) { data_->begin_ = begin; }
   void set_end(const HtmlEventListIterator& end) { data_->end_ = end; }
 
+  // Allocates an attribute for this element with room to hold
+  // escaped_value inline.
+  Attribute* NewAttribute(const HtmlName& name,
+                          const StringPiece& escaped_value,
+                          QuoteStyle quote_style);
+
+  static uint64 KeywordBit(HtmlName::Keyword keyword) {
+    return static_cast<uint64>(1) << (static_cast<unsigned>(keyword) & 63);
+  }
+
   void set_begin_line_number(int line) { data_->begin_line_number_ = line; }
   void set_end_line_number(int line) { data_->end_line_number_ = line; }
 
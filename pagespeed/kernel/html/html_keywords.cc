@@ -387,10 +387,6 @@ HtmlKeywords::HtmlKeywords() {
 }
 
 void HtmlKeywords::InitEscapeSequences() {
-  unescape_insensitive_map_.set_deleted_key("");
-  unescape_sensitive_map_.set_deleted_key("");
-  escape_map_.set_deleted_key("");
-
   StringSetInsensitive case_sensitive_symbols;
   for (size_t i = 0; i < arraysize(kHtmlKeywordsSequences); ++i) {
     // Put all symbols in the case-sensitive map
@@ -404,7 +400,7 @@ void HtmlKeywords::InitEscapeSequences() {
         case_sensitive_symbols.end()) {
       // If this symbol is already present in the insensitive map, then it
       // must be case-sensitive.  E.g. &AElig; and &aelig; are distinct.
-      StringStringSparseHashMapInsensitive::iterator p =
+      StringStringFlatHashMapInsensitive::iterator p =
           unescape_insensitive_map_.find(seq.sequence);
       if (p != unescape_insensitive_map_.end()) {
         // As this symbol is case-sensitive, we must remove it from the
@@ -583,7 +579,7 @@ bool HtmlKeywords::TryUnescape(bool accumulate_numeric_code,
     // code-points) whereas some are case-insensitive (&quot; and
     // &QUOT; both work.  So do the case-sensitive lookup first, and
     // if that fails, do an insensitive lookup.
-    StringStringSparseHashMapSensitive::const_iterator p =
+    StringStringFlatHashMapSensitive::const_iterator p =
         unescape_sensitive_map_.find(escape);
     if (p != unescape_sensitive_map_.end()) {
       *buf += p->second;
@@ -607,7 +603,7 @@ bool HtmlKeywords::TryUnescape(bool accumulate_numeric_code,
         // valid escape sequence, e.g. QUOT;, but there is no
         // multi-byte match (e.g. Yuml;).  We can allow sloppy
         // interpretation with a case insensitive lookup here.
-        StringStringSparseHashMapInsensitive::const_iterator q =
+        StringStringFlatHashMapInsensitive::const_iterator q =
             unescape_insensitive_map_.find(escape);
         if (q != unescape_insensitive_map_.end()) {
           *buf += q->second;
@@ -648,7 +644,6 @@ StringPiece HtmlKeywords::EscapeHelper(const StringPiece& unescaped,
   }
   buf->clear();
 
-  GoogleString char_to_escape;
   for (size_t i = 0; i < unescaped.size(); ++i) {
     int ch = static_cast<unsigned char>(unescaped[i]);
     // According to http://www.htmlescape.net/htmlescape_tool.html,
@@ -662,10 +657,8 @@ StringPiece HtmlKeywords::EscapeHelper(const StringPiece& unescaped,
     if (!IsHtmlSpace(ch) &&
         ((ch > 127) || (ch < 32) || (ch == '"') || (ch == '\'') ||
          (ch == '&') || (ch == '<') || (ch == '>'))) {
-      char_to_escape.clear();
-      char_to_escape += ch;
-      StringStringSparseHashMapSensitive::const_iterator p =
-          escape_map_.find(char_to_escape);
+      StringStringFlatHashMapSensitive::const_iterator p =
+          escape_map_.find(unescaped.substr(i, 1));
       if (p == escape_map_.end()) {
         StringAppendF(buf, "&#%02d;", static_cast<int>(ch));
       } else {
@@ -25,7 +25,7 @@
 #include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
-#include "pagespeed/kernel/base/sparse_hash_map.h"
+#include "pagespeed/kernel/base/flat_hash_map.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_hash.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -190,22 +190,22 @@ class HtmlKeywords {
                              GoogleString* buf,
                              bool* decoding_error) const;
 
-  // Conventional wisdom suggests this application calls for dense_hash_map,
-  // but my microbenchmarks show that sparse_hash_map has better performance.
-  // My theory is that the maps are sufficiently small that the algorithmic
-  // differences are not dominant, but keeping the data small helps the
-  // processor cache behavior.
-  typedef sparse_hash_map<
+  // These maps are small and read-mostly, so we keep them in flat tables
+  // with one-byte control tags: a miss usually costs a single 16-byte group
+  // compare, and lookups take a StringPiece so we never build a temporary
+  // GoogleString for the escape sequence being decoded.
+  typedef FlatHashMap<
     GoogleString, const char*,
-    CaseFoldStringHash,
-    CaseFoldStringEqual> StringStringSparseHashMapInsensitive;
-  typedef sparse_hash_map<
+    CaseFoldStringPieceHash,
+    CaseFoldStringPieceEqual> StringStringFlatHashMapInsensitive;
+  typedef FlatHashMap<
     GoogleString, const char*,
-    CasePreserveStringHash> StringStringSparseHashMapSensitive;
+    CasePreserveStringPieceHash,
+    CasePreserveStringPieceEqual> StringStringFlatHashMapSensitive;
 
-  StringStringSparseHashMapInsensitive unescape_insensitive_map_;
-  StringStringSparseHashMapSensitive unescape_sensitive_map_;
-  StringStringSparseHashMapSensitive escape_map_;
+  StringStringFlatHashMapInsensitive unescape_insensitive_map_;
+  StringStringFlatHashMapSensitive unescape_sensitive_map_;
+  StringStringFlatHashMapSensitive escape_map_;
 
   // Note that this is left immutable after being filled in, so it's OK
   // to take pointers into it.
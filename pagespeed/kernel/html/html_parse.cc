@@ -33,6 +33,7 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/symbol_table.h"
+#include "pagespeed/kernel/base/thread_cpu_time.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/html/doctype.h"
 #include "pagespeed/kernel/html/html_element.h"
@@ -61,6 +62,7 @@ HtmlParse::HtmlParse(MessageHandler* message_handler)
       need_coalesce_characters_(false),
       url_valid_(false),
       log_rewrite_timing_(false),
+      measure_filter_cpu_(false),
       running_filters_(false),
       buffer_events_(false),
       parse_start_time_us_(0),
@@ -405,12 +407,16 @@ void HtmlParse::ApplyFilter(HtmlFilter* filter) {
   }
 
   ShowProgress(StrCat("ApplyFilter:", filter->Name()).c_str());
+  int64 start_cpu_us = measure_filter_cpu_ ? ThreadCpuTimeUs() : -1;
   for (current_ = queue_.begin(); current_ != queue_.end(); NextEvent()) {
     HtmlEvent* event = *current_;
     line_number_ = event->line_number();
     event->Run(filter);
   }
   filter->Flush();
+  if (start_cpu_us >= 0) {
+    RecordFilterCpuUs(filter, ThreadCpuTimeUs() - start_cpu_us);
+  }
 
   if (need_sanity_check_) {
     SanityCheck();
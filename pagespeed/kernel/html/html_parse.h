@@ -447,6 +447,12 @@ class HtmlParse {
   Timer* timer() const { return timer_; }
   void set_log_rewrite_timing(bool x) { log_rewrite_timing_ = x; }
 
+  // When set, ApplyFilter measures the thread CPU time each filter spends
+  // handling a flush window's events, including its Flush(), and reports it
+  // via RecordFilterCpuUs.
+  void set_measure_filter_cpu(bool x) { measure_filter_cpu_ = x; }
+  bool measure_filter_cpu() const { return measure_filter_cpu_; }
+
   // Adds a filter to be called during parsing as new events are added.
   // Takes ownership of the HtmlFilter passed in.
   void add_event_listener(HtmlFilter* listener);
@@ -592,6 +598,10 @@ class HtmlParse {
   // Same, but over a passed-in list of filters.
   void DisableFiltersInjectingScripts(const FilterList& filters);
 
+  // Called after each ApplyFilter when measure_filter_cpu() is set, with the
+  // thread CPU time the filter consumed.  The default does nothing.
+  virtual void RecordFilterCpuUs(HtmlFilter* filter, int64 cpu_us) {}
+
  private:
   void ApplyFilterHelper(HtmlFilter* filter);
   HtmlEventListIterator Last();  // Last element in queue
@@ -657,6 +667,7 @@ class HtmlParse {
   bool need_coalesce_characters_;
   bool url_valid_;
   bool log_rewrite_timing_;  // Should we time the speed of parsing?
+  bool measure_filter_cpu_;
   bool running_filters_;
   bool buffer_events_;
   int64 parse_start_time_us_;
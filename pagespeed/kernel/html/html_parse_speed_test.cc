@@ -46,6 +46,9 @@
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/empty_html_filter.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/html/html_writer_filter.h"
 
 namespace net_instaweb {
@@ -168,6 +171,61 @@ static void BM_ParseAndSerializeReuseParserX50(int iters) {
 }
 BENCHMARK(BM_ParseAndSerializeReuseParserX50);
 
+// Looks up a handful of attributes on every element, most of which are
+// absent, the way resource-scanning filters do.
+class AttributeQueryFilter : public EmptyHtmlFilter {
+ public:
+  AttributeQueryFilter() : found_(0) {}
+
+  virtual void StartElement(HtmlElement* element) {
+    static const HtmlName::Keyword kKeywords[] = {
+      HtmlName::kSrc, HtmlName::kHref, HtmlName::kId, HtmlName::kClass,
+      HtmlName::kDataPagespeedNoTransform, HtmlName::kPagespeedNoDefer,
+      HtmlName::kOnload
+    };
+    for (int i = 0, n = arraysize(kKeywords); i < n; ++i) {
+      const char* value = element->AttributeValue(kKeywords[i]);
+      if (value != NULL) {
+        found_ += (*value != '\0');
+      }
+    }
+  }
+
+  virtual const char* Name() const { return "AttributeQuery"; }
+
+  int found() const { return found_; }
+
+ private:
+  int found_;
+
+  DISALLOW_COPY_AND_ASSIGN(AttributeQueryFilter);
+};
+
+static void BM_ParseQueryAttributesAndSerialize(int iters) {
+  StopBenchmarkTiming();
+  StringPiece text = GetHtmlText();
+  if (text.empty()) {
+    return;
+  }
+
+  NullWriter writer;
+  NullMessageHandler handler;
+  HtmlParse parser(&handler);
+  AttributeQueryFilter query_filter;
+  parser.AddFilter(&query_filter);
+  HtmlWriterFilter writer_filter(&parser);
+  parser.AddFilter(&writer_filter);
+  writer_filter.set_writer(&writer);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    parser.StartParse("http://example.com/benchmark");
+    parser.ParseText(text);
+    parser.FinishParse();
+  }
+}
+BENCHMARK(BM_ParseQueryAttributesAndSerialize);
+
 }  // namespace
 
 }  // namespace net_instaweb
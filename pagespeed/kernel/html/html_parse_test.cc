@@ -28,6 +28,7 @@
 #include "pagespeed/kernel/base/gmock.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/null_mutex.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -2037,6 +2038,65 @@ TEST_F(AttributeManipulationTest, CloneElement) {
                 " selected />");
 }
 
+TEST_F(AttributeManipulationTest, FindRenamedAttribute) {
+  HtmlElement::Attribute* href = node_->FindAttribute(HtmlName::kHref);
+  ASSERT_TRUE(href != NULL);
+  EXPECT_TRUE(node_->FindAttribute(HtmlName::kSrc) == NULL);
+  html_parse_.SetAttributeName(href, HtmlName::kSrc);
+  EXPECT_EQ(href, node_->FindAttribute(HtmlName::kSrc));
+  EXPECT_TRUE(node_->FindAttribute(HtmlName::kHref) == NULL);
+
+  // Attributes erased directly from the list are no longer found either.
+  HtmlElement::AttributeList* attrs = node_->mutable_attributes();
+  for (HtmlElement::AttributeIterator i(attrs->begin());
+       i != attrs->end(); ++i) {
+    if (i->keyword() == HtmlName::kId) {
+      attrs->Erase(&i);
+      break;
+    }
+  }
+  EXPECT_TRUE(node_->FindAttribute(HtmlName::kId) == NULL);
+  EXPECT_FALSE(node_->DeleteAttribute(HtmlName::kId));
+  EXPECT_TRUE(node_->DeleteAttribute(HtmlName::kClass));
+  EXPECT_TRUE(node_->DeleteAttribute(HtmlName::kSrc));
+  EXPECT_TRUE(node_->DeleteAttribute(HtmlName::kSelected));
+  EXPECT_TRUE(node_->attributes().IsEmpty());
+  EXPECT_TRUE(node_->FindAttribute(HtmlName::kSrc) == NULL);
+  CheckExpected("<a/>");
+}
+
+TEST_F(AttributeManipulationTest, ResizeValues) {
+  HtmlElement::Attribute* id = node_->FindAttribute(HtmlName::kId);
+  ASSERT_TRUE(id != NULL);
+
+  // Grow the value well beyond the space allocated for "37", then shrink it
+  // back, using the attribute's own value as the source.
+  const GoogleString kLong(100, 'x');
+  id->SetValue(kLong);
+  EXPECT_EQ(kLong, id->DecodedValueOrNull());
+  EXPECT_EQ(kLong, id->escaped_value());
+  id->SetValue(StringPiece(id->DecodedValueOrNull(), 3));
+  EXPECT_STREQ("xxx", id->DecodedValueOrNull());
+  EXPECT_STREQ("xxx", id->escaped_value());
+  id->SetEscapedValue(StringPiece(id->escaped_value(), 1));
+  EXPECT_STREQ("x", id->DecodedValueOrNull());
+
+  // Values with escapes keep separate escaped and decoded forms.
+  id->SetEscapedValue("a&amp;b");
+  EXPECT_STREQ("a&amp;b", id->escaped_value());
+  EXPECT_STREQ("a&b", id->DecodedValueOrNull());
+  id->SetValue(id->DecodedValueOrNull());
+  EXPECT_STREQ("a&amp;b", id->escaped_value());
+  EXPECT_STREQ("a&b", id->DecodedValueOrNull());
+  id->SetEscapedValue(id->DecodedValueOrNull());
+  EXPECT_STREQ("a&b", id->escaped_value());
+  id->SetValue(StringPiece());
+  EXPECT_TRUE(id->escaped_value() == NULL);
+  EXPECT_TRUE(id->DecodedValueOrNull() == NULL);
+  CheckExpected("<a href=\"http://www.google.com/\" id class='search!'"
+                " selected />");
+}
+
 TEST_F(HtmlParseTest, NoDisabledFilter) {
   std::vector<GoogleString> disabled_filters;
   ASSERT_TRUE(disabled_filters.empty());
@@ -3215,5 +3275,62 @@ TEST_F(HtmlParseTestNoBody, InsertExternalScriptAfterEndOfHead) {
                    "<head>text</head><script src=\"inserted\"></script>");
 }
 
+// Records the filters reported by ApplyFilter when measuring filter CPU.
+class CpuRecordingHtmlParse : public HtmlParse {
+ public:
+  explicit CpuRecordingHtmlParse(MessageHandler* handler)
+      : HtmlParse(handler) {}
+
+  const std::vector<HtmlFilter*>& recorded_filters() const {
+    return recorded_filters_;
+  }
+
+ protected:
+  virtual void RecordFilterCpuUs(HtmlFilter* filter, int64 cpu_us) {
+    EXPECT_LE(0, cpu_us);
+    recorded_filters_.push_back(filter);
+  }
+
+ private:
+  std::vector<HtmlFilter*> recorded_filters_;
+
+  DISALLOW_COPY_AND_ASSIGN(CpuRecordingHtmlParse);
+};
+
+class CountingFilter : public EmptyHtmlFilter {
+ public:
+  CountingFilter() {}
+  virtual const char* Name() const { return "Counting"; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CountingFilter);
+};
+
+TEST(HtmlParseFilterCpuTest, ReportsEachFilterPerFlush) {
+  MockMessageHandler handler(new NullMutex);
+  CpuRecordingHtmlParse html_parse(&handler);
+  CountingFilter filter1, filter2;
+  html_parse.AddFilter(&filter1);
+  html_parse.AddFilter(&filter2);
+
+  // Nothing is reported unless measurement is requested.
+  html_parse.StartParse("http://test.com/off.html");
+  html_parse.ParseText("<div>x</div>");
+  html_parse.FinishParse();
+  EXPECT_TRUE(html_parse.recorded_filters().empty());
+
+  html_parse.set_measure_filter_cpu(true);
+  html_parse.StartParse("http://test.com/on.html");
+  html_parse.ParseText("<div>x</div>");
+  html_parse.Flush();
+  html_parse.ParseText("<p>y</p>");
+  html_parse.FinishParse();
+  ASSERT_EQ(4, html_parse.recorded_filters().size());
+  EXPECT_EQ(&filter1, html_parse.recorded_filters()[0]);
+  EXPECT_EQ(&filter2, html_parse.recorded_filters()[1]);
+  EXPECT_EQ(&filter1, html_parse.recorded_filters()[2]);
+  EXPECT_EQ(&filter2, html_parse.recorded_filters()[3]);
+}
+
 
 }  // namespace net_instaweb
@@ -36,6 +36,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/http/http.pb.h"
+#include "pagespeed/kernel/http/http_header_name.h"
 #include "pagespeed/kernel/http/http_names.h"
 
 namespace net_instaweb {
@@ -182,12 +183,16 @@ template<class Proto> void Headers<Proto>::SetValue(int i, StringPiece value) {
   value.CopyToString(proto_->mutable_header(i)->mutable_value());
   map_.reset(NULL);
   cookies_.reset(NULL);
+  UpdateHook();
 }
 
 template<class Proto> void Headers<Proto>::PopulateMap() const {
   if (map_.get() == NULL) {
     map_.reset(new StringMultiMapInsensitive);
     cookies_.reset(NULL);
+    for (int k = 0; k < HttpHeaderName::kNotAKeyword; ++k) {
+      keyword_values_[k] = NULL;
+    }
     for (int i = 0, n = NumAttributes(); i < n; ++i) {
       AddToMap(Name(i), Value(i));
     }
@@ -269,31 +274,82 @@ template<class Proto> bool Headers<Proto>::HasValue(
   return false;
 }
 
+template<class Proto> const ConstStringStarVector*
+Headers<Proto>::KeywordValues(HttpHeaderName::Keyword keyword) const {
+  DCHECK_LT(keyword, HttpHeaderName::kNotAKeyword);
+  PopulateMap();
+  return keyword_values_[keyword];
+}
+
+template<class Proto> bool Headers<Proto>::Lookup(
+    HttpHeaderName::Keyword keyword, ConstStringStarVector* values) const {
+  const ConstStringStarVector* found = KeywordValues(keyword);
+  if (found == NULL) {
+    return false;
+  }
+  *values = *found;
+  return true;
+}
+
+template<class Proto> const char* Headers<Proto>::Lookup1(
+    HttpHeaderName::Keyword keyword) const {
+  const ConstStringStarVector* found = KeywordValues(keyword);
+  if ((found != NULL) && (found->size() == 1)) {
+    return (*found)[0]->c_str();
+  }
+  return NULL;
+}
+
+template<class Proto> bool Headers<Proto>::Has(
+    HttpHeaderName::Keyword keyword) const {
+  return KeywordValues(keyword) != NULL;
+}
+
+template<class Proto> bool Headers<Proto>::HasValue(
+    HttpHeaderName::Keyword keyword, const StringPiece& value) const {
+  const ConstStringStarVector* found = KeywordValues(keyword);
+  if (found != NULL) {
+    for (ConstStringStarVector::const_iterator iter = found->begin();
+         iter != found->end(); ++iter) {
+      if (value == **iter) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 namespace {
 
-bool IsCommaSeparatedField(const StringPiece& name) {
+bool IsCommaSeparatedField(HttpHeaderName::Keyword keyword) {
   // TODO(nforman): Make this a complete list.  The list of header names
   // that are not safe to comma-split is at
   // http://src.chromium.org/viewvc/chrome/trunk/src/net/http/http_util.cc
   // (search for IsNonCoalescingHeader)
-  if (StringCaseEqual(name, HttpAttributes::kAccept) ||
-      StringCaseEqual(name, HttpAttributes::kCacheControl) ||
-      StringCaseEqual(name, HttpAttributes::kContentEncoding) ||
-      StringCaseEqual(name, HttpAttributes::kConnection) ||
-      StringCaseEqual(name, HttpAttributes::kAcceptEncoding) ||
-      StringCaseEqual(name, HttpAttributes::kVary)) {
-    return true;
-  } else {
-    return false;
+  switch (keyword) {
+    case HttpHeaderName::kAccept:
+    case HttpHeaderName::kAcceptEncoding:
+    case HttpHeaderName::kCacheControl:
+    case HttpHeaderName::kConnection:
+    case HttpHeaderName::kContentEncoding:
+    case HttpHeaderName::kVary:
+      return true;
+    default:
+      return false;
   }
 }
 
+bool IsCommaSeparatedField(const StringPiece& name) {
+  return IsCommaSeparatedField(HttpHeaderName::Lookup(name));
+}
+
 // Takes a potentially comma-separated value list, and splits it into
 // a vector.  If the value is not comma-separatable, 'values' is
 // populated with the single value.
-void SplitValues(StringPiece name, StringPiece comma_separated_values,
+void SplitValues(HttpHeaderName::Keyword keyword,
+                 StringPiece comma_separated_values,
                  StringPieceVector* values) {
-  if (IsCommaSeparatedField(name)) {
+  if (IsCommaSeparatedField(keyword)) {
     SplitStringPieceToVector(comma_separated_values, ",", values, true);
     if (values->empty()) {
       values->push_back(comma_separated_values);
@@ -321,11 +377,16 @@ template<class Proto> void Headers<Proto>::Add(
 template<class Proto> void Headers<Proto>::AddToMap(
     const StringPiece& name, const StringPiece& value) const {
   if (map_.get() != NULL) {
+    HttpHeaderName::Keyword keyword = HttpHeaderName::Lookup(name);
     StringPieceVector split;
-    SplitValues(name, value, &split);
+    SplitValues(keyword, value, &split);
     for (int i = 0, n = split.size(); i < n; ++i) {
       map_->Add(name, split[i]);
     }
+    if ((keyword != HttpHeaderName::kNotAKeyword) &&
+        (keyword_values_[keyword] == NULL)) {
+      keyword_values_[keyword] = map_->LookupValues(name);
+    }
     cookies_.reset(NULL);  // Pessimistically assume this.
   }
 }
@@ -333,7 +394,7 @@ template<class Proto> void Headers<Proto>::AddToMap(
 template<class Proto> void Headers<Proto>::RemoveCookie(
     const StringPiece& cookie_name) {
   ConstStringStarVector values;
-  if (Lookup(HttpAttributes::kCookie, &values)) {
+  if (Lookup(HttpHeaderName::kCookie, &values)) {
     StringVector new_cookie_lines;
     bool remove_cookie = false;
     for (int i = 0, n = values.size(); i < n; ++i) {
@@ -424,6 +485,15 @@ template<class Proto> bool Headers<Proto>::RemoveAllFromSortedArray(
 
   // If we removed anything, we update the proto as well.
   if (removed_anything) {
+    // The map has deleted the value vectors for these names, so drop any
+    // keyword slots that pointed at them.
+    for (int i = 0; i < names_size; ++i) {
+      HttpHeaderName::Keyword keyword = HttpHeaderName::Lookup(names[i]);
+      if (keyword != HttpHeaderName::kNotAKeyword) {
+        keyword_values_[keyword] = NULL;
+      }
+    }
+
     // Remove all headers that are slated for removal.
     protobuf::RepeatedPtrField<NameValue>* headers = proto_->mutable_header();
     // Note: you might be tempted to consider repopulating the protobuf
@@ -531,7 +601,7 @@ template<class Proto> bool Headers<Proto>::RemoveIfNotIn(const Headers& keep) {
     bool needed = false;
     if (!keep_value_bag.empty()) {
       StringPieceVector this_values;
-      SplitValues(name, Value(a), &this_values);
+      SplitValues(HttpHeaderName::Lookup(name), Value(a), &this_values);
       bool partial = false;
       int out = 0;
       for (int in = 0, nv = this_values.size(); in < nv; ++in) {
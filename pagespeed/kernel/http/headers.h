@@ -30,6 +30,7 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/http_header_name.h"
 
 namespace net_instaweb {
 
@@ -99,6 +100,17 @@ template<class Proto> class Headers {
   // Is value one of the values in Lookup(name)?
   bool HasValue(const StringPiece& name, const StringPiece& value) const;
 
+  // Variants of the above for the well-known headers enumerated in
+  // HttpHeaderName.  These read a per-keyword slot that is kept in sync with
+  // the lookup map, so they skip the case-insensitive hash and compare of the
+  // name.  The same constness warnings as for Lookup() apply.
+  bool Lookup(HttpHeaderName::Keyword keyword,
+              ConstStringStarVector* values) const;
+  const char* Lookup1(HttpHeaderName::Keyword keyword) const;
+  bool Has(HttpHeaderName::Keyword keyword) const;
+  bool HasValue(HttpHeaderName::Keyword keyword,
+                const StringPiece& value) const;
+
   // NumAttributeNames is also const but not thread-safe.
   int NumAttributeNames() const;
 
@@ -232,6 +244,11 @@ template<class Proto> class Headers {
   // will contain the original pairs including comma-separated values.
   void AddToMap(const StringPiece& name, const StringPiece& value) const;
 
+  // Returns the values for keyword held in map_, or NULL if there are none.
+  // Populates the map if needed.
+  const ConstStringStarVector* KeywordValues(
+      HttpHeaderName::Keyword keyword) const;
+
   // We have two representations for the name/value pairs.  Proto contains a
   // simple string-pair vector, but lacks a fast associative lookup.  So we
   // will build structures for associative lookup lazily, and keep them
@@ -239,6 +256,12 @@ template<class Proto> class Headers {
   mutable scoped_ptr<StringMultiMapInsensitive> map_;
   scoped_ptr<Proto> proto_;
 
+  // Direct slots for the well-known headers, pointing at the value vectors
+  // owned by map_.  They are only meaningful while map_ is populated: each
+  // is NULL exactly when map_ has no entry for that header.
+  mutable const ConstStringStarVector*
+      keyword_values_[HttpHeaderName::kNotAKeyword];
+
   // Furthermore, we also have a map of cookie names to <value, attributes>.
   // It is lazilyloaded by PopulateCookieMap as/when required. The keys and
   // values all point into the map_ data element. We cater for the same cookie
@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_HTTP_HTTP_HEADER_NAME_H_
+#define PAGESPEED_KERNEL_HTTP_HTTP_HEADER_NAME_H_
+
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// Enumerates the HTTP header names that Headers indexes directly, so that
+// frequently consulted headers such as Cache-Control and Content-Type can be
+// found without a case-insensitive hash lookup.  Like HtmlName, lookup of a
+// header name is case-insensitive, and names we don't care about map to
+// kNotAKeyword.
+class HttpHeaderName {
+ public:
+  // This list must be kept in alpha-order and in sync with
+  // http_header_name.gperf.  It need not cover every header in
+  // http_names.h -- only the ones we look up often.
+  enum Keyword {
+    kAccept,
+    kAcceptEncoding,
+    kAuthorization,
+    kCacheControl,
+    kConnection,
+    kContentEncoding,
+    kContentLength,
+    kContentType,
+    kCookie,
+    kCookie2,
+    kDate,
+    kEtag,
+    kExpires,
+    kHost,
+    kIfModifiedSince,
+    kIfNoneMatch,
+    kLastModified,
+    kLink,
+    kLocation,
+    kPragma,
+    kReferer,
+    kSetCookie,
+    kSetCookie2,
+    kTransferEncoding,
+    kUserAgent,
+    kVary,
+    kVia,
+    kXOriginalContentLength,
+    kNotAKeyword
+  };
+
+  // Limited iterator (not an STL iterator).  Example usage:
+  //    for (HttpHeaderName::Iterator iter; !iter.AtEnd(); iter.Next()) {
+  //      use(iter.keyword(), iter.name());
+  //    }
+  class Iterator {
+   public:
+    Iterator() : index_(-1) { Next(); }
+    bool AtEnd() const;
+    void Next();
+    Keyword keyword() const;
+    const char* name() const;
+
+   private:
+    int index_;
+
+    // Implicit copy and assign ok.  The members can be safely copied by bits.
+  };
+
+  static int num_keywords();
+  static Keyword Lookup(const StringPiece& name);
+
+ private:
+  HttpHeaderName();  // Not instantiable.
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTTP_HTTP_HEADER_NAME_H_
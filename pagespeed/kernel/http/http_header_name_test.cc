@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test HttpHeaderName, make sure the gperf table agrees with the
+// header names in http_names.h and that matching is case insensitive.
+
+#include "pagespeed/kernel/http/http_header_name.h"
+
+#include <set>
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/http_names.h"
+
+namespace net_instaweb {
+
+class HttpHeaderNameTest : public testing::Test {
+ protected:
+};
+
+TEST_F(HttpHeaderNameTest, MatchesHttpAttributes) {
+  EXPECT_EQ(HttpHeaderName::kAccept,
+            HttpHeaderName::Lookup(HttpAttributes::kAccept));
+  EXPECT_EQ(HttpHeaderName::kAcceptEncoding,
+            HttpHeaderName::Lookup(HttpAttributes::kAcceptEncoding));
+  EXPECT_EQ(HttpHeaderName::kCacheControl,
+            HttpHeaderName::Lookup(HttpAttributes::kCacheControl));
+  EXPECT_EQ(HttpHeaderName::kContentType,
+            HttpHeaderName::Lookup(HttpAttributes::kContentType));
+  EXPECT_EQ(HttpHeaderName::kEtag,
+            HttpHeaderName::Lookup(HttpAttributes::kEtag));
+  EXPECT_EQ(HttpHeaderName::kSetCookie,
+            HttpHeaderName::Lookup(HttpAttributes::kSetCookie));
+  EXPECT_EQ(HttpHeaderName::kSetCookie2,
+            HttpHeaderName::Lookup(HttpAttributes::kSetCookie2));
+  EXPECT_EQ(HttpHeaderName::kVary,
+            HttpHeaderName::Lookup(HttpAttributes::kVary));
+  EXPECT_EQ(HttpHeaderName::kXOriginalContentLength,
+            HttpHeaderName::Lookup(HttpAttributes::kXOriginalContentLength));
+}
+
+TEST_F(HttpHeaderNameTest, AllKeywordsUpperCase) {
+  for (HttpHeaderName::Iterator iter; !iter.AtEnd(); iter.Next()) {
+    EXPECT_EQ(iter.keyword(), HttpHeaderName::Lookup(iter.name()));
+    GoogleString upper(iter.name());
+    UpperString(&upper);
+    EXPECT_EQ(iter.keyword(), HttpHeaderName::Lookup(upper));
+  }
+}
+
+TEST_F(HttpHeaderNameTest, Bogus) {
+  EXPECT_EQ(HttpHeaderName::kNotAKeyword,
+            HttpHeaderName::Lookup(HttpAttributes::kXForwardedFor));
+  EXPECT_EQ(HttpHeaderName::kNotAKeyword, HttpHeaderName::Lookup("Dat"));
+  EXPECT_EQ(HttpHeaderName::kNotAKeyword, HttpHeaderName::Lookup("Dates"));
+  EXPECT_EQ(HttpHeaderName::kNotAKeyword, HttpHeaderName::Lookup(""));
+}
+
+TEST_F(HttpHeaderNameTest, Iterator) {
+  int num_iters = 0;
+  StringSet names;
+  std::set<HttpHeaderName::Keyword> keywords;
+  for (HttpHeaderName::Iterator iter; !iter.AtEnd(); iter.Next()) {
+    EXPECT_GT(HttpHeaderName::num_keywords(),
+              static_cast<int>(iter.keyword()));
+    keywords.insert(iter.keyword());
+    names.insert(iter.name());
+    ++num_iters;
+  }
+  EXPECT_EQ(HttpHeaderName::kNotAKeyword, num_iters);
+  EXPECT_EQ(HttpHeaderName::num_keywords(), num_iters);
+  EXPECT_EQ(HttpHeaderName::num_keywords(), keywords.size());
+  EXPECT_EQ(HttpHeaderName::num_keywords(), names.size());
+}
+
+}  // namespace net_instaweb
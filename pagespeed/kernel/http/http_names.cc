@@ -47,6 +47,7 @@ const char HttpAttributes::kContentDisposition[] = "Content-Disposition";
 const char HttpAttributes::kContentEncoding[] = "Content-Encoding";
 const char HttpAttributes::kContentLanguage[] = "Content-Language";
 const char HttpAttributes::kContentLength[] = "Content-Length";
+const char HttpAttributes::kContentRange[] = "Content-Range";
 const char HttpAttributes::kContentSecurityPolicy[] = "Content-Security-Policy";
 const char HttpAttributes::kContentType[] = "Content-Type";
 const char HttpAttributes::kCookie[] = "Cookie";
@@ -60,6 +61,7 @@ const char HttpAttributes::kGzip[] = "gzip";
 const char HttpAttributes::kHost[] = "Host";
 const char HttpAttributes::kIfModifiedSince[] = "If-Modified-Since";
 const char HttpAttributes::kIfNoneMatch[] = "If-None-Match";
+const char HttpAttributes::kIfRange[] = "If-Range";
 const char HttpAttributes::kKeepAlive[] = "Keep-Alive";
 const char HttpAttributes::kLastModified[] = "Last-Modified";
 const char HttpAttributes::kLink[] = "Link";
@@ -76,6 +78,7 @@ const char HttpAttributes::kProxyAuthenticate[] = "Proxy-Authenticate";
 const char HttpAttributes::kProxyAuthorization[] = "Proxy-Authorization";
 const char HttpAttributes::kPublic[] = "public";
 const char HttpAttributes::kPurpose[] = "Purpose";
+const char HttpAttributes::kRange[] = "Range";
 const char HttpAttributes::kReferer[] = "Referer";  // sic
 const char HttpAttributes::kRefresh[] = "Refresh";
 const char HttpAttributes::kSaveData[] = "Save-Data";
@@ -49,6 +49,7 @@ struct HttpAttributes {
   static const char kContentDisposition[];
   static const char kContentLanguage[];
   static const char kContentLength[];
+  static const char kContentRange[];
   static const char kContentSecurityPolicy[];
   static const char kContentType[];
   static const char kCookie[];
@@ -62,6 +63,7 @@ struct HttpAttributes {
   static const char kHost[];
   static const char kIfModifiedSince[];
   static const char kIfNoneMatch[];
+  static const char kIfRange[];
   static const char kKeepAlive[];
   static const char kLastModified[];
   static const char kLink[];
@@ -78,6 +80,7 @@ struct HttpAttributes {
   static const char kProxyAuthorization[];
   static const char kPublic[];
   static const char kPurpose[];
+  static const char kRange[];
   static const char kReferer[];  // sic
   static const char kRefresh[];
   static const char kSaveData[];
@@ -142,7 +142,7 @@ bool RequestHeaders::WriteAsHttp(
 
 bool RequestHeaders::AcceptsGzip() const {
   ConstStringStarVector v;
-  if (Lookup(HttpAttributes::kAcceptEncoding, &v)) {
+  if (Lookup(HttpHeaderName::kAcceptEncoding, &v)) {
     for (int i = 0, nv = v.size(); i < nv; ++i) {
       StringPieceVector encodings;
       SplitStringPieceToVector(*(v[i]), ",", &encodings, true);
@@ -178,9 +178,9 @@ RequestHeaders::GetAllCookies() const {
 }
 
 RequestHeaders::Properties RequestHeaders::GetProperties() const {
-  Properties properties(Has(HttpAttributes::kCookie),
-                        Has(HttpAttributes::kCookie2),
-                        Has(HttpAttributes::kAuthorization));
+  Properties properties(Has(HttpHeaderName::kCookie),
+                        Has(HttpHeaderName::kCookie2),
+                        Has(HttpHeaderName::kAuthorization));
   return properties;
 }
 
@@ -200,6 +200,8 @@ void ResponseHeaders::FixDateHeaders(int64 now_ms) {
 void ResponseHeaders::CopyFrom(const ResponseHeaders& other) {
   Headers<HttpResponseHeaders>::Clear();
   Headers<HttpResponseHeaders>::CopyProto(*other.proto());
+  ClearParsedHeaders();
+  ClearWireHeaders();
   cache_fields_dirty_ = other.cache_fields_dirty_;
   force_cache_ttl_ms_ = other.force_cache_ttl_ms_;
   force_cached_ = other.force_cached_;
@@ -220,6 +222,8 @@ void ResponseHeaders::Clear() {
   proto->clear_reason_phrase();
   proto->clear_header();
   proto->clear_is_implicitly_cacheable();
+  ClearParsedHeaders();
+  ClearWireHeaders();
   cache_fields_dirty_ = false;
   force_cache_ttl_ms_ = -1;
   force_cached_ = false;
@@ -340,7 +344,7 @@ bool ResponseHeaders::MergeContentType(const StringPiece& content_type) {
 
   bool ret = false;
   ConstStringStarVector old_values;
-  Lookup(HttpAttributes::kContentType, &old_values);
+  Lookup(HttpHeaderName::kContentType, &old_values);
   // If there aren't any content-type headers, we can just add this one.
   // If there is exactly one content-type header, then try to merge it
   // with what we were passed.
@@ -367,6 +371,7 @@ void ResponseHeaders::UpdateFromProto(const HttpResponseHeaders& proto) {
   Clear();
   cache_fields_dirty_ = true;
   Headers<HttpResponseHeaders>::CopyProto(proto);
+  ClearWireHeaders();
 }
 
 bool ResponseHeaders::WriteAsBinary(Writer* writer, MessageHandler* handler) {
@@ -379,7 +384,9 @@ bool ResponseHeaders::WriteAsBinary(Writer* writer, MessageHandler* handler) {
 bool ResponseHeaders::ReadFromBinary(const StringPiece& buf,
                                      MessageHandler* message_handler) {
   cache_fields_dirty_ = false;
-  return Headers<HttpResponseHeaders>::ReadFromBinary(buf, message_handler);
+  bool ret = Headers<HttpResponseHeaders>::ReadFromBinary(buf, message_handler);
+  ClearWireHeaders();
+  return ret;
 }
 
 // Serialize meta-data to a binary stream.
@@ -392,10 +399,21 @@ bool ResponseHeaders::WriteAsHttp(Writer* writer, MessageHandler* handler)
   ret &= writer->Write(buf, handler);
   ret &= writer->Write(reason_phrase(), handler);
   ret &= writer->Write("\r\n", handler);
-  ret &= Headers<HttpResponseHeaders>::WriteAsHttp(writer, handler);
+  RenderWireHeaders();
+  ret &= writer->Write(wire_headers_, handler);
+  ret &= writer->Write("\r\n", handler);
   return ret;
 }
 
+void ResponseHeaders::RenderWireHeaders() const {
+  int num_attributes = NumAttributes();
+  for (int i = wire_attributes_; i < num_attributes; ++i) {
+    StrAppend(&wire_headers_, Name(i), ": ", Value(i), "\r\n");
+  }
+  wire_attributes_ = num_attributes;
+  wire_seen_attributes_ = num_attributes;
+}
+
 // Specific information about cache.  This is all embodied in the
 // headers but is centrally parsed so we can try to get it right.
 bool ResponseHeaders::IsBrowserCacheable() const {
@@ -436,12 +454,12 @@ bool ResponseHeaders::IsProxyCacheable(
   // See RFC2616, 14.8
   // (http://www.w3.org/Protocols/rfc2616/rfc2616-sec14.html#sec14.8)
   if (req_properties.has_authorization &&
-      !HasValue(HttpAttributes::kCacheControl, "public")) {
+      !HasCacheControlDirective(kCacheControlPublic)) {
     return false;
   }
 
   ConstStringStarVector values;
-  Lookup(HttpAttributes::kVary, &values);
+  Lookup(HttpHeaderName::kVary, &values);
   bool is_html_like = IsHtmlLike();
   for (int i = 0, n = values.size(); i < n; ++i) {
     StringPiece val(*values[i]);
@@ -493,7 +511,7 @@ void ResponseHeaders::SetDateAndCaching(
 
 void ResponseHeaders::SetCacheControlPublic() {
   ConstStringStarVector values;
-  if (Lookup(HttpAttributes::kCacheControl, &values)) {
+  if (Lookup(HttpHeaderName::kCacheControl, &values)) {
     for (int i = 0, n = values.size(); i < n; ++i) {
       StringPiece val = *(values[i]);
       if (StringCaseEqual(val, "private") ||
@@ -540,7 +558,7 @@ void ResponseHeaders::SetContentLength(int64 content_length) {
 void ResponseHeaders::SetOriginalContentLength(int64 content_length) {
   // This does not impact caching headers, so avoid ComputeCaching()
   // by restoring cache_fields_dirty_ after we set the header.
-  if (!Has(HttpAttributes::kXOriginalContentLength)) {
+  if (!Has(HttpHeaderName::kXOriginalContentLength)) {
     bool dirty = cache_fields_dirty_;
     Add(HttpAttributes::kXOriginalContentLength,
         Integer64ToString(content_length));
@@ -553,7 +571,7 @@ bool ResponseHeaders::Sanitize() {
   bool changed = false;
 
   // Sanitize any fields marked as hop-by-hop via the Connection: header
-  if (Lookup(HttpAttributes::kConnection, &v)) {
+  if (Lookup(HttpHeaderName::kConnection, &v)) {
     for (int i = 0, n = v.size(); i < n; ++i) {
       StringPiece val = *v[i];
       if (!IsHopByHopIndication(val)) {
@@ -796,7 +814,7 @@ void ResponseHeaders::ComputeCaching() {
     // caching of user sensitive data due to misconfigured caching headers.
     if (((type != NULL && type->IsHtmlLike()) ||
          computer.IsRedirectStatusCode()) &&
-        (Has(HttpAttributes::kSetCookie) || Has(HttpAttributes::kSetCookie2))) {
+        (Has(HttpHeaderName::kSetCookie) || Has(HttpHeaderName::kSetCookie2))) {
       proto->set_proxy_cacheable(false);
     }
 
@@ -820,15 +838,15 @@ void ResponseHeaders::ComputeCaching() {
 
 GoogleString ResponseHeaders::CacheControlValuesToPreserve() {
   GoogleString to_preserve;
-  if (HasValue(HttpAttributes::kCacheControl, "no-transform")) {
+  if (HasCacheControlDirective(kCacheControlNoTransform)) {
     to_preserve = ", no-transform";
   }
-  if (HasValue(HttpAttributes::kCacheControl, "no-store")) {
+  if (HasCacheControlDirective(kCacheControlNoStore)) {
     to_preserve += ", no-store";
   }
 
   ConstStringStarVector cc_values;
-  Lookup(HttpAttributes::kCacheControl, &cc_values);
+  Lookup(HttpHeaderName::kCacheControl, &cc_values);
   for (auto value : cc_values) {
     if (StringCaseStartsWith(*value, "s-maxage=")) {
       to_preserve += ", " + *value;
@@ -859,7 +877,7 @@ bool ResponseHeaders::ParseTime(const char* time_str, int64* time_ms) {
 // See Section 3.5
 bool ResponseHeaders::IsGzipped() const {
   ConstStringStarVector v;
-  bool found = Lookup(HttpAttributes::kContentEncoding, &v);
+  bool found = Lookup(HttpHeaderName::kContentEncoding, &v);
   if (found) {
     for (int i = 0, n = v.size(); i < n; ++i) {
       if ((v[i] != NULL) && StringCaseEqual(*v[i], HttpAttributes::kGzip)) {
@@ -872,7 +890,7 @@ bool ResponseHeaders::IsGzipped() const {
 
 bool ResponseHeaders::WasGzippedLast() const {
   ConstStringStarVector v;
-  bool found = Lookup(HttpAttributes::kContentEncoding, &v);
+  bool found = Lookup(HttpHeaderName::kContentEncoding, &v);
   if (found) {
     int index = v.size() - 1;
     if ((index > -1) && (v[index] != NULL) &&
@@ -887,34 +905,66 @@ bool ResponseHeaders::WasGzippedLast() const {
 // guess Content-Type as well. See Resource::DetermineContentType().
 void ResponseHeaders::DetermineContentTypeAndCharset(
     const ContentType** content_type_out, GoogleString* charset_out) const {
-  ConstStringStarVector content_types;
-
+  ParseContentTypeIfNeeded();
   if (content_type_out != NULL) {
-    *content_type_out = NULL;
+    *content_type_out = content_type_;
   }
-
   if (charset_out != NULL) {
-    charset_out->clear();
+    *charset_out = charset_;
   }
+}
+
+void ResponseHeaders::ParseContentTypeIfNeeded() const {
+  if (content_type_parsed_) {
+    return;
+  }
+  content_type_parsed_ = true;
+  content_type_ = NULL;
+  charset_.clear();
 
   // If there is more than one content-type header, we pick the LAST one,
   // (even if it's invalid!) as that's the behavior specified by the mime
   // sniffing spec (http://mimesniff.spec.whatwg.org/). We also use the
   // charset that comes with the same header.
-  if (Lookup(HttpAttributes::kContentType, &content_types) &&
+  ConstStringStarVector content_types;
+  if (Lookup(HttpHeaderName::kContentType, &content_types) &&
       !content_types.empty()) {
-    GoogleString mime_type, charset;
-    if (!ParseContentType(*content_types.back(), &mime_type, &charset)) {
+    GoogleString mime_type;
+    if (!ParseContentType(*content_types.back(), &mime_type, &charset_)) {
       mime_type.clear();
-      charset.clear();
+      charset_.clear();
     }
+    content_type_ = MimeTypeToContentType(mime_type);
+  }
+}
 
-    if (content_type_out != NULL) {
-      *content_type_out = MimeTypeToContentType(mime_type);
-    }
+bool ResponseHeaders::HasCacheControlDirective(
+    CacheControlDirective directive) const {
+  ParseCacheControlIfNeeded();
+  return (cache_control_directives_ & directive) != 0;
+}
 
-    if (charset_out != NULL) {
-      *charset_out = charset;
+void ResponseHeaders::ParseCacheControlIfNeeded() const {
+  if (cache_control_parsed_) {
+    return;
+  }
+  cache_control_parsed_ = true;
+  cache_control_directives_ = 0;
+
+  ConstStringStarVector values;
+  Lookup(HttpHeaderName::kCacheControl, &values);
+  for (int i = 0, n = values.size(); i < n; ++i) {
+    const GoogleString& value = *values[i];
+    if (value == "no-cache") {
+      cache_control_directives_ |= kCacheControlNoCache;
+    } else if (value == "no-store") {
+      cache_control_directives_ |= kCacheControlNoStore;
+    } else if (value == "no-transform") {
+      cache_control_directives_ |= kCacheControlNoTransform;
+    } else if (value == "private") {
+      cache_control_directives_ |= kCacheControlPrivate;
+    } else if (value == "public") {
+      cache_control_directives_ |= kCacheControlPublic;
     }
   }
 }
@@ -974,7 +1024,7 @@ void ResponseHeaders::SetCacheControlMaxAge(int64 ttl_ms) {
   SetTimeHeader(HttpAttributes::kExpires, date_ms() + ttl_ms);
 
   ConstStringStarVector values;
-  Lookup(HttpAttributes::kCacheControl, &values);
+  Lookup(HttpHeaderName::kCacheControl, &values);
 
   GoogleString new_cache_control_value =
       StrCat("max-age=", Integer64ToString(ttl_ms / Timer::kSecondMs));
@@ -1020,7 +1070,7 @@ void ResponseHeaders::DebugPrint() const {
 }
 
 bool ResponseHeaders::FindContentLength(int64* content_length) const {
-  const char* val = Lookup1(HttpAttributes::kContentLength);
+  const char* val = Lookup1(HttpHeaderName::kContentLength);
   return (val != NULL) && StringToInt64(val, content_length);
 }
 
@@ -1071,7 +1121,7 @@ bool ResponseHeaders::GetCookieString(GoogleString* cookie_str) const {
   // because we are interested in the raw header lines not the parsed results.
   cookie_str->clear();
   ConstStringStarVector cookies;
-  if (!Lookup(HttpAttributes::kSetCookie, &cookies)) {
+  if (!Lookup(HttpHeaderName::kSetCookie, &cookies)) {
     return false;
   }
 
@@ -1110,7 +1160,7 @@ bool ResponseHeaders::HasCookie(StringPiece name,
 bool ResponseHeaders::HasAnyCookiesWithAttribute(StringPiece attribute_name,
                                                  StringPiece* attribute_value) {
   ConstStringStarVector cookies;
-  if (Lookup(HttpAttributes::kSetCookie, &cookies)) {
+  if (Lookup(HttpHeaderName::kSetCookie, &cookies)) {
     // Iterate through the cookies.
     for (int i = 0, n = cookies.size(); i < n; ++i) {
       StringPieceVector name_value_pairs;
@@ -1202,6 +1252,30 @@ bool ResponseHeaders::ClearOptionCookies(
 
 void ResponseHeaders::UpdateHook() {
   cache_fields_dirty_ = true;
+  ClearParsedHeaders();
+
+  // A mutation that grew the header list by one was an Add, which leaves
+  // the lines we have already rendered intact.  Anything else may have
+  // edited, removed or reordered them.
+  int num_attributes = NumAttributes();
+  if (num_attributes != wire_seen_attributes_ + 1) {
+    ClearWireHeaders();
+  }
+  wire_seen_attributes_ = num_attributes;
+}
+
+void ResponseHeaders::ClearWireHeaders() {
+  wire_headers_.clear();
+  wire_attributes_ = 0;
+  wire_seen_attributes_ = -1;
+}
+
+void ResponseHeaders::ClearParsedHeaders() {
+  content_type_parsed_ = false;
+  content_type_ = NULL;
+  charset_.clear();
+  cache_control_parsed_ = false;
+  cache_control_directives_ = 0;
 }
 
 GoogleString ResponseHeaders::RelCanonicalHeaderValue(StringPiece url) {
@@ -1210,7 +1284,7 @@ GoogleString ResponseHeaders::RelCanonicalHeaderValue(StringPiece url) {
 
 bool ResponseHeaders::HasLinkRelCanonical() const {
   ConstStringStarVector links;
-  Lookup(HttpAttributes::kLink, &links);
+  Lookup(HttpHeaderName::kLink, &links);
   for (int i = 0, n = links.size(); i < n; ++i) {
     StringPiece cand(*links[i]);
     stringpiece_ssize_type rel_pos = cand.find("rel");
@@ -1229,7 +1303,7 @@ void ResponseHeaders::SetSMaxAge(int s_maxage_sec) {
 
   ConstStringStarVector values;
   GoogleString existing_cache_control = "";
-  if (Lookup(HttpAttributes::kCacheControl, &values)) {
+  if (Lookup(HttpHeaderName::kCacheControl, &values)) {
     // TODO(jefftk): since we've done the work to split it into a vector, it's
     // inefficient to be joining it back to a string to give to ApplySMaxAge
     // which will split to a vector.
@@ -44,6 +44,16 @@ class ResponseHeaders : public Headers<HttpResponseHeaders> {
   enum VaryOption { kRespectVaryOnResources, kIgnoreVaryOnResources };
   enum ValidatorOption { kHasValidator, kNoValidator };
 
+  // Cache-Control directives consulted often enough that we parse the
+  // header once rather than on every query.  See HasCacheControlDirective.
+  enum CacheControlDirective {
+    kCacheControlNoCache = 1 << 0,
+    kCacheControlNoStore = 1 << 1,
+    kCacheControlNoTransform = 1 << 2,
+    kCacheControlPrivate = 1 << 3,
+    kCacheControlPublic = 1 << 4
+  };
+
   // This constructor with options explicitly set should be used by all callers.
   explicit ResponseHeaders(const HttpOptions& options) { Init(options); }
 
@@ -104,6 +114,11 @@ class ResponseHeaders : public Headers<HttpResponseHeaders> {
   virtual bool ReadFromBinary(const StringPiece& buf, MessageHandler* handler);
 
   // Serialize HTTP response header in HTTP format so it can be re-parsed.
+  //
+  // The header lines are rendered once and kept, so serializing the same
+  // headers again costs a single Write of the retained block; headers added
+  // since the last call are rendered onto the end of it.  Like Lookup(), this
+  // is const but not thread-safe.
   virtual bool WriteAsHttp(Writer* writer, MessageHandler* handler) const;
 
   // Compute caching information.  The current time is used to compute
@@ -177,6 +192,12 @@ class ResponseHeaders : public Headers<HttpResponseHeaders> {
   // and returns no-transform and no-store if found.
   GoogleString CacheControlValuesToPreserve();
 
+  // Returns true if one of the Cache-Control values is exactly the given
+  // directive, as with HasValue(HttpAttributes::kCacheControl, "no-store").
+  // The header is parsed once and re-parsed only after a mutation, so this
+  // is cheap to call repeatedly.  Same constness warnings as for Lookup().
+  bool HasCacheControlDirective(CacheControlDirective directive) const;
+
   // Set a time-based header, converting ms since epoch to a string.
   void SetTimeHeader(const StringPiece& header, int64 time_ms);
   void SetDate(int64 date_ms) { SetTimeHeader(HttpAttributes::kDate, date_ms); }
@@ -411,9 +432,41 @@ class ResponseHeaders : public Headers<HttpResponseHeaders> {
   // Returns true if the headers were changed.
   bool CombineContentTypes(const StringPiece& orig, const StringPiece& fresh);
 
+  // Discards the parsed Content-Type and Cache-Control values below, so
+  // that they will be recomputed on next use.
+  void ClearParsedHeaders();
+
+  // Renders any headers not yet in wire_headers_ onto its end.
+  void RenderWireHeaders() const;
+
+  // Discards wire_headers_, so that it will be re-rendered from scratch.
+  void ClearWireHeaders();
+
+  // Fills in the parsed values if they were discarded.
+  void ParseContentTypeIfNeeded() const;
+  void ParseCacheControlIfNeeded() const;
+
   friend class ResponseHeadersTest;
   bool cache_fields_dirty_;
 
+  // Values derived from the Content-Type and Cache-Control headers, which
+  // many callers consult for the same response.  They are computed lazily
+  // and discarded by UpdateHook() on every mutation.
+  mutable bool content_type_parsed_;
+  mutable const ContentType* content_type_;
+  mutable GoogleString charset_;
+  mutable bool cache_control_parsed_;
+  mutable int cache_control_directives_;  // Bitmask of CacheControlDirective.
+
+  // "Name: value\r\n" lines for the first wire_attributes_ headers, as
+  // written by WriteAsHttp.  Headers<>::Add only appends to the header list,
+  // so UpdateHook keeps the block when a mutation grew the list by exactly
+  // one entry, and discards it otherwise.  wire_seen_attributes_ is
+  // NumAttributes() as of the last mutation or render, or -1 if unknown.
+  mutable GoogleString wire_headers_;
+  mutable int wire_attributes_;
+  mutable int wire_seen_attributes_;
+
   // TODO(sligocki): Make this const.
   HttpOptions http_options_;
 
@@ -38,6 +38,7 @@
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http.pb.h"
+#include "pagespeed/kernel/http/http_header_name.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/response_headers_parser.h"
@@ -912,6 +913,131 @@ TEST_F(ResponseHeadersTest, TestRemoveIfNotIn) {
       response_headers_.ToString());
 }
 
+TEST_F(ResponseHeadersTest, TestKeywordLookupTracksMutations) {
+  ParseHeaders(StrCat("HTTP/1.0 200 OK\r\n"
+                      "Date: ", start_time_string_, "\r\n"
+                      "cache-control: max-age=100, private\r\n"
+                      "Set-Cookie: UA=chrome\r\n"
+                      "X-Custom: 1\r\n"
+                      "\r\n"));
+  ConstStringStarVector vs;
+  ASSERT_TRUE(response_headers_.Lookup(HttpHeaderName::kCacheControl, &vs));
+  ASSERT_EQ(2, vs.size());
+  EXPECT_EQ("max-age=100", *vs[0]);
+  EXPECT_EQ("private", *vs[1]);
+  EXPECT_STREQ("UA=chrome",
+               response_headers_.Lookup1(HttpHeaderName::kSetCookie));
+  EXPECT_TRUE(response_headers_.HasValue(HttpHeaderName::kCacheControl,
+                                         "private"));
+  EXPECT_FALSE(response_headers_.Has(HttpHeaderName::kVary));
+
+  // Additions, removals and in-place edits are all reflected in the
+  // keyword slots.
+  response_headers_.Add(HttpAttributes::kVary, "Accept-Encoding");
+  EXPECT_TRUE(response_headers_.Has(HttpHeaderName::kVary));
+  response_headers_.Add(HttpAttributes::kSetCookie, "LA=1");
+  EXPECT_TRUE(response_headers_.Lookup1(HttpHeaderName::kSetCookie) == NULL);
+  ASSERT_TRUE(response_headers_.Lookup(HttpHeaderName::kSetCookie, &vs));
+  EXPECT_EQ(2, vs.size());
+  EXPECT_TRUE(response_headers_.RemoveAll(HttpAttributes::kSetCookie));
+  EXPECT_FALSE(response_headers_.Has(HttpHeaderName::kSetCookie));
+  EXPECT_TRUE(response_headers_.RemoveAllWithPrefix("Cache-"));
+  EXPECT_FALSE(response_headers_.Has(HttpHeaderName::kCacheControl));
+  EXPECT_TRUE(response_headers_.Has(HttpHeaderName::kVary));
+  ASSERT_EQ(HttpAttributes::kVary, response_headers_.Name(2));
+  response_headers_.SetValue(2, "Cookie");
+  EXPECT_TRUE(response_headers_.HasValue(HttpHeaderName::kVary, "Cookie"));
+  EXPECT_FALSE(response_headers_.HasValue(HttpHeaderName::kVary,
+                                          "Accept-Encoding"));
+}
+
+TEST_F(ResponseHeadersTest, TestParsedHeadersTrackMutations) {
+  response_headers_.Add(HttpAttributes::kContentType,
+                        "text/html; charset=UTF-8");
+  response_headers_.Add(HttpAttributes::kCacheControl, "no-transform");
+  EXPECT_EQ(&kContentTypeHtml, response_headers_.DetermineContentType());
+  EXPECT_EQ("UTF-8", response_headers_.DetermineCharset());
+  EXPECT_TRUE(response_headers_.HasCacheControlDirective(
+      ResponseHeaders::kCacheControlNoTransform));
+  EXPECT_FALSE(response_headers_.HasCacheControlDirective(
+      ResponseHeaders::kCacheControlNoStore));
+
+  response_headers_.Replace(HttpAttributes::kContentType, "text/css");
+  EXPECT_EQ(&kContentTypeCss, response_headers_.DetermineContentType());
+  EXPECT_EQ("", response_headers_.DetermineCharset());
+
+  response_headers_.Add(HttpAttributes::kCacheControl, "no-store, public");
+  EXPECT_TRUE(response_headers_.HasCacheControlDirective(
+      ResponseHeaders::kCacheControlNoStore));
+  EXPECT_TRUE(response_headers_.HasCacheControlDirective(
+      ResponseHeaders::kCacheControlPublic));
+  EXPECT_EQ(", no-transform, no-store",
+            response_headers_.CacheControlValuesToPreserve());
+
+  // Copies get their own parse, and Clear discards everything.
+  ResponseHeaders copy(response_headers_);
+  response_headers_.Clear();
+  EXPECT_TRUE(response_headers_.DetermineContentType() == NULL);
+  EXPECT_FALSE(response_headers_.HasCacheControlDirective(
+      ResponseHeaders::kCacheControlNoStore));
+  EXPECT_EQ(&kContentTypeCss, copy.DetermineContentType());
+  EXPECT_TRUE(copy.HasCacheControlDirective(
+      ResponseHeaders::kCacheControlPublic));
+}
+
+TEST_F(ResponseHeadersTest, TestWriteAsHttpTracksMutations) {
+  response_headers_.SetStatusAndReason(HttpStatus::kOK);
+  response_headers_.Add(HttpAttributes::kContentType, "text/css");
+  EXPECT_EQ("HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/css\r\n"
+            "\r\n",
+            response_headers_.ToString());
+
+  // Added headers are appended to what was already rendered.
+  response_headers_.Add(HttpAttributes::kVary, "Accept-Encoding");
+  response_headers_.Add(HttpAttributes::kCacheControl, "max-age=10");
+  EXPECT_EQ("HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/css\r\n"
+            "Vary: Accept-Encoding\r\n"
+            "Cache-Control: max-age=10\r\n"
+            "\r\n",
+            response_headers_.ToString());
+
+  // Edits and removals of rendered headers are reflected.
+  response_headers_.SetValue(0, "text/html");
+  response_headers_.RemoveAll(HttpAttributes::kVary);
+  response_headers_.set_major_version(1);
+  response_headers_.set_minor_version(1);
+  EXPECT_EQ("HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/html\r\n"
+            "Cache-Control: max-age=10\r\n"
+            "\r\n",
+            response_headers_.ToString());
+  response_headers_.Replace(HttpAttributes::kContentType, "image/png");
+  EXPECT_EQ("HTTP/1.1 200 OK\r\n"
+            "Cache-Control: max-age=10\r\n"
+            "Content-Type: image/png\r\n"
+            "\r\n",
+            response_headers_.ToString());
+
+  // Copies and clears start over.
+  ResponseHeaders copy(response_headers_);
+  copy.Add(HttpAttributes::kEtag, "W/0");
+  response_headers_.Clear();
+  response_headers_.SetStatusAndReason(HttpStatus::kNotFound);
+  response_headers_.Add(HttpAttributes::kContentType, "text/plain");
+  EXPECT_EQ("HTTP/1.0 404 Not Found\r\n"
+            "Content-Type: text/plain\r\n"
+            "\r\n",
+            response_headers_.ToString());
+  EXPECT_EQ("HTTP/1.1 200 OK\r\n"
+            "Cache-Control: max-age=10\r\n"
+            "Content-Type: image/png\r\n"
+            "Etag: W/0\r\n"
+            "\r\n",
+            copy.ToString());
+}
+
 TEST_F(ResponseHeadersTest, TestReasonPhrase) {
   response_headers_.SetStatusAndReason(HttpStatus::kOK);
   EXPECT_EQ(HttpStatus::kOK, response_headers_.status_code());
@@ -0,0 +1,190 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include "pagespeed/kernel/image/codec_pool.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace pagespeed {
+
+namespace image_compression {
+
+namespace {
+
+// Each buffer is preceded by a header recording its size class, padded so
+// the caller's pointer keeps malloc's alignment.
+const size_t kHeaderSize = 16;
+const int kUnpooled = -1;
+
+// Classes run from kMinPooledSize to kMaxPooledSize in steps of a quarter
+// of a power of two: 4KB, 5KB, 6KB, 7KB, 8KB, 10KB, ... 16MB.
+const int kMinClassBits = 12;  // log2(ScratchPool::kMinPooledSize)
+const int kMaxClassBits = 24;  // log2(ScratchPool::kMaxPooledSize)
+const int kStepsPerDoubling = 4;
+const int kNumClasses =
+    (kMaxClassBits - kMinClassBits) * kStepsPerDoubling + 1;
+
+// See ScratchPool::set_max_free_bytes.
+size_t free_bytes_limit = ScratchPool::kDefaultMaxFreeBytes;
+
+size_t ClassCapacity(int size_class) {
+  int doubling = size_class / kStepsPerDoubling;
+  int step = size_class % kStepsPerDoubling;
+  return ((ScratchPool::kMinPooledSize << doubling) / kStepsPerDoubling) *
+      (kStepsPerDoubling + step);
+}
+
+// Smallest class whose capacity is at least size, which must be in
+// [kMinPooledSize, kMaxPooledSize].
+int SizeClass(size_t size) {
+  int size_class = 0;
+  while (ClassCapacity(size_class + kStepsPerDoubling) < size) {
+    size_class += kStepsPerDoubling;
+  }
+  while (ClassCapacity(size_class) < size) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+void* Wrap(char* block, int size_class) {
+  if (block == NULL) {
+    return NULL;
+  }
+  *reinterpret_cast<int*>(block) = size_class;
+  return block + kHeaderSize;
+}
+
+class FreeLists {
+ public:
+  FreeLists() : free_bytes_(0), malloc_count_(0), reuse_count_(0) {
+    for (int i = 0; i < kNumClasses; ++i) {
+      num_free_[i] = 0;
+    }
+  }
+
+  ~FreeLists() {
+    Clear();
+  }
+
+  void* Allocate(size_t size) {
+    if (size < ScratchPool::kMinPooledSize) {
+      return Wrap(static_cast<char*>(malloc(size + kHeaderSize)), kUnpooled);
+    }
+    if (size > ScratchPool::kMaxPooledSize) {
+      if (size > SIZE_MAX - kHeaderSize) {
+        return NULL;
+      }
+      ++malloc_count_;
+      return Wrap(static_cast<char*>(malloc(size + kHeaderSize)), kUnpooled);
+    }
+    int size_class = SizeClass(size);
+    if (num_free_[size_class] > 0) {
+      ++reuse_count_;
+      free_bytes_ -= ClassCapacity(size_class);
+      return Wrap(free_[size_class][--num_free_[size_class]], size_class);
+    }
+    ++malloc_count_;
+    return Wrap(static_cast<char*>(
+        malloc(ClassCapacity(size_class) + kHeaderSize)), size_class);
+  }
+
+  void Free(void* buffer) {
+    char* block = static_cast<char*>(buffer) - kHeaderSize;
+    int size_class = *reinterpret_cast<int*>(block);
+    if (size_class != kUnpooled &&
+        num_free_[size_class] < ScratchPool::kMaxFreePerClass &&
+        free_bytes_ + ClassCapacity(size_class) <= free_bytes_limit) {
+      free_[size_class][num_free_[size_class]++] = block;
+      free_bytes_ += ClassCapacity(size_class);
+    } else {
+      free(block);
+    }
+  }
+
+  void Clear() {
+    for (int i = 0; i < kNumClasses; ++i) {
+      while (num_free_[i] > 0) {
+        free(free_[i][--num_free_[i]]);
+      }
+    }
+    free_bytes_ = 0;
+  }
+
+  int64 malloc_count() const { return malloc_count_; }
+  int64 reuse_count() const { return reuse_count_; }
+
+ private:
+  char* free_[kNumClasses][ScratchPool::kMaxFreePerClass];
+  int num_free_[kNumClasses];
+  size_t free_bytes_;
+  int64 malloc_count_;
+  int64 reuse_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(FreeLists);
+};
+
+FreeLists* ThreadFreeLists() {
+  static thread_local FreeLists free_lists;
+  return &free_lists;
+}
+
+}  // namespace
+
+const size_t ScratchPool::kMinPooledSize;
+const size_t ScratchPool::kMaxPooledSize;
+const int ScratchPool::kMaxFreePerClass;
+const size_t ScratchPool::kDefaultMaxFreeBytes;
+
+void* ScratchPool::Allocate(size_t size) {
+  return ThreadFreeLists()->Allocate(size);
+}
+
+void ScratchPool::Free(void* buffer) {
+  if (buffer != NULL) {
+    ThreadFreeLists()->Free(buffer);
+  }
+}
+
+int64 ScratchPool::malloc_count() {
+  return ThreadFreeLists()->malloc_count();
+}
+
+int64 ScratchPool::reuse_count() {
+  return ThreadFreeLists()->reuse_count();
+}
+
+void ScratchPool::Clear() {
+  ThreadFreeLists()->Clear();
+}
+
+void ScratchPool::set_max_free_bytes(size_t bytes) {
+  free_bytes_limit = bytes;
+}
+
+size_t ScratchPool::max_free_bytes() {
+  return free_bytes_limit;
+}
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
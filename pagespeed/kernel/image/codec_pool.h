@@ -0,0 +1,176 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#ifndef PAGESPEED_KERNEL_IMAGE_CODEC_POOL_H_
+#define PAGESPEED_KERNEL_IMAGE_CODEC_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace pagespeed {
+
+namespace image_compression {
+
+// Recycles the large buffers that the image codecs allocate and free for
+// every image they process: libpng's row and zlib buffers, the scanline
+// readers' and writers' row and whole-image buffers, and the resizer's
+// accumulators.  Freed buffers are kept on small per-thread free lists
+// bucketed by size, in steps of a quarter of a power of two so that a
+// request is rounded up by less than 25%.  A thread that keeps rewriting
+// images thus stops calling malloc for them once it has warmed up, and no
+// locking is needed.  A buffer may be freed on a different thread than the
+// one that allocated it; it then joins the freeing thread's lists.
+class ScratchPool {
+ public:
+  // Requests smaller than this go straight to malloc.
+  static const size_t kMinPooledSize = 4 * 1024;
+
+  // Requests larger than this go straight to malloc, so that one huge image
+  // doesn't leave a thread holding on to its buffers.
+  static const size_t kMaxPooledSize = 16 * 1024 * 1024;
+
+  // Limits on what each thread keeps around while idle.  The byte limit
+  // applies to every thread that rewrites images, so its default is small.
+  static const int kMaxFreePerClass = 4;
+  static const size_t kDefaultMaxFreeBytes = 4 * 1024 * 1024;
+
+  // Sets the number of bytes of idle buffers each thread may keep; 0
+  // disables pooling.  Must be called before threads start using the pool.
+  static void set_max_free_bytes(size_t bytes);
+  static size_t max_free_bytes();
+
+  // Returns a buffer of at least size bytes, aligned as malloc would align
+  // it, or NULL if memory is exhausted.  It must be released with Free.
+  static void* Allocate(size_t size);
+
+  // Releases a buffer returned by Allocate.  NULL is ignored.
+  static void Free(void* buffer);
+
+  // Counters for the calling thread: the number of Allocate calls of at
+  // least kMinPooledSize that had to go to malloc, and the number that were
+  // served from the free lists.
+  static int64 malloc_count();
+  static int64 reuse_count();
+
+  // Returns the calling thread's idle buffers to the system.
+  static void Clear();
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(ScratchPool);
+};
+
+// A scoped_array work-alike whose storage comes from ScratchPool.  The
+// elements are neither constructed nor destroyed, so T must be a plain type.
+template<class T>
+class ScratchArray {
+ public:
+  ScratchArray() : ptr_(NULL) {}
+  explicit ScratchArray(size_t count) : ptr_(NULL) { reset(count); }
+  ~ScratchArray() { ScratchPool::Free(ptr_); }
+
+  // Replaces the array with an uninitialized one of count elements.  get()
+  // is NULL afterwards if the allocation failed.
+  void reset(size_t count) {
+    ScratchPool::Free(ptr_);
+    ptr_ = NULL;
+    if (count <= SIZE_MAX / sizeof(T)) {
+      ptr_ = static_cast<T*>(ScratchPool::Allocate(count * sizeof(T)));
+    }
+  }
+
+  void reset() {
+    ScratchPool::Free(ptr_);
+    ptr_ = NULL;
+  }
+
+  T* get() const { return ptr_; }
+  T& operator[](size_t i) const { return ptr_[i]; }
+  bool operator==(const T* p) const { return ptr_ == p; }
+  bool operator!=(const T* p) const { return ptr_ != p; }
+
+ private:
+  T* ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScratchArray);
+};
+
+// Keeps a few idle codec contexts -- libjpeg (de)compress structs and the
+// like, whose setup allocates -- on each thread for reuse.  T must be
+// default-constructible, and a context must be back in a reusable state
+// when it is released.
+template<class T>
+class CodecContextPool {
+ public:
+  static const int kMaxIdle = 2;
+
+  // Returns an idle context released earlier on this thread, or a new one.
+  static T* Acquire() {
+    Idle* idle = GetIdle();
+    if (idle->count > 0) {
+      return idle->contexts[--idle->count];
+    }
+    return new T;
+  }
+
+  // Hands a context back for reuse on this thread, or deletes it if enough
+  // are idle already.  NULL is ignored.
+  static void Release(T* context) {
+    if (context == NULL) {
+      return;
+    }
+    Idle* idle = GetIdle();
+    if (idle->count < kMaxIdle) {
+      idle->contexts[idle->count++] = context;
+    } else {
+      delete context;
+    }
+  }
+
+ private:
+  struct Idle {
+    Idle() : count(0) {}
+    ~Idle() {
+      for (int i = 0; i < count; ++i) {
+        delete contexts[i];
+      }
+    }
+
+    T* contexts[kMaxIdle];
+    int count;
+  };
+
+  static Idle* GetIdle() {
+    static thread_local Idle idle;
+    return &idle;
+  }
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(CodecContextPool);
+};
+
+template<class T> const int CodecContextPool<T>::kMaxIdle;
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
+
+#endif  // PAGESPEED_KERNEL_IMAGE_CODEC_POOL_H_
@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+// Unit tests for ScratchPool, ScratchArray and CodecContextPool.
+
+#include "pagespeed/kernel/image/codec_pool.h"
+
+#include <cstring>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+
+namespace {
+
+using pagespeed::image_compression::CodecContextPool;
+using pagespeed::image_compression::ScratchArray;
+using pagespeed::image_compression::ScratchPool;
+
+class CountedContext {
+ public:
+  CountedContext() { ++num_live; }
+  ~CountedContext() { --num_live; }
+
+  static int num_live;
+};
+
+int CountedContext::num_live = 0;
+
+class CodecPoolTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    ScratchPool::Clear();
+    malloc_count_ = ScratchPool::malloc_count();
+    reuse_count_ = ScratchPool::reuse_count();
+  }
+
+  virtual void TearDown() {
+    ScratchPool::Clear();
+  }
+
+  int64 new_mallocs() const {
+    return ScratchPool::malloc_count() - malloc_count_;
+  }
+  int64 new_reuses() const {
+    return ScratchPool::reuse_count() - reuse_count_;
+  }
+
+ private:
+  int64 malloc_count_;
+  int64 reuse_count_;
+};
+
+TEST_F(CodecPoolTest, ReusesFreedBuffers) {
+  void* first = ScratchPool::Allocate(100 * 1000);
+  ASSERT_TRUE(first != NULL);
+  memset(first, 1, 100 * 1000);
+  ScratchPool::Free(first);
+  EXPECT_EQ(1, new_mallocs());
+  EXPECT_EQ(0, new_reuses());
+
+  // Any size in the same size class gets the same buffer back.
+  void* second = ScratchPool::Allocate(110 * 1000);
+  EXPECT_EQ(first, second);
+  memset(second, 2, 110 * 1000);
+  EXPECT_EQ(1, new_mallocs());
+  EXPECT_EQ(1, new_reuses());
+
+  // A second live buffer of that class must be freshly allocated.
+  void* third = ScratchPool::Allocate(100 * 1000);
+  EXPECT_NE(second, third);
+  EXPECT_EQ(2, new_mallocs());
+  ScratchPool::Free(second);
+  ScratchPool::Free(third);
+}
+
+TEST_F(CodecPoolTest, ClassesAreQuarterSteps) {
+  // 5KB + 1 is rounded up to the 6KB class, not to 8KB.
+  ScratchPool::Free(ScratchPool::Allocate(5 * 1024 + 1));
+  ScratchPool::Free(ScratchPool::Allocate(6 * 1024 + 1));
+  EXPECT_EQ(2, new_mallocs());
+  void* buffer = ScratchPool::Allocate(6 * 1024);
+  memset(buffer, 1, 6 * 1024);
+  ScratchPool::Free(buffer);
+  EXPECT_EQ(2, new_mallocs());
+  EXPECT_EQ(1, new_reuses());
+}
+
+TEST_F(CodecPoolTest, MaxFreeBytes) {
+  // By default a buffer larger than the idle limit isn't kept.
+  EXPECT_EQ(ScratchPool::kDefaultMaxFreeBytes, ScratchPool::max_free_bytes());
+  const size_t kLarge = ScratchPool::kDefaultMaxFreeBytes + 1;
+  ScratchPool::Free(ScratchPool::Allocate(kLarge));
+  ScratchPool::Free(ScratchPool::Allocate(kLarge));
+  EXPECT_EQ(2, new_mallocs());
+
+  ScratchPool::set_max_free_bytes(2 * kLarge);
+  ScratchPool::Free(ScratchPool::Allocate(kLarge));
+  ScratchPool::Free(ScratchPool::Allocate(kLarge));
+  EXPECT_EQ(3, new_mallocs());
+  EXPECT_EQ(1, new_reuses());
+
+  // 0 disables pooling.
+  ScratchPool::Clear();
+  ScratchPool::set_max_free_bytes(0);
+  ScratchPool::Free(ScratchPool::Allocate(8 * 1024));
+  ScratchPool::Free(ScratchPool::Allocate(8 * 1024));
+  EXPECT_EQ(5, new_mallocs());
+  EXPECT_EQ(1, new_reuses());
+  ScratchPool::set_max_free_bytes(ScratchPool::kDefaultMaxFreeBytes);
+}
+
+TEST_F(CodecPoolTest, SmallAndHugeBuffersAreNotPooled) {
+  void* small = ScratchPool::Allocate(16);
+  ASSERT_TRUE(small != NULL);
+  ScratchPool::Free(small);
+  void* huge = ScratchPool::Allocate(ScratchPool::kMaxPooledSize + 1);
+  ASSERT_TRUE(huge != NULL);
+  ScratchPool::Free(huge);
+  EXPECT_EQ(1, new_mallocs());
+
+  huge = ScratchPool::Allocate(ScratchPool::kMaxPooledSize + 1);
+  ScratchPool::Free(huge);
+  EXPECT_EQ(2, new_mallocs());
+  EXPECT_EQ(0, new_reuses());
+}
+
+TEST_F(CodecPoolTest, FreeListsAreBounded) {
+  const int kNumBuffers = ScratchPool::kMaxFreePerClass + 2;
+  void* buffers[kNumBuffers];
+  for (int i = 0; i < kNumBuffers; ++i) {
+    buffers[i] = ScratchPool::Allocate(8 * 1024);
+  }
+  for (int i = 0; i < kNumBuffers; ++i) {
+    ScratchPool::Free(buffers[i]);
+  }
+  for (int i = 0; i < kNumBuffers; ++i) {
+    buffers[i] = ScratchPool::Allocate(8 * 1024);
+  }
+  EXPECT_EQ(ScratchPool::kMaxFreePerClass, new_reuses());
+  EXPECT_EQ(2 * kNumBuffers - ScratchPool::kMaxFreePerClass, new_mallocs());
+  for (int i = 0; i < kNumBuffers; ++i) {
+    ScratchPool::Free(buffers[i]);
+  }
+}
+
+TEST_F(CodecPoolTest, Clear) {
+  ScratchPool::Free(ScratchPool::Allocate(64 * 1024));
+  ScratchPool::Clear();
+  ScratchPool::Free(ScratchPool::Allocate(64 * 1024));
+  EXPECT_EQ(2, new_mallocs());
+  EXPECT_EQ(0, new_reuses());
+}
+
+TEST_F(CodecPoolTest, ScratchArray) {
+  {
+    ScratchArray<int> array(10000);
+    ASSERT_TRUE(array != NULL);
+    for (int i = 0; i < 10000; ++i) {
+      array[i] = i;
+    }
+    EXPECT_EQ(9999, array.get()[9999]);
+    array.reset();
+    EXPECT_TRUE(array == NULL);
+    array.reset(10000);
+    EXPECT_TRUE(array != NULL);
+  }
+  EXPECT_EQ(1, new_mallocs());
+  EXPECT_EQ(1, new_reuses());
+
+  // A count whose byte size overflows yields NULL rather than a short
+  // buffer.
+  ScratchArray<int> overflow(SIZE_MAX / 2);
+  EXPECT_TRUE(overflow == NULL);
+}
+
+TEST_F(CodecPoolTest, ContextPool) {
+  typedef CodecContextPool<CountedContext> Pool;
+  CountedContext* first = Pool::Acquire();
+  Pool::Release(first);
+  EXPECT_EQ(first, Pool::Acquire());
+
+  // Only kMaxIdle contexts are kept; the rest are deleted on release.
+  const int kNumContexts = Pool::kMaxIdle + 1;
+  CountedContext* contexts[kNumContexts];
+  contexts[0] = first;
+  for (int i = 1; i < kNumContexts; ++i) {
+    contexts[i] = Pool::Acquire();
+  }
+  EXPECT_EQ(kNumContexts, CountedContext::num_live);
+  for (int i = 0; i < kNumContexts; ++i) {
+    Pool::Release(contexts[i]);
+  }
+  EXPECT_EQ(Pool::kMaxIdle, CountedContext::num_live);
+  Pool::Release(NULL);
+}
+
+}  // namespace
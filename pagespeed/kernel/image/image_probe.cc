@@ -0,0 +1,332 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include "pagespeed/kernel/image/image_probe.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "third_party/libwebp/src/webp/decode.h"
+
+#include "pagespeed/kernel/http/image_types.pb.h"
+
+namespace pagespeed {
+
+namespace {
+
+const char kPngHeader[] = "\x89PNG\r\n\x1a\n";
+const size_t kPngHeaderLength = arraysize(kPngHeader) - 1;
+const char kGifHeader[] = "GIF8";
+const size_t kGifHeaderLength = arraysize(kGifHeader) - 1;
+
+// PNG layout: signature, then chunks of {length, type, data, crc}.  IHDR must
+// come first, so its fields sit at fixed offsets.
+const size_t kPngChunkHeaderLength = 8;     // length + type
+const size_t kPngChunkOverhead = 12;        // length + type + crc
+const size_t kIHDRDataStart = kPngHeaderLength + kPngChunkHeaderLength;
+const size_t kPngColourTypeOffset = kIHDRDataStart + 9;
+const size_t kPngInterlaceOffset = kIHDRDataStart + 12;
+const int kPngAlphaChannel = 0x4;
+
+// GIF layout: signature and version, then the logical screen descriptor.
+const size_t kGifDimStart = 6;
+const size_t kGifScreenFlagsOffset = 10;
+const size_t kGifBlocksStart = 13;
+const size_t kGifImageDescriptorLength = 10;
+const int kGifColorTableFlag = 0x80;
+const int kGifInterlaceFlag = 0x40;
+const int kGifTransparentFlag = 0x01;
+const int kGifExtensionIntroducer = 0x21;
+const int kGifImageSeparator = 0x2c;
+const int kGifGraphicControlLabel = 0xf9;
+
+inline int ByteAt(const StringPiece& buf, size_t pos) {
+  return static_cast<uint8>(buf[pos]);
+}
+
+inline int BigEndian16(const StringPiece& buf, size_t pos) {
+  return (ByteAt(buf, pos) << 8) | ByteAt(buf, pos + 1);
+}
+
+inline int LittleEndian16(const StringPiece& buf, size_t pos) {
+  return (ByteAt(buf, pos + 1) << 8) | ByteAt(buf, pos);
+}
+
+inline uint32 BigEndian32(const StringPiece& buf, size_t pos) {
+  return (static_cast<uint32>(ByteAt(buf, pos)) << 24) |
+         (static_cast<uint32>(ByteAt(buf, pos + 1)) << 16) |
+         (static_cast<uint32>(ByteAt(buf, pos + 2)) << 8) |
+         static_cast<uint32>(ByteAt(buf, pos + 3));
+}
+
+inline bool PngChunkIs(const char* type, const StringPiece& buf, size_t pos) {
+  return buf.substr(pos + 4, 4) == StringPiece(type, 4);
+}
+
+// Returns the position of the first byte at or after pos that isn't 0xff,
+// or buf.size().  JPEG allows any number of 0xff fill bytes before a marker
+// code; encoders that pad use long runs, so we test 16 bytes at a time.
+size_t SkipJpegFillBytes(const StringPiece& buf, size_t pos) {
+  const size_t size = buf.size();
+  // Nearly every marker has exactly one 0xff, so check for that first.
+  if (pos + 1 < size && ByteAt(buf, pos + 1) != 0xff) {
+    return (ByteAt(buf, pos) == 0xff) ? pos + 1 : pos;
+  }
+#if defined(__SSE2__)
+  const __m128i fill = _mm_set1_epi8(static_cast<char>(0xff));
+  while (pos + 16 <= size) {
+    __m128i bytes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(buf.data() + pos));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, fill));
+    if (mask != 0xffff) {
+      return pos + __builtin_ctz(~mask);
+    }
+    pos += 16;
+  }
+#endif
+  while (pos < size && ByteAt(buf, pos) == 0xff) {
+    ++pos;
+  }
+  return pos;
+}
+
+// Skips a chain of GIF data sub-blocks starting at pos, returning the
+// position just past the zero-length terminator, or buf.size() if the data
+// ends first.
+size_t SkipGifSubBlocks(const StringPiece& buf, size_t pos) {
+  while (pos < buf.size()) {
+    int length = ByteAt(buf, pos);
+    pos += 1 + length;
+    if (length == 0) {
+      return pos;
+    }
+  }
+  return buf.size();
+}
+
+// Size in bytes of the colour table announced by a GIF flags byte.
+size_t GifColorTableSize(int flags) {
+  return ((flags & kGifColorTableFlag) != 0) ? 3 << ((flags & 0x7) + 1) : 0;
+}
+
+// Walks the marker segments up to the first SOFn, the same way the rewriter
+// always has.  Loosely based on http://www.faqs.org/faqs/jpeg-faq/part1/
+void ProbeJpeg(const StringPiece& buf,
+               image_compression::ImageProbeResult* result) {
+  size_t pos = 2;  // Position of first data block after header.
+  while (pos < buf.size()) {
+    pos = SkipJpegFillBytes(buf, pos);
+    if (pos >= buf.size()) {
+      break;
+    }
+    int id = ByteAt(buf, pos++);
+    // pos points to the first data byte of the block, which starts with its
+    // size (including these 2 bytes).  Make sure it wasn't truncated.
+    if (pos + 2 > buf.size()) {
+      break;
+    }
+    int length = BigEndian16(buf, pos);
+    // 0xc4, 0xc8 and 0xcc are in the SOFn range but aren't SOFn headers.
+    // We only need the two dimensions, not the whole block.
+    if (0xc0 <= id && id <= 0xcf && length >= 8 && pos + 7 <= buf.size() &&
+        id != 0xc4 && id != 0xc8 && id != 0xcc) {
+      result->height = BigEndian16(buf, pos + 3);
+      result->width = BigEndian16(buf, pos + 5);
+      result->has_dimensions = (result->height > 0 && result->width > 0);
+      // SOF2, SOF6, SOF10 and SOF14 are the progressive variants.
+      result->is_progressive = ((id & 0x3) == 0x2);
+      break;
+    }
+    pos += length;
+  }
+}
+
+// See http://www.w3.org/TR/PNG/ and, for acTL, the APNG specification.
+void ProbePng(const StringPiece& buf,
+              image_compression::ImageProbeResult* result) {
+  bool has_ihdr = (buf.size() >= kIHDRDataStart &&
+                   PngChunkIs("IHDR", buf, kPngHeaderLength));
+  if (has_ihdr && buf.size() >= kIHDRDataStart + 8) {
+    result->has_dimensions = true;
+    result->width = static_cast<int>(BigEndian32(buf, kIHDRDataStart));
+    result->height = static_cast<int>(BigEndian32(buf, kIHDRDataStart + 4));
+  }
+  if (has_ihdr && buf.size() > kPngInterlaceOffset) {
+    result->is_progressive = (ByteAt(buf, kPngInterlaceOffset) != 0);
+  }
+
+  // We assume the image has transparency until we reach IDAT without
+  // finding a tRNS chunk, so truncated images are treated conservatively.
+  bool colour_has_alpha = true;
+  if (buf.size() > kPngColourTypeOffset) {
+    colour_has_alpha =
+        (ByteAt(buf, kPngColourTypeOffset) & kPngAlphaChannel) != 0;
+  }
+  bool found_trns = false;
+  bool reached_idat = false;
+  size_t pos = kPngHeaderLength;
+  while (pos + kPngChunkHeaderLength < buf.size()) {
+    uint32 length = BigEndian32(buf, pos);
+    if (PngChunkIs("IDAT", buf, pos)) {
+      // tRNS and acTL must both precede the first IDAT.
+      reached_idat = true;
+      break;
+    } else if (PngChunkIs("tRNS", buf, pos) && length > 0) {
+      found_trns = true;
+    } else if (PngChunkIs("acTL", buf, pos)) {
+      result->is_animated = true;
+    }
+    pos += length + kPngChunkOverhead;
+  }
+  result->has_alpha = colour_has_alpha || found_trns || !reached_idat;
+}
+
+// See http://www.w3.org/Graphics/GIF/spec-gif89a.txt
+void ProbeGif(const StringPiece& buf,
+              image_compression::ImageProbeResult* result) {
+  if (buf.size() >= kGifDimStart + 4) {
+    result->has_dimensions = true;
+    result->width = LittleEndian16(buf, kGifDimStart);
+    result->height = LittleEndian16(buf, kGifDimStart + 2);
+  }
+  if (buf.size() < kGifBlocksStart) {
+    return;
+  }
+  size_t pos = kGifBlocksStart +
+      GifColorTableSize(ByteAt(buf, kGifScreenFlagsOffset));
+  int num_frames = 0;
+  while (pos < buf.size()) {
+    int introducer = ByteAt(buf, pos);
+    if (introducer == kGifExtensionIntroducer) {
+      if (pos + 1 >= buf.size()) {
+        break;
+      }
+      int label = ByteAt(buf, pos + 1);
+      pos += 2;
+      // Only the first frame's transparency is reported.
+      if (label == kGifGraphicControlLabel && num_frames == 0 &&
+          pos + 1 < buf.size() && ByteAt(buf, pos) == 4 &&
+          (ByteAt(buf, pos + 1) & kGifTransparentFlag) != 0) {
+        result->has_alpha = true;
+      }
+      pos = SkipGifSubBlocks(buf, pos);
+    } else if (introducer == kGifImageSeparator) {
+      ++num_frames;
+      if (num_frames > 1) {
+        result->is_animated = true;
+        break;
+      }
+      if (pos + kGifImageDescriptorLength > buf.size()) {
+        break;
+      }
+      int flags = ByteAt(buf, pos + kGifImageDescriptorLength - 1);
+      result->is_progressive = ((flags & kGifInterlaceFlag) != 0);
+      // Skip the descriptor, local colour table and LZW code size byte.
+      pos += kGifImageDescriptorLength + GifColorTableSize(flags) + 1;
+      pos = SkipGifSubBlocks(buf, pos);
+    } else {
+      // Trailer, or something we don't understand.
+      break;
+    }
+  }
+}
+
+// Detailed explanation on parsing webp format is available at
+// http://code.google.com/speed/webp/docs/riff_container.html
+void ProbeWebp(const StringPiece& buf,
+               image_compression::ImageProbeResult* result) {
+  WebPBitstreamFeatures features;
+  if (WebPGetFeatures(reinterpret_cast<const uint8*>(buf.data()),
+                      buf.size(), &features) != VP8_STATUS_OK) {
+    return;
+  }
+  if (features.has_animation) {
+    result->type = net_instaweb::IMAGE_WEBP_ANIMATED;
+  } else if (features.format == 2 || features.has_alpha) {
+    result->type = net_instaweb::IMAGE_WEBP_LOSSLESS_OR_ALPHA;
+  } else if (features.format == 1) {
+    result->type = net_instaweb::IMAGE_WEBP;
+  } else {
+    return;
+  }
+  result->has_dimensions = true;
+  result->width = features.width;
+  result->height = features.height;
+  result->is_animated = (features.has_animation != 0);
+  result->has_alpha = (features.has_alpha != 0);
+}
+
+}  // namespace
+
+namespace image_compression {
+
+void ImageProbeResult::Clear() {
+  type = net_instaweb::IMAGE_UNKNOWN;
+  has_dimensions = false;
+  width = 0;
+  height = 0;
+  is_animated = false;
+  has_alpha = false;
+  is_progressive = false;
+}
+
+bool ProbeImage(const StringPiece& buf, ImageProbeResult* result) {
+  result->Clear();
+  // Classification matches ComputeImageType() in image_util.cc.
+  if (buf.size() < 8) {
+    return false;
+  }
+  switch (ByteAt(buf, 0)) {
+    case 0xff:
+      if (ByteAt(buf, 1) == 0xd8) {
+        result->type = net_instaweb::IMAGE_JPEG;
+        ProbeJpeg(buf, result);
+      }
+      break;
+    case 0x89:
+      if (buf.substr(0, kPngHeaderLength) ==
+          StringPiece(kPngHeader, kPngHeaderLength)) {
+        result->type = net_instaweb::IMAGE_PNG;
+        ProbePng(buf, result);
+      }
+      break;
+    case 'G':
+      if (buf.substr(0, kGifHeaderLength) ==
+          StringPiece(kGifHeader, kGifHeaderLength) &&
+          (buf[kGifHeaderLength] == '7' || buf[kGifHeaderLength] == '9') &&
+          buf[kGifHeaderLength + 1] == 'a') {
+        result->type = net_instaweb::IMAGE_GIF;
+        ProbeGif(buf, result);
+      }
+      break;
+    case 'R':
+      ProbeWebp(buf, result);
+      break;
+    default:
+      break;
+  }
+  return result->type != net_instaweb::IMAGE_UNKNOWN;
+}
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#ifndef PAGESPEED_KERNEL_IMAGE_IMAGE_PROBE_H_
+#define PAGESPEED_KERNEL_IMAGE_IMAGE_PROBE_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/image_types.pb.h"
+
+namespace pagespeed {
+
+namespace image_compression {
+
+// What can be learned about an image from its headers without decoding any
+// pixels.
+struct ImageProbeResult {
+  ImageProbeResult() { Clear(); }
+  void Clear();
+
+  // Same classification as ComputeImageType().
+  net_instaweb::ImageType type;
+
+  // Set when the headers were intact enough to read the dimensions.  For
+  // JPEG, a zero dimension is treated as missing.
+  bool has_dimensions;
+  int width;
+  int height;
+
+  // A GIF with more than one frame, an APNG (acTL before the first IDAT), or
+  // an animated WebP.
+  bool is_animated;
+
+  // The image may contain non-opaque pixels.  PNGs are judged the same way
+  // as the rewriter always has: an alpha colour type, or a non-empty tRNS
+  // chunk before the first IDAT.  If the data ends before we can tell, we
+  // conservatively assume alpha.  GIFs have alpha when a graphic control
+  // extension enables a transparent index.
+  bool has_alpha;
+
+  // Progressive JPEG (SOF2, SOF6, SOF10 or SOF14), or interlaced PNG/GIF.
+  bool is_progressive;
+};
+
+// Identifies the format of buf and extracts everything in ImageProbeResult
+// in a single forward pass over the headers, without allocating.  Only the
+// bytes needed are touched: JPEG stops at the first SOFn, PNG at the first
+// IDAT, and GIF skips image data a sub-block at a time.  Returns false if
+// the format is unknown; otherwise returns true even if the data was too
+// truncated to find the dimensions (check has_dimensions).
+bool ProbeImage(const StringPiece& buf, ImageProbeResult* result);
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
+
+#endif  // PAGESPEED_KERNEL_IMAGE_IMAGE_PROBE_H_
@@ -0,0 +1,182 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include "pagespeed/kernel/image/image_probe.h"
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/image_util.h"
+#include "pagespeed/kernel/image/test_utils.h"
+
+namespace {
+
+using pagespeed::image_compression::ComputeImageType;
+using pagespeed::image_compression::ImageProbeResult;
+using pagespeed::image_compression::ProbeImage;
+using pagespeed::image_compression::ReadTestFileWithExt;
+using pagespeed::image_compression::kGifTestDir;
+using pagespeed::image_compression::kJpegTestDir;
+using pagespeed::image_compression::kPngSuiteTestDir;
+using pagespeed::image_compression::kPngTestDir;
+using pagespeed::image_compression::kWebpTestDir;
+
+class ImageProbeTest : public testing::Test {
+ protected:
+  // Reads the named test image, probes it, and checks that the probe agrees
+  // with ComputeImageType.
+  void Probe(const char* dir, const char* name) {
+    ASSERT_TRUE(ReadTestFileWithExt(dir, name, &contents_));
+    EXPECT_TRUE(ProbeImage(contents_, &result_)) << name;
+    EXPECT_EQ(ComputeImageType(contents_), result_.type) << name;
+  }
+
+  void ExpectDimensions(int width, int height) {
+    EXPECT_TRUE(result_.has_dimensions);
+    EXPECT_EQ(width, result_.width);
+    EXPECT_EQ(height, result_.height);
+  }
+
+  GoogleString contents_;
+  ImageProbeResult result_;
+};
+
+TEST_F(ImageProbeTest, Jpeg) {
+  Probe(kJpegTestDir, "sjpeg1.jpg");
+  EXPECT_EQ(net_instaweb::IMAGE_JPEG, result_.type);
+  ExpectDimensions(120, 90);
+  EXPECT_FALSE(result_.is_progressive);
+  EXPECT_FALSE(result_.has_alpha);
+  EXPECT_FALSE(result_.is_animated);
+
+  Probe(kJpegTestDir, "progressive.jpg");
+  ExpectDimensions(200, 200);
+  EXPECT_TRUE(result_.is_progressive);
+}
+
+TEST_F(ImageProbeTest, JpegFillBytes) {
+  // Long runs of 0xff fill bytes before a marker are skipped, whatever their
+  // alignment.
+  ASSERT_TRUE(ReadTestFileWithExt(kJpegTestDir, "sjpeg1.jpg", &contents_));
+  for (int fill = 1; fill < 40; ++fill) {
+    GoogleString padded = contents_.substr(0, 2);
+    padded.append(fill, '\xff');
+    padded.append(contents_, 2, GoogleString::npos);
+    ASSERT_TRUE(ProbeImage(padded, &result_));
+    ExpectDimensions(120, 90);
+  }
+}
+
+TEST_F(ImageProbeTest, Png) {
+  Probe(kPngTestDir, "this_is_a_test.png");
+  EXPECT_EQ(net_instaweb::IMAGE_PNG, result_.type);
+  ExpectDimensions(640, 400);
+  EXPECT_FALSE(result_.has_alpha);
+  EXPECT_FALSE(result_.is_progressive);
+  EXPECT_FALSE(result_.is_animated);
+
+  Probe(kPngTestDir, "rgb_alpha.png");
+  ExpectDimensions(16, 16);
+  EXPECT_TRUE(result_.has_alpha);
+
+  // Palette image with a tRNS chunk.
+  Probe(kPngSuiteTestDir, "tbbn3p08.png");
+  EXPECT_TRUE(result_.has_alpha);
+
+  Probe(kPngSuiteTestDir, "basi0g01.png");
+  ExpectDimensions(32, 32);
+  EXPECT_TRUE(result_.is_progressive);
+  EXPECT_FALSE(result_.has_alpha);
+}
+
+TEST_F(ImageProbeTest, Gif) {
+  Probe(kGifTestDir, "transparent.gif");
+  EXPECT_EQ(net_instaweb::IMAGE_GIF, result_.type);
+  ExpectDimensions(320, 320);
+  EXPECT_TRUE(result_.has_alpha);
+  EXPECT_FALSE(result_.is_animated);
+
+  Probe(kGifTestDir, "interlaced.gif");
+  ExpectDimensions(213, 323);
+  EXPECT_TRUE(result_.is_progressive);
+  EXPECT_FALSE(result_.is_animated);
+
+  Probe(kGifTestDir, "animated.gif");
+  ExpectDimensions(120, 50);
+  EXPECT_TRUE(result_.is_animated);
+}
+
+TEST_F(ImageProbeTest, Webp) {
+  Probe(kWebpTestDir, "opaque_32x20.webp");
+  EXPECT_EQ(net_instaweb::IMAGE_WEBP, result_.type);
+  ExpectDimensions(32, 20);
+  EXPECT_FALSE(result_.has_alpha);
+
+  Probe(kWebpTestDir, "img3.webpla");
+  EXPECT_EQ(net_instaweb::IMAGE_WEBP_LOSSLESS_OR_ALPHA, result_.type);
+  EXPECT_TRUE(result_.has_dimensions);
+
+  Probe(kWebpTestDir, "animated.webp");
+  EXPECT_EQ(net_instaweb::IMAGE_WEBP_ANIMATED, result_.type);
+  EXPECT_TRUE(result_.is_animated);
+}
+
+TEST_F(ImageProbeTest, Truncated) {
+  // Every prefix of a real image classifies the same way as
+  // ComputeImageType and never reads past the end of the buffer.  Once the
+  // dimensions are available they are correct.
+  const char* kImages[][2] = {
+    { kJpegTestDir, "progressive.jpg" },
+    { kPngTestDir, "this_is_a_test.png" },
+    { kGifTestDir, "animated.gif" },
+    { kWebpTestDir, "opaque_32x20.webp" },
+  };
+  for (int i = 0; i < arraysize(kImages); ++i) {
+    GoogleString full;
+    ImageProbeResult full_result;
+    ASSERT_TRUE(ReadTestFileWithExt(kImages[i][0], kImages[i][1], &full));
+    ASSERT_TRUE(ProbeImage(full, &full_result));
+    for (size_t size = 0; size < full.size(); ++size) {
+      GoogleString prefix = full.substr(0, size);
+      ProbeImage(prefix, &result_);
+      ASSERT_EQ(ComputeImageType(prefix), result_.type) << size;
+      if (result_.has_dimensions) {
+        ASSERT_EQ(full_result.width, result_.width) << size;
+        ASSERT_EQ(full_result.height, result_.height) << size;
+      }
+    }
+  }
+
+  // A PNG cut off before its first IDAT might still have a tRNS chunk.
+  ASSERT_TRUE(ReadTestFileWithExt(kPngTestDir, "this_is_a_test.png",
+                                  &contents_));
+  ASSERT_TRUE(ProbeImage(contents_.substr(0, 40), &result_));
+  ExpectDimensions(640, 400);
+  EXPECT_TRUE(result_.has_alpha);
+}
+
+TEST_F(ImageProbeTest, NotAnImage) {
+  EXPECT_FALSE(ProbeImage("", &result_));
+  EXPECT_FALSE(ProbeImage("<html><body>hello</body></html>", &result_));
+  EXPECT_EQ(net_instaweb::IMAGE_UNKNOWN, result_.type);
+  EXPECT_FALSE(result_.has_dimensions);
+}
+
+}  // namespace
@@ -22,9 +22,11 @@
 
 #include <math.h>
 #include <algorithm>
+#include <cstring>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/image/scanline_utils.h"
 
 namespace pagespeed {
@@ -462,7 +464,7 @@ class ResizeColArea : public ResizeCol {
   void ComputeOutput(const float* in_data, uint8_t* out_data);
 
   net_instaweb::scoped_array<ResizeTableEntry> table_;
-  net_instaweb::scoped_array<float> buffer_;
+  ScratchArray<float> buffer_;
   uint8_t* output_buffer_;  // Not owned
   int elements_per_row_;
   // elements_per_row_4_ is the largest multiple of 4 which is smaller than
@@ -493,7 +495,7 @@ bool ResizeColArea<BufferType>::Initialize(
 
   only_scale_outputs_ = (ratio_y == 1.0);
   if (!only_scale_outputs_) {
-    buffer_.reset(new float[elements_per_output_row]);
+    buffer_.reset(elements_per_output_row);
     if (buffer_ == NULL) {
       return false;
     }
@@ -799,9 +801,9 @@ bool ScanlineResizer::Initialize(ScanlineReaderInterface* reader,
   if (need_resize_x) {
     InstantiateResizers<float>(pixel_format, &resizer_x_, &resizer_y_,
                                message_handler_);
-    buffer_.reset(new float[elements_per_row_]);
+    buffer_.reset(elements_per_row_);
     resizer_x_buffer = buffer_.get();
-    output_.reset(new uint8_t[elements_per_row_]);
+    output_.reset(elements_per_row_);
     resizer_y_buffer = output_.get();
     if (resizer_x_buffer == NULL || resizer_y_buffer == NULL) {
       return false;
@@ -810,7 +812,7 @@ bool ScanlineResizer::Initialize(ScanlineReaderInterface* reader,
     InstantiateResizers<uint8_t>(pixel_format, &resizer_x_, &resizer_y_,
                                  message_handler_);
     if (need_resize_y) {
-      output_.reset(new uint8_t[elements_per_row_]);
+      output_.reset(elements_per_row_);
       resizer_y_buffer = output_.get();
       if (resizer_y_buffer == NULL) {
         return false;
@@ -831,6 +833,159 @@ bool ScanlineResizer::Initialize(ScanlineReaderInterface* reader,
   return true;
 }
 
+// One decoded raster held by an ImagePyramid.
+class ImagePyramid::Level {
+ public:
+  Level(size_t width, size_t height, size_t bytes_per_row,
+        PixelFormat pixel_format)
+      : width_(width),
+        height_(height),
+        bytes_per_row_(bytes_per_row),
+        pixel_format_(pixel_format) {
+    pixels_.reset(bytes_per_row * height);
+  }
+
+  size_t width() const { return width_; }
+  size_t height() const { return height_; }
+  size_t bytes_per_row() const { return bytes_per_row_; }
+  PixelFormat pixel_format() const { return pixel_format_; }
+  uint8* row(size_t y) const { return pixels_.get() + y * bytes_per_row_; }
+
+  // Fills the raster from 'reader', which must have matching dimensions.
+  bool ReadFrom(ScanlineReaderInterface* reader) {
+    for (size_t y = 0; y < height_; ++y) {
+      void* scanline = NULL;
+      if (!reader->HasMoreScanLines() || !reader->ReadNextScanline(&scanline)) {
+        return false;
+      }
+      memcpy(row(y), scanline, bytes_per_row_);
+    }
+    return true;
+  }
+
+ private:
+  const size_t width_;
+  const size_t height_;
+  const size_t bytes_per_row_;
+  const PixelFormat pixel_format_;
+  ScratchArray<uint8> pixels_;
+
+  DISALLOW_COPY_AND_ASSIGN(Level);
+};
+
+// Reads the scanlines of a Level without copying them.
+class ImagePyramid::LevelReader : public ScanlineReaderInterface {
+ public:
+  LevelReader(const Level* level, MessageHandler* handler)
+      : level_(level), next_row_(0), message_handler_(handler) {
+  }
+  virtual ~LevelReader() {}
+
+  virtual bool Reset() {
+    next_row_ = 0;
+    return true;
+  }
+  virtual size_t GetBytesPerScanline() { return level_->bytes_per_row(); }
+  virtual bool HasMoreScanLines() { return next_row_ < level_->height(); }
+  virtual ScanlineStatus InitializeWithStatus(const void* /* image_buffer */,
+                                              size_t /* buffer_length */) {
+    return PS_LOGGED_STATUS(PS_LOG_DFATAL, message_handler_,
+                            SCANLINE_STATUS_INVOCATION_ERROR,
+                            SCANLINE_RESIZER,
+                            "unexpected call to InitializeWithStatus()");
+  }
+  virtual ScanlineStatus ReadNextScanlineWithStatus(
+      void** out_scanline_bytes) {
+    if (!HasMoreScanLines()) {
+      return PS_LOGGED_STATUS(PS_LOG_DFATAL, message_handler_,
+                              SCANLINE_STATUS_INVOCATION_ERROR,
+                              SCANLINE_RESIZER,
+                              "no more scanlines");
+    }
+    *out_scanline_bytes = level_->row(next_row_++);
+    return ScanlineStatus(SCANLINE_STATUS_SUCCESS);
+  }
+  virtual size_t GetImageHeight() { return level_->height(); }
+  virtual size_t GetImageWidth() { return level_->width(); }
+  virtual PixelFormat GetPixelFormat() { return level_->pixel_format(); }
+  virtual bool IsProgressive() { return false; }
+
+ private:
+  const Level* level_;
+  size_t next_row_;
+  MessageHandler* message_handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(LevelReader);
+};
+
+ImagePyramid::ImagePyramid(MessageHandler* handler)
+    : message_handler_(handler) {
+}
+
+ImagePyramid::~ImagePyramid() {
+  STLDeleteElements(&levels_);
+}
+
+bool ImagePyramid::Initialize(ScanlineReaderInterface* reader) {
+  if (initialized() || reader == NULL ||
+      reader->GetImageWidth() == 0 || reader->GetImageHeight() == 0) {
+    return false;
+  }
+  net_instaweb::scoped_ptr<Level> base(
+      new Level(reader->GetImageWidth(), reader->GetImageHeight(),
+                reader->GetBytesPerScanline(), reader->GetPixelFormat()));
+  if (!base->ReadFrom(reader)) {
+    return false;
+  }
+  levels_.push_back(base.release());
+  return true;
+}
+
+const ImagePyramid::Level* ImagePyramid::SmallestLevelCovering(
+    size_t width, size_t height) const {
+  // levels_ is ordered by decreasing area, so the last covering level is the
+  // smallest one.
+  const Level* result = levels_[0];
+  for (int i = 1, n = levels_.size(); i < n; ++i) {
+    if (levels_[i]->width() >= width && levels_[i]->height() >= height) {
+      result = levels_[i];
+    }
+  }
+  return result;
+}
+
+ScanlineReaderInterface* ImagePyramid::NewResizedReader(size_t width,
+                                                        size_t height) {
+  if (!initialized()) {
+    PS_LOG_DFATAL(message_handler_, "ImagePyramid is not initialized.");
+    return NULL;
+  }
+
+  const Level* source = SmallestLevelCovering(width, height);
+  LevelReader source_reader(source, message_handler_);
+  ScanlineResizer resizer(message_handler_);
+  if (!resizer.Initialize(&source_reader, width, height)) {
+    return NULL;
+  }
+
+  net_instaweb::scoped_ptr<Level> level(
+      new Level(resizer.GetImageWidth(), resizer.GetImageHeight(),
+                resizer.GetBytesPerScanline(), resizer.GetPixelFormat()));
+  if (!level->ReadFrom(&resizer)) {
+    return NULL;
+  }
+
+  // Keep levels_ ordered by decreasing area.
+  const size_t area = level->width() * level->height();
+  std::vector<Level*>::iterator pos = levels_.begin() + 1;
+  while (pos != levels_.end() && (*pos)->width() * (*pos)->height() >= area) {
+    ++pos;
+  }
+  const Level* result = level.get();
+  levels_.insert(pos, level.release());
+  return new LevelReader(result, message_handler_);
+}
+
 }  // namespace image_compression
 
 }  // namespace pagespeed
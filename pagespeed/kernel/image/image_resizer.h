@@ -22,9 +22,12 @@
 #define PAGESPEED_KERNEL_IMAGE_IMAGE_RESIZER_H_
 
 #include <cstddef>
+#include <vector>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/image/image_util.h"
 #include "pagespeed/kernel/image/scanline_interface.h"
 #include "pagespeed/kernel/image/scanline_status.h"
@@ -110,19 +113,62 @@ class ScanlineResizer : public ScanlineReaderInterface {
   // Vertical resizer.
   net_instaweb::scoped_ptr<ResizeCol> resizer_y_;
 
-  net_instaweb::scoped_array<uint8> output_;
+  ScratchArray<uint8> output_;
   int width_;
   int height_;
   int elements_per_row_;
 
   // Buffer for storing the intermediate results.
-  net_instaweb::scoped_array<float> buffer_;
+  ScratchArray<float> buffer_;
   int bytes_per_buffer_row_;
   MessageHandler* message_handler_;
 
   DISALLOW_COPY_AND_ASSIGN(ScanlineResizer);
 };
 
+// ImagePyramid holds decoded rasters of a single image at decreasing sizes,
+// so that several downscaled versions of it -- e.g., the 1x, 1.5x and 2x
+// candidates generated for a responsive image -- can be produced with one
+// decode.  Each requested size is resized from the smallest raster already
+// held that covers it, and is then kept as a new level for later requests.
+//
+// The pyramid holds whole rasters in memory, so callers should keep it only
+// as long as they expect further requests for the same image.  It is not
+// thread-safe.
+class ImagePyramid {
+ public:
+  explicit ImagePyramid(MessageHandler* handler);
+  ~ImagePyramid();
+
+  // Decodes every scanline of 'reader' into the base level.  Returns false if
+  // the pyramid was already initialized or reading fails.
+  bool Initialize(ScanlineReaderInterface* reader);
+
+  bool initialized() const { return !levels_.empty(); }
+
+  // Returns the number of rasters currently held, including the base level.
+  int num_levels() const { return static_cast<int>(levels_.size()); }
+
+  // Returns a reader producing the image resized to at most width x height,
+  // as ScanlineResizer would, or NULL on failure.  The caller owns the reader,
+  // which must not outlive the pyramid.
+  ScanlineReaderInterface* NewResizedReader(size_t width, size_t height);
+
+ private:
+  class Level;
+  class LevelReader;
+
+  // Returns the smallest level at least width x height, or the base level
+  // if none is.
+  const Level* SmallestLevelCovering(size_t width, size_t height) const;
+
+  // Ordered by decreasing area; levels_[0] is the decoded original.
+  std::vector<Level*> levels_;
+  MessageHandler* message_handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImagePyramid);
+};
+
 }  // namespace image_compression
 
 }  // namespace pagespeed
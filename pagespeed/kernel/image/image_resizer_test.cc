@@ -43,6 +43,8 @@ using pagespeed::image_compression::GRAY_8;
 using pagespeed::image_compression::RGB_888;
 using pagespeed::image_compression::RGBA_8888;
 // Readers and writers
+using pagespeed::image_compression::CompareImageReaders;
+using pagespeed::image_compression::ImagePyramid;
 using pagespeed::image_compression::JpegCompressionOptions;
 using pagespeed::image_compression::JpegScanlineWriter;
 using pagespeed::image_compression::kPngSuiteTestDir;
@@ -50,6 +52,7 @@ using pagespeed::image_compression::kPngTestDir;
 using pagespeed::image_compression::kResizedTestDir;
 using pagespeed::image_compression::PngScanlineReaderRaw;
 using pagespeed::image_compression::ReadTestFile;
+using pagespeed::image_compression::ScanlineReaderInterface;
 using pagespeed::image_compression::ScanlineResizer;
 using pagespeed::image_compression::ScanlineWriterInterface;
 using pagespeed::image_compression::WebpConfiguration;
@@ -362,4 +365,51 @@ TEST_F(ScanlineResizerTest, LargeImage) {
   ResizeAndValidateImage(kLarge4096x2048, input_image_);
 }
 
+// A size requested from a fresh pyramid is resized from the decoded original,
+// so it must match resizing the original directly.
+TEST_F(ScanlineResizerTest, PyramidMatchesDirectResize) {
+  ASSERT_TRUE(ReadTestFile(kPngTestDir, kImagePagespeed, "png", &input_image_));
+  ASSERT_TRUE(reader_.Initialize(input_image_.data(), input_image_.length()));
+  ImagePyramid pyramid(&message_handler_);
+  ASSERT_TRUE(pyramid.Initialize(&reader_));
+  EXPECT_EQ(1, pyramid.num_levels());
+
+  net_instaweb::scoped_ptr<ScanlineReaderInterface> resized(
+      pyramid.NewResizedReader(33, 34));
+  ASSERT_TRUE(resized.get() != NULL);
+
+  ASSERT_TRUE(reader_.Initialize(input_image_.data(), input_image_.length()));
+  ASSERT_TRUE(resizer_.Initialize(&reader_, 33, 34));
+  CompareImageReaders(resized.get(), &resizer_);
+}
+
+// Smaller sizes are resized from the smallest level that covers them, and
+// every result is kept as a new level.
+TEST_F(ScanlineResizerTest, PyramidLevels) {
+  ASSERT_TRUE(ReadTestFile(kPngTestDir, kImagePagespeed, "png", &input_image_));
+  ASSERT_TRUE(reader_.Initialize(input_image_.data(), input_image_.length()));
+  ImagePyramid pyramid(&message_handler_);
+  EXPECT_FALSE(pyramid.initialized());
+  ASSERT_TRUE(pyramid.Initialize(&reader_));
+  EXPECT_TRUE(pyramid.initialized());
+  EXPECT_FALSE(pyramid.Initialize(&reader_));
+
+  const size_t kSizes[][2] = { {64, 64}, {100, 20}, {32, 32}, {11, 19} };
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    net_instaweb::scoped_ptr<ScanlineReaderInterface> resized(
+        pyramid.NewResizedReader(kSizes[i][0], kSizes[i][1]));
+    ASSERT_TRUE(resized.get() != NULL);
+    EXPECT_EQ(kSizes[i][0], resized->GetImageWidth());
+    EXPECT_EQ(kSizes[i][1], resized->GetImageHeight());
+    EXPECT_EQ(RGBA_8888, resized->GetPixelFormat());
+    size_t num_rows = 0;
+    while (resized->HasMoreScanLines()) {
+      ASSERT_TRUE(resized->ReadNextScanline(&scanline_));
+      ++num_rows;
+    }
+    EXPECT_EQ(kSizes[i][1], num_rows);
+    EXPECT_EQ(static_cast<int>(i) + 2, pyramid.num_levels());
+  }
+}
+
 }  // namespace
@@ -0,0 +1,249 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "pagespeed/kernel/image/image_similarity.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/image/read_image.h"
+#include "pagespeed/kernel/image/scanline_interface.h"
+
+namespace pagespeed {
+
+namespace image_compression {
+
+namespace {
+
+// SSIM window size and spacing.
+const int kWindowSize = 8;
+const int kWindowStep = 4;
+
+// Stabilizing constants from Wang et al., for 8-bit samples:
+// (0.01 * 255)^2 and (0.03 * 255)^2.
+const double kC1 = 6.5025;
+const double kC2 = 58.5225;
+
+// Per-window sums of a, b, a*a, b*b and a*b.
+struct WindowSums {
+  float a, b, aa, bb, ab;
+};
+
+#if defined(__SSE2__)
+inline float HorizontalSum(__m128 v) {
+  float lanes[4];
+  _mm_storeu_ps(lanes, v);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+void SumWindow(const LumaPlane& a, const LumaPlane& b, int x, int y,
+               WindowSums* sums) {
+#if defined(__SSE2__)
+  __m128 sa = _mm_setzero_ps();
+  __m128 sb = _mm_setzero_ps();
+  __m128 saa = _mm_setzero_ps();
+  __m128 sbb = _mm_setzero_ps();
+  __m128 sab = _mm_setzero_ps();
+  for (int j = 0; j < kWindowSize; ++j) {
+    const float* row_a = a.Row(y + j) + x;
+    const float* row_b = b.Row(y + j) + x;
+    for (int i = 0; i < kWindowSize; i += 4) {
+      __m128 va = _mm_loadu_ps(row_a + i);
+      __m128 vb = _mm_loadu_ps(row_b + i);
+      sa = _mm_add_ps(sa, va);
+      sb = _mm_add_ps(sb, vb);
+      saa = _mm_add_ps(saa, _mm_mul_ps(va, va));
+      sbb = _mm_add_ps(sbb, _mm_mul_ps(vb, vb));
+      sab = _mm_add_ps(sab, _mm_mul_ps(va, vb));
+    }
+  }
+  sums->a = HorizontalSum(sa);
+  sums->b = HorizontalSum(sb);
+  sums->aa = HorizontalSum(saa);
+  sums->bb = HorizontalSum(sbb);
+  sums->ab = HorizontalSum(sab);
+#else
+  sums->a = sums->b = sums->aa = sums->bb = sums->ab = 0.0f;
+  for (int j = 0; j < kWindowSize; ++j) {
+    const float* row_a = a.Row(y + j) + x;
+    const float* row_b = b.Row(y + j) + x;
+    for (int i = 0; i < kWindowSize; ++i) {
+      float va = row_a[i];
+      float vb = row_b[i];
+      sums->a += va;
+      sums->b += vb;
+      sums->aa += va * va;
+      sums->bb += vb * vb;
+      sums->ab += va * vb;
+    }
+  }
+#endif
+}
+
+}  // namespace
+
+bool LumaPlane::Read(ImageFormat format, const void* image_data,
+                     size_t length, int max_dimension,
+                     MessageHandler* handler) {
+  net_instaweb::scoped_ptr<ScanlineReaderInterface> reader(
+      CreateScanlineReader(format, image_data, length, handler));
+  if (reader == NULL || max_dimension <= 0) {
+    return false;
+  }
+  const int width = reader->GetImageWidth();
+  const int height = reader->GetImageHeight();
+  const PixelFormat pixel_format = reader->GetPixelFormat();
+  if (width <= 0 || height <= 0 || pixel_format == UNSUPPORTED) {
+    return false;
+  }
+  const int bytes_per_pixel = GetBytesPerPixel(pixel_format);
+  const int larger = std::max(width, height);
+  const int factor = (larger + max_dimension - 1) / max_dimension;
+
+  width_ = (width + factor - 1) / factor;
+  height_ = (height + factor - 1) / factor;
+  max_dimension_ = max_dimension;
+  pixels_.assign(width_ * height_, 0.0f);
+
+  for (int y = 0; y < height; ++y) {
+    void* scanline = NULL;
+    if (!reader->ReadNextScanline(&scanline)) {
+      return false;
+    }
+    const uint8_t* in = static_cast<const uint8_t*>(scanline);
+    float* out = &pixels_[(y / factor) * width_];
+    for (int x = 0; x < width; ++x, in += bytes_per_pixel) {
+      float luma;
+      if (pixel_format == GRAY_8) {
+        luma = in[0];
+      } else {
+        // Rec. 601 luma.
+        luma = 0.299f * in[0] + 0.587f * in[1] + 0.114f * in[2];
+        if (pixel_format == RGBA_8888) {
+          float alpha = in[3] * (1.0f / 255.0f);
+          luma = luma * alpha + 255.0f * (1.0f - alpha);
+        }
+      }
+      out[x / factor] += luma;
+    }
+  }
+
+  // Turn the sums into averages.  Only the last row and column of boxes
+  // can be partial.
+  for (int y = 0; y < height_; ++y) {
+    const int box_height = std::min(factor, height - y * factor);
+    float* row = &pixels_[y * width_];
+    for (int x = 0; x < width_; ++x) {
+      const int box_width = std::min(factor, width - x * factor);
+      row[x] /= box_width * box_height;
+    }
+  }
+  return true;
+}
+
+double ComputeSsim(const LumaPlane& a, const LumaPlane& b) {
+  if (a.width() != b.width() || a.height() != b.height() ||
+      a.width() < kWindowSize || a.height() < kWindowSize) {
+    return 0.0;
+  }
+  const double n = kWindowSize * kWindowSize;
+  double total = 0.0;
+  int num_windows = 0;
+  WindowSums sums;
+  for (int y = 0; y + kWindowSize <= a.height(); y += kWindowStep) {
+    for (int x = 0; x + kWindowSize <= a.width(); x += kWindowStep) {
+      SumWindow(a, b, x, y, &sums);
+      double mean_a = sums.a / n;
+      double mean_b = sums.b / n;
+      double var_a = sums.aa / n - mean_a * mean_a;
+      double var_b = sums.bb / n - mean_b * mean_b;
+      double covariance = sums.ab / n - mean_a * mean_b;
+      total += ((2.0 * mean_a * mean_b + kC1) * (2.0 * covariance + kC2)) /
+          ((mean_a * mean_a + mean_b * mean_b + kC1) * (var_a + var_b + kC2));
+      ++num_windows;
+    }
+  }
+  return total / num_windows;
+}
+
+QualitySearchEncoder::~QualitySearchEncoder() {
+}
+
+int SearchQualityForSsim(const LumaPlane& reference, ImageFormat output_format,
+                         int min_quality, int max_quality, double target_ssim,
+                         QualitySearchEncoder* encoder,
+                         MessageHandler* handler, GoogleString* output) {
+  DCHECK_LE(min_quality, max_quality);
+  int low = min_quality;
+  int high = max_quality;
+  int best_quality = -1;
+  int candidate_quality = -1;
+  GoogleString candidate;
+  bool timed_out = false;
+  while (low <= high) {
+    if (!encoder->HaveTimeLeft()) {
+      timed_out = true;
+      break;
+    }
+    int quality = low + (high - low) / 2;
+    candidate.clear();
+    if (!encoder->Encode(quality, &candidate)) {
+      return -1;
+    }
+    candidate_quality = quality;
+    LumaPlane decoded;
+    if (!decoded.Read(output_format, candidate.data(), candidate.size(),
+                      reference.max_dimension(), handler)) {
+      return -1;
+    }
+    if (ComputeSsim(reference, decoded) >= target_ssim) {
+      best_quality = quality;
+      output->swap(candidate);
+      high = quality - 1;
+    } else {
+      low = quality + 1;
+    }
+  }
+  if (best_quality < 0) {
+    best_quality = max_quality;
+    if (candidate_quality == max_quality) {
+      output->swap(candidate);
+    } else if (timed_out) {
+      return -1;
+    } else {
+      output->clear();
+      if (!encoder->Encode(max_quality, output)) {
+        return -1;
+      }
+    }
+  }
+  return best_quality;
+}
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
@@ -0,0 +1,119 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_IMAGE_IMAGE_SIMILARITY_H_
+#define PAGESPEED_KERNEL_IMAGE_IMAGE_SIMILARITY_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/image_util.h"
+
+namespace net_instaweb {
+class MessageHandler;
+}
+
+namespace pagespeed {
+
+namespace image_compression {
+
+using net_instaweb::MessageHandler;
+
+// Lowest quality SearchQualityForSsim will consider by default.  Below this
+// JPEG and WebP artifacts are visible whatever the metric says.
+const int kMinSearchedQuality = 30;
+
+// Largest dimension of the luma planes compared by default.  Downscaling
+// keeps the metric cheap, and hides differences too small to see at normal
+// viewing distance.
+const int kSimilarityMaxDimension = 256;
+
+// The luma channel of an image, box-filtered down by an integer factor so
+// that neither dimension exceeds max_dimension.  Two planes read with the
+// same max_dimension from images of the same size have the same size.
+class LumaPlane {
+ public:
+  LumaPlane() : width_(0), height_(0), max_dimension_(0) {}
+
+  // Decodes image_data, of the given format, into this plane.  Supports the
+  // formats CreateScanlineReader does.  Transparent pixels are composited
+  // over white.
+  bool Read(ImageFormat format, const void* image_data, size_t length,
+            int max_dimension, MessageHandler* handler);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int max_dimension() const { return max_dimension_; }
+  const float* Row(int y) const { return &pixels_[y * width_]; }
+
+ private:
+  int width_;
+  int height_;
+  int max_dimension_;
+  std::vector<float> pixels_;
+
+  DISALLOW_COPY_AND_ASSIGN(LumaPlane);
+};
+
+// Returns the mean structural similarity (SSIM) of a and b, computed over
+// 8x8 windows spaced 4 pixels apart.  1.0 means identical.  Returns 0 if
+// the planes differ in size or are smaller than a window.
+double ComputeSsim(const LumaPlane& a, const LumaPlane& b);
+
+// Encodes one fixed image at the requested quality, for
+// SearchQualityForSsim.
+class QualitySearchEncoder {
+ public:
+  QualitySearchEncoder() {}
+  virtual ~QualitySearchEncoder();
+
+  // Writes the image encoded at quality to *output.  Returns false on
+  // failure.
+  virtual bool Encode(int quality, GoogleString* output) = 0;
+
+  // Returns false once the search has used up the time allowed for it, so
+  // it stops encoding.  By default the time is unlimited.
+  virtual bool HaveTimeLeft() { return true; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(QualitySearchEncoder);
+};
+
+// Binary-searches [min_quality, max_quality] for the lowest quality whose
+// encoding, decoded as output_format, has an SSIM of at least target_ssim
+// against reference.  SSIM is assumed not to decrease as quality rises, so
+// this takes about log2(max_quality - min_quality) encodes.  If even
+// max_quality misses the target, max_quality is chosen.  If the encoder runs
+// out of time the search stops early with the lowest passing quality found
+// so far.  Returns the chosen quality and leaves its encoding in *output, or
+// returns -1 if encoding or decoding fails, or if time ran out before any
+// quality was chosen.
+int SearchQualityForSsim(const LumaPlane& reference, ImageFormat output_format,
+                         int min_quality, int max_quality, double target_ssim,
+                         QualitySearchEncoder* encoder,
+                         MessageHandler* handler, GoogleString* output);
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
+
+#endif  // PAGESPEED_KERNEL_IMAGE_IMAGE_SIMILARITY_H_
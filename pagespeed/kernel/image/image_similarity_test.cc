@@ -0,0 +1,265 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "pagespeed/kernel/image/image_similarity.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/jpeg_optimizer.h"
+#include "pagespeed/kernel/image/test_utils.h"
+
+namespace {
+
+using net_instaweb::MockMessageHandler;
+using net_instaweb::NullMutex;
+using pagespeed::image_compression::ComputeSsim;
+using pagespeed::image_compression::IMAGE_JPEG;
+using pagespeed::image_compression::JpegCompressionOptions;
+using pagespeed::image_compression::kJpegTestDir;
+using pagespeed::image_compression::kSimilarityMaxDimension;
+using pagespeed::image_compression::LumaPlane;
+using pagespeed::image_compression::OptimizeJpegWithOptions;
+using pagespeed::image_compression::QualitySearchEncoder;
+using pagespeed::image_compression::ReadTestFile;
+using pagespeed::image_compression::SearchQualityForSsim;
+
+// Re-encodes a JPEG at the requested quality, counting the encodes.  Runs
+// out of time after max_encodes encodes, if that is set.
+class JpegQualityEncoder : public QualitySearchEncoder {
+ public:
+  JpegQualityEncoder(const GoogleString& original,
+                     MockMessageHandler* handler)
+      : original_(original), handler_(handler), num_encodes_(0),
+        max_encodes_(-1) {}
+
+  virtual bool Encode(int quality, GoogleString* output) {
+    ++num_encodes_;
+    JpegCompressionOptions options;
+    options.lossy = true;
+    options.lossy_options.quality = quality;
+    return OptimizeJpegWithOptions(original_, output, options, handler_);
+  }
+
+  virtual bool HaveTimeLeft() {
+    return max_encodes_ < 0 || num_encodes_ < max_encodes_;
+  }
+
+  int num_encodes() const { return num_encodes_; }
+  void set_max_encodes(int max_encodes) { max_encodes_ = max_encodes; }
+
+ private:
+  const GoogleString& original_;
+  MockMessageHandler* handler_;
+  int num_encodes_;
+  int max_encodes_;
+
+  DISALLOW_COPY_AND_ASSIGN(JpegQualityEncoder);
+};
+
+class ImageSimilarityTest : public testing::Test {
+ public:
+  ImageSimilarityTest() : message_handler_(new NullMutex) {}
+
+ protected:
+  void ReadJpeg(const char* name, GoogleString* contents) {
+    ASSERT_TRUE(ReadTestFile(kJpegTestDir, name, "jpg", contents));
+  }
+
+  MockMessageHandler message_handler_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ImageSimilarityTest);
+};
+
+TEST_F(ImageSimilarityTest, ReadDownscales) {
+  GoogleString contents;
+  ReadJpeg("sjpeg1", &contents);  // 120x90
+  LumaPlane full;
+  ASSERT_TRUE(full.Read(IMAGE_JPEG, contents.data(), contents.size(),
+                        kSimilarityMaxDimension, &message_handler_));
+  EXPECT_EQ(120, full.width());
+  EXPECT_EQ(90, full.height());
+
+  // A factor of 3 divides 120 evenly; 90 / 3 too.
+  LumaPlane small;
+  ASSERT_TRUE(small.Read(IMAGE_JPEG, contents.data(), contents.size(), 40,
+                         &message_handler_));
+  EXPECT_EQ(40, small.width());
+  EXPECT_EQ(30, small.height());
+
+  // A factor of 7 leaves partial boxes in both dimensions.
+  LumaPlane odd;
+  ASSERT_TRUE(odd.Read(IMAGE_JPEG, contents.data(), contents.size(), 18,
+                       &message_handler_));
+  EXPECT_EQ(18, odd.width());
+  EXPECT_EQ(13, odd.height());
+  for (int y = 0; y < odd.height(); ++y) {
+    for (int x = 0; x < odd.width(); ++x) {
+      EXPECT_LE(0.0f, odd.Row(y)[x]);
+      EXPECT_GE(255.0f, odd.Row(y)[x]);
+    }
+  }
+}
+
+TEST_F(ImageSimilarityTest, ReadFailsOnCorruptImage) {
+  GoogleString contents;
+  ReadJpeg("corrupt", &contents);
+  LumaPlane plane;
+  EXPECT_FALSE(plane.Read(IMAGE_JPEG, contents.data(), contents.size(),
+                          kSimilarityMaxDimension, &message_handler_));
+}
+
+TEST_F(ImageSimilarityTest, SsimOfIdenticalImagesIsOne) {
+  GoogleString contents;
+  ReadJpeg("sjpeg1", &contents);
+  LumaPlane a, b;
+  ASSERT_TRUE(a.Read(IMAGE_JPEG, contents.data(), contents.size(),
+                     kSimilarityMaxDimension, &message_handler_));
+  ASSERT_TRUE(b.Read(IMAGE_JPEG, contents.data(), contents.size(),
+                     kSimilarityMaxDimension, &message_handler_));
+  EXPECT_DOUBLE_EQ(1.0, ComputeSsim(a, b));
+}
+
+TEST_F(ImageSimilarityTest, SsimFallsWithQuality) {
+  GoogleString original;
+  ReadJpeg("quality100", &original);
+  LumaPlane reference;
+  ASSERT_TRUE(reference.Read(IMAGE_JPEG, original.data(), original.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+
+  JpegQualityEncoder encoder(original, &message_handler_);
+  double previous_ssim = 1.0;
+  const int kQualities[] = {90, 60, 20, 5};
+  for (int i = 0; i < arraysize(kQualities); ++i) {
+    GoogleString encoded;
+    ASSERT_TRUE(encoder.Encode(kQualities[i], &encoded));
+    LumaPlane decoded;
+    ASSERT_TRUE(decoded.Read(IMAGE_JPEG, encoded.data(), encoded.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+    double ssim = ComputeSsim(reference, decoded);
+    EXPECT_GT(previous_ssim, ssim) << kQualities[i];
+    EXPECT_LT(0.0, ssim) << kQualities[i];
+    previous_ssim = ssim;
+  }
+}
+
+TEST_F(ImageSimilarityTest, SsimOfMismatchedSizesIsZero) {
+  GoogleString contents;
+  ReadJpeg("sjpeg1", &contents);
+  LumaPlane a, b;
+  ASSERT_TRUE(a.Read(IMAGE_JPEG, contents.data(), contents.size(), 120,
+                     &message_handler_));
+  ASSERT_TRUE(b.Read(IMAGE_JPEG, contents.data(), contents.size(), 60,
+                     &message_handler_));
+  EXPECT_EQ(0.0, ComputeSsim(a, b));
+}
+
+TEST_F(ImageSimilarityTest, SearchFindsLowestQualityMeetingTarget) {
+  GoogleString original;
+  ReadJpeg("quality100", &original);
+  LumaPlane reference;
+  ASSERT_TRUE(reference.Read(IMAGE_JPEG, original.data(), original.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+
+  const double kTarget = 0.95;
+  JpegQualityEncoder encoder(original, &message_handler_);
+  GoogleString output;
+  int quality = SearchQualityForSsim(reference, IMAGE_JPEG, 30, 90, kTarget,
+                                     &encoder, &message_handler_, &output);
+  ASSERT_LE(30, quality);
+  ASSERT_GE(90, quality);
+  // log2(61) rounded up.
+  EXPECT_GE(6, encoder.num_encodes());
+
+  // The returned output is the encoding at the chosen quality, and meets the
+  // target; one step lower does not (unless the bound was hit).
+  GoogleString expected;
+  ASSERT_TRUE(encoder.Encode(quality, &expected));
+  EXPECT_EQ(expected, output);
+  LumaPlane decoded;
+  ASSERT_TRUE(decoded.Read(IMAGE_JPEG, output.data(), output.size(),
+                           kSimilarityMaxDimension, &message_handler_));
+  EXPECT_LE(kTarget, ComputeSsim(reference, decoded));
+  if (quality > 30) {
+    GoogleString lower;
+    ASSERT_TRUE(encoder.Encode(quality - 1, &lower));
+    ASSERT_TRUE(decoded.Read(IMAGE_JPEG, lower.data(), lower.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+    EXPECT_GT(kTarget, ComputeSsim(reference, decoded));
+  }
+}
+
+TEST_F(ImageSimilarityTest, SearchFallsBackToMaxQuality) {
+  GoogleString original;
+  ReadJpeg("quality100", &original);
+  LumaPlane reference;
+  ASSERT_TRUE(reference.Read(IMAGE_JPEG, original.data(), original.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+
+  // No lossy encode is a perfect copy.
+  JpegQualityEncoder encoder(original, &message_handler_);
+  GoogleString output;
+  EXPECT_EQ(50, SearchQualityForSsim(reference, IMAGE_JPEG, 30, 50, 1.0,
+                                     &encoder, &message_handler_, &output));
+  GoogleString expected;
+  ASSERT_TRUE(encoder.Encode(50, &expected));
+  EXPECT_EQ(expected, output);
+}
+
+TEST_F(ImageSimilarityTest, SearchStopsWhenTimeRunsOut) {
+  GoogleString original;
+  ReadJpeg("quality100", &original);
+  LumaPlane reference;
+  ASSERT_TRUE(reference.Read(IMAGE_JPEG, original.data(), original.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+
+  // The first probe, at 60, passes this low target; the search keeps it
+  // rather than trying lower qualities.
+  JpegQualityEncoder encoder(original, &message_handler_);
+  encoder.set_max_encodes(1);
+  GoogleString output;
+  EXPECT_EQ(60, SearchQualityForSsim(reference, IMAGE_JPEG, 30, 90, 0.5,
+                                     &encoder, &message_handler_, &output));
+  EXPECT_EQ(1, encoder.num_encodes());
+  GoogleString expected;
+  ASSERT_TRUE(encoder.Encode(60, &expected));
+  EXPECT_EQ(expected, output);
+}
+
+TEST_F(ImageSimilarityTest, SearchFailsWhenTimeRunsOutBeforeAnyPass) {
+  GoogleString original;
+  ReadJpeg("quality100", &original);
+  LumaPlane reference;
+  ASSERT_TRUE(reference.Read(IMAGE_JPEG, original.data(), original.size(),
+                             kSimilarityMaxDimension, &message_handler_));
+
+  // Without time left, the fallback to max_quality is not encoded either.
+  JpegQualityEncoder encoder(original, &message_handler_);
+  encoder.set_max_encodes(2);
+  GoogleString output;
+  EXPECT_EQ(-1, SearchQualityForSsim(reference, IMAGE_JPEG, 30, 50, 1.0,
+                                     &encoder, &message_handler_, &output));
+  EXPECT_EQ(2, encoder.num_encodes());
+}
+
+}  // namespace
@@ -29,6 +29,7 @@
 #include "base/logging.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/image/jpeg_reader.h"
 
 extern "C" {
@@ -40,10 +41,13 @@ extern "C" {
 }
 
 using net_instaweb::MessageHandler;
+using pagespeed::image_compression::CodecContextPool;
 using pagespeed::image_compression::ColorSampling;
+using pagespeed::image_compression::JpegCompressEnv;
 using pagespeed::image_compression::JpegCompressionOptions;
 using pagespeed::image_compression::JpegLossyOptions;
 using pagespeed::image_compression::RETAIN;
+using pagespeed::image_compression::ScratchPool;
 using pagespeed::image_compression::YUV420;
 using pagespeed::image_compression::YUV422;
 using pagespeed::image_compression::YUV444;
@@ -155,6 +159,7 @@ void InitJpegCompress(j_compress_ptr cinfo, jpeg_error_mgr* compress_error) {
 void SetJpegCompressBeforeStartCompress(const JpegCompressionOptions& options,
     const jpeg_decompress_struct* jpeg_decompress,
     jpeg_compress_struct* jpeg_compress) {
+  jpeg_compress->optimize_coding = options.optimize_coding ? TRUE : FALSE;
   if (options.lossy) {
     const JpegLossyOptions& lossy_options = options.lossy_options;
     // Set the compression parameters if set and lossy compression is enabled,
@@ -219,6 +224,41 @@ void SetJpegCompressAfterStartCompress(const JpegCompressionOptions& options,
   }
 }
 
+}  // namespace
+
+namespace pagespeed {
+
+namespace image_compression {
+
+// libjpeg compression state.  Creating a compress struct allocates, so these
+// are pooled per thread and recycled between images.
+struct JpegCompressEnv {
+  JpegCompressEnv() {
+    InitJpegCompress(&jpeg_compress_, &compress_error_);
+  }
+
+  ~JpegCompressEnv() {
+    jpeg_destroy_compress(&jpeg_compress_);
+  }
+
+  // Abandons any compression in progress so the struct can be reused.
+  void Recycle() {
+    jpeg_compress_.client_data = NULL;
+    jpeg_abort_compress(&jpeg_compress_);
+  }
+
+  jpeg_compress_struct jpeg_compress_;
+  jpeg_error_mgr compress_error_;
+};
+
+}  // namespace image_compression
+
+}  // namespace pagespeed
+
+namespace {
+
+typedef CodecContextPool<JpegCompressEnv> JpegCompressEnvPool;
+
 class JpegOptimizer {
  public:
   explicit JpegOptimizer(MessageHandler* handler);
@@ -248,8 +288,8 @@ class JpegOptimizer {
                      const JpegCompressionOptions& options);
 
   // Structures for jpeg compression.
-  jpeg_compress_struct jpeg_compress_;
-  jpeg_error_mgr compress_error_;
+  JpegCompressEnv* compress_env_;
+  jpeg_compress_struct& jpeg_compress_;
   MessageHandler* message_handler_;
   pagespeed::image_compression::JpegReader reader_;
 
@@ -257,13 +297,15 @@ class JpegOptimizer {
 };
 
 JpegOptimizer::JpegOptimizer(MessageHandler* handler)
-  : message_handler_(handler),
+  : compress_env_(JpegCompressEnvPool::Acquire()),
+    jpeg_compress_(compress_env_->jpeg_compress_),
+    message_handler_(handler),
     reader_(handler) {
-  InitJpegCompress(&jpeg_compress_, &compress_error_);
 }
 
 JpegOptimizer::~JpegOptimizer() {
-  jpeg_destroy_compress(&jpeg_compress_);
+  compress_env_->Recycle();
+  JpegCompressEnvPool::Release(compress_env_);
 }
 
 bool JpegOptimizer::OptimizeLossy(
@@ -288,9 +330,6 @@ bool JpegOptimizer::OptimizeLossy(
   // Set the default options.
   jpeg_set_defaults(&jpeg_compress_);
 
-  // Set optimize huffman to true.
-  jpeg_compress_.optimize_coding = TRUE;
-
   SetJpegCompressBeforeStartCompress(options, jpeg_decompress, &jpeg_compress_);
 
   // Prepare to write to a string.
@@ -311,7 +350,7 @@ bool JpegOptimizer::OptimizeLossy(
   bool valid_jpeg = true;
 
   JSAMPROW row_pointer[1];
-  row_pointer[0] = static_cast<JSAMPLE*>(malloc(
+  row_pointer[0] = static_cast<JSAMPLE*>(ScratchPool::Allocate(
       jpeg_decompress->output_width * jpeg_decompress->output_components));
   while (jpeg_compress_.next_scanline < jpeg_compress_.image_height) {
     const JDIMENSION num_scanlines_read =
@@ -328,7 +367,7 @@ bool JpegOptimizer::OptimizeLossy(
     }
   }
 
-  free(row_pointer[0]);
+  ScratchPool::Free(row_pointer[0]);
   return valid_jpeg;
 }
 
@@ -350,9 +389,6 @@ bool JpegOptimizer::OptimizeLossless(jpeg_decompress_struct *jpeg_decompress,
     SetJpegCompressBeforeStartCompress(options, jpeg_decompress,
                                        &jpeg_compress_);
 
-    // Set optimize huffman to true.
-    jpeg_compress_.optimize_coding = TRUE;
-
     // Prepare to write to a string.
     JpegStringWriter(&jpeg_compress_, compressed);
 
@@ -446,27 +482,14 @@ namespace image_compression {
 JpegCompressionOptions::~JpegCompressionOptions() {
 }
 
-struct JpegScanlineWriter::Data {
-  Data() {
-    InitJpegCompress(&jpeg_compress_, &compress_error_);
-  }
-
-  ~Data() {
-    jpeg_destroy_compress(&jpeg_compress_);
-  }
-
-  // Structures for jpeg compression.
-  jpeg_compress_struct jpeg_compress_;
-  jpeg_error_mgr compress_error_;
-};
-
 JpegScanlineWriter::JpegScanlineWriter(MessageHandler* handler)
-  : data_(new Data()),
+  : data_(JpegCompressEnvPool::Acquire()),
     message_handler_(handler) {
 }
 
 JpegScanlineWriter::~JpegScanlineWriter() {
-  delete data_;
+  data_->Recycle();
+  JpegCompressEnvPool::Release(data_);
 }
 
 void JpegScanlineWriter::SetJmpBufEnv(jmp_buf* env) {
@@ -42,6 +42,8 @@ namespace image_compression {
 
 using net_instaweb::MessageHandler;
 
+struct JpegCompressEnv;
+
 enum ColorSampling {
   RETAIN,
   YUV420,
@@ -68,7 +70,7 @@ struct JpegLossyOptions {
 struct JpegCompressionOptions : public ScanlineWriterConfig {
   JpegCompressionOptions()
     : progressive(false), retain_color_profile(false),
-      retain_exif_data(false), lossy(false) {}
+      retain_exif_data(false), lossy(false), optimize_coding(true) {}
 
   ~JpegCompressionOptions() override;
 
@@ -88,6 +90,11 @@ struct JpegCompressionOptions : public ScanlineWriterConfig {
 
   // Lossy compression options. Only applicable if lossy (above) is set to true.
   JpegLossyOptions lossy_options;
+
+  // Whether to compute optimal Huffman tables, which costs an extra pass
+  // over the coefficients.  Turning this off trades a few percent of output
+  // size for encoding speed.
+  bool optimize_coding;
 };
 
 // Performs lossless optimization, that is, the output image will be
@@ -150,9 +157,8 @@ class JpegScanlineWriter : public ScanlineWriterInterface {
   void SetJpegCompressParams(const JpegCompressionOptions& options);
 
   // Opaque struct that is defined in the cc file and contains our
-  // JPEG-compressor-specific structures.
-  struct Data;
-  Data* const data_;
+  // JPEG-compressor-specific structures.  Pooled; see codec_pool.h.
+  JpegCompressEnv* const data_;
   MessageHandler* message_handler_;
 
   DISALLOW_COPY_AND_ASSIGN(JpegScanlineWriter);
@@ -25,6 +25,7 @@
 
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 
 extern "C" {
 #ifdef USE_SYSTEM_LIBJPEG
@@ -115,36 +116,62 @@ namespace image_compression {
 
 using net_instaweb::MessageHandler;
 
+// libjpeg decompression state.  Creating a decompress struct allocates its
+// memory manager and permanent pool, so these are pooled per thread and put
+// back into their just-created state with Recycle() between images.
 struct JpegEnv {
+  JpegEnv() {
+    memset(&jpeg_decompress_, 0, sizeof(jpeg_decompress_));
+    memset(&decompress_error_, 0, sizeof(decompress_error_));
+    jpeg_decompress_.err = jpeg_std_error(&decompress_error_);
+    decompress_error_.error_exit = &ErrorExit;
+    decompress_error_.output_message = &OutputMessage;
+    jpeg_create_decompress(&jpeg_decompress_);
+  }
+
+  ~JpegEnv() {
+    jpeg_destroy_decompress(&jpeg_decompress_);
+  }
+
+  // Abandons any decode in progress, keeping the permanent pool (which holds
+  // our source manager), and undoes any jpeg_save_markers() calls.
+  void Recycle() {
+    jpeg_decompress_.client_data = NULL;
+    jpeg_abort_decompress(&jpeg_decompress_);
+    jpeg_save_markers(&jpeg_decompress_, JPEG_COM, 0);
+    for (int i = 0; i < 16; ++i) {
+      jpeg_save_markers(&jpeg_decompress_, JPEG_APP0 + i, 0);
+    }
+  }
+
   jpeg_decompress_struct jpeg_decompress_;
   jpeg_error_mgr decompress_error_;
   jmp_buf jmp_buf_env_;
 };
 
+namespace {
+
+typedef CodecContextPool<JpegEnv> JpegEnvPool;
+
+}  // namespace
+
 JpegReader::JpegReader(MessageHandler* handler)
-  : message_handler_(handler) {
-  jpeg_decompress_ = static_cast<jpeg_decompress_struct*>(
-      malloc(sizeof(jpeg_decompress_struct)));
-  decompress_error_ = static_cast<jpeg_error_mgr*>(
-      malloc(sizeof(jpeg_error_mgr)));
-  memset(jpeg_decompress_, 0, sizeof(jpeg_decompress_struct));
-  memset(decompress_error_, 0, sizeof(jpeg_error_mgr));
-
-  jpeg_decompress_->err = jpeg_std_error(decompress_error_);
-  decompress_error_->error_exit = &ErrorExit;
-  decompress_error_->output_message = &OutputMessage;
-  jpeg_create_decompress(jpeg_decompress_);
+  : jpeg_env_(JpegEnvPool::Acquire()),
+    message_handler_(handler) {
 }
 
 JpegReader::~JpegReader() {
-  jpeg_destroy_decompress(jpeg_decompress_);
-  free(decompress_error_);
-  free(jpeg_decompress_);
+  jpeg_env_->Recycle();
+  JpegEnvPool::Release(jpeg_env_);
+}
+
+jpeg_decompress_struct* JpegReader::decompress_struct() const {
+  return &jpeg_env_->jpeg_decompress_;
 }
 
 void JpegReader::PrepareForRead(const void* image_data, size_t image_length) {
   // Prepare to read from a string.
-  JpegStringReader(jpeg_decompress_, image_data, image_length);
+  JpegStringReader(decompress_struct(), image_data, image_length);
 }
 
 JpegScanlineReader::JpegScanlineReader(MessageHandler* handler) :
@@ -164,7 +191,7 @@ JpegScanlineReader::~JpegScanlineReader() {
   if (was_initialized_) {
     Reset();
   }
-  free(jpeg_env_);
+  JpegEnvPool::Release(jpeg_env_);
 }
 
 bool JpegScanlineReader::Reset() {
@@ -175,9 +202,10 @@ bool JpegScanlineReader::Reset() {
   bytes_per_row_ = 0;
   was_initialized_ = false;
 
-  jpeg_destroy_decompress(&(jpeg_env_->jpeg_decompress_));
-  memset(jpeg_env_, 0, sizeof(JpegEnv));
-  free(row_pointer_[0]);
+  if (jpeg_env_ != NULL) {
+    jpeg_env_->Recycle();
+  }
+  ScratchPool::Free(row_pointer_[0]);
   row_pointer_[0] = NULL;
   return true;
 }
@@ -187,9 +215,9 @@ ScanlineStatus JpegScanlineReader::InitializeWithStatus(const void* image_data,
   if (was_initialized_) {
     // Reset the reader if it has been initialized before.
     Reset();
-  } else if (jpeg_env_ == NULL) {
-    jpeg_env_ = static_cast<JpegEnv*>(malloc(sizeof(JpegEnv)));
-    memset(jpeg_env_, 0, sizeof(JpegEnv));
+  }
+  if (jpeg_env_ == NULL) {
+    jpeg_env_ = JpegEnvPool::Acquire();
   }
 
   // libjpeg's error handling mechanism requires that longjmp be used
@@ -205,12 +233,7 @@ ScanlineStatus JpegScanlineReader::InitializeWithStatus(const void* image_data,
                             "libjpeg failed to decode the image.");
   }
 
-  jpeg_error_mgr* decompress_error = &(jpeg_env_->decompress_error_);
   jpeg_decompress_struct* jpeg_decompress = &(jpeg_env_->jpeg_decompress_);
-  jpeg_decompress->err = jpeg_std_error(decompress_error);
-  decompress_error->error_exit = &ErrorExit;
-  decompress_error->output_message = &OutputMessage;
-  jpeg_create_decompress(jpeg_decompress);
 
   // Need to install env so that it will be longjmp()ed to on error.
   jpeg_decompress->client_data = static_cast<void *>(jpeg_env_->jmp_buf_env_);
@@ -266,7 +289,8 @@ ScanlineStatus JpegScanlineReader::ReadNextScanlineWithStatus(
   // a row of pixels, and initiate decompression.
   jpeg_decompress_struct* jpeg_decompress = &(jpeg_env_->jpeg_decompress_);
   if (row_ == 0) {
-    row_pointer_[0] = static_cast<JSAMPLE*>(malloc(bytes_per_row_));
+    row_pointer_[0] = static_cast<JSAMPLE*>(
+        ScratchPool::Allocate(bytes_per_row_));
     jpeg_start_decompress(jpeg_decompress);
   }
 
@@ -28,7 +28,6 @@
 #include "pagespeed/kernel/image/scanline_status.h"
 
 struct jpeg_decompress_struct;
-struct jpeg_error_mgr;
 
 namespace net_instaweb {
 class MessageHandler;
@@ -61,13 +60,12 @@ class JpegReader {
   explicit JpegReader(MessageHandler* handler);
   ~JpegReader();
 
-  jpeg_decompress_struct *decompress_struct() const { return jpeg_decompress_; }
+  jpeg_decompress_struct *decompress_struct() const;
 
   void PrepareForRead(const void* image_data, size_t image_length);
 
  private:
-  jpeg_decompress_struct *jpeg_decompress_;
-  jpeg_error_mgr *decompress_error_;
+  JpegEnv* jpeg_env_;  // Pooled; see codec_pool.h.
   MessageHandler* message_handler_;
 
   DISALLOW_COPY_AND_ASSIGN(JpegReader);
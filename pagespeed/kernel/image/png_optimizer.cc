@@ -24,6 +24,7 @@
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/image/scanline_utils.h"
 
 #ifdef __native_client__
@@ -48,14 +49,17 @@ extern "C" {
 
 using net_instaweb::MessageHandler;
 using pagespeed::image_compression::PngCompressParams;
+using pagespeed::image_compression::ScratchPool;
 
 namespace {
 
 // A wrapper that ensures that any padding bytes are initialized
-// deterministically.
+// deterministically.  All of libpng's allocations, including the png_struct
+// itself, come from the ScratchPool, so the row and zlib buffers of one
+// image are reused for the next one on the same thread.
 void* PngWrapMalloc(png_structp ptr, png_size_t size) {
   if ((size & 7) == 0) {
-    return malloc(size);
+    return ScratchPool::Allocate(size);
   } else {
     png_size_t extra = 8 - (size & 7);
     png_size_t rounded = size + extra;
@@ -63,14 +67,26 @@ void* PngWrapMalloc(png_structp ptr, png_size_t size) {
     if (rounded == 0) {
       return nullptr;
     }
-    char* p = reinterpret_cast<char*>(malloc(rounded));
-    memset(p + (rounded - 8), 0, 8);
+    char* p = reinterpret_cast<char*>(ScratchPool::Allocate(rounded));
+    if (p != nullptr) {
+      memset(p + (rounded - 8), 0, 8);
+    }
     return p;
   }
 }
 
 static void PngWrapFree(png_structp, png_voidp ptr) {
-  free(ptr);
+  ScratchPool::Free(ptr);
+}
+
+png_structp CreatePngReadStruct() {
+  return png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+                                  NULL, &PngWrapMalloc, &PngWrapFree);
+}
+
+png_structp CreatePngWriteStruct() {
+  return png_create_write_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+                                   NULL, &PngWrapMalloc, &PngWrapFree);
 }
 
 // we use these four combinations because different images seem to benefit from
@@ -197,12 +213,10 @@ ScopedPngStruct::ScopedPngStruct(Type type,
   DCHECK(type == READ || type == WRITE);
   switch (type) {
     case READ:
-      png_ptr_ = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-                                        NULL, NULL, NULL);
+      png_ptr_ = CreatePngReadStruct();
       break;
     case WRITE:
-      png_ptr_ = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                         NULL, NULL, NULL);
+      png_ptr_ = CreatePngWriteStruct();
       break;
     default:
       PS_LOG_DFATAL(handler, "Invalid type");
@@ -211,7 +225,6 @@ ScopedPngStruct::ScopedPngStruct(Type type,
     info_ptr_ = png_create_info_struct(png_ptr_);
   }
 
-  png_set_mem_fn(png_ptr_, nullptr, &PngWrapMalloc, &PngWrapFree);
   png_set_error_fn(png_ptr_, message_handler_, &PngErrorFn, &PngWarningFn);
 }
 
@@ -219,12 +232,10 @@ bool ScopedPngStruct::reset() {
   DCHECK(type_ == READ || type_ == WRITE);
   if (type_ == READ) {
     png_destroy_read_struct(&png_ptr_, &info_ptr_, NULL);
-    png_ptr_ = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-                                      NULL, NULL, NULL);
+    png_ptr_ = CreatePngReadStruct();
   } else {
     png_destroy_write_struct(&png_ptr_, &info_ptr_);
-    png_ptr_ = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                       NULL, NULL, NULL);
+    png_ptr_ = CreatePngWriteStruct();
   }
 
   if (setjmp(png_jmpbuf(png_ptr_))) {
@@ -1082,15 +1093,15 @@ ScanlineStatus PngScanlineReaderRaw::ReadNextScanlineWithStatus(
   // also decode the entire image at the first call.
   if (row_ == 0) {
     if (!is_progressive_) {
-      image_buffer_.reset(new png_byte[bytes_per_row_]);
+      image_buffer_.reset(bytes_per_row_);
     } else {
-      image_buffer_.reset(new png_byte[bytes_per_row_ * height_]);
+      image_buffer_.reset(bytes_per_row_ * height_);
       // For a progressive PNG, we have to decode the entire image before
       // rendering any row. So at the first time when ReadNextScanline()
       // is called, we decode the entire image into image_buffer_.
       if (image_buffer_ != NULL) {
         // Initialize an array of pointers, which specify the address of rows.
-        row_pointers_.reset(new png_bytep[height_]);
+        row_pointers_.reset(height_);
         if (row_pointers_ == NULL) {
           Reset();
           return PS_LOGGED_STATUS(PS_LOG_ERROR, message_handler_,
@@ -1299,7 +1310,7 @@ ScanlineStatus PngScanlineWriter::InitializeWriteWithStatus(
 
   png_write_info(png_ptr, info_ptr);
   try_best_compression_ = png_params->try_best_compression;
-  pixel_buffer_.reset(new unsigned char[height_ * bytes_per_row_]);
+  pixel_buffer_.reset(height_ * bytes_per_row_);
   was_initialized_ = true;
   return ScanlineStatus(SCANLINE_STATUS_SUCCESS);
 }
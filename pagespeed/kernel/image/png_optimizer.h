@@ -38,6 +38,7 @@ extern "C" {
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/image/image_util.h"
 #include "pagespeed/kernel/image/scanline_interface.h"
 #include "pagespeed/kernel/image/scanline_status.h"
@@ -348,8 +349,8 @@ class PngScanlineReaderRaw : public ScanlineReaderInterface {
   size_t bytes_per_row_;
   size_t row_;
   bool was_initialized_;
-  net_instaweb::scoped_array<png_byte> image_buffer_;
-  net_instaweb::scoped_array<png_bytep> row_pointers_;
+  ScratchArray<png_byte> image_buffer_;
+  ScratchArray<png_bytep> row_pointers_;
   net_instaweb::scoped_ptr<ScopedPngStruct> png_struct_;
   // png_input_ stores a pointer to the input image stream. It also keeps
   // tracking the length of data that libpng has read. It is initialized
@@ -406,7 +407,7 @@ class PngScanlineWriter : public ScanlineWriterInterface {
   net_instaweb::scoped_ptr<ScopedPngStruct> png_struct_;
   bool was_initialized_;
   bool try_best_compression_;
-  net_instaweb::scoped_array<unsigned char> pixel_buffer_;
+  ScratchArray<unsigned char> pixel_buffer_;
   MessageHandler* message_handler_;
 
   DISALLOW_COPY_AND_ASSIGN(PngScanlineWriter);
@@ -704,7 +704,7 @@ ScanlineStatus WebpScanlineReader::ReadNextScanlineWithStatus(
 
   // The first time ReadNextScanline() is called, we decode the entire image.
   if (row_ == 0) {
-    pixels_.reset(new uint8_t[bytes_per_row_ * height_]);
+    pixels_.reset(bytes_per_row_ * height_);
     if (pixels_ == nullptr) {
       Reset();
       return PS_LOGGED_STATUS(PS_LOG_ERROR, message_handler_,
@@ -25,6 +25,7 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/image/image_frame_interface.h"
 #include "pagespeed/kernel/image/image_util.h"
 #include "pagespeed/kernel/image/scanline_interface.h"
@@ -251,7 +252,7 @@ class WebpScanlineReader : public ScanlineReaderInterface {
   bool was_initialized_;
 
   // Buffer for holding the decoded pixels.
-  net_instaweb::scoped_array<uint8_t> pixels_;
+  ScratchArray<uint8_t> pixels_;
 
   MessageHandler* message_handler_;
 
@@ -133,6 +133,18 @@ class PthreadSharedMemProcEnv : public PthreadSharedMemEnvBase {
 };
 
 
+// Places every segment on NUMA node 0, which exists on any Linux system;
+// where mbind is unsupported the segments are simply left where they are.
+class PthreadSharedMemNumaEnv : public PthreadSharedMemProcEnv {
+ public:
+  virtual AbstractSharedMem* CreateSharedMemRuntime() {
+    AbstractSharedMem* shared_mem = new PthreadSharedMem();
+    shared_mem->SetNumaNodes(std::vector<int>(1, 0));
+    return shared_mem;
+  }
+};
+
+
 INSTANTIATE_TYPED_TEST_CASE_P(PthreadProc, SharedCircularBufferTestTemplate,
                               PthreadSharedMemProcEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(PthreadProc, SharedDynamicStringMapTestTemplate,
@@ -147,6 +159,10 @@ INSTANTIATE_TYPED_TEST_CASE_P(PthreadProc, SharedMemStatisticsTestTemplate,
                               PthreadSharedMemProcEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(PthreadProc, SharedMemTestTemplate,
                               PthreadSharedMemProcEnv);
+INSTANTIATE_TYPED_TEST_CASE_P(PthreadNuma, SharedMemCacheTestTemplate,
+                              PthreadSharedMemNumaEnv);
+INSTANTIATE_TYPED_TEST_CASE_P(PthreadNuma, SharedMemTestTemplate,
+                              PthreadSharedMemNumaEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(PthreadThread, SharedCircularBufferTestTemplate,
                               PthreadSharedMemThreadEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(PthreadThread, SharedDynamicStringMapTestTemplate,
@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+//
+// Measures SharedMemCache under concurrent Gets and Puts.  Each sector has
+// its own mutex, so unlike ThreadsafeCache this should keep scaling until
+// threads collide on sectors.  The segment is set up with PthreadSharedMem,
+// the implementation used by the servers, and shared between threads rather
+// than processes.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/sharedmem/shared_mem_cache.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/pthread_shared_mem.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_random.h"
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumKeys = 10000;
+const int kKeySize = 50;
+const int kPayloadSize = 100;
+const int kCacheSizeKb = 16 * 1024;
+const int kSectors = 64;
+const char kSegmentName[] = "/shared_mem_cache_speed_test_segment";
+
+typedef SharedMemCache<64> ShmCache;
+
+class EmptyCallback : public CacheInterface::Callback {
+ public:
+  EmptyCallback() {}
+  virtual ~EmptyCallback() {}
+  virtual void Done(CacheInterface::KeyState state) {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(EmptyCallback);
+};
+
+class CacheBody : public ThreadedBenchmark::Body {
+ public:
+  explicit CacheBody(bool do_puts)
+      : timer_(Platform::CreateTimer()),
+        do_puts_(do_puts) {
+    int entries, blocks;
+    int64 size_cap;
+    ShmCache::ComputeDimensions(
+        kCacheSizeKb, 2 /* block/entry ratio, as in SystemCaches */,
+        kSectors, &entries, &blocks, &size_cap);
+    cache_.reset(new ShmCache(&shm_runtime_, kSegmentName, timer_.get(),
+                              &hasher_, kSectors, entries, blocks,
+                              &handler_));
+    CHECK(cache_->Initialize());
+    CHECK(cache_->Attach());
+
+    SimpleRandom random(new NullMutex);
+    GoogleString key_prefix = random.GenerateHighEntropyString(kKeySize);
+    value_.Assign(random.GenerateHighEntropyString(kPayloadSize));
+    for (int i = 0; i < kNumKeys; ++i) {
+      keys_.push_back(StrCat(key_prefix, IntegerToString(i)));
+      cache_->Put(keys_.back(), value_);
+    }
+  }
+
+  virtual ~CacheBody() {
+    cache_.reset(NULL);
+    ShmCache::GlobalCleanup(&shm_runtime_, kSegmentName, &handler_);
+  }
+
+  virtual void RunIteration(int thread_index, int iteration) {
+    const GoogleString& key =
+        keys_[(thread_index * (kNumKeys / 7) + iteration) % kNumKeys];
+    if (do_puts_) {
+      cache_->Put(key, value_);
+    } else {
+      EmptyCallback callback;
+      cache_->Get(key, &callback);
+    }
+  }
+
+ private:
+  scoped_ptr<Timer> timer_;
+  PthreadSharedMem shm_runtime_;
+  MD5Hasher hasher_;
+  NullMessageHandler handler_;
+  scoped_ptr<ShmCache> cache_;
+  StringVector keys_;
+  SharedString value_;
+  bool do_puts_;
+
+  DISALLOW_COPY_AND_ASSIGN(CacheBody);
+};
+
+static void BM_SharedMemCacheGets(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  CacheBody body(false);
+  ThreadedBenchmark::Run("BM_SharedMemCacheGets", iters, num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemCacheGets, 1, 8);
+
+static void BM_SharedMemCachePuts(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  CacheBody body(true);
+  ThreadedBenchmark::Run("BM_SharedMemCachePuts", iters, num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemCachePuts, 1, 8);
+
+}  // namespace
+
+}  // namespace net_instaweb
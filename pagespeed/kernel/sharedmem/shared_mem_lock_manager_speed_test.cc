@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+//
+// Measures lock/unlock through SharedMemLockManager from several threads.
+// Locks whose names hash to the same bucket share a mutex, so distinct
+// per-thread names mostly proceed in parallel while a single hot name makes
+// every thread contend for the same bucket and the same lock slot.  Locks
+// are requested with a zero wait, so with a hot name an attempt that finds
+// the lock held gives up after the usual busy-spin; the iteration still
+// counts.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/pthread_shared_mem.h"
+#include "pagespeed/kernel/thread/scheduler.h"
+#include "pagespeed/kernel/thread/scheduler_based_abstract_lock.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kMaxThreads = 8;
+const char kPath[] = "/shared_mem_lock_manager_speed_test";
+
+class LockBody : public ThreadedBenchmark::Body {
+ public:
+  explicit LockBody(bool hot_name)
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(Platform::CreateTimer()),
+        scheduler_(thread_system_.get(), timer_.get()) {
+    lock_manager_.reset(new SharedMemLockManager(
+        &shm_runtime_, kPath, &scheduler_, &hasher_, &handler_));
+    CHECK(lock_manager_->Initialize());
+    for (int i = 0; i < kMaxThreads; ++i) {
+      GoogleString name =
+          hot_name ? GoogleString("hot") : StrCat("lock", IntegerToString(i));
+      locks_.push_back(lock_manager_->CreateNamedLock(name));
+    }
+  }
+
+  virtual ~LockBody() {
+    STLDeleteElements(&locks_);
+    lock_manager_.reset(NULL);
+    SharedMemLockManager::GlobalCleanup(&shm_runtime_, kPath, &handler_);
+  }
+
+  virtual void RunIteration(int thread_index, int iteration) {
+    SchedulerBasedAbstractLock* lock = locks_[thread_index % kMaxThreads];
+    if (lock->LockTimedWait(0)) {
+      lock->Unlock();
+    }
+  }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<Timer> timer_;
+  Scheduler scheduler_;
+  PthreadSharedMem shm_runtime_;
+  MD5Hasher hasher_;
+  NullMessageHandler handler_;
+  scoped_ptr<SharedMemLockManager> lock_manager_;
+  std::vector<SchedulerBasedAbstractLock*> locks_;
+
+  DISALLOW_COPY_AND_ASSIGN(LockBody);
+};
+
+static void BM_SharedMemLockManagerPerThreadNames(int iters,
+                                                  int num_threads) {
+  StopBenchmarkTiming();
+  LockBody body(false);
+  ThreadedBenchmark::Run("BM_SharedMemLockManagerPerThreadNames", iters,
+                         num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemLockManagerPerThreadNames, 1, kMaxThreads);
+
+static void BM_SharedMemLockManagerHotName(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  LockBody body(true);
+  ThreadedBenchmark::Run("BM_SharedMemLockManagerHotName", iters, num_threads,
+                         &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemLockManagerHotName, 1, kMaxThreads);
+
+}  // namespace
+
+}  // namespace net_instaweb
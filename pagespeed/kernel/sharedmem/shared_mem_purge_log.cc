@@ -0,0 +1,232 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include "pagespeed/kernel/sharedmem/shared_mem_purge_log.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+namespace SharedMemPurgeLogData {
+
+// Memory structure:
+//
+//  Mutex
+//  (pad to 64-byte alignment)
+//  Header
+//    next sequence number (64-bit)
+//    purge file mtime in seconds (64-bit)
+//  Slot 0
+//    sequence number (64-bit)
+//    timestamp in ms (64-bit)
+//    global flag (32-bit)
+//    url size, or -1 for a reload request (32-bit)
+//    url bytes
+//  ...
+//  Slot capacity - 1
+//
+// The record with sequence number N lives in slot N % capacity.  Each slot
+// keeps its own sequence number so a reader can tell when the slot it wants
+// has already been recycled.
+
+struct Header {
+  int64 next_sequence;
+  int64 file_mtime_sec;
+};
+
+struct Slot {
+  int64 sequence;
+  int64 timestamp_ms;
+  int32 global;
+  int32 url_size;
+  char url[SharedMemPurgeLog::kMaxUrlSize];
+};
+
+const int32 kReloadUrlSize = -1;
+
+inline size_t Align64(size_t in) {
+  return (in + 63) & ~63;
+}
+
+}  // namespace SharedMemPurgeLogData
+
+namespace Data = SharedMemPurgeLogData;
+
+const int SharedMemPurgeLog::kMaxUrlSize;
+const int SharedMemPurgeLog::kDefaultCapacity;
+
+SharedMemPurgeLog::SharedMemPurgeLog(AbstractSharedMem* shm,
+                                     const GoogleString& path,
+                                     int capacity,
+                                     MessageHandler* handler)
+    : shm_runtime_(shm),
+      path_(path),
+      capacity_(capacity),
+      handler_(handler) {
+  CHECK_GT(capacity_, 0);
+}
+
+SharedMemPurgeLog::~SharedMemPurgeLog() {
+}
+
+size_t SharedMemPurgeLog::SegmentSize() const {
+  return Data::Align64(shm_runtime_->SharedMutexSize()) +
+      sizeof(Data::Header) + capacity_ * sizeof(Data::Slot);
+}
+
+bool SharedMemPurgeLog::Initialize() {
+  segment_.reset(shm_runtime_->CreateSegment(path_, SegmentSize(), handler_));
+  if (segment_.get() == NULL) {
+    handler_->MessageS(kError,
+                       "Unable to create memory segment for purge log.");
+    return false;
+  }
+  if (!segment_->InitializeSharedMutex(0, handler_)) {
+    handler_->MessageS(kError, "Unable to create purge log mutex.");
+    segment_.reset(NULL);
+    shm_runtime_->DestroySegment(path_, handler_);
+    return false;
+  }
+  mutex_.reset(segment_->AttachToSharedMutex(0));
+
+  // Mark every slot as never written, so that the first lap around the
+  // ring can't be mistaken for overwritten records.
+  Data::Header* h = header();
+  h->next_sequence = 0;
+  h->file_mtime_sec = 0;
+  for (int i = 0; i < capacity_; ++i) {
+    slot(i)->sequence = -1;
+  }
+  return true;
+}
+
+bool SharedMemPurgeLog::Attach() {
+  segment_.reset(shm_runtime_->AttachToSegment(path_, SegmentSize(),
+                                               handler_));
+  if (segment_.get() == NULL) {
+    handler_->MessageS(kWarning, "Unable to attach to purge log SHM segment");
+    return false;
+  }
+  mutex_.reset(segment_->AttachToSharedMutex(0));
+  return true;
+}
+
+void SharedMemPurgeLog::GlobalCleanup(
+    AbstractSharedMem* shm, const GoogleString& path,
+    MessageHandler* handler) {
+  shm->DestroySegment(path, handler);
+}
+
+Data::Header* SharedMemPurgeLog::header() {
+  return reinterpret_cast<Data::Header*>(
+      const_cast<char*>(segment_->Base()) +
+      Data::Align64(shm_runtime_->SharedMutexSize()));
+}
+
+Data::Slot* SharedMemPurgeLog::slot(int64 sequence) {
+  Data::Slot* slots = reinterpret_cast<Data::Slot*>(header() + 1);
+  return slots + (sequence % capacity_);
+}
+
+void SharedMemPurgeLog::AppendLocked(bool global, int64 timestamp_ms,
+                                     StringPiece url, int url_size) {
+  Data::Header* h = header();
+  int64 sequence = h->next_sequence;
+  Data::Slot* s = slot(sequence);
+  s->sequence = sequence;
+  s->timestamp_ms = timestamp_ms;
+  s->global = global ? 1 : 0;
+  s->url_size = url_size;
+  if (url_size > 0) {
+    memcpy(s->url, url.data(), url_size);
+  }
+  h->next_sequence = sequence + 1;
+}
+
+void SharedMemPurgeLog::AppendUrl(StringPiece url, int64 timestamp_ms) {
+  ScopedMutex lock(mutex_.get());
+  if (url.size() > static_cast<size_t>(kMaxUrlSize)) {
+    AppendLocked(false, timestamp_ms, StringPiece(), Data::kReloadUrlSize);
+  } else {
+    AppendLocked(false, timestamp_ms, url, url.size());
+  }
+}
+
+void SharedMemPurgeLog::AppendGlobal(int64 timestamp_ms) {
+  ScopedMutex lock(mutex_.get());
+  AppendLocked(true, timestamp_ms, StringPiece(), 0);
+}
+
+void SharedMemPurgeLog::AppendReload() {
+  ScopedMutex lock(mutex_.get());
+  AppendLocked(false, 0, StringPiece(), Data::kReloadUrlSize);
+}
+
+int64 SharedMemPurgeLog::NextSequence() {
+  ScopedMutex lock(mutex_.get());
+  return header()->next_sequence;
+}
+
+bool SharedMemPurgeLog::ReadSince(int64* sequence,
+                                  std::vector<Entry>* entries) {
+  ScopedMutex lock(mutex_.get());
+  int64 next_sequence = header()->next_sequence;
+  int64 start = *sequence;
+  *sequence = next_sequence;
+
+  // Anything older than one lap behind the writer has been overwritten.
+  if ((start < 0) || (next_sequence - start > capacity_)) {
+    return false;
+  }
+  for (int64 i = start; i < next_sequence; ++i) {
+    const Data::Slot* s = slot(i);
+    if ((s->sequence != i) || (s->url_size == Data::kReloadUrlSize)) {
+      return false;
+    }
+    entries->push_back(Entry());
+    Entry& entry = entries->back();
+    entry.global = (s->global != 0);
+    entry.timestamp_ms = s->timestamp_ms;
+    entry.url.assign(s->url, s->url_size);
+  }
+  return true;
+}
+
+int64 SharedMemPurgeLog::file_mtime_sec() {
+  ScopedMutex lock(mutex_.get());
+  return header()->file_mtime_sec;
+}
+
+void SharedMemPurgeLog::set_file_mtime_sec(int64 mtime_sec) {
+  ScopedMutex lock(mutex_.get());
+  header()->file_mtime_sec = mtime_sec;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_PURGE_LOG_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_PURGE_LOG_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+class AbstractMutex;
+class AbstractSharedMem;
+class AbstractSharedMemSegment;
+class MessageHandler;
+
+namespace SharedMemPurgeLogData {
+
+struct Header;
+struct Slot;
+
+}  // namespace SharedMemPurgeLogData
+
+// A fixed-size ring of recent cache purges, kept in shared memory so that
+// a purge recorded by one process can be picked up by every other process
+// without re-reading the cache purge file.  Each record is stamped with a
+// sequence number; readers remember the next sequence they expect and copy
+// out just the records appended since then.
+//
+// When a reader falls more than capacity() records behind, or meets a
+// record that could not be represented in the ring (e.g. a URL longer than
+// kMaxUrlSize), ReadSince reports that the reader must fall back to the
+// purge file, which remains the source of truth.
+//
+// Note that you must call Initialize() in the root process, and Attach in
+// child processes to finish the initialization.
+class SharedMemPurgeLog {
+ public:
+  // Longest URL that fits in a ring slot.
+  static const int kMaxUrlSize = 1024;
+
+  // Number of records kept by default.
+  static const int kDefaultCapacity = 1024;
+
+  // A purge copied out of the ring.  When global is true, timestamp_ms is a
+  // new global invalidation timestamp and url is empty.
+  struct Entry {
+    Entry() : global(false), timestamp_ms(0) {}
+    bool global;
+    int64 timestamp_ms;
+    GoogleString url;
+  };
+
+  SharedMemPurgeLog(AbstractSharedMem* shm, const GoogleString& path,
+                    int capacity, MessageHandler* handler);
+  ~SharedMemPurgeLog();
+
+  // Sets up our shared state for use of all child processes. Returns
+  // whether successful.
+  bool Initialize();
+
+  // Connects to already initialized state from a child process.
+  // Returns whether successful.
+  bool Attach();
+
+  // This should be called from the root process as it is about to exit,
+  // with the same shm and path as were passed to the constructor of the
+  // instance on which Initialize() was called.
+  static void GlobalCleanup(AbstractSharedMem* shm, const GoogleString& path,
+                            MessageHandler* message_handler);
+
+  // Records a purge of url as of timestamp_ms.  URLs that don't fit in a
+  // slot are recorded as a reload request instead.
+  void AppendUrl(StringPiece url, int64 timestamp_ms);
+
+  // Records a new global invalidation timestamp.
+  void AppendGlobal(int64 timestamp_ms);
+
+  // Records that the purge file has changed in a way not captured by the
+  // ring, so all readers must re-read it.
+  void AppendReload();
+
+  // Returns the sequence number the next appended record will get.
+  int64 NextSequence();
+
+  // Copies the records from *sequence up to NextSequence() into *entries,
+  // and advances *sequence past them.  Returns false if any of those
+  // records have been overwritten or is a reload request, in which case
+  // *sequence is still advanced but the caller must re-read the purge file.
+  bool ReadSince(int64* sequence, std::vector<Entry>* entries);
+
+  // The mtime of the purge file as of the last write that was reflected in
+  // the ring.  Used to detect edits made to the file behind our back.
+  int64 file_mtime_sec();
+  void set_file_mtime_sec(int64 mtime_sec);
+
+  int capacity() const { return capacity_; }
+
+ private:
+  // Appends a record while holding mutex_.  url_size of -1 marks a reload.
+  void AppendLocked(bool global, int64 timestamp_ms, StringPiece url,
+                    int url_size);
+
+  SharedMemPurgeLogData::Header* header();
+  SharedMemPurgeLogData::Slot* slot(int64 sequence);
+  size_t SegmentSize() const;
+
+  AbstractSharedMem* shm_runtime_;
+  GoogleString path_;
+  int capacity_;
+  MessageHandler* handler_;
+  scoped_ptr<AbstractSharedMemSegment> segment_;
+  scoped_ptr<AbstractMutex> mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemPurgeLog);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_PURGE_LOG_H_
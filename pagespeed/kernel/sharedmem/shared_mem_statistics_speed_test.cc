@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+//
+// Measures SharedMemStatistics updates from several threads.  Every
+// variable and histogram has its own mutex in the shared segment, so a
+// single hot counter serializes all threads while per-thread counters
+// should scale.  Histogram updates hold their mutex longer, to find the
+// bucket and update the running sums.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/mem_file_system.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/pthread_shared_mem.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kMaxThreads = 8;
+const char kPrefix[] = "/shared_mem_statistics_speed_test";
+const char kSharedVariable[] = "shared";
+const char kHistogram[] = "histogram";
+
+enum Target {
+  kUpdateSharedVariable,
+  kUpdatePerThreadVariable,
+  kUpdateHistogram,
+};
+
+GoogleString PerThreadVariableName(int thread_index) {
+  return StrCat("per_thread_", IntegerToString(thread_index));
+}
+
+class StatisticsBody : public ThreadedBenchmark::Body {
+ public:
+  explicit StatisticsBody(Target target)
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(Platform::CreateTimer()),
+        file_system_(thread_system_.get(), timer_.get()),
+        target_(target) {
+    stats_.reset(new SharedMemStatistics(
+        3 * Timer::kSecondMs, 10 /* max_logfile_size_kb */,
+        "" /* logging_file */, false /* logging */, kPrefix, &shm_runtime_,
+        &handler_, &file_system_, timer_.get()));
+    shared_ = stats_->AddVariable(kSharedVariable);
+    for (int i = 0; i < kMaxThreads; ++i) {
+      per_thread_.push_back(stats_->AddVariable(PerThreadVariableName(i)));
+    }
+    histogram_ = stats_->AddHistogram(kHistogram);
+    histogram_->SetMaxValue(1000);
+    CHECK(stats_->Init(true, &handler_));
+  }
+
+  virtual ~StatisticsBody() {
+    stats_->GlobalCleanup(&handler_);
+  }
+
+  virtual void RunIteration(int thread_index, int iteration) {
+    switch (target_) {
+      case kUpdateSharedVariable:
+        shared_->Add(1);
+        break;
+      case kUpdatePerThreadVariable:
+        per_thread_[thread_index % kMaxThreads]->Add(1);
+        break;
+      case kUpdateHistogram:
+        histogram_->Add(iteration % 1000);
+        break;
+    }
+  }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<Timer> timer_;
+  MemFileSystem file_system_;
+  PthreadSharedMem shm_runtime_;
+  NullMessageHandler handler_;
+  scoped_ptr<SharedMemStatistics> stats_;
+  Variable* shared_;
+  std::vector<Variable*> per_thread_;
+  Histogram* histogram_;
+  Target target_;
+
+  DISALLOW_COPY_AND_ASSIGN(StatisticsBody);
+};
+
+static void BM_SharedMemStatisticsSharedVariable(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  StatisticsBody body(kUpdateSharedVariable);
+  ThreadedBenchmark::Run("BM_SharedMemStatisticsSharedVariable", iters,
+                         num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemStatisticsSharedVariable, 1, kMaxThreads);
+
+static void BM_SharedMemStatisticsPerThreadVariable(int iters,
+                                                    int num_threads) {
+  StopBenchmarkTiming();
+  StatisticsBody body(kUpdatePerThreadVariable);
+  ThreadedBenchmark::Run("BM_SharedMemStatisticsPerThreadVariable", iters,
+                         num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemStatisticsPerThreadVariable, 1,
+                       kMaxThreads);
+
+static void BM_SharedMemStatisticsHistogram(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  StatisticsBody body(kUpdateHistogram);
+  ThreadedBenchmark::Run("BM_SharedMemStatisticsHistogram", iters,
+                         num_threads, &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SharedMemStatisticsHistogram, 1, kMaxThreads);
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -0,0 +1,274 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "pagespeed/kernel/thread/lock_profiler.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+base::subtle::Atomic32 LockProfiler::enabled_ = 0;
+base::subtle::Atomic32 LockProfiler::sample_period_ =
+    LockProfiler::kDefaultSamplePeriod;
+
+namespace {
+
+// Number of distinct call sites each thread can track.  Must be a power of
+// two.  Acquisitions from further call sites are lumped together.
+const int kTableSize = 256;
+
+// A thread's samples.  Only the owning thread writes to a table, but
+// snapshots read it from other threads, so the owner takes the table's
+// mutex for each sample it records.  That mutex is a raw pthread mutex and
+// is never contended except by a snapshot.
+struct ThreadTable {
+  ThreadTable() : prev(NULL), next(NULL) {
+    pthread_mutex_init(&mutex, NULL);
+  }
+  ~ThreadTable() {
+    pthread_mutex_destroy(&mutex);
+  }
+
+  void Clear() {
+    for (int i = 0; i <= kTableSize; ++i) {
+      sites[i] = LockProfiler::CallSite();
+    }
+  }
+
+  pthread_mutex_t mutex;
+  // Open-addressed on pc; the extra entry at kTableSize is the overflow.
+  LockProfiler::CallSite sites[kTableSize + 1];
+  ThreadTable* prev;
+  ThreadTable* next;
+};
+
+typedef std::map<const void*, LockProfiler::CallSite> CallSiteMap;
+
+// All live tables, plus the merged tables of threads that have exited.
+pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+ThreadTable* live_tables = NULL;
+CallSiteMap* retired_sites = NULL;
+
+pthread_once_t table_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t table_key;
+
+thread_local ThreadTable* thread_table = NULL;
+thread_local int samples_countdown = 0;
+
+void MergeInto(const LockProfiler::CallSite& site, CallSiteMap* sites) {
+  if (site.acquisitions == 0) {
+    return;
+  }
+  LockProfiler::CallSite* merged = &(*sites)[site.pc];
+  merged->pc = site.pc;
+  merged->acquisitions += site.acquisitions;
+  merged->contentions += site.contentions;
+  merged->wait_us += site.wait_us;
+}
+
+// Runs when a thread that recorded samples exits, keeping its samples.
+void RetireTable(void* arg) {
+  ThreadTable* table = static_cast<ThreadTable*>(arg);
+  pthread_mutex_lock(&registry_mutex);
+  if (retired_sites == NULL) {
+    retired_sites = new CallSiteMap;
+  }
+  for (int i = 0; i <= kTableSize; ++i) {
+    MergeInto(table->sites[i], retired_sites);
+  }
+  if (table->prev != NULL) {
+    table->prev->next = table->next;
+  } else {
+    live_tables = table->next;
+  }
+  if (table->next != NULL) {
+    table->next->prev = table->prev;
+  }
+  pthread_mutex_unlock(&registry_mutex);
+  delete table;
+  // Key destructors run on the exiting thread, so this is its thread_table.
+  // Clearing it means a lock taken by a later destructor on this thread
+  // starts a fresh table rather than writing to the one just deleted.
+  thread_table = NULL;
+}
+
+void CreateTableKey() {
+  pthread_key_create(&table_key, RetireTable);
+}
+
+ThreadTable* GetThreadTable() {
+  if (thread_table == NULL) {
+    pthread_once(&table_key_once, CreateTableKey);
+    ThreadTable* table = new ThreadTable;
+    pthread_mutex_lock(&registry_mutex);
+    table->next = live_tables;
+    if (live_tables != NULL) {
+      live_tables->prev = table;
+    }
+    live_tables = table;
+    pthread_mutex_unlock(&registry_mutex);
+    pthread_setspecific(table_key, table);
+    thread_table = table;
+  }
+  return thread_table;
+}
+
+void Record(const void* pc, int weight, bool contended, int64 wait_us) {
+  ThreadTable* table = GetThreadTable();
+  uintptr_t hash = reinterpret_cast<uintptr_t>(pc);
+  hash ^= hash >> 16;
+  pthread_mutex_lock(&table->mutex);
+  LockProfiler::CallSite* site = &table->sites[kTableSize];
+  for (int probe = 0; probe < kTableSize; ++probe) {
+    LockProfiler::CallSite* candidate =
+        &table->sites[(hash + probe) & (kTableSize - 1)];
+    if (candidate->pc == pc || candidate->pc == NULL) {
+      site = candidate;
+      break;
+    }
+  }
+  if (site != &table->sites[kTableSize]) {
+    site->pc = pc;
+  }
+  site->acquisitions += weight;
+  if (contended) {
+    site->contentions += weight;
+    site->wait_us += weight * wait_us;
+  }
+  pthread_mutex_unlock(&table->mutex);
+}
+
+int64 MonotonicNowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool CompareWait(const LockProfiler::CallSite& a,
+                 const LockProfiler::CallSite& b) {
+  if (a.wait_us != b.wait_us) {
+    return a.wait_us > b.wait_us;
+  }
+  return a.acquisitions > b.acquisitions;
+}
+
+}  // namespace
+
+void LockProfiler::Enable(int sample_period) {
+  base::subtle::NoBarrier_Store(&sample_period_, std::max(sample_period, 1));
+  base::subtle::Release_Store(&enabled_, 1);
+}
+
+void LockProfiler::Disable() {
+  base::subtle::Release_Store(&enabled_, 0);
+}
+
+void LockProfiler::Lock(pthread_mutex_t* mutex, const void* call_site) {
+  if (--samples_countdown > 0) {
+    pthread_mutex_lock(mutex);
+    return;
+  }
+  int weight = sample_period();
+  samples_countdown = weight;
+  if (pthread_mutex_trylock(mutex) == 0) {
+    Record(call_site, weight, false, 0);
+    return;
+  }
+  int64 start_us = MonotonicNowUs();
+  pthread_mutex_lock(mutex);
+  Record(call_site, weight, true, MonotonicNowUs() - start_us);
+}
+
+void LockProfiler::Snapshot(CallSiteVector* sites) {
+  CallSiteMap merged;
+  pthread_mutex_lock(&registry_mutex);
+  if (retired_sites != NULL) {
+    merged = *retired_sites;
+  }
+  for (ThreadTable* table = live_tables; table != NULL; table = table->next) {
+    pthread_mutex_lock(&table->mutex);
+    for (int i = 0; i <= kTableSize; ++i) {
+      MergeInto(table->sites[i], &merged);
+    }
+    pthread_mutex_unlock(&table->mutex);
+  }
+  pthread_mutex_unlock(&registry_mutex);
+
+  sites->clear();
+  for (CallSiteMap::const_iterator p = merged.begin(); p != merged.end();
+       ++p) {
+    sites->push_back(p->second);
+  }
+  std::sort(sites->begin(), sites->end(), CompareWait);
+}
+
+void LockProfiler::Reset() {
+  pthread_mutex_lock(&registry_mutex);
+  if (retired_sites != NULL) {
+    retired_sites->clear();
+  }
+  for (ThreadTable* table = live_tables; table != NULL; table = table->next) {
+    pthread_mutex_lock(&table->mutex);
+    table->Clear();
+    pthread_mutex_unlock(&table->mutex);
+  }
+  pthread_mutex_unlock(&registry_mutex);
+}
+
+GoogleString LockProfiler::SymbolizeCallSite(const void* pc) {
+  if (pc == NULL) {
+    return "(other call sites)";
+  }
+  Dl_info info;
+  if (dladdr(pc, &info) == 0 || info.dli_fname == NULL) {
+    return StringPrintf("%p", pc);
+  }
+  const char* base = static_cast<const char*>(info.dli_fbase);
+  if (info.dli_sname != NULL && info.dli_saddr != NULL) {
+    int status = 0;
+    char* demangled =
+        abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    GoogleString name = (status == 0) ? demangled : info.dli_sname;
+    free(demangled);
+    base = static_cast<const char*>(info.dli_saddr);
+    return StringPrintf("%s+0x%lx", name.c_str(),
+                        static_cast<unsigned long>(  // NOLINT
+                            static_cast<const char*>(pc) - base));
+  }
+  StringPiece object(info.dli_fname);
+  stringpiece_ssize_type slash = object.rfind('/');
+  if (slash != StringPiece::npos) {
+    object.remove_prefix(slash + 1);
+  }
+  return StringPrintf("%s+0x%lx", object.as_string().c_str(),
+                      static_cast<unsigned long>(  // NOLINT
+                          static_cast<const char*>(pc) - base));
+}
+
+}  // namespace net_instaweb
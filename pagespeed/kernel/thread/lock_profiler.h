@@ -0,0 +1,96 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_THREAD_LOCK_PROFILER_H_
+#define PAGESPEED_KERNEL_THREAD_LOCK_PROFILER_H_
+
+#include <pthread.h>
+#include <vector>
+
+#include "pagespeed/kernel/base/atomicops.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+
+namespace net_instaweb {
+
+// Samples lock acquisitions made through PthreadMutex and the pthread
+// shared-memory mutexes, and attributes each sample to the code that called
+// Lock().  Every thread records its samples into its own table, so the
+// profiler adds no shared state to the locks it observes; the tables are
+// merged only when a snapshot is taken.  Counts and wait times are scaled
+// by the sample period, so they estimate the totals across all acquisitions.
+//
+// The profiler is off by default.  While it is off, the mutexes pay a
+// single relaxed load of a global flag per Lock().  Profiles are per
+// process: in a multi-process server each child has its own tables.
+class LockProfiler {
+ public:
+  struct CallSite {
+    CallSite() : pc(NULL), acquisitions(0), contentions(0), wait_us(0) {}
+
+    // Return address of the call to Lock(), or NULL for acquisitions that
+    // did not fit into a full per-thread table.
+    const void* pc;
+    int64 acquisitions;
+    int64 contentions;  // Acquisitions that found the lock held.
+    int64 wait_us;      // Time spent blocked in the contended acquisitions.
+  };
+  typedef std::vector<CallSite> CallSiteVector;
+
+  // By default, one acquisition in this many is timed and recorded.
+  static const int kDefaultSamplePeriod = 100;
+
+  static bool enabled() {
+    return base::subtle::NoBarrier_Load(&enabled_) != 0;
+  }
+
+  // Starts sampling one acquisition in sample_period on every thread.
+  static void Enable(int sample_period);
+  static void Disable();
+  static int sample_period() {
+    return base::subtle::NoBarrier_Load(&sample_period_);
+  }
+
+  // Acquires *mutex on behalf of the code at call_site, recording the
+  // acquisition if it is sampled.  Callers check enabled() first, so that
+  // the disabled path stays inline.
+  static void Lock(pthread_mutex_t* mutex, const void* call_site);
+
+  // Merges the tables of all threads, live and exited, into *sites, ordered
+  // by decreasing wait time.
+  static void Snapshot(CallSiteVector* sites);
+
+  // Discards everything recorded so far.
+  static void Reset();
+
+  // Describes pc as "function+0xoffset" when the symbol is exported, or as
+  // "object+0xoffset", suitable for addr2line, when it is not.
+  static GoogleString SymbolizeCallSite(const void* pc);
+
+ private:
+  static base::subtle::Atomic32 enabled_;
+  static base::subtle::Atomic32 sample_period_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(LockProfiler);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_THREAD_LOCK_PROFILER_H_
@@ -0,0 +1,165 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test LockProfiler.
+
+#include "pagespeed/kernel/thread/lock_profiler.h"
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/pthread_thread_system.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Holds a mutex for a while, so that the main thread has to wait for it.
+class HolderThread : public ThreadSystem::Thread {
+ public:
+  HolderThread(AbstractMutex* mutex, ThreadSystem* thread_system)
+      : Thread(thread_system, "holder", ThreadSystem::kJoinable),
+        mutex_(mutex),
+        timer_(thread_system->NewTimer()) {
+  }
+
+  bool holding() const { return holding_.value(); }
+
+ protected:
+  virtual void Run() {
+    mutex_->Lock();
+    holding_.set_value(true);
+    timer_->SleepMs(20);
+    mutex_->Unlock();
+  }
+
+ private:
+  AbstractMutex* mutex_;
+  scoped_ptr<Timer> timer_;
+  AtomicBool holding_;
+
+  DISALLOW_COPY_AND_ASSIGN(HolderThread);
+};
+
+}  // namespace
+
+class LockProfilerTest : public testing::Test {
+ protected:
+  LockProfilerTest()
+      : thread_system_(new PthreadThreadSystem),
+        mutex_(thread_system_->NewMutex()) {
+    LockProfiler::Reset();
+  }
+
+  virtual ~LockProfilerTest() {
+    LockProfiler::Disable();
+    LockProfiler::Reset();
+  }
+
+  void LockAndUnlock(int times) {
+    for (int i = 0; i < times; ++i) {
+      mutex_->Lock();
+      mutex_->Unlock();
+    }
+  }
+
+  // Returns the total recorded across all call sites.
+  LockProfiler::CallSite Total() {
+    LockProfiler::CallSiteVector sites;
+    LockProfiler::Snapshot(&sites);
+    LockProfiler::CallSite total;
+    for (int i = 0, n = sites.size(); i < n; ++i) {
+      total.acquisitions += sites[i].acquisitions;
+      total.contentions += sites[i].contentions;
+      total.wait_us += sites[i].wait_us;
+    }
+    return total;
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<AbstractMutex> mutex_;
+};
+
+TEST_F(LockProfilerTest, DisabledRecordsNothing) {
+  EXPECT_FALSE(LockProfiler::enabled());
+  LockAndUnlock(10);
+  LockProfiler::CallSiteVector sites;
+  LockProfiler::Snapshot(&sites);
+  EXPECT_TRUE(sites.empty());
+}
+
+TEST_F(LockProfilerTest, UncontendedFromOneCallSite) {
+  LockProfiler::Enable(1);
+  LockAndUnlock(50);
+  LockProfiler::CallSiteVector sites;
+  LockProfiler::Snapshot(&sites);
+  ASSERT_EQ(1, sites.size());
+  EXPECT_TRUE(sites[0].pc != NULL);
+  EXPECT_EQ(50, sites[0].acquisitions);
+  EXPECT_EQ(0, sites[0].contentions);
+  EXPECT_EQ(0, sites[0].wait_us);
+  EXPECT_FALSE(LockProfiler::SymbolizeCallSite(sites[0].pc).empty());
+}
+
+TEST_F(LockProfilerTest, SampledCountsAreScaled) {
+  LockProfiler::Enable(10);
+  LockAndUnlock(100);
+  EXPECT_EQ(100, Total().acquisitions);
+}
+
+TEST_F(LockProfilerTest, ContentionAndExitedThreads) {
+  LockProfiler::Enable(1);
+  HolderThread holder(mutex_.get(), thread_system_.get());
+  ASSERT_TRUE(holder.Start());
+  scoped_ptr<Timer> timer(thread_system_->NewTimer());
+  while (!holder.holding()) {
+    timer->SleepMs(1);
+  }
+  mutex_->Lock();
+  mutex_->Unlock();
+  holder.Join();
+
+  // The holder's acquisition is kept after its thread exits.
+  LockProfiler::CallSite total = Total();
+  EXPECT_EQ(2, total.acquisitions);
+  EXPECT_EQ(1, total.contentions);
+  EXPECT_LT(0, total.wait_us);
+}
+
+TEST_F(LockProfilerTest, Reset) {
+  LockProfiler::Enable(1);
+  LockAndUnlock(5);
+  EXPECT_EQ(5, Total().acquisitions);
+  LockProfiler::Reset();
+  EXPECT_EQ(0, Total().acquisitions);
+  LockAndUnlock(3);
+  EXPECT_EQ(3, Total().acquisitions);
+}
+
+TEST_F(LockProfilerTest, SymbolizeOverflow) {
+  EXPECT_EQ("(other call sites)", LockProfiler::SymbolizeCallSite(NULL));
+}
+
+}  // namespace net_instaweb
@@ -21,6 +21,7 @@
 #include "pagespeed/kernel/thread/pthread_mutex.h"
 
 #include <pthread.h>
+#include "pagespeed/kernel/thread/lock_profiler.h"
 #include "pagespeed/kernel/thread/pthread_condvar.h"
 #include "pagespeed/kernel/base/condvar.h"
 #include "pagespeed/kernel/base/thread_system.h"
@@ -40,7 +41,11 @@ bool PthreadMutex::TryLock() {
 }
 
 void PthreadMutex::Lock() {
-  pthread_mutex_lock(&mutex_);
+  if (LockProfiler::enabled()) {
+    LockProfiler::Lock(&mutex_, __builtin_return_address(0));
+  } else {
+    pthread_mutex_lock(&mutex_);
+  }
 }
 
 void PthreadMutex::Unlock() {
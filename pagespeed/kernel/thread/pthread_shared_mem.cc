@@ -23,11 +23,16 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <sys/mman.h>
+#ifdef linux
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
 #include <unistd.h>
 #include <cerrno>
 #include <cstddef>
 #include <map>
 #include <utility>
+#include <vector>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_shared_mem.h"
@@ -36,6 +41,7 @@
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/thread/lock_profiler.h"
 
 namespace net_instaweb {
 
@@ -68,7 +74,11 @@ class PthreadSharedMemMutex : public AbstractMutex {
   }
 
   virtual void Lock() {
-    pthread_mutex_lock(external_mutex_);
+    if (LockProfiler::enabled()) {
+      LockProfiler::Lock(external_mutex_, __builtin_return_address(0));
+    } else {
+      pthread_mutex_lock(external_mutex_);
+    }
   }
 
   virtual void Unlock() {
@@ -184,12 +194,46 @@ AbstractSharedMemSegment* PthreadSharedMem::CreateSegment(
     return NULL;
   }
 
+  // The policy is attached to the mapping before any page is touched, so
+  // it governs where every page of the segment is allocated, in this
+  // process and in the children that inherit the mapping.
+#if defined(linux) && defined(SYS_mbind)
+  if (!numa_nodes_.empty()) {
+    uint64 node_mask = 0;
+    for (int i = 0, n = numa_nodes_.size(); i < n; ++i) {
+      node_mask |= static_cast<uint64>(1) << numa_nodes_[i];
+    }
+    int mode = (numa_nodes_.size() == 1) ? MPOL_BIND : MPOL_INTERLEAVE;
+    // maxnode is one more than the number of bits the kernel reads.
+    if (syscall(SYS_mbind, base, size, mode, &node_mask,
+                kMaxNumaNodes + 1, 0) != 0) {
+      handler->Message(
+          kWarning, "Unable to place SHM segment %s on NUMA nodes, mbind "
+          "failed with errno=%d.", prefixed_name.c_str(), errno);
+    }
+  }
+#endif
+
   SegmentBaseMap* bases = AcquireSegmentBases();
   (*bases)[prefixed_name] = std::make_pair(base, size);
   UnlockSegmentBases();
   return new PthreadSharedMemSegment(base, size, handler);
 }
 
+bool PthreadSharedMem::SetNumaNodes(const std::vector<int>& nodes) {
+#if defined(linux) && defined(SYS_mbind)
+  for (int i = 0, n = nodes.size(); i < n; ++i) {
+    if ((nodes[i] < 0) || (nodes[i] >= kMaxNumaNodes)) {
+      return false;
+    }
+  }
+  numa_nodes_ = nodes;
+  return true;
+#else
+  return false;
+#endif
+}
+
 AbstractSharedMemSegment* PthreadSharedMem::AttachToSegment(
     const GoogleString& name, size_t size, MessageHandler* handler) {
   GoogleString prefixed_name = PrefixSegmentName(name);
@@ -24,6 +24,7 @@
 #include <cstddef>
 #include <map>
 #include <utility>
+#include <vector>
 
 #include "pagespeed/kernel/base/abstract_shared_mem.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -55,6 +56,12 @@ class PthreadSharedMem : public AbstractSharedMem {
   virtual void DestroySegment(const GoogleString& name,
                               MessageHandler* handler);
 
+  // Supported on Linux, using mbind(2).  Node numbers must be below
+  // kMaxNumaNodes.
+  virtual bool SetNumaNodes(const std::vector<int>& nodes);
+
+  static const int kMaxNumaNodes = 64;
+
   // Frees all lazy-initialized memory used to track shared-memory segments.
   static void Terminate();
 
@@ -82,6 +89,8 @@ class PthreadSharedMem : public AbstractSharedMem {
   // created, before destroying the old one.
   size_t instance_number_;
 
+  std::vector<int> numa_nodes_;
+
   DISALLOW_COPY_AND_ASSIGN(PthreadSharedMem);
 };
 
@@ -22,8 +22,10 @@
 
 #ifdef linux
 #include <features.h>
+#include <sched.h>
 #endif
 #include <pthread.h>
+#include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/posix_timer.h"
@@ -162,4 +164,23 @@ ThreadSystem::ThreadId* PthreadThreadSystem::GetThreadId() const {
   return new PthreadId;
 }
 
+bool PthreadThreadSystem::SetCurrentThreadCpuAffinity(
+    const std::vector<int>& cpus) {
+#if defined(linux) && defined(__GLIBC__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int i = 0, n = cpus.size(); i < n; ++i) {
+    if ((cpus[i] < 0) || (cpus[i] >= CPU_SETSIZE)) {
+      return false;
+    }
+    CPU_SET(cpus[i], &cpu_set);
+  }
+  return (!cpus.empty() &&
+          (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set),
+                                  &cpu_set) == 0));
+#else
+  return false;
+#endif
+}
+
 }  // namespace net_instaweb
@@ -23,6 +23,8 @@
 #ifndef PAGESPEED_KERNEL_THREAD_PTHREAD_THREAD_SYSTEM_H_
 #define PAGESPEED_KERNEL_THREAD_PTHREAD_THREAD_SYSTEM_H_
 
+#include <vector>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/thread_system.h"
 
@@ -40,6 +42,9 @@ class PthreadThreadSystem : public ThreadSystem {
   virtual Timer* NewTimer();
   virtual ThreadId* GetThreadId() const;
 
+  // Uses pthread_setaffinity_np where available (Linux/glibc).
+  virtual bool SetCurrentThreadCpuAffinity(const std::vector<int>& cpus);
+
  protected:
   // This hook will get invoked by the implementation in the context of a
   // thread before invoking its Run() method.
@@ -28,6 +28,7 @@
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/condvar.h"
 #include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -46,17 +47,29 @@ inline void UpdateWaveform(Waveform* queue_size, int delta) {
 
 const size_t kUnboundedQueue = 0;
 
+const int kDefaultPriorityWeights[QueuedWorkerPool::kNumPriorities] = {
+  8, 4, 1
+};
+
 }  // namespace
 
 QueuedWorkerPool::QueuedWorkerPool(
     int max_workers, StringPiece thread_name_base, ThreadSystem* thread_system)
     : thread_system_(thread_system),
       mutex_(thread_system_->NewMutex()),
+      num_queued_(0),
       max_workers_(max_workers),
       shutdown_(false),
       queue_size_(NULL),
       load_shedding_threshold_(kNoLoadShedding) {
   thread_name_base.CopyToString(&thread_name_base_);
+  for (int p = 0; p < kNumPriorities; ++p) {
+    priority_weights_[p] = kDefaultPriorityWeights[p];
+    dequeue_credits_[p] = kDefaultPriorityWeights[p];
+    num_shed_[p] = 0;
+    queued_stats_[p] = NULL;
+    shed_stats_[p] = NULL;
+  }
 }
 
 QueuedWorkerPool::~QueuedWorkerPool() {
@@ -171,20 +184,69 @@ QueuedWorkerPool::Sequence* QueuedWorkerPool::AssignWorkerToNextSequence(
   Sequence* sequence = NULL;
   ScopedMutex lock(mutex_.get());
   if (!shutdown_) {
-    if (queued_sequences_.empty()) {
+    sequence = PopNextSequence();
+    if (sequence == NULL) {
       int erased = active_workers_.erase(worker);
       DCHECK_EQ(1, erased);
       available_workers_.push_back(worker);
-    } else {
-      sequence = queued_sequences_.front();
-      queued_sequences_.pop_front();
     }
   }
   return sequence;
 }
 
-void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
+QueuedWorkerPool::Sequence* QueuedWorkerPool::PopNextSequence() {
+  if (num_queued_ == 0) {
+    return NULL;
+  }
+
+  // Take the highest class that is non-empty and still has credit left in
+  // this round.  If every non-empty class has used up its credit, start a
+  // new round; the second pass is then guaranteed to find one.
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int p = 0; p < kNumPriorities; ++p) {
+      std::deque<Sequence*>& queue = queued_sequences_[p];
+      if (!queue.empty() && (dequeue_credits_[p] > 0)) {
+        --dequeue_credits_[p];
+        --num_queued_;
+        if (queued_stats_[p] != NULL) {
+          queued_stats_[p]->Add(-1);
+        }
+        Sequence* sequence = queue.front();
+        queue.pop_front();
+        return sequence;
+      }
+    }
+    for (int p = 0; p < kNumPriorities; ++p) {
+      dequeue_credits_[p] = priority_weights_[p];
+    }
+  }
+  LOG(DFATAL) << "num_queued_=" << num_queued_ << " but no queued sequence";
+  return NULL;
+}
+
+QueuedWorkerPool::Sequence* QueuedWorkerPool::PopSequenceToShed() {
+  for (int p = kNumPriorities - 1; p >= 0; --p) {
+    std::deque<Sequence*>& queue = queued_sequences_[p];
+    if (!queue.empty()) {
+      --num_queued_;
+      ++num_shed_[p];
+      if (queued_stats_[p] != NULL) {
+        queued_stats_[p]->Add(-1);
+      }
+      if (shed_stats_[p] != NULL) {
+        shed_stats_[p]->Add(1);
+      }
+      Sequence* sequence = queue.front();
+      queue.pop_front();
+      return sequence;
+    }
+  }
+  return NULL;
+}
+
+void QueuedWorkerPool::QueueSequence(Sequence* sequence, Priority priority) {
   QueuedWorker* worker = NULL;
+  bool new_worker = false;
   Sequence* drop_sequence = NULL;
   {
     ScopedMutex lock(mutex_.get());
@@ -198,17 +260,20 @@ void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
                              thread_system_);
         worker->Start();
         active_workers_.insert(worker);
+        new_worker = true;
       } else {
         // No workers available: must queue the sequence.
-        queued_sequences_.push_back(sequence);
+        queued_sequences_[priority].push_back(sequence);
+        ++num_queued_;
+        if (queued_stats_[priority] != NULL) {
+          queued_stats_[priority]->Add(1);
+        }
 
         // If too many sequences are waiting, we will cancel the oldest
-        // waiting one.
+        // waiting one of the lowest priority.
         if ((load_shedding_threshold_ != kNoLoadShedding) &&
-            (queued_sequences_.size() >
-             static_cast<size_t>(load_shedding_threshold_))) {
-          drop_sequence = queued_sequences_.front();
-          queued_sequences_.pop_front();
+            (num_queued_ > load_shedding_threshold_)) {
+          drop_sequence = PopSequenceToShed();
         }
       }
     } else {
@@ -225,6 +290,10 @@ void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
 
   // Run the worker without holding the Pool lock.
   if (worker != NULL) {
+    if (new_worker && !cpu_affinity_.empty()) {
+      worker->RunInWorkThread(
+          MakeFunction(this, &QueuedWorkerPool::SetWorkerCpuAffinity));
+    }
     worker->RunInWorkThread(
         new MemberFunction2<QueuedWorkerPool, QueuedWorkerPool::Sequence*,
                             QueuedWorker*>(
@@ -232,6 +301,13 @@ void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
   }
 }
 
+void QueuedWorkerPool::SetWorkerCpuAffinity() {
+  if (!thread_system_->SetCurrentThreadCpuAffinity(cpu_affinity_)) {
+    LOG(WARNING) << "Unable to set CPU affinity for a " << thread_name_base_
+                 << " worker thread";
+  }
+}
+
 bool QueuedWorkerPool::AreBusy(const SequenceSet& sequences)
     NO_THREAD_SAFETY_ANALYSIS {
   // This is the only operation that accesses multiple workers at once.
@@ -263,6 +339,36 @@ void QueuedWorkerPool::SetLoadSheddingThreshold(int x) {
   load_shedding_threshold_ = x;
 }
 
+int QueuedWorkerPool::NumQueuedSequences() {
+  ScopedMutex lock(mutex_.get());
+  return num_queued_;
+}
+
+int QueuedWorkerPool::NumQueuedSequences(Priority priority) {
+  ScopedMutex lock(mutex_.get());
+  return queued_sequences_[priority].size();
+}
+
+int64 QueuedWorkerPool::NumShedSequences(Priority priority) {
+  ScopedMutex lock(mutex_.get());
+  return num_shed_[priority];
+}
+
+void QueuedWorkerPool::SetPriorityWeight(Priority priority, int weight) {
+  DCHECK_GT(weight, 0);
+  ScopedMutex lock(mutex_.get());
+  priority_weights_[priority] = weight;
+  dequeue_credits_[priority] = weight;
+}
+
+void QueuedWorkerPool::set_priority_stats(Priority priority,
+                                          UpDownCounter* queued,
+                                          Variable* shed) {
+  ScopedMutex lock(mutex_.get());
+  queued_stats_[priority] = queued;
+  shed_stats_[priority] = shed;
+}
+
 QueuedWorkerPool::Sequence* QueuedWorkerPool::NewSequence() {
   ScopedMutex lock(mutex_.get());
   Sequence* sequence = NULL;
@@ -313,9 +419,20 @@ void QueuedWorkerPool::Sequence::Reset() {
   ScopedMutex lock(sequence_mutex_.get());
   shutdown_ = false;
   active_ = false;
+  priority_ = kNormalPriority;
   DCHECK(work_queue_.empty());
 }
 
+void QueuedWorkerPool::Sequence::set_priority(Priority x) {
+  ScopedMutex lock(sequence_mutex_.get());
+  priority_ = x;
+}
+
+QueuedWorkerPool::Priority QueuedWorkerPool::Sequence::priority() {
+  ScopedMutex lock(sequence_mutex_.get());
+  return priority_;
+}
+
 QueuedWorkerPool::Sequence::~Sequence() {
   DCHECK(shutdown_);
   DCHECK(work_queue_.empty());
@@ -376,6 +493,7 @@ void QueuedWorkerPool::Sequence::Cancel() {
 void QueuedWorkerPool::Sequence::Add(Function* function) {
   bool queue_sequence = false;
   bool cancel = false;
+  Priority priority = kNormalPriority;
   {
     ScopedMutex lock(sequence_mutex_.get());
     if (shutdown_) {
@@ -400,13 +518,14 @@ void QueuedWorkerPool::Sequence::Add(Function* function) {
 
       work_queue_.push_back(function_to_add);
       queue_sequence = (!active_ && (work_queue_.size() == 1));
+      priority = priority_;
     }
   }
   if (cancel) {
     function->CallCancel();
   }
   if (queue_sequence) {
-    pool_->QueueSequence(this);
+    pool_->QueueSequence(this, priority);
   }
   UpdateWaveform(queue_size_, cancel ? 0 : 1);
 }
@@ -45,6 +45,8 @@
 namespace net_instaweb {
 
 class QueuedWorker;
+class UpDownCounter;
+class Variable;
 class Waveform;
 
 // Maintains a predefined number of worker threads, and dispatches any
@@ -53,6 +55,16 @@ class QueuedWorkerPool {
  public:
   static const int kNoLoadShedding = -1;
 
+  // Sequences waiting for a worker are queued by priority class.  Workers
+  // pick among the non-empty classes by weighted round-robin (see
+  // SetPriorityWeight), and load-shedding drops the lowest class first.
+  enum Priority {
+    kHighPriority,        // Work on the critical path of an HTML response.
+    kNormalPriority,      // The default, e.g. .pagespeed. resource fetches.
+    kBackgroundPriority,  // Work no client is waiting for, e.g. IPRO.
+    kNumPriorities
+  };
+
   QueuedWorkerPool(int max_workers, StringPiece thread_name_base,
                    ThreadSystem* thread_system);
   ~QueuedWorkerPool();
@@ -106,6 +118,12 @@ class QueuedWorkerPool {
 
     void set_queue_size_stat(Waveform* x) { queue_size_ = x; }
 
+    // Sets the class this sequence is queued in when it is waiting for a
+    // worker.  A change takes effect the next time the sequence goes idle
+    // and is re-queued.  Recycled sequences are reset to kNormalPriority.
+    void set_priority(Priority x) LOCKS_EXCLUDED(sequence_mutex_);
+    Priority priority() LOCKS_EXCLUDED(sequence_mutex_);
+
     // Sets the maximum number of functions that can be enqueued to a sequence.
     // By default, sequences are unbounded.  When a bound is reached, the oldest
     // functions are retired by calling Cancel() on them.
@@ -159,6 +177,7 @@ class QueuedWorkerPool {
         GUARDED_BY(sequence_mutex_);
     Waveform* queue_size_;
     size_t max_queue_size_;
+    Priority priority_ GUARDED_BY(sequence_mutex_);
 
     DISALLOW_COPY_AND_ASSIGN(Sequence);
   };
@@ -209,27 +228,73 @@ class QueuedWorkerPool {
 
   // If x == kNoLoadShedding disables load-shedding.
   // Otherwise, if more than x sequences are queued waiting to run,
-  // sequences will start getting dropped and canceled, with oldest
-  // sequences canceled first.
+  // sequences will start getting dropped and canceled.  The oldest
+  // sequence in the lowest-priority non-empty class is canceled first,
+  // so kHighPriority sequences are only shed once nothing else is queued.
   //
   // Precondition: x > 0 || x == kNoLoadShedding
   // x = kNoLoadShedding (the default) disables the limit.
   //
   // Should be called before starting any work.
   void SetLoadSheddingThreshold(int x);
+  int load_shedding_threshold() const { return load_shedding_threshold_; }
+
+  // Returns the number of sequences waiting for a worker.  When this
+  // exceeds load_shedding_threshold(), sequences are dropped.
+  int NumQueuedSequences();
+  int NumQueuedSequences(Priority priority);
+
+  // Returns the number of sequences of the given class dropped by
+  // load-shedding since the pool was created.
+  int64 NumShedSequences(Priority priority);
+
+  // Sets how many sequences of the given class a worker takes, when others
+  // are also waiting, before giving each lower class its turn.  The
+  // defaults are 8, 4 and 1 for high, normal and background, so background
+  // work keeps making progress under sustained load but cannot delay HTML
+  // rewrites by more than one sequence in thirteen.
+  //
+  // Precondition: weight > 0.  Should be called before starting any work.
+  void SetPriorityWeight(Priority priority, int weight);
 
   // Sets up a timed-variable statistic indicating the current queue depth.
   //
   // This must be called prior to creating sequences.
   void set_queue_size_stat(Waveform* x) { queue_size_ = x; }
 
+  // Sets up statistics mirroring NumQueuedSequences(priority) and
+  // NumShedSequences(priority).  Either may be NULL.
+  //
+  // This must be called prior to starting any work.
+  void set_priority_stats(Priority priority, UpDownCounter* queued,
+                          Variable* shed);
+
+  // Restricts the pool's worker threads to the given CPUs, via
+  // ThreadSystem::SetCurrentThreadCpuAffinity, as each thread starts.  An
+  // empty set (the default) leaves them unrestricted.
+  //
+  // This must be called prior to starting any work.
+  void set_cpu_affinity(const std::vector<int>& cpus) { cpu_affinity_ = cpus; }
+  const std::vector<int>& cpu_affinity() const { return cpu_affinity_; }
+
  private:
   friend class Sequence;
   void Run(Sequence* sequence, QueuedWorker* worker);
-  void QueueSequence(Sequence* sequence);
+  void QueueSequence(Sequence* sequence, Priority priority);
   Sequence* AssignWorkerToNextSequence(QueuedWorker* worker);
   void SequenceNoLongerActive(Sequence* sequence);
 
+  // Runs first on each new worker thread when cpu_affinity_ is set.
+  void SetWorkerCpuAffinity();
+
+  // Removes and returns the sequence a worker should run next, or NULL if
+  // nothing is queued.
+  Sequence* PopNextSequence() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Removes and returns the sequence to cancel to bring the queue back
+  // under load_shedding_threshold_.
+  Sequence* PopSequenceToShed() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   ThreadSystem* thread_system_;
   scoped_ptr<AbstractMutex> mutex_;
 
@@ -240,8 +305,17 @@ class QueuedWorkerPool {
   // queued_sequences_ and free_sequences_ are mutually exclusive, but
   // all_sequences contains all of them.
   std::vector<Sequence*> all_sequences_;
-  std::deque<Sequence*> queued_sequences_;
+  std::deque<Sequence*> queued_sequences_[kNumPriorities];
   std::vector<Sequence*> free_sequences_;
+  int num_queued_;
+
+  // Weighted round-robin state: each class may be picked up to
+  // priority_weights_[p] times before the credits are refilled.
+  int priority_weights_[kNumPriorities];
+  int dequeue_credits_[kNumPriorities];
+  int64 num_shed_[kNumPriorities];
+  UpDownCounter* queued_stats_[kNumPriorities];
+  Variable* shed_stats_[kNumPriorities];
 
   GoogleString thread_name_base_;
 
@@ -250,6 +324,7 @@ class QueuedWorkerPool {
 
   Waveform* queue_size_;
   int load_shedding_threshold_;
+  std::vector<int> cpu_affinity_;
 
   DISALLOW_COPY_AND_ASSIGN(QueuedWorkerPool);
 };
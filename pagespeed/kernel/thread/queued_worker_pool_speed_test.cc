@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+//
+// Measures the round trip of handing a Function to a QueuedWorkerPool and
+// waiting for it to run.  Each benchmark thread owns a Sequence, so the
+// work items themselves never wait on each other; what is measured is the
+// cost of the pool's queue, its mutex, and waking a worker.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kMaxThreads = 8;
+
+// The per-thread state: a sequence to add work to, and a condvar to learn
+// when that work has run.
+class Slot {
+ public:
+  Slot(QueuedWorkerPool* pool, ThreadSystem* thread_system)
+      : pool_(pool),
+        sequence_(pool->NewSequence()),
+        mutex_(thread_system->NewMutex()),
+        condvar_(mutex_->NewCondvar()),
+        done_(false) {
+  }
+
+  ~Slot() {
+    pool_->FreeSequence(sequence_);
+  }
+
+  void RoundTrip() {
+    {
+      ScopedMutex lock(mutex_.get());
+      done_ = false;
+    }
+    sequence_->Add(MakeFunction(this, &Slot::Done));
+    ScopedMutex lock(mutex_.get());
+    while (!done_) {
+      condvar_->Wait();
+    }
+  }
+
+ private:
+  void Done() {
+    ScopedMutex lock(mutex_.get());
+    done_ = true;
+    condvar_->Signal();
+  }
+
+  QueuedWorkerPool* pool_;
+  QueuedWorkerPool::Sequence* sequence_;
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> condvar_;
+  bool done_;
+
+  DISALLOW_COPY_AND_ASSIGN(Slot);
+};
+
+class PoolBody : public ThreadedBenchmark::Body {
+ public:
+  PoolBody()
+      : thread_system_(Platform::CreateThreadSystem()),
+        pool_(new QueuedWorkerPool(kMaxThreads, "speed_test",
+                                   thread_system_.get())) {
+    for (int i = 0; i < kMaxThreads; ++i) {
+      slots_.push_back(new Slot(pool_.get(), thread_system_.get()));
+    }
+  }
+
+  virtual ~PoolBody() {
+    STLDeleteElements(&slots_);
+    pool_->ShutDown();
+  }
+
+  virtual void RunIteration(int thread_index, int iteration) {
+    slots_[thread_index % kMaxThreads]->RoundTrip();
+  }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<QueuedWorkerPool> pool_;
+  std::vector<Slot*> slots_;
+
+  DISALLOW_COPY_AND_ASSIGN(PoolBody);
+};
+
+static void BM_QueuedWorkerPoolRoundTrip(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  PoolBody body;
+  ThreadedBenchmark::Run("BM_QueuedWorkerPoolRoundTrip", iters, num_threads,
+                         &body);
+}
+BENCHMARK_THREAD_RANGE(BM_QueuedWorkerPoolRoundTrip, 1, kMaxThreads);
+
+}  // namespace
+
+}  // namespace net_instaweb
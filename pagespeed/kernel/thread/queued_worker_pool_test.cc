@@ -21,11 +21,18 @@
 
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 
+#ifdef linux
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <vector>
+
 #include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/thread/worker_test_base.h"
 
 namespace net_instaweb {
@@ -243,6 +250,7 @@ TEST_F(QueuedWorkerPoolTest, LoadShedding) {
   SyncPoint done_sync(thread_runtime_.get());
   QueuedWorkerPool::Sequence* done = worker_->NewSequence();
   done->Add(new NotifyRunFunction(&done_sync));
+  EXPECT_EQ(kThresh, worker_->NumQueuedSequences());
 
   wedge1_sync.Notify();
   wedge2_sync.Notify();
@@ -272,6 +280,191 @@ TEST_F(QueuedWorkerPoolTest, LoadShedding) {
   worker_->FreeSequence(done);
 }
 
+// Tests that load shedding drops background sequences before normal ones,
+// and normal ones before high-priority ones.
+TEST_F(QueuedWorkerPoolTest, LoadSheddingByPriority) {
+  const int kThresh = 4;
+  worker_->SetLoadSheddingThreshold(kThresh);
+  SyncPoint wedge1_sync(thread_runtime_.get());
+  SyncPoint wedge2_sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* wedge1 = worker_->NewSequence();
+  wedge1->Add(new WaitRunFunction(&wedge1_sync));
+  QueuedWorkerPool::Sequence* wedge2 = worker_->NewSequence();
+  wedge2->Add(new WaitRunFunction(&wedge2_sync));
+
+  // Queue, oldest first: 2 high, 2 background, 2 normal, 2 high.  That is 4
+  // over the threshold, so both background and the two normal sequences
+  // must go, even though the first high-priority ones are older.
+  const QueuedWorkerPool::Priority kPriorities[] = {
+    QueuedWorkerPool::kHighPriority, QueuedWorkerPool::kHighPriority,
+    QueuedWorkerPool::kBackgroundPriority,
+    QueuedWorkerPool::kBackgroundPriority,
+    QueuedWorkerPool::kNormalPriority, QueuedWorkerPool::kNormalPriority,
+    QueuedWorkerPool::kHighPriority, QueuedWorkerPool::kHighPriority
+  };
+  const int kNumOps = arraysize(kPriorities);
+  std::vector<QueuedWorkerPool::Sequence*> log_ops;
+  std::vector<LogOpsFunction*> log_ops_functions;
+  for (int i = 0; i < kNumOps; ++i) {
+    LogOpsFunction* fn = new LogOpsFunction;
+    QueuedWorkerPool::Sequence* log_op = worker_->NewSequence();
+    log_op->set_priority(kPriorities[i]);
+    log_op->Add(fn);
+    log_ops.push_back(log_op);
+    log_ops_functions.push_back(fn);
+  }
+  EXPECT_EQ(kThresh, worker_->NumQueuedSequences());
+  EXPECT_EQ(kThresh,
+            worker_->NumQueuedSequences(QueuedWorkerPool::kHighPriority));
+  EXPECT_EQ(0, worker_->NumQueuedSequences(QueuedWorkerPool::kNormalPriority));
+  EXPECT_EQ(2, worker_->NumShedSequences(QueuedWorkerPool::kNormalPriority));
+  EXPECT_EQ(2,
+            worker_->NumShedSequences(QueuedWorkerPool::kBackgroundPriority));
+  EXPECT_EQ(0, worker_->NumShedSequences(QueuedWorkerPool::kHighPriority));
+
+  // One more high-priority sequence has to displace the oldest high one.
+  SyncPoint done_sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* done = worker_->NewSequence();
+  done->set_priority(QueuedWorkerPool::kHighPriority);
+  done->Add(new NotifyRunFunction(&done_sync));
+  EXPECT_EQ(1, worker_->NumShedSequences(QueuedWorkerPool::kHighPriority));
+
+  wedge1_sync.Notify();
+  wedge2_sync.Notify();
+  done_sync.Wait();
+  worker_->ShutDown();
+
+  for (int i = 0; i < kNumOps; ++i) {
+    bool shed = (kPriorities[i] != QueuedWorkerPool::kHighPriority) ||
+        (i == 0);
+    EXPECT_EQ(shed, log_ops_functions[i]->cancel_called()) << i;
+    EXPECT_EQ(!shed, log_ops_functions[i]->run_called()) << i;
+    delete log_ops_functions[i];
+    worker_->FreeSequence(log_ops[i]);
+  }
+  worker_->FreeSequence(wedge1);
+  worker_->FreeSequence(wedge2);
+  worker_->FreeSequence(done);
+}
+
+// Appends a tag to a shared string, relying on a single-threaded pool for
+// ordering.
+class AppendTag : public Function {
+ public:
+  AppendTag(char tag, GoogleString* log) : tag_(tag), log_(log) {}
+
+ protected:
+  virtual void Run() { log_->push_back(tag_); }
+
+ private:
+  char tag_;
+  GoogleString* log_;
+
+  DISALLOW_COPY_AND_ASSIGN(AppendTag);
+};
+
+// Tests that queued sequences are picked by weighted round-robin across
+// priority classes rather than strictly by priority or arrival.
+TEST_F(QueuedWorkerPoolTest, WeightedPriorityDequeue) {
+  worker_.reset(new QueuedWorkerPool(1, "queued_worker_pool_test",
+                                     thread_runtime_.get()));
+  worker_->SetPriorityWeight(QueuedWorkerPool::kHighPriority, 2);
+  SyncPoint wedge_sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* wedge = worker_->NewSequence();
+  wedge->Add(new WaitRunFunction(&wedge_sync));
+
+  // Background work is queued first, but high-priority work still gets two
+  // turns for each background one.
+  GoogleString log;
+  std::vector<QueuedWorkerPool::Sequence*> sequences;
+  for (int i = 0; i < 4; ++i) {
+    QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+    sequence->set_priority(QueuedWorkerPool::kBackgroundPriority);
+    sequence->Add(new AppendTag('b', &log));
+    sequences.push_back(sequence);
+  }
+  for (int i = 0; i < 6; ++i) {
+    QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+    sequence->set_priority(QueuedWorkerPool::kHighPriority);
+    sequence->Add(new AppendTag('h', &log));
+    sequences.push_back(sequence);
+  }
+  SyncPoint done_sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* done = worker_->NewSequence();
+  done->set_priority(QueuedWorkerPool::kBackgroundPriority);
+  done->Add(new NotifyRunFunction(&done_sync));
+  EXPECT_EQ(5, worker_->NumQueuedSequences(
+      QueuedWorkerPool::kBackgroundPriority));
+  EXPECT_EQ(11, worker_->NumQueuedSequences());
+
+  wedge_sync.Notify();
+  done_sync.Wait();
+  EXPECT_EQ("hhbhhbhhbb", log);
+
+  for (int i = 0, n = sequences.size(); i < n; ++i) {
+    worker_->FreeSequence(sequences[i]);
+  }
+  worker_->FreeSequence(wedge);
+  worker_->FreeSequence(done);
+}
+
+// Tests that a recycled sequence goes back to the default priority.
+TEST_F(QueuedWorkerPoolTest, PriorityResetOnRecycle) {
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  EXPECT_EQ(QueuedWorkerPool::kNormalPriority, sequence->priority());
+  sequence->set_priority(QueuedWorkerPool::kBackgroundPriority);
+  EXPECT_EQ(QueuedWorkerPool::kBackgroundPriority, sequence->priority());
+  worker_->FreeSequence(sequence);
+  QueuedWorkerPool::Sequence* recycled = worker_->NewSequence();
+  EXPECT_EQ(sequence, recycled);
+  EXPECT_EQ(QueuedWorkerPool::kNormalPriority, recycled->priority());
+  worker_->FreeSequence(recycled);
+}
+
+#if defined(linux) && defined(__GLIBC__)
+// Appends the CPUs the calling thread may run on to cpus.
+void GetThreadAffinity(std::vector<int>* cpus) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(cpu_set),
+                                      &cpu_set));
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpu_set)) {
+      cpus->push_back(cpu);
+    }
+  }
+}
+
+class RecordThreadAffinity : public Function {
+ public:
+  explicit RecordThreadAffinity(std::vector<int>* cpus) : cpus_(cpus) {}
+
+ protected:
+  virtual void Run() { GetThreadAffinity(cpus_); }
+
+ private:
+  std::vector<int>* cpus_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordThreadAffinity);
+};
+
+// Tests that worker threads are confined to the pool's CPUs.
+TEST_F(QueuedWorkerPoolTest, CpuAffinity) {
+  std::vector<int> allowed;
+  GetThreadAffinity(&allowed);
+  ASSERT_FALSE(allowed.empty());
+  std::vector<int> cpus(1, allowed.back());
+  worker_->set_cpu_affinity(cpus);
+
+  std::vector<int> worker_cpus;
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  sequence->Add(new RecordThreadAffinity(&worker_cpus));
+  WaitUntilSequenceCompletes(sequence);
+  EXPECT_TRUE(cpus == worker_cpus);
+  worker_->FreeSequence(sequence);
+}
+#endif
+
 class NotifyAndWait : public Function {
  public:
   NotifyAndWait(WorkerTestBase::SyncPoint* notify,
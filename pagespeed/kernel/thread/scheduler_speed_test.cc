@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+//
+// Measures the Scheduler's alarm bookkeeping from several threads.  All
+// alarms live in one ordered set behind the scheduler mutex, which every
+// fetch and rewrite deadline goes through.  The scheduler is pre-loaded
+// with far-future alarms so the set has a realistic depth.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/thread/scheduler.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kPendingAlarms = 1000;
+const int64 kFarFutureUs = 3600 * Timer::kSecondUs;
+
+class NoOp {
+ public:
+  NoOp() {}
+  void Run() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoOp);
+};
+
+class SchedulerBody : public ThreadedBenchmark::Body {
+ public:
+  explicit SchedulerBody(bool immediate)
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(Platform::CreateTimer()),
+        scheduler_(thread_system_.get(), timer_.get()),
+        immediate_(immediate) {
+    ScopedMutex lock(scheduler_.mutex());
+    int64 now_us = timer_->NowUs();
+    for (int i = 0; i < kPendingAlarms; ++i) {
+      pending_.push_back(scheduler_.AddAlarmAtUsMutexHeld(
+          now_us + kFarFutureUs + i, MakeFunction(&no_op_, &NoOp::Run)));
+    }
+  }
+
+  virtual ~SchedulerBody() {
+    ScopedMutex lock(scheduler_.mutex());
+    for (int i = 0, n = pending_.size(); i < n; ++i) {
+      scheduler_.CancelAlarm(pending_[i]);
+    }
+  }
+
+  virtual void RunIteration(int thread_index, int iteration) {
+    if (immediate_) {
+      // Runs the new alarm, along with any other outstanding ones, before
+      // returning.
+      scheduler_.AddAlarmAtUs(timer_->NowUs(),
+                              MakeFunction(&no_op_, &NoOp::Run));
+    } else {
+      ScopedMutex lock(scheduler_.mutex());
+      Scheduler::Alarm* alarm = scheduler_.AddAlarmAtUsMutexHeld(
+          timer_->NowUs() + kFarFutureUs / 2,
+          MakeFunction(&no_op_, &NoOp::Run));
+      scheduler_.CancelAlarm(alarm);
+    }
+  }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<Timer> timer_;
+  Scheduler scheduler_;
+  NoOp no_op_;
+  std::vector<Scheduler::Alarm*> pending_;
+  bool immediate_;
+
+  DISALLOW_COPY_AND_ASSIGN(SchedulerBody);
+};
+
+static void BM_SchedulerAddCancelAlarm(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  SchedulerBody body(false);
+  ThreadedBenchmark::Run("BM_SchedulerAddCancelAlarm", iters, num_threads,
+                         &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SchedulerAddCancelAlarm, 1, 8);
+
+static void BM_SchedulerRunImmediateAlarm(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  SchedulerBody body(true);
+  ThreadedBenchmark::Run("BM_SchedulerRunImmediateAlarm", iters, num_threads,
+                         &body);
+}
+BENCHMARK_THREAD_RANGE(BM_SchedulerRunImmediateAlarm, 1, 8);
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -0,0 +1,953 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#include "pagespeed/kernel/thread/uring_file_system.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/thread/sequence.h"
+
+#if defined(linux) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+// IORING_OP_MKDIRAT, the newest opcode we use, arrived in Linux 5.15;
+// IORING_FEAT_CQE_SKIP is the first feature flag defined after it.
+#if defined(IORING_FEAT_CQE_SKIP) && defined(__NR_io_uring_setup) && \
+    defined(__NR_statx) && defined(STATX_BASIC_STATS)
+#define PAGESPEED_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace net_instaweb {
+
+#ifdef PAGESPEED_HAVE_IO_URING
+namespace {
+
+// Pathname passed to statx along with AT_EMPTY_PATH to stat an open fd.
+const char kEmptyPath[] = "";
+
+// Returns the directory portion of filename, without the trailing slash.
+GoogleString DirName(const GoogleString& filename) {
+  size_t slash = filename.rfind('/');
+  return (slash == GoogleString::npos) ? GoogleString()
+                                       : filename.substr(0, slash);
+}
+
+void ReportError(MessageHandler* handler, const char* operation,
+                 const GoogleString& path, int result) {
+  handler->Message(kError, "Failed to %s %s: %s", operation, path.c_str(),
+                   strerror(-result));
+}
+
+// Makes the system call described by sqe on this thread, returning what its
+// completion would have: the result, or -errno.
+int RunStepBlocking(const io_uring_sqe& sqe) {
+  const char* path = reinterpret_cast<const char*>(sqe.addr);
+  int result = -1;
+  switch (sqe.opcode) {
+    case IORING_OP_NOP:
+      result = 0;
+      break;
+    case IORING_OP_OPENAT:
+      result = openat(sqe.fd, path, sqe.open_flags, sqe.len);
+      break;
+    case IORING_OP_STATX:
+      result = syscall(__NR_statx, sqe.fd, path, sqe.statx_flags, sqe.len,
+                       reinterpret_cast<struct statx*>(sqe.off));
+      break;
+    case IORING_OP_READ:
+      result = pread(sqe.fd, reinterpret_cast<void*>(sqe.addr), sqe.len,
+                     sqe.off);
+      break;
+    case IORING_OP_WRITE:
+      result = pwrite(sqe.fd, reinterpret_cast<const void*>(sqe.addr),
+                      sqe.len, sqe.off);
+      break;
+    case IORING_OP_CLOSE:
+      result = close(sqe.fd);
+      break;
+    case IORING_OP_RENAMEAT:
+      result = renameat(sqe.fd, path, sqe.len,
+                        reinterpret_cast<const char*>(sqe.addr2));
+      break;
+    case IORING_OP_UNLINKAT:
+      result = unlinkat(sqe.fd, path, sqe.unlink_flags);
+      break;
+    case IORING_OP_MKDIRAT:
+      result = mkdirat(sqe.fd, path, sqe.len);
+      break;
+    default:
+      LOG(DFATAL) << "Unexpected opcode " << static_cast<int>(sqe.opcode);
+      return -EINVAL;
+  }
+  return (result < 0) ? -errno : result;
+}
+
+}  // namespace
+#endif  // PAGESPEED_HAVE_IO_URING
+
+// The mapped submission and completion rings.
+struct UringFileSystem::Ring {
+#ifdef PAGESPEED_HAVE_IO_URING
+  Ring()
+      : fd(-1), sq_ptr(MAP_FAILED), sq_size(0), cq_ptr(MAP_FAILED),
+        cq_size(0), sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sqes_size(0) {
+  }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sqes_size);
+    }
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+      munmap(cq_ptr, cq_size);
+    }
+    if (sq_ptr != MAP_FAILED) {
+      munmap(sq_ptr, sq_size);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  // Sets up a ring with queue_depth entries, and checks that it supports
+  // every opcode the operations below use.
+  bool Init(int queue_depth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (fd < 0) {
+      return false;
+    }
+    sq_entries = params.sq_entries;
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+      return false;
+    }
+    if (single_mmap) {
+      cq_ptr = sq_ptr;
+    } else {
+      cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq_ptr == MAP_FAILED) {
+        return false;
+      }
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(
+        mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return SupportsOpcodes();
+  }
+
+  bool SupportsOpcodes() {
+    static const int kNumProbeOps = 256;
+    GoogleString buf(sizeof(io_uring_probe) +
+                     kNumProbeOps * sizeof(io_uring_probe_op), '\0');
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(&buf[0]);
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                kNumProbeOps) < 0) {
+      return false;
+    }
+    static const int kOpcodes[] = {
+      IORING_OP_NOP, IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ,
+      IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_RENAMEAT,
+      IORING_OP_UNLINKAT, IORING_OP_MKDIRAT
+    };
+    for (int i = 0, n = arraysize(kOpcodes); i < n; ++i) {
+      int op = kOpcodes[i];
+      if (op > probe->last_op ||
+          (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Blocks until at least one completion is available.
+  void WaitForCompletion() {
+    syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+  }
+
+  int fd;
+  unsigned sq_entries;
+  void* sq_ptr;
+  size_t sq_size;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned sq_mask;
+  unsigned* sq_array;
+  void* cq_ptr;
+  size_t cq_size;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  io_uring_cqe* cqes;
+  io_uring_sqe* sqes;
+  size_t sqes_size;
+#else
+  bool Init(int queue_depth) { return false; }
+#endif  // PAGESPEED_HAVE_IO_URING
+};
+
+// One asynchronous file operation.  Subclasses are state machines that
+// issue one system call at a time on the ring, or run the whole operation
+// in RunBlocking when the ring is unavailable.
+class UringFileSystem::Op {
+ public:
+  Op(UringFileSystem* file_system, Sequence* sequence)
+      : file_system_(file_system), success_(false), sequence_(sequence) {
+  }
+  virtual ~Op() {}
+
+#ifdef PAGESPEED_HAVE_IO_URING
+  // Describes the next system call in sqe, which has been zeroed.
+  virtual void PrepareStep(io_uring_sqe* sqe) = 0;
+
+  // Consumes the result of the system call described by PrepareStep.
+  // Returns true if there is another step to submit.
+  virtual bool StepDone(int result) = 0;
+#endif
+
+  virtual void RunBlocking() = 0;
+
+  // Queues the caller's callback on its sequence.
+  void Deliver() {
+    sequence_->Add(MakeFunction(this, &Op::Done, &Op::Cancel));
+  }
+
+ protected:
+  virtual void RunCallback(bool success) = 0;
+
+#ifdef PAGESPEED_HAVE_IO_URING
+  // Steps that make the missing directories above path, as
+  // RecursivelyMakeDir does, but one mkdirat at a time on the ring.
+  // While making_dirs(), the subclass passes its steps to PrepareMakeDir
+  // and MakeDirDone, and then carries on where it left off.
+  void StartMakingDirs(const GoogleString& path) {
+    dirs_to_make_.assign(1, DirName(path));
+  }
+  bool making_dirs() const { return !dirs_to_make_.empty(); }
+
+  void PrepareMakeDir(io_uring_sqe* sqe) {
+    sqe->opcode = IORING_OP_MKDIRAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64>(dirs_to_make_.back().c_str());
+    sqe->len = 0777;  // Same as StdioFileSystem::MakeDir.
+  }
+
+  // Returns false, having reported the error, if a directory can't be made.
+  bool MakeDirDone(int result, MessageHandler* handler) {
+    if (result == -ENOENT) {
+      // Make the parent first, then try again.
+      GoogleString parent = DirName(dirs_to_make_.back());
+      if (!parent.empty()) {
+        dirs_to_make_.push_back(parent);
+        return true;
+      }
+    }
+    if ((result < 0) && (result != -EEXIST)) {
+      ReportError(handler, "make directory", dirs_to_make_.back(), result);
+      dirs_to_make_.clear();
+      return false;
+    }
+    dirs_to_make_.pop_back();
+    return true;
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+
+  UringFileSystem* file_system_;
+  bool success_;
+
+ private:
+  void Done() {
+    RunCallback(success_);
+    delete this;
+  }
+
+  void Cancel() {
+    RunCallback(false);
+    delete this;
+  }
+
+  Sequence* sequence_;
+  // Innermost last.
+  std::vector<GoogleString> dirs_to_make_;
+
+  DISALLOW_COPY_AND_ASSIGN(Op);
+};
+
+class UringFileSystem::ReadOp : public UringFileSystem::Op {
+ public:
+  ReadOp(UringFileSystem* file_system, const GoogleString& filename,
+         int64 max_file_size, Sequence* sequence, ReadCallback* callback)
+      : Op(file_system, sequence), filename_(filename),
+        max_file_size_(max_file_size), callback_(callback), state_(kOpen),
+        fd_(-1), file_size_(0), offset_(0) {
+  }
+
+#ifdef PAGESPEED_HAVE_IO_URING
+  virtual void PrepareStep(io_uring_sqe* sqe) {
+    switch (state_) {
+      case kOpen:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64>(filename_.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        break;
+      case kStat:
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64>(kEmptyPath);
+        sqe->len = STATX_SIZE;
+        sqe->off = reinterpret_cast<uint64>(&statx_);
+        sqe->statx_flags = AT_EMPTY_PATH;
+        break;
+      case kRead:
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64>(&contents_[offset_]);
+        sqe->len = contents_.size() - offset_;
+        sqe->off = offset_;
+        break;
+      case kClose:
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd_;
+        break;
+    }
+  }
+
+  virtual bool StepDone(int result) {
+    switch (state_) {
+      case kOpen:
+        if (result < 0) {
+          return false;
+        }
+        fd_ = result;
+        state_ = kStat;
+        return true;
+      case kStat:
+        if (result < 0 || TooBig(statx_.stx_size)) {
+          state_ = kClose;
+        } else {
+          // Leave room for one more byte so we see the end of the file in
+          // the first read.
+          file_size_ = statx_.stx_size;
+          contents_.resize(file_size_ + 1);
+          state_ = kRead;
+        }
+        return true;
+      case kRead:
+        return ReadDone(result);
+      case kClose:
+        return false;
+    }
+    return false;
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+
+  virtual void RunBlocking() {
+    NullMessageHandler null_handler;
+    success_ = file_system_->ReadFile(filename_.c_str(), max_file_size_,
+                                      &contents_, &null_handler);
+  }
+
+ protected:
+  virtual void RunCallback(bool success) {
+    if (!success) {
+      contents_.clear();
+    }
+    callback_->Done(success, &contents_);
+  }
+
+ private:
+  enum State { kOpen, kStat, kRead, kClose };
+
+  bool TooBig(int64 size) const {
+    return (max_file_size_ != FileSystem::kUnlimitedSize) &&
+        (size > max_file_size_);
+  }
+
+  bool ReadDone(int result) {
+    if (result < 0) {
+      state_ = kClose;
+      return true;
+    }
+    offset_ += result;
+    if ((result == 0) ||
+        ((offset_ >= file_size_) && (offset_ < contents_.size()))) {
+      // End of file.
+      contents_.resize(offset_);
+      success_ = true;
+      state_ = kClose;
+    } else if (offset_ == contents_.size()) {
+      // The file grew since we stat'ed it.
+      if (TooBig(offset_)) {
+        state_ = kClose;
+      } else {
+        contents_.resize(2 * contents_.size());
+      }
+    }
+    return true;
+  }
+
+  GoogleString filename_;
+  int64 max_file_size_;
+  ReadCallback* callback_;
+  State state_;
+  int fd_;
+  size_t file_size_;
+  size_t offset_;
+  GoogleString contents_;
+#ifdef PAGESPEED_HAVE_IO_URING
+  struct statx statx_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(ReadOp);
+};
+
+class UringFileSystem::WriteOp : public UringFileSystem::Op {
+ public:
+  WriteOp(UringFileSystem* file_system, const GoogleString& filename,
+          const SharedString& buffer, MessageHandler* handler,
+          Sequence* sequence, WriteCallback* callback)
+      : Op(file_system, sequence), filename_(filename), buffer_(buffer),
+        handler_(handler), callback_(callback), state_(kOpen), fd_(-1),
+        offset_(0), failed_(false), made_dirs_(false) {
+    // The pid and this object's address distinguish concurrent writers of
+    // the same file, as mkstemp would.
+    temp_filename_ = StringPrintf("%s.temp%d-%p", filename.c_str(),
+                                  static_cast<int>(getpid()), this);
+  }
+
+#ifdef PAGESPEED_HAVE_IO_URING
+  virtual void PrepareStep(io_uring_sqe* sqe) {
+    if (making_dirs()) {
+      PrepareMakeDir(sqe);
+      return;
+    }
+    switch (state_) {
+      case kOpen:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64>(temp_filename_.c_str());
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        sqe->len = 0600;  // Same as mkstemp.
+        break;
+      case kWrite:
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64>(buffer_.data() + offset_);
+        sqe->len = buffer_.size() - offset_;
+        sqe->off = offset_;
+        break;
+      case kClose:
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd_;
+        break;
+      case kRename:
+        sqe->opcode = IORING_OP_RENAMEAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64>(temp_filename_.c_str());
+        sqe->len = AT_FDCWD;
+        sqe->addr2 = reinterpret_cast<uint64>(filename_.c_str());
+        break;
+      case kUnlink:
+        sqe->opcode = IORING_OP_UNLINKAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64>(temp_filename_.c_str());
+        break;
+    }
+  }
+
+  virtual bool StepDone(int result) {
+    if (making_dirs()) {
+      return MakeDirDone(result, handler_);
+    }
+    switch (state_) {
+      case kOpen:
+        if ((result == -ENOENT) && !made_dirs_) {
+          // Make the directory, and then open again.
+          made_dirs_ = true;
+          StartMakingDirs(filename_);
+          return true;
+        } else if (result < 0) {
+          ReportError(handler_, "open temp file", temp_filename_, result);
+          return false;
+        }
+        fd_ = result;
+        state_ = buffer_.empty() ? kClose : kWrite;
+        return true;
+      case kWrite:
+        if (result <= 0) {
+          ReportError(handler_, "write file", temp_filename_,
+                      (result == 0) ? -EIO : result);
+          failed_ = true;
+          state_ = kClose;
+        } else {
+          offset_ += result;
+          if (offset_ == static_cast<size_t>(buffer_.size())) {
+            state_ = kClose;
+          }
+        }
+        return true;
+      case kClose:
+        if (result < 0) {
+          ReportError(handler_, "close file", temp_filename_, result);
+          failed_ = true;
+        }
+        state_ = failed_ ? kUnlink : kRename;
+        return true;
+      case kRename:
+        if (result < 0) {
+          ReportError(handler_, "rename file to", filename_, result);
+          state_ = kUnlink;
+          return true;
+        }
+        success_ = true;
+        return false;
+      case kUnlink:
+        return false;
+    }
+    return false;
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+
+  virtual void RunBlocking() {
+    success_ = file_system_->WriteFileAtomic(filename_, buffer_.Value(),
+                                             handler_);
+  }
+
+ protected:
+  virtual void RunCallback(bool success) {
+    callback_->Done(success);
+  }
+
+ private:
+  enum State { kOpen, kWrite, kClose, kRename, kUnlink };
+
+  GoogleString filename_;
+  GoogleString temp_filename_;
+  SharedString buffer_;
+  MessageHandler* handler_;
+  WriteCallback* callback_;
+  State state_;
+  int fd_;
+  size_t offset_;
+  bool failed_;
+  bool made_dirs_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteOp);
+};
+
+class UringFileSystem::StatOp : public UringFileSystem::Op {
+ public:
+  StatOp(UringFileSystem* file_system, const GoogleString& path,
+         Sequence* sequence, StatCallback* callback)
+      : Op(file_system, sequence), path_(path), callback_(callback),
+        size_bytes_(0), atime_sec_(0), mtime_sec_(0) {
+  }
+
+#ifdef PAGESPEED_HAVE_IO_URING
+  virtual void PrepareStep(io_uring_sqe* sqe) {
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64>(path_.c_str());
+    sqe->len = STATX_BASIC_STATS;
+    sqe->off = reinterpret_cast<uint64>(&statx_);
+  }
+
+  virtual bool StepDone(int result) {
+    if (result == 0) {
+      size_bytes_ = statx_.stx_blocks * kBlockSize;
+      atime_sec_ = statx_.stx_atime.tv_sec;
+      mtime_sec_ = statx_.stx_mtime.tv_sec;
+      success_ = true;
+    }
+    return false;
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+
+  virtual void RunBlocking() {
+    NullMessageHandler null_handler;
+    struct stat statbuf;
+    if (file_system_->Stat(path_, &statbuf, &null_handler)) {
+      size_bytes_ = statbuf.st_blocks * kBlockSize;
+      atime_sec_ = statbuf.st_atime;
+      mtime_sec_ = statbuf.st_mtime;
+      success_ = true;
+    }
+  }
+
+ protected:
+  virtual void RunCallback(bool success) {
+    callback_->Done(success, size_bytes_, atime_sec_, mtime_sec_);
+  }
+
+ private:
+  GoogleString path_;
+  StatCallback* callback_;
+  int64 size_bytes_;
+  int64 atime_sec_;
+  int64 mtime_sec_;
+#ifdef PAGESPEED_HAVE_IO_URING
+  struct statx statx_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(StatOp);
+};
+
+class UringFileSystem::RenameOp : public UringFileSystem::Op {
+ public:
+  RenameOp(UringFileSystem* file_system, const GoogleString& old_filename,
+           const GoogleString& new_filename, MessageHandler* handler,
+           Sequence* sequence, WriteCallback* callback)
+      : Op(file_system, sequence), old_filename_(old_filename),
+        new_filename_(new_filename), handler_(handler), callback_(callback),
+        made_dirs_(false) {
+  }
+
+#ifdef PAGESPEED_HAVE_IO_URING
+  virtual void PrepareStep(io_uring_sqe* sqe) {
+    if (making_dirs()) {
+      PrepareMakeDir(sqe);
+      return;
+    }
+    sqe->opcode = IORING_OP_RENAMEAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64>(old_filename_.c_str());
+    sqe->len = AT_FDCWD;
+    sqe->addr2 = reinterpret_cast<uint64>(new_filename_.c_str());
+  }
+
+  virtual bool StepDone(int result) {
+    if (making_dirs()) {
+      return MakeDirDone(result, handler_);
+    }
+    if ((result == -ENOENT) && !made_dirs_) {
+      // Either old_filename_ is missing, or the directory for new_filename_
+      // is; in the latter case, the retry will succeed.
+      made_dirs_ = true;
+      StartMakingDirs(new_filename_);
+      return true;
+    } else if (result < 0) {
+      ReportError(handler_, "rename file", old_filename_, result);
+      return false;
+    }
+    success_ = true;
+    return false;
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+
+  virtual void RunBlocking() {
+    success_ = file_system_->RenameFile(old_filename_.c_str(),
+                                        new_filename_.c_str(), handler_);
+  }
+
+ protected:
+  virtual void RunCallback(bool success) {
+    callback_->Done(success);
+  }
+
+ private:
+  GoogleString old_filename_;
+  GoogleString new_filename_;
+  MessageHandler* handler_;
+  WriteCallback* callback_;
+  bool made_dirs_;
+
+  DISALLOW_COPY_AND_ASSIGN(RenameOp);
+};
+
+class UringFileSystem::CompletionThread : public ThreadSystem::Thread {
+ public:
+  CompletionThread(UringFileSystem* file_system, ThreadSystem* thread_system)
+      : Thread(thread_system, "uring_completion", ThreadSystem::kJoinable),
+        file_system_(file_system) {
+  }
+
+ protected:
+  virtual void Run() { file_system_->ReapCompletions(); }
+
+ private:
+  UringFileSystem* file_system_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompletionThread);
+};
+
+UringFileSystem::UringFileSystem(int queue_depth, ThreadSystem* thread_system)
+    : queue_depth_(queue_depth),
+      thread_system_(thread_system),
+      mutex_(thread_system->NewMutex()),
+      init_attempted_(false),
+      shutdown_(false),
+      num_in_flight_(0) {
+}
+
+UringFileSystem::~UringFileSystem() {
+  ShutDown();
+}
+
+bool UringFileSystem::IsAsync() {
+  ScopedMutex lock(mutex_.get());
+  return !shutdown_ && InitRingIfNeeded();
+}
+
+void UringFileSystem::ReadFileAsync(const GoogleString& filename,
+                                    int64 max_file_size, Sequence* sequence,
+                                    ReadCallback* callback) {
+  Start(new ReadOp(this, filename, max_file_size, sequence, callback));
+}
+
+void UringFileSystem::WriteFileAtomicAsync(const GoogleString& filename,
+                                           const SharedString& buffer,
+                                           MessageHandler* handler,
+                                           Sequence* sequence,
+                                           WriteCallback* callback) {
+  Start(new WriteOp(this, filename, buffer, handler, sequence, callback));
+}
+
+void UringFileSystem::StatAsync(const GoogleString& path, Sequence* sequence,
+                                StatCallback* callback) {
+  Start(new StatOp(this, path, sequence, callback));
+}
+
+void UringFileSystem::RenameFileAsync(const GoogleString& old_filename,
+                                      const GoogleString& new_filename,
+                                      MessageHandler* handler,
+                                      Sequence* sequence,
+                                      WriteCallback* callback) {
+  Start(new RenameOp(this, old_filename, new_filename, handler, sequence,
+                     callback));
+}
+
+void UringFileSystem::ShutDown() {
+  {
+    ScopedMutex lock(mutex_.get());
+    if (shutdown_) {
+      return;
+    }
+    shutdown_ = true;
+    if (ring_.get() == NULL) {
+      return;
+    }
+    // A NULL op tells the completion thread to exit once the ring drains.
+    // If the ring refuses it, the thread goes by shutdown_ instead.
+    Submit(NULL);
+  }
+  thread_->Join();
+  thread_.reset(NULL);
+  ScopedMutex lock(mutex_.get());
+  ring_.reset(NULL);
+}
+
+void UringFileSystem::Start(Op* op) {
+  {
+    ScopedMutex lock(mutex_.get());
+    if (!shutdown_ && InitRingIfNeeded()) {
+      if (num_in_flight_ >= queue_depth_) {
+        waiting_.push_back(op);
+        return;
+      }
+      ++num_in_flight_;
+      if (Submit(op)) {
+        return;
+      }
+      --num_in_flight_;
+    }
+  }
+  op->RunBlocking();
+  op->Deliver();
+}
+
+bool UringFileSystem::InitRingIfNeeded() {
+  if (!init_attempted_) {
+    init_attempted_ = true;
+    if (queue_depth_ > 0) {
+      scoped_ptr<Ring> ring(new Ring);
+      if (ring->Init(queue_depth_)) {
+        ring_.reset(ring.release());
+        thread_.reset(new CompletionThread(this, thread_system_));
+        if (!thread_->Start()) {
+          thread_.reset(NULL);
+          ring_.reset(NULL);
+        }
+      }
+    }
+  }
+  return ring_.get() != NULL;
+}
+
+bool UringFileSystem::Submit(Op* op) {
+#ifdef PAGESPEED_HAVE_IO_URING
+  Ring* ring = ring_.get();
+  // We are the only producer, and each entry is either consumed by
+  // io_uring_enter or taken back before we return, so the slot at the tail
+  // is always free.
+  unsigned tail = *ring->sq_tail;
+  unsigned index = tail & ring->sq_mask;
+  io_uring_sqe* sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  if (op == NULL) {
+    sqe->opcode = IORING_OP_NOP;
+  } else {
+    op->PrepareStep(sqe);
+  }
+  sqe->user_data = reinterpret_cast<uint64>(op);
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0) {
+    if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+      if (__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) != tail) {
+        return true;  // The kernel took the entry after all.
+      }
+      LOG(ERROR) << "io_uring_enter: " << strerror(errno);
+      __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+      return false;
+    }
+  }
+  return true;
+#else
+  LOG(DFATAL) << "io_uring is not supported in this build";
+  return false;
+#endif  // PAGESPEED_HAVE_IO_URING
+}
+
+void UringFileSystem::FinishBlocking(Op* op) {
+#ifdef PAGESPEED_HAVE_IO_URING
+  bool more = true;
+  while (more) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    op->PrepareStep(&sqe);
+    more = op->StepDone(RunStepBlocking(sqe));
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+  op->Deliver();
+}
+
+void UringFileSystem::ReapCompletions() {
+#ifdef PAGESPEED_HAVE_IO_URING
+  Ring* ring;
+  {
+    ScopedMutex lock(mutex_.get());
+    ring = ring_.get();
+  }
+  bool quit = false;
+  while (true) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      {
+        // If the ring refused the NOP from ShutDown we won't see it, so
+        // shutdown_ will do too.
+        ScopedMutex lock(mutex_.get());
+        if ((quit || shutdown_) && (num_in_flight_ == 0)) {
+          DCHECK(waiting_.empty());
+          return;
+        }
+      }
+      ring->WaitForCompletion();
+      continue;
+    }
+    io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+    Op* op = reinterpret_cast<Op*>(cqe->user_data);
+    int result = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    if (op == NULL) {
+      quit = true;
+      continue;
+    }
+    bool more = op->StepDone(result);
+    // Operations whose next step the ring refused; we finish them here.
+    std::vector<Op*> refused;
+    {
+      ScopedMutex lock(mutex_.get());
+      if (!more || !Submit(op)) {
+        if (more) {
+          refused.push_back(op);
+        }
+        // op's slot is free, so pass it on to a waiting operation.
+        bool slot_taken = false;
+        while (!slot_taken && !waiting_.empty()) {
+          Op* next = waiting_.front();
+          waiting_.pop_front();
+          if (Submit(next)) {
+            slot_taken = true;
+          } else {
+            refused.push_back(next);
+          }
+        }
+        if (!slot_taken) {
+          --num_in_flight_;
+        }
+      }
+    }
+    if (!more) {
+      op->Deliver();
+    }
+    for (Op* refused_op : refused) {
+      FinishBlocking(refused_op);
+    }
+  }
+#endif  // PAGESPEED_HAVE_IO_URING
+}
+
+}  // namespace net_instaweb
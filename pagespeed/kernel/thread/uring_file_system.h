@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#ifndef PAGESPEED_KERNEL_THREAD_URING_FILE_SYSTEM_H_
+#define PAGESPEED_KERNEL_THREAD_URING_FILE_SYSTEM_H_
+
+#include <deque>
+
+#include "pagespeed/kernel/base/async_file_system.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class Sequence;
+
+// A StdioFileSystem whose AsyncFileSystem operations are issued through a
+// Linux io_uring, so that cache reads and writes don't tie up a worker
+// thread while the disk is busy.  A single completion thread owns the ring:
+// it reaps completions, advances each operation to its next step
+// (open, read or write, close, rename), and finally adds the caller's
+// callback to the caller's Sequence.  The synchronous FileSystem methods
+// are inherited unchanged.
+//
+// The ring is created lazily, on the first asynchronous operation, so a
+// server that forks its children after configuration gets one ring per
+// child.  If the kernel lacks io_uring (or any opcode we need), or
+// queue_depth is 0, each asynchronous call instead runs the blocking
+// StdioFileSystem path on the calling thread and IsAsync() returns false.
+class UringFileSystem : public StdioFileSystem, public AsyncFileSystem {
+ public:
+  // Number of submission queue entries; this also bounds the number of
+  // operations in flight.  Further operations wait in a queue.
+  static const int kDefaultQueueDepth = 64;
+
+  UringFileSystem(int queue_depth, ThreadSystem* thread_system);
+  virtual ~UringFileSystem();
+
+  bool IsAsync() override LOCKS_EXCLUDED(mutex_);
+
+  void ReadFileAsync(const GoogleString& filename, int64 max_file_size,
+                     Sequence* sequence, ReadCallback* callback) override;
+  void WriteFileAtomicAsync(const GoogleString& filename,
+                            const SharedString& buffer,
+                            MessageHandler* handler, Sequence* sequence,
+                            WriteCallback* callback) override;
+  void StatAsync(const GoogleString& path, Sequence* sequence,
+                 StatCallback* callback) override;
+  void RenameFileAsync(const GoogleString& old_filename,
+                       const GoogleString& new_filename,
+                       MessageHandler* handler, Sequence* sequence,
+                       WriteCallback* callback) override;
+
+  // Waits for all operations in flight to complete and stops the
+  // completion thread.  Later asynchronous calls take the blocking path.
+  void ShutDown() LOCKS_EXCLUDED(mutex_);
+
+ private:
+  class CompletionThread;
+  class Op;
+  class ReadOp;
+  class RenameOp;
+  class StatOp;
+  class WriteOp;
+  struct Ring;
+  friend class CompletionThread;
+  friend class Op;
+
+  // Hands op to the ring, or, if the ring can't be used, runs it on this
+  // thread.  Either way op is eventually delivered to its Sequence.
+  void Start(Op* op) LOCKS_EXCLUDED(mutex_);
+
+  // Creates the ring and the completion thread if that hasn't been tried
+  // yet.  Returns true if the ring is usable.
+  bool InitRingIfNeeded() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Places the next step of op on the submission queue.  Called with
+  // mutex_ held, by Start for the first step and by the completion thread
+  // for the rest.  Returns false if io_uring_enter fails, in which case the
+  // step is taken back off the queue, and the caller must finish op some
+  // other way.
+  bool Submit(Op* op) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Runs the remaining steps of op on this thread, one system call at a
+  // time, and then delivers it.  For operations the ring refused partway.
+  void FinishBlocking(Op* op) LOCKS_EXCLUDED(mutex_);
+
+  // Body of the completion thread.
+  void ReapCompletions() LOCKS_EXCLUDED(mutex_);
+
+  const int queue_depth_;
+  ThreadSystem* thread_system_;
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<Ring> ring_ GUARDED_BY(mutex_);
+  scoped_ptr<CompletionThread> thread_;
+  bool init_attempted_ GUARDED_BY(mutex_);
+  bool shutdown_ GUARDED_BY(mutex_);
+  // Operations with a step on the ring, and operations waiting for a slot.
+  int num_in_flight_ GUARDED_BY(mutex_);
+  std::deque<Op*> waiting_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(UringFileSystem);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_THREAD_URING_FILE_SYSTEM_H_
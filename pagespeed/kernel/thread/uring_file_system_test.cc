@@ -0,0 +1,347 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+// Unit-test UringFileSystem.
+
+#include "pagespeed/kernel/thread/uring_file_system.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/async_file_system.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/scheduler.h"
+#include "pagespeed/kernel/thread/scheduler_sequence.h"
+#include "pagespeed/kernel/thread/worker_test_base.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int64 kTimeoutMs = 10 * Timer::kSecondMs;
+
+// Parameterized on whether the ring is enabled, so both the io_uring and
+// the blocking paths are covered.
+class UringFileSystemTest : public WorkerTestBase,
+                            public ::testing::WithParamInterface<bool> {
+ protected:
+  // Records the result of an operation, and counts completions.
+  class Result : public AsyncFileSystem::ReadCallback,
+                 public AsyncFileSystem::WriteCallback,
+                 public AsyncFileSystem::StatCallback {
+   public:
+    explicit Result(UringFileSystemTest* test)
+        : test_(test), success_(false), size_bytes_(0), mtime_sec_(0) {
+    }
+
+    virtual void Done(bool success, GoogleString* contents) {
+      contents_.swap(*contents);
+      Done(success);
+    }
+
+    virtual void Done(bool success) {
+      success_ = success;
+      test_->OpDone();
+    }
+
+    virtual void Done(bool success, int64 size_bytes, int64 atime_sec,
+                      int64 mtime_sec) {
+      size_bytes_ = size_bytes;
+      mtime_sec_ = mtime_sec;
+      Done(success);
+    }
+
+    bool success() const { return success_; }
+    const GoogleString& contents() const { return contents_; }
+    int64 size_bytes() const { return size_bytes_; }
+    int64 mtime_sec() const { return mtime_sec_; }
+
+   private:
+    UringFileSystemTest* test_;
+    bool success_;
+    GoogleString contents_;
+    int64 size_bytes_;
+    int64 mtime_sec_;
+
+    DISALLOW_COPY_AND_ASSIGN(Result);
+  };
+
+  UringFileSystemTest()
+      : timer_(Platform::CreateTimer()),
+        scheduler_(thread_runtime_.get(), timer_.get()),
+        sequence_(scheduler_.NewSequence()),
+        file_system_(GetParam() ? UringFileSystem::kDefaultQueueDepth : 0,
+                     thread_runtime_.get()),
+        num_done_(0),
+        num_expected_(0),
+        done_(false) {
+    dir_ = StrCat(GTestTempDir(), "/uring_file_system_test");
+  }
+
+  virtual void SetUp() {
+    DeleteDir(dir_);
+  }
+
+  virtual void TearDown() {
+    file_system_.ShutDown();
+    DeleteDir(dir_);
+  }
+
+  void DeleteDir(const GoogleString& dir) {
+    StringVector files;
+    if (file_system_.IsDir(dir.c_str(), &handler_).is_true() &&
+        file_system_.ListContents(dir, &files, &handler_)) {
+      for (int i = 0, n = files.size(); i < n; ++i) {
+        if (file_system_.IsDir(files[i].c_str(), &handler_).is_true()) {
+          DeleteDir(files[i]);
+        } else {
+          file_system_.RemoveFile(files[i].c_str(), &handler_);
+        }
+      }
+      file_system_.RemoveDir(dir.c_str(), &handler_);
+    }
+  }
+
+  // Runs callbacks on sequence_, in this thread, until num_done_ reaches
+  // num_ops.
+  void WaitForOps(int num_ops) {
+    ScopedMutex lock(scheduler_.mutex());
+    num_expected_ = num_ops;
+    done_ = (num_done_ >= num_expected_);
+    EXPECT_TRUE(sequence_->RunTasksUntil(kTimeoutMs, &done_));
+  }
+
+  // Called from callbacks, which run on this thread.
+  void OpDone() {
+    ++num_done_;
+    done_ = (num_done_ >= num_expected_);
+  }
+
+  void Write(const GoogleString& filename, const GoogleString& contents,
+             Result* result) {
+    file_system_.WriteFileAtomicAsync(filename, SharedString(contents),
+                                      &handler_, sequence_.get(), result);
+  }
+
+  void Read(const GoogleString& filename, int64 max_file_size,
+            Result* result) {
+    file_system_.ReadFileAsync(filename, max_file_size, sequence_.get(),
+                               result);
+  }
+
+  scoped_ptr<Timer> timer_;
+  Scheduler scheduler_;
+  scoped_ptr<Scheduler::Sequence> sequence_;
+  GoogleMessageHandler handler_;
+  UringFileSystem file_system_;
+  GoogleString dir_;
+  int num_done_;
+  int num_expected_;
+  bool done_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(UringFileSystemTest);
+};
+
+TEST_P(UringFileSystemTest, IsAsync) {
+  if (!GetParam()) {
+    EXPECT_FALSE(file_system_.IsAsync());
+  }
+  file_system_.ShutDown();
+  EXPECT_FALSE(file_system_.IsAsync());
+}
+
+TEST_P(UringFileSystemTest, WriteReadStatRename) {
+  // The directories are created as needed.
+  GoogleString filename = StrCat(dir_, "/a/b/file");
+  Result write(this);
+  Write(filename, "hello", &write);
+  WaitForOps(1);
+  EXPECT_TRUE(write.success());
+
+  Result read(this);
+  Read(filename, FileSystem::kUnlimitedSize, &read);
+  Result stat(this);
+  file_system_.StatAsync(filename, sequence_.get(), &stat);
+  WaitForOps(3);
+  EXPECT_TRUE(read.success());
+  EXPECT_EQ("hello", read.contents());
+  EXPECT_TRUE(stat.success());
+  EXPECT_LT(0, stat.size_bytes());
+  EXPECT_LT(0, stat.mtime_sec());
+
+  // No temp files are left behind.
+  StringVector files;
+  ASSERT_TRUE(file_system_.ListContents(StrCat(dir_, "/a/b"), &files,
+                                        &handler_));
+  EXPECT_EQ(1, files.size());
+
+  GoogleString new_filename = StrCat(dir_, "/c/file");
+  Result rename(this);
+  file_system_.RenameFileAsync(filename, new_filename, &handler_,
+                               sequence_.get(), &rename);
+  WaitForOps(4);
+  EXPECT_TRUE(rename.success());
+
+  Result read_old(this);
+  Read(filename, FileSystem::kUnlimitedSize, &read_old);
+  Result read_new(this);
+  Read(new_filename, FileSystem::kUnlimitedSize, &read_new);
+  WaitForOps(6);
+  EXPECT_FALSE(read_old.success());
+  EXPECT_TRUE(read_new.success());
+  EXPECT_EQ("hello", read_new.contents());
+}
+
+TEST_P(UringFileSystemTest, Overwrite) {
+  GoogleString filename = StrCat(dir_, "/file");
+  Result write1(this);
+  Write(filename, "a long first value", &write1);
+  WaitForOps(1);
+  Result write2(this);
+  Write(filename, "short", &write2);
+  WaitForOps(2);
+  Result read(this);
+  Read(filename, FileSystem::kUnlimitedSize, &read);
+  WaitForOps(3);
+  EXPECT_TRUE(write1.success());
+  EXPECT_TRUE(write2.success());
+  EXPECT_EQ("short", read.contents());
+}
+
+TEST_P(UringFileSystemTest, Failures) {
+  Result missing(this);
+  Read(StrCat(dir_, "/missing"), FileSystem::kUnlimitedSize, &missing);
+  Result stat_missing(this);
+  file_system_.StatAsync(StrCat(dir_, "/missing"), sequence_.get(),
+                         &stat_missing);
+  GoogleString filename = StrCat(dir_, "/file");
+  Result write(this);
+  Write(filename, "0123456789", &write);
+  WaitForOps(3);
+  EXPECT_FALSE(missing.success());
+  EXPECT_TRUE(missing.contents().empty());
+  EXPECT_FALSE(stat_missing.success());
+  EXPECT_TRUE(write.success());
+
+  Result too_big(this);
+  Read(filename, 9, &too_big);
+  Result just_fits(this);
+  Read(filename, 10, &just_fits);
+  WaitForOps(5);
+  EXPECT_FALSE(too_big.success());
+  EXPECT_TRUE(just_fits.success());
+  EXPECT_EQ("0123456789", just_fits.contents());
+}
+
+TEST_P(UringFileSystemTest, EmptyAndLargeFiles) {
+  GoogleString large;
+  for (int i = 0; large.size() < 3 * 1000 * 1000; ++i) {
+    StrAppend(&large, IntegerToString(i), ",");
+  }
+  Result write_empty(this);
+  Write(StrCat(dir_, "/empty"), "", &write_empty);
+  Result write_large(this);
+  Write(StrCat(dir_, "/large"), large, &write_large);
+  WaitForOps(2);
+  EXPECT_TRUE(write_empty.success());
+  EXPECT_TRUE(write_large.success());
+
+  Result read_empty(this);
+  Read(StrCat(dir_, "/empty"), FileSystem::kUnlimitedSize, &read_empty);
+  Result read_large(this);
+  Read(StrCat(dir_, "/large"), FileSystem::kUnlimitedSize, &read_large);
+  WaitForOps(4);
+  EXPECT_TRUE(read_empty.success());
+  EXPECT_EQ("", read_empty.contents());
+  EXPECT_TRUE(read_large.success());
+  EXPECT_TRUE(large == read_large.contents());
+}
+
+TEST_P(UringFileSystemTest, MoreOpsThanQueueDepth) {
+  const int kNumFiles = 3 * UringFileSystem::kDefaultQueueDepth;
+  std::vector<Result*> writes;
+  for (int i = 0; i < kNumFiles; ++i) {
+    writes.push_back(new Result(this));
+    Write(StrCat(dir_, "/", IntegerToString(i)), IntegerToString(i),
+          writes.back());
+  }
+  WaitForOps(kNumFiles);
+  std::vector<Result*> reads;
+  for (int i = 0; i < kNumFiles; ++i) {
+    EXPECT_TRUE(writes[i]->success());
+    reads.push_back(new Result(this));
+    Read(StrCat(dir_, "/", IntegerToString(i)), FileSystem::kUnlimitedSize,
+         reads.back());
+  }
+  WaitForOps(2 * kNumFiles);
+  for (int i = 0; i < kNumFiles; ++i) {
+    EXPECT_TRUE(reads[i]->success());
+    EXPECT_EQ(IntegerToString(i), reads[i]->contents());
+  }
+  STLDeleteElements(&writes);
+  STLDeleteElements(&reads);
+}
+
+TEST_P(UringFileSystemTest, CallbacksCanceledWithSequence) {
+  GoogleString filename = StrCat(dir_, "/file");
+  Result write(this);
+  Write(filename, "value", &write);
+  WaitForOps(1);
+
+  // If the sequence goes away before the read is delivered, the callback
+  // still runs, reporting failure.
+  Result read(this);
+  Read(filename, FileSystem::kUnlimitedSize, &read);
+  file_system_.ShutDown();  // Waits for the read to be queued.
+  sequence_.reset(NULL);
+  EXPECT_EQ(2, num_done_);
+  EXPECT_FALSE(read.success());
+}
+
+TEST_P(UringFileSystemTest, BlockingAfterShutDown) {
+  file_system_.ShutDown();
+  GoogleString filename = StrCat(dir_, "/file");
+  Result write(this);
+  Write(filename, "value", &write);
+  Result read(this);
+  Read(filename, FileSystem::kUnlimitedSize, &read);
+  WaitForOps(2);
+  EXPECT_TRUE(write.success());
+  EXPECT_EQ("value", read.contents());
+}
+
+INSTANTIATE_TEST_CASE_P(UringFileSystemTestInstance, UringFileSystemTest,
+                        ::testing::Bool());
+
+}  // namespace
+
+}  // namespace net_instaweb
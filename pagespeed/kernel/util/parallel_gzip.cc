@@ -0,0 +1,344 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "pagespeed/kernel/util/parallel_gzip.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "base/logging.h"
+#ifdef USE_SYSTEM_ZLIB
+#include "zlib.h"  // NOLINT
+#else
+#include "third_party/zlib/src/zlib.h"
+#endif
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/writer.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Deflate's maximum back-reference distance.  Each block is primed with
+// this much of the preceding input so it compresses as well as it would
+// have in a single stream.
+const size_t kDictionarySize = 32 * 1024;
+
+// Minimal gzip header (RFC 1952): no file name, no mtime, OS "Unix".
+const char kGzipHeader[] = {
+  '\x1f', '\x8b', '\x08', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x03'
+};
+
+void AppendLittleEndian32(uLong value, GoogleString* out) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+void AppendBigEndian32(uLong value, GoogleString* out) {
+  for (int i = 3; i >= 0; --i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+// Builds the two-byte zlib header (RFC 1950) that deflateInit would have
+// emitted for this level.
+GoogleString ZlibHeader(int compression_level) {
+  int level_flags;
+  if (compression_level == Z_DEFAULT_COMPRESSION || compression_level == 6) {
+    level_flags = 2;
+  } else if (compression_level < 2) {
+    level_flags = 0;
+  } else if (compression_level < 6) {
+    level_flags = 1;
+  } else {
+    level_flags = 3;
+  }
+  int header = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+  header |= level_flags << 6;
+  header += 31 - (header % 31);
+  GoogleString out;
+  out.push_back(static_cast<char>(header >> 8));
+  out.push_back(static_cast<char>(header & 0xff));
+  return out;
+}
+
+}  // namespace
+
+// Tracks the outstanding blocks of a single Deflate call so the caller can
+// wait for all of them.
+class ParallelGzip::Job {
+ public:
+  Job(int num_blocks, ThreadSystem* thread_system)
+      : mutex_(thread_system->NewMutex()),
+        condvar_(mutex_->NewCondvar()),
+        pending_(num_blocks) {
+  }
+
+  void BlockDone() {
+    ScopedMutex lock(mutex_.get());
+    --pending_;
+    if (pending_ == 0) {
+      condvar_->Signal();
+    }
+  }
+
+  void Wait() {
+    ScopedMutex lock(mutex_.get());
+    while (pending_ > 0) {
+      condvar_->Wait();
+    }
+  }
+
+ private:
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> condvar_;
+  int pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(Job);
+};
+
+// One slice of the input, compressed as a raw deflate fragment that ends
+// on a byte boundary.
+class ParallelGzip::Block {
+ public:
+  Block(StringPiece dictionary, StringPiece input, bool last,
+        GzipInflater::InflateType format, int compression_level, Job* job)
+      : dictionary_(dictionary),
+        input_(input),
+        last_(last),
+        format_(format),
+        compression_level_(compression_level),
+        check_(0),
+        success_(false),
+        cancelled_(false),
+        job_(job) {
+  }
+
+  void Run() {
+    success_ = Compress();
+    job_->BlockDone();
+  }
+
+  // Called when the pool shuts down before the block ran; the block is
+  // left for CompressIfCancelled.
+  void Cancel() {
+    cancelled_ = true;
+    job_->BlockDone();
+  }
+
+  // Compresses the block on the calling thread if the pool cancelled it.
+  // Call only once the Job is done.
+  void CompressIfCancelled() {
+    if (cancelled_) {
+      cancelled_ = false;
+      success_ = Compress();
+    }
+  }
+
+  StringPiece input() const { return input_; }
+  const GoogleString& output() const { return output_; }
+  uLong check() const { return check_; }
+  bool success() const { return success_; }
+
+ private:
+  bool Compress() {
+    const Bytef* data = reinterpret_cast<const Bytef*>(input_.data());
+    if (format_ == GzipInflater::kGzip) {
+      check_ = crc32(crc32(0L, Z_NULL, 0), data, input_.size());
+    } else {
+      check_ = adler32(adler32(0L, Z_NULL, 0), data, input_.size());
+    }
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    if (deflateInit2(&strm, compression_level_, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    if (!dictionary_.empty() &&
+        deflateSetDictionary(
+            &strm, reinterpret_cast<const Bytef*>(dictionary_.data()),
+            dictionary_.size()) != Z_OK) {
+      deflateEnd(&strm);
+      return false;
+    }
+
+    // deflateBound covers the block itself; leave room for the empty stored
+    // block that a sync flush appends.
+    output_.resize(deflateBound(&strm, input_.size()) + 16);
+    strm.next_in = const_cast<Bytef*>(data);
+    strm.avail_in = input_.size();
+    int flush = last_ ? Z_FINISH : Z_SYNC_FLUSH;
+    size_t have = 0;
+    bool done = false;
+    while (!done) {
+      if (have == output_.size()) {
+        output_.resize(2 * output_.size());
+      }
+      strm.next_out = reinterpret_cast<Bytef*>(&output_[have]);
+      strm.avail_out = output_.size() - have;
+      int ret = deflate(&strm, flush);
+      if (ret == Z_STREAM_ERROR) {
+        deflateEnd(&strm);
+        return false;
+      }
+      have = output_.size() - strm.avail_out;
+      if (last_) {
+        done = (ret == Z_STREAM_END);
+        if (!done && strm.avail_out != 0) {
+          deflateEnd(&strm);
+          return false;
+        }
+      } else {
+        done = (strm.avail_out != 0);
+      }
+    }
+    output_.resize(have);
+    deflateEnd(&strm);
+    return strm.avail_in == 0;
+  }
+
+  StringPiece dictionary_;
+  StringPiece input_;
+  bool last_;
+  GzipInflater::InflateType format_;
+  int compression_level_;
+  GoogleString output_;
+  uLong check_;
+  bool success_;
+  bool cancelled_;
+  Job* job_;
+
+  DISALLOW_COPY_AND_ASSIGN(Block);
+};
+
+ParallelGzip::ParallelGzip(int num_threads, ThreadSystem* thread_system)
+    : num_threads_(std::max(num_threads, 1)),
+      block_size_(kDefaultBlockSize),
+      min_parallel_bytes_(kDefaultMinParallelBytes),
+      thread_system_(thread_system),
+      pool_(new QueuedWorkerPool(num_threads_, "gzip", thread_system)) {
+}
+
+ParallelGzip::~ParallelGzip() {
+  ShutDown();
+}
+
+void ParallelGzip::ShutDown() {
+  pool_->ShutDown();
+}
+
+bool ParallelGzip::Deflate(StringPiece in, GzipInflater::InflateType format,
+                           int compression_level, Writer* writer) {
+  if (in.size() < min_parallel_bytes_ || block_size_ == 0) {
+    return GzipInflater::Deflate(in, format, compression_level, writer);
+  }
+  if (compression_level < 0 || compression_level > 9) {
+    compression_level = Z_DEFAULT_COMPRESSION;
+  }
+
+  int num_blocks = (in.size() + block_size_ - 1) / block_size_;
+  int num_sequences = std::min(num_threads_, num_blocks);
+  std::vector<QueuedWorkerPool::Sequence*> sequences;
+  for (int i = 0; i < num_sequences; ++i) {
+    QueuedWorkerPool::Sequence* sequence = pool_->NewSequence();
+    if (sequence == NULL) {
+      // Shutting down; finish the job on this thread.
+      for (int j = 0, n = sequences.size(); j < n; ++j) {
+        pool_->FreeSequence(sequences[j]);
+      }
+      return GzipInflater::Deflate(in, format, compression_level, writer);
+    }
+    sequences.push_back(sequence);
+  }
+
+  Job job(num_blocks, thread_system_);
+  std::vector<Block*> blocks;
+  for (int i = 0; i < num_blocks; ++i) {
+    size_t start = i * block_size_;
+    size_t dictionary_start =
+        (start > kDictionarySize) ? start - kDictionarySize : 0;
+    Block* block = new Block(
+        in.substr(dictionary_start, start - dictionary_start),
+        in.substr(start, block_size_), i == num_blocks - 1, format,
+        compression_level, &job);
+    blocks.push_back(block);
+    sequences[i % num_sequences]->Add(
+        MakeFunction(block, &Block::Run, &Block::Cancel));
+  }
+  job.Wait();
+  for (int i = 0; i < num_sequences; ++i) {
+    pool_->FreeSequence(sequences[i]);
+  }
+  // A shutdown cancels any blocks still queued; finish those here.
+  for (int i = 0; i < num_blocks; ++i) {
+    blocks[i]->CompressIfCancelled();
+  }
+
+  bool ret = true;
+  GoogleString header, trailer;
+  uLong check = 0;
+  if (format == GzipInflater::kGzip) {
+    header.assign(kGzipHeader, sizeof(kGzipHeader));
+    check = crc32(0L, Z_NULL, 0);
+  } else {
+    header = ZlibHeader(compression_level);
+    check = adler32(0L, Z_NULL, 0);
+  }
+  ret = writer->Write(header, NULL);
+  for (int i = 0; ret && (i < num_blocks); ++i) {
+    const Block* block = blocks[i];
+    if (!block->success()) {
+      ret = false;
+    } else {
+      z_off_t length = block->input().size();
+      if (format == GzipInflater::kGzip) {
+        check = crc32_combine(check, block->check(), length);
+      } else {
+        check = adler32_combine(check, block->check(), length);
+      }
+      ret = writer->Write(block->output(), NULL);
+    }
+  }
+  STLDeleteElements(&blocks);
+  if (ret) {
+    if (format == GzipInflater::kGzip) {
+      AppendLittleEndian32(check, &trailer);
+      AppendLittleEndian32(in.size() & 0xffffffffUL, &trailer);
+    } else {
+      AppendBigEndian32(check, &trailer);
+    }
+    ret = writer->Write(trailer, NULL);
+  }
+  return ret;
+}
+
+}  // namespace net_instaweb
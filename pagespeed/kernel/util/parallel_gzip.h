@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_KERNEL_UTIL_PARALLEL_GZIP_H_
+#define PAGESPEED_KERNEL_UTIL_PARALLEL_GZIP_H_
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
+
+namespace net_instaweb {
+
+class QueuedWorkerPool;
+class ThreadSystem;
+class Writer;
+
+// Compresses large buffers on several threads, in the manner of pigz.  The
+// input is cut into fixed-size blocks, and each block is raw-deflated
+// independently, primed with the last 32k of the block before it as a
+// preset dictionary.  Every block but the last ends with a sync flush, so
+// the compressed blocks are byte-aligned and can simply be concatenated
+// between a gzip (or zlib) header and trailer to form a single valid
+// stream that any inflater can read.  The per-block checksums are merged
+// with crc32_combine/adler32_combine.
+//
+// Inputs smaller than min_parallel_bytes() are handed straight to
+// GzipInflater::Deflate, as are all inputs once the pool is shut down, so
+// callers can route every deflate through here.
+//
+// Deflate is thread-safe and blocks the calling thread until the whole
+// stream has been written.
+class ParallelGzip {
+ public:
+  // Size of the input slice compressed by each work item.
+  static const int kDefaultBlockSize = 128 * 1024;
+
+  // Inputs below this size are compressed on the calling thread.
+  static const int kDefaultMinParallelBytes = 256 * 1024;
+
+  ParallelGzip(int num_threads, ThreadSystem* thread_system);
+  ~ParallelGzip();
+
+  // Deflates in, writing a complete gzip or zlib stream to writer.  The
+  // output may differ byte-for-byte from GzipInflater::Deflate, but
+  // inflates to the same content.  Returns false on failure.
+  bool Deflate(StringPiece in, GzipInflater::InflateType format,
+               int compression_level, Writer* writer);
+
+  // Stops the worker threads.  Subsequent calls to Deflate compress
+  // serially, and a Deflate in progress compresses the blocks that had not
+  // started yet on its own thread.
+  void ShutDown();
+
+  int num_threads() const { return num_threads_; }
+
+  size_t block_size() const { return block_size_; }
+  void set_block_size(size_t x) { block_size_ = x; }
+
+  size_t min_parallel_bytes() const { return min_parallel_bytes_; }
+  void set_min_parallel_bytes(size_t x) { min_parallel_bytes_ = x; }
+
+ private:
+  class Block;
+  class Job;
+
+  int num_threads_;
+  size_t block_size_;
+  size_t min_parallel_bytes_;
+  ThreadSystem* thread_system_;
+  scoped_ptr<QueuedWorkerPool> pool_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelGzip);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_UTIL_PARALLEL_GZIP_H_
@@ -0,0 +1,125 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+//
+// Measures ParallelGzip throughput on a 4MB low-entropy payload (similar to
+// a large combined JS bundle) as the number of compression threads grows.
+// The serial row is GzipInflater::Deflate for comparison.  Throughput is
+// reported in MB/s of uncompressed input.
+//
+// Benchmark                     Time(ns)     MB/s
+// -----------------------------------------------
+// BM_SerialGzip                 45150303     88.6
+// BM_ParallelGzip1Thread        49940311     80.1
+// BM_ParallelGzip2Threads       24443570    163.6
+// BM_ParallelGzip4Threads       22724527    176.0
+// BM_ParallelGzip8Threads       31966285    125.1
+//
+// The parallel output is about 3% larger than the serial output because
+// every block restarts its Huffman tables and ends with a sync flush.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
+#include "pagespeed/kernel/util/parallel_gzip.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_random.h"
+
+namespace {
+
+const int kPayloadSize = 4 * 1000 * 1000;
+const int kCompressionLevel = 9;
+
+GoogleString MakePayload() {
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  GoogleString chunk = random.GenerateHighEntropyString(1000);
+  GoogleString value;
+  while (static_cast<int>(value.size()) < kPayloadSize) {
+    value += chunk;
+    value += "var x = document.getElementById('content');\n";
+  }
+  value.resize(kPayloadSize);
+  return value;
+}
+
+static void BM_SerialGzip(int iters) {
+  StopBenchmarkTiming();
+  GoogleString payload = MakePayload();
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    GoogleString out;
+    net_instaweb::StringWriter writer(&out);
+    net_instaweb::GzipInflater::Deflate(
+        payload, net_instaweb::GzipInflater::kGzip, kCompressionLevel,
+        &writer);
+  }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * kPayloadSize);
+}
+
+void TestParallelGzip(int num_threads, int iters) {
+  StopBenchmarkTiming();
+  GoogleString payload = MakePayload();
+  net_instaweb::scoped_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::ParallelGzip gzip(num_threads, thread_system.get());
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    GoogleString out;
+    net_instaweb::StringWriter writer(&out);
+    gzip.Deflate(payload, net_instaweb::GzipInflater::kGzip,
+                 kCompressionLevel, &writer);
+  }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * kPayloadSize);
+  StopBenchmarkTiming();
+}
+
+static void BM_ParallelGzip1Thread(int iters) {
+  TestParallelGzip(1, iters);
+}
+
+static void BM_ParallelGzip2Threads(int iters) {
+  TestParallelGzip(2, iters);
+}
+
+static void BM_ParallelGzip4Threads(int iters) {
+  TestParallelGzip(4, iters);
+}
+
+static void BM_ParallelGzip8Threads(int iters) {
+  TestParallelGzip(8, iters);
+}
+
+}  // namespace
+
+BENCHMARK(BM_SerialGzip);
+BENCHMARK(BM_ParallelGzip1Thread);
+BENCHMARK(BM_ParallelGzip2Threads);
+BENCHMARK(BM_ParallelGzip4Threads);
+BENCHMARK(BM_ParallelGzip8Threads);
@@ -0,0 +1,201 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+// Unit-test ParallelGzip.
+
+#include "pagespeed/kernel/util/parallel_gzip.h"
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_random.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumThreads = 4;
+
+// Runs one Deflate, so the test thread can shut the pool down under it.
+class DeflateThread : public ThreadSystem::Thread {
+ public:
+  DeflateThread(ParallelGzip* gzip, StringPiece payload,
+                ThreadSystem* thread_system)
+      : Thread(thread_system, "deflate", ThreadSystem::kJoinable),
+        gzip_(gzip),
+        payload_(payload),
+        success_(false) {
+  }
+
+  const GoogleString& deflated() const { return deflated_; }
+  bool success() const { return success_; }
+
+ protected:
+  virtual void Run() {
+    StringWriter writer(&deflated_);
+    success_ = gzip_->Deflate(payload_, GzipInflater::kGzip, 9, &writer);
+  }
+
+ private:
+  ParallelGzip* gzip_;
+  StringPiece payload_;
+  GoogleString deflated_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeflateThread);
+};
+
+class ParallelGzipTest : public testing::Test {
+ protected:
+  ParallelGzipTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        gzip_(kNumThreads, thread_system_.get()),
+        random_(new NullMutex) {
+    // Use small blocks so modest payloads span many of them.
+    gzip_.set_block_size(8 * 1024);
+    gzip_.set_min_parallel_bytes(16 * 1024);
+  }
+
+  // Mixes repetitive text with random bytes so that back-references
+  // cross block boundaries and some blocks barely compress.
+  GoogleString MakePayload(int size) {
+    GoogleString payload;
+    while (static_cast<int>(payload.size()) < size) {
+      StrAppend(&payload, "function f", IntegerToString(payload.size() % 97),
+                "() { return document.getElementById('x'); }\n");
+      if ((payload.size() % 5) == 0) {
+        payload += random_.GenerateHighEntropyString(200);
+      }
+    }
+    payload.resize(size);
+    return payload;
+  }
+
+  void TestRoundTrip(StringPiece payload, GzipInflater::InflateType format,
+                     int level) {
+    GoogleString deflated, inflated;
+    StringWriter deflate_writer(&deflated);
+    ASSERT_TRUE(gzip_.Deflate(payload, format, level, &deflate_writer));
+    if (format == GzipInflater::kGzip) {
+      EXPECT_TRUE(GzipInflater::HasGzipMagicBytes(deflated));
+    }
+    StringWriter inflate_writer(&inflated);
+    ASSERT_TRUE(GzipInflater::Inflate(deflated, format, &inflate_writer));
+    EXPECT_EQ(payload.size(), inflated.size());
+    EXPECT_TRUE(payload == inflated);
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  ParallelGzip gzip_;
+  SimpleRandom random_;
+};
+
+TEST_F(ParallelGzipTest, SmallInputIsSerial) {
+  // Below the threshold we should produce exactly what GzipInflater does.
+  GoogleString payload = MakePayload(1000);
+  GoogleString parallel, serial;
+  StringWriter parallel_writer(&parallel), serial_writer(&serial);
+  ASSERT_TRUE(gzip_.Deflate(payload, GzipInflater::kGzip, 9,
+                            &parallel_writer));
+  ASSERT_TRUE(GzipInflater::Deflate(payload, GzipInflater::kGzip, 9,
+                                    &serial_writer));
+  EXPECT_EQ(serial, parallel);
+  TestRoundTrip(payload, GzipInflater::kGzip, 9);
+}
+
+TEST_F(ParallelGzipTest, Gzip) {
+  TestRoundTrip(MakePayload(100 * 1000), GzipInflater::kGzip, 9);
+}
+
+TEST_F(ParallelGzipTest, Deflate) {
+  TestRoundTrip(MakePayload(100 * 1000), GzipInflater::kDeflate, 9);
+}
+
+TEST_F(ParallelGzipTest, Levels) {
+  GoogleString payload = MakePayload(50 * 1000);
+  for (int level = -1; level <= 9; ++level) {
+    TestRoundTrip(payload, GzipInflater::kGzip, level);
+    TestRoundTrip(payload, GzipInflater::kDeflate, level);
+  }
+}
+
+TEST_F(ParallelGzipTest, BlockBoundaries) {
+  // Exact multiples of the block size, and one byte either side.
+  for (int size = 16 * 1024 - 1; size <= 16 * 1024 + 1; ++size) {
+    TestRoundTrip(MakePayload(size), GzipInflater::kGzip, 6);
+  }
+  TestRoundTrip(MakePayload(64 * 1024), GzipInflater::kDeflate, 6);
+}
+
+TEST_F(ParallelGzipTest, HighEntropy) {
+  TestRoundTrip(random_.GenerateHighEntropyString(100 * 1000),
+                GzipInflater::kGzip, 9);
+}
+
+TEST_F(ParallelGzipTest, CompressionComparableToSerial) {
+  // Priming each block with its predecessor's window should keep the
+  // parallel output within a few percent of a single-stream deflate.
+  GoogleString payload = MakePayload(200 * 1000);
+  GoogleString parallel, serial;
+  StringWriter parallel_writer(&parallel), serial_writer(&serial);
+  ASSERT_TRUE(gzip_.Deflate(payload, GzipInflater::kGzip, 9,
+                            &parallel_writer));
+  ASSERT_TRUE(GzipInflater::Deflate(payload, GzipInflater::kGzip, 9,
+                                    &serial_writer));
+  EXPECT_LT(parallel.size(), serial.size() * 105 / 100);
+}
+
+TEST_F(ParallelGzipTest, AfterShutDown) {
+  gzip_.ShutDown();
+  TestRoundTrip(MakePayload(100 * 1000), GzipInflater::kGzip, 9);
+}
+
+TEST_F(ParallelGzipTest, ShutDownDuringDeflate) {
+  // Blocks the shutdown cancels are compressed on the calling thread, so
+  // the Deflate still succeeds.
+  GoogleString payload = MakePayload(4 * 1000 * 1000);
+  DeflateThread thread(&gzip_, payload, thread_system_.get());
+  ASSERT_TRUE(thread.Start());
+  // Give the Deflate time to queue its blocks, most of which will still be
+  // waiting when the pool shuts down.
+  scoped_ptr<Timer> timer(thread_system_->NewTimer());
+  timer->SleepMs(20);
+  gzip_.ShutDown();
+  thread.Join();
+  ASSERT_TRUE(thread.success());
+  GoogleString inflated;
+  StringWriter inflate_writer(&inflated);
+  ASSERT_TRUE(GzipInflater::Inflate(thread.deflated(), GzipInflater::kGzip,
+                                    &inflate_writer));
+  EXPECT_TRUE(payload == inflated);
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -132,6 +132,10 @@ const char* const kGraphsVars[] = {
   "redis_async_deletes",
   "redis_blocking_hits", "redis_blocking_inserts", "redis_blocking_misses",
   "redis_blocking_deletes",
+  "adaptive_rewrite_deadline_ms",
+  // Per-filter CPU accounting, see RewriteStats::AddFilterCpuUs.
+  "filter_cpu_sampled_pages", "filter_cpu_html_us", "filter_cpu_rewrite_us",
+  "filter_cpu_render_us",
 };
 
 }  // namespace
@@ -0,0 +1,291 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#include "pagespeed/kernel/util/threaded_benchmark.h"
+
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+int64 NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Latency summary for one benchmark at one thread count.
+struct Result {
+  GoogleString name;
+  int num_threads;
+  int iters;
+  int64 elapsed_ns;
+  int64 num_samples;
+  int64 p50_ns;
+  int64 p90_ns;
+  int64 p99_ns;
+  int64 p999_ns;
+  int64 max_ns;
+};
+
+// The runner calls each benchmark with growing iteration counts until a run
+// is long enough to time, so we keep only the last Result for each name and
+// thread count, and report them when the process exits.
+std::vector<Result>* results = NULL;
+
+GoogleString JsonEscape(StringPiece in) {
+  GoogleString out;
+  for (int i = 0, n = in.size(); i < n; ++i) {
+    if ((in[i] == '"') || (in[i] == '\\')) {
+      out.push_back('\\');
+    }
+    out.push_back(in[i]);
+  }
+  return out;
+}
+
+void WriteJson(const char* filename) {
+  GoogleString json = "[\n";
+  for (int i = 0, n = results->size(); i < n; ++i) {
+    const Result& r = (*results)[i];
+    StrAppend(&json, "  {\"name\": \"", JsonEscape(r.name), "\", ",
+              "\"threads\": ", IntegerToString(r.num_threads), ", ");
+    StrAppend(&json, "\"iterations\": ", IntegerToString(r.iters), ", ",
+              "\"elapsed_ns\": ", Integer64ToString(r.elapsed_ns), ", ");
+    StrAppend(&json, "\"samples\": ", Integer64ToString(r.num_samples), ", ",
+              "\"latency_ns\": {");
+    StrAppend(&json, "\"p50\": ", Integer64ToString(r.p50_ns), ", ",
+              "\"p90\": ", Integer64ToString(r.p90_ns), ", ");
+    StrAppend(&json, "\"p99\": ", Integer64ToString(r.p99_ns), ", ",
+              "\"p999\": ", Integer64ToString(r.p999_ns), ", ");
+    StrAppend(&json, "\"max\": ", Integer64ToString(r.max_ns), "}}",
+              (i + 1 < n) ? ",\n" : "\n");
+  }
+  json += "]\n";
+  FILE* file = fopen(filename, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to open %s for benchmark results\n", filename);
+    return;
+  }
+  fwrite(json.data(), 1, json.size(), file);
+  fclose(file);
+}
+
+void ReportResults() {
+  printf("\n%-40s %7s %10s %10s %10s %10s %10s\n", "Latency(ns)", "Threads",
+         "p50", "p90", "p99", "p99.9", "max");
+  for (int i = 0, n = results->size(); i < n; ++i) {
+    const Result& r = (*results)[i];
+    printf("%-40s %7d %10lld %10lld %10lld %10lld %10lld\n", r.name.c_str(),
+           r.num_threads, static_cast<long long>(r.p50_ns),
+           static_cast<long long>(r.p90_ns), static_cast<long long>(r.p99_ns),
+           static_cast<long long>(r.p999_ns), static_cast<long long>(r.max_ns));
+  }
+  const char* filename = getenv(ThreadedBenchmark::kJsonOutputEnvVar);
+  if ((filename != NULL) && (*filename != '\0')) {
+    WriteJson(filename);
+  }
+  delete results;
+  results = NULL;
+}
+
+void RecordResult(const Result& result) {
+  if (results == NULL) {
+    results = new std::vector<Result>;
+    atexit(ReportResults);
+  }
+  for (int i = 0, n = results->size(); i < n; ++i) {
+    Result& r = (*results)[i];
+    if ((r.name == result.name) && (r.num_threads == result.num_threads)) {
+      r = result;
+      return;
+    }
+  }
+  results->push_back(result);
+}
+
+int64 Percentile(const std::vector<int64>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  int index = static_cast<int>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+// Holds the threads at the starting line until every one has been created,
+// so thread start-up cost doesn't skew the measurement.
+class StartingGate {
+ public:
+  StartingGate(int num_threads, ThreadSystem* thread_system)
+      : mutex_(thread_system->NewMutex()),
+        ready_condvar_(mutex_->NewCondvar()),
+        go_condvar_(mutex_->NewCondvar()),
+        num_waiting_(num_threads),
+        open_(false) {
+  }
+
+  // Called by each thread before its first iteration.
+  void Wait() {
+    ScopedMutex lock(mutex_.get());
+    --num_waiting_;
+    if (num_waiting_ == 0) {
+      ready_condvar_->Signal();
+    }
+    while (!open_) {
+      go_condvar_->Wait();
+    }
+  }
+
+  // Called by the benchmark thread; returns once all threads are waiting.
+  void WaitUntilReady() {
+    ScopedMutex lock(mutex_.get());
+    while (num_waiting_ > 0) {
+      ready_condvar_->Wait();
+    }
+  }
+
+  void Open() {
+    ScopedMutex lock(mutex_.get());
+    open_ = true;
+    go_condvar_->Broadcast();
+  }
+
+ private:
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> ready_condvar_;
+  scoped_ptr<ThreadSystem::Condvar> go_condvar_;
+  int num_waiting_;
+  bool open_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartingGate);
+};
+
+class BenchmarkThread : public ThreadSystem::Thread {
+ public:
+  BenchmarkThread(ThreadSystem* thread_system, int thread_index, int iters,
+                  StartingGate* gate, ThreadedBenchmark::Body* body)
+      : Thread(thread_system, "benchmark", ThreadSystem::kJoinable),
+        thread_index_(thread_index),
+        iters_(iters),
+        gate_(gate),
+        body_(body) {
+    samples_.reserve(iters / ThreadedBenchmark::kLatencySampleInterval + 1);
+  }
+
+  virtual void Run() {
+    gate_->Wait();
+    for (int i = 0; i < iters_; ++i) {
+      if ((i % ThreadedBenchmark::kLatencySampleInterval) == 0) {
+        int64 start_ns = NowNs();
+        body_->RunIteration(thread_index_, i);
+        samples_.push_back(NowNs() - start_ns);
+      } else {
+        body_->RunIteration(thread_index_, i);
+      }
+    }
+  }
+
+  const std::vector<int64>& samples() const { return samples_; }
+
+ private:
+  int thread_index_;
+  int iters_;
+  StartingGate* gate_;
+  ThreadedBenchmark::Body* body_;
+  std::vector<int64> samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(BenchmarkThread);
+};
+
+}  // namespace
+
+const char ThreadedBenchmark::kJsonOutputEnvVar[] = "PAGESPEED_BENCHMARK_JSON";
+
+ThreadedBenchmark::Body::~Body() {
+}
+
+void ThreadedBenchmark::Run(const char* name, int iters, int num_threads,
+                            Body* body) {
+  StopBenchmarkTiming();
+  num_threads = std::max(num_threads, 1);
+  scoped_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  StartingGate gate(num_threads, thread_system.get());
+  std::vector<BenchmarkThread*> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    // Hand the remainder out one apiece so the total is exactly iters.
+    int thread_iters =
+        iters / num_threads + ((i < iters % num_threads) ? 1 : 0);
+    threads.push_back(new BenchmarkThread(thread_system.get(), i,
+                                          thread_iters, &gate, body));
+    CHECK(threads.back()->Start());
+  }
+  gate.WaitUntilReady();
+
+  StartBenchmarkTiming();
+  int64 start_ns = NowNs();
+  gate.Open();
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i]->Join();
+  }
+  int64 elapsed_ns = NowNs() - start_ns;
+  StopBenchmarkTiming();
+
+  std::vector<int64> samples;
+  for (int i = 0; i < num_threads; ++i) {
+    samples.insert(samples.end(), threads[i]->samples().begin(),
+                   threads[i]->samples().end());
+  }
+  STLDeleteElements(&threads);
+  std::sort(samples.begin(), samples.end());
+
+  Result result;
+  result.name = name;
+  result.num_threads = num_threads;
+  result.iters = iters;
+  result.elapsed_ns = elapsed_ns;
+  result.num_samples = samples.size();
+  result.p50_ns = Percentile(samples, 0.5);
+  result.p90_ns = Percentile(samples, 0.9);
+  result.p99_ns = Percentile(samples, 0.99);
+  result.p999_ns = Percentile(samples, 0.999);
+  result.max_ns = samples.empty() ? 0 : samples.back();
+  RecordResult(result);
+}
+
+}  // namespace net_instaweb
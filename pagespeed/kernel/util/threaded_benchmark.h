@@ -0,0 +1,89 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#ifndef PAGESPEED_KERNEL_UTIL_THREADED_BENCHMARK_H_
+#define PAGESPEED_KERNEL_UTIL_THREADED_BENCHMARK_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+// Runs a benchmark body on several threads at once, to measure how kernel
+// primitives behave under contention.  The RE2 benchmark runner our speed
+// tests are built on only runs benchmarks on its own thread, so a
+// multi-threaded benchmark is registered with BENCHMARK_THREAD_RANGE, takes
+// the thread count as its argument, and hands the work to
+// ThreadedBenchmark::Run:
+//
+//   static void BM_CacheGets(int iters, int num_threads) {
+//     StopBenchmarkTiming();
+//     CacheGetsBody body(...);
+//     ThreadedBenchmark::Run("BM_CacheGets", iters, num_threads, &body);
+//   }
+//   BENCHMARK_THREAD_RANGE(BM_CacheGets, 1, 16);
+//
+// The iterations are split evenly between the threads, which are released
+// together once they have all started.  Only the time from release until
+// the last thread finishes is counted, so the runner's ns/op column is the
+// inverse of aggregate throughput.
+//
+// Every kLatencySampleInterval'th iteration on each thread is also timed on
+// its own.  When the process exits, latency percentiles from the final run
+// of each benchmark and thread count are printed, and if the environment
+// variable PAGESPEED_BENCHMARK_JSON names a file, they are written there as
+// a JSON array for comparing runs with scripts.
+class ThreadedBenchmark {
+ public:
+  // Timing every iteration would add two clock reads to operations that
+  // take tens of nanoseconds, so we sample.
+  static const int kLatencySampleInterval = 16;
+
+  // Name of the environment variable giving the JSON output file.
+  static const char kJsonOutputEnvVar[];
+
+  class Body {
+   public:
+    Body() {}
+    virtual ~Body();
+
+    // Runs the iteration'th of this thread's iterations on behalf of
+    // thread thread_index, which is in [0, num_threads).  This is called
+    // concurrently from every thread.
+    virtual void RunIteration(int thread_index, int iteration) = 0;
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(Body);
+  };
+
+  // Runs body->RunIteration iters times in total, spread over num_threads
+  // threads, and records the latency distribution under name.  Benchmark
+  // timing is started when the threads are released and stopped when they
+  // have all finished, whatever state it was in on entry.
+  static void Run(const char* name, int iters, int num_threads, Body* body);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(ThreadedBenchmark);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_UTIL_THREADED_BENCHMARK_H_
@@ -90,6 +90,7 @@
         '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_base_core',
       ],
       'sources': [
+        'opt/logging/log_event_buffer.cc',
         'opt/logging/log_record.cc',
         'opt/logging/request_timing_info.cc',
       ],
@@ -39,6 +39,7 @@ RequestContext::RequestContext(const HttpOptions& options,
       options_set_(true),
       options_(options) {
   Init();
+  log_record_->SetBufferRewriterInfo(true);
 }
 
 RequestContext::RequestContext(AbstractMutex* logging_mutex, Timer* timer)
@@ -51,6 +52,7 @@ RequestContext::RequestContext(AbstractMutex* logging_mutex, Timer* timer)
       // set_options to be called
       options_(kDeprecatedDefaultHttpOptions) {
   Init();
+  log_record_->SetBufferRewriterInfo(true);
 }
 
 RequestContext::RequestContext(const HttpOptions& options,
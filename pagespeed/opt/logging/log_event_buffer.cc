@@ -0,0 +1,67 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#include "pagespeed/opt/logging/log_event_buffer.h"
+
+#include <cstring>
+
+namespace net_instaweb {
+
+const int LogEventBuffer::kCapacity;
+const int LogEventBuffer::kMaxIdSize;
+
+LogEventBuffer::LogEventBuffer() : num_read_(0) {
+}
+
+LogEventBuffer::~LogEventBuffer() {
+}
+
+bool LogEventBuffer::Append(Type type, StringPiece id, int status) {
+  // Checking first keeps num_claimed_ from growing without bound once the
+  // buffer is full.
+  if (id.size() > static_cast<size_t>(kMaxIdSize) ||
+      num_claimed_.value() >= kCapacity) {
+    return false;
+  }
+  int32 index = num_claimed_.NoBarrierIncrement(1) - 1;
+  if (index >= kCapacity) {
+    return false;
+  }
+  Event* event = &slots_[index].event;
+  event->type = type;
+  event->status = status;
+  memcpy(event->id, id.data(), id.size());
+  event->id[id.size()] = '\0';
+  slots_[index].published.set_value(true);
+  return true;
+}
+
+bool LogEventBuffer::Next(Event* event) {
+  if (num_read_ >= kCapacity || !slots_[num_read_].published.value()) {
+    return false;
+  }
+  *event = slots_[num_read_].event;
+  ++num_read_;
+  return true;
+}
+
+}  // namespace net_instaweb
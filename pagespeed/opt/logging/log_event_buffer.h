@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#ifndef PAGESPEED_OPT_LOGGING_LOG_EVENT_BUFFER_H_
+#define PAGESPEED_OPT_LOGGING_LOG_EVENT_BUFFER_H_
+
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// Fixed-capacity, append-only buffer of compact per-request logging events.
+// Any number of threads may Append concurrently without taking a lock; a
+// single consumer at a time (AbstractLogRecord, under its mutex) reads the
+// events back in the order their slots were claimed.
+//
+// Each event is a fixed-size record holding the rewriter id inline, so
+// appending never allocates.  When the buffer is full, or an id is too long
+// to store inline, Append fails and the caller logs by other means.
+class LogEventBuffer {
+ public:
+  static const int kCapacity = 128;
+
+  // Rewriter ids are two or three characters; leave some room.
+  static const int kMaxIdSize = 7;
+
+  enum Type {
+    kApplicationStatus,  // AbstractLogRecord::LogRewriterApplicationStatus
+    kHtmlStatus,         // AbstractLogRecord::LogRewriterHtmlStatus
+    kRewriterInfo,       // AbstractLogRecord::SetRewriterLoggingStatus
+  };
+
+  struct Event {
+    Type type;
+    int status;
+    char id[kMaxIdSize + 1];
+  };
+
+  LogEventBuffer();
+  ~LogEventBuffer();
+
+  // Records an event.  Returns false, recording nothing, if the buffer is
+  // full or id is longer than kMaxIdSize.
+  bool Append(Type type, StringPiece id, int status);
+
+  // Copies the oldest event not yet read into *event and returns true.
+  // Returns false if there is none, or if the next slot has been claimed
+  // by an Append that has not yet finished writing it; a later call will
+  // pick it up.  Must not be called concurrently with itself.
+  bool Next(Event* event);
+
+ private:
+  struct Slot {
+    Event event;
+    AtomicBool published;
+  };
+
+  Slot slots_[kCapacity];
+  AtomicInt32 num_claimed_;
+  int num_read_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogEventBuffer);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_OPT_LOGGING_LOG_EVENT_BUFFER_H_
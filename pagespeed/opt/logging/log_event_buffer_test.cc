@@ -0,0 +1,153 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+
+#include "pagespeed/opt/logging/log_event_buffer.h"
+
+#include <set>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumThreads = 4;
+const int kEventsPerThread = LogEventBuffer::kCapacity / kNumThreads;
+
+class AppendThread : public ThreadSystem::Thread {
+ public:
+  AppendThread(ThreadSystem* thread_system, LogEventBuffer* buffer, int id)
+      : ThreadSystem::Thread(thread_system, "log_event_buffer_test",
+                             ThreadSystem::kJoinable),
+        buffer_(buffer),
+        id_(IntegerToString(id)) {
+  }
+
+  virtual void Run() {
+    for (int i = 0; i < kEventsPerThread; ++i) {
+      EXPECT_TRUE(buffer_->Append(LogEventBuffer::kApplicationStatus, id_, i));
+    }
+  }
+
+ private:
+  LogEventBuffer* buffer_;
+  GoogleString id_;
+
+  DISALLOW_COPY_AND_ASSIGN(AppendThread);
+};
+
+}  // namespace
+
+class LogEventBufferTest : public testing::Test {
+ protected:
+  LogEventBuffer buffer_;
+};
+
+TEST_F(LogEventBufferTest, Empty) {
+  LogEventBuffer::Event event;
+  EXPECT_FALSE(buffer_.Next(&event));
+}
+
+TEST_F(LogEventBufferTest, ReadInOrder) {
+  EXPECT_TRUE(buffer_.Append(LogEventBuffer::kHtmlStatus, "ll", 1));
+  EXPECT_TRUE(buffer_.Append(LogEventBuffer::kRewriterInfo, "ic", 2));
+
+  LogEventBuffer::Event event;
+  ASSERT_TRUE(buffer_.Next(&event));
+  EXPECT_EQ(LogEventBuffer::kHtmlStatus, event.type);
+  EXPECT_STREQ("ll", event.id);
+  EXPECT_EQ(1, event.status);
+
+  // Events appended after a read are picked up by the next one.
+  EXPECT_TRUE(buffer_.Append(LogEventBuffer::kApplicationStatus, "jm", 3));
+  ASSERT_TRUE(buffer_.Next(&event));
+  EXPECT_EQ(LogEventBuffer::kRewriterInfo, event.type);
+  EXPECT_STREQ("ic", event.id);
+  ASSERT_TRUE(buffer_.Next(&event));
+  EXPECT_EQ(LogEventBuffer::kApplicationStatus, event.type);
+  EXPECT_STREQ("jm", event.id);
+  EXPECT_EQ(3, event.status);
+  EXPECT_FALSE(buffer_.Next(&event));
+}
+
+TEST_F(LogEventBufferTest, RejectsLongIds) {
+  EXPECT_TRUE(buffer_.Append(LogEventBuffer::kHtmlStatus, "1234567", 0));
+  EXPECT_FALSE(buffer_.Append(LogEventBuffer::kHtmlStatus, "12345678", 0));
+  LogEventBuffer::Event event;
+  ASSERT_TRUE(buffer_.Next(&event));
+  EXPECT_STREQ("1234567", event.id);
+  EXPECT_FALSE(buffer_.Next(&event));
+}
+
+TEST_F(LogEventBufferTest, Full) {
+  for (int i = 0; i < LogEventBuffer::kCapacity; ++i) {
+    EXPECT_TRUE(buffer_.Append(LogEventBuffer::kApplicationStatus, "a", i));
+  }
+  EXPECT_FALSE(buffer_.Append(LogEventBuffer::kApplicationStatus, "a", 0));
+
+  // Reading does not make room.
+  LogEventBuffer::Event event;
+  for (int i = 0; i < LogEventBuffer::kCapacity; ++i) {
+    ASSERT_TRUE(buffer_.Next(&event));
+    EXPECT_EQ(i, event.status);
+  }
+  EXPECT_FALSE(buffer_.Next(&event));
+  EXPECT_FALSE(buffer_.Append(LogEventBuffer::kApplicationStatus, "a", 0));
+}
+
+TEST_F(LogEventBufferTest, ConcurrentAppends) {
+  scoped_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  scoped_ptr<AppendThread> threads[kNumThreads];
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i].reset(new AppendThread(thread_system.get(), &buffer_, i));
+    ASSERT_TRUE(threads[i]->Start());
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i]->Join();
+  }
+
+  // Every event arrives exactly once, and each thread's events arrive in
+  // the order that thread appended them.
+  std::set<GoogleString> seen;
+  int next_status[kNumThreads] = {0};
+  LogEventBuffer::Event event;
+  while (buffer_.Next(&event)) {
+    int thread;
+    ASSERT_TRUE(StringToInt(event.id, &thread));
+    ASSERT_LE(0, thread);
+    ASSERT_GT(kNumThreads, thread);
+    EXPECT_EQ(next_status[thread], event.status);
+    ++next_status[thread];
+    EXPECT_TRUE(seen.insert(StrCat(event.id, ":",
+                                   IntegerToString(event.status))).second);
+  }
+  EXPECT_EQ(LogEventBuffer::kCapacity, seen.size());
+}
+
+}  // namespace net_instaweb
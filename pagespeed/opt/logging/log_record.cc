@@ -37,7 +37,8 @@ AbstractLogRecord::AbstractLogRecord(AbstractMutex* mutex)
     : mutex_(mutex),
       rewriter_info_max_size_(-1),
       allow_logging_urls_(false),
-      log_url_indices_(false) {
+      log_url_indices_(false),
+      buffer_rewriter_info_(false) {
 }
 
 AbstractLogRecord::~AbstractLogRecord() {
@@ -55,17 +56,55 @@ void AbstractLogRecord::SetIsHtml(bool is_html) {
   logging_info()->set_is_html_response(true);
 }
 
+LoggingInfo* AbstractLogRecord::logging_info() {
+  ReadEvents();
+  return logging_info_proto();
+}
+
+void AbstractLogRecord::ReadEvents() {
+  LogEventBuffer::Event event;
+  while (events_.Next(&event)) {
+    RewriterStatsInternal* stats = &rewriter_stats_[event.id];
+    switch (event.type) {
+      case LogEventBuffer::kApplicationStatus:
+        stats->status_counts[
+            static_cast<RewriterApplication::Status>(event.status)]++;
+        break;
+      case LogEventBuffer::kHtmlStatus:
+        stats->html_status =
+            static_cast<RewriterHtmlApplication::Status>(event.status);
+        break;
+      case LogEventBuffer::kRewriterInfo: {
+        RewriterApplication::Status status =
+            static_cast<RewriterApplication::Status>(event.status);
+        stats->status_counts[status]++;
+        RewriterInfo* rewriter_info = AddRewriterInfo(event.id);
+        if (rewriter_info != NULL) {
+          rewriter_info->set_status(status);
+        }
+        break;
+      }
+    }
+  }
+}
+
 RewriterInfo* AbstractLogRecord::NewRewriterInfo(const char* rewriter_id) {
   ScopedMutex lock(mutex_.get());
+  ReadEvents();
+  return AddRewriterInfo(rewriter_id);
+}
+
+RewriterInfo* AbstractLogRecord::AddRewriterInfo(const char* rewriter_id) {
+  LoggingInfo* info = logging_info_proto();
   if (rewriter_info_max_size_ != -1 &&
-      logging_info()->rewriter_info_size() >= rewriter_info_max_size_) {
-    if (!logging_info()->rewriter_info_size_limit_exceeded()) {
+      info->rewriter_info_size() >= rewriter_info_max_size_) {
+    if (!info->rewriter_info_size_limit_exceeded()) {
       VLOG(1) << "Exceeded size limit for rewriter info.";
-      logging_info()->set_rewriter_info_size_limit_exceeded(true);
+      info->set_rewriter_info_size_limit_exceeded(true);
     }
     return NULL;
   }
-  RewriterInfo* rewriter_info = logging_info()->add_rewriter_info();
+  RewriterInfo* rewriter_info = info->add_rewriter_info();
   rewriter_info->set_id(rewriter_id);
   return rewriter_info;
 }
@@ -75,6 +114,17 @@ void AbstractLogRecord::SetRewriterLoggingStatus(
   SetRewriterLoggingStatus(id, "", status);
 }
 
+void AbstractLogRecord::SetRewriterLoggingStatus(
+    const char* id, const GoogleString& url,
+    RewriterApplication::Status status) {
+  DCHECK(RewriterApplication::Status_IsValid(status));
+  if (buffer_rewriter_info_now_.value() &&
+      events_.Append(LogEventBuffer::kRewriterInfo, id, status)) {
+    return;
+  }
+  SetRewriterLoggingStatusHelper(id, url, status);
+}
+
 RewriterInfo* AbstractLogRecord::SetRewriterLoggingStatusHelper(
     const char* id, const GoogleString& url,
     RewriterApplication::Status application_status) {
@@ -97,8 +147,12 @@ RewriterInfo* AbstractLogRecord::SetRewriterLoggingStatusHelper(
 void AbstractLogRecord::LogRewriterHtmlStatus(
     const char* rewriter_id,
     RewriterHtmlApplication::Status status) {
-  ScopedMutex lock(mutex_.get());
   DCHECK(RewriterHtmlApplication::Status_IsValid(status)) << status;
+  if (events_.Append(LogEventBuffer::kHtmlStatus, rewriter_id, status)) {
+    return;
+  }
+  ScopedMutex lock(mutex_.get());
+  ReadEvents();
   // TODO(gee): Verify this is called only once?
   rewriter_stats_[rewriter_id].html_status = status;
 }
@@ -106,8 +160,13 @@ void AbstractLogRecord::LogRewriterHtmlStatus(
 void AbstractLogRecord::LogRewriterApplicationStatus(
     const char* rewriter_id,
     RewriterApplication::Status status) {
-  ScopedMutex lock(mutex_.get());
   DCHECK(RewriterApplication::Status_IsValid(status));
+  if (events_.Append(LogEventBuffer::kApplicationStatus, rewriter_id,
+                     status)) {
+    return;
+  }
+  ScopedMutex lock(mutex_.get());
+  ReadEvents();
   RewriterStatsInternal* stats = &rewriter_stats_[rewriter_id];
   stats->status_counts[status]++;
 }
@@ -158,11 +217,26 @@ void AbstractLogRecord::SetRewriterInfoMaxSize(int x) {
 void AbstractLogRecord::SetAllowLoggingUrls(bool allow_logging_urls) {
   ScopedMutex lock(mutex_.get());
   allow_logging_urls_ = allow_logging_urls;
+  UpdateBufferRewriterInfoNow();
 }
 
 void AbstractLogRecord::SetLogUrlIndices(bool log_url_indices) {
   ScopedMutex lock(mutex_.get());
   log_url_indices_ = log_url_indices;
+  UpdateBufferRewriterInfoNow();
+}
+
+void AbstractLogRecord::SetBufferRewriterInfo(bool x) {
+  ScopedMutex lock(mutex_.get());
+  buffer_rewriter_info_ = x;
+  UpdateBufferRewriterInfoNow();
+}
+
+void AbstractLogRecord::UpdateBufferRewriterInfoNow() {
+  // Urls are recorded in the proto as the submessages are added, so when
+  // they are being logged the submessages can't be deferred.
+  buffer_rewriter_info_now_.set_value(
+      buffer_rewriter_info_ && !allow_logging_urls_ && !log_url_indices_);
 }
 
 void AbstractLogRecord::LogJsDisableFilter(const char* id,
@@ -239,11 +313,14 @@ void AbstractLogRecord::SetCriticalCssInfo(int critical_inlined_bytes,
 
 void AbstractLogRecord::PopulateRewriterStatusCounts() {
   mutex_->DCheckLocked();
-  if (logging_info() == NULL) {
+  // Drain the event buffer once, up front: logging_info() would otherwise
+  // fold newly appended events into rewriter_stats_ while it is iterated.
+  LoggingInfo* info = logging_info();
+  if (info == NULL) {
     return;
   }
 
-  if (logging_info()->rewriter_stats_size() > 0) {
+  if (info->rewriter_stats_size() > 0) {
     LOG(DFATAL) <<  "PopulateRewriterStatusCounts should be called only once";
     return;
   }
@@ -253,7 +330,7 @@ void AbstractLogRecord::PopulateRewriterStatusCounts() {
        ++iter) {
     const GoogleString& rewriter_id = iter->first;
     const RewriterStatsInternal& stats = iter->second;
-    RewriterStats* stats_proto = logging_info()->add_rewriter_stats();
+    RewriterStats* stats_proto = info->add_rewriter_stats();
     stats_proto->set_id(rewriter_id);
     stats_proto->set_html_status(stats.html_status);
     for (RewriteStatusCountMap::const_iterator iter =
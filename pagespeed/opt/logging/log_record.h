@@ -22,6 +22,7 @@
 #define PAGESPEED_OPT_LOGGING_LOG_RECORD_H_
 
 #include <map>
+#include "pagespeed/kernel/base/atomic_bool.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/gtest_prod.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -29,6 +30,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/image_types.pb.h"
 #include "pagespeed/opt/logging/enums.pb.h"
+#include "pagespeed/opt/logging/log_event_buffer.h"
 #include "pagespeed/opt/logging/logging_proto.h"
 #include "pagespeed/opt/logging/logging_proto_impl.h"
 
@@ -55,6 +57,12 @@ class RequestTimingInfo;
 //      into functions in this class (and be so guarded therein).
 //  (3) In most cases, log records should be created and owned by request
 //      contexts.
+//  (4) The per-resource status calls made by filters many times per request
+//      (SetRewriterLoggingStatus without a logged url,
+//      LogRewriterApplicationStatus and LogRewriterHtmlStatus) append to a
+//      lock-free LogEventBuffer instead of taking the mutex.  The buffered
+//      events are folded into the LoggingInfo proto the next time it is read
+//      through logging_info(), which includes WriteLog.
 
 // Subclasses may wrap some other type of protobuf; they must still provide
 // access to a LoggingInfo instance, however.
@@ -83,12 +91,12 @@ class AbstractLogRecord  {
       const char* rewriter_id, RewriterApplication::Status status);
 
   // Creates a new rewriter logging submessage for |rewriter_id|,
-  // sets status and the url index.
+  // sets status and the url index.  If SetBufferRewriterInfo(true) has been
+  // called and the url is not going to be logged, the submessage is buffered
+  // and only appears in logging_info() when that is next called.
   void SetRewriterLoggingStatus(
       const char* rewriter_id, const GoogleString& url,
-      RewriterApplication::Status status) {
-    SetRewriterLoggingStatusHelper(rewriter_id, url, status);
-  }
+      RewriterApplication::Status status);
 
   // Log the HTML level status for a filter.  This should be called only once
   // per filter, at the point where it is determined the filter is either
@@ -102,9 +110,10 @@ class AbstractLogRecord  {
       const char* rewriter_id, RewriterApplication::Status status);
 
   // TODO(gee): Deprecate raw access to proto.
-  // Return the LoggingInfo proto wrapped by this class. Calling code must
-  // guard any reads and writes to this using mutex().
-  virtual LoggingInfo* logging_info() = 0;
+  // Return the LoggingInfo proto wrapped by this class, after folding in any
+  // buffered events. Calling code must guard any reads and writes to this
+  // using mutex().
+  LoggingInfo* logging_info();
 
   // TODO(huibao): Rename LogImageBackgroundRewriteActivity() to make it clear
   // that it will log even when the rewriting finishes in the line-of-request.
@@ -186,6 +195,12 @@ class AbstractLogRecord  {
   // the LoggingInfo proto wrapped by this class.
   void SetRewriterInfoMaxSize(int x);
 
+  // Sets whether SetRewriterLoggingStatus may buffer its RewriterInfo
+  // submessage rather than adding it to the proto immediately.  Off by
+  // default, since it means a LoggingInfo pointer held across calls does
+  // not see new submessages until logging_info() is called again.
+  void SetBufferRewriterInfo(bool x);
+
   // Sets whether urls should be logged. This could potentially generate a lot
   // of logs data, so this should be switched on only for debugging.
   void SetAllowLoggingUrls(bool allow_logging_urls);
@@ -237,6 +252,10 @@ class AbstractLogRecord  {
   virtual void SetTimingInfo(const RequestTimingInfo& timing_info) {}
 
  protected:
+  // Returns the LoggingInfo proto wrapped by the subclass, without folding in
+  // buffered events.
+  virtual LoggingInfo* logging_info_proto() = 0;
+
   // Implements writing a log, base implementation is a no-op. Returns false if
   // writing failed.
   virtual bool WriteLogImpl() = 0;
@@ -252,6 +271,17 @@ class AbstractLogRecord  {
   // Called on construction.
   void InitLogging();
 
+  // Folds the events buffered in events_ into the proto and rewriter_stats_.
+  // Requires the mutex to be held.
+  void ReadEvents();
+
+  // Appends a RewriterInfo to the proto unless that would exceed
+  // rewriter_info_max_size_.  Requires the mutex to be held.
+  RewriterInfo* AddRewriterInfo(const char* rewriter_id);
+
+  // Recomputes buffer_rewriter_info_now_.  Requires the mutex to be held.
+  void UpdateBufferRewriterInfoNow();
+
   void PopulateUrl(
       const GoogleString& url, RewriteResourceInfo* rewrite_resource_info);
 
@@ -289,6 +319,16 @@ class AbstractLogRecord  {
   typedef std::map<GoogleString, RewriterStatsInternal> RewriterStatsMap;
   RewriterStatsMap rewriter_stats_;
 
+  // Events logged without the mutex; see (4) above.
+  LogEventBuffer events_;
+
+  // Set by SetBufferRewriterInfo.
+  bool buffer_rewriter_info_;
+
+  // True when SetRewriterLoggingStatus may buffer: buffer_rewriter_info_ is
+  // set and urls are not being logged.  Read without the mutex.
+  AtomicBool buffer_rewriter_info_now_;
+
   DISALLOW_COPY_AND_ASSIGN(AbstractLogRecord);
 };
 
@@ -299,8 +339,6 @@ class LogRecord : public AbstractLogRecord {
 
   virtual ~LogRecord();
 
-  LoggingInfo* logging_info() { return logging_info_.get(); }
-
   virtual void SetImageStats(int num_img_tags, int num_inlined_img_tags,
                              int num_critical_images_used) {}
 
@@ -343,6 +381,9 @@ class LogRecord : public AbstractLogRecord {
 
   bool WriteLogImpl() override { return true; }
 
+ protected:
+  LoggingInfo* logging_info_proto() override { return logging_info_.get(); }
+
  private:
   scoped_ptr<LoggingInfo> logging_info_;
 };
@@ -298,6 +298,62 @@ TEST_F(LogRecordTest, LogRewriterApplicationStatus) {
   EXPECT_EQ("", log_record_->AppliedRewritersString());
 }
 
+TEST_F(LogRecordTest, BufferRewriterInfo) {
+  log_record_->SetBufferRewriterInfo(true);
+  log_record_->SetRewriterLoggingStatus("zz", "url",
+                                        RewriterApplication::APPLIED_OK);
+  log_record_->SetRewriterLoggingStatus("aa", RewriterApplication::NOT_APPLIED);
+  TestRewriterInfo(2, "aa", RewriterApplication::NOT_APPLIED);
+  EXPECT_EQ("zz", log_record_->logging_info()->rewriter_info(0).id());
+  EXPECT_EQ("zz", log_record_->AppliedRewritersString());
+
+  // Submessages added directly stay in order with buffered ones.
+  log_record_->SetRewriterLoggingStatus("bb", RewriterApplication::APPLIED_OK);
+  RewriterInfo* info = log_record_->NewRewriterInfo("cc");
+  info->set_status(RewriterApplication::APPLIED_OK);
+  TestRewriterInfo(4, "cc", RewriterApplication::APPLIED_OK);
+  EXPECT_EQ("bb", log_record_->logging_info()->rewriter_info(2).id());
+
+  log_record_->WriteLog();
+  const LoggingInfo& logged = *log_record_->logging_info();
+  ASSERT_EQ(3, logged.rewriter_stats_size());
+  EXPECT_EQ("aa", logged.rewriter_stats(0).id());
+  EXPECT_EQ(RewriterApplication::NOT_APPLIED,
+            logged.rewriter_stats(0).status_counts(0).application_status());
+  EXPECT_EQ("bb", logged.rewriter_stats(1).id());
+  EXPECT_EQ("zz", logged.rewriter_stats(2).id());
+}
+
+TEST_F(LogRecordTest, BufferRewriterInfoWithUrls) {
+  // Urls are logged as the submessage is added, so buffering is bypassed.
+  log_record_->SetBufferRewriterInfo(true);
+  log_record_->SetAllowLoggingUrls(true);
+  LoggingInfo* logging_info = log_record_->logging_info();
+  log_record_->SetRewriterLoggingStatus("z1", "url",
+                                        RewriterApplication::APPLIED_OK);
+  EXPECT_EQ(1, logging_info->rewriter_info_size());
+  EXPECT_EQ("url", logging_info->resource_url_info().url(0));
+}
+
+TEST_F(LogRecordTest, BufferOverflow) {
+  log_record_->SetBufferRewriterInfo(true);
+  log_record_->LogRewriterHtmlStatus("aa", RewriterHtmlApplication::ACTIVE);
+  // Once the buffer fills, events are logged under the mutex, in order.
+  for (int i = 0; i < 2 * LogEventBuffer::kCapacity; ++i) {
+    log_record_->SetRewriterLoggingStatus("aa",
+                                          RewriterApplication::APPLIED_OK);
+  }
+  EXPECT_EQ(2 * LogEventBuffer::kCapacity,
+            log_record_->logging_info()->rewriter_info_size());
+  log_record_->WriteLog();
+  const LoggingInfo& logged = *log_record_->logging_info();
+  ASSERT_EQ(1, logged.rewriter_stats_size());
+  EXPECT_EQ(RewriterHtmlApplication::ACTIVE,
+            logged.rewriter_stats(0).html_status());
+  EXPECT_EQ(2 * LogEventBuffer::kCapacity,
+            logged.rewriter_stats(0).status_counts(0).count());
+}
+
 TEST_F(LogRecordTest, LogIsXhr) {
   EXPECT_FALSE(log_record_->logging_info()->has_is_xhr());
   log_record_->LogIsXhr(true);
@@ -20,6 +20,7 @@
 
 #include "pagespeed/system/admin_site.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <memory>
 #include <set>
@@ -29,10 +30,12 @@
 #include "net/instaweb/http/public/http_cache.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_query.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/util/public/property_cache.h"
 #include "net/instaweb/util/public/property_store.h"
 #include "strings/stringpiece_utils.h"
+#include "pagespeed/kernel/base/allocation_profiler.h"
 #include "pagespeed/kernel/base/cache_interface.h"
 #include "pagespeed/kernel/base/callback.h"
 #include "pagespeed/kernel/base/message_handler.h"
@@ -49,6 +52,7 @@
 #include "pagespeed/kernel/http/query_params.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/thread/lock_profiler.h"
 #include "pagespeed/kernel/util/statistics_logger.h"
 #include "pagespeed/system/system_cache_path.h"
 #include "pagespeed/system/system_caches.h"
@@ -96,6 +100,7 @@ const Tab kTabs[] = {
   {"Console", "Console", "console", NULL, kLongBreak},
   {"Message History", "Message History", "message_history", NULL, kLongBreak},
   {"Graphs", "Graphs", "graphs", NULL, kLongBreak},
+  {"Profiling", "Profiling", "profiling", NULL, kLongBreak},
 };
 
 // Controls the generation of an HTML Admin page.  Constructing it
@@ -390,6 +395,107 @@ void AdminSite::PrintHistograms(AdminSource source, AsyncFetch* fetch,
 
 namespace {
 
+// Number of lock call sites listed on the profiling page.
+const int kMaxProfiledCallSites = 50;
+
+GoogleString HistogramSummaryRow(StringPiece title, Histogram* histogram) {
+  return StrCat(
+      "<tr><td>", title, "</td><td>",
+      Integer64ToString(static_cast<int64>(histogram->Count())), "</td><td>",
+      Integer64ToString(static_cast<int64>(histogram->Average())),
+      "</td><td>",
+      Integer64ToString(static_cast<int64>(histogram->Percentile(50))),
+      "</td><td>",
+      Integer64ToString(static_cast<int64>(histogram->Percentile(99))),
+      "</td></tr>\n");
+}
+
+}  // namespace
+
+void AdminSite::PrintProfiling(AdminSource source,
+                               const QueryParams& query_params,
+                               AsyncFetch* fetch,
+                               ServerContext* server_context) {
+  if (query_params.Has("enable")) {
+    int sample_period = LockProfiler::kDefaultSamplePeriod;
+    GoogleString value;
+    if (query_params.Lookup1Unescaped("enable", &value) && !value.empty()) {
+      StringToInt(value, &sample_period);
+    }
+    LockProfiler::Enable(sample_period);
+    AllocationProfiler::set_enabled(true);
+  } else if (query_params.Has("disable")) {
+    LockProfiler::Disable();
+    AllocationProfiler::set_enabled(false);
+  } else if (query_params.Has("reset")) {
+    LockProfiler::Reset();
+  }
+
+  AdminHtml admin_html("profiling", "", source, timer_, fetch,
+                       message_handler_);
+  GoogleString buf = "<p>Lock profiling is ";
+  if (LockProfiler::enabled()) {
+    StrAppend(&buf, "<b>on</b>, sampling one acquisition in ",
+              IntegerToString(LockProfiler::sample_period()), ".");
+  } else {
+    StrAppend(&buf, "<b>off</b>.");
+  }
+  StrAppend(&buf, " Allocation counting is ");
+  if (!AllocationProfiler::compiled_in()) {
+    StrAppend(&buf, "not compiled in (build with "
+              "enable_allocation_profiling=1).");
+  } else if (AllocationProfiler::enabled()) {
+    StrAppend(&buf, "<b>on</b>.");
+  } else {
+    StrAppend(&buf, "<b>off</b>.");
+  }
+  StrAppend(&buf, "</p>\n<p><a href='?enable'>Enable</a>", kLongBreak,
+            "<a href='?disable'>Disable</a>", kLongBreak,
+            "<a href='?reset'>Reset lock profile</a></p>\n");
+  fetch->Write(buf, message_handler_);
+
+  // Lock profiles live in each process's memory, so in a multi-process
+  // server this shows only the process that served this request.
+  LockProfiler::CallSiteVector sites;
+  LockProfiler::Snapshot(&sites);
+  buf.assign(
+      "<h3>Lock contention</h3>\n"
+      "<p>Estimated from samples, for this process only.  Call sites "
+      "shown as object+offset can be resolved with addr2line.</p>\n"
+      "<table>\n<thead><tr><td>Call site</td><td>Acquisitions</td>"
+      "<td>Contended</td><td>Wait ms</td><td>Avg wait us</td></tr>"
+      "</thead>\n<tbody>\n");
+  GoogleString escaped;
+  for (int i = 0, n = std::min(static_cast<int>(sites.size()),
+                               kMaxProfiledCallSites); i < n; ++i) {
+    const LockProfiler::CallSite& site = sites[i];
+    int64 average_wait_us =
+        (site.contentions == 0) ? 0 : site.wait_us / site.contentions;
+    StrAppend(&buf, "<tr><td><code>",
+              HtmlKeywords::Escape(
+                  LockProfiler::SymbolizeCallSite(site.pc), &escaped),
+              "</code></td><td>", Integer64ToString(site.acquisitions),
+              "</td><td>", Integer64ToString(site.contentions), "</td><td>");
+    StrAppend(&buf, Integer64ToString(site.wait_us / 1000), "</td><td>",
+              Integer64ToString(average_wait_us), "</td></tr>\n");
+  }
+  StrAppend(&buf, "</tbody>\n</table>\n");
+  fetch->Write(buf, message_handler_);
+
+  RewriteStats* rewrite_stats = server_context->rewrite_stats();
+  fetch->Write(StrCat(
+      "<h3>Allocations per HTML page</h3>\n"
+      "<table>\n<thead><tr><td></td><td>Pages</td><td>Average</td>"
+      "<td>Median</td><td>99th percentile</td></tr></thead>\n<tbody>\n",
+      HistogramSummaryRow("Allocations",
+                          rewrite_stats->html_allocations_histogram()),
+      HistogramSummaryRow("Allocated KB",
+                          rewrite_stats->html_allocated_kb_histogram()),
+      "</tbody>\n</table>\n"), message_handler_);
+}
+
+namespace {
+
 static const char kTableStart[] =
     "<table class='pagespeed-caches-structure'>\n"
     "  <thead>\n"
@@ -773,6 +879,8 @@ void AdminSite::AdminPage(
                   page_property_cache, server_context);
     } else if (leaf == "histograms") {
       PrintHistograms(kPageSpeedAdmin, fetch, stats);
+    } else if (leaf == "profiling") {
+      PrintProfiling(kPageSpeedAdmin, query_params, fetch, server_context);
     } else {
       fetch->response_headers()->SetStatusAndReason(HttpStatus::kNotFound);
       fetch->response_headers()->Add(HttpAttributes::kContentType, "text/html");
@@ -147,6 +147,12 @@ class AdminSite {
   void PrintHistograms(AdminSource source, AsyncFetch* fetch,
                        Statistics* stats);
 
+  // Print the lock-contention and allocation profiles.  The query parameters
+  // "enable" (optionally with a sample period), "disable" and "reset"
+  // control the profilers.  Lock profiles are per-process.
+  void PrintProfiling(AdminSource source, const QueryParams& query_params,
+                      AsyncFetch* fetch, ServerContext* server_context);
+
   void PurgeHandler(StringPiece url, SystemCachePath* cache_path,
                     AsyncFetch* fetch);
 
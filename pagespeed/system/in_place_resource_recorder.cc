@@ -86,7 +86,7 @@ InPlaceResourceRecorder::InPlaceResourceRecorder(
   // The http cache also has a maximum response body length that it will accept,
   // so we need to look at max_response_bytes_ and takes the most constraining
   // of the two.
-  int64 cache_max_cl = cache_->max_cacheable_response_content_length();
+  int64 cache_max_cl = cache_->MaxCacheableBodySize();
   if (cache_max_cl != -1) {
     if (max_response_bytes_ <= 0) {
       max_response_bytes_ = cache_max_cl;
@@ -0,0 +1,1184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "pagespeed/system/memcached_binary_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/hasher.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/key_value_codec.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kMemcachedBinaryTimeouts[] = "memcached_binary_timeouts";
+const char kMemcachedBinaryQuietFailures[] = "memcached_binary_quiet_failures";
+const char kLastErrorCheckpointMs[] =
+    "memcached_binary_last_error_checkpoint_ms";
+const char kErrorBurstSize[] = "memcached_binary_error_burst_size";
+
+// Matches the default of the MemcachedTimeoutUs option.
+const int kDefaultTimeoutUs = 500 * Timer::kMsUs;
+
+// Size of a request or response header in the binary protocol.
+const size_t kHeaderSize = 24;
+
+const size_t kReadChunkSize = 16 * 1024;
+
+const uint8 kRequestMagic = 0x80;
+const uint8 kResponseMagic = 0x81;
+
+// Opcodes we use.  The 'Q' variants are quiet: memcached only responds to
+// them on failure, or, for GETKQ, on a hit.
+const uint8 kGetOpcode = 0x00;
+const uint8 kDeleteOpcode = 0x04;
+const uint8 kNoopOpcode = 0x0a;
+const uint8 kGetKQOpcode = 0x0d;
+const uint8 kStatOpcode = 0x10;
+const uint8 kSetQOpcode = 0x11;
+const uint8 kDeleteQOpcode = 0x14;
+
+const uint16 kStatusNoError = 0x0000;
+const uint16 kStatusKeyNotFound = 0x0001;
+
+void AppendBigEndian(uint64 value, int num_bytes, GoogleString* out) {
+  for (int i = num_bytes - 1; i >= 0; --i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64 ReadBigEndian(const char* data, int num_bytes) {
+  uint64 value = 0;
+  for (int i = 0; i < num_bytes; ++i) {
+    value = (value << 8) | static_cast<unsigned char>(data[i]);
+  }
+  return value;
+}
+
+// Appends a request header, extras, and key to out.  The caller sends the
+// value_size bytes of value that complete the body.
+void AppendRequest(uint8 opcode, StringPiece extras, StringPiece key,
+                   size_t value_size, uint32 opaque, GoogleString* out) {
+  out->push_back(static_cast<char>(kRequestMagic));
+  out->push_back(static_cast<char>(opcode));
+  AppendBigEndian(key.size(), 2, out);
+  AppendBigEndian(extras.size(), 1, out);
+  AppendBigEndian(0, 1, out);  // Data type.
+  AppendBigEndian(0, 2, out);  // vbucket.
+  AppendBigEndian(extras.size() + key.size() + value_size, 4, out);
+  AppendBigEndian(opaque, 4, out);
+  AppendBigEndian(0, 8, out);  // CAS.
+  extras.AppendToString(out);
+  key.AppendToString(out);
+}
+
+// Flags and expiration for SETQ; we use neither.
+const char kSetExtras[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+}  // namespace
+
+struct MemcachedBinaryCache::Response {
+  uint8 opcode;
+  uint16 status;
+  uint32 opaque;
+  GoogleString key;
+  GoogleString value;
+};
+
+// An operation waiting for replies.  Ops are created on the calling
+// thread, but once queued they belong to the I/O thread, which deletes
+// them after the last reply, or after failing them.
+class MemcachedBinaryCache::Op {
+ public:
+  Op(uint32 first_opaque, int num_opaques, int64 deadline_us)
+      : first_opaque_(first_opaque),
+        num_opaques_(num_opaques),
+        deadline_us_(deadline_us) {
+  }
+  virtual ~Op() {}
+
+  // Whether opaque tags one of our requests.  Opaques wrap around, so
+  // compare offsets rather than values.
+  bool Owns(uint32 opaque) const {
+    return opaque - first_opaque_ < num_opaques_;
+  }
+
+  uint32 first_opaque() const { return first_opaque_; }
+  int64 deadline_us() const { return deadline_us_; }
+
+  // Takes a reply to one of our requests, returning true if it was the
+  // last one we expect.
+  virtual bool HandleReply(Response* response) = 0;
+
+  // Called if the connection fails, or the cache is shut down, before the
+  // last reply arrives.
+  virtual void Fail() = 0;
+
+ private:
+  const uint32 first_opaque_;
+  const uint32 num_opaques_;
+  const int64 deadline_us_;
+
+  DISALLOW_COPY_AND_ASSIGN(Op);
+};
+
+class MemcachedBinaryCache::GetOp : public Op {
+ public:
+  GetOp(MemcachedBinaryCache* cache, const GoogleString& key,
+        Callback* callback, uint32 opaque, int64 deadline_us)
+      : Op(opaque, 1, deadline_us),
+        cache_(cache),
+        key_(key),
+        callback_(callback) {
+  }
+
+  virtual bool HandleReply(Response* response) {
+    if (response->status == kStatusNoError) {
+      cache_->DecodeValueMatchingKeyAndCallCallback(key_, response->value,
+                                                    "Get", callback_);
+      return true;
+    }
+    if (response->status != kStatusKeyNotFound) {
+      cache_->RecordError();
+      cache_->message_handler_->Message(
+          kError, "MemcachedBinaryCache::Get error: status 0x%04x (%s) on "
+          "key %s", response->status, response->value.c_str(), key_.c_str());
+    }
+    cache_->ValidateAndReportResult(key_, CacheInterface::kNotFound,
+                                    callback_);
+    return true;
+  }
+
+  virtual void Fail() {
+    cache_->ValidateAndReportResult(key_, CacheInterface::kNotFound,
+                                    callback_);
+  }
+
+ private:
+  MemcachedBinaryCache* cache_;
+  const GoogleString key_;
+  Callback* callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(GetOp);
+};
+
+// The keys of a MultiGet and the values found so far.  Each batch reports
+// in once, as does MultiGet itself after queueing them all, and whoever is
+// last runs the callbacks.
+class MemcachedBinaryCache::MultiGetState {
+ public:
+  MultiGetState(MemcachedBinaryCache* cache, MultiGetRequest* request)
+      : cache_(cache),
+        request_(request),
+        hashed_keys_(request->size()),
+        values_(request->size()),
+        found_(request->size(), false),
+        pending_(1) {
+  }
+
+  MultiGetRequest* request() { return request_.get(); }
+  GoogleString* hashed_key(int index) { return &hashed_keys_[index]; }
+
+  void AddBatch() { pending_.NoBarrierIncrement(1); }
+
+  // Called on the I/O thread, with a reply from memcached.
+  void Found(int index, Response* response) {
+    if (response->key == hashed_keys_[index]) {
+      values_[index].swap(response->value);
+      found_[index] = true;
+    }
+  }
+
+  void BatchDone() {
+    if (pending_.BarrierIncrement(-1) == 0) {
+      Report();
+      delete this;
+    }
+  }
+
+ private:
+  void Report() {
+    for (int i = 0, n = request_->size(); i < n; ++i) {
+      CacheInterface::KeyCallback* key_callback = &(*request_)[i];
+      if (found_[i]) {
+        cache_->DecodeValueMatchingKeyAndCallCallback(
+            key_callback->key, values_[i], "MultiGet",
+            key_callback->callback);
+      } else {
+        cache_->ValidateAndReportResult(
+            key_callback->key, CacheInterface::kNotFound,
+            key_callback->callback);
+      }
+    }
+  }
+
+  MemcachedBinaryCache* cache_;
+  scoped_ptr<MultiGetRequest> request_;
+  StringVector hashed_keys_;
+  StringVector values_;
+  std::vector<bool> found_;
+  AtomicInt32 pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultiGetState);
+};
+
+// The keys of a MultiGet that share a connection: one GETKQ each, of which
+// only hits are answered, then a NOOP whose reply ends the batch.
+class MemcachedBinaryCache::MultiGetBatchOp : public Op {
+ public:
+  MultiGetBatchOp(MultiGetState* state, const std::vector<int>& indices,
+                  uint32 first_opaque, int64 deadline_us)
+      : Op(first_opaque, indices.size() + 1, deadline_us),
+        state_(state),
+        indices_(indices) {
+  }
+
+  virtual bool HandleReply(Response* response) {
+    uint32 offset = response->opaque - first_opaque();
+    if (offset == indices_.size()) {
+      state_->BatchDone();
+      return true;
+    }
+    if (response->status == kStatusNoError) {
+      state_->Found(indices_[offset], response);
+    }
+    return false;
+  }
+
+  virtual void Fail() { state_->BatchDone(); }
+
+ private:
+  MultiGetState* state_;
+  const std::vector<int> indices_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultiGetBatchOp);
+};
+
+// Waits for a NOOP, which memcached answers only after it has dealt with
+// every quiet command sent before it.
+class MemcachedBinaryCache::NoopOp : public Op {
+ public:
+  NoopOp(uint32 opaque, int64 deadline_us) : Op(opaque, 1, deadline_us) {}
+
+  virtual bool HandleReply(Response* response) { return true; }
+  virtual void Fail() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoopOp);
+};
+
+// The outcome of a STAT command, for GetStatus, which waits for done.
+struct MemcachedBinaryCache::StatusReply {
+  StatusReply() : ok(false), done(false) {}
+
+  GoogleString text;
+  bool ok;
+  bool done;
+};
+
+// Each statistic is a separate reply; an empty key ends the list.
+class MemcachedBinaryCache::StatOp : public Op {
+ public:
+  StatOp(MemcachedBinaryCache* cache, StatusReply* reply, uint32 opaque,
+         int64 deadline_us)
+      : Op(opaque, 1, deadline_us),
+        cache_(cache),
+        reply_(reply) {
+  }
+
+  virtual bool HandleReply(Response* response) {
+    if (!response->key.empty()) {
+      StrAppend(&reply_->text, response->key, ": ", response->value, "\n");
+      return false;
+    }
+    Finish(true);
+    return true;
+  }
+
+  virtual void Fail() { Finish(false); }
+
+ private:
+  void Finish(bool ok) {
+    ScopedMutex lock(cache_->mutex_.get());
+    reply_->ok = ok;
+    reply_->done = true;
+    cache_->status_done_->Broadcast();
+  }
+
+  MemcachedBinaryCache* cache_;
+  StatusReply* reply_;
+
+  DISALLOW_COPY_AND_ASSIGN(StatOp);
+};
+
+// A non-blocking socket to a memcached server, shared by every thread with
+// a key pinned to it.  Callers append requests to the queue, under the
+// cache's mutex; everything else is done by the I/O thread.
+class MemcachedBinaryCache::Connection {
+ public:
+  explicit Connection(const ExternalServerSpec& spec)
+      : spec_(spec),
+        unacknowledged_ops_(0),
+        fd_(-1),
+        connecting_(false),
+        connect_deadline_us_(0),
+        send_offset_(0),
+        send_deadline_us_(0),
+        read_pos_(0) {
+  }
+
+  ~Connection() {
+    Close();
+    DCHECK(queued_ops_.empty());
+    DCHECK(pending_ops_.empty());
+  }
+
+  const ExternalServerSpec& spec() const { return spec_; }
+
+  // Called by the calling threads, with the cache's mutex held.
+  void QueueBytes(const SharedString& bytes) {
+    if (bytes.size() > 0) {
+      queued_bytes_.push_back(bytes);
+    }
+  }
+  void QueueOp(Op* op) { queued_ops_.push_back(op); }
+  int unacknowledged_ops() const { return unacknowledged_ops_; }
+  void AddUnacknowledgedOp() { ++unacknowledged_ops_; }
+  void ClearUnacknowledgedOps() { unacknowledged_ops_ = 0; }
+
+  // Moves the queued requests over to the I/O thread.  Called with the
+  // cache's mutex held.
+  void TakeQueued(int64 deadline_us) {
+    if (sending_.empty() && !queued_bytes_.empty()) {
+      send_deadline_us_ = deadline_us;
+    }
+    sending_.insert(sending_.end(), queued_bytes_.begin(),
+                    queued_bytes_.end());
+    queued_bytes_.clear();
+    pending_ops_.insert(pending_ops_.end(), queued_ops_.begin(),
+                        queued_ops_.end());
+    queued_ops_.clear();
+  }
+
+  // The rest is only called by the I/O thread.
+  bool open() const { return fd_ >= 0; }
+  bool connecting() const { return connecting_; }
+  int fd() const { return fd_; }
+  bool has_work() const { return !sending_.empty() || !pending_ops_.empty(); }
+  bool wants_write() const { return connecting_ || !sending_.empty(); }
+  std::deque<Op*>* pending_ops() { return &pending_ops_; }
+
+  // Returns the time by which we must hear from the server.
+  int64 NextDeadlineUs() const {
+    int64 deadline_us = kint64max;
+    if (connecting_) {
+      deadline_us = connect_deadline_us_;
+    }
+    if (!sending_.empty()) {
+      deadline_us = std::min(deadline_us, send_deadline_us_);
+    }
+    if (!pending_ops_.empty()) {
+      deadline_us = std::min(deadline_us, pending_ops_.front()->deadline_us());
+    }
+    return deadline_us;
+  }
+
+  // Starts connecting, returning false if that failed at once.
+  bool StartConnect(int64 deadline_us) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = NULL;
+    if (getaddrinfo(spec_.host.c_str(), IntegerToString(spec_.port).c_str(),
+                    &hints, &addresses) != 0) {
+      return false;
+    }
+    for (struct addrinfo* address = addresses;
+         (address != NULL) && !open();
+         address = address->ai_next) {
+      fd_ = socket(address->ai_family, address->ai_socktype,
+                   address->ai_protocol);
+      if (fd_ < 0) {
+        continue;
+      }
+      fcntl(fd_, F_SETFD, FD_CLOEXEC);
+      fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+      int one = 1;
+      setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (connect(fd_, address->ai_addr, address->ai_addrlen) == 0) {
+        break;
+      }
+      if (errno == EINPROGRESS) {
+        connecting_ = true;
+        connect_deadline_us_ = deadline_us;
+        break;
+      }
+      Close();
+    }
+    freeaddrinfo(addresses);
+    return open();
+  }
+
+  // Called when a connecting socket becomes writable.
+  bool FinishConnect() {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if ((getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) != 0) ||
+        (error != 0)) {
+      return false;
+    }
+    connecting_ = false;
+    return true;
+  }
+
+  // Closes the socket, and returns the operations that were in flight,
+  // which the caller must fail.
+  void Close(std::deque<Op*>* failed_ops) {
+    Close();
+    failed_ops->swap(pending_ops_);
+  }
+
+  // Writes as much as the socket will take, returning false on error.
+  bool Flush(int64 deadline_us) {
+    while (!sending_.empty()) {
+      struct iovec iov[kMaxIovecs];
+      int num_iovecs = 0;
+      for (std::deque<SharedString>::const_iterator p = sending_.begin();
+           (p != sending_.end()) && (num_iovecs < kMaxIovecs);
+           ++p, ++num_iovecs) {
+        size_t offset = (num_iovecs == 0) ? send_offset_ : 0;
+        iov[num_iovecs].iov_base = const_cast<char*>(p->data()) + offset;
+        iov[num_iovecs].iov_len = p->size() - offset;
+      }
+      struct msghdr message;
+      memset(&message, 0, sizeof(message));
+      message.msg_iov = iov;
+      message.msg_iovlen = num_iovecs;
+      ssize_t sent = sendmsg(fd_, &message, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+          return true;
+        } else if (errno != EINTR) {
+          return false;
+        }
+        continue;
+      }
+      // The server is keeping up, so give it a fresh timeout.
+      send_deadline_us_ = deadline_us;
+      while ((sent > 0) &&
+             (static_cast<size_t>(sent) >=
+              sending_.front().size() - send_offset_)) {
+        sent -= sending_.front().size() - send_offset_;
+        sending_.pop_front();
+        send_offset_ = 0;
+      }
+      send_offset_ += sent;
+    }
+    return true;
+  }
+
+  // Reads whatever is available, returning false if the server closed the
+  // connection or there was an error.
+  bool Read() {
+    if ((read_pos_ != 0) && (read_pos_ == read_buffer_.size())) {
+      read_buffer_.clear();
+      read_pos_ = 0;
+    }
+    while (true) {
+      size_t old_size = read_buffer_.size();
+      read_buffer_.resize(old_size + kReadChunkSize);
+      ssize_t received = recv(fd_, &read_buffer_[old_size], kReadChunkSize,
+                              0);
+      read_buffer_.resize(old_size + std::max<ssize_t>(received, 0));
+      if (received == 0) {
+        return false;  // Closed by the server.
+      } else if (received < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+          return true;
+        } else if (errno != EINTR) {
+          return false;
+        }
+      }
+    }
+  }
+
+  // Parses the next reply out of what has been read.  Returns false if
+  // there isn't a whole one yet, setting *corrupt if what is there can't
+  // be a reply.
+  bool NextResponse(Response* response, bool* corrupt) {
+    size_t available = read_buffer_.size() - read_pos_;
+    if (available < kHeaderSize) {
+      return false;
+    }
+    const char* header = read_buffer_.data() + read_pos_;
+    if (static_cast<uint8>(header[0]) != kResponseMagic) {
+      *corrupt = true;
+      return false;
+    }
+    size_t key_length = ReadBigEndian(header + 2, 2);
+    size_t extras_length = ReadBigEndian(header + 4, 1);
+    size_t body_length = ReadBigEndian(header + 8, 4);
+    if (extras_length + key_length > body_length) {
+      *corrupt = true;
+      return false;
+    }
+    if (available < kHeaderSize + body_length) {
+      return false;
+    }
+    response->opcode = static_cast<uint8>(header[1]);
+    response->status = ReadBigEndian(header + 6, 2);
+    response->opaque = ReadBigEndian(header + 12, 4);
+    const char* body = header + kHeaderSize;
+    response->key.assign(body + extras_length, key_length);
+    response->value.assign(body + extras_length + key_length,
+                           body_length - extras_length - key_length);
+    read_pos_ += kHeaderSize + body_length;
+    if (read_pos_ > kReadChunkSize) {
+      read_buffer_.erase(0, read_pos_);
+      read_pos_ = 0;
+    }
+    return true;
+  }
+
+ private:
+  static const int kMaxIovecs = 64;
+
+  void Close() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    connecting_ = false;
+    sending_.clear();
+    send_offset_ = 0;
+    read_buffer_.clear();
+    read_pos_ = 0;
+  }
+
+  const ExternalServerSpec spec_;
+
+  // Guarded by the cache's mutex.
+  std::vector<SharedString> queued_bytes_;
+  std::vector<Op*> queued_ops_;
+  int unacknowledged_ops_;
+
+  // Only touched by the I/O thread.
+  int fd_;
+  bool connecting_;
+  int64 connect_deadline_us_;
+  std::deque<SharedString> sending_;
+  size_t send_offset_;
+  int64 send_deadline_us_;
+  GoogleString read_buffer_;
+  size_t read_pos_;
+  std::deque<Op*> pending_ops_;
+
+  DISALLOW_COPY_AND_ASSIGN(Connection);
+};
+
+class MemcachedBinaryCache::IoThread : public ThreadSystem::Thread {
+ public:
+  IoThread(MemcachedBinaryCache* cache, ThreadSystem* thread_system)
+      : Thread(thread_system, "memcached_io", ThreadSystem::kJoinable),
+        cache_(cache) {
+  }
+
+ protected:
+  virtual void Run() { cache_->RunIoLoop(); }
+
+ private:
+  MemcachedBinaryCache* cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoThread);
+};
+
+MemcachedBinaryCache::MemcachedBinaryCache(
+    const ExternalClusterSpec& cluster, int connections_per_server,
+    Hasher* hasher, Statistics* statistics, Timer* timer,
+    MessageHandler* handler, ThreadSystem* thread_system)
+    : cluster_spec_(cluster),
+      connections_per_server_(std::max(connections_per_server, 1)),
+      timeout_us_(kDefaultTimeoutUs),
+      hasher_(hasher),
+      timer_(timer),
+      message_handler_(handler),
+      thread_system_(thread_system),
+      mutex_(thread_system->NewMutex()),
+      status_done_(mutex_->NewCondvar()),
+      shut_down_(false),
+      wake_pending_(false),
+      timeouts_(statistics->GetVariable(kMemcachedBinaryTimeouts)),
+      quiet_failures_(statistics->GetVariable(kMemcachedBinaryQuietFailures)),
+      last_error_checkpoint_ms_(
+          statistics->GetUpDownCounter(kLastErrorCheckpointMs)),
+      error_burst_size_(statistics->GetUpDownCounter(kErrorBurstSize)) {
+  wake_fds_[0] = wake_fds_[1] = -1;
+  for (const ExternalServerSpec& spec : cluster_spec_.servers) {
+    for (int i = 0; i < connections_per_server_; ++i) {
+      connections_.push_back(new Connection(spec));
+    }
+  }
+}
+
+MemcachedBinaryCache::~MemcachedBinaryCache() {
+  ShutDown();
+  for (int fd : wake_fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  STLDeleteElements(&connections_);
+}
+
+void MemcachedBinaryCache::InitStats(Statistics* statistics) {
+  statistics->AddVariable(kMemcachedBinaryTimeouts);
+  statistics->AddVariable(kMemcachedBinaryQuietFailures);
+  statistics->AddUpDownCounter(kLastErrorCheckpointMs);
+  statistics->AddUpDownCounter(kErrorBurstSize);
+}
+
+bool MemcachedBinaryCache::Connect() {
+  DCHECK(ring_.empty());
+  ring_.clear();
+  for (int i = 0, n = cluster_spec_.servers.size(); i < n; ++i) {
+    const GoogleString server_name = cluster_spec_.servers[i].ToString();
+    for (int point = 0; point < kPointsPerServer; ++point) {
+      ring_.push_back(std::make_pair(
+          hasher_->HashToUint64(StrCat(server_name, "-",
+                                       IntegerToString(point))),
+          i));
+    }
+  }
+  std::sort(ring_.begin(), ring_.end());
+  if (ring_.empty()) {
+    return false;
+  }
+
+  if (pipe(wake_fds_) != 0) {
+    message_handler_->Message(
+        kError, "MemcachedBinaryCache: cannot create wake pipe: %s",
+        strerror(errno));
+    ring_.clear();
+    return false;
+  }
+  for (int fd : wake_fds_) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  }
+  ScopedMutex lock(mutex_.get());
+  io_thread_.reset(new IoThread(this, thread_system_));
+  if (!io_thread_->Start()) {
+    message_handler_->Message(
+        kError, "MemcachedBinaryCache: cannot start I/O thread");
+    io_thread_.reset(NULL);
+    ring_.clear();
+    return false;
+  }
+  return true;
+}
+
+int MemcachedBinaryCache::RingLookup(uint64 hash) const {
+  DCHECK(!ring_.empty());
+  std::vector<std::pair<uint64, int> >::const_iterator point =
+      std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(hash, 0));
+  if (point == ring_.end()) {
+    point = ring_.begin();
+  }
+  return point->second;
+}
+
+int MemcachedBinaryCache::ServerIndexForKey(const GoogleString& key) const {
+  return RingLookup(hasher_->HashToUint64(key));
+}
+
+int MemcachedBinaryCache::BatchForKey(const GoogleString& key) const {
+  // The ring is searched with the whole hash, so take the slot from the
+  // high bits, which barely affect where on the ring the key lands.
+  uint64 hash = hasher_->HashToUint64(key);
+  int slot = (hash >> 32) % connections_per_server_;
+  return RingLookup(hash) * connections_per_server_ + slot;
+}
+
+int64 MemcachedBinaryCache::DeadlineUs() const {
+  return timer_->NowUs() + timeout_us_;
+}
+
+uint32 MemcachedBinaryCache::ReserveOpaques(int count) {
+  return static_cast<uint32>(next_opaque_.NoBarrierIncrement(count) - count);
+}
+
+bool MemcachedBinaryCache::Queue(int batch, const SharedString& request,
+                                 const SharedString& value, Op* op) {
+  bool wake = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (shut_down_) {
+      return false;
+    }
+    Connection* connection = connections_[batch];
+    connection->QueueBytes(request);
+    connection->QueueBytes(value);
+    if (op != NULL) {
+      // memcached handles each connection's commands in order, so this
+      // reply will also acknowledge any quiet commands sent before.
+      connection->QueueOp(op);
+      connection->ClearUnacknowledgedOps();
+    } else {
+      connection->AddUnacknowledgedOp();
+      if (connection->unacknowledged_ops() >= kMaxUnacknowledgedOps) {
+        // Make the server catch up, so failures can't pile up unseen.
+        uint32 opaque = ReserveOpaques(1);
+        GoogleString noop;
+        AppendRequest(kNoopOpcode, StringPiece(), StringPiece(), 0, opaque,
+                      &noop);
+        connection->QueueBytes(SharedString(noop));
+        connection->QueueOp(new NoopOp(opaque, DeadlineUs()));
+        connection->ClearUnacknowledgedOps();
+      }
+    }
+    if (!wake_pending_) {
+      wake_pending_ = true;
+      wake = true;
+    }
+  }
+  if (wake) {
+    Wake();
+  }
+  return true;
+}
+
+void MemcachedBinaryCache::Wake() {
+  ssize_t written;
+  do {
+    written = write(wake_fds_[1], "x", 1);
+  } while ((written < 0) && (errno == EINTR));
+  // EAGAIN means the pipe is full, and so the I/O thread will wake anyway.
+}
+
+void MemcachedBinaryCache::DrainWakePipe() {
+  char buf[64];
+  while ((read(wake_fds_[0], buf, sizeof(buf)) > 0) || (errno == EINTR)) {
+  }
+}
+
+void MemcachedBinaryCache::RunIoLoop() {
+  std::vector<struct pollfd> poll_fds;
+  std::vector<Connection*> polled;
+  while (true) {
+    DrainWakePipe();
+    int64 now_us = timer_->NowUs();
+    {
+      ScopedMutex lock(mutex_.get());
+      if (shut_down_) {
+        break;
+      }
+      wake_pending_ = false;
+      for (Connection* connection : connections_) {
+        connection->TakeQueued(now_us + timeout_us_);
+      }
+    }
+
+    poll_fds.clear();
+    polled.clear();
+    struct pollfd wake_poll_fd;
+    wake_poll_fd.fd = wake_fds_[0];
+    wake_poll_fd.events = POLLIN;
+    wake_poll_fd.revents = 0;
+    poll_fds.push_back(wake_poll_fd);
+    int64 next_deadline_us = kint64max;
+    for (Connection* connection : connections_) {
+      if (!connection->open() && connection->has_work() &&
+          !connection->StartConnect(now_us + timeout_us_)) {
+        FailConnection(connection, false);
+        continue;
+      }
+      // Write straight away rather than waiting for poll() to say we can;
+      // usually the socket has room.
+      if (connection->open() && !connection->connecting() &&
+          !connection->Flush(now_us + timeout_us_)) {
+        FailConnection(connection, false);
+        continue;
+      }
+      if (!connection->open()) {
+        continue;
+      }
+      int64 deadline_us = connection->NextDeadlineUs();
+      if (deadline_us <= now_us) {
+        FailConnection(connection, true);
+        continue;
+      }
+      next_deadline_us = std::min(next_deadline_us, deadline_us);
+      struct pollfd poll_fd;
+      poll_fd.fd = connection->fd();
+      poll_fd.events = POLLIN | (connection->wants_write() ? POLLOUT : 0);
+      poll_fd.revents = 0;
+      poll_fds.push_back(poll_fd);
+      polled.push_back(connection);
+    }
+
+    int timeout_ms = -1;
+    if (next_deadline_us != kint64max) {
+      timeout_ms = (next_deadline_us - now_us + Timer::kMsUs - 1) /
+          Timer::kMsUs;
+    }
+    if (poll(&poll_fds[0], poll_fds.size(), timeout_ms) <= 0) {
+      // Timeouts are noticed at the top of the loop.
+      continue;
+    }
+    now_us = timer_->NowUs();
+    for (int i = 0, n = polled.size(); i < n; ++i) {
+      Connection* connection = polled[i];
+      int16 revents = poll_fds[i + 1].revents;
+      if (revents == 0) {
+        continue;
+      }
+      bool ok = true;
+      if (connection->connecting()) {
+        ok = connection->FinishConnect();
+      }
+      if (ok && ((revents & (POLLIN | POLLERR | POLLHUP)) != 0)) {
+        ok = connection->Read() && DispatchReplies(connection);
+      }
+      if (ok && ((revents & POLLOUT) != 0)) {
+        ok = connection->Flush(now_us + timeout_us_);
+      }
+      if (!ok) {
+        FailConnection(connection, false);
+      }
+    }
+  }
+
+  // We are shutting down; nothing more can be queued, so fail whatever
+  // was.
+  {
+    ScopedMutex lock(mutex_.get());
+    for (Connection* connection : connections_) {
+      connection->TakeQueued(0);
+    }
+  }
+  for (Connection* connection : connections_) {
+    FailConnection(connection, false);
+  }
+}
+
+bool MemcachedBinaryCache::DispatchReplies(Connection* connection) {
+  std::deque<Op*>* pending_ops = connection->pending_ops();
+  Response response;
+  bool corrupt = false;
+  while (connection->NextResponse(&response, &corrupt)) {
+    // Replies come back in the order the requests were sent, so a reply
+    // either belongs to the oldest operation, or reports the failure of a
+    // quiet command.
+    if (!pending_ops->empty() && pending_ops->front()->Owns(response.opaque)) {
+      Op* op = pending_ops->front();
+      if (op->HandleReply(&response)) {
+        pending_ops->pop_front();
+        delete op;
+      }
+    } else {
+      HandleQuietReply(response);
+    }
+  }
+  return !corrupt;
+}
+
+void MemcachedBinaryCache::FailConnection(Connection* connection,
+                                          bool timed_out) {
+  bool had_work = connection->has_work();
+  std::deque<Op*> failed_ops;
+  connection->Close(&failed_ops);
+  if (had_work && !shutdown_.value()) {
+    RecordError();
+    if (timed_out) {
+      timeouts_->Add(1);
+    }
+    message_handler_->Message(
+        kError, "MemcachedBinaryCache: %s talking to %s; failing %d "
+        "operations", timed_out ? "timeout" : "error",
+        connection->spec().ToString().c_str(),
+        static_cast<int>(failed_ops.size()));
+  }
+  for (Op* op : failed_ops) {
+    op->Fail();
+    delete op;
+  }
+}
+
+void MemcachedBinaryCache::HandleQuietReply(const Response& response) {
+  // A miss on DELETEQ is reported, but is exactly what was asked for.
+  if ((response.opcode == kDeleteQOpcode) &&
+      (response.status == kStatusKeyNotFound)) {
+    return;
+  }
+  quiet_failures_->Add(1);
+  RecordError();
+  message_handler_->Message(
+      kWarning, "MemcachedBinaryCache: pipelined opcode 0x%02x failed with "
+      "status 0x%04x: %s", response.opcode, response.status,
+      response.value.c_str());
+}
+
+void MemcachedBinaryCache::DecodeValueMatchingKeyAndCallCallback(
+    const GoogleString& key, const GoogleString& data,
+    const char* calling_method, Callback* callback) {
+  SharedString key_and_value(data);
+  GoogleString actual_key;
+  SharedString value;
+  if (key_value_codec::Decode(&key_and_value, &actual_key, &value)) {
+    callback->set_value(value);
+    if (key == actual_key) {
+      ValidateAndReportResult(actual_key, CacheInterface::kAvailable,
+                              callback);
+    } else {
+      message_handler_->Message(
+          kError, "MemcachedBinaryCache::%s key collision %s != %s",
+          calling_method, key.c_str(), actual_key.c_str());
+      ValidateAndReportResult(key, CacheInterface::kNotFound, callback);
+    }
+  } else {
+    message_handler_->Message(
+        kError, "MemcachedBinaryCache::%s decoding error on key %s",
+        calling_method, key.c_str());
+    ValidateAndReportResult(key, CacheInterface::kNotFound, callback);
+  }
+}
+
+void MemcachedBinaryCache::Get(const GoogleString& key, Callback* callback) {
+  if (!IsHealthy()) {
+    ValidateAndReportResult(key, CacheInterface::kNotFound, callback);
+    return;
+  }
+  uint32 opaque = ReserveOpaques(1);
+  GoogleString request;
+  AppendRequest(kGetOpcode, StringPiece(), hasher_->Hash(key), 0, opaque,
+                &request);
+  GetOp* op = new GetOp(this, key, callback, opaque, DeadlineUs());
+  if (!Queue(BatchForKey(key), SharedString(request), SharedString(), op)) {
+    delete op;
+    ValidateAndReportResult(key, CacheInterface::kNotFound, callback);
+  }
+}
+
+void MemcachedBinaryCache::MultiGet(MultiGetRequest* request) {
+  if (!IsHealthy()) {
+    ReportMultiGetNotFound(request);
+    return;
+  }
+
+  // Group the keys by the connection they are pinned to, so that each one
+  // carries a single pipelined batch.
+  MultiGetState* state = new MultiGetState(this, request);
+  int num_keys = request->size();
+  std::vector<std::vector<int> > keys_for_batch(connections_.size());
+  for (int i = 0; i < num_keys; ++i) {
+    const GoogleString& key = (*request)[i].key;
+    *state->hashed_key(i) = hasher_->Hash(key);
+    keys_for_batch[BatchForKey(key)].push_back(i);
+  }
+
+  // Each GETKQ gets its own opaque, counting up from the batch's first,
+  // and the NOOP that ends the batch gets the next one.
+  int64 deadline_us = DeadlineUs();
+  for (int b = 0, n = keys_for_batch.size(); b < n; ++b) {
+    const std::vector<int>& indices = keys_for_batch[b];
+    if (indices.empty()) {
+      continue;
+    }
+    uint32 opaque = ReserveOpaques(indices.size() + 1);
+    GoogleString batch;
+    for (int j = 0, m = indices.size(); j < m; ++j) {
+      AppendRequest(kGetKQOpcode, StringPiece(),
+                    *state->hashed_key(indices[j]), 0, opaque + j, &batch);
+    }
+    AppendRequest(kNoopOpcode, StringPiece(), StringPiece(), 0,
+                  opaque + indices.size(), &batch);
+    MultiGetBatchOp* op =
+        new MultiGetBatchOp(state, indices, opaque, deadline_us);
+    state->AddBatch();
+    if (!Queue(b, SharedString(batch), SharedString(), op)) {
+      delete op;
+      state->BatchDone();
+    }
+  }
+  state->BatchDone();
+}
+
+void MemcachedBinaryCache::SendQuiet(const GoogleString& key, uint8 opcode,
+                                     const SharedString& value) {
+  // The value is queued as is; only the header, extras, and key are
+  // copied.
+  StringPiece extras;
+  if (opcode == kSetQOpcode) {
+    extras = StringPiece(kSetExtras, sizeof(kSetExtras));
+  }
+  GoogleString header;
+  AppendRequest(opcode, extras, hasher_->Hash(key), value.size(),
+                ReserveOpaques(1), &header);
+  Queue(BatchForKey(key), SharedString(header), value, NULL);
+}
+
+void MemcachedBinaryCache::PutWithKeyInValue(
+    const GoogleString& key, const SharedString& key_and_value) {
+  if (!IsHealthy()) {
+    return;
+  }
+  SendQuiet(key, kSetQOpcode, key_and_value);
+}
+
+void MemcachedBinaryCache::Put(const GoogleString& key,
+                               const SharedString& value) {
+  if (!IsHealthy()) {
+    return;
+  }
+  SharedString key_and_value;
+  if (key_value_codec::Encode(key, value, &key_and_value)) {
+    SendQuiet(key, kSetQOpcode, key_and_value);
+  } else {
+    message_handler_->Message(
+        kError, "MemcachedBinaryCache::Put error: key size %d too large, "
+        "first 100 bytes of key is: %s",
+        static_cast<int>(key.size()), key.substr(0, 100).c_str());
+  }
+}
+
+void MemcachedBinaryCache::Delete(const GoogleString& key) {
+  if (!IsHealthy()) {
+    return;
+  }
+  // See AprMemCache::Delete regarding values in the fallback cache.
+  SendQuiet(key, kDeleteQOpcode, SharedString());
+}
+
+bool MemcachedBinaryCache::GetStatus(GoogleString* buffer) {
+  if (ring_.empty()) {
+    return false;
+  }
+  int num_servers = cluster_spec_.servers.size();
+  std::vector<StatusReply> replies(num_servers);
+  int64 deadline_us = DeadlineUs();
+  for (int i = 0; i < num_servers; ++i) {
+    uint32 opaque = ReserveOpaques(1);
+    GoogleString request;
+    AppendRequest(kStatOpcode, StringPiece(), StringPiece(), 0, opaque,
+                  &request);
+    StatOp* op = new StatOp(this, &replies[i], opaque, deadline_us);
+    if (!Queue(i * connections_per_server_, SharedString(request),
+               SharedString(), op)) {
+      delete op;
+      replies[i].done = true;
+    }
+  }
+
+  // Every operation either gets its replies or fails by its deadline.
+  {
+    ScopedMutex lock(mutex_.get());
+    for (int i = 0; i < num_servers; ++i) {
+      while (!replies[i].done) {
+        status_done_->Wait();
+      }
+    }
+  }
+
+  bool ret = true;
+  for (int i = 0; i < num_servers; ++i) {
+    if (replies[i].ok) {
+      StrAppend(buffer, "memcached server ",
+                cluster_spec_.servers[i].ToString(), "\n", replies[i].text,
+                "\n");
+    } else {
+      ret = false;
+    }
+  }
+  return ret;
+}
+
+void MemcachedBinaryCache::RecordError() {
+  // See AprMemCache::RecordError.
+  int64 time_ms = timer_->NowMs();
+  int64 last_error_checkpoint_ms = last_error_checkpoint_ms_->Get();
+  int64 delta_ms = time_ms - last_error_checkpoint_ms;
+  if (delta_ms > kHealthCheckpointIntervalMs) {
+    last_error_checkpoint_ms_->Set(time_ms);
+    error_burst_size_->Set(1);
+  } else {
+    error_burst_size_->Add(1);
+  }
+}
+
+bool MemcachedBinaryCache::IsHealthy() const {
+  if (shutdown_.value() || ring_.empty()) {
+    return false;
+  }
+  int64 time_ms = timer_->NowMs();
+  int64 last_error_checkpoint_ms = last_error_checkpoint_ms_->Get();
+  int64 delta_ms = time_ms - last_error_checkpoint_ms;
+  int64 error_burst_size = error_burst_size_->Get();
+
+  if (delta_ms > kHealthCheckpointIntervalMs) {
+    if (error_burst_size >= kMaxErrorBurst) {
+      message_handler_->Message(
+          kInfo, "MemcachedBinaryCache::IsHealthy error: Attempting to "
+          "recover");
+    }
+    error_burst_size_->Set(0);
+    return true;
+  }
+  return error_burst_size < kMaxErrorBurst;
+}
+
+void MemcachedBinaryCache::ShutDown() {
+  shutdown_.set_value(true);
+  scoped_ptr<IoThread> io_thread;
+  {
+    ScopedMutex lock(mutex_.get());
+    shut_down_ = true;
+    io_thread.reset(io_thread_.release());
+  }
+  if (io_thread.get() != NULL) {
+    Wake();
+    io_thread->Join();
+  }
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,254 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef PAGESPEED_SYSTEM_MEMCACHED_BINARY_CACHE_H_
+#define PAGESPEED_SYSTEM_MEMCACHED_BINARY_CACHE_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/system/external_server_spec.h"
+
+namespace net_instaweb {
+
+class Hasher;
+class MessageHandler;
+class Statistics;
+class UpDownCounter;
+class Variable;
+
+// Native client for the memcached binary protocol, as documented in
+// https://github.com/memcached/memcached/wiki/BinaryProtocolRevamped.
+// It is a drop-in alternative to AprMemCache, but unlike it is
+// non-blocking: requests from every thread are multiplexed onto shared
+// connections, and a single I/O thread reads the replies and runs the
+// callbacks.
+//
+// 1. Keys are spread over the servers in the cluster with a consistent
+//    hash ring, so adding or removing a server only remaps the keys that
+//    hashed near it.
+// 2. Each server has connections_per_server sockets, and each key is
+//    pinned to one of them, so memcached sees the operations on any one
+//    key in the order they were issued.  Any number of threads may have
+//    requests in flight on the same connection; each request is tagged
+//    with an opaque value that memcached echoes in its reply, which is how
+//    the I/O thread finds the operation a reply belongs to.
+// 3. Puts and Deletes are sent as quiet commands (SETQ / DELETEQ), for
+//    which memcached only replies on failure, so writes never wait for a
+//    round trip.  A NOOP is sent after kMaxUnacknowledgedOps quiet commands
+//    to bound how many can be outstanding.
+// 4. MultiGet sends one GETKQ per key followed by a NOOP on each
+//    connection involved, so a batch costs one round trip rather than one
+//    per key.
+//
+// Callbacks run on the I/O thread, so they should hand off any real work
+// rather than doing it inline.  The I/O thread is started by Connect(),
+// which a forking server must call in each child.
+//
+// Values are encoded with key_value_codec, exactly as AprMemCache does, so
+// the two clients can share a memcached cluster and a FallbackCache.
+class MemcachedBinaryCache : public CacheInterface {
+ public:
+  // memcached's default item size limit is 1MB; see
+  // AprMemCache::kValueSizeThreshold, which we share with FallbackCache.
+  static const size_t kValueSizeThreshold = 1 * 1000 * 1000;
+
+  // Number of points each server gets on the consistent hash ring.  160 is
+  // what libketama uses, which spreads keys within a few percent of evenly.
+  static const int kPointsPerServer = 160;
+
+  // Number of quiet commands that may be sent on a connection before we
+  // ask for a NOOP to come back.
+  static const int kMaxUnacknowledgedOps = 64;
+
+  static const int kDefaultConnectionsPerServer = 2;
+
+  // Amount of time after a burst of errors to retry memcached operations.
+  static const int64 kHealthCheckpointIntervalMs = 30 * Timer::kSecondMs;
+
+  // Maximum number of errors tolerated within kHealthCheckpointIntervalMs,
+  // after which the cache declares itself unhealthy for
+  // kHealthCheckpointIntervalMs.
+  static const int64 kMaxErrorBurst = 4;
+
+  // Does not take ownership of hasher, statistics, timer, or handler.
+  MemcachedBinaryCache(const ExternalClusterSpec& cluster,
+                       int connections_per_server, Hasher* hasher,
+                       Statistics* statistics, Timer* timer,
+                       MessageHandler* handler, ThreadSystem* thread_system);
+  virtual ~MemcachedBinaryCache();
+
+  static void InitStats(Statistics* statistics);
+
+  const ExternalClusterSpec& cluster_spec() const { return cluster_spec_; }
+
+  virtual void Get(const GoogleString& key, Callback* callback);
+  virtual void Put(const GoogleString& key, const SharedString& value);
+  virtual void Delete(const GoogleString& key);
+  virtual void MultiGet(MultiGetRequest* request);
+
+  // Builds the hash ring and starts the I/O thread.  Connections are opened
+  // lazily, on first use, so this returns false only if there are no
+  // servers to talk to, or the I/O thread can't be started.
+  bool Connect();
+
+  // Appends the output of the STAT command for every server to
+  // status_string, returning false if any server failed to reply.  Unlike
+  // the other operations, this waits for the replies.
+  bool GetStatus(GoogleString* status_string);
+
+  static GoogleString FormatName() { return "MemcachedBinaryCache"; }
+  virtual GoogleString Name() const { return FormatName(); }
+
+  virtual bool IsBlocking() const { return false; }
+
+  // Records in statistics that a system error occurred, helping it detect
+  // when it's unhealthy if they are too frequent.
+  void RecordError();
+
+  // See AprMemCache::IsHealthy.
+  virtual bool IsHealthy() const;
+
+  // Refuses any further operations, stops the I/O thread, and reports
+  // everything still in flight as not found.
+  virtual void ShutDown();
+
+  virtual bool MustEncodeKeyInValueOnPut() const { return true; }
+  virtual void PutWithKeyInValue(const GoogleString& key,
+                                 const SharedString& key_and_value);
+
+  // Sets the I/O timeout in microseconds.  This should be called at
+  // setup time and not while there are operations in flight.
+  void set_timeout_us(int timeout_us) { timeout_us_ = timeout_us; }
+
+  // Returns the index into cluster_spec().servers of the server that owns
+  // key.  Must be called after Connect().  Exposed for testing.
+  int ServerIndexForKey(const GoogleString& key) const;
+
+ private:
+  class Connection;
+  class GetOp;
+  class IoThread;
+  class MultiGetBatchOp;
+  class MultiGetState;
+  class NoopOp;
+  class Op;
+  class StatOp;
+  struct Response;
+  struct StatusReply;
+  friend class IoThread;
+
+  // Returns the first of count consecutive opaque values, which tag
+  // requests so that their replies can be matched to them.
+  uint32 ReserveOpaques(int count);
+
+  // Queues request, followed by value, on connection batch.  If op is
+  // non-NULL it is handed to the I/O thread, which owns it from then on,
+  // to receive the replies.  If op is NULL, request is a quiet command.
+  // Returns false, leaving op to the caller, if we are shutting down.
+  bool Queue(int batch, const SharedString& request, const SharedString& value,
+             Op* op) LOCKS_EXCLUDED(mutex_);
+
+  // Sends a single quiet command (SETQ or DELETEQ) for key.
+  void SendQuiet(const GoogleString& key, uint8 opcode,
+                 const SharedString& value);
+
+  void HandleQuietReply(const Response& response);
+
+  void DecodeValueMatchingKeyAndCallCallback(
+      const GoogleString& key, const GoogleString& data,
+      const char* calling_method, Callback* callback);
+
+  // The I/O thread's loop.
+  void RunIoLoop();
+
+  // Hands the replies buffered on connection to the operations they
+  // belong to.  Returns false if the stream is corrupt.
+  bool DispatchReplies(Connection* connection);
+
+  // Closes connection and fails the operations in flight on it, logging
+  // and recording an error unless there were none, or we are shutting down.
+  void FailConnection(Connection* connection, bool timed_out);
+
+  // Wakes the I/O thread if it might be waiting in poll().
+  void Wake();
+  void DrainWakePipe();
+
+  // Returns the index of the server whose ring point follows hash.
+  int RingLookup(uint64 hash) const;
+
+  // Returns server_index * connections_per_server_ + slot, identifying the
+  // connection that key is pinned to.
+  int BatchForKey(const GoogleString& key) const;
+
+  int64 DeadlineUs() const;
+
+  ExternalClusterSpec cluster_spec_;
+  const int connections_per_server_;
+  int timeout_us_;
+  Hasher* hasher_;
+  Timer* timer_;
+  MessageHandler* message_handler_;
+  ThreadSystem* thread_system_;
+  AtomicBool shutdown_;
+  AtomicInt32 next_opaque_;
+
+  // Protects the request queues of all the connections, and the state
+  // below.  It is only held briefly, and never during I/O or callbacks.
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  // Signalled when a StatusReply is completed.
+  scoped_ptr<ThreadSystem::Condvar> status_done_;
+  bool shut_down_ GUARDED_BY(mutex_);
+  // Whether a byte has been written to the wake pipe since the I/O thread
+  // last picked up the queued requests.
+  bool wake_pending_ GUARDED_BY(mutex_);
+  scoped_ptr<IoThread> io_thread_ GUARDED_BY(mutex_);
+  int wake_fds_[2];
+
+  // Owned.  Indexed by BatchForKey(); connection i talks to
+  // cluster_spec_.servers[i / connections_per_server_].
+  std::vector<Connection*> connections_;
+
+  // Sorted (point, server index) pairs.  Written only by Connect().
+  std::vector<std::pair<uint64, int> > ring_;
+
+  Variable* timeouts_;
+  Variable* quiet_failures_;
+  UpDownCounter* last_error_checkpoint_ms_;
+  UpDownCounter* error_burst_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemcachedBinaryCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_SYSTEM_MEMCACHED_BINARY_CACHE_H_
@@ -0,0 +1,706 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Unit-test the native memcached binary-protocol client against a mock
+// memcached server that runs in-process.
+
+#include "pagespeed/system/memcached_binary_cache.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/posix_timer.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/thread/blocking_callback.h"
+#include "pagespeed/kernel/thread/worker_test_base.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "pagespeed/system/external_server_spec.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kTimeoutUs = 200 * Timer::kMsUs;
+const int kConnectionsPerServer = 2;
+
+uint64 ReadBigEndian(const char* data, int num_bytes) {
+  uint64 value = 0;
+  for (int i = 0; i < num_bytes; ++i) {
+    value = (value << 8) | static_cast<unsigned char>(data[i]);
+  }
+  return value;
+}
+
+void AppendBigEndian(uint64 value, int num_bytes, GoogleString* out) {
+  for (int i = num_bytes - 1; i >= 0; --i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+// A memcached that speaks just enough of the binary protocol for
+// MemcachedBinaryCache, listening on a system-chosen port on 127.0.0.1.
+// All connections are served from one thread with poll(), so it handles
+// pipelined requests and any number of clients.
+class MockMemcachedServer : public ThreadSystem::Thread {
+ public:
+  explicit MockMemcachedServer(ThreadSystem* thread_system)
+      : Thread(thread_system, "mock_memcached", ThreadSystem::kJoinable),
+        mutex_(thread_system->NewMutex()),
+        listen_fd_(-1),
+        port_(0),
+        fail_sets_(false),
+        unresponsive_(false),
+        connections_accepted_(0),
+        replies_sent_(0),
+        noops_received_(0) {
+    wake_fds_[0] = wake_fds_[1] = -1;
+  }
+
+  virtual ~MockMemcachedServer() {
+    if (Started()) {
+      CHECK_EQ(1, write(wake_fds_[1], "x", 1));
+      Join();
+    }
+    for (int fd : {listen_fd_, wake_fds_[0], wake_fds_[1]}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  // Binds the listening socket and starts serving.
+  bool Listen() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if ((listen_fd_ < 0) ||
+        (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) != 0) ||
+        (listen(listen_fd_, 16) != 0) ||
+        (getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+                     &length) != 0) ||
+        (pipe(wake_fds_) != 0)) {
+      return false;
+    }
+    port_ = ntohs(address.sin_port);
+    return Start();
+  }
+
+  ExternalServerSpec spec() const {
+    return ExternalServerSpec("127.0.0.1", port_);
+  }
+
+  // Makes every set fail with "Item not stored".
+  void set_fail_sets(bool x) {
+    ScopedMutex lock(mutex_.get());
+    fail_sets_ = x;
+  }
+
+  // Makes the server read requests but never reply.
+  void set_unresponsive(bool x) {
+    ScopedMutex lock(mutex_.get());
+    unresponsive_ = x;
+  }
+
+  int connections_accepted() {
+    ScopedMutex lock(mutex_.get());
+    return connections_accepted_;
+  }
+
+  int replies_sent() {
+    ScopedMutex lock(mutex_.get());
+    return replies_sent_;
+  }
+
+  int noops_received() {
+    ScopedMutex lock(mutex_.get());
+    return noops_received_;
+  }
+
+  int num_items() {
+    ScopedMutex lock(mutex_.get());
+    return items_.size();
+  }
+
+ protected:
+  virtual void Run() {
+    std::vector<int> clients;
+    std::map<int, GoogleString> input;
+    bool done = false;
+    while (!done) {
+      std::vector<struct pollfd> poll_fds(2 + clients.size());
+      poll_fds[0].fd = wake_fds_[0];
+      poll_fds[1].fd = listen_fd_;
+      for (int i = 0, n = clients.size(); i < n; ++i) {
+        poll_fds[2 + i].fd = clients[i];
+      }
+      for (struct pollfd& poll_fd : poll_fds) {
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+      }
+      if (poll(&poll_fds[0], poll_fds.size(), -1) <= 0) {
+        continue;
+      }
+      if (poll_fds[0].revents != 0) {
+        done = true;
+        continue;
+      }
+      std::vector<int> open_clients;
+      if (poll_fds[1].revents != 0) {
+        int fd = accept(listen_fd_, NULL, NULL);
+        if (fd >= 0) {
+          open_clients.push_back(fd);
+          ScopedMutex lock(mutex_.get());
+          ++connections_accepted_;
+        }
+      }
+      for (int i = 2, n = poll_fds.size(); i < n; ++i) {
+        int fd = poll_fds[i].fd;
+        bool keep = true;
+        if (poll_fds[i].revents != 0) {
+          char buf[64 * 1024];
+          ssize_t received = read(fd, buf, sizeof(buf));
+          if (received <= 0) {
+            keep = false;
+          } else {
+            input[fd].append(buf, received);
+            GoogleString output;
+            ProcessRequests(&input[fd], &output);
+            keep = SendAll(fd, output);
+          }
+        }
+        if (keep) {
+          open_clients.push_back(fd);
+        } else {
+          close(fd);
+          input.erase(fd);
+        }
+      }
+      clients.swap(open_clients);
+    }
+    for (int fd : clients) {
+      close(fd);
+    }
+  }
+
+ private:
+  static const uint8 kGet = 0x00;
+  static const uint8 kSet = 0x01;
+  static const uint8 kDelete = 0x04;
+  static const uint8 kNoop = 0x0a;
+  static const uint8 kGetKQ = 0x0d;
+  static const uint8 kStat = 0x10;
+  static const uint8 kSetQ = 0x11;
+  static const uint8 kDeleteQ = 0x14;
+
+  static bool SendAll(int fd, StringPiece data) {
+    while (!data.empty()) {
+      ssize_t sent = write(fd, data.data(), data.size());
+      if (sent <= 0) {
+        return false;
+      }
+      data.remove_prefix(sent);
+    }
+    return true;
+  }
+
+  void AppendReply(uint8 opcode, uint16 status, uint32 opaque,
+                   StringPiece extras, StringPiece key, StringPiece value,
+                   GoogleString* out) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    out->push_back(static_cast<char>(0x81));
+    out->push_back(static_cast<char>(opcode));
+    AppendBigEndian(key.size(), 2, out);
+    AppendBigEndian(extras.size(), 1, out);
+    AppendBigEndian(0, 1, out);
+    AppendBigEndian(status, 2, out);
+    AppendBigEndian(extras.size() + key.size() + value.size(), 4, out);
+    AppendBigEndian(opaque, 4, out);
+    AppendBigEndian(0, 8, out);
+    extras.AppendToString(out);
+    key.AppendToString(out);
+    value.AppendToString(out);
+    ++replies_sent_;
+  }
+
+  // Consumes every complete request in input, appending replies to output.
+  void ProcessRequests(GoogleString* input, GoogleString* output) {
+    ScopedMutex lock(mutex_.get());
+    size_t pos = 0;
+    while (input->size() - pos >= 24) {
+      const char* header = input->data() + pos;
+      CHECK_EQ(0x80, static_cast<uint8>(header[0]));
+      uint8 opcode = header[1];
+      size_t key_length = ReadBigEndian(header + 2, 2);
+      size_t extras_length = ReadBigEndian(header + 4, 1);
+      size_t body_length = ReadBigEndian(header + 8, 4);
+      uint32 opaque = ReadBigEndian(header + 12, 4);
+      if (input->size() - pos < 24 + body_length) {
+        break;
+      }
+      const char* body = header + 24;
+      GoogleString key(body + extras_length, key_length);
+      StringPiece value(body + extras_length + key_length,
+                        body_length - extras_length - key_length);
+      pos += 24 + body_length;
+      if (opcode == kNoop) {
+        ++noops_received_;
+      }
+      if (unresponsive_) {
+        continue;
+      }
+      const char kFlags[4] = { 0, 0, 0, 0 };
+      StringPiece flags(kFlags, sizeof(kFlags));
+      std::map<GoogleString, GoogleString>::iterator item = items_.find(key);
+      switch (opcode) {
+        case kGet:
+          if (item == items_.end()) {
+            AppendReply(opcode, 1, opaque, "", "", "Not found", output);
+          } else {
+            AppendReply(opcode, 0, opaque, flags, "", item->second, output);
+          }
+          break;
+        case kGetKQ:
+          if (item != items_.end()) {
+            AppendReply(opcode, 0, opaque, flags, key, item->second, output);
+          }
+          break;
+        case kSet:
+        case kSetQ:
+          if (fail_sets_) {
+            AppendReply(opcode, 5, opaque, "", "", "Not stored", output);
+          } else {
+            value.CopyToString(&items_[key]);
+            if (opcode == kSet) {
+              AppendReply(opcode, 0, opaque, "", "", "", output);
+            }
+          }
+          break;
+        case kDelete:
+        case kDeleteQ:
+          if (item == items_.end()) {
+            AppendReply(opcode, 1, opaque, "", "", "Not found", output);
+          } else {
+            items_.erase(item);
+            if (opcode == kDelete) {
+              AppendReply(opcode, 0, opaque, "", "", "", output);
+            }
+          }
+          break;
+        case kNoop:
+          AppendReply(opcode, 0, opaque, "", "", "", output);
+          break;
+        case kStat:
+          AppendReply(opcode, 0, opaque, "", "curr_items",
+                      IntegerToString(items_.size()), output);
+          AppendReply(opcode, 0, opaque, "", "", "", output);
+          break;
+        default:
+          AppendReply(opcode, 0x81, opaque, "", "", "Unknown command",
+                      output);
+          break;
+      }
+    }
+    input->erase(0, pos);
+  }
+
+  scoped_ptr<AbstractMutex> mutex_;
+  int listen_fd_;
+  int wake_fds_[2];
+  int port_;
+  std::map<GoogleString, GoogleString> items_ GUARDED_BY(mutex_);
+  bool fail_sets_ GUARDED_BY(mutex_);
+  bool unresponsive_ GUARDED_BY(mutex_);
+  int connections_accepted_ GUARDED_BY(mutex_);
+  int replies_sent_ GUARDED_BY(mutex_);
+  int noops_received_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(MockMemcachedServer);
+};
+
+}  // namespace
+
+class MemcachedBinaryCacheTest : public CacheTestBase {
+ protected:
+  // Callbacks run on the cache's I/O thread, so the test thread waits for
+  // them.
+  class SyncedCallback : public CacheTestBase::Callback {
+   public:
+    explicit SyncedCallback(MemcachedBinaryCacheTest* test)
+        : Callback(test),
+          sync_point_(test->thread_system_.get()) {
+    }
+
+    virtual void Done(CacheInterface::KeyState state) {
+      Callback::Done(state);
+      sync_point_.Notify();
+    }
+
+    virtual void Wait() { sync_point_.Wait(); }
+
+   private:
+    WorkerTestBase::SyncPoint sync_point_;
+  };
+
+  MemcachedBinaryCacheTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        statistics_(thread_system_.get()),
+        hasher_(20) {
+    set_mutex(thread_system_->NewMutex());
+    MemcachedBinaryCache::InitStats(&statistics_);
+  }
+
+  virtual void TearDown() {
+    if (cache_.get() != NULL) {
+      cache_->ShutDown();
+    }
+    cache_.reset();
+    STLDeleteElements(&servers_);
+    CacheTestBase::TearDown();
+  }
+
+  // Starts num_servers mock servers and a cache that talks to them.
+  void StartServersAndCache(int num_servers) {
+    StartServersAndCache(num_servers, kConnectionsPerServer);
+  }
+
+  void StartServersAndCache(int num_servers, int connections_per_server) {
+    ExternalClusterSpec cluster;
+    for (int i = 0; i < num_servers; ++i) {
+      servers_.push_back(new MockMemcachedServer(thread_system_.get()));
+      ASSERT_TRUE(servers_.back()->Listen());
+      cluster.servers.push_back(servers_.back()->spec());
+    }
+    cache_.reset(MakeCache(cluster, connections_per_server));
+  }
+
+  MemcachedBinaryCache* MakeCache(const ExternalClusterSpec& cluster,
+                                  int connections_per_server) {
+    MemcachedBinaryCache* cache = new MemcachedBinaryCache(
+        cluster, connections_per_server, &hasher_, &statistics_, &timer_,
+        &handler_, thread_system_.get());
+    cache->set_timeout_us(kTimeoutUs);
+    EXPECT_TRUE(cache->Connect());
+    return cache;
+  }
+
+  virtual CacheInterface* Cache() { return cache_.get(); }
+  virtual Callback* NewCallback() { return new SyncedCallback(this); }
+
+  int64 StatValue(const char* name) {
+    return statistics_.GetVariable(name)->Get();
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  SimpleStats statistics_;
+  PosixTimer timer_;
+  GoogleMessageHandler handler_;
+  MD5Hasher hasher_;
+  std::vector<MockMemcachedServer*> servers_;
+  scoped_ptr<MemcachedBinaryCache> cache_;
+};
+
+// Simple flow of putting in an item, getting it, deleting it.
+TEST_F(MemcachedBinaryCacheTest, PutGetDelete) {
+  StartServersAndCache(1);
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  CheckNotFound("Another Name");
+
+  CheckPut("Name", "NewValue");
+  CheckGet("Name", "NewValue");
+
+  cache_->Delete("Name");
+  CheckNotFound("Name");
+  EXPECT_TRUE(cache_->IsHealthy());
+}
+
+TEST_F(MemcachedBinaryCacheTest, LargeValue) {
+  StartServersAndCache(1);
+  GoogleString value;
+  for (int i = 0; value.size() < 300 * 1000; ++i) {
+    StrAppend(&value, IntegerToString(i), ",");
+  }
+  CheckPut("Large", value);
+  CheckGet("Large", value);
+}
+
+TEST_F(MemcachedBinaryCacheTest, MultiGet) {
+  StartServersAndCache(1);
+  TestMultiGet();
+}
+
+// Sets and deletes are quiet, so they do not generate any replies, and the
+// following Get still sees them because memcached handles each
+// connection's commands in order.  With a single connection, the Gets'
+// replies also show that everything before them was handled.
+TEST_F(MemcachedBinaryCacheTest, QuietCommandsArePipelined) {
+  StartServersAndCache(1, 1);
+  for (int i = 0; i < 10; ++i) {
+    cache_->Put(StrCat("key", IntegerToString(i)), SharedString("value"));
+  }
+  cache_->Delete("key0");
+  cache_->Delete("never-written");
+  CheckNotFound("key0");
+  CheckGet("key9", "value");
+
+  // Only the DELETEQ miss and the two Gets were answered.
+  EXPECT_EQ(3, servers_[0]->replies_sent());
+  EXPECT_EQ(9, servers_[0]->num_items());
+  EXPECT_EQ(0, StatValue("memcached_binary_quiet_failures"));
+  EXPECT_TRUE(cache_->IsHealthy());
+}
+
+// After kMaxUnacknowledgedOps quiet commands on a connection, the client
+// syncs with a NOOP.  Writes to one key all use the same connection.
+TEST_F(MemcachedBinaryCacheTest, QuietCommandsAreBounded) {
+  StartServersAndCache(1);
+  for (int i = 0; i < MemcachedBinaryCache::kMaxUnacknowledgedOps; ++i) {
+    cache_->Put("key", SharedString(IntegerToString(i)));
+  }
+  CheckGet("key", IntegerToString(
+      MemcachedBinaryCache::kMaxUnacknowledgedOps - 1));
+  EXPECT_EQ(1, servers_[0]->noops_received());
+  EXPECT_EQ(2, servers_[0]->replies_sent());
+}
+
+// A failed quiet set is noticed when its reply arrives ahead of the reply
+// to a later Get.
+TEST_F(MemcachedBinaryCacheTest, QuietFailuresAreCollected) {
+  StartServersAndCache(1);
+  servers_[0]->set_fail_sets(true);
+  cache_->Put("Name", SharedString("Value"));
+  EXPECT_EQ(0, StatValue("memcached_binary_quiet_failures"));
+  CheckNotFound("Name");
+  EXPECT_EQ(1, StatValue("memcached_binary_quiet_failures"));
+}
+
+// Keys are spread over the servers, and a MultiGet costs each connection
+// a single pipelined batch terminated by a NOOP.
+TEST_F(MemcachedBinaryCacheTest, MultiGetAcrossServers) {
+  const int kNumKeys = 20;
+  StartServersAndCache(3);
+  std::vector<int> keys_per_server(servers_.size(), 0);
+  for (int i = 0; i < kNumKeys; ++i) {
+    GoogleString key = StrCat("key", IntegerToString(i));
+    CheckPut(key, StrCat("value", IntegerToString(i)));
+    ++keys_per_server[cache_->ServerIndexForKey(key)];
+  }
+  for (int i = 0, n = servers_.size(); i < n; ++i) {
+    EXPECT_EQ(0, servers_[i]->noops_received());
+  }
+
+  CacheInterface::MultiGetRequest* request =
+      new CacheInterface::MultiGetRequest;
+  std::vector<Callback*> callbacks;
+  for (int i = 0; i <= kNumKeys; ++i) {
+    callbacks.push_back(AddCallback());
+    request->push_back(CacheInterface::KeyCallback(
+        StrCat("key", IntegerToString(i)), callbacks.back()));
+  }
+  cache_->MultiGet(request);
+  for (int i = 0; i < kNumKeys; ++i) {
+    WaitAndCheck(callbacks[i], StrCat("value", IntegerToString(i)));
+  }
+  WaitAndCheckNotFound(callbacks[kNumKeys]);
+  for (int i = 0, n = servers_.size(); i < n; ++i) {
+    EXPECT_EQ(keys_per_server[i], servers_[i]->num_items());
+    EXPECT_EQ(keys_per_server[i] > 0, servers_[i]->noops_received() > 0);
+    EXPECT_LE(servers_[i]->noops_received(), kConnectionsPerServer);
+  }
+}
+
+// Adding a server only moves keys onto the new server.
+TEST_F(MemcachedBinaryCacheTest, ConsistentHashing) {
+  const int kNumKeys = 3000;
+  ExternalClusterSpec two_servers, three_servers;
+  two_servers.servers.push_back(ExternalServerSpec("host1", 11211));
+  two_servers.servers.push_back(ExternalServerSpec("host2", 11211));
+  three_servers = two_servers;
+  three_servers.servers.push_back(ExternalServerSpec("host3", 11211));
+  scoped_ptr<MemcachedBinaryCache> two(
+      MakeCache(two_servers, kConnectionsPerServer));
+  scoped_ptr<MemcachedBinaryCache> three(
+      MakeCache(three_servers, kConnectionsPerServer));
+
+  std::vector<int> keys_per_server(3, 0);
+  for (int i = 0; i < kNumKeys; ++i) {
+    GoogleString key = StrCat("http://example.com/", IntegerToString(i));
+    int index = three->ServerIndexForKey(key);
+    ++keys_per_server[index];
+    if (index != 2) {
+      EXPECT_EQ(index, two->ServerIndexForKey(key)) << key;
+    }
+  }
+  for (int count : keys_per_server) {
+    EXPECT_LT(kNumKeys / 5, count);
+  }
+}
+
+class WorkerThread : public ThreadSystem::Thread {
+ public:
+  WorkerThread(CacheInterface* cache, int id, ThreadSystem* thread_system)
+      : Thread(thread_system, "memcached_worker", ThreadSystem::kJoinable),
+        thread_system_(thread_system),
+        cache_(cache),
+        id_(id),
+        hits_(0) {
+  }
+
+  int hits() const { return hits_; }
+
+ protected:
+  virtual void Run() {
+    for (int i = 0; i < 50; ++i) {
+      GoogleString key = StrCat(IntegerToString(id_), "-", IntegerToString(i));
+      cache_->Put(key, SharedString(key));
+      BlockingCallback callback(thread_system_);
+      cache_->Get(key, &callback);
+      callback.Block();
+      if ((callback.result() == CacheInterface::kAvailable) &&
+          (callback.value() == key)) {
+        ++hits_;
+      }
+    }
+  }
+
+ private:
+  ThreadSystem* thread_system_;
+  CacheInterface* cache_;
+  int id_;
+  int hits_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkerThread);
+};
+
+// Several threads share the connections, of which there are never more
+// than connections_per_server, and each reads its own writes.
+TEST_F(MemcachedBinaryCacheTest, ThreadsShareConnectionPool) {
+  const int kNumThreads = 6;
+  StartServersAndCache(1);
+  std::vector<WorkerThread*> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(
+        new WorkerThread(cache_.get(), i, thread_system_.get()));
+    ASSERT_TRUE(threads.back()->Start());
+  }
+  for (WorkerThread* thread : threads) {
+    thread->Join();
+    EXPECT_EQ(50, thread->hits());
+  }
+  STLDeleteElements(&threads);
+  EXPECT_LE(servers_[0]->connections_accepted(), kConnectionsPerServer);
+  EXPECT_EQ(kNumThreads * 50, servers_[0]->num_items());
+}
+
+// Get returns without waiting for the reply, so any number of lookups can
+// be in flight on one connection: against a server that never answers,
+// they all time out together.
+TEST_F(MemcachedBinaryCacheTest, GetsDoNotBlock) {
+  const int kNumGets = 10;
+  StartServersAndCache(1, 1);
+  EXPECT_FALSE(cache_->IsBlocking());
+  servers_[0]->set_unresponsive(true);
+  std::vector<Callback*> callbacks;
+  int64 start_us = timer_.NowUs();
+  for (int i = 0; i < kNumGets; ++i) {
+    callbacks.push_back(AddCallback());
+    cache_->Get(StrCat("key", IntegerToString(i)), callbacks.back());
+  }
+  EXPECT_GT(kTimeoutUs, timer_.NowUs() - start_us);
+  for (Callback* callback : callbacks) {
+    WaitAndCheckNotFound(callback);
+  }
+  EXPECT_EQ(1, servers_[0]->connections_accepted());
+  EXPECT_EQ(1, StatValue("memcached_binary_timeouts"));
+}
+
+TEST_F(MemcachedBinaryCacheTest, GetStatus) {
+  StartServersAndCache(2);
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");  // Makes sure the server has stored it.
+  GoogleString status;
+  EXPECT_TRUE(cache_->GetStatus(&status));
+  EXPECT_NE(GoogleString::npos, status.find(servers_[0]->spec().ToString()));
+  EXPECT_NE(GoogleString::npos, status.find(servers_[1]->spec().ToString()));
+  EXPECT_NE(GoogleString::npos, status.find("curr_items: 1"));
+}
+
+TEST_F(MemcachedBinaryCacheTest, Timeout) {
+  StartServersAndCache(1);
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  servers_[0]->set_unresponsive(true);
+  CheckNotFound("Name");
+  EXPECT_EQ(1, StatValue("memcached_binary_timeouts"));
+
+  // The timed-out connection was dropped, so once the server recovers the
+  // next Get succeeds on a fresh one.
+  servers_[0]->set_unresponsive(false);
+  CheckGet("Name", "Value");
+}
+
+// When the server is down each operation fails, until enough errors
+// accumulate to declare the cache unhealthy.
+TEST_F(MemcachedBinaryCacheTest, ServerDown) {
+  StartServersAndCache(1);
+  ExternalServerSpec spec = servers_[0]->spec();
+  STLDeleteElements(&servers_);
+  ExternalClusterSpec cluster;
+  cluster.servers.push_back(spec);
+  cache_.reset(MakeCache(cluster, kConnectionsPerServer));
+
+  for (int i = 0; i < MemcachedBinaryCache::kMaxErrorBurst; ++i) {
+    EXPECT_TRUE(cache_->IsHealthy());
+    CheckNotFound("Name");
+  }
+  EXPECT_FALSE(cache_->IsHealthy());
+}
+
+TEST_F(MemcachedBinaryCacheTest, ShutDown) {
+  StartServersAndCache(1);
+  CheckPut("Name", "Value");
+  cache_->ShutDown();
+  EXPECT_FALSE(cache_->IsHealthy());
+  CheckNotFound("Name");
+}
+
+}  // namespace net_instaweb
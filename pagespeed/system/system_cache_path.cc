@@ -37,6 +37,7 @@
 #include "pagespeed/kernel/cache/purge_set.h"
 #include "pagespeed/kernel/cache/threadsafe_cache.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_purge_log.h"
 #include "pagespeed/kernel/util/file_system_lock_manager.h"
 #include "pagespeed/system/system_rewrite_options.h"
 #include "pagespeed/system/system_server_context.h"
@@ -58,8 +59,10 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
       shm_runtime_(shm_runtime),
       lock_manager_(NULL),
       file_cache_backend_(NULL),
+      async_file_cache_backend_(NULL),
       lru_cache_(NULL),
       file_cache_(NULL),
+      async_file_cache_(NULL),
       cache_flush_filename_(config->cache_flush_filename()),
       unplugged_(config->unplugged()),
       enable_cache_purge_(config->enable_cache_purge()),
@@ -108,6 +111,12 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
     FallBackToFileBasedLocking();
   }
 
+  if (enable_cache_purge_ && !unplugged_) {
+    purge_log_.reset(new SharedMemPurgeLog(
+        shm_runtime, PurgeLogSegmentName(),
+        SharedMemPurgeLog::kDefaultCapacity, factory->message_handler()));
+  }
+
   FileCache::CachePolicy* policy = new FileCache::CachePolicy(
       factory->timer(),
       factory->hasher(),
@@ -179,6 +188,44 @@ void SystemCachePath::MergeConfig(const SystemRewriteOptions* config) {
                true, "InodeLimit",
                &policy->target_inode_count,
                &clean_inode_limit_explicitly_set_);
+  CopyCachePolicyToAsyncFileCache();
+}
+
+void SystemCachePath::EnableAsyncFileCache(AsyncFileSystem* async_file_system,
+                                           QueuedWorkerPool* callback_pool) {
+  if (unplugged_ || (async_file_cache_ != NULL)) {
+    return;
+  }
+
+  // Both FileCaches clean the same directory.  That is safe for the same
+  // reason several processes sharing it is: cleaning takes a lock file.
+  const FileCache::CachePolicy* policy = file_cache_backend_->cache_policy();
+  async_file_cache_backend_ = new FileCache(
+      file_cache_backend_->path(), factory_->file_system(),
+      factory_->thread_system(), file_cache_backend_->worker(),
+      new FileCache::CachePolicy(
+          factory_->timer(), factory_->hasher(), policy->clean_interval_ms,
+          policy->target_size_bytes, policy->target_inode_count),
+      factory_->statistics(), factory_->message_handler());
+  async_file_cache_backend_->set_async_file_system(async_file_system,
+                                                   callback_pool);
+  factory_->TakeOwnership(async_file_cache_backend_);
+  async_file_cache_ = new CacheStats(kFileCache, async_file_cache_backend_,
+                                     factory_->timer(),
+                                     factory_->statistics());
+  factory_->TakeOwnership(async_file_cache_);
+}
+
+void SystemCachePath::CopyCachePolicyToAsyncFileCache() {
+  if (async_file_cache_backend_ == NULL) {
+    return;
+  }
+  const FileCache::CachePolicy* policy = file_cache_backend_->cache_policy();
+  FileCache::CachePolicy* async_policy =
+      async_file_cache_backend_->mutable_cache_policy();
+  async_policy->clean_interval_ms = policy->clean_interval_ms;
+  async_policy->target_size_bytes = policy->target_size_bytes;
+  async_policy->target_inode_count = policy->target_inode_count;
 }
 
 void SystemCachePath::MergeEntries(int64 config_value, bool config_was_set,
@@ -221,6 +268,9 @@ void SystemCachePath::RootInit() {
       !shared_mem_lock_manager_->Initialize()) {
     FallBackToFileBasedLocking();
   }
+  if ((purge_log_.get() != NULL) && !purge_log_->Initialize()) {
+    purge_log_.reset(NULL);
+  }
 }
 
 void SystemCachePath::ChildInit(SlowWorker* cache_clean_worker) {
@@ -233,9 +283,15 @@ void SystemCachePath::ChildInit(SlowWorker* cache_clean_worker) {
       !shared_mem_lock_manager_->Attach()) {
     FallBackToFileBasedLocking();
   }
+  if ((purge_log_.get() != NULL) && !purge_log_->Attach()) {
+    purge_log_.reset(NULL);
+  }
   if (file_cache_backend_ != NULL) {
     file_cache_backend_->set_worker(cache_clean_worker);
   }
+  if (async_file_cache_backend_ != NULL) {
+    async_file_cache_backend_->set_worker(cache_clean_worker);
+  }
 
   purge_context_.reset(new PurgeContext(cache_flush_filename_,
                                         factory_->file_system(),
@@ -247,6 +303,7 @@ void SystemCachePath::ChildInit(SlowWorker* cache_clean_worker) {
                                         factory_->statistics(),
                                         factory_->message_handler()));
   purge_context_->set_enable_purge(enable_cache_purge_);
+  purge_context_->set_purge_log(purge_log_.get());
   purge_context_->SetUpdateCallback(NewPermanentCallback(
       this, &SystemCachePath::UpdateCachePurgeSet));
 }
@@ -256,6 +313,10 @@ void SystemCachePath::GlobalCleanup(MessageHandler* handler) {
     shared_mem_lock_manager_->GlobalCleanup(
         shm_runtime_, LockManagerSegmentName(), handler);
   }
+  if (purge_log_.get() != NULL) {
+    SharedMemPurgeLog::GlobalCleanup(shm_runtime_, PurgeLogSegmentName(),
+                                     handler);
+  }
 }
 
 void SystemCachePath::FallBackToFileBasedLocking() {
@@ -272,6 +333,10 @@ GoogleString SystemCachePath::LockManagerSegmentName() const {
   return StrCat(path_, "/named_locks");
 }
 
+GoogleString SystemCachePath::PurgeLogSegmentName() const {
+  return StrCat(path_, "/purge_log");
+}
+
 void SystemCachePath::FlushCacheIfNecessary() {
   if (!unplugged_) {
     purge_context_->PollFileSystem();
@@ -34,6 +34,7 @@ namespace net_instaweb {
 
 class AbstractMutex;
 class AbstractSharedMem;
+class AsyncFileSystem;
 class CacheInterface;
 class FileCache;
 class FileSystemLockManager;
@@ -41,8 +42,10 @@ class MessageHandler;
 class NamedLockManager;
 class PurgeContext;
 class PurgeSet;
+class QueuedWorkerPool;
 class RewriteDriverFactory;
 class SharedMemLockManager;
+class SharedMemPurgeLog;
 class SlowWorker;
 class SystemServerContext;
 class SystemRewriteOptions;
@@ -75,6 +78,18 @@ class SystemCachePath {
   // Access to backend for testing.  Do not use this directly in production
   // as it lacks statistics wrappers, etc.
   FileCache* file_cache_backend() { return file_cache_backend_; }
+
+  // Non-blocking view of the same file cache, with stats wrappers, or NULL
+  // unless EnableAsyncFileCache was called.  file_cache() stays blocking, as
+  // the property store requires.
+  CacheInterface* async_file_cache() { return async_file_cache_; }
+
+  // Creates async_file_cache(), whose Gets and Puts go through
+  // async_file_system, with their completions run on callback_pool.  Does
+  // nothing if it already exists, or if the cache is unplugged.
+  void EnableAsyncFileCache(AsyncFileSystem* async_file_system,
+                            QueuedWorkerPool* callback_pool);
+
   NamedLockManager* lock_manager() { return lock_manager_; }
 
   // See comments in SystemCaches for calling conventions on these.
@@ -106,7 +121,13 @@ class SystemCachePath {
   typedef std::set<SystemServerContext*> ServerContextSet;
 
   void FallBackToFileBasedLocking();
+
+  // Copies the cleaning policy of file_cache_backend_, which MergeConfig
+  // updates, to async_file_cache_backend_.
+  void CopyCachePolicyToAsyncFileCache();
+
   GoogleString LockManagerSegmentName() const;
+  GoogleString PurgeLogSegmentName() const;
 
   // Merge a value taken from a config file against the value already
   // initialized in a cache policy, reporting a Warning if they were
@@ -138,10 +159,15 @@ class SystemCachePath {
   AbstractSharedMem* shm_runtime_;
   scoped_ptr<SharedMemLockManager> shared_mem_lock_manager_;
   scoped_ptr<FileSystemLockManager> file_system_lock_manager_;
+  // Propagates cache purges between processes; NULL if purging is off or
+  // shared memory could not be set up, in which case we rely on the file.
+  scoped_ptr<SharedMemPurgeLog> purge_log_;
   NamedLockManager* lock_manager_;
   FileCache* file_cache_backend_;  // owned by file_cache_
+  FileCache* async_file_cache_backend_;  // owned by factory_
   CacheInterface* lru_cache_;
   CacheInterface* file_cache_;
+  CacheInterface* async_file_cache_;
   GoogleString cache_flush_filename_;
   bool unplugged_;
   bool enable_cache_purge_;
@@ -32,6 +32,7 @@
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/system/apr_mem_cache.h"
+#include "pagespeed/system/memcached_binary_cache.h"
 #include "pagespeed/system/redis_cache.h"
 #include "pagespeed/system/system_cache_path.h"
 #include "pagespeed/system/system_rewrite_options.h"
@@ -46,6 +47,7 @@
 #include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/cache/async_cache.h"
+#include "pagespeed/kernel/cache/blocking_cache.h"
 #include "pagespeed/kernel/cache/cache_batcher.h"
 #include "pagespeed/kernel/cache/cache_stats.h"
 #include "pagespeed/kernel/cache/compressed_cache.h"
@@ -55,9 +57,19 @@
 #include "pagespeed/kernel/cache/write_through_cache.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
+#include "pagespeed/kernel/thread/uring_file_system.h"
+#include "pagespeed/kernel/util/parallel_gzip.h"
 
 namespace net_instaweb {
 
+namespace {
+
+// Threads that run asynchronous file cache completions, which only copy
+// the value and call back into the caller.
+const int kFileCacheCallbackThreads = 4;
+
+}  // namespace
+
 const char SystemCaches::kMemcachedAsync[] = "memcached_async";
 const char SystemCaches::kMemcachedBlocking[] = "memcached_blocking";
 const char SystemCaches::kRedisAsync[] = "redis_async";
@@ -122,6 +134,20 @@ void SystemCaches::ShutDown(MessageHandler* message_handler) {
     redis_pool_->WaitForShutDownComplete();
     redis_pool_.reset(nullptr);
   }
+  // Let io_uring finish the file cache operations in flight, which hands their
+  // completions to file_cache_pool_, before stopping that pool.  Both stay
+  // around, as FileCaches still point at them; later operations block.
+  if (uring_file_system_.get() != NULL) {
+    uring_file_system_->ShutDown();
+  }
+  if (file_cache_pool_.get() != NULL) {
+    file_cache_pool_->ShutDown();
+  }
+  // HTTPCaches may still hold a pointer to parallel_gzip_, so stop its
+  // threads but keep it around; it compresses serially from now on.
+  if (parallel_gzip_.get() != NULL) {
+    parallel_gzip_->ShutDown();
+  }
 
   if (is_root_process_) {
     // Cleanup per-path shm resources.
@@ -155,6 +181,19 @@ SystemCachePath* SystemCaches::GetCache(SystemRewriteOptions* config) {
     system_cache_path = iter->second;
     system_cache_path->MergeConfig(config);
   }
+  int queue_depth = config->file_cache_async_queue_depth();
+  if ((queue_depth > 0) && !config->unplugged()) {
+    if (uring_file_system_.get() == NULL) {
+      // As with memcached_pool_, the first VirtualHost to ask for an
+      // asynchronous file cache decides the queue depth.
+      uring_file_system_.reset(
+          new UringFileSystem(queue_depth, factory_->thread_system()));
+      file_cache_pool_.reset(new QueuedWorkerPool(
+          kFileCacheCallbackThreads, "file_cache", factory_->thread_system()));
+    }
+    system_cache_path->EnableAsyncFileCache(uring_file_system_.get(),
+                                            file_cache_pool_.get());
+  }
   return system_cache_path;
 }
 
@@ -195,7 +234,13 @@ SystemCaches::ConstructExternalCacheInterfacesFromBlocking(
 
   // Populate the blocking interface, giving it its own
   // statistics wrapper.
-  result.blocking = new CacheStats(blocking_stats_name, backend,
+  CacheInterface* blocking_backend = backend;
+  if (!backend->IsBlocking()) {
+    DCHECK(pool == NULL);
+    blocking_backend = new BlockingCache(backend, factory_->thread_system());
+    factory_->TakeOwnership(blocking_backend);
+  }
+  result.blocking = new CacheStats(blocking_stats_name, blocking_backend,
                                    factory_->timer(), factory_->statistics());
   factory_->TakeOwnership(result.blocking);
   return result;
@@ -204,24 +249,26 @@ SystemCaches::ConstructExternalCacheInterfacesFromBlocking(
 SystemCaches::ExternalCacheInterfaces SystemCaches::NewMemcached(
     SystemRewriteOptions* config) {
   const ExternalClusterSpec& servers_specs = config->memcached_servers();
+  int num_threads = config->memcached_threads();
+  if (config->memcached_binary_protocol()) {
+    return NewMemcachedBinary(config);
+  }
   AprMemCache* mem_cache =
       new AprMemCache(servers_specs, thread_limit_, &cache_hasher_,
                       factory_->statistics(), factory_->timer(),
                       factory_->message_handler());
-  factory_->TakeOwnership(mem_cache);
   mem_cache->set_timeout_us(config->memcached_timeout_us());
   memcache_servers_.push_back(mem_cache);
+  if ((num_threads != 0) && (num_threads != 1)) {
+    factory_->message_handler()->Message(
+        kWarning, "ModPagespeedMemcachedThreads support for >1 thread "
+        "requires ModPagespeedMemcachedBinaryProtocol; changing to 1 "
+        "thread (was %d)", num_threads);
+    num_threads = 1;
+  }
+  factory_->TakeOwnership(mem_cache);
 
-  int num_threads = config->memcached_threads();
   if (num_threads != 0) {
-    if (num_threads != 1) {
-      factory_->message_handler()->Message(
-          kWarning, "ModPagespeedMemcachedThreads support for >1 thread "
-          "is not supported yet; changing to 1 thread (was %d)",
-          num_threads);
-      num_threads = 1;
-    }
-
     if (memcached_pool_.get() == NULL) {
       // Note -- we will use the first value of ModPagespeedMemCacheThreads
       // that we see in a VirtualHost, ignoring later ones.
@@ -241,6 +288,28 @@ SystemCaches::ExternalCacheInterfaces SystemCaches::NewMemcached(
   }
 }
 
+SystemCaches::ExternalCacheInterfaces SystemCaches::NewMemcachedBinary(
+    SystemRewriteOptions* config) {
+  // The binary-protocol client does its own I/O on a thread of its own, and
+  // multiplexes lookups from any number of threads onto its connections, so
+  // it needs no worker pool, and MemcachedThreads does not apply.
+  MemcachedBinaryCache* mem_cache = new MemcachedBinaryCache(
+      config->memcached_servers(), config->memcached_connections_per_server(),
+      &cache_hasher_, factory_->statistics(), factory_->timer(),
+      factory_->message_handler(), factory_->thread_system());
+  mem_cache->set_timeout_us(config->memcached_timeout_us());
+  factory_->TakeOwnership(mem_cache);
+  binary_memcache_servers_.push_back(mem_cache);
+
+  // Let the batcher keep every connection busy.
+  int max_parallel_lookups = config->memcached_servers().servers.size() *
+      config->memcached_connections_per_server();
+  return ConstructExternalCacheInterfacesFromBlocking(
+      mem_cache,
+      NULL,  // No worker pool.
+      max_parallel_lookups, kMemcachedAsync, kMemcachedBlocking);
+}
+
 SystemCaches::ExternalCacheInterfaces SystemCaches::NewRedis(
     SystemRewriteOptions* config) {
   const ExternalServerSpec& server_spec = config->redis_server();
@@ -295,9 +364,12 @@ SystemCaches::ExternalCacheInterfaces SystemCaches::NewExternalCache(
                IntegerToString(config->redis_timeout_us()), ";",
                IntegerToString(config->redis_ttl_sec()));
   } else if (use_memcached) {
-    spec_signature = StrCat("m;", config->memcached_servers().ToString(), ";",
-                            IntegerToString(config->memcached_threads()), ";",
-                            IntegerToString(config->memcached_timeout_us()));
+    spec_signature = StrCat(
+        "m;", config->memcached_servers().ToString(), ";",
+        IntegerToString(config->memcached_threads()), ";",
+        IntegerToString(config->memcached_timeout_us()), ";",
+        config->memcached_binary_protocol() ? "b" : "a", ";",
+        IntegerToString(config->memcached_connections_per_server()));
   } else {
     return ExternalCacheInterfaces();
   }
@@ -467,7 +539,14 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
   DCHECK(config != NULL);
   SystemCachePath* caches_for_path = GetCache(config);
   CacheInterface* lru_cache = caches_for_path->lru_cache();
-  CacheInterface* file_cache = caches_for_path->file_cache();
+  // The property store needs a blocking cache, so it keeps using the
+  // blocking file cache even when the HTTP and metadata caches read and
+  // write files asynchronously.
+  CacheInterface* blocking_file_cache = caches_for_path->file_cache();
+  CacheInterface* file_cache = caches_for_path->async_file_cache();
+  if (file_cache == NULL) {
+    file_cache = blocking_file_cache;
+  }
   MetadataShmCacheInfo* shm_metadata_cache_info =
       GetShmMetadataCacheOrDefault(config);
   CacheInterface* shm_metadata_cache = (shm_metadata_cache_info != NULL) ?
@@ -516,6 +595,19 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
   }
 
   http_cache->set_max_cacheable_response_content_length(max_content_length);
+  http_cache->set_chunk_size(config->http_cache_chunk_size());
+  http_cache->set_max_cacheable_chunked_content_length(
+      config->http_cache_max_chunked_content_length());
+  int compression_threads = config->http_cache_compression_threads();
+  if ((compression_threads > 0) && (http_cache->compression_level() != 0)) {
+    if (parallel_gzip_.get() == NULL) {
+      // As with memcached_pool_, the first VirtualHost to ask for a
+      // parallel compressor decides how many threads it gets.
+      parallel_gzip_.reset(
+          new ParallelGzip(compression_threads, factory_->thread_system()));
+    }
+    http_cache->set_parallel_gzip(parallel_gzip_.get());
+  }
   server_context->set_http_cache(http_cache);
 
   // And now the metadata cache. If we only have one level, it will be in
@@ -569,6 +661,17 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
       server_context->DeleteCacheOnDestruction(metadata_fallback);
       metadata_l2 = metadata_fallback;
 
+      if (file_cache != blocking_file_cache) {
+        FallbackCache* property_store_fallback =
+            new FallbackCache(
+                shm_metadata_cache, blocking_file_cache,
+                shm_metadata_cache_info->cache_backend->MaxValueSize(),
+                factory_->message_handler());
+        property_store_fallback->set_account_for_key_size(false);
+        server_context->DeleteCacheOnDestruction(property_store_fallback);
+        property_store_cache = property_store_fallback;
+      }
+
       // TODO(jmarantz): do we really want to use the shm-cache as a
       // pcache?  The potential for inconsistent data across a
       // multi-server setup seems like it could give confusing results.
@@ -577,6 +680,9 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
     l1_size_limit = config->lru_cache_byte_limit();
     metadata_l1 = lru_cache;  // may be NULL
     metadata_l2 = http_l2;  // external or file cache.
+    if (property_store_cache == NULL) {
+      property_store_cache = blocking_file_cache;
+    }
   }
 
   CacheInterface* metadata_cache;
@@ -721,6 +827,18 @@ void SystemCaches::ChildInit() {
     }
   }
 
+  // Unlike AprMemCache::Connect, this only fails when no servers are
+  // configured.  The cache then reports itself unhealthy, so every lookup
+  // misses, and there is no need to take the process down.
+  for (MemcachedBinaryCache* mem_cache : binary_memcache_servers_) {
+    if (!mem_cache->Connect()) {
+      factory_->message_handler()->Message(
+          kError, "Cannot start the memcached client for \"%s\"; "
+          "the binary-protocol memcached cache is disabled.",
+          mem_cache->cluster_spec().ToString().c_str());
+    }
+  }
+
   for (RedisCache* redis_cache : redis_servers_) {
     redis_cache->StartUp();
   }
@@ -748,6 +866,7 @@ void SystemCaches::StopCacheActivity() {
 
 void SystemCaches::InitStats(Statistics* statistics) {
   AprMemCache::InitStats(statistics);
+  MemcachedBinaryCache::InitStats(statistics);
   FileCache::InitStats(statistics);
   CacheStats::InitStats(SystemCachePath::kFileCache, statistics);
   CacheStats::InitStats(SystemCachePath::kLruCache, statistics);
@@ -786,6 +905,12 @@ void SystemCaches::PrintCacheStats(StatFlags flags, GoogleString* out) {
                   mem_cache->cluster_spec().ToString());
       }
     }
+    for (MemcachedBinaryCache* mem_cache : binary_memcache_servers_) {
+      if (!mem_cache->GetStatus(out)) {
+        StrAppend(out, "\nError getting memcached server status for ",
+                  mem_cache->cluster_spec().ToString());
+      }
+    }
   }
 
   if (flags & kIncludeRedis) {
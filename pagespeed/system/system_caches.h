@@ -39,13 +39,16 @@ namespace net_instaweb {
 
 class AbstractSharedMem;
 class AprMemCache;
+class MemcachedBinaryCache;
 class NamedLockManager;
+class ParallelGzip;
 class QueuedWorkerPool;
 class RewriteDriverFactory;
 class ServerContext;
 class SlowWorker;
 class Statistics;
 class SystemCachePath;
+class UringFileSystem;
 
 // Helps manage setup of cache backends provided by the PSOL library
 // (LRU, File, Memcached, and shared memory metadata), as well as named lock
@@ -173,6 +176,9 @@ class SystemCaches {
   // override the batcher's max_parallel_lookups. If you don't want to override
   // it, pass in -1.
   //
+  // The backend may instead be non-blocking, in which case pool must be NULL,
+  // and the blocking version waits for it with a BlockingCache.
+  //
   // Each cache is also wrapped in CacheStatistics with given name. All newly
   // created wrappers are owned by SystemCaches.
   ExternalCacheInterfaces ConstructExternalCacheInterfacesFromBlocking(
@@ -187,6 +193,7 @@ class SystemCaches {
   //
   // The corresponding external cache should be enabled in the config.
   ExternalCacheInterfaces NewMemcached(SystemRewriteOptions* config);
+  ExternalCacheInterfaces NewMemcachedBinary(SystemRewriteOptions* config);
   ExternalCacheInterfaces NewRedis(SystemRewriteOptions* config);
 
   // Either constructs a new external cache (memcached/redis) based on
@@ -239,12 +246,24 @@ class SystemCaches {
   scoped_ptr<QueuedWorkerPool> memcached_pool_;
   scoped_ptr<QueuedWorkerPool> redis_pool_;
 
-  // Explicit lists of AprMemCache/RedisCache instances are stored individually,
-  // as they require extra treatment during startup and shutdown.
+  // Reads and writes the HTTP and metadata file caches through io_uring, with
+  // each operation's completion run on its own Sequence from
+  // file_cache_pool_.  Both are NULL when FileCacheAsyncQueueDepth is 0.
+  scoped_ptr<UringFileSystem> uring_file_system_;
+  scoped_ptr<QueuedWorkerPool> file_cache_pool_;
+
+  // Compresses large HTTPCache values on multiple threads; shared by all
+  // vhosts' HTTPCaches.  NULL when HttpCacheCompressionThreads is 0.
+  scoped_ptr<ParallelGzip> parallel_gzip_;
+
+  // Explicit lists of AprMemCache/MemcachedBinaryCache/RedisCache instances
+  // are stored individually, as they require extra treatment during startup
+  // and shutdown.
   // TODO(yeputons): consider reducing to a single vector when these classes
   // have common base class. Potential problem: users may want to enable
   // statistics for only memcached or only Redis (see kIncludeMemcached flag).
   std::vector<AprMemCache*> memcache_servers_;
+  std::vector<MemcachedBinaryCache*> binary_memcache_servers_;
   std::vector<RedisCache*> redis_servers_;
 
   // As each external cache object typically holds a TCP connection, we do not
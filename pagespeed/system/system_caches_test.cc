@@ -42,6 +42,7 @@
 #include "net/instaweb/rewriter/public/test_rewrite_driver_factory.h"
 #include "pagespeed/system/admin_site.h"
 #include "pagespeed/system/apr_mem_cache.h"
+#include "pagespeed/system/memcached_binary_cache.h"
 #include "pagespeed/system/system_cache_path.h"
 #include "pagespeed/system/system_rewrite_options.h"
 #include "pagespeed/system/system_server_context.h"
@@ -66,6 +67,7 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/async_cache.h"
+#include "pagespeed/kernel/cache/blocking_cache.h"
 #include "pagespeed/kernel/cache/cache_batcher.h"
 #include "pagespeed/kernel/cache/cache_spammer.h"
 #include "pagespeed/kernel/cache/cache_stats.h"
@@ -323,6 +325,10 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
     return Stats("file_cache", FileCacheName());
   }
 
+  GoogleString AsyncFileCacheWithStats() {
+    return Stats("file_cache", FileCache::FormatAsyncName());
+  }
+
   GoogleString Pcache(StringPiece cache) {
     return CachePropertyStore::FormatName3(
         RewriteDriver::kBeaconCohort,
@@ -416,6 +422,54 @@ TEST_F(SystemCachesTest, BasicFileOnlyCache) {
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
 }
 
+TEST_F(SystemCachesTest, AsyncFileOnlyCache) {
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(0);
+  options_->set_default_shared_memory_cache_kb(0);
+  options_->set_file_cache_async_queue_depth(8);
+  PrepareWithConfig(options_.get());
+
+  scoped_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  EXPECT_STREQ(Compressed(AsyncFileCacheWithStats()),
+               server_context->metadata_cache()->Name());
+  EXPECT_STREQ(HttpCache(AsyncFileCacheWithStats()),
+               server_context->http_cache()->Name());
+  // The property store keeps reading the blocking file cache.
+  EXPECT_STREQ(Pcache(Compressed(FileCacheWithStats())),
+               server_context->page_property_cache()->property_store()->Name());
+  EXPECT_TRUE(server_context->pcache_cache_backend()->IsBlocking());
+  EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
+}
+
+TEST_F(SystemCachesTest, AsyncFileCacheAndShm) {
+  GoogleString error_msg;
+  EXPECT_TRUE(system_caches_->CreateShmMetadataCache(
+      kCachePath, kUsableMetadataCacheSize, &error_msg));
+
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(0);
+  options_->set_file_cache_async_queue_depth(8);
+  PrepareWithConfig(options_.get());
+
+  scoped_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  EXPECT_STREQ(Compressed(Fallback(Stats("shm_cache", "SharedMemCache<64>"),
+                                   AsyncFileCacheWithStats())),
+               server_context->metadata_cache()->Name());
+  EXPECT_STREQ(HttpCache(AsyncFileCacheWithStats()),
+               server_context->http_cache()->Name());
+  // The property store falls back to the blocking file cache instead.
+  EXPECT_STREQ(
+      Pcache(Compressed(Fallback(Stats("shm_cache", "SharedMemCache<64>"),
+                                 FileCacheWithStats()))),
+      server_context->page_property_cache()->property_store()->Name());
+  EXPECT_TRUE(server_context->pcache_cache_backend()->IsBlocking());
+  EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
+}
+
 TEST_F(SystemCachesTest, UnusableShmAndLru) {
   // Test that we properly fallback when we can't create the shm cache
   // due to too small a size given.
@@ -799,6 +853,38 @@ TEST_F(SystemCachesMemCacheTest, BasicMemCachedAndNoLru_2_Threads) {
   TestBasicMemCacheAndNoLru(2, 1);  // Clamp to 1.
 }
 
+// The binary-protocol client only connects on first use, so its cache
+// hierarchy can be checked without a memcached server.  Unlike AprMemCache
+// it is not limited to one thread.
+TEST_F(SystemCachesTest, BinaryMemCachedAndNoLru_2_Threads) {
+  ExternalClusterSpec cluster;
+  cluster.servers.push_back(ExternalServerSpec("localhost", 1));
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(0);
+  options_->set_memcached_servers(cluster);
+  options_->set_memcached_binary_protocol(true);
+  options_->set_memcached_threads(2);
+  options_->set_default_shared_memory_cache_kb(0);
+  PrepareWithConfig(options_.get());
+
+  scoped_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  // The binary-protocol client is non-blocking by itself, so MemcachedThreads
+  // is ignored, and the batcher sends one lookup per connection.
+  GoogleString mem_cache = Batcher(
+      Stats(SystemCaches::kMemcachedAsync, MemcachedBinaryCache::FormatName()),
+      2 /* MemcachedConnectionsPerServer */, 1000);
+  EXPECT_STREQ(Compressed(Fallback(mem_cache, FileCacheWithStats())),
+               server_context->metadata_cache()->Name());
+  EXPECT_STREQ(
+      Fallback(Stats(SystemCaches::kMemcachedBlocking,
+                     BlockingCache::FormatName(
+                         MemcachedBinaryCache::FormatName())),
+               FileCacheWithStats()),
+      server_context->filesystem_metadata_cache()->Name());
+}
+
 class SystemCachesRedisCacheTest : public SystemCachesExternalCacheTestBase {
  protected:
   // TODO(yeputons): share this code with SystemCachesMemCacheTest or move it to
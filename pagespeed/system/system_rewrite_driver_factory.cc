@@ -28,6 +28,7 @@
 #include <memory>
 #include <set>
 #include <utility>  // for pair
+#include <vector>
 
 #include "apr_general.h"
 #include "base/logging.h"
@@ -67,6 +68,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/image/codec_pool.h"
 #include "pagespeed/kernel/sharedmem/shared_circular_buffer.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
 #include "pagespeed/kernel/thread/pthread_shared_mem.h"
@@ -93,6 +95,46 @@ const char kMessageBufferSize[] = "MessageBufferSize";
 const char kTrackOriginalContentLength[] = "TrackOriginalContentLength";
 const char kCreateSharedMemoryMetadataCache[] =
     "CreateSharedMemoryMetadataCache";
+const char kRewriteThreadCpus[] = "RewriteThreadCpus";
+const char kExpensiveRewriteThreadCpus[] = "ExpensiveRewriteThreadCpus";
+const char kSharedMemoryNumaNodes[] = "SharedMemoryNumaNodes";
+const char kCombineFragmentCacheKb[] = "CombineFragmentCacheKb";
+const char kImageScratchPoolKb[] = "ImageScratchPoolKb";
+
+// Larger than any CPU or NUMA node number we expect to see; guards against
+// typos like "0-40000" expanding into huge lists.
+const int kMaxListedId = 4096;
+
+// Parses a list of CPU or NUMA node numbers in the style of taskset and
+// numactl, e.g. "0-3,8,10-11".  Duplicates are dropped and the result is
+// sorted.
+bool ParseIdList(StringPiece arg, std::vector<int>* ids) {
+  std::set<int> id_set;
+  StringPieceVector ranges;
+  SplitStringPieceToVector(arg, ",", &ranges, true /* omit_empty_strings */);
+  for (int i = 0, n = ranges.size(); i < n; ++i) {
+    StringPiece range = ranges[i];
+    TrimWhitespace(&range);
+    StringPieceVector bounds;
+    SplitStringPieceToVector(range, "-", &bounds, false);
+    int first = 0;
+    int last = 0;
+    if ((bounds.size() < 1) || (bounds.size() > 2) ||
+        !StringToInt(bounds[0].as_string(), &first) ||
+        !StringToInt(bounds.back().as_string(), &last) ||
+        (first < 0) || (last < first) || (last >= kMaxListedId)) {
+      return false;
+    }
+    for (int id = first; id <= last; ++id) {
+      id_set.insert(id);
+    }
+  }
+  if (id_set.empty()) {
+    return false;
+  }
+  ids->assign(id_set.begin(), id_set.end());
+  return true;
+}
 
 }  // namespace
 
@@ -240,12 +282,20 @@ QueuedWorkerPool* SystemRewriteDriverFactory::CreateWorkerPool(
     case kHtmlWorkers:
       // In Apache this will effectively be 0, as it doesn't use HTML threads.
       return new QueuedWorkerPool(1, name, thread_system());
-    case kRewriteWorkers:
-      return new QueuedWorkerPool(num_rewrite_threads_, name, thread_system());
-    case kLowPriorityRewriteWorkers:
-      return new QueuedWorkerPool(num_expensive_rewrite_threads_,
-                                  name,
-                                  thread_system());
+    case kRewriteWorkers: {
+      QueuedWorkerPool* pool =
+          new QueuedWorkerPool(num_rewrite_threads_, name, thread_system());
+      pool->set_cpu_affinity(rewrite_thread_cpus_);
+      return pool;
+    }
+    case kLowPriorityRewriteWorkers: {
+      QueuedWorkerPool* pool =
+          new QueuedWorkerPool(num_expensive_rewrite_threads_,
+                               name,
+                               thread_system());
+      pool->set_cpu_affinity(expensive_rewrite_thread_cpus_);
+      return pool;
+    }
     default:
       return RewriteDriverFactory::CreateWorkerPool(pool, name);
   }
@@ -415,7 +465,12 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
       StringCaseEqual(option, kUsePerVHostStatistics) ||
       StringCaseEqual(option, kInstallCrashHandler) ||
       StringCaseEqual(option, kNumRewriteThreads) ||
-      StringCaseEqual(option, kNumExpensiveRewriteThreads)) {
+      StringCaseEqual(option, kNumExpensiveRewriteThreads) ||
+      StringCaseEqual(option, kRewriteThreadCpus) ||
+      StringCaseEqual(option, kExpensiveRewriteThreadCpus) ||
+      StringCaseEqual(option, kSharedMemoryNumaNodes) ||
+      StringCaseEqual(option, kCombineFragmentCacheKb) ||
+      StringCaseEqual(option, kImageScratchPoolKb)) {
     if (!process_scope) {
       *msg = StrCat("'", option, "' is global and can't be set at this scope.");
       return RewriteOptions::kOptionValueInvalid;
@@ -443,6 +498,26 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
     return RewriteOptions::kOptionOk;
   }
 
+  // CPU and NUMA node lists, e.g. "0-3,8".
+  if (StringCaseEqual(option, kRewriteThreadCpus) ||
+      StringCaseEqual(option, kExpensiveRewriteThreadCpus) ||
+      StringCaseEqual(option, kSharedMemoryNumaNodes)) {
+    std::vector<int> ids;
+    if (!ParseIdList(arg, &ids)) {
+      *msg = "must be a list of numbers and ranges, such as 0-3,8";
+      return RewriteOptions::kOptionValueInvalid;
+    }
+    if (StringCaseEqual(option, kRewriteThreadCpus)) {
+      set_rewrite_thread_cpus(ids);
+    } else if (StringCaseEqual(option, kExpensiveRewriteThreadCpus)) {
+      set_expensive_rewrite_thread_cpus(ids);
+    } else if (!shared_mem_runtime_->SetNumaNodes(ids)) {
+      *msg = "NUMA placement is not supported for this shared memory";
+      return RewriteOptions::kOptionValueInvalid;
+    }
+    return RewriteOptions::kOptionOk;
+  }
+
   // Most of our options take booleans, so just parse once.
   bool is_on = false;
   RewriteOptions::OptionSettingResult parsed_as_bool =
@@ -470,6 +545,8 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   // Values of 0 have special meanings:
   //   Num(Expensive)RewriteThreads: autodetect (see AutoDetectThreadCounts())
   //   MessageBufferSize: disable the message buffer
+  //   CombineFragmentCacheKb: disable the combine fragment cache
+  //   ImageScratchPoolKb: don't keep idle image codec buffers
   int int_value = 0;
   RewriteOptions::OptionSettingResult parsed_as_int =
       RewriteOptions::ParseFromString(arg, &int_value) ?
@@ -483,6 +560,19 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   } else if (StringCaseEqual(option, kMessageBufferSize)) {
     set_message_buffer_size(int_value);
     return parsed_as_int;
+  } else if (StringCaseEqual(option, kCombineFragmentCacheKb)) {
+    if (int_value < 0) {
+      return RewriteOptions::kOptionValueInvalid;
+    }
+    set_combine_fragment_cache_bytes(static_cast<int64>(int_value) * 1024);
+    return parsed_as_int;
+  } else if (StringCaseEqual(option, kImageScratchPoolKb)) {
+    if (int_value < 0) {
+      return RewriteOptions::kOptionValueInvalid;
+    }
+    pagespeed::image_compression::ScratchPool::set_max_free_bytes(
+        static_cast<size_t>(int_value) * 1024);
+    return parsed_as_int;
   }
 
   LOG(FATAL) << "Unknown options should have been handled in scope checking.";
@@ -233,6 +233,21 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   void set_num_expensive_rewrite_threads(int x) {
     num_expensive_rewrite_threads_ = x;
   }
+
+  // CPUs the rewrite and expensive-rewrite worker threads are restricted to.
+  // Empty (the default) leaves them to the scheduler.
+  const std::vector<int>& rewrite_thread_cpus() const {
+    return rewrite_thread_cpus_;
+  }
+  void set_rewrite_thread_cpus(const std::vector<int>& x) {
+    rewrite_thread_cpus_ = x;
+  }
+  const std::vector<int>& expensive_rewrite_thread_cpus() const {
+    return expensive_rewrite_thread_cpus_;
+  }
+  void set_expensive_rewrite_thread_cpus(const std::vector<int>& x) {
+    expensive_rewrite_thread_cpus_ = x;
+  }
   bool use_per_vhost_statistics() const {
     return use_per_vhost_statistics_;
   }
@@ -417,6 +432,9 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   int num_rewrite_threads_;
   int num_expensive_rewrite_threads_;
 
+  std::vector<int> rewrite_thread_cpus_;
+  std::vector<int> expensive_rewrite_thread_cpus_;
+
   std::shared_ptr<CentralControllerRpcClient> central_controller_;
 
   DISALLOW_COPY_AND_ASSIGN(SystemRewriteDriverFactory);
@@ -38,6 +38,7 @@ namespace {
 const int64 kDefaultCacheFlushIntervalSec = 5;
 const int64 kDefaultRedisDatabaseIndex = 0;
 const int64 kDefaultRedisTTLSec = -1;
+const int kDefaultMemcachedConnectionsPerServer = 2;
 
 const char kFetchHttps[] = "FetchHttps";
 
@@ -45,11 +46,23 @@ const char kFetchHttps[] = "FetchHttps";
 
 const char SystemRewriteOptions::kCentralControllerPort[] =
     "ExperimentalCentralControllerPort";
+const char SystemRewriteOptions::kFileCacheAsyncQueueDepth[] =
+    "FileCacheAsyncQueueDepth";
 const char SystemRewriteOptions::kPopularityContestMaxInFlight[] =
     "ExperimentalPopularityContestMaxInFlight";
 const char SystemRewriteOptions::kPopularityContestMaxQueueSize[] =
     "ExperimentalPopularityContestMaxQueueSize";
+const char SystemRewriteOptions::kHttpCacheChunkSize[] =
+    "HttpCacheChunkSize";
+const char SystemRewriteOptions::kHttpCacheMaxChunkedContentLength[] =
+    "HttpCacheMaxChunkedContentLength";
+const char SystemRewriteOptions::kHttpCacheCompressionThreads[] =
+    "HttpCacheCompressionThreads";
 const char SystemRewriteOptions::kStaticAssetCDN[] = "StaticAssetCDN";
+const char SystemRewriteOptions::kMemcachedBinaryProtocol[] =
+    "MemcachedBinaryProtocol";
+const char SystemRewriteOptions::kMemcachedConnectionsPerServer[] =
+    "MemcachedConnectionsPerServer";
 const char SystemRewriteOptions::kRedisServer[] = "RedisServer";
 const char SystemRewriteOptions::kRedisReconnectionDelayMs[] =
     "RedisReconnectionDelayMs";
@@ -111,12 +124,24 @@ void SystemRewriteOptions::AddProperties() {
   AddSystemProperty(1, &SystemRewriteOptions::memcached_threads_, "amt",
                     RewriteOptions::kMemcachedThreads,
                     "Number of background threads to use to run "
-                        "memcached fetches", true);
+                        "memcached fetches; ignored by the binary-protocol "
+                        "client", true);
   AddSystemProperty(500 * Timer::kMsUs,  // half a second
                     &SystemRewriteOptions::memcached_timeout_us_, "amo",
                     RewriteOptions::kMemcachedTimeoutUs,
                     "Maximum time in microseconds to allow for memcached "
                         "transactions", true);
+  AddSystemProperty(false, &SystemRewriteOptions::memcached_binary_protocol_,
+                    "amb", SystemRewriteOptions::kMemcachedBinaryProtocol,
+                    "Talk to memcached with the native non-blocking "
+                        "binary-protocol client, which pipelines requests "
+                        "from all threads, instead of apr_memcache2", true);
+  AddSystemProperty(kDefaultMemcachedConnectionsPerServer,
+                    &SystemRewriteOptions::memcached_connections_per_server_,
+                    "amc", SystemRewriteOptions::kMemcachedConnectionsPerServer,
+                    "Number of connections the binary-protocol memcached "
+                        "client opens to each server, shared by all "
+                        "threads", true);
   AddSystemProperty(ExternalServerSpec(),
                     &SystemRewriteOptions::redis_server_, "rds",
                     SystemRewriteOptions::kRedisServer,
@@ -142,6 +167,25 @@ void SystemRewriteOptions::AddProperties() {
                     SystemRewriteOptions::kRedisTTLSec,
                     "Redis key TTL to use (seconds)",
                     true);
+  AddSystemProperty(0, &SystemRewriteOptions::http_cache_compression_threads_,
+                    "hcct", SystemRewriteOptions::kHttpCacheCompressionThreads,
+                    "Number of threads used to gzip large resources as they "
+                        "are written to the HTTPCache.  0 compresses on the "
+                        "writing thread.", true);
+  AddSystemProperty(0, &SystemRewriteOptions::http_cache_chunk_size_,
+                    "hccs", SystemRewriteOptions::kHttpCacheChunkSize,
+                    "Resources larger than this many bytes are stored in the "
+                        "HTTPCache as separate values of at most this size.  "
+                        "0 stores every resource as a single value.", true);
+  AddSystemProperty(256 * 1024 * 1024,  // 256MB
+                    &SystemRewriteOptions::
+                        http_cache_max_chunked_content_length_,
+                    "hcmc",
+                    SystemRewriteOptions::kHttpCacheMaxChunkedContentLength,
+                    "When HttpCacheChunkSize is positive, resources larger "
+                        "than MaxCacheableContentLength are still cached, in "
+                        "chunks, up to this many bytes.  -1 means no limit.",
+                    true);
   AddSystemProperty(50 * Timer::kMsUs,  // 50 ms
                     &SystemRewriteOptions::slow_file_latency_threshold_us_,
                     "asflt", "SlowFileLatencyUs",
@@ -194,6 +238,11 @@ void SystemRewriteOptions::AddProperties() {
                     "afcl", RewriteOptions::kFileCacheCleanInodeLimit,
                     "Set the target number of inodes for the file cache; 0 "
                         "means no limit", true);
+  AddSystemProperty(0, &SystemRewriteOptions::file_cache_async_queue_depth_,
+                    "fcaq", SystemRewriteOptions::kFileCacheAsyncQueueDepth,
+                    "Number of HTTP and metadata file cache reads and writes "
+                        "kept in flight through io_uring.  0 reads and writes "
+                        "the file cache on the calling thread.", true);
   AddSystemProperty(0, &SystemRewriteOptions::lru_cache_byte_limit_, "alcb",
                     RewriteOptions::kLruCacheByteLimit,
                     "Set the maximum byte size entry to store in the "
@@ -46,6 +46,12 @@ class SystemRewriteOptions : public RewriteOptions {
   typedef std::set<StaticAssetEnum::StaticAsset> StaticAssetSet;
 
   static const char kCentralControllerPort[];
+  static const char kFileCacheAsyncQueueDepth[];
+  static const char kHttpCacheChunkSize[];
+  static const char kHttpCacheMaxChunkedContentLength[];
+  static const char kHttpCacheCompressionThreads[];
+  static const char kMemcachedBinaryProtocol[];
+  static const char kMemcachedConnectionsPerServer[];
   static const char kPopularityContestMaxInFlight[];
   static const char kPopularityContestMaxQueueSize[];
   static const char kStaticAssetCDN[];
@@ -101,6 +107,12 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_file_cache_clean_inode_limit(int64 x) {
     set_option(x, &file_cache_clean_inode_limit_);
   }
+  int file_cache_async_queue_depth() const {
+    return file_cache_async_queue_depth_.value();
+  }
+  void set_file_cache_async_queue_depth(int x) {
+    set_option(x, &file_cache_async_queue_depth_);
+  }
   int64 lru_cache_byte_limit() const {
     return lru_cache_byte_limit_.value();
   }
@@ -181,6 +193,18 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_memcached_timeout_us(int x) {
     set_option(x, &memcached_timeout_us_);
   }
+  bool memcached_binary_protocol() const {
+    return memcached_binary_protocol_.value();
+  }
+  void set_memcached_binary_protocol(bool x) {
+    set_option(x, &memcached_binary_protocol_);
+  }
+  int memcached_connections_per_server() const {
+    return memcached_connections_per_server_.value();
+  }
+  void set_memcached_connections_per_server(int x) {
+    set_option(x, &memcached_connections_per_server_);
+  }
   const ExternalServerSpec& redis_server() const {
     return redis_server_.value();
   }
@@ -202,6 +226,24 @@ class SystemRewriteOptions : public RewriteOptions {
   int redis_ttl_sec() const {
     return redis_ttl_sec_.value();
   }
+  int http_cache_compression_threads() const {
+    return http_cache_compression_threads_.value();
+  }
+  void set_http_cache_compression_threads(int x) {
+    set_option(x, &http_cache_compression_threads_);
+  }
+  int64 http_cache_chunk_size() const {
+    return http_cache_chunk_size_.value();
+  }
+  void set_http_cache_chunk_size(int64 x) {
+    set_option(x, &http_cache_chunk_size_);
+  }
+  int64 http_cache_max_chunked_content_length() const {
+    return http_cache_max_chunked_content_length_.value();
+  }
+  void set_http_cache_max_chunked_content_length(int64 x) {
+    set_option(x, &http_cache_max_chunked_content_length_);
+  }
   bool has_redis_ttl_sec() const {
     return redis_ttl_sec_.was_set();
   }
@@ -515,13 +557,19 @@ class SystemRewriteOptions : public RewriteOptions {
 
   Option<int> memcached_threads_;
   Option<int> memcached_timeout_us_;
+  Option<bool> memcached_binary_protocol_;
+  Option<int> memcached_connections_per_server_;
   Option<int64> redis_reconnection_delay_ms_;
   Option<int64> redis_timeout_us_;
   Option<int> redis_database_index_;
   Option<int> redis_ttl_sec_;
+  Option<int> http_cache_compression_threads_;
+  Option<int64> http_cache_chunk_size_;
+  Option<int64> http_cache_max_chunked_content_length_;
 
   Option<int64> slow_file_latency_threshold_us_;
   Option<int64> file_cache_clean_inode_limit_;
+  Option<int> file_cache_async_queue_depth_;
   Option<int64> file_cache_clean_interval_ms_;
   Option<int64> file_cache_clean_size_kb_;
   Option<int64> lru_cache_byte_limit_;